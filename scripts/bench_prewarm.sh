@@ -0,0 +1,80 @@
+#!/bin/bash
+#
+# bench_prewarm.sh — First-boot time of a legacy runtime with and without prewarm
+#
+# Rosetta keeps its translations per macOS build, so right after a macOS
+# update every legacy runtime boots cold exactly once. This takes two
+# runtimes that haven't booted on this build yet, prewarms one, leaves the
+# other cold, then boots a fresh device on each --boots times with
+# `rosettasim-ctl boot --measure`. The first boot of each is the comparison;
+# the later ones are the warm floor a prewarm can at best reach.
+#
+# Prerequisites:
+#   - rosettasim_daemon running
+#   - tools built: make -C src && make -C src prewarm
+#   - neither runtime booted since the last macOS update
+#
+# Usage:
+#   ./scripts/bench_prewarm.sh --cold=9.3 --prewarm=10.3 [--boots=3] [--device="iPhone 6s"]
+
+set -uo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_ROOT="$(cd "$SCRIPT_DIR/.." && pwd)"
+CTL="$PROJECT_ROOT/src/build/rosettasim-ctl"
+HISTORY="$HOME/Library/Caches/RosettaSim/boot_history.jsonl"
+
+COLD="" WARM="" BOOTS=3 DEVICE="iPhone 6s"
+for arg in "$@"; do
+    case "$arg" in
+        --cold=*)    COLD="${arg#*=}" ;;
+        --prewarm=*) WARM="${arg#*=}" ;;
+        --boots=*)   BOOTS="${arg#*=}" ;;
+        --device=*)  DEVICE="${arg#*=}" ;;
+        *) echo "Unknown option: $arg" >&2; exit 1 ;;
+    esac
+done
+if [[ -z "$COLD" || -z "$WARM" || "$COLD" == "$WARM" ]]; then
+    echo "Usage: $0 --cold=<version> --prewarm=<version> [--boots=N] [--device=NAME]" >&2
+    exit 1
+fi
+[[ -x "$CTL" ]] || { echo "rosettasim-ctl not built (make -C src)" >&2; exit 1; }
+
+log() { echo "[bench] $*"; }
+
+# 9.3 -> com.apple.CoreSimulator.SimRuntime.iOS-9-3
+runtime_id() {
+    xcrun simctl list runtimes 2>/dev/null | grep -E "^iOS $1 " | sed 's/.*- //' | head -1
+}
+
+OS_BUILD=$(sysctl -n kern.osversion)
+for v in "$COLD" "$WARM"; do
+    RT=$(runtime_id "$v")
+    [[ -n "$RT" ]] || { echo "iOS $v runtime not installed" >&2; exit 1; }
+    # A measured boot on this build means the runtime is already translated
+    if [[ -f "$HISTORY" ]] && grep "\"runtime\":\"$RT\"" "$HISTORY" | grep -q "\"os_build\":\"$OS_BUILD\""; then
+        echo "iOS $v has already booted on macOS $OS_BUILD; its first boot can't be measured again" >&2
+        echo "until the next macOS update. Pick a runtime that hasn't booted since." >&2
+        exit 1
+    fi
+done
+
+log "Prewarming iOS $WARM (iOS $COLD stays cold)..."
+"$CTL" prewarm "$WARM" || { echo "prewarm failed" >&2; exit 1; }
+
+for v in "$COLD" "$WARM"; do
+    RT=$(runtime_id "$v")
+    UDID=$(xcrun simctl create "bench-prewarm-$v" "$DEVICE" "$RT" 2>/dev/null)
+    [[ -n "$UDID" ]] || { echo "Couldn't create a $DEVICE on iOS $v" >&2; exit 1; }
+    log "iOS $v: $BOOTS boot(s) of $DEVICE ($UDID)"
+    for i in $(seq 1 "$BOOTS"); do
+        "$CTL" boot "$UDID" --measure | grep -E "^Boot timing" | sed "s/^/[bench]   #$i /"
+        "$CTL" shutdown "$UDID" > /dev/null
+        sleep 2
+    done
+    xcrun simctl delete "$UDID" 2>/dev/null || true
+done
+
+log ""
+"$CTL" prewarm "$COLD" --report
+"$CTL" prewarm "$WARM" --report | tail -n +2
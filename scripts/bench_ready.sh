@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# bench_ready.sh — Daemon time to ready for 1, 10 and 50 shut-down devices
+#
+# The daemon prepares every shut-down legacy device in parallel at launch and
+# logs a "Ready:" line with the time to ready and its phases. This creates
+# throwaway devices on one legacy runtime, starts the daemon --runs times for
+# each count, with surfaces on first message (the default) and with --eager,
+# and prints the Ready: lines. Legacy devices that already exist are shut
+# down devices too, so they add to every count; the Ready: line says how many
+# were registered.
+#
+# Prerequisites:
+#   - daemon built: make -C src
+#   - no rosettasim_daemon running (this starts its own)
+#
+# Usage:
+#   ./scripts/bench_ready.sh --runtime=9.3 [--counts=1,10,50] [--runs=3] [--device="iPhone 6s"]
+
+set -uo pipefail
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_ROOT="$(cd "$SCRIPT_DIR/.." && pwd)"
+DAEMON="$PROJECT_ROOT/src/build/rosettasim_daemon"
+
+VERSION="" COUNTS="1,10,50" RUNS=3 DEVICE="iPhone 6s"
+for arg in "$@"; do
+    case "$arg" in
+        --runtime=*) VERSION="${arg#*=}" ;;
+        --counts=*)  COUNTS="${arg#*=}" ;;
+        --runs=*)    RUNS="${arg#*=}" ;;
+        --device=*)  DEVICE="${arg#*=}" ;;
+        *) echo "Unknown option: $arg" >&2; exit 1 ;;
+    esac
+done
+if [[ -z "$VERSION" ]]; then
+    echo "Usage: $0 --runtime=<version> [--counts=1,10,50] [--runs=N] [--device=NAME]" >&2
+    exit 1
+fi
+[[ -x "$DAEMON" ]] || { echo "rosettasim_daemon not built (make -C src)" >&2; exit 1; }
+if pgrep -f rosettasim_daemon >/dev/null 2>&1; then
+    echo "rosettasim_daemon is already running; stop it first" >&2
+    exit 1
+fi
+
+log() { echo "[bench] $*"; }
+
+RT=$(xcrun simctl list runtimes 2>/dev/null | grep -E "^iOS $VERSION " | sed 's/.*- //' | head -1)
+[[ -n "$RT" ]] || { echo "iOS $VERSION runtime not installed" >&2; exit 1; }
+
+CREATED=()
+cleanup() {
+    pkill -f rosettasim_daemon 2>/dev/null || true
+    for udid in "${CREATED[@]}"; do xcrun simctl delete "$udid" 2>/dev/null || true; done
+}
+trap cleanup EXIT
+
+# Start the daemon, wait for its Ready: line, stop it
+ready_line() {
+    local out
+    out=$(mktemp /tmp/rosettasim_bench_ready.XXXXXX)
+    "$DAEMON" "$@" > "$out" 2>&1 &
+    local pid=$!
+    for _ in $(seq 1 300); do
+        grep -q "Ready:" "$out" && break
+        kill -0 "$pid" 2>/dev/null || break
+        sleep 0.2
+    done
+    kill "$pid" 2>/dev/null
+    wait "$pid" 2>/dev/null
+    grep -o "Ready:.*" "$out" || echo "no Ready: line (see $out)"
+    grep -q "Ready:" "$out" && rm -f "$out"
+}
+
+IFS=, read -ra WANT <<< "$COUNTS"
+for n in "${WANT[@]}"; do
+    while (( ${#CREATED[@]} < n )); do
+        udid=$(xcrun simctl create "bench-ready-${#CREATED[@]}" "$DEVICE" "$RT" 2>/dev/null)
+        [[ -n "$udid" ]] || { echo "Couldn't create a $DEVICE on iOS $VERSION" >&2; exit 1; }
+        CREATED+=("$udid")
+    done
+    log "$n device(s) created on iOS $VERSION"
+    for mode in "" "--eager"; do
+        for i in $(seq 1 "$RUNS"); do
+            echo "[bench]   ${mode:-lazy} #$i $(ready_line $mode)"
+        done
+    done
+done
@@ -221,6 +221,22 @@ cmd_patch_all() {
     done
 }
 
+# =============================================================================
+# Runtime tree copies through the content store (src/build/rosettasim_dedup)
+# =============================================================================
+
+# copy_tree SRC DEST — like `cp -R SRC/ DEST/`, but files whose contents are
+# already in the store (another runtime) are cloned instead of copied.
+copy_tree() {
+    local DEDUP="$PROJECT_ROOT/src/build/rosettasim_dedup"
+    if [ -x "$DEDUP" ]; then
+        "$DEDUP" "$1" "$2" && return 0
+        warn "rosettasim_dedup failed for $(basename "$1"), falling back to cp -R"
+    fi
+    mkdir -p "$2"
+    cp -R "$1"/ "$2"/
+}
+
 # =============================================================================
 # Generate plists for runtimes that don't ship with them (iOS 7.x, 8.x)
 # =============================================================================
@@ -352,17 +368,25 @@ patch_runtime_binaries() {
     local MAJOR
     MAJOR=$(echo "$VERSION" | cut -d. -f1)
 
-    # --- SimFramebufferClient stub (iOS 12+) ---
-    # Prevents backboardd ud2 trap from SimFramebufferClient framework
+    # --- SimFramebufferClient replacement (iOS 12+) ---
+    # Prevents backboardd ud2 trap from SimFramebufferClient framework.
+    # iOS 13+: prefer the daemon-backed client (double-buffered IOSurfaces,
+    # no per-flush copy); it falls back to PurpleFB if the daemon doesn't answer.
     local SFB_STUB="$PROJECT_ROOT/src/build/SimFramebufferClient"
+    local SFB_CLIENT="$PROJECT_ROOT/src/build/SimFramebufferClient_rosettasim"
     local SFB_FW="$RTROOT/System/Library/PrivateFrameworks/SimFramebufferClient.framework"
-    if [ -f "$SFB_STUB" ] && [ -d "$SFB_FW" ] && [ "$MAJOR" -ge 12 ]; then
+    local SFB_SRC="$SFB_STUB" SFB_KIND="stub"
+    if [ -f "$SFB_CLIENT" ] && [ "$MAJOR" -ge 13 ]; then
+        SFB_SRC="$SFB_CLIENT"
+        SFB_KIND="daemon client"
+    fi
+    if [ -f "$SFB_SRC" ] && [ -d "$SFB_FW" ] && [ "$MAJOR" -ge 12 ]; then
         if [ ! -f "$SFB_FW/SimFramebufferClient.orig" ]; then
             cp "$SFB_FW/SimFramebufferClient" "$SFB_FW/SimFramebufferClient.orig" 2>/dev/null || true
         fi
-        cp "$SFB_STUB" "$SFB_FW/SimFramebufferClient"
+        cp "$SFB_SRC" "$SFB_FW/SimFramebufferClient"
         codesign --force --sign - "$SFB_FW/SimFramebufferClient" 2>/dev/null
-        log "Deployed SimFramebufferClient stub (iOS $VERSION)"
+        log "Deployed SimFramebufferClient $SFB_KIND (iOS $VERSION)"
     fi
 
     # --- App installer dylib (all legacy runtimes) ---
@@ -535,7 +559,7 @@ install_from_xcode() {
         # Xcode has a proper .simruntime bundle — copy it directly
         log "Found pre-built simruntime in Xcode: $(basename "$EXISTING_RUNTIME")"
         rm -rf "$RUNTIME_DIR"
-        cp -R "$EXISTING_RUNTIME" "$RUNTIME_DIR"
+        copy_tree "$EXISTING_RUNTIME" "$RUNTIME_DIR"
     else
         # Build runtime from SDK directory
         log "Building simruntime from SDK..."
@@ -544,7 +568,7 @@ install_from_xcode() {
 
         # Copy the SDK contents as RuntimeRoot
         log "Copying RuntimeRoot (this may take a moment)..."
-        cp -R "$SIM_SDK"/ "$RUNTIME_DIR/Contents/Resources/RuntimeRoot/"
+        copy_tree "$SIM_SDK" "$RUNTIME_DIR/Contents/Resources/RuntimeRoot"
 
         # Generate Info.plist
         generate_info_plist "$VERSION" "$RUNTIME_DIR"
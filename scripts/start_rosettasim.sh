@@ -61,7 +61,7 @@ if $STOP; then
     fi
     pkill -f rosettasim_daemon 2>/dev/null || true
     xcrun simctl shutdown all 2>/dev/null || true
-    rm -f /tmp/rosettasim_*.json /tmp/rosettasim_fb_*.raw /tmp/sim_framebuffer.raw
+    rm -f /tmp/rosettasim_*.json /tmp/rosettasim_fb_*.fb /tmp/sim_framebuffer.raw
     echo "Done."
     exit 0
 fi
@@ -125,7 +125,7 @@ if $CLEAN; then
     xcrun simctl shutdown all 2>/dev/null || true
     pkill -f rosettasim_daemon 2>/dev/null || true
     pkill -x Simulator 2>/dev/null || true
-    rm -f /tmp/rosettasim_*.json /tmp/rosettasim_fb_*.raw /tmp/sim_framebuffer.raw
+    rm -f /tmp/rosettasim_*.json /tmp/rosettasim_fb_*.fb /tmp/sim_framebuffer.raw
     sleep 2
     echo "  All simulators shut down."
 fi
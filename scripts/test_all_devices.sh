@@ -128,7 +128,7 @@ while IFS= read -r RUNTIME_LINE; do
         log "  Waiting ${FLUSH_WAIT}s for rendering..."
         sleep "$FLUSH_WAIT"
 
-        FB_FILE="/tmp/rosettasim_fb_${UDID}.raw"
+        FB_FILE="/tmp/rosettasim_fb_${UDID}.fb"
         FB_SHARED="/tmp/sim_framebuffer.raw"
         FB=""
         [[ -f "$FB_FILE" ]] && FB="$FB_FILE"
@@ -137,10 +137,11 @@ while IFS= read -r RUNTIME_LINE; do
         if [[ -n "$FB" ]]; then
             FB_SIZE=$(wc -c < "$FB" 2>/dev/null || echo 0)
             # Count non-zero pixels (sample every 16th)
+            # Per-device frame files carry a one-page header (RSFB v2)
             NZ=$(python3 -c "
 d=open('$FB','rb').read()
-w,h=750,1334
-nz=sum(1 for i in range(0,len(d),64) if d[i]|d[i+1]|d[i+2])
+if d[:4]==b'RSFB': d=d[4096:]
+nz=sum(1 for i in range(0,len(d)-3,64) if d[i]|d[i+1]|d[i+2])
 print(nz)" 2>/dev/null || echo 0)
             log "  FB: ${FB_SIZE}B, ~${NZ} non-zero (sampled)"
             if [[ "$FB_SIZE" -gt 100000 ]]; then
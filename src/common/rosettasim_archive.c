@@ -0,0 +1,393 @@
+/*
+ * rosettasim_archive.c — Parallel deflate into a capped zip (see rosettasim_archive.h)
+ */
+
+#include "rosettasim_archive.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define ZIP_LOCAL_HEADER        30
+#define ZIP_CENTRAL_HEADER      46
+#define ZIP_END_RECORD          22
+#define ZIP_LIMIT               0xFFFFFFFFLL
+#define MANIFEST_RESERVE        (64 * 1024)     /* kept free for MANIFEST.txt */
+#define QUEUE_PER_JOB           4               /* add_* blocks beyond this */
+
+struct RSimArchiveJob {
+    RSimArchiveJob *next;
+    char            name[256];
+    char           *path;           /* file to read, or NULL for data */
+    long long       max_bytes;
+    unsigned char  *data;
+    size_t          len;
+    time_t          mtime;
+};
+
+const char *rsim_archive_status_name(RSimArchiveStatus status) {
+    switch (status) {
+    case RSIM_ARCHIVE_STORED:    return "stored";
+    case RSIM_ARCHIVE_TRUNCATED: return "truncated";
+    case RSIM_ARCHIVE_SKIPPED:   return "skipped";
+    case RSIM_ARCHIVE_FAILED:    return "failed";
+    }
+    return "?";
+}
+
+/* ================================================================
+ * Zip records
+ * ================================================================ */
+
+static unsigned char *put16(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);
+    return p + 2;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16); p[3] = (unsigned char)(v >> 24);
+    return p + 4;
+}
+
+static void dos_datetime(time_t t, uint16_t *dtime, uint16_t *ddate) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    if (tm.tm_year < 80) tm = (struct tm){ .tm_year = 80, .tm_mday = 1 };
+    *dtime = (uint16_t)(tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2);
+    *ddate = (uint16_t)((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday);
+}
+
+/* Fields shared by the local and the central header, from "version needed" on */
+static unsigned char *put_common(unsigned char *p, const RSimArchiveItem *it, size_t name_len) {
+    p = put16(p, 20);                   /* version needed: deflate */
+    p = put16(p, 1 << 11);              /* names are UTF-8 */
+    p = put16(p, it->method);
+    p = put16(p, it->dos_time);
+    p = put16(p, it->dos_date);
+    p = put32(p, it->crc);
+    p = put32(p, (uint32_t)it->packed);
+    p = put32(p, (uint32_t)it->size);
+    p = put16(p, (uint32_t)name_len);
+    return put16(p, 0);                 /* extra field length */
+}
+
+/* ================================================================
+ * Workers
+ * ================================================================ */
+
+/* Whole file, or its last max_bytes. Returns 0, or -1 with note set. */
+static int load_file(RSimArchiveJob *job, RSimArchiveItem *it) {
+    int fd = open(job->path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        snprintf(it->note, sizeof(it->note), "%s", strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        snprintf(it->note, sizeof(it->note), "not a regular file");
+        close(fd);
+        return -1;
+    }
+    off_t from = 0;
+    if (job->max_bytes > 0 && st.st_size > job->max_bytes) {
+        from = st.st_size - job->max_bytes;
+        it->status = RSIM_ARCHIVE_TRUNCATED;
+    }
+    size_t len = (size_t)(st.st_size - from), got = 0;
+    job->data = malloc(len ? len : 1);
+    while (job->data && got < len) {
+        ssize_t n = pread(fd, job->data + got, len - got, from + (off_t)got);
+        if (n <= 0) break;              /* shrank under us: keep what was read */
+        got += (size_t)n;
+    }
+    close(fd);
+    if (!job->data) {
+        snprintf(it->note, sizeof(it->note), "out of memory");
+        return -1;
+    }
+    job->len = got;
+    job->mtime = st.st_mtime;
+    return 0;
+}
+
+/* Raw deflate; stored instead when that doesn't shrink it. */
+static unsigned char *pack(const unsigned char *data, size_t len, int level, RSimArchiveItem *it) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+    size_t bound = deflateBound(&zs, (uLong)len);
+    unsigned char *out = malloc(bound ? bound : 1);
+    if (out) {
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = (uInt)len;
+        zs.next_out = out;
+        zs.avail_out = (uInt)bound;
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+            free(out);
+            out = NULL;
+        }
+    }
+    deflateEnd(&zs);
+    if (!out) return NULL;
+    it->crc = (uint32_t)crc32(crc32(0, Z_NULL, 0), data, (uInt)len);
+    it->size = (long long)len;
+    if (zs.total_out >= len) {
+        memcpy(out, data, len);
+        it->method = 0;
+        it->packed = (long long)len;
+    } else {
+        it->method = 8;
+        it->packed = (long long)zs.total_out;
+    }
+    return out;
+}
+
+/* Append one entry (or record why not). Called with the lock held. */
+static void append(RSimArchive *a, RSimArchiveItem *it, const unsigned char *packed) {
+    size_t name_len = strlen(it->name);
+    if (it->status != RSIM_ARCHIVE_FAILED) {
+        long long need = ZIP_LOCAL_HEADER + (long long)name_len + it->packed;
+        long long keep = a->central + ZIP_CENTRAL_HEADER + (long long)name_len +
+                         MANIFEST_RESERVE + ZIP_END_RECORD;
+        if (a->written + need + keep > a->cap) {
+            it->status = RSIM_ARCHIVE_SKIPPED;
+        } else {
+            unsigned char hdr[ZIP_LOCAL_HEADER];
+            it->offset = (uint32_t)a->written;
+            put_common(put32(hdr, 0x04034b50), it, name_len);
+            if (fwrite(hdr, 1, sizeof(hdr), a->out) != sizeof(hdr) ||
+                fwrite(it->name, 1, name_len, a->out) != name_len ||
+                fwrite(packed, 1, (size_t)it->packed, a->out) != (size_t)it->packed)
+                a->write_error = errno ? errno : EIO;
+            a->written += need;
+            a->central += ZIP_CENTRAL_HEADER + (long long)name_len;
+        }
+    }
+    if (a->count == a->capacity) {
+        size_t cap = a->capacity ? a->capacity * 2 : 256;
+        RSimArchiveItem *grown = realloc(a->items, cap * sizeof(*grown));
+        if (!grown) return;             /* entry still written; only its manifest line is lost */
+        a->items = grown;
+        a->capacity = cap;
+    }
+    a->items[a->count++] = *it;
+}
+
+static void process(RSimArchive *a, RSimArchiveJob *job) {
+    RSimArchiveItem it;
+    memset(&it, 0, sizeof(it));
+    snprintf(it.name, sizeof(it.name), "%s", job->name);
+    it.status = RSIM_ARCHIVE_STORED;
+
+    unsigned char *packed = NULL;
+    if (job->path && load_file(job, &it) != 0) {
+        it.status = RSIM_ARCHIVE_FAILED;
+    } else if (!(packed = pack(job->data, job->len, a->level, &it))) {
+        it.status = RSIM_ARCHIVE_FAILED;
+        snprintf(it.note, sizeof(it.note), "deflate failed");
+    }
+    if (it.status != RSIM_ARCHIVE_FAILED) dos_datetime(job->mtime, &it.dos_time, &it.dos_date);
+    free(job->data);
+
+    pthread_mutex_lock(&a->lock);
+    append(a, &it, packed);
+    pthread_mutex_unlock(&a->lock);
+    free(packed);
+    free(job->path);
+    free(job);
+}
+
+static void *worker(void *arg) {
+    RSimArchive *a = arg;
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        while (!a->head && !a->closing) pthread_cond_wait(&a->work, &a->lock);
+        RSimArchiveJob *job = a->head;
+        if (!job) {
+            pthread_mutex_unlock(&a->lock);
+            return NULL;
+        }
+        a->head = job->next;
+        if (!a->head) a->tail = NULL;
+        a->queued--;
+        pthread_cond_signal(&a->room);
+        pthread_mutex_unlock(&a->lock);
+        process(a, job);
+    }
+}
+
+/* ================================================================
+ * Public API
+ * ================================================================ */
+
+int rsim_archive_open(RSimArchive *a, const char *path, int jobs, long long cap, int level,
+                      char *err, size_t err_size) {
+    memset(a, 0, sizeof(*a));
+    clock_gettime(CLOCK_MONOTONIC, &a->start);
+    a->cap = cap > 0 && cap < ZIP_LIMIT ? cap : ZIP_LIMIT;
+    if (a->cap < MANIFEST_RESERVE + ZIP_END_RECORD + 1024) {
+        snprintf(err, err_size, "size cap too small (at least %d KB)", MANIFEST_RESERVE / 1024 + 2);
+        return -1;
+    }
+    a->level = level;
+    a->out = fopen(path, "wb");
+    if (!a->out) {
+        snprintf(err, err_size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->work, NULL);
+    pthread_cond_init(&a->room, NULL);
+    if (jobs < 1) jobs = 1;
+    if (jobs > RSIM_ARCHIVE_MAX_JOBS) jobs = RSIM_ARCHIVE_MAX_JOBS;
+    for (a->jobs = 0; a->jobs < jobs; a->jobs++)
+        if (pthread_create(&a->threads[a->jobs], NULL, worker, a) != 0) break;
+    if (a->jobs == 0) {
+        snprintf(err, err_size, "can't start compression threads");
+        fclose(a->out);
+        return -1;
+    }
+    return 0;
+}
+
+static int enqueue(RSimArchive *a, RSimArchiveJob *job) {
+    pthread_mutex_lock(&a->lock);
+    while (a->queued >= (size_t)a->jobs * QUEUE_PER_JOB) pthread_cond_wait(&a->room, &a->lock);
+    if (a->tail) a->tail->next = job;
+    else a->head = job;
+    a->tail = job;
+    a->queued++;
+    pthread_cond_signal(&a->work);
+    pthread_mutex_unlock(&a->lock);
+    return 0;
+}
+
+int rsim_archive_add_file(RSimArchive *a, const char *name, const char *path, long long max_bytes) {
+    RSimArchiveJob *job = calloc(1, sizeof(*job));
+    if (!job || !(job->path = strdup(path))) {
+        free(job);
+        return -1;
+    }
+    snprintf(job->name, sizeof(job->name), "%s", name);
+    job->max_bytes = max_bytes;
+    return enqueue(a, job);
+}
+
+int rsim_archive_add_data(RSimArchive *a, const char *name, void *data, size_t len, time_t mtime) {
+    RSimArchiveJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        free(data);
+        return -1;
+    }
+    snprintf(job->name, sizeof(job->name), "%s", name);
+    job->data = data;
+    job->len = len;
+    job->mtime = mtime;
+    return enqueue(a, job);
+}
+
+/* One line per entry, in archive order */
+static char *manifest_text(const RSimArchive *a, size_t *len) {
+    size_t cap = 256 + a->count * 400, n = 0;
+    char *text = malloc(cap);
+    if (!text) return NULL;
+    n += (size_t)snprintf(text + n, cap - n, "%-9s %12s %12s  %s\n", "status", "bytes", "archived", "name");
+    for (size_t i = 0; i < a->count; i++) {
+        const RSimArchiveItem *it = &a->items[i];
+        int w = snprintf(text + n, cap - n, "%-9s %12lld %12lld  %s%s%s\n", rsim_archive_status_name(it->status),
+                         it->size, it->status <= RSIM_ARCHIVE_TRUNCATED ? it->packed : 0LL, it->name,
+                         it->note[0] ? "  — " : "", it->note);
+        if (w < 0 || (size_t)w >= cap - n) break;
+        n += (size_t)w;
+    }
+    *len = n;
+    return text;
+}
+
+int rsim_archive_close(RSimArchive *a, RSimArchiveStats *stats) {
+    pthread_mutex_lock(&a->lock);
+    a->closing = 1;
+    pthread_cond_broadcast(&a->work);
+    pthread_mutex_unlock(&a->lock);
+    for (int i = 0; i < a->jobs; i++) pthread_join(a->threads[i], NULL);
+
+    /* Manifest, into the room every append kept free for it */
+    size_t len = 0;
+    char *text = manifest_text(a, &len);
+    if (text) {
+        RSimArchiveItem it;
+        memset(&it, 0, sizeof(it));
+        snprintf(it.name, sizeof(it.name), RSIM_ARCHIVE_MANIFEST);
+        unsigned char *packed = pack((unsigned char *)text, len, a->level, &it);
+        dos_datetime(time(NULL), &it.dos_time, &it.dos_date);
+        if (packed) {
+            a->cap += MANIFEST_RESERVE;     /* this is what it was for */
+            append(a, &it, packed);
+            a->cap -= MANIFEST_RESERVE;
+        }
+        free(packed);
+        free(text);
+    }
+
+    /* Central directory */
+    long long central_start = a->written;
+    memset(stats, 0, sizeof(*stats));
+    size_t in_zip = 0;
+    for (size_t i = 0; i < a->count; i++) {
+        RSimArchiveItem *it = &a->items[i];
+        int manifest = i == a->count - 1 && strcmp(it->name, RSIM_ARCHIVE_MANIFEST) == 0;
+        if (!manifest) {
+            stats->entries++;
+            if (it->status == RSIM_ARCHIVE_STORED) stats->stored++;
+            else if (it->status == RSIM_ARCHIVE_TRUNCATED) stats->truncated++;
+            else if (it->status == RSIM_ARCHIVE_SKIPPED) stats->skipped++;
+            else stats->failed++;
+        }
+        if (it->status > RSIM_ARCHIVE_TRUNCATED) continue;
+        if (!manifest) stats->bytes_in += it->size;
+        size_t name_len = strlen(it->name);
+        unsigned char hdr[ZIP_CENTRAL_HEADER], *p = hdr;
+        p = put32(p, 0x02014b50);
+        p = put16(p, 3 << 8 | 20);                  /* made by: Unix, zip 2.0 */
+        p = put_common(p, it, name_len);
+        p = put16(p, 0);                            /* comment length */
+        p = put16(p, 0);                            /* disk number */
+        p = put16(p, 0);                            /* internal attributes */
+        p = put32(p, (uint32_t)0100644 << 16);      /* external: regular file, rw-r--r-- */
+        put32(p, it->offset);
+        if (fwrite(hdr, 1, sizeof(hdr), a->out) != sizeof(hdr) ||
+            fwrite(it->name, 1, name_len, a->out) != name_len)
+            a->write_error = EIO;
+        a->written += ZIP_CENTRAL_HEADER + (long long)name_len;
+        in_zip++;
+    }
+    unsigned char end[ZIP_END_RECORD], *p = end;
+    p = put32(p, 0x06054b50);
+    p = put16(p, 0);
+    p = put16(p, 0);
+    p = put16(p, (uint32_t)(in_zip > 0xFFFF ? 0xFFFF : in_zip));
+    p = put16(p, (uint32_t)(in_zip > 0xFFFF ? 0xFFFF : in_zip));
+    p = put32(p, (uint32_t)(a->written - central_start));
+    p = put32(p, (uint32_t)central_start);
+    put16(p, 0);
+    if (fwrite(end, 1, sizeof(end), a->out) != sizeof(end)) a->write_error = EIO;
+    a->written += ZIP_END_RECORD;
+    if (fclose(a->out) != 0) a->write_error = EIO;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats->bytes_out = a->written;
+    stats->ms = (now.tv_sec - a->start.tv_sec) * 1000.0 + (now.tv_nsec - a->start.tv_nsec) / 1e6;
+
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->work);
+    pthread_cond_destroy(&a->room);
+    free(a->items);
+    return a->write_error ? -1 : 0;
+}
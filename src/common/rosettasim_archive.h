@@ -0,0 +1,100 @@
+/*
+ * rosettasim_archive.h — Streaming, size-capped zip writer (portable C)
+ *
+ * `rosettasim-ctl diagnose` gathers its artifacts on several threads and
+ * hands each one over as soon as it has it. Worker threads read and
+ * deflate (zlib, raw deflate) the entries in parallel, and each finished
+ * entry is appended to the zip under a lock, in completion order, so
+ * collecting, compressing and writing overlap:
+ *
+ *   add_file / add_data --queue--> workers: read, deflate, crc32 --> out.zip
+ *
+ * The archive never exceeds cap bytes. An entry that no longer fits is
+ * skipped (room for the central directory and the manifest is always
+ * kept), and files can be limited to their last max_bytes: for logs the
+ * tail is what matters. MANIFEST.txt, written last, lists every entry
+ * with its status, so a capped archive says what it is missing.
+ *
+ * Plain zip (no zip64): cap is at most 4 GB. Used by rosettasim-ctl; no
+ * Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_ARCHIVE_H
+#define ROSETTASIM_ARCHIVE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define RSIM_ARCHIVE_MAX_JOBS       32
+#define RSIM_ARCHIVE_MANIFEST       "MANIFEST.txt"
+
+typedef enum {
+    RSIM_ARCHIVE_STORED,            /* whole file in the archive */
+    RSIM_ARCHIVE_TRUNCATED,         /* only its last max_bytes */
+    RSIM_ARCHIVE_SKIPPED,           /* would have gone over the cap */
+    RSIM_ARCHIVE_FAILED,            /* couldn't be read or compressed */
+} RSimArchiveStatus;
+
+typedef struct {
+    char                name[256];  /* path inside the archive */
+    RSimArchiveStatus   status;
+    long long           size;       /* bytes before compression */
+    long long           packed;     /* bytes in the archive */
+    char                note[96];   /* why it failed */
+    /* central directory fields */
+    uint32_t            crc, offset;
+    uint16_t            method, dos_time, dos_date;
+} RSimArchiveItem;
+
+typedef struct RSimArchiveJob RSimArchiveJob;
+
+typedef struct {
+    /* private */
+    FILE               *out;
+    long long           cap;
+    int                 level;
+    long long           written;        /* bytes of local headers + data so far */
+    long long           central;        /* bytes the central directory will take */
+    RSimArchiveItem    *items;
+    size_t              count, capacity;
+    RSimArchiveJob     *head, *tail;    /* queued, not yet picked up */
+    size_t              queued;
+    int                 closing;
+    int                 write_error;
+    pthread_mutex_t     lock;
+    pthread_cond_t      work, room;
+    pthread_t           threads[RSIM_ARCHIVE_MAX_JOBS];
+    int                 jobs;
+    struct timespec     start;
+} RSimArchive;
+
+typedef struct {
+    size_t      entries, stored, truncated, skipped, failed;
+    long long   bytes_in;           /* of the entries stored or truncated */
+    long long   bytes_out;          /* size of the archive */
+    double      ms;
+} RSimArchiveStats;
+
+/* Create path and start jobs compression threads. cap 0 means the zip
+ * limit; level is the zlib level (1 fast .. 9 small). Returns 0, or -1
+ * with a message in err. */
+int  rsim_archive_open(RSimArchive *a, const char *path, int jobs, long long cap, int level,
+                       char *err, size_t err_size);
+
+/* Queue a file; with max_bytes > 0 only its last max_bytes are kept. Blocks
+ * while the workers are far behind. Safe to call from several threads. */
+int  rsim_archive_add_file(RSimArchive *a, const char *name, const char *path, long long max_bytes);
+
+/* Queue bytes already in memory; takes ownership of data (malloc'd) */
+int  rsim_archive_add_data(RSimArchive *a, const char *name, void *data, size_t len, time_t mtime);
+
+/* Wait for the queue to drain, write the manifest and central directory,
+ * close the file. Returns 0, or -1 if writing the archive failed. */
+int  rsim_archive_close(RSimArchive *a, RSimArchiveStats *stats);
+
+const char *rsim_archive_status_name(RSimArchiveStatus status);
+
+#endif /* ROSETTASIM_ARCHIVE_H */
@@ -0,0 +1,534 @@
+/*
+ * rosettasim_dedup.c — Content-addressed tree copies for runtime installs
+ *
+ * See rosettasim_dedup.h for the store layout.
+ */
+
+#include "rosettasim_dedup.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+
+#define OBJECT_MODE     0444
+
+/* ================================================================
+ * SHA-256 (FIPS 180-4)
+ * ================================================================ */
+
+typedef struct {
+    uint32_t        h[8];
+    uint64_t        length;
+    unsigned char   block[64];
+    size_t          used;
+} Sha256;
+
+static const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t ror(uint32_t v, int n) { return v >> n | v << (32 - n); }
+
+static void sha256_block(Sha256 *s, const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3];
+    uint32_t e = s->h[4], f = s->h[5], g = s->h[6], h = s->h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + kK[i] + w[i];
+        uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    s->h[0] += a; s->h[1] += b; s->h[2] += c; s->h[3] += d;
+    s->h[4] += e; s->h[5] += f; s->h[6] += g; s->h[7] += h;
+}
+
+static void sha256_init(Sha256 *s) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(s->h, init, sizeof(init));
+    s->length = 0;
+    s->used = 0;
+}
+
+static void sha256_update(Sha256 *s, const unsigned char *p, size_t len) {
+    s->length += len;
+    if (s->used) {
+        size_t take = 64 - s->used < len ? 64 - s->used : len;
+        memcpy(s->block + s->used, p, take);
+        s->used += take;
+        p += take;
+        len -= take;
+        if (s->used < 64) return;
+        sha256_block(s, s->block);
+        s->used = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64) sha256_block(s, p);
+    memcpy(s->block, p, len);
+    s->used = len;
+}
+
+static void sha256_final(Sha256 *s, unsigned char out[32]) {
+    uint64_t bits = s->length * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t padlen = (s->used < 56 ? 56 : 120) - s->used;
+    for (int i = 0; i < 8; i++) pad[padlen + i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(s, pad, padlen + 8);
+    for (int i = 0; i < 8; i++) {
+        out[i * 4] = (unsigned char)(s->h[i] >> 24);
+        out[i * 4 + 1] = (unsigned char)(s->h[i] >> 16);
+        out[i * 4 + 2] = (unsigned char)(s->h[i] >> 8);
+        out[i * 4 + 3] = (unsigned char)s->h[i];
+    }
+}
+
+void rsim_dedup_hex(const unsigned char digest[32], char out[65]) {
+    static const char kHex[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++) {
+        out[i * 2] = kHex[digest[i] >> 4];
+        out[i * 2 + 1] = kHex[digest[i] & 15];
+    }
+    out[64] = 0;
+}
+
+/* ================================================================
+ * Worker pool: fn(ctx, i) for i in [0, count) on up to jobs threads
+ * ================================================================ */
+
+typedef void (*PoolFn)(void *ctx, size_t i);
+
+typedef struct {
+    PoolFn          fn;
+    void           *ctx;
+    size_t          count;
+    size_t          next;
+    pthread_mutex_t lock;
+} Pool;
+
+static void *pool_worker(void *arg) {
+    Pool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) return NULL;
+        pool->fn(pool->ctx, i);
+    }
+}
+
+static void run_pool(int jobs, size_t count, PoolFn fn, void *ctx) {
+    Pool pool = { fn, ctx, count, 0, PTHREAD_MUTEX_INITIALIZER };
+    if (jobs < 1) jobs = 4;
+    if ((size_t)jobs > count) jobs = (int)count;
+    pthread_t threads[64];
+    if (jobs > 64) jobs = 64;
+    int started = 0;
+    for (int i = 0; i < jobs; i++)
+        if (pthread_create(&threads[started], NULL, pool_worker, &pool) == 0) started++;
+    if (!started) pool_worker(&pool);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* ================================================================
+ * Scan
+ * ================================================================ */
+
+static RSimDedupEntry *add_entry(RSimDedupTree *tree, const char *rel, RSimDedupType type,
+                                 const struct stat *st) {
+    if (tree->count == tree->capacity) {
+        size_t cap = tree->capacity ? tree->capacity * 2 : 1024;
+        RSimDedupEntry *grown = realloc(tree->entries, cap * sizeof(*grown));
+        if (!grown) return NULL;
+        tree->entries = grown;
+        tree->capacity = cap;
+    }
+    RSimDedupEntry *e = &tree->entries[tree->count++];
+    memset(e, 0, sizeof(*e));
+    e->rel = strdup(rel);
+    e->type = type;
+    e->mode = st->st_mode & 07777;
+    e->size = type == RSIM_DEDUP_FILE ? (long long)st->st_size : 0;
+    return e;
+}
+
+/* Depth-first, so every directory comes before what it contains */
+static int walk(RSimDedupTree *tree, const char *rel, char *err, size_t err_size) {
+    char path[2048];
+    snprintf(path, sizeof(path), "%s%s%s", tree->root, rel[0] ? "/" : "", rel);
+    DIR *dir = opendir(path);
+    if (!dir) {
+        snprintf(err, err_size, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    struct dirent *de;
+    int rc = 0;
+    while (rc == 0 && (de = readdir(dir))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        char child[2048], full[3200];
+        snprintf(child, sizeof(child), "%s%s%s", rel, rel[0] ? "/" : "", de->d_name);
+        snprintf(full, sizeof(full), "%s/%s", tree->root, child);
+        struct stat st;
+        if (lstat(full, &st) != 0) {
+            snprintf(err, err_size, "%s: %s", full, strerror(errno));
+            rc = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            rc = add_entry(tree, child, RSIM_DEDUP_DIR, &st) ? walk(tree, child, err, err_size) : -1;
+        } else if (S_ISREG(st.st_mode)) {
+            if (!add_entry(tree, child, RSIM_DEDUP_FILE, &st)) rc = -1;
+        } else if (S_ISLNK(st.st_mode)) {
+            char target[2048];
+            ssize_t n = readlink(full, target, sizeof(target) - 1);
+            RSimDedupEntry *e = n >= 0 ? add_entry(tree, child, RSIM_DEDUP_SYMLINK, &st) : NULL;
+            if (e) {
+                target[n] = 0;
+                e->target = strdup(target);
+            } else {
+                rc = -1;
+            }
+        }
+        /* Sockets, FIFOs and devices have no place in a runtime; skipped */
+    }
+    closedir(dir);
+    return rc;
+}
+
+typedef struct {
+    RSimDedupTree  *tree;
+    size_t         *files;          /* indices of file entries */
+} HashCtx;
+
+static void hash_one(void *arg, size_t i) {
+    HashCtx *ctx = arg;
+    RSimDedupEntry *e = &ctx->tree->entries[ctx->files[i]];
+    char path[2048];
+    snprintf(path, sizeof(path), "%s/%s", ctx->tree->root, e->rel);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        e->failed = 1;
+        return;
+    }
+    Sha256 s;
+    sha256_init(&s);
+    unsigned char *buf = malloc(1 << 20);
+    ssize_t n = buf ? 0 : -1;
+    while (buf && (n = read(fd, buf, 1 << 20)) > 0) sha256_update(&s, buf, (size_t)n);
+    free(buf);
+    close(fd);
+    if (n < 0) e->failed = 1;
+    else sha256_final(&s, e->digest);
+}
+
+/* By digest, then position in the tree */
+static int cmp_files(const void *a, const void *b) {
+    const RSimDedupEntry *x = *(RSimDedupEntry *const *)a, *y = *(RSimDedupEntry *const *)b;
+    int c = memcmp(x->digest, y->digest, 32);
+    return c ? c : (x < y ? -1 : x > y);
+}
+
+int rsim_dedup_scan(RSimDedupTree *tree, const char *root, int jobs, RSimDedupStats *stats,
+                    char *err, size_t err_size) {
+    memset(tree, 0, sizeof(*tree));
+    snprintf(tree->root, sizeof(tree->root), "%s", root);
+    size_t len = strlen(tree->root);
+    while (len > 1 && tree->root[len - 1] == '/') tree->root[--len] = 0;
+
+    double t0 = now_ms();
+    struct stat st;
+    if (stat(tree->root, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        snprintf(err, err_size, "%s: not a directory", tree->root);
+        return -1;
+    }
+    if (!add_entry(tree, "", RSIM_DEDUP_DIR, &st) || walk(tree, "", err, err_size) != 0) return -1;
+
+    size_t nfiles = 0;
+    size_t *files = malloc((tree->count + 1) * sizeof(*files));
+    if (!files) {
+        snprintf(err, err_size, "out of memory");
+        return -1;
+    }
+    for (size_t i = 0; i < tree->count; i++)
+        if (tree->entries[i].type == RSIM_DEDUP_FILE) files[nfiles++] = i;
+    HashCtx ctx = { tree, files };
+    run_pool(jobs, nfiles, hash_one, &ctx);
+
+    /* Mark the first file of each content; it is the one that feeds the store */
+    RSimDedupEntry **sorted = malloc((nfiles + 1) * sizeof(*sorted));
+    if (!sorted) {
+        free(files);
+        snprintf(err, err_size, "out of memory");
+        return -1;
+    }
+    for (size_t k = 0; k < nfiles; k++) sorted[k] = &tree->entries[files[k]];
+    qsort(sorted, nfiles, sizeof(*sorted), cmp_files);
+
+    memset(stats, 0, sizeof(*stats));
+    int failed = 0;
+    for (size_t k = 0; k < nfiles; k++) {
+        RSimDedupEntry *e = sorted[k];
+        if (e->failed) {
+            if (!failed++) snprintf(err, err_size, "can't read %s/%s", tree->root, e->rel);
+            continue;
+        }
+        e->primary = k == 0 || sorted[k - 1]->failed || memcmp(e->digest, sorted[k - 1]->digest, 32) != 0;
+        stats->bytes += e->size;
+        if (e->primary) {
+            stats->unique++;
+            stats->bytes_unique += e->size;
+        }
+    }
+    free(sorted);
+    free(files);
+    for (size_t i = 0; i < tree->count; i++) {
+        stats->files += tree->entries[i].type == RSIM_DEDUP_FILE;
+        stats->dirs += tree->entries[i].type == RSIM_DEDUP_DIR;
+        stats->symlinks += tree->entries[i].type == RSIM_DEDUP_SYMLINK;
+    }
+    stats->scan_ms = now_ms() - t0;
+    return failed ? -1 : 0;
+}
+
+/* ================================================================
+ * Store + materialize
+ * ================================================================ */
+
+static void mkdirs(const char *dir) {
+    char path[2048];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    mkdir(path, 0755);
+}
+
+static int copy_data(const char *src, const char *dst, mode_t mode) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(dst, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode | 0200);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    char buf[1 << 16];
+    ssize_t n;
+    int ok = 1;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+        if (write(out, buf, (size_t)n) != n) { ok = 0; break; }
+    if (n < 0) ok = 0;
+    close(in);
+    if (fchmod(out, mode) != 0 || close(out) != 0) ok = 0;
+    if (!ok) unlink(dst);
+    return ok ? 0 : -1;
+}
+
+typedef enum { PLACED_CLONE, PLACED_LINK, PLACED_COPY, PLACED_FAILED } Placed;
+
+/* Put src at dst (which must not exist): clone, else copy */
+static Placed place(const char *src, const char *dst, mode_t mode) {
+#ifdef __APPLE__
+    if (clonefile(src, dst, CLONE_NOFOLLOW) == 0) return chmod(dst, mode) == 0 ? PLACED_CLONE : PLACED_FAILED;
+#endif
+    return copy_data(src, dst, mode) == 0 ? PLACED_COPY : PLACED_FAILED;
+}
+
+/* Hard link to a variant of the object that has the wanted mode (a link
+ * can't have a mode of its own): the object itself for OBJECT_MODE, else
+ * <object>.<mode>, made on first use. *made is set when that cost a copy. */
+static int link_object(const char *obj, const char *dst, mode_t mode, size_t i, int *made) {
+    char variant[2300], tmp[2400];
+    *made = 0;
+    if ((mode & 07777) == OBJECT_MODE) return link(obj, dst);
+    snprintf(variant, sizeof(variant), "%s.%o", obj, (unsigned)mode);
+    if (access(variant, F_OK) != 0) {
+        snprintf(tmp, sizeof(tmp), "%s.%ld.%zu.tmp", variant, (long)getpid(), i);
+        unlink(tmp);
+        if (copy_data(obj, tmp, mode) != 0) return -1;
+        if (rename(tmp, variant) != 0) {
+            unlink(tmp);
+            return -1;
+        }
+        *made = 1;
+    }
+    return link(variant, dst);
+}
+
+typedef struct {
+    RSimDedupTree      *tree;
+    const char         *store;
+    const char         *dest;
+    int                 allow_link;
+    RSimDedupStats     *stats;
+    pthread_mutex_t     lock;
+    size_t             *files;
+} PlaceCtx;
+
+static void object_path(const char *store, const unsigned char digest[32], char *out, size_t size) {
+    char hex[65];
+    rsim_dedup_hex(digest, hex);
+    snprintf(out, size, "%s/objects/%.2s/%s", store, hex, hex + 2);
+}
+
+/* Primaries: make sure the store has the content */
+static void ingest_one(void *arg, size_t i) {
+    PlaceCtx *ctx = arg;
+    RSimDedupEntry *e = &ctx->tree->entries[ctx->files[i]];
+    if (!e->primary) return;
+    char obj[2200], tmp[2300], src[2048];
+    object_path(ctx->store, e->digest, obj, sizeof(obj));
+    if (access(obj, F_OK) == 0) return;
+
+    snprintf(src, sizeof(src), "%s/%s", ctx->tree->root, e->rel);
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%zu.tmp", obj, (long)getpid(), i);
+    char *slash = strrchr(obj, '/');
+    *slash = 0;
+    mkdirs(obj);
+    *slash = '/';
+    unlink(tmp);
+    int ok = place(src, tmp, OBJECT_MODE) != PLACED_FAILED && rename(tmp, obj) == 0;
+    if (!ok) {
+        unlink(tmp);
+        e->failed = 1;
+        return;
+    }
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stats->bytes_new += e->size;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void place_one(void *arg, size_t i) {
+    PlaceCtx *ctx = arg;
+    RSimDedupEntry *e = &ctx->tree->entries[ctx->files[i]];
+    char obj[2200], dst[3200];
+    object_path(ctx->store, e->digest, obj, sizeof(obj));
+    snprintf(dst, sizeof(dst), "%s/%s", ctx->dest, e->rel);
+    unlink(dst);
+    Placed how = PLACED_FAILED;
+    int variant = 0;
+    if (!e->failed && access(obj, F_OK) == 0) {
+#ifdef __APPLE__
+        if (clonefile(obj, dst, CLONE_NOFOLLOW) == 0)
+            how = chmod(dst, e->mode) == 0 ? PLACED_CLONE : PLACED_FAILED;
+        else
+#endif
+        if (ctx->allow_link && link_object(obj, dst, e->mode, i, &variant) == 0)
+            how = PLACED_LINK;
+        else
+            how = copy_data(obj, dst, e->mode) == 0 ? PLACED_COPY : PLACED_FAILED;
+    }
+    pthread_mutex_lock(&ctx->lock);
+    switch (how) {
+    case PLACED_CLONE:  ctx->stats->cloned++; break;
+    case PLACED_LINK:   ctx->stats->linked++; ctx->stats->bytes_new += variant ? e->size : 0; break;
+    case PLACED_COPY:   ctx->stats->copied++; ctx->stats->bytes_copied += e->size; break;
+    case PLACED_FAILED: ctx->stats->failed++; e->failed = 1; break;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+int rsim_dedup_materialize(RSimDedupTree *tree, const char *store, const char *dest,
+                           int jobs, int allow_link, RSimDedupStats *stats) {
+    double t0 = now_ms();
+    stats->cloned = stats->linked = stats->copied = stats->failed = 0;
+    stats->bytes_new = stats->bytes_copied = 0;
+
+    /* Directories first (writable while we fill them, also those left
+     * read-only by an earlier run into the same dest), in walk order */
+    char path[3200];
+    struct stat st;
+    for (size_t i = 0; i < tree->count; i++) {
+        RSimDedupEntry *e = &tree->entries[i];
+        if (e->type != RSIM_DEDUP_DIR) continue;
+        snprintf(path, sizeof(path), "%s%s%s", dest, e->rel[0] ? "/" : "", e->rel);
+        if (i == 0) mkdirs(path);
+        else if (mkdir(path, 0755) == 0) continue;
+        if (lstat(path, &st) != 0 || !S_ISDIR(st.st_mode) || chmod(path, 0755) != 0) e->failed = 1;
+    }
+
+    size_t nfiles = 0;
+    size_t *files = malloc((tree->count + 1) * sizeof(*files));
+    if (!files) return (int)tree->count;
+    for (size_t i = 0; i < tree->count; i++)
+        if (tree->entries[i].type == RSIM_DEDUP_FILE) files[nfiles++] = i;
+
+    PlaceCtx ctx = { tree, store, dest, allow_link, stats, PTHREAD_MUTEX_INITIALIZER, files };
+    run_pool(jobs, nfiles, ingest_one, &ctx);
+    /* A failed primary fails every file with the same content */
+    for (size_t k = 0; k < nfiles; k++) {
+        RSimDedupEntry *e = &tree->entries[files[k]];
+        for (size_t j = 0; e->primary && e->failed && j < nfiles; j++)
+            if (memcmp(tree->entries[files[j]].digest, e->digest, 32) == 0) tree->entries[files[j]].failed = 1;
+    }
+    run_pool(jobs, nfiles, place_one, &ctx);
+    pthread_mutex_destroy(&ctx.lock);
+    free(files);
+
+    for (size_t i = 0; i < tree->count; i++) {
+        RSimDedupEntry *e = &tree->entries[i];
+        if (e->type != RSIM_DEDUP_SYMLINK) continue;
+        snprintf(path, sizeof(path), "%s/%s", dest, e->rel);
+        unlink(path);
+        if (symlink(e->target, path) != 0) {
+            e->failed = 1;
+            stats->failed++;
+        }
+    }
+    /* Directory modes last, deepest first, so read-only ones don't block their children */
+    for (size_t i = tree->count; i-- > 0;) {
+        RSimDedupEntry *e = &tree->entries[i];
+        if (e->type != RSIM_DEDUP_DIR) continue;
+        snprintf(path, sizeof(path), "%s%s%s", dest, e->rel[0] ? "/" : "", e->rel);
+        if (e->failed || chmod(path, e->mode) != 0) stats->failed++;
+    }
+    stats->place_ms = now_ms() - t0;
+    return (int)stats->failed;
+}
+
+long long rsim_dedup_saved(const RSimDedupStats *stats) {
+    /* Copy fallback plus a new store object can cost more than a plain copy */
+    long long saved = stats->bytes - stats->bytes_new - stats->bytes_copied;
+    return saved > 0 ? saved : 0;
+}
+
+void rsim_dedup_free(RSimDedupTree *tree) {
+    for (size_t i = 0; i < tree->count; i++) {
+        free(tree->entries[i].rel);
+        free(tree->entries[i].target);
+    }
+    free(tree->entries);
+    memset(tree, 0, sizeof(*tree));
+}
@@ -0,0 +1,81 @@
+/*
+ * rosettasim_dedup.h — Content-addressed tree copies for runtime installs (portable C)
+ *
+ * Legacy runtimes are mostly the same bytes: frameworks, fonts and resources
+ * repeat across a dozen RuntimeRoots. Instead of `cp -R`, a tree is scanned
+ * and every file hashed (SHA-256, worker threads), each distinct content is
+ * put once into a store, and the destination is materialized from the store:
+ *
+ *   <store>/objects/ab/cdef...     one read-only file per content
+ *
+ * Files are placed with clonefile() on APFS (copy-on-write: a runtime that
+ * patches a binary only diverges that file), optionally with a hard link
+ * where cloning isn't available, else with a plain copy. Runtimes cloned
+ * from the same objects also share page cache when booted side by side.
+ *
+ * Used by tools/rosettasim_dedup.c; no Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_DEDUP_H
+#define ROSETTASIM_DEDUP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef enum {
+    RSIM_DEDUP_DIR,
+    RSIM_DEDUP_FILE,
+    RSIM_DEDUP_SYMLINK,
+} RSimDedupType;
+
+typedef struct {
+    char           *rel;            /* path under the root; "" for the root itself */
+    char           *target;         /* symlinks: what they point to */
+    RSimDedupType   type;
+    mode_t          mode;
+    long long       size;
+    unsigned char   digest[32];     /* files: SHA-256 of the contents */
+    int             primary;        /* first file with this digest */
+    int             failed;
+} RSimDedupEntry;
+
+typedef struct {
+    char            root[1024];
+    RSimDedupEntry *entries;        /* parents before children */
+    size_t          count;
+    size_t          capacity;
+} RSimDedupTree;
+
+typedef struct {
+    size_t      files, dirs, symlinks;
+    size_t      unique;             /* distinct file contents */
+    size_t      cloned, linked, copied, failed;
+    long long   bytes;              /* logical size of all files */
+    long long   bytes_unique;       /* size of the distinct contents */
+    long long   bytes_new;          /* added to the store: new contents, link mode variants */
+    long long   bytes_copied;       /* written by the copy fallback */
+    double      scan_ms, place_ms;
+} RSimDedupStats;
+
+/* Walk root and hash every regular file on jobs threads. Returns 0, or -1
+ * with a message in err. */
+int  rsim_dedup_scan(RSimDedupTree *tree, const char *root, int jobs, RSimDedupStats *stats,
+                     char *err, size_t err_size);
+
+/* Add the tree's missing contents to store, then recreate the tree at dest
+ * (created; existing files are replaced). allow_link permits hard links into
+ * the store when cloning fails — the file then shares its inode with the
+ * store, so it must only ever be replaced, never edited in place. Returns
+ * the number of entries that failed. */
+int  rsim_dedup_materialize(RSimDedupTree *tree, const char *store, const char *dest,
+                            int jobs, int allow_link, RSimDedupStats *stats);
+
+/* Bytes the destination did not cost: shared with the store or other trees */
+long long rsim_dedup_saved(const RSimDedupStats *stats);
+
+void rsim_dedup_free(RSimDedupTree *tree);
+
+/* Lowercase hex of a digest (65 bytes incl. NUL) */
+void rsim_dedup_hex(const unsigned char digest[32], char out[65]);
+
+#endif /* ROSETTASIM_DEDUP_H */
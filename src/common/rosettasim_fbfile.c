@@ -0,0 +1,417 @@
+/*
+ * rosettasim_fbfile.c — v2 framebuffer file writer and mmap reader
+ * (see rosettasim_fbfile.h)
+ */
+
+#include "rosettasim_fbfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(RSimFBHeader) <= RSIM_FB_HEADER_SIZE, "header must fit in one page");
+
+/* The checksum is four Fletcher lanes over 32-byte blocks: after n blocks
+ * a[k] = sum of word k of each block, b[k] = sum over blocks j of
+ * (n - j) * word k. Both are linear in the words, so a block that changes
+ * can be taken out and put back in without touching the rest. */
+#define SUM_BLOCK   32
+
+static void sum_blocks(const uint8_t *p, size_t blocks, uint64_t a[4], uint64_t b[4]) {
+    /* Four independent lanes so the loop vectorizes / pipelines */
+    for (size_t j = 0; j < blocks; j++) {
+        uint64_t w[4];
+        memcpy(w, p + j * SUM_BLOCK, sizeof(w));
+        for (int k = 0; k < 4; k++) {
+            a[k] += w[k];
+            b[k] += a[k];
+        }
+    }
+}
+
+/* Remove (sign -1) or add back (sign 1) blocks [j0, j1) of a frame of n blocks */
+static void sum_adjust(const uint8_t *p, size_t j0, size_t j1, size_t n, int sign,
+                       uint64_t a[4], uint64_t b[4]) {
+    for (size_t j = j0; j < j1; j++) {
+        uint64_t w[4];
+        memcpy(w, p + j * SUM_BLOCK, sizeof(w));
+        for (int k = 0; k < 4; k++) {
+            uint64_t v = sign < 0 ? 0 - w[k] : w[k];
+            a[k] += v;
+            b[k] += v * (uint64_t)(n - j);
+        }
+    }
+}
+
+/* Fold in the bytes after the last whole block and mix the lanes */
+static uint64_t sum_finish(const uint8_t *p, size_t size, const uint64_t a[4], const uint64_t b[4]) {
+    uint64_t tail = 0;
+    for (size_t i = size / SUM_BLOCK * SUM_BLOCK, k = 0; i < size; i++, k++)
+        tail ^= (uint64_t)p[i] << (8 * (k % 8));
+    uint64_t sum = tail;
+    for (int k = 0; k < 4; k++) sum = (sum ^ a[k]) * 0x100000001b3ull ^ b[k];
+    return sum ^ (uint64_t)size;
+}
+
+uint64_t rsim_fb_checksum(const void *data, size_t size) {
+    uint64_t a[4] = {0}, b[4] = {0};
+    sum_blocks(data, size / SUM_BLOCK, a, b);
+    return sum_finish(data, size, a, b);
+}
+
+int rsim_fb_write(const char *path, const RSimFBHeader *hdr, const void *pixels, size_t src_bpr) {
+    uint8_t page[RSIM_FB_HEADER_SIZE];
+    RSimFBHeader h = *hdr;
+    size_t row = (size_t)h.bytes_per_row;
+    h.magic = RSIM_FB_MAGIC;
+    h.version = RSIM_FB_VERSION;
+    h.header_size = RSIM_FB_HEADER_SIZE;
+    h.data_size = (uint64_t)row * h.height;
+
+    /* Tight source: one write; otherwise row by row (and checksum rows in order) */
+    int tight = src_bpr == row;
+    if (tight) {
+        h.checksum = rsim_fb_checksum(pixels, (size_t)h.data_size);
+    } else {
+        h.checksum = 0;     /* filled below once rows are gathered */
+    }
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return RSIM_FB_ERR_IO;
+
+    int ok = 1;
+    if (tight) {
+        memset(page, 0, sizeof(page));
+        memcpy(page, &h, sizeof(h));
+        struct iovec iov[2] = {
+            { page, sizeof(page) },
+            { (void *)pixels, (size_t)h.data_size },
+        };
+        size_t want = sizeof(page) + (size_t)h.data_size;
+        ssize_t n = writev(fd, iov, 2);
+        ok = n == (ssize_t)want;
+        /* writev may be short for large frames; finish with plain writes */
+        if (!ok && n >= (ssize_t)sizeof(page)) {
+            size_t done = (size_t)n - sizeof(page);
+            while (done < h.data_size) {
+                ssize_t m = write(fd, (const uint8_t *)pixels + done, (size_t)h.data_size - done);
+                if (m <= 0) break;
+                done += (size_t)m;
+            }
+            ok = done == h.data_size;
+        }
+    } else {
+        /* Strided source (IOSurface padding): write rows after a placeholder
+         * header, then rewrite the header with the checksum. */
+        memset(page, 0, sizeof(page));
+        ok = write(fd, page, sizeof(page)) == (ssize_t)sizeof(page);
+        for (uint32_t y = 0; ok && y < h.height; y++)
+            ok = write(fd, (const uint8_t *)pixels + (size_t)y * src_bpr, row) == (ssize_t)row;
+        if (ok) {
+            /* Checksum the tight layout, as readers see it */
+            void *m = mmap(NULL, sizeof(page) + (size_t)h.data_size, PROT_READ, MAP_SHARED, fd, 0);
+            ok = m != MAP_FAILED;
+            if (ok) {
+                h.checksum = rsim_fb_checksum((const uint8_t *)m + sizeof(page), (size_t)h.data_size);
+                munmap(m, sizeof(page) + (size_t)h.data_size);
+            }
+        }
+        if (ok) {
+            memcpy(page, &h, sizeof(h));
+            ok = pwrite(fd, page, sizeof(page), 0) == (ssize_t)sizeof(page);
+        }
+    }
+    if (close(fd) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        return RSIM_FB_ERR_IO;
+    }
+    return RSIM_FB_OK;
+}
+
+/* ================================================================
+ * Incremental writer
+ * ================================================================ */
+
+typedef struct { uint32_t x, y, w, h; } Rect;
+
+static Rect rect_union(Rect r, Rect s) {
+    if (!r.w) return s;
+    if (!s.w) return r;
+    uint32_t x0 = r.x < s.x ? r.x : s.x, y0 = r.y < s.y ? r.y : s.y;
+    uint32_t x1 = r.x + r.w > s.x + s.w ? r.x + r.w : s.x + s.w;
+    uint32_t y1 = r.y + r.h > s.y + s.h ? r.y + r.h : s.y + s.h;
+    return (Rect){ x0, y0, x1 - x0, y1 - y0 };
+}
+
+static void slot_path(const RSimFBWriter *w, unsigned i, char *out, size_t size) {
+    snprintf(out, size, "%s.%u", w->path, i);
+}
+
+static void slot_close(RSimFBWriter *w, unsigned i, int remove) {
+    RSimFBSlot *s = &w->slots[i];
+    if (s->map) munmap(s->map, w->map_size);
+    if (s->fd > 0) close(s->fd);
+    memset(s, 0, sizeof(*s));
+    if (remove) {
+        char path[1040];
+        slot_path(w, i, path, sizeof(path));
+        unlink(path);
+    }
+}
+
+static int slot_open(RSimFBWriter *w, unsigned i) {
+    RSimFBSlot *s = &w->slots[i];
+    char path[1040];
+    slot_path(w, i, path, sizeof(path));
+    /* A fresh inode: readers may still map the old file, which must not
+     * shrink under them */
+    unlink(path);
+    s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (s->fd < 0 || ftruncate(s->fd, (off_t)w->map_size) != 0) {
+        int saved = errno;
+        slot_close(w, i, 0);
+        errno = saved;
+        return RSIM_FB_ERR_IO;
+    }
+    void *m = mmap(NULL, w->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (m == MAP_FAILED) {
+        int saved = errno;
+        slot_close(w, i, 0);
+        errno = saved;
+        return RSIM_FB_ERR_IO;
+    }
+    s->map = m;
+    return RSIM_FB_OK;
+}
+
+void rsim_fb_writer_init(RSimFBWriter *w, const char *path, int raw) {
+    memset(w, 0, sizeof(*w));
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    w->raw = raw;
+}
+
+void rsim_fb_writer_reset(RSimFBWriter *w) {
+    for (unsigned i = 0; i < RSIM_FB_RING; i++) w->slots[i].valid = 0;
+}
+
+void rsim_fb_writer_close(RSimFBWriter *w, int remove) {
+    for (unsigned i = 0; i < RSIM_FB_RING; i++) slot_close(w, i, remove);
+    if (remove && w->path[0]) {
+        char tmp[1040];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+        unlink(tmp);
+        unlink(w->path);
+    }
+    w->width = w->height = w->bytes_per_row = 0;
+    w->map_size = 0;
+    w->next = 0;
+}
+
+int rsim_fb_writer_publish(RSimFBWriter *w, const RSimFBHeader *hdr, const void *pixels, size_t src_bpr) {
+    size_t row = hdr->bytes_per_row, header = w->raw ? 0 : RSIM_FB_HEADER_SIZE;
+    size_t data_size = row * hdr->height, blocks = data_size / SUM_BLOCK;
+    if (hdr->width != w->width || hdr->height != w->height || hdr->bytes_per_row != w->bytes_per_row) {
+        for (unsigned i = 0; i < RSIM_FB_RING; i++) slot_close(w, i, 0);
+        w->width = hdr->width;
+        w->height = hdr->height;
+        w->bytes_per_row = hdr->bytes_per_row;
+        w->map_size = header + data_size;
+        w->next = 0;
+    }
+    unsigned i = w->next;
+    RSimFBSlot *s = &w->slots[i];
+    if (!s->map) {
+        int err = slot_open(w, i);
+        if (err != RSIM_FB_OK) return err;
+    }
+
+    Rect dirty = { hdr->dirty_x, hdr->dirty_y, hdr->dirty_w, hdr->dirty_h };
+    if (!dirty.w || !dirty.h || dirty.x >= w->width || dirty.y >= w->height)
+        dirty = (Rect){ 0, 0, w->width, w->height };
+    if (dirty.w > w->width - dirty.x) dirty.w = w->width - dirty.x;
+    if (dirty.h > w->height - dirty.y) dirty.h = w->height - dirty.y;
+
+    /* Seqlock: odd generation before the first pixel changes */
+    uint32_t *gen = w->raw ? NULL : &((RSimFBHeader *)s->map)->generation;
+    uint32_t generation = gen ? __atomic_load_n(gen, __ATOMIC_RELAXED) | 1 : 0;
+    if (gen) {
+        __atomic_store_n(gen, generation, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    uint8_t *dst = s->map + header;
+    const uint8_t *src = pixels;
+    if (!s->valid) {
+        for (uint32_t y = 0; y < w->height; y++)
+            memcpy(dst + y * row, src + y * src_bpr, row);
+        memset(s->sum_a, 0, sizeof(s->sum_a));
+        memset(s->sum_b, 0, sizeof(s->sum_b));
+        sum_blocks(dst, blocks, s->sum_a, s->sum_b);
+    } else {
+        /* Everything published since this file was written, plus this frame */
+        Rect r = rect_union((Rect){ s->stale_x, s->stale_y, s->stale_w, s->stale_h }, dirty);
+        for (uint32_t y = r.y; y < r.y + r.h; y++) {
+            size_t off = y * row + (size_t)r.x * 4, len = (size_t)r.w * 4;
+            size_t j0 = off / SUM_BLOCK, j1 = (off + len + SUM_BLOCK - 1) / SUM_BLOCK;
+            if (j1 > blocks) j1 = blocks;
+            if (j0 < j1) sum_adjust(dst, j0, j1, blocks, -1, s->sum_a, s->sum_b);
+            memcpy(dst + off, src + y * src_bpr + (size_t)r.x * 4, len);
+            if (j0 < j1) sum_adjust(dst, j0, j1, blocks, 1, s->sum_a, s->sum_b);
+        }
+    }
+    if (!w->raw) {
+        RSimFBHeader h = *hdr;
+        h.magic = RSIM_FB_MAGIC;
+        h.version = RSIM_FB_VERSION;
+        h.header_size = RSIM_FB_HEADER_SIZE;
+        h.data_size = data_size;
+        h.checksum = sum_finish(dst, data_size, s->sum_a, s->sum_b);
+        h.generation = generation;
+        memcpy(s->map, &h, sizeof(h));
+        __atomic_store_n(gen, generation + 1, __ATOMIC_RELEASE);
+    }
+
+    /* Hard link over path: readers that open it now get this file, and the
+     * previous one stays intact until its turn comes round again. */
+    char from[1040], tmp[1040];
+    slot_path(w, i, from, sizeof(from));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    unlink(tmp);
+    if (link(from, tmp) != 0 || rename(tmp, w->path) != 0) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        return RSIM_FB_ERR_IO;
+    }
+
+    s->valid = 1;
+    s->stale_w = s->stale_h = 0;
+    for (unsigned k = 0; k < RSIM_FB_RING; k++) {
+        RSimFBSlot *o = &w->slots[k];
+        if (k == i || !o->valid) continue;
+        Rect r = rect_union((Rect){ o->stale_x, o->stale_y, o->stale_w, o->stale_h }, dirty);
+        o->stale_x = r.x; o->stale_y = r.y; o->stale_w = r.w; o->stale_h = r.h;
+    }
+    w->next = (i + 1) % RSIM_FB_RING;
+    return RSIM_FB_OK;
+}
+
+int rsim_fb_is_v2(const void *data, size_t size) {
+    const RSimFBHeader *h = data;
+    return size >= sizeof(RSimFBHeader) && h->magic == RSIM_FB_MAGIC && h->version == RSIM_FB_VERSION;
+}
+
+int rsim_fb_map(const char *path, RSimFBMap *out, int verify_checksum) {
+    memset(out, 0, sizeof(*out));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return RSIM_FB_ERR_IO;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return RSIM_FB_ERR_IO; }
+    if ((size_t)st.st_size < RSIM_FB_HEADER_SIZE) { close(fd); return RSIM_FB_ERR_FORMAT; }
+
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return RSIM_FB_ERR_IO;
+
+    const RSimFBHeader *h = m;
+    int err = RSIM_FB_OK;
+    if (!rsim_fb_is_v2(m, (size_t)st.st_size) || h->header_size < sizeof(RSimFBHeader) ||
+        h->header_size % RSIM_FB_HEADER_SIZE || h->pixel_format != RSIM_FB_FORMAT_BGRA ||
+        !h->width || !h->height || h->bytes_per_row < (uint64_t)h->width * 4 ||
+        h->data_size != (uint64_t)h->bytes_per_row * h->height)
+        err = RSIM_FB_ERR_FORMAT;
+    else if ((uint64_t)st.st_size < h->header_size + h->data_size)
+        err = RSIM_FB_ERR_TRUNCATED;
+    else if (verify_checksum &&
+             rsim_fb_checksum((const uint8_t *)m + h->header_size, (size_t)h->data_size) != h->checksum)
+        err = RSIM_FB_ERR_CHECKSUM;
+
+    if (err != RSIM_FB_OK) {
+        munmap(m, (size_t)st.st_size);
+        return err;
+    }
+    out->header = h;
+    out->pixels = (const uint8_t *)m + h->header_size;
+    out->map = m;
+    out->map_size = (size_t)st.st_size;
+    return RSIM_FB_OK;
+}
+
+void rsim_fb_unmap(RSimFBMap *map) {
+    if (map->map) munmap(map->map, map->map_size);
+    memset(map, 0, sizeof(*map));
+}
+
+#define READ_ATTEMPTS   8
+
+int rsim_fb_read(const char *path, RSimFBFrame *frame, uint64_t skip_sequence, int verify_checksum) {
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        if (attempt) sched_yield();
+        RSimFBMap map;
+        int err = rsim_fb_map(path, &map, 0);
+        if (err != RSIM_FB_OK) return err;
+        const RSimFBHeader *h = map.header;
+        uint32_t *gen = (uint32_t *)&((RSimFBHeader *)map.map)->generation;
+        uint32_t g1 = __atomic_load_n(gen, __ATOMIC_ACQUIRE);
+        if (g1 & 1) {
+            rsim_fb_unmap(&map);
+            continue;
+        }
+        if (skip_sequence && h->sequence == skip_sequence) {
+            rsim_fb_unmap(&map);
+            return RSIM_FB_SAME;
+        }
+        /* The geometry rsim_fb_map validated; a torn header is caught below */
+        size_t data_size = (size_t)h->data_size;
+        if (data_size > frame->capacity) {
+            uint8_t *px = realloc(frame->pixels, data_size);
+            if (!px) {
+                rsim_fb_unmap(&map);
+                errno = ENOMEM;
+                return RSIM_FB_ERR_IO;
+            }
+            frame->pixels = px;
+            frame->capacity = data_size;
+        }
+        memcpy(&frame->header, h, sizeof(frame->header));
+        memcpy(frame->pixels, map.pixels, data_size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t g2 = __atomic_load_n(gen, __ATOMIC_RELAXED);
+        rsim_fb_unmap(&map);
+        if (g1 != g2 || frame->header.data_size != data_size) continue;
+        if (verify_checksum && rsim_fb_checksum(frame->pixels, data_size) != frame->header.checksum)
+            return RSIM_FB_ERR_CHECKSUM;
+        return RSIM_FB_OK;
+    }
+    return RSIM_FB_ERR_BUSY;
+}
+
+void rsim_fb_frame_free(RSimFBFrame *frame) {
+    free(frame->pixels);
+    memset(frame, 0, sizeof(*frame));
+}
+
+const char *rsim_fb_strerror(int err) {
+    switch (err) {
+    case RSIM_FB_OK:            return "ok";
+    case RSIM_FB_ERR_IO:        return strerror(errno);
+    case RSIM_FB_ERR_FORMAT:    return "not a v2 framebuffer file";
+    case RSIM_FB_ERR_TRUNCATED: return "framebuffer file truncated";
+    case RSIM_FB_ERR_CHECKSUM:  return "framebuffer checksum mismatch";
+    case RSIM_FB_ERR_BUSY:      return "framebuffer file rewritten while it was read";
+    case RSIM_FB_SAME:          return "same frame";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,150 @@
+/*
+ * rosettasim_fbfile.h — Self-describing framebuffer file (v2) (portable C)
+ *
+ * The daemon publishes each device's latest frame to
+ * /tmp/rosettasim_fb_<UDID>.fb: one page of header followed by the BGRA
+ * pixels, so readers can mmap the file, validate it and use the pixels in
+ * place without consulting the dims JSON. rsim_fb_write replaces the file
+ * atomically (write to .tmp, rename), so an existing mapping stays a
+ * consistent frame.
+ *
+ * The daemon publishes through an RSimFBWriter instead, which copies only
+ * what changed. It keeps RSIM_FB_RING backing files (<path>.0, .1, ...),
+ * each mapped once, and publishes by hard-linking the one it just updated
+ * over <path>. A backing file is brought up to date by copying the union
+ * of the dirty rects published since it was last written, and its checksum
+ * is updated from the changed words alone, so a small change costs a small
+ * copy.
+ *
+ * That means a backing file is rewritten in place RSIM_FB_RING frames
+ * after it was published, under a reader that still has it mapped. The
+ * header's generation is a seqlock (odd while the writer is at work), and
+ * rsim_fb_read copies a frame out and retries until it got one the writer
+ * didn't touch meanwhile. Readers that keep or encode the pixels use it;
+ * rsim_fb_map alone is only safe on files from rsim_fb_write, or to look at
+ * the header.
+ *
+ * The headerless /tmp/sim_framebuffer.raw is still written (an RSimFBWriter
+ * with raw set) for tools from the purple_fb_bridge era.
+ */
+
+#ifndef ROSETTASIM_FBFILE_H
+#define ROSETTASIM_FBFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_FB_MAGIC           0x42465352u     /* "RSFB" on disk (little-endian) */
+#define RSIM_FB_VERSION         2
+#define RSIM_FB_HEADER_SIZE     4096            /* pixels start on a page boundary */
+#define RSIM_FB_FORMAT_BGRA     0x42475241u     /* 'BGRA', same as the IOSurface format */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;       /* offset of the pixel data */
+    uint32_t pixel_format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_row;
+    uint32_t scale_milli;       /* device scale * 1000 */
+    uint64_t sequence;          /* daemon frame sequence (RosettaSimFrontSequence) */
+    uint64_t timestamp_ns;      /* CLOCK_REALTIME when published */
+    uint32_t dirty_x;           /* region changed since the previous frame, pixels */
+    uint32_t dirty_y;
+    uint32_t dirty_w;
+    uint32_t dirty_h;
+    uint64_t data_size;         /* bytes_per_row * height */
+    uint64_t checksum;          /* rsim_fb_checksum() of the pixel data */
+    uint32_t orientation;       /* guest UIInterfaceOrientation, 0 = unknown (rosettasim_image.h) */
+    uint32_t generation;        /* seqlock: odd while an RSimFBWriter rewrites the file */
+} RSimFBHeader;
+
+typedef struct {
+    const RSimFBHeader *header;
+    const uint8_t      *pixels;
+    void               *map;
+    size_t              map_size;
+} RSimFBMap;
+
+enum {
+    RSIM_FB_OK = 0,
+    RSIM_FB_ERR_IO = -1,        /* open/stat/mmap/write failed (errno is set) */
+    RSIM_FB_ERR_FORMAT = -2,    /* not a v2 file, or header fields inconsistent */
+    RSIM_FB_ERR_TRUNCATED = -3, /* file shorter than the header says */
+    RSIM_FB_ERR_CHECKSUM = -4,
+    RSIM_FB_ERR_BUSY = -5,      /* rewritten during every attempt to copy it */
+    RSIM_FB_SAME = 1,           /* rsim_fb_read: still the frame the caller has */
+};
+
+/* Fletcher-style 64-bit sum over 8-byte words (tail bytes folded in) */
+uint64_t    rsim_fb_checksum(const void *data, size_t size);
+
+/* Write header + pixels to path atomically. Fills in magic, version,
+ * header_size, data_size and checksum; the caller sets the rest. Rows are
+ * taken at src_bpr and written tightly at hdr->bytes_per_row. */
+int         rsim_fb_write(const char *path, const RSimFBHeader *hdr,
+                          const void *pixels, size_t src_bpr);
+
+/* ---- Incremental writer ---- */
+
+#define RSIM_FB_RING            3
+
+typedef struct {
+    int         fd;
+    uint8_t    *map;                /* header page (unless raw), then pixels */
+    uint64_t    sum_a[4], sum_b[4]; /* checksum lanes of the pixels it holds */
+    uint32_t    stale_x, stale_y;   /* changed since it was last written; */
+    uint32_t    stale_w, stale_h;   /* w == 0: up to date */
+    int         valid;              /* holds a complete frame */
+} RSimFBSlot;
+
+typedef struct {
+    char        path[1024];
+    int         raw;                /* headerless pixels only */
+    uint32_t    width, height, bytes_per_row;
+    size_t      map_size;
+    RSimFBSlot  slots[RSIM_FB_RING];
+    unsigned    next;
+} RSimFBWriter;
+
+/* No files are touched until the first publish */
+void        rsim_fb_writer_init(RSimFBWriter *w, const char *path, int raw);
+
+/* Publish a frame. hdr is as for rsim_fb_write; its dirty rect (w == 0:
+ * everything) is the only region read from pixels, unless the geometry
+ * changed or the backing file is new. */
+int         rsim_fb_writer_publish(RSimFBWriter *w, const RSimFBHeader *hdr,
+                                   const void *pixels, size_t src_bpr);
+
+/* Next publish copies the whole frame (e.g. the pixel source changed) */
+void        rsim_fb_writer_reset(RSimFBWriter *w);
+
+/* Unmap and close; with remove, also unlink <path> and the backing files */
+void        rsim_fb_writer_close(RSimFBWriter *w, int remove);
+
+/* Map and validate a v2 file. verify_checksum re-sums the pixel data. */
+int         rsim_fb_map(const char *path, RSimFBMap *out, int verify_checksum);
+void        rsim_fb_unmap(RSimFBMap *map);
+
+/* A frame copied out of its file */
+typedef struct {
+    RSimFBHeader    header;
+    uint8_t        *pixels;         /* header.data_size bytes (owned) */
+    size_t          capacity;
+} RSimFBFrame;
+
+/* Copy the frame at path into frame (its buffer is reused and grown), so
+ * that it stays consistent however soon the writer comes back to the file.
+ * With skip_sequence non-zero, returns RSIM_FB_SAME without copying when
+ * the file still holds that frame. verify_checksum sums the copy. */
+int         rsim_fb_read(const char *path, RSimFBFrame *frame, uint64_t skip_sequence,
+                         int verify_checksum);
+void        rsim_fb_frame_free(RSimFBFrame *frame);
+
+/* Cheap check used to tell v2 files from headerless raw dumps */
+int         rsim_fb_is_v2(const void *data, size_t size);
+
+const char *rsim_fb_strerror(int err);
+
+#endif /* ROSETTASIM_FBFILE_H */
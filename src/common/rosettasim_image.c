@@ -0,0 +1,325 @@
+/*
+ * rosettasim_image.c — BGRA box downscaling and rotation (see rosettasim_image.h)
+ *
+ * The 2x2 average works on 4 output pixels per step: NEON deinterleaves
+ * even/odd pixels with vld2q_u32, SSE2 with shuffle_ps; sums are widened to
+ * 16 bits and rounded, so results match the scalar path bit for bit.
+ *
+ * Quarter turns move 4x4 pixel blocks through a register transpose (NEON
+ * vtrnq_u32, SSE2 unpack) into a 32x64 block buffer, which is stored as
+ * 256-byte runs of destination rows. On x86 big outputs are written with
+ * streaming stores, whole lines at a time (see put_run).
+ */
+
+#include "rosettasim_image.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RSIM_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RSIM_SSE 1
+#endif
+
+static void half_row(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int out_w) {
+    int x = 0;
+#if RSIM_NEON
+    for (; x + 4 <= out_w; x += 4, r0 += 32, r1 += 32, dst += 16) {
+        uint32x4x2_t a = vld2q_u32((const uint32_t *)r0);
+        uint32x4x2_t b = vld2q_u32((const uint32_t *)r1);
+        uint8x16_t a0 = vreinterpretq_u8_u32(a.val[0]), a1 = vreinterpretq_u8_u32(a.val[1]);
+        uint8x16_t b0 = vreinterpretq_u8_u32(b.val[0]), b1 = vreinterpretq_u8_u32(b.val[1]);
+        uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a0), vget_low_u8(a1)),
+                                  vaddl_u8(vget_low_u8(b0), vget_low_u8(b1)));
+        uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a0), vget_high_u8(a1)),
+                                  vaddl_u8(vget_high_u8(b0), vget_high_u8(b1)));
+        vst1q_u8(dst, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)));
+    }
+#elif RSIM_SSE
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    for (; x + 4 <= out_w; x += 4, r0 += 32, r1 += 32, dst += 16) {
+        __m128 a_lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)r0));
+        __m128 a_hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(r0 + 16)));
+        __m128 b_lo = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)r1));
+        __m128 b_hi = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(r1 + 16)));
+        __m128i a0 = _mm_castps_si128(_mm_shuffle_ps(a_lo, a_hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i a1 = _mm_castps_si128(_mm_shuffle_ps(a_lo, a_hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i b0 = _mm_castps_si128(_mm_shuffle_ps(b_lo, b_hi, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i b1 = _mm_castps_si128(_mm_shuffle_ps(b_lo, b_hi, _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(a1, zero)),
+                                   _mm_add_epi16(_mm_unpacklo_epi8(b0, zero), _mm_unpacklo_epi8(b1, zero)));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(a1, zero)),
+                                   _mm_add_epi16(_mm_unpackhi_epi8(b0, zero), _mm_unpackhi_epi8(b1, zero)));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+        _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < out_w; x++, r0 += 8, r1 += 8, dst += 4) {
+        for (int c = 0; c < 4; c++)
+            dst[c] = (uint8_t)((r0[c] + r0[4 + c] + r1[c] + r1[4 + c] + 2) >> 2);
+    }
+}
+
+void rsim_bgra_half(const uint8_t *src, int width, int height, size_t src_bpr,
+                    uint8_t *dst, size_t dst_bpr) {
+    int out_w = width / 2, out_h = height / 2;
+    for (int y = 0; y < out_h; y++) {
+        const uint8_t *r0 = src + (size_t)(2 * y) * src_bpr;
+        half_row(r0, r0 + src_bpr, dst + (size_t)y * dst_bpr, out_w);
+    }
+}
+
+int rsim_bgra_shrink(const uint8_t *src, int width, int height, size_t src_bpr,
+                     int factor, RSimBitmap *out) {
+    if (factor < 1 || (factor & (factor - 1)) || width / factor < 1 || height / factor < 1)
+        return -1;
+
+    int w = factor == 1 ? width : width / 2;
+    int h = factor == 1 ? height : height / 2;
+    size_t need = (size_t)w * h * 4;
+    if (need > out->capacity) {
+        uint8_t *px = realloc(out->px, need);
+        if (!px) return -1;
+        out->px = px;
+        out->capacity = need;
+    }
+
+    if (factor == 1) {
+        for (int y = 0; y < h; y++)
+            memcpy(out->px + (size_t)y * w * 4, src + (size_t)y * src_bpr, (size_t)w * 4);
+    } else {
+        rsim_bgra_half(src, width, height, src_bpr, out->px, (size_t)w * 4);
+        /* Remaining levels run in place */
+        for (int f = factor / 2; f > 1; f /= 2) {
+            rsim_bgra_half(out->px, w, h, (size_t)w * 4, out->px, (size_t)(w / 2) * 4);
+            w /= 2;
+            h /= 2;
+        }
+    }
+    out->width = w;
+    out->height = h;
+    out->bytes_per_row = (size_t)w * 4;
+    return 0;
+}
+
+int rsim_shrink_factor(int width, int height, int min_width, int min_height) {
+    int factor = 1;
+    while (width / (factor * 2) >= min_width && height / (factor * 2) >= min_height)
+        factor *= 2;
+    return factor;
+}
+
+void rsim_bitmap_free(RSimBitmap *bmp) {
+    if (!bmp) return;
+    free(bmp->px);
+    memset(bmp, 0, sizeof(*bmp));
+}
+
+/* ---- Rotation ---- */
+
+#define ROT_BLOCK_COLS  32              /* source columns per block */
+#define ROT_STRIP_ROWS  64              /* source rows per strip: 256-byte destination runs */
+#define ROT_STREAM_MIN  (4u << 20)      /* outputs this big bypass the cache */
+
+int rsim_orientation_rotation(int orientation) {
+    switch (orientation) {
+    case RSIM_ORIENTATION_PORTRAIT_UPSIDE_DOWN: return 180;
+    case RSIM_ORIENTATION_LANDSCAPE_RIGHT:      return 270;
+    case RSIM_ORIENTATION_LANDSCAPE_LEFT:       return 90;
+    default:                                    return 0;
+    }
+}
+
+/* Column j of the 4x4 block whose rows are r0..r3 (4 pixels each) goes to
+ * out + j * out_stride. */
+static inline void transpose4(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2,
+                              const uint8_t *r3, uint8_t *out, ptrdiff_t out_stride) {
+#if RSIM_NEON
+    uint32x4x2_t p = vtrnq_u32(vld1q_u32((const uint32_t *)r0), vld1q_u32((const uint32_t *)r1));
+    uint32x4x2_t q = vtrnq_u32(vld1q_u32((const uint32_t *)r2), vld1q_u32((const uint32_t *)r3));
+    vst1q_u32((uint32_t *)out,                  vcombine_u32(vget_low_u32(p.val[0]), vget_low_u32(q.val[0])));
+    vst1q_u32((uint32_t *)(out + out_stride),   vcombine_u32(vget_low_u32(p.val[1]), vget_low_u32(q.val[1])));
+    vst1q_u32((uint32_t *)(out + 2 * out_stride), vcombine_u32(vget_high_u32(p.val[0]), vget_high_u32(q.val[0])));
+    vst1q_u32((uint32_t *)(out + 3 * out_stride), vcombine_u32(vget_high_u32(p.val[1]), vget_high_u32(q.val[1])));
+#elif RSIM_SSE
+    __m128i a = _mm_loadu_si128((const __m128i *)r0), b = _mm_loadu_si128((const __m128i *)r1);
+    __m128i c = _mm_loadu_si128((const __m128i *)r2), d = _mm_loadu_si128((const __m128i *)r3);
+    __m128i ab_lo = _mm_unpacklo_epi32(a, b), cd_lo = _mm_unpacklo_epi32(c, d);
+    __m128i ab_hi = _mm_unpackhi_epi32(a, b), cd_hi = _mm_unpackhi_epi32(c, d);
+    _mm_storeu_si128((__m128i *)out,                    _mm_unpacklo_epi64(ab_lo, cd_lo));
+    _mm_storeu_si128((__m128i *)(out + out_stride),     _mm_unpackhi_epi64(ab_lo, cd_lo));
+    _mm_storeu_si128((__m128i *)(out + 2 * out_stride), _mm_unpacklo_epi64(ab_hi, cd_hi));
+    _mm_storeu_si128((__m128i *)(out + 3 * out_stride), _mm_unpackhi_epi64(ab_hi, cd_hi));
+#else
+    const uint8_t *rows[4] = { r0, r1, r2, r3 };
+    for (int j = 0; j < 4; j++)
+        for (int i = 0; i < 4; i++)
+            memcpy(out + j * out_stride + i * 4, rows[i] + j * 4, 4);
+#endif
+}
+
+/* One whole 64-byte line at a 64-byte aligned dst, past the cache where
+ * there are streaming stores (SSE2 movntdq); a plain copy otherwise. */
+static inline void put_line(uint8_t *dst, const uint8_t *src) {
+#if RSIM_SSE
+    __m128i *d = (__m128i *)dst;
+    const __m128i *s = (const __m128i *)src;
+    _mm_stream_si128(d,     _mm_loadu_si128(s));
+    _mm_stream_si128(d + 1, _mm_loadu_si128(s + 1));
+    _mm_stream_si128(d + 2, _mm_loadu_si128(s + 2));
+    _mm_stream_si128(d + 3, _mm_loadu_si128(s + 3));
+#else
+    memcpy(dst, src, 64);
+#endif
+}
+
+static inline void put_fence(void) {
+#if RSIM_SSE
+    _mm_sfence();
+#endif
+}
+
+/* Store a run of n bytes that continues a destination row where the
+ * previous strip's run ended. A streamed line must be written whole at
+ * once, so the partial line the previous run ended in was left in carry
+ * and is completed here, and this run's own partial tail goes to carry.
+ * first/last runs touch the row's ends (or the scalar edge pixels) and
+ * store their partial lines normally. */
+static void put_run(uint8_t *d, const uint8_t *s, size_t n, uint8_t *carry, int first, int last) {
+    size_t pre = (uintptr_t)d & 63;
+    if (pre) {
+        size_t k = 64 - pre < n ? 64 - pre : n;
+        if (first) {
+            memcpy(d, s, k);
+        } else {
+            memcpy(carry + pre, s, k);
+            if (pre + k == 64) put_line(d - pre, carry);
+            else if (last) memcpy(d - pre, carry, pre + k);
+        }
+        d += k;
+        s += k;
+        n -= k;
+    }
+    for (; n >= 64; n -= 64, d += 64, s += 64) put_line(d, s);
+    memcpy(last ? d : carry, s, n);
+}
+
+/* cw: dst[x][h-1-y] = src[y][x]; otherwise (270) dst[w-1-x][y] = src[y][x].
+ * The source is walked in strips of ROT_STRIP_ROWS rows, ROT_BLOCK_COLS
+ * columns at a time: each block is transposed 4x4 at a time into buf, one
+ * buf row per destination row, and then stored as ROT_BLOCK_COLS runs of
+ * 256 bytes. Strips go in increasing destination column order, so each
+ * destination row is filled left to right, one run per strip. Big outputs
+ * are streamed past the cache a whole line at a time (see put_run); the
+ * rest store runs with memcpy. */
+static void rotate_quarter(const uint8_t *src, int w, int h, size_t sbpr, int cw,
+                           uint8_t *dst, size_t dbpr) {
+    enum { run_bytes = ROT_STRIP_ROWS * 4 };
+    _Alignas(64) uint8_t buf[ROT_BLOCK_COLS * run_bytes];
+    int h4 = h & ~3, w4 = w & ~3;
+    int strips = (h4 + ROT_STRIP_ROWS - 1) / ROT_STRIP_ROWS;
+    uint8_t *carry = NULL;
+#if RSIM_SSE
+    if ((size_t)w * h * 4 >= ROT_STREAM_MIN) carry = malloc((size_t)w * 64);
+#endif
+
+    for (int k = 0; k < strips; k++) {
+        /* The short strip, if any, is the last run of each destination row */
+        int y0 = cw ? h4 - (k + 1) * ROT_STRIP_ROWS : k * ROT_STRIP_ROWS;
+        int n = ROT_STRIP_ROWS;
+        if (y0 < 0) { n += y0; y0 = 0; }
+        if (y0 + n > h4) n = h4 - y0;
+        for (int x0 = 0; x0 < w4; x0 += ROT_BLOCK_COLS) {
+            int bw = w4 - x0 < ROT_BLOCK_COLS ? w4 - x0 : ROT_BLOCK_COLS;
+            for (int i = 0; i < n; i += 4) {
+                /* buf column i is source row y0+n-1-i (cw) or y0+i */
+                ptrdiff_t step = cw ? -(ptrdiff_t)sbpr : (ptrdiff_t)sbpr;
+                const uint8_t *a = src + (size_t)(cw ? y0 + n - 1 - i : y0 + i) * sbpr + (size_t)x0 * 4;
+                for (int j = 0; j < bw; j += 4, a += 16)
+                    transpose4(a, a + step, a + 2 * step, a + 3 * step, buf + j * run_bytes + i * 4, run_bytes);
+            }
+            for (int j = 0; j < bw; j++) {
+                int row = cw ? x0 + j : w - 1 - x0 - j;
+                uint8_t *d = dst + (size_t)row * dbpr + (size_t)(cw ? h - y0 - n : y0) * 4;
+                if (carry) put_run(d, buf + j * run_bytes, (size_t)n * 4, carry + (size_t)row * 64,
+                                   k == 0, k == strips - 1);
+                else       memcpy(d, buf + j * run_bytes, (size_t)n * 4);
+            }
+        }
+    }
+    if (carry) {
+        put_fence();
+        free(carry);
+    }
+
+    /* Right columns and bottom rows outside the 4x4 grid */
+    for (int y = 0; y < h; y++) {
+        for (int x = y < h4 ? w4 : 0; x < w; x++) {
+            const uint8_t *s = src + (size_t)y * sbpr + (size_t)x * 4;
+            if (cw) memcpy(dst + (size_t)x * dbpr + (size_t)(h - 1 - y) * 4, s, 4);
+            else    memcpy(dst + (size_t)(w - 1 - x) * dbpr + (size_t)y * 4, s, 4);
+        }
+    }
+}
+
+/* dst row y is src row h-1-y with its pixels reversed */
+static void rotate_half_turn(const uint8_t *src, int w, int h, size_t sbpr,
+                             uint8_t *dst, size_t dbpr) {
+    for (int y = 0; y < h; y++) {
+        const uint8_t *s = src + (size_t)(h - 1 - y) * sbpr;
+        uint8_t *d = dst + (size_t)y * dbpr;
+        int x = 0;
+#if RSIM_NEON
+        for (; x + 4 <= w; x += 4) {
+            uint32x4_t v = vrev64q_u32(vld1q_u32((const uint32_t *)(s + (size_t)(w - 4 - x) * 4)));
+            vst1q_u32((uint32_t *)(d + (size_t)x * 4), vextq_u32(v, v, 2));
+        }
+#elif RSIM_SSE
+        for (; x + 4 <= w; x += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(s + (size_t)(w - 4 - x) * 4));
+            _mm_storeu_si128((__m128i *)(d + (size_t)x * 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+        }
+#endif
+        for (; x < w; x++)
+            memcpy(d + (size_t)x * 4, s + (size_t)(w - 1 - x) * 4, 4);
+    }
+}
+
+void rsim_bgra_rotate_into(const uint8_t *src, int width, int height, size_t src_bpr,
+                           int degrees, uint8_t *dst, size_t dst_bpr) {
+    switch (((degrees % 360) + 360) % 360) {
+    case 90:  rotate_quarter(src, width, height, src_bpr, 1, dst, dst_bpr); break;
+    case 180: rotate_half_turn(src, width, height, src_bpr, dst, dst_bpr); break;
+    case 270: rotate_quarter(src, width, height, src_bpr, 0, dst, dst_bpr); break;
+    default:
+        for (int y = 0; y < height; y++)
+            memcpy(dst + (size_t)y * dst_bpr, src + (size_t)y * src_bpr, (size_t)width * 4);
+        break;
+    }
+}
+
+int rsim_bgra_rotate(const uint8_t *src, int width, int height, size_t src_bpr,
+                     int degrees, RSimBitmap *out) {
+    int deg = ((degrees % 360) + 360) % 360;
+    if (deg % 90 || width < 1 || height < 1) return -1;
+
+    int w = deg % 180 ? height : width;
+    int h = deg % 180 ? width : height;
+    size_t need = (size_t)w * h * 4;
+    if (need > out->capacity) {
+        uint8_t *px = realloc(out->px, need);
+        if (!px) return -1;
+        out->px = px;
+        out->capacity = need;
+    }
+    rsim_bgra_rotate_into(src, width, height, src_bpr, deg, out->px, (size_t)w * 4);
+    out->width = w;
+    out->height = h;
+    out->bytes_per_row = (size_t)w * 4;
+    return 0;
+}
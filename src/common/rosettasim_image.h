@@ -0,0 +1,71 @@
+/*
+ * rosettasim_image.h — BGRA bitmap helpers shared by host tools (portable C)
+ *
+ * Framebuffers are BGRA, kCGBitmapByteOrder32Little | premultiplied first.
+ * Downscaling is a 2x2 box filter applied repeatedly, so factors are powers
+ * of two; callers let CoreGraphics / CALayer handle any remaining fraction.
+ *
+ * Rotation by quarter turns turns the portrait framebuffer into the layout
+ * the guest UI is shown in (landscape iPad/iPhone). It is a blocked 4x4
+ * transpose (SSE2/NEON) that writes straight into the caller's buffer. At
+ * 2048x2732 on an x86_64 VM (tests/bench_image.c) a half turn costs about a
+ * plain copy and a quarter turn about 1.9x one: it reads the source in 64
+ * row-strided streams where a copy reads one. The target is 2x a copy for
+ * quarter turns and 1.2x for half turns.
+ *
+ * Used by sim_viewer (thumbnails) and fb_to_png (--scale, --rotate); no
+ * Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_IMAGE_H
+#define ROSETTASIM_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tightly packed (bytes_per_row == width * 4) reusable buffer */
+typedef struct {
+    uint8_t *px;
+    int      width;
+    int      height;
+    size_t   bytes_per_row;
+    size_t   capacity;      /* bytes allocated in px */
+} RSimBitmap;
+
+/* 2x2 box filter: dst is (width/2) x (height/2). dst may alias src when
+ * dst_bpr <= src_bpr (each output block is written after its inputs are read). */
+void rsim_bgra_half(const uint8_t *src, int width, int height, size_t src_bpr,
+                    uint8_t *dst, size_t dst_bpr);
+
+/* Downscale by factor (1, 2, 4, 8, ...) into out, growing out->px if needed.
+ * Returns 0 on success, -1 on a bad factor or allocation failure. */
+int  rsim_bgra_shrink(const uint8_t *src, int width, int height, size_t src_bpr,
+                      int factor, RSimBitmap *out);
+
+/* Largest power-of-two factor that keeps width x height at least
+ * min_width x min_height (>= 1). */
+int  rsim_shrink_factor(int width, int height, int min_width, int min_height);
+
+void rsim_bitmap_free(RSimBitmap *bmp);
+
+/* UIInterfaceOrientation as the guest reports it; 0 = unknown (portrait) */
+#define RSIM_ORIENTATION_PORTRAIT               1
+#define RSIM_ORIENTATION_PORTRAIT_UPSIDE_DOWN   2
+#define RSIM_ORIENTATION_LANDSCAPE_RIGHT        3   /* home button right: UI top at framebuffer right */
+#define RSIM_ORIENTATION_LANDSCAPE_LEFT         4   /* home button left: UI top at framebuffer left */
+
+/* Clockwise rotation (0, 90, 180, 270) that shows a framebuffer captured in
+ * orientation upright. */
+int  rsim_orientation_rotation(int orientation);
+
+/* Rotate width x height clockwise by degrees (a multiple of 90) into dst,
+ * which is height x width for 90/270. dst must not overlap src. */
+void rsim_bgra_rotate_into(const uint8_t *src, int width, int height, size_t src_bpr,
+                           int degrees, uint8_t *dst, size_t dst_bpr);
+
+/* Same into out, growing out->px if needed. Returns 0, or -1 on a bad angle
+ * or allocation failure. */
+int  rsim_bgra_rotate(const uint8_t *src, int width, int height, size_t src_bpr,
+                      int degrees, RSimBitmap *out);
+
+#endif /* ROSETTASIM_IMAGE_H */
@@ -0,0 +1,424 @@
+/*
+ * rosettasim_jpeg.c — Baseline JPEG encoder (see rosettasim_jpeg.h)
+ *
+ * Colour conversion and the AAN float DCT run on 4-wide vectors (GCC/Clang
+ * vector extensions, which lower to NEON on arm64 and SSE on x86_64):
+ * the column pass transforms four columns per butterfly, then the block is
+ * transposed and the same pass does the rows. The result is left transposed;
+ * the quantizer and zigzag tables are built in that layout instead of paying
+ * for a second transpose.
+ */
+
+#include "rosettasim_jpeg.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef float    v4f __attribute__((vector_size(16)));
+typedef uint32_t v4u __attribute__((vector_size(16)));
+
+/* ================================================================
+ * Tables (ITU T.81 Annex K)
+ * ================================================================ */
+
+static const uint8_t k_zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+static const uint8_t k_quant_luma[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99,
+};
+
+static const uint8_t k_quant_chroma[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+static const uint8_t k_dc_luma_bits[16]   = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t k_dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t k_dc_vals[12]        = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t k_ac_luma_bits[16]   = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t k_ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+static const uint8_t k_ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t k_ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+/* AAN output scale per frequency, folded into the quantizer */
+static const float k_aan_scale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+    1.0f, 0.785694958f, 0.541196100f, 0.275899379f,
+};
+
+/* ================================================================
+ * Output
+ * ================================================================ */
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t  size[256];
+} HuffTable;
+
+typedef struct {
+    uint8_t  *buf;
+    size_t    len;
+    size_t    cap;
+    uint64_t  bits;         /* pending bits, right-aligned */
+    int       count;
+    int       failed;
+} JpegWriter;
+
+/* Worst case for one MCU: 6 blocks x 64 codes x (16 + 16 bits), all stuffed */
+#define MCU_MAX_BYTES   (6 * 64 * 4 * 2)
+
+static int reserve(JpegWriter *w, size_t n) {
+    if (w->failed) return 0;
+    if (w->len + n > w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 64 * 1024;
+        while (cap < w->len + n) cap *= 2;
+        uint8_t *buf = realloc(w->buf, cap);
+        if (!buf) { w->failed = 1; return 0; }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    return 1;
+}
+
+static void put_bytes(JpegWriter *w, const void *p, size_t n) {
+    if (!reserve(w, n)) return;
+    memcpy(w->buf + w->len, p, n);
+    w->len += n;
+}
+
+static void put_u8(JpegWriter *w, uint8_t v) { put_bytes(w, &v, 1); }
+
+static void put_u16(JpegWriter *w, uint16_t v) {
+    uint8_t b[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+    put_bytes(w, b, 2);
+}
+
+/* Entropy-coded data only; the caller has reserved MCU_MAX_BYTES */
+static inline void put_bits(JpegWriter *w, uint32_t code, int size) {
+    w->bits = (w->bits << size) | code;
+    w->count += size;
+    if (w->count < 32) return;
+    uint8_t *dst = w->buf + w->len;
+    while (w->count >= 8) {
+        w->count -= 8;
+        uint8_t byte = (uint8_t)(w->bits >> w->count);
+        *dst++ = byte;
+        if (byte == 0xFF) *dst++ = 0;       /* byte stuffing */
+    }
+    w->len = (size_t)(dst - w->buf);
+}
+
+static void flush_bits(JpegWriter *w) {
+    if (!reserve(w, 16)) return;
+    int pad = (8 - w->count % 8) % 8;
+    put_bits(w, (1u << pad) - 1, pad);     /* pad the last byte with 1s */
+    uint8_t *dst = w->buf + w->len;
+    while (w->count >= 8) {
+        w->count -= 8;
+        uint8_t byte = (uint8_t)(w->bits >> w->count);
+        *dst++ = byte;
+        if (byte == 0xFF) *dst++ = 0;
+    }
+    w->len = (size_t)(dst - w->buf);
+}
+
+static void build_huffman(HuffTable *t, const uint8_t bits[16], const uint8_t *vals) {
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            t->code[vals[k]] = code++;
+            t->size[vals[k]] = (uint8_t)len;
+        }
+        code <<= 1;
+    }
+}
+
+static void write_dht(JpegWriter *w, int cls_id, const uint8_t bits[16], const uint8_t *vals) {
+    int n = 0;
+    for (int i = 0; i < 16; i++) n += bits[i];
+    put_u16(w, 0xFFC4);
+    put_u16(w, (uint16_t)(2 + 1 + 16 + n));
+    put_u8(w, (uint8_t)cls_id);
+    put_bytes(w, bits, 16);
+    put_bytes(w, vals, (size_t)n);
+}
+
+/* ================================================================
+ * Transform
+ * ================================================================ */
+
+/* One AAN pass over 8 vectors: transforms 4 independent 8-point columns */
+static inline void fdct_pass(v4f d[8]) {
+    v4f tmp0 = d[0] + d[7], tmp7 = d[0] - d[7];
+    v4f tmp1 = d[1] + d[6], tmp6 = d[1] - d[6];
+    v4f tmp2 = d[2] + d[5], tmp5 = d[2] - d[5];
+    v4f tmp3 = d[3] + d[4], tmp4 = d[3] - d[4];
+
+    v4f tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    v4f tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+    d[0] = tmp10 + tmp11;
+    d[4] = tmp10 - tmp11;
+    v4f z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2] = tmp13 + z1;
+    d[6] = tmp13 - z1;
+
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+    v4f z5 = (tmp10 - tmp12) * 0.382683433f;
+    v4f z2 = tmp10 * 0.541196100f + z5;
+    v4f z4 = tmp12 * 1.306562965f + z5;
+    v4f z3 = tmp11 * 0.707106781f;
+    v4f z11 = tmp7 + z3, z13 = tmp7 - z3;
+    d[5] = z13 + z2;
+    d[3] = z13 - z2;
+    d[1] = z11 + z4;
+    d[7] = z11 - z4;
+}
+
+/* block is 8 rows x 8 floats, row-major. On return block[u*8+v] holds the
+ * coefficient of horizontal frequency u, vertical frequency v (transposed). */
+static void fdct_8x8(float block[64]) {
+    v4f d[8];
+    for (int half = 0; half < 8; half += 4) {
+        for (int i = 0; i < 8; i++) memcpy(&d[i], block + i * 8 + half, sizeof(v4f));
+        fdct_pass(d);
+        for (int i = 0; i < 8; i++) memcpy(block + i * 8 + half, &d[i], sizeof(v4f));
+    }
+    float t[64];
+    for (int r = 0; r < 8; r++)
+        for (int c = 0; c < 8; c++) t[c * 8 + r] = block[r * 8 + c];
+    for (int half = 0; half < 8; half += 4) {
+        for (int i = 0; i < 8; i++) memcpy(&d[i], t + i * 8 + half, sizeof(v4f));
+        fdct_pass(d);
+        for (int i = 0; i < 8; i++) memcpy(block + i * 8 + half, &d[i], sizeof(v4f));
+    }
+}
+
+typedef struct {
+    float    fdtbl[64];     /* 1 / (q * aan * 8), zigzag order */
+    uint8_t  src[64];       /* zigzag position → index in the transposed block */
+    uint8_t  qt[64];        /* quantizer in zigzag order, for DQT */
+} QuantTable;
+
+static void build_quant(QuantTable *q, const uint8_t base[64], int quality) {
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int k = 0; k < 64; k++) {
+        int n = k_zigzag[k], row = n / 8, col = n % 8;
+        int v = (base[n] * scale + 50) / 100;
+        if (v < 1) v = 1;
+        if (v > 255) v = 255;
+        q->qt[k] = (uint8_t)v;
+        q->src[k] = (uint8_t)(col * 8 + row);
+        q->fdtbl[k] = 1.0f / (v * k_aan_scale[row] * k_aan_scale[col] * 8.0f);
+    }
+}
+
+static void encode_block(JpegWriter *w, float block[64], const QuantTable *q,
+                         const HuffTable *dc, const HuffTable *ac, int *prev_dc) {
+    fdct_8x8(block);
+
+    int coef[64];
+    for (int k = 0; k < 64; k++) {
+        float v = block[q->src[k]] * q->fdtbl[k];
+        coef[k] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+    }
+
+    int diff = coef[0] - *prev_dc;
+    *prev_dc = coef[0];
+    int mag = diff < 0 ? -diff : diff;
+    int nbits = mag ? 32 - __builtin_clz((unsigned)mag) : 0;
+    put_bits(w, dc->code[nbits], dc->size[nbits]);
+    if (nbits) put_bits(w, (uint32_t)(diff < 0 ? diff - 1 : diff) & ((1u << nbits) - 1), nbits);
+
+    int last = 63;
+    while (last > 0 && coef[last] == 0) last--;
+    int run = 0;
+    for (int k = 1; k <= last; k++) {
+        if (coef[k] == 0) { run++; continue; }
+        while (run >= 16) {
+            put_bits(w, ac->code[0xF0], ac->size[0xF0]);   /* ZRL */
+            run -= 16;
+        }
+        int v = coef[k];
+        mag = v < 0 ? -v : v;
+        nbits = 32 - __builtin_clz((unsigned)mag);
+        int sym = (run << 4) | nbits;
+        put_bits(w, ac->code[sym], ac->size[sym]);
+        put_bits(w, (uint32_t)(v < 0 ? v - 1 : v) & ((1u << nbits) - 1), nbits);
+        run = 0;
+    }
+    if (last < 63) put_bits(w, ac->code[0x00], ac->size[0x00]);  /* EOB */
+}
+
+/* ================================================================
+ * Encoder
+ * ================================================================ */
+
+/* Copy a 16x16 MCU (edges replicated) and convert it to level-shifted
+ * Y (full res) and 2x2-averaged Cb/Cr. */
+static void load_mcu(const uint8_t *bgra, int width, int height, size_t bpr,
+                     int mx, int my, float y_out[4][64], float cb[64], float cr[64]) {
+    uint32_t px[16][16];
+    for (int r = 0; r < 16; r++) {
+        int sy = my + r < height ? my + r : height - 1;
+        const uint32_t *row = (const uint32_t *)(bgra + (size_t)sy * bpr);
+        int n = width - mx < 16 ? width - mx : 16;
+        memcpy(px[r], row + mx, (size_t)n * 4);
+        for (int c = n; c < 16; c++) px[r][c] = px[r][n - 1];
+    }
+
+    float cb_full[16][16], cr_full[16][16];
+    const v4u mask = { 0xFF, 0xFF, 0xFF, 0xFF };
+    for (int r = 0; r < 16; r++) {
+        for (int c = 0; c < 16; c += 4) {
+            v4u p;
+            memcpy(&p, &px[r][c], sizeof(p));
+            v4f b = __builtin_convertvector(p & mask, v4f);
+            v4f g = __builtin_convertvector((p >> 8) & mask, v4f);
+            v4f rr = __builtin_convertvector((p >> 16) & mask, v4f);
+            v4f yv = rr * 0.299f + g * 0.587f + b * 0.114f - 128.0f;
+            v4f cbv = rr * -0.168736f + g * -0.331264f + b * 0.5f;
+            v4f crv = rr * 0.5f + g * -0.418688f + b * -0.081312f;
+            /* Y blocks: 0 1 / 2 3 */
+            int blk = (r / 8) * 2 + c / 8;
+            memcpy(&y_out[blk][(r % 8) * 8 + c % 8], &yv, sizeof(yv));
+            memcpy(&cb_full[r][c], &cbv, sizeof(cbv));
+            memcpy(&cr_full[r][c], &crv, sizeof(crv));
+        }
+    }
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++) {
+            cb[r * 8 + c] = 0.25f * (cb_full[2 * r][2 * c] + cb_full[2 * r][2 * c + 1] +
+                                     cb_full[2 * r + 1][2 * c] + cb_full[2 * r + 1][2 * c + 1]);
+            cr[r * 8 + c] = 0.25f * (cr_full[2 * r][2 * c] + cr_full[2 * r][2 * c + 1] +
+                                     cr_full[2 * r + 1][2 * c] + cr_full[2 * r + 1][2 * c + 1]);
+        }
+    }
+}
+
+int rsim_jpeg_encode_bgra(const uint8_t *bgra, int width, int height, size_t bytes_per_row,
+                          int quality, uint8_t **out, size_t *out_size) {
+    if (!bgra || width < 1 || height < 1 || width > 65535 || height > 65535 || !out || !out_size)
+        return -1;
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+
+    QuantTable ql, qc;
+    build_quant(&ql, k_quant_luma, quality);
+    build_quant(&qc, k_quant_chroma, quality);
+    HuffTable dc_l, dc_c, ac_l, ac_c;
+    memset(&dc_l, 0, sizeof(dc_l)); memset(&dc_c, 0, sizeof(dc_c));
+    memset(&ac_l, 0, sizeof(ac_l)); memset(&ac_c, 0, sizeof(ac_c));
+    build_huffman(&dc_l, k_dc_luma_bits, k_dc_vals);
+    build_huffman(&dc_c, k_dc_chroma_bits, k_dc_vals);
+    build_huffman(&ac_l, k_ac_luma_bits, k_ac_luma_vals);
+    build_huffman(&ac_c, k_ac_chroma_bits, k_ac_chroma_vals);
+
+    JpegWriter w;
+    memset(&w, 0, sizeof(w));
+
+    /* SOI + JFIF APP0 */
+    static const uint8_t app0[] = {
+        0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00,
+        0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,
+    };
+    put_bytes(&w, app0, sizeof(app0));
+
+    put_u16(&w, 0xFFDB);
+    put_u16(&w, 2 + 2 * 65);
+    put_u8(&w, 0);
+    put_bytes(&w, ql.qt, 64);
+    put_u8(&w, 1);
+    put_bytes(&w, qc.qt, 64);
+
+    /* SOF0: 3 components, Y 2x2 sampling, Cb/Cr 1x1 */
+    put_u16(&w, 0xFFC0);
+    put_u16(&w, 8 + 3 * 3);
+    put_u8(&w, 8);
+    put_u16(&w, (uint16_t)height);
+    put_u16(&w, (uint16_t)width);
+    put_u8(&w, 3);
+    static const uint8_t comps[9] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    put_bytes(&w, comps, sizeof(comps));
+
+    write_dht(&w, 0x00, k_dc_luma_bits, k_dc_vals);
+    write_dht(&w, 0x10, k_ac_luma_bits, k_ac_luma_vals);
+    write_dht(&w, 0x01, k_dc_chroma_bits, k_dc_vals);
+    write_dht(&w, 0x11, k_ac_chroma_bits, k_ac_chroma_vals);
+
+    put_u16(&w, 0xFFDA);
+    put_u16(&w, 6 + 2 * 3);
+    put_u8(&w, 3);
+    static const uint8_t scan[6] = { 1, 0x00, 2, 0x11, 3, 0x11 };
+    put_bytes(&w, scan, sizeof(scan));
+    static const uint8_t spectral[3] = { 0, 63, 0 };
+    put_bytes(&w, spectral, sizeof(spectral));
+
+    int dc_y = 0, dc_cb = 0, dc_cr = 0;
+    float yb[4][64], cb[64], cr[64];
+    for (int my = 0; my < height && !w.failed; my += 16) {
+        for (int mx = 0; mx < width; mx += 16) {
+            if (!reserve(&w, MCU_MAX_BYTES)) break;
+            load_mcu(bgra, width, height, bytes_per_row, mx, my, yb, cb, cr);
+            for (int i = 0; i < 4; i++) encode_block(&w, yb[i], &ql, &dc_l, &ac_l, &dc_y);
+            encode_block(&w, cb, &qc, &dc_c, &ac_c, &dc_cb);
+            encode_block(&w, cr, &qc, &dc_c, &ac_c, &dc_cr);
+        }
+    }
+
+    flush_bits(&w);
+    put_u16(&w, 0xFFD9);
+    if (w.failed) {
+        free(w.buf);
+        return -1;
+    }
+    *out = w.buf;
+    *out_size = w.len;
+    return 0;
+}
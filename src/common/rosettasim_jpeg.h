@@ -0,0 +1,22 @@
+/*
+ * rosettasim_jpeg.h — Baseline JPEG encoder for framebuffer captures (portable C)
+ *
+ * Encodes a BGRA frame as baseline JFIF: YCbCr 4:2:0, standard Annex K
+ * quantization (IJG quality scaling) and Huffman tables. Alpha is ignored.
+ *
+ * Meant for thumbnail-grade CI evidence where PNG through ImageIO is
+ * overkill. Used by fb_to_png --format jpeg; no Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_JPEG_H
+#define ROSETTASIM_JPEG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* quality 1..100 (clamped). On success returns 0 and a malloc'd JFIF stream
+ * in *out (caller frees); returns -1 on bad input or allocation failure. */
+int rsim_jpeg_encode_bgra(const uint8_t *bgra, int width, int height, size_t bytes_per_row,
+                          int quality, uint8_t **out, size_t *out_size);
+
+#endif /* ROSETTASIM_JPEG_H */
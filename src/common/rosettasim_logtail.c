@@ -0,0 +1,463 @@
+/*
+ * rosettasim_logtail.c — Follow several log files at once (see rosettasim_logtail.h)
+ */
+
+#include "rosettasim_logtail.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/event.h>
+#define RSIM_LOGTAIL_KQUEUE 1
+#else
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef O_EVTONLY
+#define O_EVTONLY O_RDONLY
+#endif
+
+#define READ_CHUNK          (64 * 1024)
+#define MAX_LINE            (1024 * 1024)   /* flush a line this long even without '\n' */
+
+static double now_epoch(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ================================================================
+ * Timestamps
+ * ================================================================ */
+
+static int digits(const char *s, int n, int *out) {
+    int v = 0;
+    for (int i = 0; i < n; i++) {
+        if (s[i] < '0' || s[i] > '9') return 0;
+        v = v * 10 + (s[i] - '0');
+    }
+    *out = v;
+    return 1;
+}
+
+/* mktime() consults the zone rules on every call; lines mostly share a day */
+static double local_day_start(int year, int mon, int mday) {
+    static int cached_year = -1, cached_mon, cached_mday;
+    static double cached;
+    if (year != cached_year || mon != cached_mon || mday != cached_mday) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon;
+        tm.tm_mday = mday;
+        tm.tm_hour = 12;            /* noon: immune to DST shifts at midnight */
+        tm.tm_isdst = -1;
+        cached = (double)mktime(&tm) - 12 * 3600;
+        cached_year = year;
+        cached_mon = mon;
+        cached_mday = mday;
+    }
+    return cached;
+}
+
+static int parse_clock(const char *s, int *h, int *m, int *sec) {
+    return digits(s, 2, h) && s[2] == ':' && digits(s + 3, 2, m) && s[5] == ':' && digits(s + 6, 2, sec) &&
+           *h < 24 && *m < 60 && *sec < 61;
+}
+
+double rsim_log_parse_time(const char *s, size_t len) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    int year, mon, mday, h, m, sec;
+    size_t p;
+
+    if (len >= 19 && digits(s, 4, &year) && s[4] == '-' && digits(s + 5, 2, &mon) && s[7] == '-' &&
+        digits(s + 8, 2, &mday) && (s[10] == ' ' || s[10] == 'T') && parse_clock(s + 11, &h, &m, &sec) &&
+        mon >= 1 && mon <= 12) {
+        mon -= 1;
+        p = 19;
+    } else if (len >= 15 && s[3] == ' ' && s[6] == ' ' && parse_clock(s + 7, &h, &m, &sec)) {
+        const char *found = NULL;
+        for (int i = 0; i < 12 && !found; i++)
+            if (memcmp(months + i * 3, s, 3) == 0) found = months + i * 3;
+        if (!found) return 0;
+        mon = (int)(found - months) / 3;
+        mday = (s[4] == ' ' ? 0 : (s[4] - '0') * 10) + (s[5] - '0');
+        if (mday < 1 || mday > 31 || (s[4] != ' ' && (s[4] < '0' || s[4] > '9'))) return 0;
+        /* syslog has no year: this year, unless that lands in the future */
+        time_t now = time(NULL);
+        struct tm lt;
+        localtime_r(&now, &lt);
+        year = lt.tm_year + 1900;
+        if (local_day_start(year, mon, mday) > (double)now + 86400) year--;
+        p = 15;
+    } else {
+        return 0;
+    }
+
+    double t = local_day_start(year, mon, mday) + h * 3600 + m * 60 + sec;
+    if (p < len && (s[p] == '.' || s[p] == ',')) {
+        double scale = 0.1;
+        for (p++; p < len && s[p] >= '0' && s[p] <= '9'; p++, scale /= 10) t += (s[p] - '0') * scale;
+    }
+    return t;
+}
+
+/* ================================================================
+ * Lines
+ * ================================================================ */
+
+static int queue_line(RSimLogTail *t, int file, const char *text, size_t len, double time) {
+    if (t->has_filter) {
+        char stack[1024], *buf = len < sizeof(stack) ? stack : malloc(len + 1);
+        if (!buf) return 0;
+        memcpy(buf, text, len);
+        buf[len] = 0;
+        int miss = regexec(&t->filter, buf, 0, NULL, 0) != 0;
+        if (buf != stack) free(buf);
+        if (miss) return 0;
+    }
+    if (t->line_count == t->line_capacity) {
+        size_t cap = t->line_capacity ? t->line_capacity * 2 : 256;
+        RSimLogLine *grown = realloc(t->lines, cap * sizeof(*grown));
+        if (!grown) return 0;
+        t->lines = grown;
+        t->line_capacity = cap;
+    }
+    char *copy = malloc(len + 1);
+    if (!copy) return 0;
+    memcpy(copy, text, len);
+    copy[len] = 0;
+    RSimLogLine *l = &t->lines[t->line_count++];
+    l->time = time;
+    l->file = file;
+    l->seq = t->next_seq++;
+    l->text = copy;
+    l->len = len;
+    return 1;
+}
+
+/* Split complete lines off the file's partial buffer. Lines without a
+ * timestamp inherit the previous one from this read (*last), else arrival. */
+static int emit_lines(RSimLogTail *t, int fi, double arrival, double *last, int flush) {
+    RSimLogFile *f = &t->files[fi];
+    size_t start = 0;
+    int queued = 0;
+    for (size_t i = 0; i < f->partial_len; i++) {
+        if (f->partial[i] != '\n') continue;
+        size_t len = i - start;
+        if (len && f->partial[start + len - 1] == '\r') len--;
+        double ts = rsim_log_parse_time(f->partial + start, len);
+        if (ts > 0) *last = ts;
+        queued += queue_line(t, fi, f->partial + start, len, ts > 0 ? ts : *last > 0 ? *last : arrival);
+        start = i + 1;
+    }
+    if ((flush && start < f->partial_len) || f->partial_len - start >= MAX_LINE) {
+        size_t len = f->partial_len - start;
+        double ts = rsim_log_parse_time(f->partial + start, len);
+        queued += queue_line(t, fi, f->partial + start, len, ts > 0 ? ts : *last > 0 ? *last : arrival);
+        start = f->partial_len;
+    }
+    memmove(f->partial, f->partial + start, f->partial_len - start);
+    f->partial_len -= start;
+    return queued;
+}
+
+/* pread [offset, end) into the partial buffer chunk by chunk */
+static int read_range(RSimLogTail *t, int fi, off_t end, double arrival) {
+    RSimLogFile *f = &t->files[fi];
+    double last = 0;
+    int queued = 0;
+    while (f->offset < end) {
+        size_t want = end - f->offset > READ_CHUNK ? READ_CHUNK : (size_t)(end - f->offset);
+        if (f->partial_len + want > f->partial_cap) {
+            size_t cap = f->partial_len + want + READ_CHUNK;
+            char *grown = realloc(f->partial, cap);
+            if (!grown) break;
+            f->partial = grown;
+            f->partial_cap = cap;
+        }
+        ssize_t n = pread(f->fd, f->partial + f->partial_len, want, f->offset);
+        if (n <= 0) break;
+        f->partial_len += (size_t)n;
+        f->offset += n;
+        queued += emit_lines(t, fi, arrival, &last, 0);
+    }
+    return queued;
+}
+
+/* ================================================================
+ * Watches
+ * ================================================================ */
+
+static void watch_file(RSimLogTail *t, RSimLogFile *f) {
+#ifdef RSIM_LOGTAIL_KQUEUE
+    struct kevent ev;
+    EV_SET(&ev, f->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR,
+           NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME | NOTE_ATTRIB, 0, NULL);
+    kevent(t->event_fd, &ev, 1, NULL, 0, NULL);
+#else
+    f->watch = inotify_add_watch(t->event_fd, f->path, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+#endif
+}
+
+static void close_file(RSimLogTail *t, RSimLogFile *f) {
+    if (f->fd < 0) return;
+#ifndef RSIM_LOGTAIL_KQUEUE
+    if (f->watch >= 0) inotify_rm_watch(t->event_fd, f->watch);
+    f->watch = -1;
+#endif
+    close(f->fd);           /* also drops the kevent */
+    f->fd = -1;
+}
+
+static int open_file(RSimLogTail *t, RSimLogFile *f) {
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+    f->fd = fd;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->offset = 0;
+    f->partial_len = 0;
+    watch_file(t, f);
+    return 1;
+}
+
+/* Watch dir, or the nearest ancestor of it that exists (*exact = 0).
+ * Returns the kqueue fd / inotify wd, or -1. */
+static int watch_dir(RSimLogTail *t, const char *dir, int *exact) {
+    char path[1024];
+    strncpy(path, dir, sizeof(path) - 1);
+    path[sizeof(path) - 1] = 0;
+    *exact = 1;
+    for (;;) {
+#ifdef RSIM_LOGTAIL_KQUEUE
+        int fd = open(path, O_EVTONLY | O_CLOEXEC);
+        if (fd >= 0) {
+            struct kevent ev;
+            EV_SET(&ev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, NULL);
+            kevent(t->event_fd, &ev, 1, NULL, 0, NULL);
+            return fd;
+        }
+#else
+        int fd = inotify_add_watch(t->event_fd, path, IN_CREATE | IN_MOVED_TO);
+        if (fd >= 0) return fd;
+#endif
+        if (errno != ENOENT || strcmp(path, "/") == 0 || strcmp(path, ".") == 0) return -1;
+        char up[1024];
+        strcpy(up, path);
+        strcpy(path, dirname(up));
+        *exact = 0;
+    }
+}
+
+/* Missing files can only show up through their directory: watch the parents
+ * of those, and nothing else, so unrelated /tmp churn doesn't wake us. A
+ * parent that doesn't exist yet is waited for through its nearest existing
+ * ancestor, and the watches are redone on every scan until it appears. */
+static void update_dir_watches(RSimLogTail *t) {
+    uint32_t mask = 0;
+    for (int i = 0; i < t->count; i++)
+        if (t->files[i].fd < 0) mask |= 1u << i;
+    if (mask == t->missing_mask && t->dir_count >= 0 && !t->dirs_pending) return;
+    t->missing_mask = mask;
+    t->dirs_pending = 0;
+
+    for (int i = 0; i < t->dir_count; i++) {
+#ifdef RSIM_LOGTAIL_KQUEUE
+        close(t->dir_fds[i]);
+#else
+        inotify_rm_watch(t->event_fd, t->dir_fds[i]);
+#endif
+    }
+    t->dir_count = 0;
+
+    char dirs[RSIM_LOGTAIL_MAX_FILES][1024];
+    for (int i = 0; i < t->count; i++) {
+        if (!(mask & (1u << i))) continue;
+        char copy[1024];
+        strncpy(copy, t->files[i].path, sizeof(copy) - 1);
+        copy[sizeof(copy) - 1] = 0;
+        const char *dir = dirname(copy);
+        int seen = 0;
+        for (int d = 0; d < t->dir_count && !seen; d++) seen = strcmp(dirs[d], dir) == 0;
+        if (seen) continue;
+        int exact, fd = watch_dir(t, dir, &exact);
+        if (!exact) t->dirs_pending = 1;
+        if (fd < 0) continue;
+        strcpy(dirs[t->dir_count], dir);
+        t->dir_fds[t->dir_count++] = fd;
+    }
+}
+
+/* Pick up new bytes, new files, replacements and truncations */
+static int scan(RSimLogTail *t) {
+    double arrival = now_epoch();
+    int queued = 0;
+    for (int i = 0; i < t->count; i++) {
+        RSimLogFile *f = &t->files[i];
+        if (f->fd >= 0) {
+            struct stat st;
+            if (stat(f->path, &st) != 0 || st.st_dev != f->dev || st.st_ino != f->ino) {
+                /* Replaced or gone: finish the old file, then start over */
+                struct stat old;
+                if (fstat(f->fd, &old) == 0) queued += read_range(t, i, old.st_size, arrival);
+                double last = 0;
+                queued += emit_lines(t, i, arrival, &last, 1);
+                close_file(t, f);
+            }
+        }
+        if (f->fd < 0 && !open_file(t, f)) continue;
+
+        struct stat st;
+        if (fstat(f->fd, &st) != 0) continue;
+        if (st.st_size < f->offset) {
+            f->offset = 0;      /* truncated */
+            f->partial_len = 0;
+        }
+        queued += read_range(t, i, st.st_size, arrival);
+    }
+    update_dir_watches(t);
+    return queued;
+}
+
+/* ================================================================
+ * API
+ * ================================================================ */
+
+int rsim_logtail_init(RSimLogTail *t) {
+    memset(t, 0, sizeof(*t));
+    t->dir_count = -1;      /* forces the first update_dir_watches */
+#ifdef RSIM_LOGTAIL_KQUEUE
+    t->event_fd = kqueue();
+#else
+    t->event_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    return t->event_fd >= 0 ? 0 : -1;
+}
+
+void rsim_logtail_close(RSimLogTail *t) {
+    for (int i = 0; i < t->count; i++) {
+        close_file(t, &t->files[i]);
+        free(t->files[i].partial);
+    }
+#ifdef RSIM_LOGTAIL_KQUEUE
+    for (int i = 0; i < t->dir_count; i++) close(t->dir_fds[i]);
+#endif
+    if (t->event_fd >= 0) close(t->event_fd);
+    for (size_t i = 0; i < t->line_count; i++) free(t->lines[i].text);
+    free(t->lines);
+    if (t->has_filter) regfree(&t->filter);
+    memset(t, 0, sizeof(*t));
+    t->event_fd = -1;
+}
+
+int rsim_logtail_add(RSimLogTail *t, const char *path, const char *label) {
+    if (t->count >= RSIM_LOGTAIL_MAX_FILES) return -1;
+    RSimLogFile *f = &t->files[t->count];
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+    f->watch = -1;
+    strncpy(f->path, path, sizeof(f->path) - 1);
+    strncpy(f->label, label, sizeof(f->label) - 1);
+    if (open_file(t, f)) {
+        struct stat st;
+        if (fstat(f->fd, &st) == 0) f->offset = st.st_size;
+    }
+    return t->count++;
+}
+
+int rsim_logtail_set_filter(RSimLogTail *t, const char *pattern, int ignore_case) {
+    if (t->has_filter) regfree(&t->filter);
+    t->has_filter = 0;
+    int err = regcomp(&t->filter, pattern, REG_EXTENDED | REG_NOSUB | (ignore_case ? REG_ICASE : 0));
+    if (!err) t->has_filter = 1;
+    return err;
+}
+
+/* Offset where the last max_lines lines of the file begin */
+static off_t tail_start(int fd, off_t size, int max_lines) {
+    char buf[READ_CHUNK];
+    off_t pos = size;
+    int newlines = 0;
+    while (pos > 0) {
+        size_t n = pos > READ_CHUNK ? READ_CHUNK : (size_t)pos;
+        pos -= (off_t)n;
+        if (pread(fd, buf, n, pos) != (ssize_t)n) return 0;
+        for (size_t i = n; i-- > 0;) {
+            /* A final newline ends the last line rather than starting one */
+            if (buf[i] == '\n' && pos + (off_t)i != size - 1 && ++newlines == max_lines)
+                return pos + (off_t)i + 1;
+        }
+    }
+    return 0;
+}
+
+void rsim_logtail_backlog(RSimLogTail *t, int max_lines) {
+    for (int i = 0; i < t->count; i++) {
+        RSimLogFile *f = &t->files[i];
+        if (f->fd < 0 && !open_file(t, f)) continue;
+        struct stat st;
+        if (fstat(f->fd, &st) != 0) continue;
+        f->partial_len = 0;
+        if (max_lines <= 0) {
+            f->offset = st.st_size;
+            continue;
+        }
+        f->offset = tail_start(f->fd, st.st_size, max_lines);
+        size_t first = t->line_count;
+        read_range(t, i, st.st_size, (double)st.st_mtime);
+
+        /* Lines before the first timestamped one belong with it, not at mtime */
+        size_t stamped = first;
+        while (stamped < t->line_count &&
+               rsim_log_parse_time(t->lines[stamped].text, t->lines[stamped].len) <= 0)
+            stamped++;
+        if (stamped < t->line_count)
+            for (size_t l = first; l < stamped; l++) t->lines[l].time = t->lines[stamped].time;
+    }
+    update_dir_watches(t);
+}
+
+int rsim_logtail_wait(RSimLogTail *t, int timeout_ms) {
+#ifdef RSIM_LOGTAIL_KQUEUE
+    struct kevent events[RSIM_LOGTAIL_MAX_FILES * 2];
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    int n = kevent(t->event_fd, NULL, 0, events, RSIM_LOGTAIL_MAX_FILES * 2, timeout_ms < 0 ? NULL : &ts);
+    if (n < 0 && errno != EINTR) return -1;
+#else
+    struct pollfd pfd = { t->event_fd, POLLIN, 0 };
+    int n = poll(&pfd, 1, timeout_ms);
+    if (n < 0 && errno != EINTR) return -1;
+    char buf[4096];
+    while (read(t->event_fd, buf, sizeof(buf)) > 0) { }     /* events only wake us; scan() decides */
+#endif
+    return n > 0 ? scan(t) : 0;
+}
+
+static int compare_lines(const void *a, const void *b) {
+    const RSimLogLine *x = a, *y = b;
+    if (x->time != y->time) return x->time < y->time ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+void rsim_logtail_drain(RSimLogTail *t, RSimLogLineFn fn, void *ctx) {
+    qsort(t->lines, t->line_count, sizeof(*t->lines), compare_lines);
+    for (size_t i = 0; i < t->line_count; i++) {
+        fn(t, &t->lines[i], ctx);
+        free(t->lines[i].text);
+    }
+    t->line_count = 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * rosettasim_logtail.h — Follow several log files at once (portable C)
+ *
+ * Watches a set of files with kqueue vnode events (inotify on Linux), reads
+ * only the appended bytes with pread, and hands back complete lines merged
+ * by timestamp. Blocks in the kernel while nothing is written, so an idle
+ * follow costs no CPU.
+ *
+ * Timestamps are parsed from the start of each line (NSLog / ISO 8601
+ * "YYYY-MM-DD HH:MM:SS[.fff]", or syslog "Mon DD HH:MM:SS"). A line without
+ * one takes the previous line's from the same read (continuation lines),
+ * else the time it was read — the file's mtime for the initial backlog.
+ * Ordering is exact within one batch; a line written late with an old
+ * timestamp is still printed after lines already returned.
+ *
+ * Files may be missing at start (their directory too), truncated, or
+ * replaced (rename / unlink + create): they are (re)opened when they
+ * appear. Used by rosettasim-ctl logs.
+ */
+
+#ifndef ROSETTASIM_LOGTAIL_H
+#define ROSETTASIM_LOGTAIL_H
+
+#include <regex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define RSIM_LOGTAIL_MAX_FILES  16
+
+typedef struct {
+    char        path[1024];
+    char        label[32];      /* shown in front of every line */
+    int         fd;             /* -1 while the file doesn't exist */
+    int         watch;          /* inotify watch descriptor (Linux) */
+    dev_t       dev;
+    ino_t       ino;
+    off_t       offset;         /* bytes consumed */
+    char       *partial;        /* trailing bytes without a newline yet */
+    size_t      partial_len;
+    size_t      partial_cap;
+} RSimLogFile;
+
+typedef struct {
+    double      time;           /* seconds since 1970 */
+    int         file;           /* index into RSimLogTail.files */
+    uint64_t    seq;            /* arrival order, ties keep file order */
+    char       *text;           /* NUL-terminated, no newline */
+    size_t      len;
+} RSimLogLine;
+
+typedef struct {
+    RSimLogFile files[RSIM_LOGTAIL_MAX_FILES];
+    int         count;
+    int         event_fd;       /* kqueue / inotify instance */
+    int         dir_fds[RSIM_LOGTAIL_MAX_FILES];    /* parents of missing files (fd / inotify wd) */
+    int         dir_count;
+    uint32_t    missing_mask;   /* files that didn't exist at the last scan */
+    int         dirs_pending;   /* a parent is missing too: an ancestor is watched */
+    RSimLogLine *lines;         /* pending batch */
+    size_t      line_count;
+    size_t      line_capacity;
+    uint64_t    next_seq;
+    regex_t     filter;
+    int         has_filter;
+} RSimLogTail;
+
+typedef void (*RSimLogLineFn)(const RSimLogTail *tail, const RSimLogLine *line, void *ctx);
+
+/* Returns 0, or -1 if no kqueue/inotify instance could be created (errno). */
+int  rsim_logtail_init(RSimLogTail *tail);
+void rsim_logtail_close(RSimLogTail *tail);
+
+/* Watch path (need not exist yet) from its current end; files that appear
+ * later are read from the start. Returns the file index or -1 when full. */
+int  rsim_logtail_add(RSimLogTail *tail, const char *path, const char *label);
+
+/* Only keep lines matching an extended regex. Returns 0 or a regcomp error. */
+int  rsim_logtail_set_filter(RSimLogTail *tail, const char *pattern, int ignore_case);
+
+/* Queue the last max_lines of every file (0: none, just seek to the end). */
+void rsim_logtail_backlog(RSimLogTail *tail, int max_lines);
+
+/* Sleep until a watched file changes (or timeout_ms; -1 waits forever),
+ * then queue what was appended. Returns the number of lines queued, or -1. */
+int  rsim_logtail_wait(RSimLogTail *tail, int timeout_ms);
+
+/* Hand queued lines to fn in timestamp order and clear the batch. */
+void rsim_logtail_drain(RSimLogTail *tail, RSimLogLineFn fn, void *ctx);
+
+/* Timestamp at the start of a line, or 0 if it has none. */
+double rsim_log_parse_time(const char *line, size_t len);
+
+#endif /* ROSETTASIM_LOGTAIL_H */
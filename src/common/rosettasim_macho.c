@@ -0,0 +1,232 @@
+/*
+ * rosettasim_macho.c — Minimal Mach-O reader / dylib patcher (see rosettasim_macho.h)
+ */
+
+#include "rosettasim_macho.h"
+
+#include <string.h>
+
+#define MH_MAGIC            0xfeedfaceu
+#define MH_MAGIC_64         0xfeedfacfu
+#define FAT_MAGIC           0xcafebabeu
+#define FAT_MAGIC_64        0xcafebabfu
+#define LC_SEGMENT          0x1u
+#define LC_SEGMENT_64       0x19u
+#define LC_REQ_DYLD         0x80000000u
+#define LC_LOAD_DYLIB       0xcu
+#define LC_LOAD_WEAK_DYLIB  (0x18u | LC_REQ_DYLD)
+#define LC_REEXPORT_DYLIB   (0x1fu | LC_REQ_DYLD)
+#define LC_LAZY_LOAD_DYLIB  0x20u
+#define LC_LOAD_UPWARD_DYLIB (0x23u | LC_REQ_DYLD)
+
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t le64(const uint8_t *p) {
+    return (uint64_t)le32(p) | (uint64_t)le32(p + 4) << 32;
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t be32(const uint8_t *p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t be64(const uint8_t *p) {
+    return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+int rsim_macho_sniff(const uint8_t *head, size_t len) {
+    if (len < 8) return 0;
+    uint32_t magic = le32(head);
+    if (magic == MH_MAGIC || magic == MH_MAGIC_64) return 1;
+    magic = be32(head);
+    if (magic == FAT_MAGIC || magic == FAT_MAGIC_64) {
+        uint32_t n = be32(head + 4);
+        return n > 0 && n <= RSIM_MACHO_MAX_SLICES;
+    }
+    return 0;
+}
+
+static int thin_slice(const uint8_t *image, size_t size, uint64_t offset, uint64_t slice_size,
+                      RSimMachOSlice *out) {
+    if (offset > size || size - offset < 28 || slice_size < 28) return 0;
+    uint32_t magic = le32(image + offset);
+    if (magic != MH_MAGIC && magic != MH_MAGIC_64) return 0;
+    out->cputype = le32(image + offset + 4);
+    out->cpusubtype = le32(image + offset + 8);
+    out->offset = offset;
+    out->size = slice_size;
+    out->is64 = magic == MH_MAGIC_64;
+    return 1;
+}
+
+int rsim_macho_slices(const uint8_t *image, size_t size, RSimMachOSlice *out, int max) {
+    if (size < 8 || max <= 0) return 0;
+    uint32_t magic = be32(image);
+    if (magic != FAT_MAGIC && magic != FAT_MAGIC_64)
+        return thin_slice(image, size, 0, size, out);
+
+    int fat64 = magic == FAT_MAGIC_64;
+    uint32_t n = be32(image + 4);
+    size_t entry = fat64 ? 32 : 20;     /* fat_arch_64 / fat_arch */
+    if (n == 0 || n > RSIM_MACHO_MAX_SLICES || 8 + n * entry > size) return 0;
+    int count = 0;
+    for (uint32_t i = 0; i < n && count < max; i++) {
+        const uint8_t *a = image + 8 + i * entry;
+        uint64_t offset = fat64 ? be64(a + 8) : be32(a + 8);
+        uint64_t slice_size = fat64 ? be64(a + 16) : be32(a + 12);
+        if (offset > size || slice_size > size - offset) continue;
+        count += thin_slice(image, size, offset, slice_size, &out[count]);
+    }
+    return count;
+}
+
+const RSimMachOSlice *rsim_macho_find_slice(const RSimMachOSlice *slices, int count, uint32_t cputype) {
+    for (int i = 0; i < count; i++)
+        if (slices[i].cputype == cputype) return &slices[i];
+    return NULL;
+}
+
+int rsim_macho_segment(const uint8_t *image, size_t size, const RSimMachOSlice *slice,
+                       const char *name, uint64_t *fileoff, uint64_t *filesize) {
+    const uint8_t *base = image + slice->offset;
+    uint64_t avail = slice->size < size - slice->offset ? slice->size : size - slice->offset;
+    size_t header = slice->is64 ? 32 : 28;
+    uint32_t ncmds = le32(base + 16), sizeofcmds = le32(base + 20);
+    if (header + (uint64_t)sizeofcmds > avail) return -1;
+
+    uint64_t p = header, end = header + sizeofcmds;
+    for (uint32_t i = 0; i < ncmds && p + 8 <= end; i++) {
+        uint32_t cmd = le32(base + p), cmdsize = le32(base + p + 4);
+        if (cmdsize < 8 || p + cmdsize > end) return -1;
+        if ((cmd == LC_SEGMENT_64 && cmdsize >= 72) || (cmd == LC_SEGMENT && cmdsize >= 56)) {
+            char segname[17];
+            memcpy(segname, base + p + 8, 16);
+            segname[16] = 0;
+            if (strcmp(segname, name) == 0) {
+                if (cmd == LC_SEGMENT_64) {
+                    *fileoff = le64(base + p + 40);
+                    *filesize = le64(base + p + 48);
+                } else {
+                    *fileoff = le32(base + p + 32);
+                    *filesize = le32(base + p + 36);
+                }
+                return *fileoff <= avail && *filesize <= avail - *fileoff ? 0 : -1;
+            }
+        }
+        p += cmdsize;
+    }
+    return -1;
+}
+
+/* Load command area of a slice: base, header size and [header, end) bounds */
+typedef struct {
+    const uint8_t  *base;
+    uint64_t        avail;          /* bytes of the slice inside the image */
+    uint32_t        header;
+    uint32_t        ncmds;
+    uint64_t        end;            /* header + sizeofcmds */
+} LoadCommands;
+
+static int load_commands(const uint8_t *image, size_t size, const RSimMachOSlice *slice, LoadCommands *lc) {
+    if (slice->offset > size) return -1;
+    lc->base = image + slice->offset;
+    lc->avail = slice->size < size - slice->offset ? slice->size : size - slice->offset;
+    lc->header = slice->is64 ? 32 : 28;
+    if (lc->avail < lc->header) return -1;
+    lc->ncmds = le32(lc->base + 16);
+    lc->end = lc->header + (uint64_t)le32(lc->base + 20);
+    return lc->end <= lc->avail ? 0 : -1;
+}
+
+static int is_dylib_load(uint32_t cmd) {
+    return cmd == LC_LOAD_DYLIB || cmd == LC_LOAD_WEAK_DYLIB || cmd == LC_REEXPORT_DYLIB ||
+           cmd == LC_LAZY_LOAD_DYLIB || cmd == LC_LOAD_UPWARD_DYLIB;
+}
+
+int rsim_macho_has_dylib(const uint8_t *image, size_t size, const RSimMachOSlice *slice, const char *path) {
+    LoadCommands lc;
+    if (load_commands(image, size, slice, &lc) != 0) return -1;
+    size_t want = strlen(path);
+    uint64_t p = lc.header;
+    for (uint32_t i = 0; i < lc.ncmds; i++) {
+        if (p + 8 > lc.end) return -1;
+        uint32_t cmd = le32(lc.base + p), cmdsize = le32(lc.base + p + 4);
+        if (cmdsize < 8 || p + cmdsize > lc.end) return -1;
+        if (is_dylib_load(cmd) && cmdsize >= 24) {
+            uint32_t name = le32(lc.base + p + 8);
+            if (name < cmdsize) {
+                const char *s = (const char *)lc.base + p + name;
+                size_t max = cmdsize - name;
+                if (strnlen(s, max) == want && memcmp(s, path, want) == 0) return 1;
+            }
+        }
+        p += cmdsize;
+    }
+    return 0;
+}
+
+long rsim_macho_header_room(const uint8_t *image, size_t size, const RSimMachOSlice *slice) {
+    LoadCommands lc;
+    if (load_commands(image, size, slice, &lc) != 0) return -1;
+    /* The first thing after the commands: lowest non-zero section offset, or
+     * the file offset of any segment that doesn't start at 0 */
+    uint64_t first = lc.avail;
+    uint64_t p = lc.header;
+    for (uint32_t i = 0; i < lc.ncmds; i++) {
+        if (p + 8 > lc.end) return -1;
+        uint32_t cmd = le32(lc.base + p), cmdsize = le32(lc.base + p + 4);
+        if (cmdsize < 8 || p + cmdsize > lc.end) return -1;
+        int seg64 = cmd == LC_SEGMENT_64;
+        if ((seg64 && cmdsize >= 72) || (cmd == LC_SEGMENT && cmdsize >= 56)) {
+            uint64_t fileoff = seg64 ? le64(lc.base + p + 40) : le32(lc.base + p + 32);
+            uint64_t filesize = seg64 ? le64(lc.base + p + 48) : le32(lc.base + p + 36);
+            uint32_t nsects = le32(lc.base + p + (seg64 ? 64 : 48));
+            uint64_t sect = p + (seg64 ? 72 : 56), sectsize = seg64 ? 80 : 68;
+            if (fileoff > 0 && filesize > 0 && fileoff < first) first = fileoff;
+            for (uint32_t k = 0; k < nsects && sect + sectsize <= p + cmdsize; k++, sect += sectsize) {
+                uint32_t offset = le32(lc.base + sect + (seg64 ? 48 : 40));
+                uint32_t flags = le32(lc.base + sect + (seg64 ? 64 : 56));
+                /* zerofill sections (S_ZEROFILL/GB_ZEROFILL/TLV zerofill) have no file data */
+                uint32_t type = flags & 0xff;
+                if (offset > 0 && type != 0x1 && type != 0xc && type != 0x12 && offset < first) first = offset;
+            }
+        }
+        p += cmdsize;
+    }
+    return first >= lc.end ? (long)(first - lc.end) : -1;
+}
+
+int rsim_macho_add_dylib(uint8_t *image, size_t size, const RSimMachOSlice *slice, const char *path) {
+    int has = rsim_macho_has_dylib(image, size, slice, path);
+    if (has != 0) return has;
+    long room = rsim_macho_header_room(image, size, slice);
+    if (room < 0) return -1;
+
+    uint32_t align = slice->is64 ? 8 : 4;
+    uint32_t cmdsize = (uint32_t)((24 + strlen(path) + 1 + align - 1) & ~(size_t)(align - 1));
+    if ((long)cmdsize > room) return -2;
+
+    LoadCommands lc;
+    load_commands(image, size, slice, &lc);
+    uint8_t *base = image + slice->offset;
+    uint8_t *cmd = base + lc.end;
+    memset(cmd, 0, cmdsize);
+    put_le32(cmd, LC_LOAD_DYLIB);
+    put_le32(cmd + 4, cmdsize);
+    put_le32(cmd + 8, 24);              /* dylib.name.offset */
+    put_le32(cmd + 12, 2);              /* timestamp, as ld writes it */
+    put_le32(cmd + 16, 0x10000);        /* current_version 1.0.0 */
+    put_le32(cmd + 20, 0x10000);        /* compatibility_version 1.0.0 */
+    memcpy(cmd + 24, path, strlen(path));
+    put_le32(base + 16, lc.ncmds + 1);
+    put_le32(base + 20, (uint32_t)(lc.end - lc.header) + cmdsize);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * rosettasim_macho.h — Minimal Mach-O reader / dylib patcher for runtime binaries (portable C)
+ *
+ * Just enough Mach-O to find things in simulator runtime files: the
+ * architecture slices of thin and fat (32/64-bit fat header) files, a
+ * named segment within a slice, and the dylibs a slice loads — plus adding
+ * an LC_LOAD_DYLIB in the header padding, which is what insert_dylib does
+ * for the deploy targets. Works on an in-memory image (read or mmap'd);
+ * every offset is bounds-checked against the buffer, so truncated or
+ * foreign files simply don't match. Needs no Apple headers.
+ */
+
+#ifndef ROSETTASIM_MACHO_H
+#define ROSETTASIM_MACHO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_CPU_X86        0x00000007u
+#define RSIM_CPU_X86_64     0x01000007u
+#define RSIM_CPU_ARM64      0x0100000cu
+
+#define RSIM_MACHO_MAX_SLICES   8
+
+typedef struct {
+    uint32_t    cputype;
+    uint32_t    cpusubtype;
+    uint64_t    offset;         /* of the slice's mach_header in the file */
+    uint64_t    size;
+    int         is64;
+} RSimMachOSlice;
+
+/* Cheap check on the first bytes of a file: thin Mach-O (either width) or a
+ * fat header with a plausible slice count (0xcafebabe is also Java's magic). */
+int rsim_macho_sniff(const uint8_t *head, size_t len);
+
+/* Slices of a thin or fat image, up to max. Returns the count, 0 if not Mach-O. */
+int rsim_macho_slices(const uint8_t *image, size_t size, RSimMachOSlice *out, int max);
+
+/* The slice for cputype, or NULL */
+const RSimMachOSlice *rsim_macho_find_slice(const RSimMachOSlice *slices, int count, uint32_t cputype);
+
+/* File range (relative to the slice) of segment `name`. Returns 0 or -1. */
+int rsim_macho_segment(const uint8_t *image, size_t size, const RSimMachOSlice *slice,
+                       const char *name, uint64_t *fileoff, uint64_t *filesize);
+
+/* Whether the slice already loads dylib `path` (LC_LOAD_DYLIB, weak,
+ * reexport, lazy or upward). 1 yes, 0 no, -1 malformed. */
+int rsim_macho_has_dylib(const uint8_t *image, size_t size, const RSimMachOSlice *slice, const char *path);
+
+/* Free bytes between the end of the load commands and the first section
+ * or segment data, or -1 if malformed. */
+long rsim_macho_header_room(const uint8_t *image, size_t size, const RSimMachOSlice *slice);
+
+/* Append an LC_LOAD_DYLIB for path in place (image must be writable). Like
+ * insert_dylib --no-strip-codesig the code signature is left alone: the
+ * caller re-signs where the runtime enforces it. Returns 0, 1 if the slice
+ * already loads it, -1 if malformed, -2 if the header padding is too small. */
+int rsim_macho_add_dylib(uint8_t *image, size_t size, const RSimMachOSlice *slice, const char *path);
+
+#endif /* ROSETTASIM_MACHO_H */
@@ -0,0 +1,57 @@
+/*
+ * rosettasim_match.h — Template matching on framebuffer luma (portable C)
+ *
+ * Locates a template image inside a frame with normalized cross-correlation.
+ * The search runs coarse-to-fine over a 2x box-filtered pyramid: the full NCC
+ * map is only computed at the coarsest level, and the best candidates are then
+ * refined in a small neighbourhood at each finer level. Level-l pixels average
+ * 2^l x 2^l blocks; the right and bottom edges average partial blocks.
+ *
+ * All coordinates are in pixels of the level-0 (input) images. Callers convert
+ * to points by dividing by the device scale.
+ *
+ * Used by rosettasim-ctl find/tapon; no Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_MATCH_H
+#define ROSETTASIM_MATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Single-channel float image (luma 0..255) */
+typedef struct {
+    float   *px;
+    int      width;
+    int      height;
+} RSimGray;
+
+typedef struct {
+    int      x;         /* top-left, pixels */
+    int      y;
+    int      width;     /* template size, pixels */
+    int      height;
+    float    score;     /* NCC in [-1, 1] */
+} RSimMatch;
+
+/* Convert BGRA (kCGBitmapByteOrder32Little | premultiplied first) to luma.
+ * Returns 0 on success, -1 on allocation failure. */
+int  rsim_gray_from_bgra(RSimGray *out, const uint8_t *bgra,
+                         int width, int height, size_t bytes_per_row);
+
+/* 2x2 box downsample. Returns 0 on success, -1 if the input is too small. */
+int  rsim_gray_downsample(RSimGray *out, const RSimGray *in);
+
+void rsim_gray_free(RSimGray *img);
+
+/* Find up to max_matches non-overlapping occurrences of tmpl in frame with
+ * score >= threshold, best first. Returns the number found, or -1 on error. */
+int  rsim_match_template(const RSimGray *frame, const RSimGray *tmpl,
+                         float threshold, RSimMatch *matches, int max_matches);
+
+/* Same search straight from a BGRA frame (no full-resolution luma copy). */
+int  rsim_match_bgra(const uint8_t *bgra, int width, int height, size_t bytes_per_row,
+                     const RSimGray *tmpl, float threshold,
+                     RSimMatch *matches, int max_matches);
+
+#endif /* ROSETTASIM_MATCH_H */
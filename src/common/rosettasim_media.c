@@ -0,0 +1,569 @@
+/*
+ * rosettasim_media.c — Bulk media import for legacy Photos libraries
+ *
+ * See rosettasim_media.h for the stages.
+ */
+
+#include "rosettasim_media.h"
+#include "rosettasim_jpeg.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+
+#define DCIM_DIRECTORY      "DCIM/100APPLE"     /* ZDIRECTORY, relative to Media/ */
+#define CORE_DATA_EPOCH     978307200.0         /* 2001-01-01 in Unix seconds */
+#define THUMB_QUALITY       80
+
+/* ================================================================
+ * Assets
+ * ================================================================ */
+
+static const struct {
+    const char     *ext;
+    RSimMediaKind   kind;
+    const char     *uti;
+} kTypes[] = {
+    { "jpg",  RSIM_MEDIA_PHOTO, "public.jpeg" },
+    { "jpeg", RSIM_MEDIA_PHOTO, "public.jpeg" },
+    { "png",  RSIM_MEDIA_PHOTO, "public.png" },
+    { "heic", RSIM_MEDIA_PHOTO, "public.heic" },
+    { "gif",  RSIM_MEDIA_PHOTO, "com.compuserve.gif" },
+    { "tif",  RSIM_MEDIA_PHOTO, "public.tiff" },
+    { "tiff", RSIM_MEDIA_PHOTO, "public.tiff" },
+    { "mov",  RSIM_MEDIA_VIDEO, "com.apple.quicktime-movie" },
+    { "mp4",  RSIM_MEDIA_VIDEO, "public.mpeg-4" },
+    { "m4v",  RSIM_MEDIA_VIDEO, "com.apple.m4v-video" },
+};
+
+static void random_bytes(unsigned char *buf, size_t len) {
+#ifdef __APPLE__
+    arc4random_buf(buf, len);
+#else
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    ssize_t n = fd >= 0 ? read(fd, buf, len) : -1;
+    if (fd >= 0) close(fd);
+    if (n != (ssize_t)len) {
+        static unsigned seed;
+        if (!seed) seed = (unsigned)time(NULL) ^ (unsigned)getpid();
+        for (size_t i = 0; i < len; i++) buf[i] = (unsigned char)rand_r(&seed);
+    }
+#endif
+}
+
+static void make_uuid(char out[37]) {
+    unsigned char b[16];
+    random_bytes(b, sizeof(b));
+    b[6] = (b[6] & 0x0f) | 0x40;            /* version 4 */
+    b[8] = (b[8] & 0x3f) | 0x80;
+    snprintf(out, 37, "%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+             b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+             b[8], b[9], b[10], b[11], b[12], b[13], b[14], b[15]);
+}
+
+int rsim_media_asset_init(RSimMediaAsset *asset, const char *src) {
+    memset(asset, 0, sizeof(*asset));
+    asset->src = src;
+    struct stat st;
+    if (stat(src, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    const char *slash = strrchr(src, '/');
+    snprintf(asset->name, sizeof(asset->name), "%s", slash ? slash + 1 : src);
+    asset->size = (long long)st.st_size;
+    asset->created = (double)st.st_mtime;
+    asset->kind = RSIM_MEDIA_PHOTO;
+    asset->uti = "public.image";
+    const char *dot = strrchr(asset->name, '.');
+    for (size_t i = 0; dot && i < sizeof(kTypes) / sizeof(kTypes[0]); i++) {
+        if (strcasecmp(dot + 1, kTypes[i].ext) == 0) {
+            asset->kind = kTypes[i].kind;
+            asset->uti = kTypes[i].uti;
+            break;
+        }
+    }
+    make_uuid(asset->uuid);
+    return 0;
+}
+
+/* ================================================================
+ * Files
+ * ================================================================ */
+
+static void mkdirs(const char *dir) {
+    char path[1400];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    mkdir(path, 0755);
+}
+
+/* Temp name next to path, unique to this process and asset */
+static void temp_name(char *tmp, size_t size, const char *path, size_t job) {
+    snprintf(tmp, size, "%s.rsimtmp-%ld-%zu", path, (long)getpid(), job);
+}
+
+/* Clone where the filesystem can (APFS), else copy; via a temp name + rename.
+ * Returns 1 if cloned, 0 if copied, -1 on failure. */
+static int copy_file(const char *src, const char *dst, size_t job) {
+    char tmp[1500];
+    temp_name(tmp, sizeof(tmp), dst, job);
+    unlink(tmp);
+#ifdef __APPLE__
+    if (clonefile(src, tmp, 0) == 0) return rename(tmp, dst) == 0 ? 1 : (unlink(tmp), -1);
+#endif
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    char buf[1 << 16];
+    ssize_t n;
+    int ok = 1;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+        if (write(out, buf, (size_t)n) != n) { ok = 0; break; }
+    if (n < 0) ok = 0;
+    close(in);
+    if (close(out) != 0) ok = 0;
+    if (ok && rename(tmp, dst) == 0) return 0;
+    unlink(tmp);
+    return -1;
+}
+
+static int write_file(const char *path, const uint8_t *data, size_t size, size_t job) {
+    char tmp[1600];
+    temp_name(tmp, sizeof(tmp), path, job);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    int ok = fwrite(data, 1, size, f) == size;
+    if (fclose(f) != 0) ok = 0;
+    if (ok && rename(tmp, path) == 0) return 0;
+    unlink(tmp);
+    return -1;
+}
+
+/* ================================================================
+ * Thumbnails
+ * ================================================================ */
+
+/* Bilinear resample to exactly dw x dh. Used after the power-of-two box
+ * shrink, so the remaining ratio is under 2 and bilinear doesn't alias. */
+static void resample(const RSimBitmap *src, uint8_t *dst, int dw, int dh) {
+    double sx = (double)src->width / dw, sy = (double)src->height / dh;
+    for (int y = 0; y < dh; y++) {
+        double fy = (y + 0.5) * sy - 0.5;
+        int y0 = fy < 0 ? 0 : (int)fy;
+        int y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        double wy = fy - y0;
+        if (wy < 0) wy = 0;
+        const uint8_t *r0 = src->px + (size_t)y0 * src->bytes_per_row;
+        const uint8_t *r1 = src->px + (size_t)y1 * src->bytes_per_row;
+        uint8_t *out = dst + (size_t)y * dw * 4;
+        for (int x = 0; x < dw; x++) {
+            double fx = (x + 0.5) * sx - 0.5;
+            int x0 = fx < 0 ? 0 : (int)fx;
+            int x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            double wx = fx - x0;
+            if (wx < 0) wx = 0;
+            for (int c = 0; c < 4; c++) {
+                double top = r0[x0 * 4 + c] + (r0[x1 * 4 + c] - r0[x0 * 4 + c]) * wx;
+                double bot = r1[x0 * 4 + c] + (r1[x1 * 4 + c] - r1[x0 * 4 + c]) * wx;
+                out[x * 4 + c] = (uint8_t)(top + (bot - top) * wy + 0.5);
+            }
+        }
+    }
+}
+
+int rsim_media_thumbnail(const RSimBitmap *src, int size, int quality,
+                         uint8_t **jpeg, size_t *jpeg_size) {
+    if (!src || !src->px || src->width < 1 || src->height < 1 || size < 1) return -1;
+    int longest = src->width > src->height ? src->width : src->height;
+    int dw = src->width, dh = src->height;
+    if (longest > size) {
+        dw = (int)((double)src->width * size / longest + 0.5);
+        dh = (int)((double)src->height * size / longest + 0.5);
+        if (dw < 1) dw = 1;
+        if (dh < 1) dh = 1;
+    }
+
+    RSimBitmap shrunk = {0};
+    int factor = rsim_shrink_factor(src->width, src->height, dw, dh);
+    if (rsim_bgra_shrink(src->px, src->width, src->height, src->bytes_per_row, factor, &shrunk) != 0)
+        return -1;
+    int rc = -1;
+    uint8_t *px = malloc((size_t)dw * dh * 4);
+    if (px) {
+        resample(&shrunk, px, dw, dh);
+        rc = rsim_jpeg_encode_bgra(px, dw, dh, (size_t)dw * 4, quality, jpeg, jpeg_size);
+    }
+    free(px);
+    rsim_bitmap_free(&shrunk);
+    return rc;
+}
+
+/* ================================================================
+ * Copy + thumbnail pool
+ * ================================================================ */
+
+typedef struct {
+    RSimMediaAsset              *assets;
+    size_t                       count;
+    size_t                       next;
+    const RSimMediaImportOpts   *opts;
+    int                          thumb_size;
+    RSimMediaStats              *stats;
+    pthread_mutex_t              lock;
+} Pool;
+
+static void import_one(Pool *pool, size_t index, RSimBitmap *scratch) {
+    const RSimMediaImportOpts *o = pool->opts;
+    RSimMediaAsset *a = &pool->assets[index];
+    char path[1400];
+    snprintf(path, sizeof(path), "%s/" RSIM_MEDIA_DCIM_DIR "/%s", o->device_root, a->name);
+    int rc = copy_file(a->src, path, index);
+    if (rc < 0) {
+        snprintf(a->error, sizeof(a->error), "copy failed: %s", strerror(errno));
+        pthread_mutex_lock(&pool->lock);
+        pool->stats->failed++;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+    a->copied = 1;
+
+    int thumbed = 0;
+    if (o->decode && a->kind == RSIM_MEDIA_PHOTO &&
+        o->decode(a->src, pool->thumb_size, scratch, &a->width, &a->height, o->decode_ctx) == 0) {
+        uint8_t *jpeg = NULL;
+        size_t jpeg_size = 0;
+        if (rsim_media_thumbnail(scratch, pool->thumb_size, THUMB_QUALITY, &jpeg, &jpeg_size) == 0) {
+            char dir[1400], file[1500];
+            snprintf(dir, sizeof(dir), "%s/" RSIM_MEDIA_THUMB_DIR "/" DCIM_DIRECTORY "/%s", o->device_root, a->name);
+            mkdirs(dir);
+            snprintf(file, sizeof(file), "%s/" RSIM_MEDIA_THUMB_NAME, dir);
+            thumbed = write_file(file, jpeg, jpeg_size, index) == 0;
+        }
+        free(jpeg);
+    }
+    a->thumbnailed = thumbed;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats->copied++;
+    pool->stats->cloned += rc == 1;
+    pool->stats->thumbnailed += thumbed;
+    pool->stats->bytes += a->size;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void *pool_worker(void *arg) {
+    Pool *pool = arg;
+    RSimBitmap scratch = {0};       /* decode buffer, reused across assets */
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) break;
+        import_one(pool, i, &scratch);
+    }
+    rsim_bitmap_free(&scratch);
+    return NULL;
+}
+
+/* ================================================================
+ * DCIM names
+ * ================================================================ */
+
+/* Names taken so far, compared without case like the APFS volume they end
+ * up on: open addressing, grown at half full. Existing DCIM entries are
+ * owned (strdup'd); the assets' names are borrowed. */
+typedef struct {
+    const char    **slots;
+    size_t          mask, used;
+    char          **owned;
+    size_t          owned_count;
+} NameSet;
+
+static size_t name_hash(const char *name) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (const unsigned char *c = (const unsigned char *)name; *c; c++)
+        h = (h ^ (uint64_t)(*c >= 'A' && *c <= 'Z' ? *c + 32 : *c)) * 0x100000001b3ull;
+    return (size_t)h;
+}
+
+static int name_taken(const NameSet *set, const char *name) {
+    for (size_t i = name_hash(name) & set->mask; set->slots[i]; i = (i + 1) & set->mask)
+        if (strcasecmp(set->slots[i], name) == 0) return 1;
+    return 0;
+}
+
+static int name_add(NameSet *set, const char *name) {
+    if ((set->used + 1) * 2 > set->mask + 1) {
+        NameSet grown = *set;
+        grown.mask = set->mask * 2 + 1;
+        grown.used = 0;
+        grown.slots = calloc(grown.mask + 1, sizeof(*grown.slots));
+        if (!grown.slots) return -1;
+        for (size_t i = 0; i <= set->mask; i++)
+            if (set->slots[i]) name_add(&grown, set->slots[i]);
+        free(set->slots);
+        *set = grown;
+    }
+    size_t i = name_hash(name) & set->mask;
+    while (set->slots[i]) i = (i + 1) & set->mask;
+    set->slots[i] = name;
+    set->used++;
+    return 0;
+}
+
+/* Rename assets whose DCIM name is already used, by a file in DCIM or an
+ * earlier asset in the batch, to IMG_0001-1.JPG, IMG_0001-2.JPG, ... so no
+ * two copies (or their temp files) write the same path and nothing in the
+ * library is replaced. Runs before the pool starts. */
+static int assign_names(RSimMediaAsset *assets, size_t count, const char *dcim) {
+    NameSet set = { NULL, 63, 0, NULL, 0 };
+    set.slots = calloc(set.mask + 1, sizeof(*set.slots));
+    int ok = set.slots != NULL;
+    DIR *dir = ok ? opendir(dcim) : NULL;
+    for (struct dirent *e; ok && dir && (e = readdir(dir));) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char **grown = realloc(set.owned, (set.owned_count + 1) * sizeof(char *));
+        char *name = grown ? strdup(e->d_name) : NULL;
+        if (grown) set.owned = grown;
+        ok = name && name_add(&set, name) == 0;
+        if (name) set.owned[set.owned_count++] = name;
+    }
+    if (dir) closedir(dir);
+
+    for (size_t i = 0; ok && i < count; i++) {
+        RSimMediaAsset *a = &assets[i];
+        char base[256], ext[64] = "";
+        snprintf(base, sizeof(base), "%s", a->name);
+        char *dot = strrchr(base, '.');
+        if (dot && dot != base && strlen(dot) < sizeof(ext)) {
+            snprintf(ext, sizeof(ext), "%s", dot);
+            *dot = 0;
+        }
+        for (int n = 1; name_taken(&set, a->name); n++) {
+            char suffix[80];
+            snprintf(suffix, sizeof(suffix), "-%d%s", n, ext);
+            int keep = (int)(sizeof(a->name) - 1 - strlen(suffix));
+            snprintf(a->name, sizeof(a->name), "%.*s%s", keep, base, suffix);
+        }
+        ok = name_add(&set, a->name) == 0;
+    }
+    for (size_t i = 0; i < set.owned_count; i++) free(set.owned[i]);
+    free(set.owned);
+    free(set.slots);
+    return ok ? 0 : -1;
+}
+
+int rsim_media_import(RSimMediaAsset *assets, size_t count, const RSimMediaImportOpts *opts,
+                      RSimMediaStats *stats) {
+    RSimMediaStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+
+    char dcim[1200];
+    snprintf(dcim, sizeof(dcim), "%s/" RSIM_MEDIA_DCIM_DIR, opts->device_root);
+    mkdirs(dcim);
+    if (assign_names(assets, count, dcim) != 0) {
+        for (size_t i = 0; i < count; i++) snprintf(assets[i].error, sizeof(assets[i].error), "out of memory");
+        stats->failed = count;
+        return (int)count;
+    }
+
+    Pool pool = { assets, count, 0, opts, opts->thumb_size > 0 ? opts->thumb_size : RSIM_MEDIA_THUMB_SIZE,
+                  stats, PTHREAD_MUTEX_INITIALIZER };
+    int jobs = opts->jobs > 0 ? opts->jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if ((size_t)jobs > count) jobs = (int)count;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_t *threads = calloc((size_t)jobs + 1, sizeof(*threads));
+    int started = 0;
+    for (int i = 0; threads && i < jobs; i++)
+        if (pthread_create(&threads[i], NULL, pool_worker, &pool) == 0) started++;
+    if (!started) pool_worker(&pool);       /* no threads: do it here */
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    stats->copy_ms = (t1.tv_sec - t0.tv_sec) * 1000.0 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+    pthread_mutex_destroy(&pool.lock);
+    return (int)stats->failed;
+}
+
+/* ================================================================
+ * Photos.sqlite
+ * ================================================================ */
+
+/* Asset columns we can fill; written only if the runtime's table has them */
+typedef enum {
+    COL_PK, COL_ENT, COL_OPT, COL_UUID, COL_DIRECTORY, COL_FILENAME, COL_KIND, COL_KINDSUBTYPE,
+    COL_WIDTH, COL_HEIGHT, COL_ORIENTATION, COL_DATECREATED, COL_ADDEDDATE, COL_MODIFICATIONDATE,
+    COL_COMPLETE, COL_UTI, COL_HIDDEN, COL_TRASHEDSTATE, COL_COUNT,
+} Column;
+
+static const char *const kColumns[COL_COUNT] = {
+    "Z_PK", "Z_ENT", "Z_OPT", "ZUUID", "ZDIRECTORY", "ZFILENAME", "ZKIND", "ZKINDSUBTYPE",
+    "ZWIDTH", "ZHEIGHT", "ZORIENTATION", "ZDATECREATED", "ZADDEDDATE", "ZMODIFICATIONDATE",
+    "ZCOMPLETE", "ZUNIFORMTYPEIDENTIFIER", "ZHIDDEN", "ZTRASHEDSTATE",
+};
+
+static long long query_int(sqlite3 *db, const char *sql, long long fallback) {
+    sqlite3_stmt *stmt = NULL;
+    long long v = fallback;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW &&
+        sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+        v = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return v;
+}
+
+int rsim_media_index(const char *db_path, const RSimMediaAsset *assets, size_t count,
+                     char *err, size_t err_size) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *insert = NULL, *exists = NULL;
+    int inserted = 0, ok = 0, in_txn = 0;
+    snprintf(err, err_size, "can't open %s", db_path);
+
+    /* The library is created by assetsd on first boot; don't make one up */
+    if (access(db_path, F_OK) != 0 || sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+        goto done;
+    sqlite3_busy_timeout(db, 5000);
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+        snprintf(err, err_size, "%s", sqlite3_errmsg(db));
+        goto done;
+    }
+    in_txn = 1;
+
+    /* iOS 8-12: ZGENERICASSET; Core Data entity "Asset" (or its parent "GenericAsset") */
+    const char *table = query_int(db, "SELECT 1 FROM sqlite_master WHERE name = 'ZGENERICASSET'", 0) ? "ZGENERICASSET" :
+                        query_int(db, "SELECT 1 FROM sqlite_master WHERE name = 'ZASSET'", 0) ? "ZASSET" : NULL;
+    long long ent = query_int(db, "SELECT Z_ENT FROM Z_PRIMARYKEY WHERE Z_NAME = 'Asset'",
+                    query_int(db, "SELECT Z_ENT FROM Z_PRIMARYKEY WHERE Z_NAME = 'GenericAsset'", -1));
+    if (!table || ent < 0) {
+        snprintf(err, err_size, "not a Photos library (no asset table)");
+        goto done;
+    }
+
+    char sql[1024];
+    int have[COL_COUNT] = {0};
+    sqlite3_stmt *info = NULL;
+    snprintf(sql, sizeof(sql), "PRAGMA table_info(%s)", table);
+    if (sqlite3_prepare_v2(db, sql, -1, &info, NULL) == SQLITE_OK) {
+        while (sqlite3_step(info) == SQLITE_ROW) {
+            const char *name = (const char *)sqlite3_column_text(info, 1);
+            for (int c = 0; name && c < COL_COUNT; c++)
+                if (strcasecmp(name, kColumns[c]) == 0) have[c] = 1;
+        }
+    }
+    sqlite3_finalize(info);
+    if (!have[COL_PK] || !have[COL_DIRECTORY] || !have[COL_FILENAME]) {
+        snprintf(err, err_size, "%s lacks Z_PK/ZDIRECTORY/ZFILENAME", table);
+        goto done;
+    }
+
+    /* One statement, prepared once: INSERT INTO t (cols...) VALUES (?1, ?2, ...) */
+    int len = snprintf(sql, sizeof(sql), "INSERT INTO %s (", table), params = 0;
+    for (int c = 0; c < COL_COUNT; c++)
+        if (have[c]) len += snprintf(sql + len, sizeof(sql) - (size_t)len, "%s%s", params++ ? ", " : "", kColumns[c]);
+    len += snprintf(sql + len, sizeof(sql) - (size_t)len, ") VALUES (");
+    for (int p = 1; p <= params; p++)
+        len += snprintf(sql + len, sizeof(sql) - (size_t)len, "%s?%d", p > 1 ? ", " : "", p);
+    snprintf(sql + len, sizeof(sql) - (size_t)len, ")");
+    if (sqlite3_prepare_v2(db, sql, -1, &insert, NULL) != SQLITE_OK) {
+        snprintf(err, err_size, "%s", sqlite3_errmsg(db));
+        goto done;
+    }
+    snprintf(sql, sizeof(sql), "SELECT 1 FROM %s WHERE ZDIRECTORY = ?1 AND ZFILENAME = ?2", table);
+    if (sqlite3_prepare_v2(db, sql, -1, &exists, NULL) != SQLITE_OK) {
+        snprintf(err, err_size, "%s", sqlite3_errmsg(db));
+        goto done;
+    }
+
+    /* Next primary key: past both the rows and Core Data's Z_MAX */
+    snprintf(sql, sizeof(sql), "SELECT MAX(Z_PK) FROM %s", table);
+    long long pk = query_int(db, sql, 0);
+    long long zmax = query_int(db, "SELECT MAX(Z_MAX) FROM Z_PRIMARYKEY WHERE Z_NAME IN ('Asset', 'GenericAsset')", 0);
+    if (zmax > pk) pk = zmax;
+
+    double now = (double)time(NULL) - CORE_DATA_EPOCH;
+    ok = 1;
+    for (size_t i = 0; ok && i < count; i++) {
+        const RSimMediaAsset *a = &assets[i];
+        if (!a->copied) continue;
+        sqlite3_reset(exists);
+        sqlite3_bind_text(exists, 1, DCIM_DIRECTORY, -1, SQLITE_STATIC);
+        sqlite3_bind_text(exists, 2, a->name, -1, SQLITE_STATIC);
+        if (sqlite3_step(exists) == SQLITE_ROW) continue;
+
+        sqlite3_reset(insert);
+        int p = 0;
+        for (int c = 0; c < COL_COUNT; c++) {
+            if (!have[c]) continue;
+            p++;
+            switch ((Column)c) {
+            case COL_PK:                sqlite3_bind_int64(insert, p, ++pk); break;
+            case COL_ENT:               sqlite3_bind_int64(insert, p, ent); break;
+            case COL_OPT:               sqlite3_bind_int(insert, p, 1); break;
+            case COL_UUID:              sqlite3_bind_text(insert, p, a->uuid, -1, SQLITE_STATIC); break;
+            case COL_DIRECTORY:         sqlite3_bind_text(insert, p, DCIM_DIRECTORY, -1, SQLITE_STATIC); break;
+            case COL_FILENAME:          sqlite3_bind_text(insert, p, a->name, -1, SQLITE_STATIC); break;
+            case COL_KIND:              sqlite3_bind_int(insert, p, a->kind == RSIM_MEDIA_VIDEO ? 1 : 0); break;
+            case COL_KINDSUBTYPE:       sqlite3_bind_int(insert, p, 0); break;
+            case COL_WIDTH:             sqlite3_bind_int(insert, p, a->width); break;
+            case COL_HEIGHT:            sqlite3_bind_int(insert, p, a->height); break;
+            case COL_ORIENTATION:       sqlite3_bind_int(insert, p, 1); break;
+            case COL_DATECREATED:       sqlite3_bind_double(insert, p, a->created - CORE_DATA_EPOCH); break;
+            case COL_ADDEDDATE:
+            case COL_MODIFICATIONDATE:  sqlite3_bind_double(insert, p, now); break;
+            case COL_COMPLETE:          sqlite3_bind_int(insert, p, 1); break;
+            case COL_UTI:               sqlite3_bind_text(insert, p, a->uti, -1, SQLITE_STATIC); break;
+            case COL_HIDDEN:
+            case COL_TRASHEDSTATE:      sqlite3_bind_int(insert, p, 0); break;
+            case COL_COUNT:             break;
+            }
+        }
+        ok = sqlite3_step(insert) == SQLITE_DONE;
+        inserted += ok;
+    }
+    if (ok && inserted) {
+        sqlite3_stmt *upd = NULL;
+        ok = sqlite3_prepare_v2(db, "UPDATE Z_PRIMARYKEY SET Z_MAX = ?1 WHERE Z_NAME IN ('Asset', 'GenericAsset')",
+                                -1, &upd, NULL) == SQLITE_OK &&
+             sqlite3_bind_int64(upd, 1, pk) == SQLITE_OK && sqlite3_step(upd) == SQLITE_DONE;
+        sqlite3_finalize(upd);
+    }
+    if (!ok) snprintf(err, err_size, "%s", sqlite3_errmsg(db));
+
+done:
+    sqlite3_finalize(insert);
+    sqlite3_finalize(exists);
+    if (in_txn) {
+        if (ok && sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+            snprintf(err, err_size, "%s", sqlite3_errmsg(db));
+            ok = 0;
+        }
+        if (!ok) sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_close(db);
+    if (ok) err[0] = 0;
+    return ok ? inserted : -1;
+}
@@ -0,0 +1,93 @@
+/*
+ * rosettasim_media.h — Bulk media import for legacy Photos libraries (portable C)
+ *
+ * `rosettasim-ctl addmedia` on a legacy device runs three stages:
+ *   1. copy     each file into Media/DCIM/100APPLE (clonefile on APFS, so
+ *               thousands of assets cost metadata, not bytes)
+ *   2. thumb    decode (through the caller's decoder), scale and JPEG-encode
+ *               a thumbnail under PhotoData/Thumbnails/V2
+ *   3. index    insert the assets into Media/PhotoData/Photos.sqlite in one
+ *               transaction, so they are in the library without a reboot
+ * Stages 1 and 2 run per asset on a pool of worker threads; stage 3 runs once
+ * on the caller's thread. Decoding is the only platform-specific part (ImageIO
+ * in rosettasim-ctl), so everything else builds and runs on Linux.
+ */
+
+#ifndef ROSETTASIM_MEDIA_H
+#define ROSETTASIM_MEDIA_H
+
+#include "rosettasim_image.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_MEDIA_DCIM_DIR     "Media/DCIM/100APPLE"
+#define RSIM_MEDIA_PHOTOS_DB    "Media/PhotoData/Photos.sqlite"
+#define RSIM_MEDIA_THUMB_DIR    "Media/PhotoData/Thumbnails/V2"
+#define RSIM_MEDIA_THUMB_NAME   "5005.JPG"  /* per-asset file inside <thumb dir>/DCIM/100APPLE/<name>/ */
+#define RSIM_MEDIA_THUMB_SIZE   256         /* longest side, pixels */
+
+typedef enum {
+    RSIM_MEDIA_PHOTO,
+    RSIM_MEDIA_VIDEO,
+} RSimMediaKind;
+
+typedef struct {
+    const char     *src;            /* file on the host */
+    char            name[256];      /* file name in DCIM: basename of src, made unique by import */
+    RSimMediaKind   kind;           /* from the extension */
+    const char     *uti;            /* public.jpeg, public.png, com.apple.quicktime-movie, ... */
+    char            uuid[37];
+    int             width, height;  /* from the decoder; 0 if it couldn't */
+    long long       size;
+    double          created;        /* mtime, Unix seconds */
+    int             copied;         /* stage results */
+    int             thumbnailed;
+    char            error[128];
+} RSimMediaAsset;
+
+/* Decode path to BGRA whose longest side is at least max_side when the image
+ * is that large (a decoder may return a smaller-than-full embedded preview).
+ * Sets width and height to the full image size. Returns 0 or -1. */
+typedef int (*RSimMediaDecodeFn)(const char *path, int max_side, RSimBitmap *out,
+                                 int *width, int *height, void *ctx);
+
+typedef struct {
+    const char         *device_root;    /* device data directory */
+    int                 jobs;           /* worker threads (<= 0: one per CPU) */
+    int                 thumb_size;     /* <= 0: RSIM_MEDIA_THUMB_SIZE */
+    RSimMediaDecodeFn   decode;         /* NULL: no thumbnails */
+    void               *decode_ctx;
+} RSimMediaImportOpts;
+
+typedef struct {
+    size_t      copied, cloned, thumbnailed, failed;
+    long long   bytes;
+    double      copy_ms;                /* wall time of the copy + thumbnail pass */
+} RSimMediaStats;
+
+/* Fill name, kind, uti, uuid, size and created for src. Returns 0, or -1 if
+ * src is not a regular file. */
+int  rsim_media_asset_init(RSimMediaAsset *asset, const char *src);
+
+/* Stages 1 and 2 for every asset; results are in each asset. A name already
+ * used in DCIM or earlier in the batch gets a -1, -2, ... suffix first, so
+ * existing assets are never overwritten. Returns the number that failed to
+ * copy. */
+int  rsim_media_import(RSimMediaAsset *assets, size_t count, const RSimMediaImportOpts *opts,
+                       RSimMediaStats *stats);
+
+/* Scale src to fit size x size (aspect kept) and JPEG-encode it. Returns 0
+ * with a malloc'd stream in *jpeg, or -1. */
+int  rsim_media_thumbnail(const RSimBitmap *src, int size, int quality,
+                          uint8_t **jpeg, size_t *jpeg_size);
+
+/* Stage 3: insert the copied assets into the Photos.sqlite at db_path in one
+ * transaction. Assets already in the library (same directory and file name)
+ * are skipped, so running it again on the same assets is harmless. Only columns the runtime's
+ * schema has are written. Returns the number of rows inserted, or -1 with a
+ * message in err (nothing is inserted). */
+int  rsim_media_index(const char *db_path, const RSimMediaAsset *assets, size_t count,
+                      char *err, size_t err_size);
+
+#endif /* ROSETTASIM_MEDIA_H */
@@ -0,0 +1,196 @@
+/*
+ * rosettasim_monkey.c — Feedback-driven UI exploration (see rosettasim_monkey.h)
+ */
+
+#include "rosettasim_monkey.h"
+#include "rosettasim_phash.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* splitmix64: tiny, seedable, good enough for input generation */
+static uint64_t next_u64(RSimMonkey *m) {
+    uint64_t z = (m->rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1) */
+static float next_unit(RSimMonkey *m) {
+    return (float)(next_u64(m) >> 40) / (float)(1ull << 24);
+}
+
+static int next_below(RSimMonkey *m, int n) {
+    return n > 0 ? (int)(next_u64(m) % (uint64_t)n) : 0;
+}
+
+void rsim_monkey_init(RSimMonkey *m, uint64_t seed, float width, float height) {
+    memset(m, 0, sizeof(*m));
+    m->rng = seed;
+    m->width = width;
+    m->height = height;
+    m->merge_distance = 6;
+    m->weights[RSIM_MONKEY_TAP] = 70;
+    m->weights[RSIM_MONKEY_SWIPE] = 20;
+    m->weights[RSIM_MONKEY_TEXT] = 10;
+}
+
+void rsim_monkey_free(RSimMonkey *m) {
+    free(m->screens);
+    m->screens = NULL;
+    m->screen_count = m->screen_capacity = 0;
+}
+
+static int find_screen(const RSimMonkey *m, uint64_t hash) {
+    int best = -1, best_d = m->merge_distance + 1;
+    for (int i = 0; i < m->screen_count; i++) {
+        int d = rsim_hash_distance(m->screens[i].hash, hash);
+        if (d < best_d) {
+            best_d = d;
+            best = i;
+            if (!d) break;
+        }
+    }
+    return best;
+}
+
+static int lookup_screen(RSimMonkey *m, uint64_t hash) {
+    int i = find_screen(m, hash);
+    if (i >= 0) return i;
+    if (m->screen_count == m->screen_capacity) {
+        int cap = m->screen_capacity ? m->screen_capacity * 2 : 32;
+        RSimMonkeyScreen *grown = realloc(m->screens, (size_t)cap * sizeof(*grown));
+        if (!grown) return -1;
+        m->screens = grown;
+        m->screen_capacity = cap;
+    }
+    RSimMonkeyScreen *s = &m->screens[m->screen_count];
+    memset(s, 0, sizeof(*s));
+    s->hash = hash;
+    return m->screen_count++;
+}
+
+int rsim_monkey_visit(RSimMonkey *m, uint64_t hash) {
+    int i = lookup_screen(m, hash);
+    if (i >= 0) m->screens[i].visits++;
+    return i;
+}
+
+static RSimMonkeyType pick_type(RSimMonkey *m) {
+    int total = 0;
+    for (int t = 0; t < RSIM_MONKEY_TYPES; t++) total += m->weights[t] > 0 ? m->weights[t] : 0;
+    int r = next_below(m, total > 0 ? total : 1);
+    for (int t = 0; t < RSIM_MONKEY_TYPES; t++) {
+        int w = m->weights[t] > 0 ? m->weights[t] : 0;
+        if (r < w) return (RSimMonkeyType)t;
+        r -= w;
+    }
+    return RSIM_MONKEY_TAP;
+}
+
+/* Roulette over cells: untried cells weigh 0.25, productive ones more, and
+ * every try divides the weight so the search keeps moving. */
+static int pick_cell(RSimMonkey *m, const RSimMonkeyScreen *s) {
+    if (!s) return next_below(m, RSIM_MONKEY_CELLS);
+    float w[RSIM_MONKEY_CELLS], total = 0;
+    for (int c = 0; c < RSIM_MONKEY_CELLS; c++) {
+        w[c] = (0.25f + s->reward[c]) / (1.0f + (float)s->tried[c]);
+        total += w[c];
+    }
+    float r = next_unit(m) * total;
+    for (int c = 0; c < RSIM_MONKEY_CELLS; c++) {
+        if (r < w[c]) return c;
+        r -= w[c];
+    }
+    return RSIM_MONKEY_CELLS - 1;
+}
+
+static int cell_of(const RSimMonkey *m, float x, float y) {
+    int cx = (int)(x / m->width * RSIM_MONKEY_COLS);
+    int cy = (int)(y / m->height * RSIM_MONKEY_ROWS);
+    if (cx < 0) cx = 0;
+    if (cx >= RSIM_MONKEY_COLS) cx = RSIM_MONKEY_COLS - 1;
+    if (cy < 0) cy = 0;
+    if (cy >= RSIM_MONKEY_ROWS) cy = RSIM_MONKEY_ROWS - 1;
+    return cy * RSIM_MONKEY_COLS + cx;
+}
+
+static float clampf(float v, float lo, float hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+void rsim_monkey_next(RSimMonkey *m, uint64_t hash, RSimMonkeyAction *out) {
+    memset(out, 0, sizeof(*out));
+    int si = find_screen(m, hash);
+    const RSimMonkeyScreen *s = si >= 0 ? &m->screens[si] : NULL;
+
+    out->type = pick_type(m);
+    int cell = pick_cell(m, s);
+    float cw = m->width / RSIM_MONKEY_COLS, ch = m->height / RSIM_MONKEY_ROWS;
+    out->x = ((float)(cell % RSIM_MONKEY_COLS) + next_unit(m)) * cw;
+    out->y = ((float)(cell / RSIM_MONKEY_COLS) + next_unit(m)) * ch;
+    out->cell = cell;
+
+    switch (out->type) {
+    case RSIM_MONKEY_TAP:
+        out->x2 = out->x;
+        out->y2 = out->y;
+        out->duration_ms = 16 + next_below(m, 32);     /* one to three frames: still a tap */
+        break;
+    case RSIM_MONKEY_SWIPE: {
+        /* Mostly axis-aligned (scrolling, paging), a fifth of them diagonal */
+        float len = (0.2f + 0.4f * next_unit(m)) * (m->width < m->height ? m->width : m->height);
+        float angle = next_below(m, 5) < 4 ? (float)next_below(m, 4) * (float)M_PI_2
+                                           : next_unit(m) * 2.0f * (float)M_PI;
+        out->x2 = clampf(out->x + len * cosf(angle), 1.0f, m->width - 1.0f);
+        out->y2 = clampf(out->y + len * sinf(angle), 1.0f, m->height - 1.0f);
+        out->duration_ms = 60 + next_below(m, 120);
+        break;
+    }
+    case RSIM_MONKEY_TEXT: {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 .@-";
+        int n = 1 + next_below(m, 4);     /* 60ms a key: keep actions short */
+        for (int i = 0; i < n; i++)
+            out->text[i] = alphabet[next_below(m, (int)sizeof(alphabet) - 1)];
+        out->text[n] = 0;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+int rsim_monkey_feedback(RSimMonkey *m, uint64_t before, const RSimMonkeyAction *action,
+                         uint64_t after) {
+    int bi = lookup_screen(m, before);
+    if (bi < 0) return -1;
+    int ai = rsim_monkey_visit(m, after);
+    if (ai < 0) return -1;
+    RSimMonkeyScreen *b = &m->screens[bi];     /* after the visit: screens may have moved */
+    int cell = action->cell >= 0 && action->cell < RSIM_MONKEY_CELLS ? action->cell
+                                                                      : cell_of(m, action->x, action->y);
+    b->tried[cell]++;
+    m->actions++;
+    if (ai == bi) return 0;
+    b->reward[cell] += 1.0f / (float)m->screens[ai].visits;
+    m->changes++;
+    return 1;
+}
+
+static const char *const kTypeNames[RSIM_MONKEY_TYPES] = { "tap", "swipe", "text" };
+
+const char *rsim_monkey_type_name(RSimMonkeyType type) {
+    return type < RSIM_MONKEY_TYPES ? kTypeNames[type] : "?";
+}
+
+int rsim_monkey_type_parse(const char *name, RSimMonkeyType *out) {
+    for (int t = 0; t < RSIM_MONKEY_TYPES; t++) {
+        if (strcmp(name, kTypeNames[t]) == 0) {
+            *out = (RSimMonkeyType)t;
+            return 0;
+        }
+    }
+    return -1;
+}
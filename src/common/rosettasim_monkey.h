@@ -0,0 +1,78 @@
+/*
+ * rosettasim_monkey.h — Feedback-driven UI exploration (portable C)
+ *
+ * Picks random taps, swipes and text input, biased by what earlier actions
+ * did. Screens are keyed by frame dHash (hashes within merge_distance bits
+ * are the same screen). Each screen splits the display into a grid; every
+ * cell remembers how often it was tried and how much novelty it produced
+ * (1 / visits of the screen it led to, so actions reaching new or rarely
+ * seen screens score highest). Untried and productive cells are preferred.
+ *
+ * Deterministic for a given seed and sequence of screen hashes. Coordinates
+ * are in points. Used by rosettasim-ctl monkey; no Apple framework deps.
+ */
+
+#ifndef ROSETTASIM_MONKEY_H
+#define ROSETTASIM_MONKEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_MONKEY_COLS        6
+#define RSIM_MONKEY_ROWS        10
+#define RSIM_MONKEY_CELLS       (RSIM_MONKEY_COLS * RSIM_MONKEY_ROWS)
+
+typedef enum {
+    RSIM_MONKEY_TAP = 0,
+    RSIM_MONKEY_SWIPE,
+    RSIM_MONKEY_TEXT,
+    RSIM_MONKEY_TYPES
+} RSimMonkeyType;
+
+typedef struct {
+    RSimMonkeyType  type;
+    float           x, y;           /* tap point / swipe start */
+    float           x2, y2;         /* swipe end */
+    int             duration_ms;    /* tap hold / swipe length in time */
+    char            text[24];       /* TEXT only */
+    int             cell;           /* grid cell x,y falls in (internal bookkeeping) */
+} RSimMonkeyAction;
+
+typedef struct {
+    uint64_t        hash;
+    uint32_t        visits;
+    uint32_t        tried[RSIM_MONKEY_CELLS];
+    float           reward[RSIM_MONKEY_CELLS];
+} RSimMonkeyScreen;
+
+typedef struct {
+    uint64_t            rng;
+    float               width;          /* points */
+    float               height;
+    int                 merge_distance; /* default 6 bits */
+    int                 weights[RSIM_MONKEY_TYPES]; /* default tap 70, swipe 20, text 10 */
+    RSimMonkeyScreen   *screens;
+    int                 screen_count;
+    int                 screen_capacity;
+    int                 actions;
+    int                 changes;        /* actions after which the screen changed */
+} RSimMonkey;
+
+void rsim_monkey_init(RSimMonkey *m, uint64_t seed, float width, float height);
+void rsim_monkey_free(RSimMonkey *m);
+
+/* Screen index for a hash (added if unseen); counts a visit. -1 on OOM. */
+int  rsim_monkey_visit(RSimMonkey *m, uint64_t hash);
+
+/* Choose the next action on the screen with this hash (does not visit). */
+void rsim_monkey_next(RSimMonkey *m, uint64_t hash, RSimMonkeyAction *out);
+
+/* Record the outcome of an action taken on `before`; visits `after`.
+ * Returns 1 if the screen changed, 0 if not, -1 on OOM. */
+int  rsim_monkey_feedback(RSimMonkey *m, uint64_t before, const RSimMonkeyAction *action,
+                          uint64_t after);
+
+const char *rsim_monkey_type_name(RSimMonkeyType type);
+int         rsim_monkey_type_parse(const char *name, RSimMonkeyType *out);
+
+#endif /* ROSETTASIM_MONKEY_H */
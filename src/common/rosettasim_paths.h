@@ -17,13 +17,22 @@
 #define ROSETTASIM_DEV_TOUCH_LOG        "tmp/rosettasim_touch.log"
 #define ROSETTASIM_DEV_TOUCH_INJECT_LOG "tmp/rosettasim_touch_inject.log"
 #define ROSETTASIM_DEV_INSTALLED_APPS   "Library/rosettasim_installed_apps.plist"
+#define ROSETTASIM_DEV_HANGS_FILE       "tmp/rosettasim_hangs.jsonl"
+#define ROSETTASIM_DEV_HANG_THRESHOLD   "tmp/rosettasim_hang_threshold_ms"
 
 /* Host-side paths (C format strings — pass UDID as char* arg) */
 #define ROSETTASIM_HOST_CMD_FMT         "/tmp/rosettasim_cmd_%s.json"
 #define ROSETTASIM_HOST_RESULT_FMT      "/tmp/rosettasim_install_result_%s.txt"
+#define ROSETTASIM_HOST_ORIENTATION_FMT "/tmp/rosettasim_orientation_%s"   /* SpringBoard → daemon */
+#define ROSETTASIM_HOST_PUSH_SPOOL_FMT  "/tmp/rosettasim_push_%s.jsonl"     /* push --batch payloads */
+
+/* Host-side logs the sim and daemon write (fixed names, no UDID) */
+#define ROSETTASIM_HOST_HID_LOG         "/tmp/rosettasim_hid_backport.txt"  /* shims/hid_backport.m */
+#define ROSETTASIM_HOST_DAEMON_LOG      "/tmp/rosettasim_daemon.log"        /* daemon stdout/stderr (launchd plist) */
 
 /* NSString format variants (pass UDID as NSString %@ arg) — for ObjC code */
 #define ROSETTASIM_HOST_CMD_NSFMT       "/tmp/rosettasim_cmd_%@.json"
 #define ROSETTASIM_HOST_RESULT_NSFMT    "/tmp/rosettasim_install_result_%@.txt"
+#define ROSETTASIM_HOST_PUSH_SPOOL_NSFMT "/tmp/rosettasim_push_%@.jsonl"
 
 #endif /* ROSETTASIM_PATHS_H */
@@ -0,0 +1,123 @@
+/*
+ * rosettasim_phash.c — dHash over BGRA frames (see rosettasim_phash.h)
+ *
+ * The daemon hashes every frame on its message thread, so the grid is built
+ * from a subset of rows (ROWS_PER_CELL per grid row) and each cell's channel
+ * sums use NEON on arm64 / SSE2 on x86_64. An iPad frame costs ~0.1 ms.
+ */
+
+#include "rosettasim_phash.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RSIM_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RSIM_SSE 1
+#endif
+
+#define HASH_COLS       9
+#define HASH_ROWS       8
+#define ROWS_PER_CELL   16      /* sampled source rows per grid row */
+
+/* Add the B, G, R sums of n BGRA pixels to sum[0..2] */
+static void sum_bgr(const uint8_t *p, int n, uint64_t sum[3]) {
+    int i = 0;
+#if RSIM_NEON
+    uint32x4_t acc_b = vdupq_n_u32(0), acc_g = vdupq_n_u32(0), acc_r = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16, p += 64) {
+        uint8x16x4_t px = vld4q_u8(p);
+        acc_b = vpadalq_u16(acc_b, vpaddlq_u8(px.val[0]));
+        acc_g = vpadalq_u16(acc_g, vpaddlq_u8(px.val[1]));
+        acc_r = vpadalq_u16(acc_r, vpaddlq_u8(px.val[2]));
+    }
+    sum[0] += vaddvq_u32(acc_b);
+    sum[1] += vaddvq_u32(acc_g);
+    sum[2] += vaddvq_u32(acc_r);
+#elif RSIM_SSE
+    const __m128i mask = _mm_set1_epi32(0xFF), zero = _mm_setzero_si128();
+    __m128i acc_b = zero, acc_g = zero, acc_r = zero;
+    for (; i + 4 <= n; i += 4, p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        acc_b = _mm_add_epi64(acc_b, _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+        acc_g = _mm_add_epi64(acc_g, _mm_sad_epu8(_mm_and_si128(_mm_srli_epi32(v, 8), mask), zero));
+        acc_r = _mm_add_epi64(acc_r, _mm_sad_epu8(_mm_and_si128(_mm_srli_epi32(v, 16), mask), zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc_b); sum[0] += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, acc_g); sum[1] += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, acc_r); sum[2] += lanes[0] + lanes[1];
+#endif
+    for (; i < n; i++, p += 4) {
+        sum[0] += p[0];
+        sum[1] += p[1];
+        sum[2] += p[2];
+    }
+}
+
+uint64_t rsim_dhash_bgra(const uint8_t *bgra, int width, int height, size_t bytes_per_row) {
+    if (!bgra || width < HASH_COLS || height < HASH_ROWS) return 0;
+
+    int col_start[HASH_COLS + 1];
+    for (int c = 0; c <= HASH_COLS; c++) col_start[c] = (int)((int64_t)c * width / HASH_COLS);
+
+    uint64_t hash = 0;
+    for (int r = 0; r < HASH_ROWS; r++) {
+        int y0 = (int)((int64_t)r * height / HASH_ROWS);
+        int y1 = (int)((int64_t)(r + 1) * height / HASH_ROWS);
+        int step = (y1 - y0) / ROWS_PER_CELL;
+        if (step < 1) step = 1;
+
+        uint64_t sums[HASH_COLS][3];
+        memset(sums, 0, sizeof(sums));
+        int rows = 0;
+        /* Sample around the middle of each step so bands don't all hit their top edge */
+        for (int y = y0 + step / 2; y < y1; y += step, rows++) {
+            const uint8_t *row = bgra + (size_t)y * bytes_per_row;
+            for (int c = 0; c < HASH_COLS; c++)
+                sum_bgr(row + (size_t)col_start[c] * 4, col_start[c + 1] - col_start[c], sums[c]);
+        }
+
+        /* Same BT.601 weights as the matcher; per-pixel scale doesn't matter
+         * for comparisons within a row, only the cell width does. */
+        uint64_t luma[HASH_COLS];
+        for (int c = 0; c < HASH_COLS; c++) {
+            uint64_t n = (uint64_t)(col_start[c + 1] - col_start[c]) * (rows ? rows : 1);
+            luma[c] = (29 * sums[c][0] + 150 * sums[c][1] + 77 * sums[c][2]) * 16 / n;
+        }
+        for (int c = 0; c < HASH_COLS - 1; c++) {
+            hash <<= 1;
+            if (luma[c] > luma[c + 1]) hash |= 1;
+        }
+    }
+    return hash;
+}
+
+int rsim_hash_distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
+
+void rsim_hash_format(uint64_t hash, char out[RSIM_HASH_HEX_LEN + 1]) {
+    snprintf(out, RSIM_HASH_HEX_LEN + 1, "%016llx", (unsigned long long)hash);
+}
+
+int rsim_hash_parse(const char *s, uint64_t *hash) {
+    uint64_t v = 0;
+    int n = 0;
+    for (; *s; s++, n++) {
+        char ch = *s;
+        int d;
+        if (ch >= '0' && ch <= '9') d = ch - '0';
+        else if (ch >= 'a' && ch <= 'f') d = ch - 'a' + 10;
+        else if (ch >= 'A' && ch <= 'F') d = ch - 'A' + 10;
+        else return -1;
+        if (n >= RSIM_HASH_HEX_LEN) return -1;
+        v = (v << 4) | (uint64_t)d;
+    }
+    if (n == 0) return -1;
+    *hash = v;
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * rosettasim_phash.h — Perceptual frame hash (portable C)
+ *
+ * 64-bit difference hash (dHash): the frame is area-averaged down to a 9x8
+ * luma grid and each bit records whether a cell is brighter than its right
+ * neighbour. Identical frames hash identically; frames that differ only in
+ * a few pixels (cursor blink, clock tick) usually land within a few bits.
+ *
+ * Computed by the daemon for every published frame and read by
+ * rosettasim-ctl; no Apple framework dependencies.
+ */
+
+#ifndef ROSETTASIM_PHASH_H
+#define ROSETTASIM_PHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_HASH_HEX_LEN   16
+
+/* dHash of a BGRA (kCGBitmapByteOrder32Little) frame. Returns 0 for frames
+ * smaller than the 9x8 grid. */
+uint64_t rsim_dhash_bgra(const uint8_t *bgra, int width, int height, size_t bytes_per_row);
+
+/* Number of differing bits (0 = same screen, 64 = unrelated) */
+int      rsim_hash_distance(uint64_t a, uint64_t b);
+
+/* 16 lowercase hex digits + NUL */
+void     rsim_hash_format(uint64_t hash, char out[RSIM_HASH_HEX_LEN + 1]);
+
+/* Returns 0 on success, -1 if s isn't 1-16 hex digits */
+int      rsim_hash_parse(const char *s, uint64_t *hash);
+
+#endif /* ROSETTASIM_PHASH_H */
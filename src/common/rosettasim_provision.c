@@ -0,0 +1,582 @@
+/*
+ * rosettasim_provision.c — Diff/plan engine for provisioning (see rosettasim_provision.h)
+ */
+
+#include "rosettasim_provision.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sqlite3.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <sys/clonefile.h>
+#endif
+
+#define TCC_DB          "Library/TCC/TCC.db"
+#define TRUST_STORE_DB  "Library/Keychains/TrustStore.sqlite3"
+
+static const char *const kKindNames[RSIM_PROV_KIND_COUNT] = {
+    "privacy", "certificate", "content_size", "location", "pasteboard", "media", "app",
+};
+
+const char *rsim_prov_kind_name(RSimProvKind kind) {
+    return (unsigned)kind < RSIM_PROV_KIND_COUNT ? kKindNames[kind] : "?";
+}
+
+/* ================================================================
+ * Small helpers: SHA-1, base64, files
+ * ================================================================ */
+
+static uint32_t rol(uint32_t v, int n) { return v << n | v >> (32 - n); }
+
+static void sha1(const unsigned char *data, size_t len, unsigned char out[20]) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = (len + 9 + 63) / 64 * 64;
+    for (size_t off = 0; off < total; off += 64) {
+        unsigned char block[64];
+        for (int i = 0; i < 64; i++) {
+            size_t p = off + (size_t)i;
+            block[i] = p < len ? data[p] : p == len ? 0x80 : 0;
+        }
+        if (off + 64 == total)
+            for (int i = 0; i < 8; i++) block[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+                   (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+            else             { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) out[i] = (unsigned char)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static int b64_value(int c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+/* Decode base64 in place, skipping whitespace; returns the decoded length */
+static size_t b64_decode(char *text, size_t len) {
+    size_t out = 0;
+    uint32_t acc = 0;
+    int n = 0;
+    for (size_t i = 0; i < len; i++) {
+        int v = b64_value((unsigned char)text[i]);
+        if (v < 0) continue;
+        acc = acc << 6 | (uint32_t)v;
+        if (++n == 4) {
+            text[out++] = (char)(acc >> 16);
+            text[out++] = (char)(acc >> 8);
+            text[out++] = (char)acc;
+            acc = 0;
+            n = 0;
+        }
+    }
+    if (n == 3) {
+        text[out++] = (char)(acc >> 10);
+        text[out++] = (char)(acc >> 2);
+    } else if (n == 2) {
+        text[out++] = (char)(acc >> 4);
+    }
+    return out;
+}
+
+static unsigned char *read_all(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0, n;
+    do {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 16384;
+            unsigned char *grown = realloc(buf, cap + 1);
+            if (!grown) {
+                free(buf);
+                fclose(f);
+                return NULL;
+            }
+            buf = grown;
+        }
+        n = fread(buf + len, 1, cap - len, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    buf[len] = 0;
+    *size = len;
+    return buf;
+}
+
+unsigned char *rsim_prov_read_cert(const char *path, size_t *size) {
+    unsigned char *data = read_all(path, size);
+    if (!data) return NULL;
+    const char *begin = strstr((char *)data, "-----BEGIN CERTIFICATE-----");
+    if (!begin) return data;                                /* already DER */
+    begin += strlen("-----BEGIN CERTIFICATE-----");
+    const char *end = strstr(begin, "-----END CERTIFICATE-----");
+    if (!end) {
+        free(data);
+        return NULL;
+    }
+    size_t len = (size_t)(end - begin);
+    memmove(data, begin, len);
+    *size = b64_decode((char *)data, len);
+    if (!*size) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static void mkdirs(const char *dir) {
+    char path[1200];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        mkdir(path, 0755);
+        *p = '/';
+    }
+    mkdir(path, 0755);
+}
+
+static void parent_dirs(const char *file) {
+    char dir[1200];
+    snprintf(dir, sizeof(dir), "%s", file);
+    char *slash = strrchr(dir, '/');
+    if (slash && slash != dir) {
+        *slash = 0;
+        mkdirs(dir);
+    }
+}
+
+/* Clone where the filesystem can (APFS), else copy; via a temp name + rename */
+static int copy_file(const char *src, const char *dst) {
+    char tmp[1300];
+    snprintf(tmp, sizeof(tmp), "%s.rsimtmp", dst);
+    unlink(tmp);
+#ifdef __APPLE__
+    if (clonefile(src, tmp, 0) == 0) return rename(tmp, dst) == 0 ? 0 : (unlink(tmp), -1);
+#endif
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) return -1;
+    int out = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        close(in);
+        return -1;
+    }
+    char buf[1 << 16];
+    ssize_t n;
+    int ok = 1;
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+        if (write(out, buf, (size_t)n) != n) { ok = 0; break; }
+    if (n < 0) ok = 0;
+    close(in);
+    if (close(out) != 0) ok = 0;
+    if (ok && rename(tmp, dst) == 0) return 0;
+    unlink(tmp);
+    return -1;
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/* ================================================================
+ * State file
+ * ================================================================ */
+
+typedef struct {
+    char  **lines;              /* "<kind>\t<key>\t<value>" */
+    size_t  count;
+} StateFile;
+
+static void state_load(const char *root, StateFile *st) {
+    char path[1200];
+    snprintf(path, sizeof(path), "%s/" RSIM_PROV_STATE_FILE, root);
+    memset(st, 0, sizeof(*st));
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = 0;
+        char **grown = realloc(st->lines, (st->count + 1) * sizeof(char *));
+        if (!grown) break;
+        st->lines = grown;
+        st->lines[st->count++] = strdup(line);
+    }
+    fclose(f);
+}
+
+static void state_free(StateFile *st) {
+    for (size_t i = 0; i < st->count; i++) free(st->lines[i]);
+    free(st->lines);
+}
+
+/* The recorded line for kind+key, or -1 */
+static long state_find(const StateFile *st, RSimProvKind kind, const char *key) {
+    char prefix[256];
+    int n = snprintf(prefix, sizeof(prefix), "%s\t%s\t", rsim_prov_kind_name(kind), key);
+    for (size_t i = 0; i < st->count; i++)
+        if (strncmp(st->lines[i], prefix, (size_t)n) == 0) return (long)i;
+    return -1;
+}
+
+static int state_has(const StateFile *st, RSimProvKind kind, const char *key, const char *value) {
+    long i = state_find(st, kind, key);
+    if (i < 0) return 0;
+    const char *recorded = strchr(strchr(st->lines[i], '\t') + 1, '\t') + 1;
+    return strcmp(recorded, value) == 0;
+}
+
+/* ================================================================
+ * Planning
+ * ================================================================ */
+
+static RSimProvStep *add_step(RSimProvPlan *plan, RSimProvKind kind, size_t index, int pending) {
+    if (plan->count == plan->capacity) {
+        size_t cap = plan->capacity ? plan->capacity * 2 : 32;
+        RSimProvStep *grown = realloc(plan->steps, cap * sizeof(*grown));
+        if (!grown) return NULL;
+        plan->steps = grown;
+        plan->capacity = cap;
+    }
+    RSimProvStep *s = &plan->steps[plan->count++];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    s->index = index;
+    s->status = pending ? RSIM_PROV_PENDING : RSIM_PROV_DONE;
+    return s;
+}
+
+static void hex(const unsigned char *bytes, size_t len, char *out) {
+    for (size_t i = 0; i < len; i++) sprintf(out + 2 * i, "%02x", bytes[i]);
+}
+
+/* 1 if TrustStore.sqlite3 has a row for this SHA-1 */
+static int trust_store_has(sqlite3 *db, const unsigned char digest[20]) {
+    sqlite3_stmt *stmt = NULL;
+    int found = 0;
+    if (db && sqlite3_prepare_v2(db, "SELECT 1 FROM tsettings WHERE sha1 = ?1", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_bind_blob(stmt, 1, digest, 20, SQLITE_STATIC);
+        found = sqlite3_step(stmt) == SQLITE_ROW;
+    }
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+static const char *const kOpNames[] = { "grant", "revoke", "reset" };
+
+int rsim_prov_plan(RSimProvPlan *plan, const char *device_root, const RSimProvProfile *p,
+                   const RSimProvFacts *facts, char *err, size_t err_size) {
+    memset(plan, 0, sizeof(*plan));
+    snprintf(plan->root, sizeof(plan->root), "%s", device_root);
+    char path[1200];
+    StateFile st;
+    state_load(device_root, &st);
+    int ret = 0;
+
+    if (p->privacy_count) {
+        int *pending = calloc(p->privacy_count, sizeof(int));
+        snprintf(path, sizeof(path), "%s/" TCC_DB, device_root);
+        if (!pending || rsim_tcc_pending(path, p->privacy, p->privacy_count, pending) != 0) {
+            /* Unreadable database: plan everything, let the transaction report it */
+            for (size_t i = 0; pending && i < p->privacy_count; i++) pending[i] = 1;
+        }
+        for (size_t i = 0; i < p->privacy_count; i++) {
+            const RSimTccChange *c = &p->privacy[i];
+            RSimProvStep *s = add_step(plan, RSIM_PROV_TCC, i, pending ? pending[i] : 1);
+            if (!s) break;
+            snprintf(s->key, sizeof(s->key), "%s %s", c->service && c->service[0] ? c->service : "all",
+                     c->client ? c->client : "*");
+            snprintf(s->value, sizeof(s->value), "%s", kOpNames[c->op % 3]);
+        }
+        free(pending);
+    }
+
+    if (p->cert_count) {
+        sqlite3 *db = NULL;
+        snprintf(path, sizeof(path), "%s/" TRUST_STORE_DB, device_root);
+        if (access(path, F_OK) != 0 || sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+            sqlite3_close(db);
+            db = NULL;
+        }
+        for (size_t i = 0; i < p->cert_count && ret == 0; i++) {
+            size_t size = 0;
+            unsigned char *der = rsim_prov_read_cert(p->certs[i], &size), digest[20];
+            if (!der) {
+                snprintf(err, err_size, "can't read certificate %s", p->certs[i]);
+                ret = -1;
+                break;
+            }
+            sha1(der, size, digest);
+            free(der);
+            RSimProvStep *s = add_step(plan, RSIM_PROV_CERT, i, !trust_store_has(db, digest));
+            if (!s) break;
+            hex(digest, 20, s->key);
+            snprintf(s->value, sizeof(s->value), "%s", base_name(p->certs[i]));
+        }
+        sqlite3_close(db);
+    }
+
+    if (p->content_size) {
+        int same = facts && facts->content_size && strcmp(facts->content_size, p->content_size) == 0;
+        RSimProvStep *s = add_step(plan, RSIM_PROV_CONTENT_SIZE, 0, !same);
+        if (s) snprintf(s->value, sizeof(s->value), "%s", p->content_size);
+    }
+
+    if (p->has_location) {
+        char value[64];
+        snprintf(value, sizeof(value), "%.6f,%.6f", p->lat, p->lon);
+        RSimProvStep *s = add_step(plan, RSIM_PROV_LOCATION, 0, !state_has(&st, RSIM_PROV_LOCATION, "", value));
+        if (s) snprintf(s->value, sizeof(s->value), "%s", value);
+    }
+
+    if (p->pasteboard) {
+        /* Recorded by FNV-1a digest, not the text itself */
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (const unsigned char *c = (const unsigned char *)p->pasteboard; *c; c++) h = (h ^ *c) * 0x100000001b3ull;
+        char value[32];
+        snprintf(value, sizeof(value), "%016llx", (unsigned long long)h);
+        RSimProvStep *s = add_step(plan, RSIM_PROV_PASTEBOARD, 0, !state_has(&st, RSIM_PROV_PASTEBOARD, "", value));
+        if (s) snprintf(s->value, sizeof(s->value), "%s", value);
+    }
+
+    for (size_t i = 0; i < p->media_count && ret == 0; i++) {
+        struct stat src, dst;
+        if (stat(p->media[i], &src) != 0 || !S_ISREG(src.st_mode)) {
+            snprintf(err, err_size, "can't read media file %s", p->media[i]);
+            ret = -1;
+            break;
+        }
+        snprintf(path, sizeof(path), "%s/" RSIM_PROV_DCIM_DIR "/%s", device_root, base_name(p->media[i]));
+        int present = stat(path, &dst) == 0 && dst.st_size == src.st_size;
+        RSimProvStep *s = add_step(plan, RSIM_PROV_MEDIA, i, !present);
+        if (!s) break;
+        snprintf(s->key, sizeof(s->key), "%s", base_name(p->media[i]));
+        snprintf(s->value, sizeof(s->value), "%lld", (long long)src.st_size);
+    }
+
+    for (size_t i = 0; i < p->app_count; i++) {
+        const RSimProvApp *want = &p->apps[i];
+        int installed = 0;
+        for (size_t k = 0; facts && k < facts->installed_count && !installed; k++) {
+            const RSimProvApp *have = &facts->installed[k];
+            installed = strcmp(have->bundle_id, want->bundle_id) == 0 &&
+                        (!want->version || (have->version && strcmp(have->version, want->version) == 0));
+        }
+        RSimProvStep *s = add_step(plan, RSIM_PROV_APP, i, !installed);
+        if (!s) break;
+        snprintf(s->key, sizeof(s->key), "%s", want->bundle_id);
+        snprintf(s->value, sizeof(s->value), "%s", want->version ? want->version : "");
+    }
+
+    state_free(&st);
+    for (size_t i = 0; i < plan->count; i++)
+        if (plan->steps[i].status == RSIM_PROV_PENDING && !plan->steps[i].note[0])
+            snprintf(plan->steps[i].note, sizeof(plan->steps[i].note), "differs");
+    return ret;
+}
+
+void rsim_prov_free(RSimProvPlan *plan) {
+    free(plan->steps);
+    memset(plan, 0, sizeof(*plan));
+}
+
+/* ================================================================
+ * Applying
+ * ================================================================ */
+
+void rsim_prov_mark(RSimProvStep *step, int ok, const char *note) {
+    step->status = ok ? RSIM_PROV_APPLIED : RSIM_PROV_FAILED;
+    snprintf(step->note, sizeof(step->note), "%s", note ? note : "");
+}
+
+static int apply_tcc(RSimProvPlan *plan, const RSimProvProfile *p) {
+    RSimTccChange *batch = calloc(p->privacy_count + 1, sizeof(*batch));
+    size_t n = 0;
+    for (size_t i = 0; batch && i < plan->count; i++)
+        if (plan->steps[i].kind == RSIM_PROV_TCC && plan->steps[i].status == RSIM_PROV_PENDING)
+            batch[n++] = p->privacy[plan->steps[i].index];
+    if (!n) {
+        free(batch);
+        return 0;
+    }
+    char path[1200], err[RSIM_PROV_NOTE_LEN] = "out of memory";
+    snprintf(path, sizeof(path), "%s/" TCC_DB, plan->root);
+    parent_dirs(path);
+    int ok = batch && rsim_tcc_apply(path, batch, n, err, sizeof(err)) >= 0;
+    free(batch);
+    int failed = 0;
+    for (size_t i = 0; i < plan->count; i++) {
+        RSimProvStep *s = &plan->steps[i];
+        if (s->kind != RSIM_PROV_TCC || s->status != RSIM_PROV_PENDING) continue;
+        rsim_prov_mark(s, ok, ok ? NULL : err);
+        failed += !ok;
+    }
+    return failed;
+}
+
+static const char kTrustSchema[] =
+    "CREATE TABLE IF NOT EXISTS tsettings ("
+    "sha1 BLOB NOT NULL DEFAULT (x''), subj BLOB NOT NULL DEFAULT (x''), "
+    "tset BLOB, data BLOB, PRIMARY KEY (sha1))";
+
+/* Open TrustStore.sqlite3 (created with its table if missing) in a
+ * transaction with the insert prepared. *db is set even on failure, for
+ * the error message. */
+static int trust_begin(const char *path, sqlite3 **db, sqlite3_stmt **insert) {
+    *db = NULL;
+    *insert = NULL;
+    parent_dirs(path);
+    if (sqlite3_open_v2(path, db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK) return -1;
+    sqlite3_busy_timeout(*db, 5000);
+    return sqlite3_exec(*db, kTrustSchema, NULL, NULL, NULL) == SQLITE_OK &&
+           sqlite3_exec(*db, "BEGIN IMMEDIATE", NULL, NULL, NULL) == SQLITE_OK &&
+           sqlite3_prepare_v2(*db, "INSERT OR REPLACE INTO tsettings (sha1, subj, data) VALUES (?1, x'', ?2)",
+                              -1, insert, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+/* Rows are keyed by the certificate's SHA-1, which is how securityd looks them up */
+static int trust_insert(sqlite3_stmt *insert, const unsigned char *der, size_t size) {
+    unsigned char digest[20];
+    sha1(der, size, digest);
+    sqlite3_reset(insert);
+    sqlite3_bind_blob(insert, 1, digest, 20, SQLITE_TRANSIENT);
+    sqlite3_bind_blob(insert, 2, der, (int)size, SQLITE_TRANSIENT);
+    return sqlite3_step(insert) == SQLITE_DONE ? 0 : -1;
+}
+
+/* Commit if everything went in, otherwise roll back with the reason in err */
+static int trust_end(sqlite3 *db, sqlite3_stmt *insert, int ok, char *err, size_t err_size) {
+    sqlite3_finalize(insert);
+    if (ok && sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) ok = 0;
+    if (!ok) {
+        snprintf(err, err_size, "%s", db ? sqlite3_errmsg(db) : "can't open TrustStore.sqlite3");
+        if (db) sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    sqlite3_close(db);
+    return ok;
+}
+
+int rsim_prov_trust_add(const char *device_root, const unsigned char *der, size_t size,
+                        char *err, size_t err_size) {
+    char path[1200];
+    snprintf(path, sizeof(path), "%s/" TRUST_STORE_DB, device_root);
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    int ok = trust_begin(path, &db, &insert) == 0 && trust_insert(insert, der, size) == 0;
+    return trust_end(db, insert, ok, err, err_size) ? 0 : -1;
+}
+
+static int apply_certs(RSimProvPlan *plan, const RSimProvProfile *p) {
+    char path[1200], msg[RSIM_PROV_NOTE_LEN] = "";
+    snprintf(path, sizeof(path), "%s/" TRUST_STORE_DB, plan->root);
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    int any = 0, failed = 0;
+    for (size_t i = 0; i < plan->count; i++)
+        any |= plan->steps[i].kind == RSIM_PROV_CERT && plan->steps[i].status == RSIM_PROV_PENDING;
+    if (!any) return 0;
+
+    int ok = trust_begin(path, &db, &insert) == 0;
+    for (size_t i = 0; ok && i < plan->count; i++) {
+        RSimProvStep *s = &plan->steps[i];
+        if (s->kind != RSIM_PROV_CERT || s->status != RSIM_PROV_PENDING) continue;
+        size_t size = 0;
+        unsigned char *der = rsim_prov_read_cert(p->certs[s->index], &size);
+        ok = der && trust_insert(insert, der, size) == 0;
+        free(der);
+    }
+    ok = trust_end(db, insert, ok, msg, sizeof(msg));
+    for (size_t i = 0; i < plan->count; i++) {
+        RSimProvStep *s = &plan->steps[i];
+        if (s->kind != RSIM_PROV_CERT || s->status != RSIM_PROV_PENDING) continue;
+        rsim_prov_mark(s, ok, ok ? NULL : msg);
+        failed += !ok;
+    }
+    return failed;
+}
+
+static int apply_media(RSimProvPlan *plan, const RSimProvProfile *p) {
+    char dir[1200], path[1400];
+    snprintf(dir, sizeof(dir), "%s/" RSIM_PROV_DCIM_DIR, plan->root);
+    int failed = 0, made = 0;
+    for (size_t i = 0; i < plan->count; i++) {
+        RSimProvStep *s = &plan->steps[i];
+        if (s->kind != RSIM_PROV_MEDIA || s->status != RSIM_PROV_PENDING) continue;
+        if (!made++) mkdirs(dir);
+        snprintf(path, sizeof(path), "%s/%s", dir, s->key);
+        int ok = copy_file(p->media[s->index], path) == 0;
+        rsim_prov_mark(s, ok, ok ? NULL : strerror(errno));
+        failed += !ok;
+    }
+    return failed;
+}
+
+int rsim_prov_apply(RSimProvPlan *plan, const RSimProvProfile *profile, unsigned kinds) {
+    int failed = 0;
+    if (kinds & (1u << RSIM_PROV_TCC))   failed += apply_tcc(plan, profile);
+    if (kinds & (1u << RSIM_PROV_CERT))  failed += apply_certs(plan, profile);
+    if (kinds & (1u << RSIM_PROV_MEDIA)) failed += apply_media(plan, profile);
+    return failed;
+}
+
+int rsim_prov_save_state(const RSimProvPlan *plan) {
+    StateFile st;
+    state_load(plan->root, &st);
+    for (size_t i = 0; i < plan->count; i++) {
+        const RSimProvStep *s = &plan->steps[i];
+        if (s->status != RSIM_PROV_APPLIED) continue;
+        char line[512];
+        snprintf(line, sizeof(line), "%s\t%s\t%s", rsim_prov_kind_name(s->kind), s->key, s->value);
+        long at = state_find(&st, s->kind, s->key);
+        if (at >= 0) {
+            free(st.lines[at]);
+            st.lines[at] = strdup(line);
+        } else {
+            char **grown = realloc(st.lines, (st.count + 1) * sizeof(char *));
+            if (!grown) break;
+            st.lines = grown;
+            st.lines[st.count++] = strdup(line);
+        }
+    }
+
+    char path[1200], tmp[1300];
+    snprintf(path, sizeof(path), "%s/" RSIM_PROV_STATE_FILE, plan->root);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    parent_dirs(path);
+    FILE *f = fopen(tmp, "w");
+    int ret = -1;
+    if (f) {
+        for (size_t i = 0; i < st.count; i++)
+            if (st.lines[i]) fprintf(f, "%s\n", st.lines[i]);
+        ret = fclose(f) == 0 && rename(tmp, path) == 0 ? 0 : -1;
+        if (ret) unlink(tmp);
+    }
+    state_free(&st);
+    return ret;
+}
+
+void rsim_prov_counts(const RSimProvPlan *plan, size_t counts[4]) {
+    memset(counts, 0, 4 * sizeof(size_t));
+    for (size_t i = 0; i < plan->count; i++) counts[plan->steps[i].status]++;
+}
@@ -0,0 +1,130 @@
+/*
+ * rosettasim_provision.h — Diff/plan engine for `rosettasim-ctl provision` (portable C)
+ *
+ * A profile lists the state a legacy device should be in: privacy grants,
+ * trusted certificates, content size, location, pasteboard, media and apps.
+ * rsim_prov_plan() compares it with the device's data directory and turns it
+ * into steps, each marked pending or already done, so running the same
+ * profile twice writes nothing the second time.
+ *
+ * What lives in plain files is read and written here, one transaction or
+ * copy pass per kind:
+ *   TCC      Library/TCC/TCC.db (via rosettasim_tcc.c)
+ *   CERT     Library/Keychains/TrustStore.sqlite3, keyed by SHA-1 of the DER
+ *   MEDIA    Media/DCIM/100APPLE/<name>, same name and size = present
+ * The rest needs Apple APIs or the in-sim agent, so the caller reads the
+ * current values into RSimProvFacts and applies those steps itself:
+ *   CONTENT_SIZE, APP                       compared against the facts
+ *   LOCATION, PASTEBOARD                    compared against what the last
+ *                                           run recorded in the state file
+ *
+ * State file: {device data}/Library/rosettasim_provision.tsv, one
+ * "<kind>\t<key>\t<value>" line per step applied.
+ */
+
+#ifndef ROSETTASIM_PROVISION_H
+#define ROSETTASIM_PROVISION_H
+
+#include "rosettasim_tcc.h"
+
+#include <stddef.h>
+
+#define RSIM_PROV_STATE_FILE    "Library/rosettasim_provision.tsv"
+#define RSIM_PROV_DCIM_DIR      "Media/DCIM/100APPLE"
+#define RSIM_PROV_NOTE_LEN      160     /* longer notes are cut */
+
+typedef enum {
+    RSIM_PROV_TCC,
+    RSIM_PROV_CERT,
+    RSIM_PROV_CONTENT_SIZE,
+    RSIM_PROV_LOCATION,
+    RSIM_PROV_PASTEBOARD,
+    RSIM_PROV_MEDIA,
+    RSIM_PROV_APP,
+    RSIM_PROV_KIND_COUNT,
+} RSimProvKind;
+
+#define RSIM_PROV_FILE_KINDS    ((1u << RSIM_PROV_TCC) | (1u << RSIM_PROV_CERT) | (1u << RSIM_PROV_MEDIA))
+
+typedef struct {
+    const char *bundle_id;
+    const char *version;        /* CFBundleVersion; NULL matches any */
+    const char *path;           /* .app on the host (profile) or NULL (facts) */
+} RSimProvApp;
+
+typedef struct {
+    const RSimTccChange    *privacy;
+    size_t                  privacy_count;
+    const char *const      *certs;          /* PEM or DER files */
+    size_t                  cert_count;
+    const char             *content_size;   /* UICTContentSizeCategory* or NULL */
+    int                     has_location;
+    double                  lat, lon;
+    const char             *pasteboard;     /* or NULL */
+    const char *const      *media;          /* files to put in DCIM */
+    size_t                  media_count;
+    const RSimProvApp      *apps;
+    size_t                  app_count;
+} RSimProvProfile;
+
+/* Current values the caller reads with platform APIs */
+typedef struct {
+    const char             *content_size;   /* PreferredContentSizeCategoryName, or NULL */
+    const RSimProvApp      *installed;
+    size_t                  installed_count;
+} RSimProvFacts;
+
+typedef enum {
+    RSIM_PROV_DONE,             /* already in the wanted state */
+    RSIM_PROV_PENDING,
+    RSIM_PROV_APPLIED,
+    RSIM_PROV_FAILED,
+} RSimProvStatus;
+
+typedef struct {
+    RSimProvKind    kind;
+    RSimProvStatus  status;
+    size_t          index;      /* into the profile's array for this kind */
+    char            key[160];   /* what it is: service/client, SHA-1, file name, bundle ID */
+    char            value[160]; /* wanted value as recorded in the state file */
+    char            note[RSIM_PROV_NOTE_LEN];  /* why pending, or why it failed */
+} RSimProvStep;
+
+typedef struct {
+    char            root[1024]; /* device data directory */
+    RSimProvStep   *steps;
+    size_t          count;
+    size_t          capacity;
+} RSimProvPlan;
+
+/* Build the plan for one device. Returns 0, or -1 if the profile can't be
+ * read (a missing certificate or media file; the message is in err). */
+int  rsim_prov_plan(RSimProvPlan *plan, const char *device_root, const RSimProvProfile *profile,
+                    const RSimProvFacts *facts, char *err, size_t err_size);
+void rsim_prov_free(RSimProvPlan *plan);
+
+/* Apply the pending file-backed steps whose kind is in kinds (a bit mask):
+ * TCC and certificates in one transaction each, media by clone/copy.
+ * Returns the number of failed steps. */
+int  rsim_prov_apply(RSimProvPlan *plan, const RSimProvProfile *profile, unsigned kinds);
+
+/* Steps the caller applied itself */
+void rsim_prov_mark(RSimProvStep *step, int ok, const char *note);
+
+/* Record applied steps in the state file (merged with earlier runs) */
+int  rsim_prov_save_state(const RSimProvPlan *plan);
+
+/* Counts by status, for reporting */
+void rsim_prov_counts(const RSimProvPlan *plan, size_t counts[4]);
+
+const char *rsim_prov_kind_name(RSimProvKind kind);
+
+/* DER bytes of a PEM or DER certificate file (malloc'd), or NULL */
+unsigned char *rsim_prov_read_cert(const char *path, size_t *size);
+
+/* Add one DER certificate to the device's TrustStore.sqlite3 (created if
+ * missing), keyed by its SHA-1. Returns 0, or -1 with a message in err. */
+int  rsim_prov_trust_add(const char *device_root, const unsigned char *der, size_t size,
+                         char *err, size_t err_size);
+
+#endif /* ROSETTASIM_PROVISION_H */
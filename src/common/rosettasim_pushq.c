@@ -0,0 +1,142 @@
+/*
+ * rosettasim_pushq.c — Push batch queue, rate limiter, latency stats (see rosettasim_pushq.h)
+ */
+
+#include "rosettasim_pushq.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+/* ================================================================
+ * Queue
+ * ================================================================ */
+
+int rsim_pushq_init(RSimPushQueue *q, size_t capacity) {
+    memset(q, 0, sizeof(*q));
+    q->items = calloc(capacity, sizeof(*q->items));
+    if (!q->items) return -1;
+    q->capacity = capacity;
+    q->next_seq = 1;
+    return 0;
+}
+
+int rsim_pushq_push(RSimPushQueue *q, char *data, size_t len, uint32_t seq) {
+    if (q->count == q->capacity) return -1;
+    q->items[(q->head + q->count) % q->capacity] = (RSimPushItem){ data, len, seq };
+    q->count++;
+    return 0;
+}
+
+int rsim_pushq_pop(RSimPushQueue *q, RSimPushItem *item) {
+    if (q->count == 0) return -1;
+    *item = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    return 0;
+}
+
+static int blank(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        if (!isspace((unsigned char)s[i])) return 0;
+    return 1;
+}
+
+size_t rsim_pushq_fill(RSimPushQueue *q, FILE *f) {
+    size_t added = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while (q->count < q->capacity) {
+        ssize_t n = getline(&line, &cap, f);
+        if (n < 0) {
+            q->eof = 1;
+            break;
+        }
+        uint32_t seq = q->next_seq++;
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if (blank(line, (size_t)n)) continue;
+        /* Hand over the buffer itself; getline allocates the next one */
+        rsim_pushq_push(q, line, (size_t)n, seq);
+        line = NULL;
+        cap = 0;
+        added++;
+    }
+    free(line);
+    return added;
+}
+
+int rsim_pushq_done(const RSimPushQueue *q) {
+    return q->eof && q->count == 0;
+}
+
+void rsim_pushq_free(RSimPushQueue *q) {
+    RSimPushItem item;
+    while (rsim_pushq_pop(q, &item) == 0) free(item.data);
+    free(q->items);
+    memset(q, 0, sizeof(*q));
+}
+
+/* ================================================================
+ * Rate limiter
+ * ================================================================ */
+
+void rsim_ratelimit_init(RSimRateLimit *rl, double rate, unsigned burst, double now) {
+    rl->interval = 1.0 / rate;
+    rl->window = (burst > 1 ? burst - 1 : 0) * rl->interval;
+    rl->tat = now;
+}
+
+double rsim_ratelimit_take(RSimRateLimit *rl, double now, double *due) {
+    double earliest = rl->tat - rl->window;
+    if (now < earliest) return earliest - now;
+    /* Late by a little: keep the grid (catch up). A stall: restart from now. */
+    double slack = rl->interval > RSIM_RATELIMIT_SLACK ? rl->interval : RSIM_RATELIMIT_SLACK;
+    if (rl->tat < now - rl->window - slack) rl->tat = now;
+    *due = rl->tat < now ? rl->tat : now;      /* early (burst) payloads aren't late */
+    rl->tat += rl->interval;
+    return 0;
+}
+
+/* ================================================================
+ * Latency samples
+ * ================================================================ */
+
+int rsim_latency_add(RSimLatencies *lat, double ms) {
+    if (lat->count == lat->capacity) {
+        size_t cap = lat->capacity ? lat->capacity * 2 : 1024;
+        double *p = realloc(lat->ms, cap * sizeof(*p));
+        if (!p) return -1;
+        lat->ms = p;
+        lat->capacity = cap;
+    }
+    lat->ms[lat->count++] = ms;
+    lat->sum_ms += ms;
+    lat->sorted = 0;
+    return 0;
+}
+
+double rsim_latency_mean(const RSimLatencies *lat) {
+    return lat->count ? lat->sum_ms / lat->count : 0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+double rsim_latency_percentile(RSimLatencies *lat, double p) {
+    if (!lat->count) return 0;
+    if (!lat->sorted) {
+        qsort(lat->ms, lat->count, sizeof(*lat->ms), cmp_double);
+        lat->sorted = 1;
+    }
+    size_t rank = (size_t)ceil(p * lat->count);
+    return lat->ms[rank ? rank - 1 : 0];
+}
+
+void rsim_latency_free(RSimLatencies *lat) {
+    free(lat->ms);
+    memset(lat, 0, sizeof(*lat));
+}
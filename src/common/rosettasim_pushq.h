@@ -0,0 +1,94 @@
+/*
+ * rosettasim_pushq.h — Paced delivery queue for push notification batches (portable C)
+ *
+ * `rosettasim-ctl push <UDID> <bundle> --batch payloads.jsonl --rate N`
+ * spools the payloads (one JSON object per line) to a file and hands it to
+ * sim_app_installer, which streams it through a bounded queue:
+ *
+ *   spool file --rsim_pushq_fill--> queue --rsim_ratelimit_take--> deliver
+ *
+ * The queue holds at most its capacity, so a batch of any size costs a
+ * fixed amount of SpringBoard memory. The rate limiter is GCRA (a token
+ * bucket kept as one "theoretical arrival time"): payload k is due at
+ * start + k / rate and up to burst - 1 payloads may go early. Timer
+ * jitter doesn't move the schedule (late payloads are caught up), so the
+ * achieved rate doesn't drift below the target; only after a stall longer
+ * than RSIM_RATELIMIT_SLACK does it restart from now instead of firing a
+ * long catch-up burst.
+ *
+ * Latency is measured from a payload's due time to the end of its
+ * delivery: scheduling lateness plus the cost of handing it to SpringBoard.
+ *
+ * Used by rosettasim-ctl and sim_app_installer; no Apple framework
+ * dependencies.
+ */
+
+#ifndef ROSETTASIM_PUSHQ_H
+#define ROSETTASIM_PUSHQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define RSIM_PUSHQ_CAPACITY     256
+#define RSIM_PUSH_MAX_RATE      1000.0  /* payloads per second */
+
+typedef struct {
+    char       *data;           /* NUL-terminated payload line (owned) */
+    size_t      len;
+    uint32_t    seq;            /* 1-based line number in the spool */
+} RSimPushItem;
+
+typedef struct {
+    RSimPushItem   *items;      /* ring buffer */
+    size_t          capacity;
+    size_t          head;
+    size_t          count;
+    uint32_t        next_seq;   /* line number of the next line read */
+    int             eof;        /* the spool has been read to the end */
+} RSimPushQueue;
+
+int     rsim_pushq_init(RSimPushQueue *q, size_t capacity);
+/* Takes ownership of data (malloc'd) on success. Returns 0, or -1 when full. */
+int     rsim_pushq_push(RSimPushQueue *q, char *data, size_t len, uint32_t seq);
+/* Returns 0 with the oldest item (caller frees item->data), or -1 when empty */
+int     rsim_pushq_pop(RSimPushQueue *q, RSimPushItem *item);
+/* Read lines from f until the queue is full or f is at EOF (sets q->eof).
+ * Blank lines are skipped. Returns the number of items added. */
+size_t  rsim_pushq_fill(RSimPushQueue *q, FILE *f);
+/* Nothing left: queue empty and spool exhausted */
+int     rsim_pushq_done(const RSimPushQueue *q);
+void    rsim_pushq_free(RSimPushQueue *q);
+
+/* ---- Rate limiter (GCRA) ---- */
+
+#define RSIM_RATELIMIT_SLACK    0.1     /* seconds behind before the schedule restarts */
+
+typedef struct {
+    double  interval;           /* seconds between payloads */
+    double  window;             /* how early a payload may go: (burst - 1) * interval */
+    double  tat;                /* theoretical arrival time of the next payload */
+} RSimRateLimit;
+
+void    rsim_ratelimit_init(RSimRateLimit *rl, double rate, unsigned burst, double now);
+/* 0 when a payload may go now (it is then counted, and *due set to its
+ * scheduled time), else the seconds to wait before asking again. */
+double  rsim_ratelimit_take(RSimRateLimit *rl, double now, double *due);
+
+/* ---- Latency samples ---- */
+
+typedef struct {
+    double *ms;
+    size_t  count;
+    size_t  capacity;
+    double  sum_ms;
+    int     sorted;
+} RSimLatencies;
+
+int     rsim_latency_add(RSimLatencies *lat, double ms);
+double  rsim_latency_mean(const RSimLatencies *lat);
+/* Value below which fraction p (0..1) of the samples fall (nearest rank) */
+double  rsim_latency_percentile(RSimLatencies *lat, double p);
+void    rsim_latency_free(RSimLatencies *lat);
+
+#endif /* ROSETTASIM_PUSHQ_H */
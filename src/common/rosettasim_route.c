@@ -0,0 +1,296 @@
+/*
+ * rosettasim_route.c — GPX parsing and route sampling (see rosettasim_route.h)
+ */
+
+#include "rosettasim_route.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EARTH_RADIUS_M  6371008.8
+#define DEG             (M_PI / 180.0)
+
+int rsim_route_add(RSimRoute *route, double lat, double lon, double ele, double time) {
+    if (route->count == route->capacity) {
+        size_t cap = route->capacity ? route->capacity * 2 : 256;
+        RSimRoutePoint *p = realloc(route->points, cap * sizeof(*p));
+        if (!p) return -1;
+        route->points = p;
+        route->capacity = cap;
+    }
+    route->points[route->count++] = (RSimRoutePoint){ lat, lon, ele, time, 0, 0 };
+    return 0;
+}
+
+void rsim_route_free(RSimRoute *route) {
+    free(route->points);
+    memset(route, 0, sizeof(*route));
+}
+
+/* ================================================================
+ * GPX
+ * ================================================================ */
+
+/* Days from 1970-01-01 to y-m-d (proleptic Gregorian) */
+static long days_from_civil(long y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long)doe - 719468;
+}
+
+/* ISO 8601 as GPX writes it: 2024-05-01T12:00:00[.123][Z|+02:00] */
+static double parse_iso8601(const char *s, const char *end) {
+    int y, mo, d, h, mi, n = 0;
+    double sec;
+    char buf[64];
+    size_t len = (size_t)(end - s);
+    if (len >= sizeof(buf)) return NAN;
+    memcpy(buf, s, len);
+    buf[len] = '\0';
+    if (sscanf(buf, " %d-%d-%dT%d:%d:%lf%n", &y, &mo, &d, &h, &mi, &sec, &n) != 6) return NAN;
+    double t = (double)days_from_civil(y, (unsigned)mo, (unsigned)d) * 86400.0 + h * 3600.0 + mi * 60.0 + sec;
+    const char *tz = buf + n;
+    if (*tz == '+' || *tz == '-') {
+        int oh = 0, om = 0;
+        if (sscanf(tz + 1, "%d:%d", &oh, &om) < 1) return NAN;
+        t -= (*tz == '+' ? 1 : -1) * (oh * 3600.0 + om * 60.0);
+    }
+    return t;
+}
+
+static const char *find(const char *p, const char *end, const char *needle) {
+    size_t n = strlen(needle);
+    for (; p + n <= end; p++)
+        if (*p == *needle && memcmp(p, needle, n) == 0) return p;
+    return NULL;
+}
+
+/* Next <name ...> start tag (not <nameX>), or NULL */
+static const char *find_tag(const char *p, const char *end, const char *name) {
+    char open[32];
+    snprintf(open, sizeof(open), "<%s", name);
+    size_t n = strlen(open);
+    while ((p = find(p, end, open))) {
+        if (p + n < end && (isspace((unsigned char)p[n]) || p[n] == '>' || p[n] == '/')) return p;
+        p += n;
+    }
+    return NULL;
+}
+
+/* Attribute value within a start tag [tag, tag_end); either quote style */
+static int attr_double(const char *tag, const char *tag_end, const char *name, double *out) {
+    size_t n = strlen(name);
+    for (const char *p = tag; p + n + 2 < tag_end; p++) {
+        if (!isspace((unsigned char)p[0]) || memcmp(p + 1, name, n) != 0) continue;
+        const char *q = p + 1 + n;
+        while (q < tag_end && isspace((unsigned char)*q)) q++;
+        if (q >= tag_end || *q++ != '=') continue;
+        while (q < tag_end && isspace((unsigned char)*q)) q++;
+        if (q >= tag_end || (*q != '"' && *q != '\'')) continue;
+        char *e;
+        *out = strtod(q + 1, &e);
+        return e > q + 1 && *e == *q ? 0 : -1;
+    }
+    return -1;
+}
+
+/* Text of <name>...</name> inside [p, end), or NULL */
+static const char *child_text(const char *p, const char *end, const char *name, const char **text_end) {
+    const char *tag = find_tag(p, end, name);
+    if (!tag) return NULL;
+    const char *gt = memchr(tag, '>', (size_t)(end - tag));
+    if (!gt || gt[-1] == '/') return NULL;
+    char close[32];
+    snprintf(close, sizeof(close), "</%s", name);
+    const char *c = find(gt + 1, end, close);
+    if (!c) return NULL;
+    *text_end = c;
+    return gt + 1;
+}
+
+static int parse_points(RSimRoute *route, const char *xml, const char *end, const char *name,
+                        char *err, size_t err_size) {
+    int added = 0;
+    char close[32];
+    snprintf(close, sizeof(close), "</%s", name);
+    for (const char *p = find_tag(xml, end, name); p; p = find_tag(p, end, name)) {
+        const char *gt = memchr(p, '>', (size_t)(end - p));
+        if (!gt) break;
+        double lat, lon, ele = 0, time = NAN;
+        /* strtod takes "nan" and "inf", which no range check catches */
+        if (attr_double(p, gt, "lat", &lat) != 0 || attr_double(p, gt, "lon", &lon) != 0 ||
+            !isfinite(lat) || !isfinite(lon) || lat < -90 || lat > 90 || lon < -180 || lon > 180) {
+            int line = 1;
+            for (const char *q = xml; q < p; q++) line += *q == '\n';
+            snprintf(err, err_size, "line %d: <%s> without a valid lat/lon", line, name);
+            return -1;
+        }
+        const char *next = gt + 1;
+        if (gt[-1] != '/') {
+            const char *body_end = find(gt + 1, end, close);
+            if (!body_end) body_end = end;
+            const char *te, *tx;
+            if ((tx = child_text(gt + 1, body_end, "ele", &te))) ele = strtod(tx, NULL);
+            if ((tx = child_text(gt + 1, body_end, "time", &te))) time = parse_iso8601(tx, te);
+            next = body_end;
+        }
+        if (rsim_route_add(route, lat, lon, ele, time) != 0) {
+            snprintf(err, err_size, "out of memory");
+            return -1;
+        }
+        added++;
+        p = next;
+    }
+    return added;
+}
+
+int rsim_route_parse_gpx(RSimRoute *route, const char *xml, size_t len, char *err, size_t err_size) {
+    /* A track is what was driven; a route its planned turns; waypoints last */
+    static const char *const kinds[] = { "trkpt", "rtept", "wpt" };
+    const char *end = xml + len;
+    if (!find(xml, end, "<gpx")) {
+        snprintf(err, err_size, "not a GPX document");
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        int n = parse_points(route, xml, end, kinds[i], err, err_size);
+        if (n != 0) return n;
+    }
+    snprintf(err, err_size, "no <trkpt>, <rtept> or <wpt> points");
+    return -1;
+}
+
+int rsim_route_load_gpx(RSimRoute *route, const char *path, char *err, size_t err_size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        snprintf(err, err_size, "%s: cannot open", path);
+        return -1;
+    }
+    size_t cap = 1 << 16, len = 0;
+    char *buf = malloc(cap);
+    size_t n;
+    while (buf && (n = fread(buf + len, 1, cap - len, f)) > 0) {
+        len += n;
+        if (len == cap) {
+            char *grown = realloc(buf, cap *= 2);
+            if (!grown) free(buf);
+            buf = grown;
+        }
+    }
+    fclose(f);
+    if (!buf) {
+        snprintf(err, err_size, "%s: out of memory", path);
+        return -1;
+    }
+    int rc = rsim_route_parse_gpx(route, buf, len, err, err_size);
+    free(buf);
+    return rc;
+}
+
+/* ================================================================
+ * Geometry and timeline
+ * ================================================================ */
+
+double rsim_route_distance(double lat1, double lon1, double lat2, double lon2) {
+    double dlat = (lat2 - lat1) * DEG, dlon = (lon2 - lon1) * DEG;
+    double a = sin(dlat / 2) * sin(dlat / 2) +
+               cos(lat1 * DEG) * cos(lat2 * DEG) * sin(dlon / 2) * sin(dlon / 2);
+    return 2 * EARTH_RADIUS_M * atan2(sqrt(a), sqrt(1 - a));
+}
+
+double rsim_route_bearing(double lat1, double lon1, double lat2, double lon2) {
+    double dlon = (lon2 - lon1) * DEG;
+    double y = sin(dlon) * cos(lat2 * DEG);
+    double x = cos(lat1 * DEG) * sin(lat2 * DEG) - sin(lat1 * DEG) * cos(lat2 * DEG) * cos(dlon);
+    double b = atan2(y, x) / DEG;
+    return b < 0 ? b + 360 : b;
+}
+
+double rsim_route_timeline(RSimRoute *route, double speed_mps) {
+    RSimRoutePoint *p = route->points;
+    size_t n = route->count;
+    if (n == 0) return 0;
+
+    int timed = speed_mps <= 0;
+    p[0].dist = 0;
+    for (size_t i = 1; i < n; i++) {
+        p[i].dist = p[i - 1].dist + rsim_route_distance(p[i - 1].lat, p[i - 1].lon, p[i].lat, p[i].lon);
+        /* GPX times must be present and never go backwards to be replayed */
+        if (isnan(p[i].time) || isnan(p[0].time) || p[i].time < p[i - 1].time) timed = 0;
+    }
+    if (n == 1 || isnan(p[0].time)) timed = 0;
+    if (speed_mps <= 0 && !timed) speed_mps = RSIM_ROUTE_DEFAULT_SPEED;
+
+    for (size_t i = 0; i < n; i++)
+        p[i].t = timed ? p[i].time - p[0].time : p[i].dist / speed_mps;
+    return p[n - 1].t;
+}
+
+int rsim_route_sample(const RSimRoute *route, double t, size_t *cursor, RSimRouteFix *fix) {
+    const RSimRoutePoint *p = route->points;
+    size_t n = route->count;
+    if (n == 0) return 1;
+
+    size_t i = *cursor < n ? *cursor : 0;
+    if (t < p[i].t) i = 0;                          /* went backwards: rescan */
+    while (i + 1 < n && p[i + 1].t <= t) i++;
+    *cursor = i;
+
+    if (i + 1 >= n) {
+        const RSimRoutePoint *e = &p[n - 1];
+        *fix = (RSimRouteFix){ e->lat, e->lon, e->ele, -1, 0 };
+        return 1;
+    }
+
+    const RSimRoutePoint *a = &p[i], *b = &p[i + 1];
+    double span = b->t - a->t;
+    double f = span > 0 ? (t - a->t) / span : 1;
+    if (f < 0) f = 0;
+    double seg = b->dist - a->dist;
+    /* The short way round: 179 -> -179 crosses the antimeridian, not Greenwich */
+    double dlon = remainder(b->lon - a->lon, 360);
+    fix->lat = a->lat + (b->lat - a->lat) * f;
+    fix->lon = a->lon + dlon * f;
+    if (fix->lon > 180) fix->lon -= 360;
+    else if (fix->lon < -180) fix->lon += 360;
+    fix->ele = a->ele + (b->ele - a->ele) * f;
+    fix->speed = span > 0 ? seg / span : 0;
+    fix->course = seg > 0.01 && fix->speed > 0 ? rsim_route_bearing(a->lat, a->lon, b->lat, b->lon) : -1;
+    return 0;
+}
+
+/* ================================================================
+ * Timer accuracy
+ * ================================================================ */
+
+void rsim_tick_record(RSimTickStats *stats, double late_ms, unsigned missed) {
+    if (late_ms < 0) late_ms = 0;
+    stats->ticks++;
+    stats->missed += missed;
+    stats->sum_ms += late_ms;
+    if (late_ms > stats->max_ms) stats->max_ms = late_ms;
+    size_t b = (size_t)(late_ms * 10);
+    stats->hist[b < RSIM_TICK_BUCKETS ? b : RSIM_TICK_BUCKETS - 1]++;
+}
+
+double rsim_tick_mean(const RSimTickStats *stats) {
+    return stats->ticks ? stats->sum_ms / stats->ticks : 0;
+}
+
+double rsim_tick_percentile(const RSimTickStats *stats, double p) {
+    if (!stats->ticks) return 0;
+    size_t want = (size_t)ceil(p * stats->ticks), seen = 0;
+    if (want < 1) want = 1;
+    for (size_t b = 0; b < RSIM_TICK_BUCKETS; b++) {
+        seen += stats->hist[b];
+        if (seen >= want)
+            return b == RSIM_TICK_BUCKETS - 1 ? stats->max_ms : (b + 1) / 10.0;
+    }
+    return stats->max_ms;
+}
@@ -0,0 +1,93 @@
+/*
+ * rosettasim_route.h — GPX routes and timed playback for location simulation (portable C)
+ *
+ * `rosettasim-ctl location <UDID> route file.gpx` parses the GPX on the host
+ * (<trkpt>, else <rtept>, else <wpt>), gives every point a playback time and
+ * sends the whole route to sim_app_installer once. Inside the simulator a
+ * timer samples the route at the requested rate:
+ *
+ *   t = now - start        (not a running sum of intervals, so no drift)
+ *   fix = rsim_route_sample(route, t)
+ *
+ * Positions are interpolated linearly between points (segments of a GPS
+ * track are short enough that the great-circle difference is far below
+ * GPS accuracy), the short way across the antimeridian; course and speed
+ * come from the enclosing segment.
+ *
+ * RSimTickStats records how late each timer tick fired against its ideal
+ * time, which is what the playback reports as timing accuracy.
+ *
+ * Used by rosettasim-ctl and sim_app_installer; no Apple framework
+ * dependencies.
+ */
+
+#ifndef ROSETTASIM_ROUTE_H
+#define ROSETTASIM_ROUTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_ROUTE_DEFAULT_SPEED    10.0    /* m/s when neither --speed nor GPX times */
+#define RSIM_ROUTE_MAX_RATE         50.0    /* Hz */
+
+typedef struct {
+    double  lat, lon;           /* degrees */
+    double  ele;                /* meters; 0 when the GPX has none */
+    double  time;               /* GPX <time>, seconds since 1970; NAN if none */
+    double  t;                  /* playback time, seconds from the first point */
+    double  dist;               /* meters along the route from the first point */
+} RSimRoutePoint;
+
+typedef struct {
+    RSimRoutePoint *points;
+    size_t          count;
+    size_t          capacity;
+} RSimRoute;
+
+typedef struct {
+    double  lat, lon, ele;
+    double  course;             /* degrees clockwise from north; -1 while stopped */
+    double  speed;              /* m/s */
+} RSimRouteFix;
+
+/* Append a point (time may be NAN). Returns 0, or -1 on allocation failure. */
+int     rsim_route_add(RSimRoute *route, double lat, double lon, double ele, double time);
+
+/* Parse GPX text. Returns the number of points added, or -1 with a message
+ * in err. */
+int     rsim_route_parse_gpx(RSimRoute *route, const char *xml, size_t len,
+                             char *err, size_t err_size);
+int     rsim_route_load_gpx(RSimRoute *route, const char *path, char *err, size_t err_size);
+
+/* Fill dist and t for every point: at speed_mps when > 0, else from the GPX
+ * times when every point has one, else at RSIM_ROUTE_DEFAULT_SPEED. Returns
+ * the playback duration in seconds. */
+double  rsim_route_timeline(RSimRoute *route, double speed_mps);
+
+/* Position at playback time t. cursor (start at 0) makes sequential calls
+ * O(1). Returns 0 inside the route, 1 at or past its end (fix = last point). */
+int     rsim_route_sample(const RSimRoute *route, double t, size_t *cursor, RSimRouteFix *fix);
+
+/* Great-circle distance in meters and initial bearing in degrees */
+double  rsim_route_distance(double lat1, double lon1, double lat2, double lon2);
+double  rsim_route_bearing(double lat1, double lon1, double lat2, double lon2);
+
+void    rsim_route_free(RSimRoute *route);
+
+/* ---- Timer accuracy ---- */
+
+#define RSIM_TICK_BUCKETS       250     /* 0.1 ms each; the last also holds anything later */
+
+typedef struct {
+    size_t      ticks;                  /* handler runs */
+    size_t      missed;                 /* ideal ticks coalesced into a later run */
+    double      sum_ms, max_ms;         /* lateness against the ideal tick time */
+    uint32_t    hist[RSIM_TICK_BUCKETS];
+} RSimTickStats;
+
+void    rsim_tick_record(RSimTickStats *stats, double late_ms, unsigned missed);
+double  rsim_tick_mean(const RSimTickStats *stats);
+/* Lateness below which fraction p (0..1) of the ticks fired, in ms */
+double  rsim_tick_percentile(const RSimTickStats *stats, double p);
+
+#endif /* ROSETTASIM_ROUTE_H */
@@ -0,0 +1,77 @@
+/*
+ * rosettasim_sfb.h — Wire protocol between the SimFramebufferClient shim and the daemon
+ *
+ * The shim (shims/sim_framebuffer_client.c) runs inside backboardd on iOS 13.7+
+ * and talks to the daemon over the same port the daemon registers as
+ * PurpleFBServer. PurpleFB message ids (2/3/4/1011) stay untouched; the SFB
+ * messages use their own id range so both paths can share one port.
+ *
+ * Buffer ownership: the daemon creates two IOSurfaces per device and sends
+ * both to the client on connect. The client renders into the buffer it owns
+ * (the back buffer) and presents it; the daemon takes ownership of that
+ * buffer as the new front and hands the previous front back. No pixels are
+ * copied on present.
+ *
+ * Readers (display injection, fb_to_png) find the current front buffer via
+ * IOSurface values: every surface carries ROSETTASIM_SFB_PEER_KEY (the ID of
+ * the other buffer) and the daemon stamps ROSETTASIM_SFB_FRONT_KEY with an
+ * increasing sequence number on each present. Highest sequence = front.
+ */
+
+#ifndef ROSETTASIM_SFB_H
+#define ROSETTASIM_SFB_H
+
+#include <mach/mach.h>
+#include <stdint.h>
+
+#define ROSETTASIM_SFB_MSG_CONNECT      5001
+#define ROSETTASIM_SFB_MSG_PRESENT      5002
+#define ROSETTASIM_SFB_REPLY_OFFSET     100
+
+#define ROSETTASIM_SFB_BUFFER_COUNT     2
+
+/* IOSurface value keys (CFString literals) */
+#define ROSETTASIM_SFB_PEER_KEY         "RosettaSimPeerSurfaceID"
+#define ROSETTASIM_SFB_FRONT_KEY        "RosettaSimFrontSequence"
+/* Guest UIInterfaceOrientation, stamped on both surfaces when it changes */
+#define ROSETTASIM_SFB_ORIENTATION_KEY  "RosettaSimOrientation"
+
+#pragma pack(4)
+/* Client → daemon: empty body, reply port in msgh_local_port */
+typedef struct {
+    mach_msg_header_t           header;
+    uint32_t                    client_version;
+} RosettaSimSFBConnect;
+
+/* Daemon → client: both swapchain buffers as IOSurface mach ports */
+typedef struct {
+    mach_msg_header_t           header;
+    mach_msg_body_t             body;
+    mach_msg_port_descriptor_t  surfaces[ROSETTASIM_SFB_BUFFER_COUNT];
+    uint32_t                    width;
+    uint32_t                    height;
+    uint32_t                    stride;
+    uint32_t                    pixel_format;
+    uint32_t                    scale_milli;    /* mainScreenScale * 1000 */
+    uint32_t                    back_index;     /* buffer the client owns first */
+} RosettaSimSFBConnectReply;
+
+/* Client → daemon: buffer `index` is complete, dirty rect in pixels */
+typedef struct {
+    mach_msg_header_t           header;
+    uint32_t                    index;
+    uint32_t                    dirty_x;
+    uint32_t                    dirty_y;
+    uint32_t                    dirty_w;
+    uint32_t                    dirty_h;
+} RosettaSimSFBPresent;
+
+/* Daemon → client: buffer the client owns next */
+typedef struct {
+    mach_msg_header_t           header;
+    uint32_t                    back_index;
+    uint32_t                    frame;
+} RosettaSimSFBPresentReply;
+#pragma pack()
+
+#endif /* ROSETTASIM_SFB_H */
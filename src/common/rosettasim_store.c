@@ -0,0 +1,426 @@
+/*
+ * rosettasim_store.c — Content-addressed baseline store (see rosettasim_store.h)
+ */
+
+#include "rosettasim_store.h"
+#include "rosettasim_phash.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ── Digest: 4-lane xxHash64-style accumulation, 256-bit state folded to 128 ── */
+
+#define P1 0x9E3779B185EBCA87ull
+#define P2 0xC2B2AE3D27D4EB4Full
+#define P3 0x165667B19E3779F9ull
+#define P4 0x85EBCA77C2B2AE63ull
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static inline uint64_t lane_round(uint64_t acc, uint64_t in) {
+    acc += in * P2;
+    acc = rotl64(acc, 31);
+    return acc * P1;
+}
+
+static inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 33; h *= P2;
+    h ^= h >> 29; h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+typedef struct {
+    uint64_t acc[4];
+    uint8_t  buf[32];
+    size_t   buffered;
+    uint64_t total;
+} DigestState;
+
+static void digest_stripes(DigestState *st, const uint8_t *p, size_t stripes) {
+    uint64_t a0 = st->acc[0], a1 = st->acc[1], a2 = st->acc[2], a3 = st->acc[3];
+    for (size_t i = 0; i < stripes; i++, p += 32) {
+        uint64_t w[4];
+        memcpy(w, p, sizeof(w));
+        a0 = lane_round(a0, w[0]);
+        a1 = lane_round(a1, w[1]);
+        a2 = lane_round(a2, w[2]);
+        a3 = lane_round(a3, w[3]);
+    }
+    st->acc[0] = a0; st->acc[1] = a1; st->acc[2] = a2; st->acc[3] = a3;
+}
+
+static void digest_update(DigestState *st, const uint8_t *p, size_t n) {
+    st->total += n;
+    if (st->buffered) {
+        size_t take = 32 - st->buffered < n ? 32 - st->buffered : n;
+        memcpy(st->buf + st->buffered, p, take);
+        st->buffered += take;
+        p += take;
+        n -= take;
+        if (st->buffered < 32) return;
+        digest_stripes(st, st->buf, 1);
+        st->buffered = 0;
+    }
+    digest_stripes(st, p, n / 32);
+    p += n & ~(size_t)31;
+    n &= 31;
+    memcpy(st->buf, p, n);
+    st->buffered = n;
+}
+
+void rsim_content_digest(const uint8_t *bgra, int width, int height, size_t bytes_per_row,
+                         RSimDigest *out) {
+    DigestState st = {
+        .acc = { P1 + P2, P2, 0, 0 - P1 },
+    };
+    uint32_t dims[2] = { (uint32_t)width, (uint32_t)height };
+    digest_update(&st, (const uint8_t *)dims, sizeof(dims));
+    size_t row = (size_t)width * 4;
+    if (bytes_per_row == row) {
+        digest_update(&st, bgra, row * (size_t)height);
+    } else {
+        for (int y = 0; y < height; y++)
+            digest_update(&st, bgra + (size_t)y * bytes_per_row, row);
+    }
+
+    uint64_t tail = st.total;
+    for (size_t i = 0; i < st.buffered; i++)
+        tail = rotl64(tail ^ (st.buf[i] * P4), 11) * P1;
+    uint64_t a = rotl64(st.acc[0], 1) + rotl64(st.acc[1], 7) + rotl64(st.acc[2], 12) + rotl64(st.acc[3], 18);
+    uint64_t b = st.acc[0] ^ rotl64(st.acc[1], 29) ^ rotl64(st.acc[2], 41) ^ rotl64(st.acc[3], 53);
+    out->hi = avalanche(a ^ tail);
+    out->lo = avalanche(b + tail * P3 + a);
+}
+
+int rsim_digest_equal(RSimDigest a, RSimDigest b) {
+    return a.hi == b.hi && a.lo == b.lo;
+}
+
+void rsim_digest_format(RSimDigest d, char out[RSIM_DIGEST_HEX_LEN + 1]) {
+    snprintf(out, RSIM_DIGEST_HEX_LEN + 1, "%016llx%016llx",
+             (unsigned long long)d.hi, (unsigned long long)d.lo);
+}
+
+static int parse_hex64(const char *s, uint64_t *out) {
+    uint64_t v = 0;
+    for (int i = 0; i < 16; i++) {
+        char c = s[i];
+        int n = c >= '0' && c <= '9' ? c - '0' :
+                c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (n < 0) return -1;
+        v = v << 4 | (uint64_t)n;
+    }
+    *out = v;
+    return 0;
+}
+
+int rsim_digest_parse(const char *hex, RSimDigest *out) {
+    if (!hex || strlen(hex) < RSIM_DIGEST_HEX_LEN) return -1;
+    if (parse_hex64(hex, &out->hi) != 0 || parse_hex64(hex + 16, &out->lo) != 0) return -1;
+    return 0;
+}
+
+static int digest_cmp(const void *a, const void *b) {
+    const RSimDigest *x = a, *y = b;
+    if (x->hi != y->hi) return x->hi < y->hi ? -1 : 1;
+    if (x->lo != y->lo) return x->lo < y->lo ? -1 : 1;
+    return 0;
+}
+
+/* ── Index ── */
+
+static void sanitize(char *dst, size_t size, const char *src) {
+    size_t n = src ? strnlen(src, size - 1) : 0;
+    memmove(dst, src ? src : "", n);
+    dst[n] = 0;
+    for (char *p = dst; *p; p++)
+        if (*p == '\t' || *p == '\n' || *p == '\r') *p = '_';
+}
+
+static int format_ref(const RSimStoreRef *r, char *line, size_t size) {
+    char hex[RSIM_DIGEST_HEX_LEN + 1];
+    rsim_digest_format(r->digest, hex);
+    return snprintf(line, size, "%.3f\t%s\t%016llx\t%u\t%u\t%s\t%s\n", r->time, hex,
+                    (unsigned long long)r->phash, r->width, r->height, r->device, r->name);
+}
+
+static int parse_ref(char *line, RSimStoreRef *r) {
+    char *field[7];
+    int n = 0;
+    for (char *p = line; n < 7; ) {
+        field[n++] = p;
+        char *tab = strchr(p, n < 7 ? '\t' : '\n');
+        if (!tab) break;
+        *tab = 0;
+        p = tab + 1;
+    }
+    if (n < 7) return -1;
+    char *nl = strchr(field[6], '\n');
+    if (nl) *nl = 0;
+    memset(r, 0, sizeof(*r));
+    r->time = strtod(field[0], NULL);
+    if (rsim_digest_parse(field[1], &r->digest) != 0) return -1;
+    if (strlen(field[2]) < 16 || parse_hex64(field[2], &r->phash) != 0) return -1;
+    r->width = (uint32_t)strtoul(field[3], NULL, 10);
+    r->height = (uint32_t)strtoul(field[4], NULL, 10);
+    sanitize(r->device, sizeof(r->device), field[5]);
+    sanitize(r->name, sizeof(r->name), field[6]);
+    return 0;
+}
+
+static int push_ref(RSimStore *s, const RSimStoreRef *r) {
+    if (s->count == s->capacity) {
+        size_t cap = s->capacity ? s->capacity * 2 : 256;
+        RSimStoreRef *grown = realloc(s->refs, cap * sizeof(*grown));
+        if (!grown) return -1;
+        s->refs = grown;
+        s->capacity = cap;
+    }
+    s->refs[s->count++] = *r;
+    return 0;
+}
+
+static int load_index(RSimStore *s) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/index.tsv", s->root);
+    s->count = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return errno == ENOENT ? 0 : -1;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        RSimStoreRef r;
+        if (parse_ref(line, &r) == 0 && push_ref(s, &r) != 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* ── Store ── */
+
+int rsim_store_open(RSimStore *s, const char *root) {
+    memset(s, 0, sizeof(*s));
+    if (strlen(root) >= sizeof(s->root) - 64) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(s->root, root);
+
+    /* mkdir -p root/objects */
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/objects", root);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    return load_index(s);
+}
+
+void rsim_store_close(RSimStore *s) {
+    free(s->refs);
+    memset(s, 0, sizeof(*s));
+}
+
+int rsim_store_object_path(const RSimStore *s, RSimDigest d, const char *ext,
+                           char *out, size_t size) {
+    char hex[RSIM_DIGEST_HEX_LEN + 1];
+    rsim_digest_format(d, hex);
+    snprintf(out, size, "%s/objects/%.2s", s->root, hex);
+    if (mkdir(out, 0755) != 0 && errno != EEXIST) return -1;
+    snprintf(out, size, "%s/objects/%.2s/%s%s", s->root, hex, hex, ext ? ext : "");
+    return 0;
+}
+
+int rsim_store_lock(const RSimStore *s, int exclusive) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s/.lock", s->root);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    if (flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void rsim_store_unlock(int fd) {
+    if (fd < 0) return;
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+int rsim_store_add_ref(RSimStore *s, const RSimStoreRef *ref) {
+    RSimStoreRef r = *ref;
+    sanitize(r.device, sizeof(r.device), ref->device);
+    sanitize(r.name, sizeof(r.name), ref->name);
+
+    char path[1100], line[512];
+    snprintf(path, sizeof(path), "%s/index.tsv", s->root);
+    int len = format_ref(&r, line, sizeof(line));
+    if (len <= 0 || len >= (int)sizeof(line)) return -1;
+    /* One short O_APPEND write: concurrent savers never interleave lines */
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, line, (size_t)len);
+    close(fd);
+    if (n != len) return -1;
+    return push_ref(s, &r);
+}
+
+int rsim_store_closest(const RSimStore *s, uint64_t phash, const char *name,
+                       RSimStoreRef *out, int *distances, int max) {
+    int found = 0;
+    /* Newest first, so the first ref seen for a digest is the one reported */
+    for (size_t i = s->count; i-- > 0 && max > 0; ) {
+        const RSimStoreRef *r = &s->refs[i];
+        if (name && strcmp(r->name, name) != 0) continue;
+        int d = rsim_hash_distance(r->phash, phash);
+        int dup = 0;
+        for (int k = 0; k < found && !dup; k++)
+            dup = rsim_digest_equal(out[k].digest, r->digest);
+        if (dup) continue;
+        if (found == max && d >= distances[found - 1]) continue;
+
+        /* Insertion into the sorted top-max list */
+        int at = found < max ? found++ : max - 1;
+        while (at > 0 && distances[at - 1] > d) {
+            out[at] = out[at - 1];
+            distances[at] = distances[at - 1];
+            at--;
+        }
+        out[at] = *r;
+        distances[at] = d;
+    }
+    return found;
+}
+
+size_t rsim_store_distinct(const RSimStore *s) {
+    if (!s->count) return 0;
+    RSimDigest *d = malloc(s->count * sizeof(*d));
+    if (!d) return 0;
+    for (size_t i = 0; i < s->count; i++) d[i] = s->refs[i].digest;
+    qsort(d, s->count, sizeof(*d), digest_cmp);
+    size_t n = 1;
+    for (size_t i = 1; i < s->count; i++) n += digest_cmp(&d[i - 1], &d[i]) != 0;
+    free(d);
+    return n;
+}
+
+int rsim_store_gc(RSimStore *s, double cutoff, RSimStoreGCStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    int lock = rsim_store_lock(s, 1);
+    if (lock < 0) return -1;
+    /* Savers may have appended since open */
+    if (load_index(s) != 0) {
+        rsim_store_unlock(lock);
+        return -1;
+    }
+
+    /* Keep recent refs and the newest ref of every name */
+    char *keep = calloc(s->count ? s->count : 1, 1);
+    RSimDigest *live = malloc((s->count ? s->count : 1) * sizeof(*live));
+    if (!keep || !live) {
+        free(keep);
+        free(live);
+        rsim_store_unlock(lock);
+        return -1;
+    }
+    /* Index order is append order: walking backwards, the first ref of a name
+     * is its newest. Names are tracked by 64-bit FNV-1a in an open-addressed set. */
+    size_t slots = 64;
+    while (slots < s->count * 2) slots <<= 1;
+    uint64_t *seen = calloc(slots, sizeof(*seen));
+    if (!seen) {
+        free(keep);
+        free(live);
+        rsim_store_unlock(lock);
+        return -1;
+    }
+    for (size_t i = s->count; i-- > 0; ) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (const char *p = s->refs[i].name; *p; p++) h = (h ^ (uint8_t)*p) * 0x100000001b3ull;
+        h |= 1;     /* 0 marks an empty slot */
+        size_t at = h & (slots - 1);
+        while (seen[at] && seen[at] != h) at = (at + 1) & (slots - 1);
+        int newest = !seen[at];
+        seen[at] = h;
+        keep[i] = newest || s->refs[i].time >= cutoff;
+    }
+    free(seen);
+
+    char path[1100], tmp[1100];
+    snprintf(path, sizeof(path), "%s/index.tsv", s->root);
+    snprintf(tmp, sizeof(tmp), "%s/index.tsv.tmp", s->root);
+    FILE *f = fopen(tmp, "w");
+    int ok = f != NULL;
+    size_t n_live = 0, kept = 0;
+    for (size_t i = 0; ok && i < s->count; i++) {
+        if (!keep[i]) { stats->refs_dropped++; continue; }
+        char line[512];
+        format_ref(&s->refs[i], line, sizeof(line));
+        ok = fputs(line, f) >= 0;
+        live[n_live++] = s->refs[i].digest;
+        s->refs[kept++] = s->refs[i];
+    }
+    if (f && fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        free(keep);
+        free(live);
+        load_index(s);
+        rsim_store_unlock(lock);
+        return -1;
+    }
+    s->count = kept;
+    stats->refs_kept = kept;
+    qsort(live, n_live, sizeof(*live), digest_cmp);
+
+    /* Sweep objects/<xx>/ for digests nothing references any more */
+    snprintf(path, sizeof(path), "%s/objects", s->root);
+    DIR *top = opendir(path);
+    struct dirent *de;
+    while (top && (de = readdir(top))) {
+        if (de->d_name[0] == '.' || strlen(de->d_name) != 2) continue;
+        char sub[1100];
+        snprintf(sub, sizeof(sub), "%s/objects/%.2s", s->root, de->d_name);
+        DIR *dir = opendir(sub);
+        struct dirent *fe;
+        while (dir && (fe = readdir(dir))) {
+            if (fe->d_name[0] == '.') continue;
+            char file[1400];
+            snprintf(file, sizeof(file), "%s/%s", sub, fe->d_name);
+            RSimDigest d;
+            /* Unparseable names are leftovers of interrupted writes (.tmp) */
+            int referenced = rsim_digest_parse(fe->d_name, &d) == 0 && !strstr(fe->d_name, ".tmp") &&
+                bsearch(&d, live, n_live, sizeof(*live), digest_cmp) != NULL;
+            if (referenced) { stats->objects_kept++; continue; }
+            struct stat st;
+            if (stat(file, &st) == 0 && unlink(file) == 0) {
+                stats->objects_deleted++;
+                stats->bytes_freed += (uint64_t)st.st_size;
+            }
+        }
+        if (dir) closedir(dir);
+        rmdir(sub);     /* only succeeds once empty */
+    }
+    if (top) closedir(top);
+
+    free(keep);
+    free(live);
+    rsim_store_unlock(lock);
+    return 0;
+}
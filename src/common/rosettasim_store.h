@@ -0,0 +1,93 @@
+/*
+ * rosettasim_store.h — Content-addressed screenshot baseline store (portable C)
+ *
+ * Frames are keyed by a 128-bit digest of their pixels (dims + visible rows,
+ * stride padding excluded), not of the encoded file, so the same screen
+ * captured twice is stored once no matter how it was encoded. Every capture
+ * adds a reference (time, device, name, digest, dHash) to an append-only
+ * index; "closest baseline" is a Hamming-distance scan over the dHashes.
+ *
+ * Layout under the store root:
+ *   index.tsv                      one reference per line
+ *   objects/<2 hex>/<32 hex>.png   one encoded frame per digest
+ *   .lock                          flock: shared for appends, exclusive for gc
+ *
+ * The caller encodes objects (rosettasim-ctl uses ImageIO); this file only
+ * does hashing, bookkeeping and garbage collection.
+ */
+
+#ifndef ROSETTASIM_STORE_H
+#define ROSETTASIM_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RSIM_DIGEST_HEX_LEN     32
+
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} RSimDigest;
+
+typedef struct {
+    double      time;           /* seconds since 1970 */
+    RSimDigest  digest;
+    uint64_t    phash;          /* rsim_dhash_bgra() of the frame */
+    uint32_t    width;
+    uint32_t    height;
+    char        device[64];
+    char        name[128];      /* test / baseline name; tabs and newlines become '_' */
+} RSimStoreRef;
+
+typedef struct {
+    char            root[1024];
+    RSimStoreRef   *refs;
+    size_t          count;
+    size_t          capacity;
+} RSimStore;
+
+typedef struct {
+    size_t      refs_dropped;
+    size_t      refs_kept;
+    size_t      objects_deleted;
+    size_t      objects_kept;
+    uint64_t    bytes_freed;
+} RSimStoreGCStats;
+
+/* Digest of the visible pixels; identical frames digest identically
+ * regardless of bytes_per_row. */
+void rsim_content_digest(const uint8_t *bgra, int width, int height, size_t bytes_per_row,
+                         RSimDigest *out);
+int  rsim_digest_equal(RSimDigest a, RSimDigest b);
+void rsim_digest_format(RSimDigest d, char out[RSIM_DIGEST_HEX_LEN + 1]);
+int  rsim_digest_parse(const char *hex, RSimDigest *out);
+
+/* Create the layout if needed and load the index. Returns 0, or -1 (errno). */
+int  rsim_store_open(RSimStore *store, const char *root);
+void rsim_store_close(RSimStore *store);
+
+/* root/objects/<xx>/<digest><ext>; creates the fan-out directory */
+int  rsim_store_object_path(const RSimStore *store, RSimDigest d, const char *ext,
+                            char *out, size_t size);
+
+/* flock on root/.lock: hold shared while writing an object and its reference
+ * so a concurrent gc can't sweep it. Returns an fd for rsim_store_unlock. */
+int  rsim_store_lock(const RSimStore *store, int exclusive);
+void rsim_store_unlock(int fd);
+
+/* Append a reference to the index (one O_APPEND write) and to store->refs */
+int  rsim_store_add_ref(RSimStore *store, const RSimStoreRef *ref);
+
+/* Up to max distinct digests closest to phash, nearest first (newest ref of
+ * each digest). name filters by exact name when non-NULL. Returns the count. */
+int  rsim_store_closest(const RSimStore *store, uint64_t phash, const char *name,
+                        RSimStoreRef *out, int *distances, int max);
+
+/* Number of distinct digests referenced by the index */
+size_t rsim_store_distinct(const RSimStore *store);
+
+/* Drop references older than cutoff (seconds since 1970), except the newest
+ * reference of each name, rewrite the index and delete unreferenced objects. */
+int  rsim_store_gc(RSimStore *store, double cutoff, RSimStoreGCStats *stats);
+
+#endif /* ROSETTASIM_STORE_H */
@@ -0,0 +1,160 @@
+/*
+ * rosettasim_tcc.c — Batched TCC.db privacy edits (see rosettasim_tcc.h)
+ */
+
+#include "rosettasim_tcc.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const struct {
+    const char *name;
+    const char *key;
+} kServices[] = {
+    { "photos",             "kTCCServicePhotos" },
+    { "camera",             "kTCCServiceCamera" },
+    { "microphone",         "kTCCServiceMicrophone" },
+    { "contacts",           "kTCCServiceAddressBook" },
+    { "calendar",           "kTCCServiceCalendar" },
+    { "reminders",          "kTCCServiceReminders" },
+    { "location",           "kTCCServiceLocation" },
+    { "media-library",      "kTCCServiceMediaLibrary" },
+    { "motion",             "kTCCServiceMotion" },
+    { "siri",               "kTCCServiceSiri" },
+    { "speech-recognition", "kTCCServiceSpeechRecognition" },
+};
+#define SERVICE_COUNT (sizeof(kServices) / sizeof(kServices[0]))
+
+const char *const rsim_tcc_service_names[] = {
+    "photos", "camera", "microphone", "contacts", "calendar", "reminders",
+    "location", "media-library", "motion", "siri", "speech-recognition", NULL,
+};
+
+const char *rsim_tcc_service_key(const char *name) {
+    if (strcmp(name, "all") == 0) return "";
+    for (size_t i = 0; i < SERVICE_COUNT; i++)
+        if (strcmp(kServices[i].name, name) == 0) return kServices[i].key;
+    return NULL;
+}
+
+static const char kSchema[] =
+    "CREATE TABLE IF NOT EXISTS access ("
+    "service TEXT NOT NULL, client TEXT NOT NULL, client_type INTEGER NOT NULL DEFAULT 0, "
+    "allowed INTEGER NOT NULL DEFAULT 1, prompt_count INTEGER NOT NULL DEFAULT 0, "
+    "PRIMARY KEY (service, client, client_type))";
+
+/* ?1 service, ?2 client; a NULL binding matches every row */
+static const char *const kStatements[] = {
+    [RSIM_TCC_GRANT] =  "INSERT OR REPLACE INTO access (service, client, client_type, allowed, prompt_count) "
+                        "VALUES (?1, ?2, 0, 1, 0)",
+    [RSIM_TCC_REVOKE] = "UPDATE access SET allowed = 0 WHERE client = ?2 AND (?1 IS NULL OR service = ?1)",
+    [RSIM_TCC_RESET] =  "DELETE FROM access WHERE (?2 IS NULL OR client = ?2) AND (?1 IS NULL OR service = ?1)",
+};
+
+/* Rows that keep a change from being a no-op; same bindings as kStatements */
+static const char *const kPendingQueries[] = {
+    [RSIM_TCC_GRANT] =  "SELECT count(*) = 0 FROM access WHERE service = ?1 AND client = ?2 AND allowed = 1",
+    [RSIM_TCC_REVOKE] = "SELECT count(*) > 0 FROM access WHERE client = ?2 AND (?1 IS NULL OR service = ?1) "
+                        "AND allowed <> 0",
+    [RSIM_TCC_RESET] =  "SELECT count(*) > 0 FROM access WHERE (?2 IS NULL OR client = ?2) AND (?1 IS NULL OR service = ?1)",
+};
+
+static int step(sqlite3 *db, sqlite3_stmt *stmt, const char *service, const char *client) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, service, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, client, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE) return -1;
+    return sqlite3_changes(db);
+}
+
+int rsim_tcc_apply(const char *db_path, const RSimTccChange *changes, size_t count,
+                   char *err, size_t err_size) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmts[3] = { NULL, NULL, NULL };
+    const char *invalid = NULL;
+    int total = 0, in_txn = 0, ok = 0;
+
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+        goto done;
+    sqlite3_busy_timeout(db, 5000);     /* tccd may hold it briefly on a booted device */
+    if (sqlite3_exec(db, kSchema, NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK)
+        goto done;
+    in_txn = 1;
+
+    for (size_t i = 0; i < count; i++) {
+        const RSimTccChange *c = &changes[i];
+        if ((unsigned)c->op > RSIM_TCC_RESET || (!c->client && c->op != RSIM_TCC_RESET)) {
+            invalid = "grant and revoke need a bundle ID";
+            goto done;
+        }
+        if (!stmts[c->op] && sqlite3_prepare_v2(db, kStatements[c->op], -1, &stmts[c->op], NULL) != SQLITE_OK)
+            goto done;
+        const char *service = c->service && c->service[0] ? c->service : NULL;
+        for (size_t s = 0; s < SERVICE_COUNT; s++) {
+            /* A grant of every service is one row each; revoke/reset match with NULL */
+            int all = c->op == RSIM_TCC_GRANT && !service;
+            int n = step(db, stmts[c->op], all ? kServices[s].key : service, c->client);
+            if (n < 0) goto done;
+            total += n;
+            if (!all) break;
+        }
+    }
+    ok = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+
+done:
+    if (!ok) {
+        snprintf(err, err_size, "%s", invalid ? invalid : db ? sqlite3_errmsg(db) : "out of memory");
+        if (in_txn) sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    }
+    for (int i = 0; i < 3; i++) sqlite3_finalize(stmts[i]);
+    sqlite3_close(db);
+    return ok ? total : -1;
+}
+
+static int query_pending(sqlite3_stmt *stmt, const char *service, const char *client) {
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, service, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, client, -1, SQLITE_STATIC);
+    return sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+}
+
+int rsim_tcc_pending(const char *db_path, const RSimTccChange *changes, size_t count, int *pending) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmts[3] = { NULL, NULL, NULL };
+    int ret = 0, have_db = 0;
+
+    /* Empty-database answers until a readable access table says otherwise */
+    for (size_t i = 0; i < count; i++) pending[i] = changes[i].op == RSIM_TCC_GRANT;
+    if (access(db_path, F_OK) != 0) return 0;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        sqlite3_close(db);
+        return -1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    for (int op = 0; op < 3; op++)
+        if (sqlite3_prepare_v2(db, kPendingQueries[op], -1, &stmts[op], NULL) == SQLITE_OK) have_db = 1;
+
+    for (size_t i = 0; i < count && have_db; i++) {
+        const RSimTccChange *c = &changes[i];
+        if ((unsigned)c->op > RSIM_TCC_RESET || !stmts[c->op]) continue;
+        const char *service = c->service && c->service[0] ? c->service : NULL;
+        int any = 0;
+        for (size_t s = 0; s < SERVICE_COUNT && !any; s++) {
+            int all = c->op == RSIM_TCC_GRANT && !service;
+            int n = query_pending(stmts[c->op], all ? kServices[s].key : service, c->client);
+            if (n < 0) {
+                ret = -1;
+                break;
+            }
+            any = n;
+            if (!all) break;
+        }
+        pending[i] = any;
+    }
+    for (int i = 0; i < 3; i++) sqlite3_finalize(stmts[i]);
+    sqlite3_close(db);
+    return ret;
+}
@@ -0,0 +1,48 @@
+/*
+ * rosettasim_tcc.h — Batched TCC.db privacy edits for legacy runtimes (portable C)
+ *
+ * Legacy simulators keep privacy decisions in {device data}/Library/TCC/TCC.db
+ * (table `access`). A batch of grants, revokes and resets is applied with
+ * libsqlite3 in one BEGIN IMMEDIATE transaction: the database is opened once,
+ * each statement is prepared once and re-bound per row, and either every
+ * change lands or none does. Used by `rosettasim-ctl privacy` for single
+ * edits and manifests alike.
+ */
+
+#ifndef ROSETTASIM_TCC_H
+#define ROSETTASIM_TCC_H
+
+#include <stddef.h>
+
+typedef enum {
+    RSIM_TCC_GRANT,             /* insert or replace, allowed = 1 */
+    RSIM_TCC_REVOKE,            /* allowed = 0 on existing rows */
+    RSIM_TCC_RESET,             /* delete rows */
+} RSimTccOp;
+
+typedef struct {
+    RSimTccOp   op;
+    const char *service;        /* kTCCService* key; NULL = every known service */
+    const char *client;         /* bundle ID; NULL = every client (reset only) */
+} RSimTccChange;
+
+/* The TCC service key for a simctl-style name ("photos", "camera", ...), ""
+ * for "all", or NULL if unknown. */
+const char *rsim_tcc_service_key(const char *name);
+
+/* NULL-terminated list of the simctl-style names, "all" excluded */
+extern const char *const rsim_tcc_service_names[];
+
+/* Apply changes to db_path (created with the access table if missing) in one
+ * transaction. Returns the number of rows changed, or -1 with a message in
+ * err (nothing is applied). */
+int rsim_tcc_apply(const char *db_path, const RSimTccChange *changes, size_t count,
+                   char *err, size_t err_size);
+
+/* Whether each change would modify db_path: pending[i] = 1, or 0 if it is
+ * already in effect (grant: allowed rows exist; revoke/reset: nothing left
+ * to change). A missing database or table counts as empty. Returns 0, or
+ * -1 if the database can't be read. */
+int rsim_tcc_pending(const char *db_path, const RSimTccChange *changes, size_t count, int *pending);
+
+#endif /* ROSETTASIM_TCC_H */
@@ -5,9 +5,20 @@
  * boots, automatically registers PurpleFBServer with the correct dimensions.
  * Handles multiple devices simultaneously.
  *
+ * iOS 13.7+ runtimes patched with shims/sim_framebuffer_client.c connect over the
+ * same port with SFB messages instead: surfaces A/B become a swapchain and each
+ * present swaps ownership without the A→B memcpy of the PurpleFB flush path.
+ *
  * Usage:
  *   rosettasim_daemon              # run in foreground
  *   rosettasim_daemon --list       # list legacy devices and exit
+ *   rosettasim_daemon --eager      # create every device's surfaces at registration
+ *
+ * At startup every shut-down legacy device is prepared in parallel (port,
+ * and surfaces with --eager) and then registered serially; by default the
+ * surfaces of a device are only created when it boots. The "Ready:" log line
+ * reports the time to ready and its phases; scripts/bench_ready.sh collects
+ * it for 1, 10 and 50 devices.
  *
  * Handles SIGTERM/SIGINT gracefully (cleans up ports, files, IOSurfaces).
  * Logs a warning if any active device hasn't flushed in 60s.
@@ -36,8 +47,16 @@
 #import <IOSurface/IOSurface.h>
 #import <CoreGraphics/CoreGraphics.h>
 #import <dlfcn.h>
+#include <time.h>
+
+#include "common/rosettasim_sfb.h"
+#include "common/rosettasim_phash.h"
+#include "common/rosettasim_fbfile.h"
+#include "common/rosettasim_paths.h"
+#include <sys/stat.h>
 
 #define PFB_PAGE_SIZE 4096
+#define PHASH_HISTORY 16    /* distinct screens remembered per device */
 
 extern kern_return_t mach_make_memory_entry_64(
     vm_map_t, memory_object_size_t *, memory_object_offset_t,
@@ -76,6 +95,18 @@ typedef struct DeviceContext {
     IOSurfaceRef    iosurface;       /* surface A: mapped to backboardd via memory_entry */
     IOSurfaceRef    iosurface_read;  /* surface B: stable copy for injection to read */
     uint32_t        surface_id;      /* ID of surface B (the read surface) */
+    int             sfb_active;      /* SimFramebufferClient connected: A/B are a swapchain */
+    uint32_t        sfb_front;       /* swapchain index owned by the daemon (0=A, 1=B) */
+    uint32_t        sfb_sequence;    /* stamped on the front surface for readers */
+    uint64_t        frame_cpu_ns[2]; /* handler thread CPU per path: [0]=PurpleFB, [1]=SFB */
+    int             frame_cpu_count[2];
+    struct {
+        uint64_t    hash;            /* dHash of the frame (common/rosettasim_phash.h) */
+        int         frame;           /* flush_count when this screen first appeared */
+        double      time;            /* wall clock, seconds since 1970 */
+    }               phash_history[PHASH_HISTORY]; /* ring of distinct screens */
+    int             phash_head;      /* index of the latest entry */
+    int             phash_count;
     void           *surface_base;
     mach_port_t     mem_entry;
     mach_port_t     service_port;
@@ -85,6 +116,9 @@ typedef struct DeviceContext {
     time_t          last_flush_time;
     long            last_state;     /* for state change deduplication */
     char            runtime_root[512]; /* RuntimeRoot path for scale fix detection */
+    int             orientation;    /* guest UIInterfaceOrientation from SpringBoard, 0 = unknown */
+    struct timespec orientation_mtime; /* of the hint file when last read */
+    RSimFBWriter    fb_out;         /* /tmp/rosettasim_fb_<UDID>.fb */
 } DeviceContext;
 
 static DeviceContext *g_devices = NULL;
@@ -92,6 +126,10 @@ static int g_device_count = 0;
 static int g_device_capacity = 0;
 static dispatch_queue_t g_msg_queue;
 
+/* /tmp/sim_framebuffer.raw: shared by all devices, the last to present wins */
+static RSimFBWriter g_raw_out;
+static char g_raw_owner[64];
+
 /* ================================================================
  * Device context management
  * ================================================================ */
@@ -126,17 +164,50 @@ static DeviceContext *alloc_context(const char *udid, const char *name) {
  * File I/O helpers
  * ================================================================ */
 
-static void write_framebuffer(DeviceContext *ctx) {
-    if (!ctx->surface_base) return;
-    char path[256], tmp_path[256];
-    snprintf(path, sizeof(path), "/tmp/rosettasim_fb_%s.raw", ctx->udid);
-    snprintf(tmp_path, sizeof(tmp_path), "/tmp/rosettasim_fb_%s.raw.tmp", ctx->udid);
-    FILE *f = fopen(tmp_path, "wb");
-    if (f) {
-        fwrite(ctx->surface_base, 1, ctx->surface_size, f);
-        fclose(f);
-        rename(tmp_path, path);
+/* Per-device frame file: self-describing v2 layout (common/rosettasim_fbfile.h),
+ * and the headerless shared raw file. dirty is the changed region in pixels
+ * (w == 0: the whole frame); only that region is copied into either file. */
+static void write_framebuffer(DeviceContext *ctx, const void *base,
+                              uint32_t dx, uint32_t dy, uint32_t dw, uint32_t dh) {
+    if (!base) return;
+    if (!ctx->fb_out.path[0]) {
+        char path[256];
+        snprintf(path, sizeof(path), "/tmp/rosettasim_fb_%s.fb", ctx->udid);
+        rsim_fb_writer_init(&ctx->fb_out, path, 0);
+    }
+
+    if (!dw || !dh || dx >= ctx->pixel_width || dy >= ctx->pixel_height) {
+        dx = dy = 0;
+        dw = ctx->pixel_width;
+        dh = ctx->pixel_height;
+    }
+    if (dw > ctx->pixel_width - dx) dw = ctx->pixel_width - dx;
+    if (dh > ctx->pixel_height - dy) dh = ctx->pixel_height - dy;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    RSimFBHeader h = {
+        .pixel_format = RSIM_FB_FORMAT_BGRA,
+        .width = ctx->pixel_width,
+        .height = ctx->pixel_height,
+        .bytes_per_row = ctx->bytes_per_row,
+        .scale_milli = (uint32_t)(ctx->scale * 1000.0f),
+        .sequence = ctx->sfb_sequence,
+        .timestamp_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec,
+        .dirty_x = dx, .dirty_y = dy, .dirty_w = dw, .dirty_h = dh,
+        .orientation = (uint32_t)ctx->orientation,
+    };
+    int err = rsim_fb_writer_publish(&ctx->fb_out, &h, base, ctx->bytes_per_row);
+    if (err != RSIM_FB_OK && ctx->flush_count <= 10)
+        NSLog(@"[daemon] %s: writing %s failed: %s", ctx->name, ctx->fb_out.path, rsim_fb_strerror(err));
+
+    /* Also write to legacy shared path for backward compat */
+    if (!g_raw_out.path[0]) rsim_fb_writer_init(&g_raw_out, "/tmp/sim_framebuffer.raw", 1);
+    if (strcmp(g_raw_owner, ctx->udid) != 0) {
+        rsim_fb_writer_reset(&g_raw_out);     /* holds another device's pixels */
+        strlcpy(g_raw_owner, ctx->udid, sizeof(g_raw_owner));
     }
+    rsim_fb_writer_publish(&g_raw_out, &h, base, ctx->bytes_per_row);
 }
 
 static void write_device_metadata(DeviceContext *ctx) {
@@ -169,14 +240,15 @@ static void write_active_devices(void) {
         if (!g_devices[i].active) continue;
         if (!first) fprintf(f, ",\n");
         fprintf(f, "  {\"udid\":\"%s\",\"name\":\"%s\",\"width\":%u,\"height\":%u,\"scale\":%.1f,"
-                "\"surface_id\":%u,"
-                "\"fb\":\"/tmp/rosettasim_fb_%s.raw\","
-                "\"dims\":\"/tmp/rosettasim_dims_%s.json\"}",
+                "\"surface_id\":%u,\"orientation\":%d,"
+                "\"fb\":\"/tmp/rosettasim_fb_%s.fb\","
+                "\"dims\":\"/tmp/rosettasim_dims_%s.json\","
+                "\"phash\":\"/tmp/rosettasim_phash_%s.json\"}",
                 g_devices[i].udid, g_devices[i].name,
                 g_devices[i].pixel_width, g_devices[i].pixel_height,
                 g_devices[i].scale,
-                g_devices[i].surface_id,
-                g_devices[i].udid, g_devices[i].udid);
+                g_devices[i].surface_id, g_devices[i].orientation,
+                g_devices[i].udid, g_devices[i].udid, g_devices[i].udid);
         first = 0;
     }
     fprintf(f, "\n]\n");
@@ -185,11 +257,12 @@ static void write_active_devices(void) {
 
 static void cleanup_device_files(DeviceContext *ctx) {
     char path[256];
-    snprintf(path, sizeof(path), "/tmp/rosettasim_fb_%s.raw", ctx->udid);
+    rsim_fb_writer_close(&ctx->fb_out, 1);
+    snprintf(path, sizeof(path), "/tmp/rosettasim_dims_%s.json", ctx->udid);
     unlink(path);
-    snprintf(path, sizeof(path), "/tmp/rosettasim_fb_%s.raw.tmp", ctx->udid);
+    snprintf(path, sizeof(path), "/tmp/rosettasim_phash_%s.json", ctx->udid);
     unlink(path);
-    snprintf(path, sizeof(path), "/tmp/rosettasim_dims_%s.json", ctx->udid);
+    snprintf(path, sizeof(path), ROSETTASIM_HOST_ORIENTATION_FMT, ctx->udid);
     unlink(path);
 }
 
@@ -197,9 +270,208 @@ static void cleanup_device_files(DeviceContext *ctx) {
  * PurpleFB message handler (per-device)
  * ================================================================ */
 
+/* ================================================================
+ * Frame publishing (shared by PurpleFB flush and SFB present)
+ * ================================================================ */
+
+static uint64_t thread_cpu_ns(void) {
+    return clock_gettime_nsec_np(CLOCK_THREAD_CPUTIME_ID);
+}
+
+/* path: 0 = PurpleFB flush (memcpy A→B), 1 = SFB present (ownership swap) */
+static void account_frame_cpu(DeviceContext *ctx, int path, uint64_t cpu0) {
+    ctx->frame_cpu_ns[path] += thread_cpu_ns() - cpu0;
+    ctx->frame_cpu_count[path]++;
+    if (ctx->frame_cpu_count[path] == 10 || ctx->frame_cpu_count[path] % 500 == 0) {
+        double pfb = ctx->frame_cpu_count[0] ?
+            (double)ctx->frame_cpu_ns[0] / ctx->frame_cpu_count[0] / 1e6 : 0;
+        double sfb = ctx->frame_cpu_count[1] ?
+            (double)ctx->frame_cpu_ns[1] / ctx->frame_cpu_count[1] / 1e6 : 0;
+        NSLog(@"[daemon] %s: frame CPU avg purplefb=%.3fms (%d frames) sfb=%.3fms (%d frames)",
+              ctx->name, pfb, ctx->frame_cpu_count[0], sfb, ctx->frame_cpu_count[1]);
+    }
+}
+
+/* Latest hash + recent distinct screens, newest first. Only rewritten when
+ * the screen changes, so identical frames cost one hash and a compare. */
+static void write_phash_history(DeviceContext *ctx) {
+    char path[256], tmp_path[256], hex[RSIM_HASH_HEX_LEN + 1];
+    snprintf(path, sizeof(path), "/tmp/rosettasim_phash_%s.json", ctx->udid);
+    snprintf(tmp_path, sizeof(tmp_path), "/tmp/rosettasim_phash_%s.json.tmp", ctx->udid);
+    FILE *f = fopen(tmp_path, "w");
+    if (!f) return;
+    rsim_hash_format(ctx->phash_history[ctx->phash_head].hash, hex);
+    fprintf(f, "{\"udid\":\"%s\",\"hash\":\"%s\",\"frame\":%d,\"history\":[",
+            ctx->udid, hex, ctx->flush_count);
+    for (int i = 0; i < ctx->phash_count; i++) {
+        int idx = (ctx->phash_head - i + PHASH_HISTORY) % PHASH_HISTORY;
+        rsim_hash_format(ctx->phash_history[idx].hash, hex);
+        fprintf(f, "%s\n  {\"hash\":\"%s\",\"frame\":%d,\"time\":%.3f}", i ? "," : "",
+                hex, ctx->phash_history[idx].frame, ctx->phash_history[idx].time);
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    rename(tmp_path, path);
+}
+
+static void record_frame_hash(DeviceContext *ctx, const void *base) {
+    uint64_t hash = rsim_dhash_bgra(base, (int)ctx->pixel_width, (int)ctx->pixel_height,
+                                    ctx->bytes_per_row);
+    if (ctx->phash_count && ctx->phash_history[ctx->phash_head].hash == hash) return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ctx->phash_head = ctx->phash_count ? (ctx->phash_head + 1) % PHASH_HISTORY : 0;
+    if (ctx->phash_count < PHASH_HISTORY) ctx->phash_count++;
+    ctx->phash_history[ctx->phash_head].hash = hash;
+    ctx->phash_history[ctx->phash_head].frame = ctx->flush_count;
+    ctx->phash_history[ctx->phash_head].time = ts.tv_sec + ts.tv_nsec / 1e9;
+    write_phash_history(ctx);
+}
+
+/* SpringBoard (sim_app_installer) writes the interface orientation to
+ * ROSETTASIM_HOST_ORIENTATION_FMT when it changes. One stat per frame; on a
+ * change the value is stamped on both surfaces for IOSurface readers and
+ * carried in every frame file header, so captures can rotate upright. */
+static void update_orientation(DeviceContext *ctx) {
+    char path[256];
+    snprintf(path, sizeof(path), ROSETTASIM_HOST_ORIENTATION_FMT, ctx->udid);
+    struct stat st;
+    if (stat(path, &st) != 0) return;
+    if (st.st_mtimespec.tv_sec == ctx->orientation_mtime.tv_sec &&
+        st.st_mtimespec.tv_nsec == ctx->orientation_mtime.tv_nsec) return;
+    ctx->orientation_mtime = st.st_mtimespec;
+
+    int orientation = 0;
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    if (fscanf(f, "%d", &orientation) != 1) orientation = 0;
+    fclose(f);
+    if (orientation < 0 || orientation > 4 || orientation == ctx->orientation) return;
+
+    NSLog(@"[daemon] %s: interface orientation %d → %d", ctx->name, ctx->orientation, orientation);
+    ctx->orientation = orientation;
+    CFNumberRef n = CFNumberCreate(NULL, kCFNumberIntType, &orientation);
+    if (ctx->iosurface) IOSurfaceSetValue(ctx->iosurface, CFSTR(ROSETTASIM_SFB_ORIENTATION_KEY), n);
+    if (ctx->iosurface_read) IOSurfaceSetValue(ctx->iosurface_read, CFSTR(ROSETTASIM_SFB_ORIENTATION_KEY), n);
+    CFRelease(n);
+    dispatch_async(dispatch_get_main_queue(), ^{ write_active_devices(); });
+}
+
+static void publish_frame(DeviceContext *ctx, const void *base,
+                          uint32_t dx, uint32_t dy, uint32_t dw, uint32_t dh) {
+    update_orientation(ctx);
+    write_framebuffer(ctx, base, dx, dy, dw, dh);
+    if (base) record_frame_hash(ctx, base);
+
+    /* Periodic pixel stats: every flush <=10, every 10th <=50, every 200th after */
+    if (base && (ctx->flush_count <= 10 || (ctx->flush_count <= 50 && ctx->flush_count % 10 == 0) || ctx->flush_count % 200 == 0)) {
+        const uint32_t *px = (const uint32_t *)base;
+        int nz = 0;
+        for (uint32_t i = 0; i < ctx->pixel_width * ctx->pixel_height; i++) {
+            uint8_t r = (px[i] >> 16) & 0xFF;
+            uint8_t g = (px[i] >> 8) & 0xFF;
+            uint8_t b = px[i] & 0xFF;
+            if (r || g || b) nz++;
+        }
+        NSLog(@"[daemon] %s: flush #%d: %d/%d non-zero RGB (%.0f%%)",
+              ctx->name, ctx->flush_count, nz, ctx->pixel_width * ctx->pixel_height,
+              100.0 * nz / (ctx->pixel_width * ctx->pixel_height));
+    } else if (ctx->flush_count % 500 == 0) {
+        NSLog(@"[daemon] %s: flush #%d", ctx->name, ctx->flush_count);
+    }
+}
+
+/* ================================================================
+ * SimFramebufferClient swapchain (iOS 13.7+, see common/rosettasim_sfb.h)
+ * ================================================================ */
+
+static IOSurfaceRef sfb_buffer(DeviceContext *ctx, uint32_t index) {
+    return (index % ROSETTASIM_SFB_BUFFER_COUNT) ? ctx->iosurface_read : ctx->iosurface;
+}
+
+static void sfb_stamp_front(DeviceContext *ctx, IOSurfaceRef front) {
+    ctx->sfb_sequence++;
+    CFNumberRef seq = CFNumberCreate(NULL, kCFNumberSInt32Type, &ctx->sfb_sequence);
+    IOSurfaceSetValue(front, CFSTR(ROSETTASIM_SFB_FRONT_KEY), seq);
+    CFRelease(seq);
+}
+
+static void handle_sfb_connect(DeviceContext *ctx, mach_msg_header_t *msg) {
+    RosettaSimSFBConnectReply r;
+    memset(&r, 0, sizeof(r));
+    r.header.msgh_bits = MACH_MSGH_BITS_COMPLEX |
+                         MACH_MSGH_BITS(MACH_MSG_TYPE_MOVE_SEND_ONCE, 0);
+    r.header.msgh_size = sizeof(r);
+    r.header.msgh_remote_port = msg->msgh_remote_port;
+    r.header.msgh_id = msg->msgh_id + ROSETTASIM_SFB_REPLY_OFFSET;
+    r.body.msgh_descriptor_count = ROSETTASIM_SFB_BUFFER_COUNT;
+    for (uint32_t i = 0; i < ROSETTASIM_SFB_BUFFER_COUNT; i++) {
+        r.surfaces[i].name = IOSurfaceCreateMachPort(sfb_buffer(ctx, i));
+        r.surfaces[i].disposition = MACH_MSG_TYPE_MOVE_SEND;
+        r.surfaces[i].type = MACH_MSG_PORT_DESCRIPTOR;
+    }
+    r.width = ctx->pixel_width;
+    r.height = ctx->pixel_height;
+    r.stride = ctx->bytes_per_row;
+    r.pixel_format = 0x42475241;
+    r.scale_milli = (uint32_t)(ctx->scale * 1000.0f);
+
+    /* Surface B already holds the last published frame — keep it as front */
+    ctx->sfb_front = 1;
+    r.back_index = 0;
+
+    kern_return_t kr = mach_msg(&r.header, MACH_SEND_MSG, sizeof(r),
+                                0, MACH_PORT_NULL, MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+    if (kr != KERN_SUCCESS) {
+        for (uint32_t i = 0; i < ROSETTASIM_SFB_BUFFER_COUNT; i++)
+            mach_port_deallocate(mach_task_self(), r.surfaces[i].name);
+    } else {
+        ctx->sfb_active = 1;
+    }
+    NSLog(@"[daemon] %s: SFB connect reply kr=%d (%ux%u, buffers %u/%u)",
+          ctx->name, kr, ctx->pixel_width, ctx->pixel_height,
+          IOSurfaceGetID(ctx->iosurface), IOSurfaceGetID(ctx->iosurface_read));
+}
+
+static void handle_sfb_present(DeviceContext *ctx, RosettaSimSFBPresent *p) {
+    uint64_t cpu0 = thread_cpu_ns();
+    ctx->flush_count++;
+    ctx->last_flush_time = time(NULL);
+
+    /* The presented buffer becomes ours; the previous front goes back to the client. */
+    uint32_t index = p->index % ROSETTASIM_SFB_BUFFER_COUNT;
+    ctx->sfb_front = index;
+    IOSurfaceRef front = sfb_buffer(ctx, index);
+    sfb_stamp_front(ctx, front);
+
+    if (p->header.msgh_remote_port) {
+        RosettaSimSFBPresentReply reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.header.msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_MOVE_SEND_ONCE, 0);
+        reply.header.msgh_size = sizeof(reply);
+        reply.header.msgh_remote_port = p->header.msgh_remote_port;
+        reply.header.msgh_id = p->header.msgh_id + ROSETTASIM_SFB_REPLY_OFFSET;
+        reply.back_index = (index + 1) % ROSETTASIM_SFB_BUFFER_COUNT;
+        reply.frame = (uint32_t)ctx->flush_count;
+        mach_msg(&reply.header, MACH_SEND_MSG, sizeof(reply),
+                 0, MACH_PORT_NULL, MACH_MSG_TIMEOUT_NONE, MACH_PORT_NULL);
+    }
+
+    /* The client may already be rendering into the other buffer; this one is
+     * ours until the next present, but lock it like any shared surface. */
+    IOSurfaceLock(front, kIOSurfaceLockReadOnly, NULL);
+    publish_frame(ctx, IOSurfaceGetBaseAddress(front), p->dirty_x, p->dirty_y, p->dirty_w, p->dirty_h);
+    IOSurfaceUnlock(front, kIOSurfaceLockReadOnly, NULL);
+    account_frame_cpu(ctx, 1, cpu0);
+}
+
 static void handle_one_msg(DeviceContext *ctx, mach_msg_header_t *msg);
+static void ensure_surfaces(DeviceContext *ctx);
 
 static void handle_msg_for_device(DeviceContext *ctx) {
+    ensure_surfaces(ctx);
+
     /* Drain ALL pending messages — dispatch_source coalesces events */
     uint8_t buf[4096];
     mach_msg_header_t *msg = (mach_msg_header_t *)buf;
@@ -245,6 +517,7 @@ static void handle_one_msg(DeviceContext *ctx, mach_msg_header_t *msg) {
 
     } else if (msg->msgh_id == 3) {
         /* flush_shmem — reply and dump pixels */
+        uint64_t cpu0 = thread_cpu_ns();
         ctx->flush_count++;
         ctx->last_flush_time = time(NULL);
         if (msg->msgh_remote_port) {
@@ -272,35 +545,19 @@ static void handle_one_msg(DeviceContext *ctx, mach_msg_header_t *msg) {
                 NSLog(@"[daemon] %s: flush #%d memcpy %.1fms (%u bytes)",
                       ctx->name, ctx->flush_count, ms, ctx->surface_size);
             }
+            /* Same sequence the SFB path stamps: lets probes wait for the next frame */
+            sfb_stamp_front(ctx, ctx->iosurface_read);
         }
-        write_framebuffer(ctx);
-
-        /* Also write to legacy shared path for backward compat */
-        if (ctx->surface_base) {
-            FILE *f = fopen("/tmp/sim_framebuffer.raw.tmp", "wb");
-            if (f) {
-                fwrite(ctx->surface_base, 1, ctx->surface_size, f);
-                fclose(f);
-                rename("/tmp/sim_framebuffer.raw.tmp", "/tmp/sim_framebuffer.raw");
-            }
-        }
+        /* PurpleFB flushes carry no damage info: the whole frame is dirty */
+        publish_frame(ctx, ctx->surface_base, 0, 0, 0, 0);
+        account_frame_cpu(ctx, 0, cpu0);
 
-        /* Periodic pixel stats: every flush <=10, every 10th <=50, every 200th after */
-        if (ctx->surface_base && (ctx->flush_count <= 10 || (ctx->flush_count <= 50 && ctx->flush_count % 10 == 0) || ctx->flush_count % 200 == 0)) {
-            uint32_t *px = (uint32_t *)ctx->surface_base;
-            int nz = 0;
-            for (uint32_t i = 0; i < ctx->pixel_width * ctx->pixel_height; i++) {
-                uint8_t r = (px[i] >> 16) & 0xFF;
-                uint8_t g = (px[i] >> 8) & 0xFF;
-                uint8_t b = px[i] & 0xFF;
-                if (r || g || b) nz++;
-            }
-            NSLog(@"[daemon] %s: flush #%d: %d/%d non-zero RGB (%.0f%%)",
-                  ctx->name, ctx->flush_count, nz, ctx->pixel_width * ctx->pixel_height,
-                  100.0 * nz / (ctx->pixel_width * ctx->pixel_height));
-        } else if (ctx->flush_count % 500 == 0) {
-            NSLog(@"[daemon] %s: flush #%d", ctx->name, ctx->flush_count);
-        }
+    } else if (msg->msgh_id == ROSETTASIM_SFB_MSG_CONNECT && msg->msgh_remote_port) {
+        handle_sfb_connect(ctx, msg);
+
+    } else if (msg->msgh_id == ROSETTASIM_SFB_MSG_PRESENT &&
+               msg->msgh_size >= sizeof(RosettaSimSFBPresent)) {
+        handle_sfb_present(ctx, (RosettaSimSFBPresent *)msg);
 
     } else if (msg->msgh_id == 1011) {
         /* Display state change */
@@ -400,13 +657,28 @@ static void diagnose_display_ports(id device, DeviceContext *ctx) {
 
 /* ================================================================
  * Device activation / deactivation
+ *
+ * Activation is split so a large device set comes up quickly:
+ *   prepare — receive port, and (eager mode) the two surfaces, their fill
+ *             and the memory entry. Touches only the device's own context,
+ *             so startup runs it for every device on a concurrent queue.
+ *   publish — registerPort, the mach_recv source and metadata. CoreSimulator
+ *             calls, kept serial on the main thread.
+ * Only the port has to exist before boot (backboardd looks it up early), so
+ * by default the surfaces are created when the device's first message
+ * arrives instead of for every shut-down device at startup.
  * ================================================================ */
 
-static void activate_device(DeviceContext *ctx, id device) {
-    if (ctx->active) return;
-    NSLog(@"[daemon] Activating %s (%s)", ctx->name, ctx->udid);
+static int g_eager_surfaces = 0;    /* --eager: create surfaces at registration */
+
+static double ms_since(uint64_t t0) {
+    static mach_timebase_info_data_t tb = {0};
+    if (!tb.numer) mach_timebase_info(&tb);
+    return (double)(mach_absolute_time() - t0) * tb.numer / tb.denom / 1e6;
+}
 
-    /* Query dimensions from SimDeviceType */
+/* Dimensions from SimDeviceType (ObjC: call on the main thread) */
+static void query_dimensions(DeviceContext *ctx, id device) {
     @try {
         id deviceType = ((id(*)(id, SEL))objc_msgSend)(device, sel_registerName("deviceType"));
         if (deviceType) {
@@ -430,6 +702,31 @@ static void activate_device(DeviceContext *ctx, id device) {
     ctx->surface_alloc = ((ctx->surface_size + PFB_PAGE_SIZE - 1) / PFB_PAGE_SIZE) * PFB_PAGE_SIZE;
 
     NSLog(@"[daemon] %s: %ux%u @%.0fx", ctx->name, ctx->pixel_width, ctx->pixel_height, ctx->scale);
+}
+
+static void release_surfaces(DeviceContext *ctx) {
+    if (ctx->mem_entry != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), ctx->mem_entry);
+        ctx->mem_entry = MACH_PORT_NULL;
+    }
+    if (ctx->iosurface) {
+        CFRelease(ctx->iosurface);
+        ctx->iosurface = NULL;
+    }
+    if (ctx->iosurface_read) {
+        CFRelease(ctx->iosurface_read);
+        ctx->iosurface_read = NULL;
+    }
+    ctx->surface_base = NULL;
+    ctx->surface_id = 0;
+    ctx->orientation = 0;
+    memset(&ctx->orientation_mtime, 0, sizeof(ctx->orientation_mtime));
+}
+
+/* Surfaces A/B, opaque black, plus the memory entry backboardd maps.
+ * Thread-safe for distinct contexts. */
+static BOOL prepare_surfaces(DeviceContext *ctx) {
+    if (ctx->iosurface) return YES;
 
     /* Create IOSurface A (write surface — mapped to backboardd via memory_entry) */
     NSDictionary *props = @{
@@ -444,7 +741,7 @@ static void activate_device(DeviceContext *ctx, id device) {
     ctx->iosurface = IOSurfaceCreate((__bridge CFDictionaryRef)props);
     if (!ctx->iosurface) {
         NSLog(@"[daemon] ERROR: IOSurfaceCreate failed for %s", ctx->name);
-        return;
+        return NO;
     }
     ctx->surface_base = IOSurfaceGetBaseAddress(ctx->iosurface);
 
@@ -452,20 +749,35 @@ static void activate_device(DeviceContext *ctx, id device) {
     ctx->iosurface_read = IOSurfaceCreate((__bridge CFDictionaryRef)props);
     if (!ctx->iosurface_read) {
         NSLog(@"[daemon] ERROR: IOSurfaceCreate (read) failed for %s", ctx->name);
-        CFRelease(ctx->iosurface); ctx->iosurface = NULL;
-        return;
+        release_surfaces(ctx);
+        return NO;
     }
 
-    /* Fill both with opaque black */
+    /* Fill both with opaque black: BGRA 00 00 00 FF, one 32-bit pattern per pixel */
+    static const uint32_t opaque_black = 0xFF000000;
     IOSurfaceLock(ctx->iosurface, 0, NULL);
-    uint8_t *px = (uint8_t *)ctx->surface_base;
-    memset(px, 0, ctx->surface_size);
-    for (uint32_t i = 0; i < ctx->pixel_width * ctx->pixel_height; i++) px[i * 4 + 3] = 0xFF;
+    memset_pattern4(ctx->surface_base, &opaque_black, ctx->surface_size);
     IOSurfaceUnlock(ctx->iosurface, 0, NULL);
     IOSurfaceLock(ctx->iosurface_read, 0, NULL);
-    memcpy(IOSurfaceGetBaseAddress(ctx->iosurface_read), ctx->surface_base, ctx->surface_size);
+    memset_pattern4(IOSurfaceGetBaseAddress(ctx->iosurface_read), &opaque_black, ctx->surface_size);
     IOSurfaceUnlock(ctx->iosurface_read, 0, NULL);
 
+    /* Let readers find the current front buffer once an SFB client starts
+     * swapping A/B (PurpleFB mode never stamps A, so B always wins). */
+    uint32_t id_a = IOSurfaceGetID(ctx->iosurface), id_b = IOSurfaceGetID(ctx->iosurface_read);
+    CFNumberRef peer_a = CFNumberCreate(NULL, kCFNumberSInt32Type, &id_b);
+    CFNumberRef peer_b = CFNumberCreate(NULL, kCFNumberSInt32Type, &id_a);
+    IOSurfaceSetValue(ctx->iosurface, CFSTR(ROSETTASIM_SFB_PEER_KEY), peer_a);
+    IOSurfaceSetValue(ctx->iosurface_read, CFSTR(ROSETTASIM_SFB_PEER_KEY), peer_b);
+    CFRelease(peer_a);
+    CFRelease(peer_b);
+    ctx->sfb_active = 0;
+    ctx->sfb_front = 1;
+    ctx->sfb_sequence = 0;
+    sfb_stamp_front(ctx, ctx->iosurface_read);
+    ctx->phash_count = 0;
+    ctx->phash_head = 0;
+
     /* Create memory entry */
     memory_object_size_t sz = ctx->surface_alloc;
     kern_return_t kr = mach_make_memory_entry_64(mach_task_self(), &sz,
@@ -473,15 +785,76 @@ static void activate_device(DeviceContext *ctx, id device) {
         VM_PROT_READ | VM_PROT_WRITE, &ctx->mem_entry, MACH_PORT_NULL);
     if (kr != KERN_SUCCESS) {
         NSLog(@"[daemon] ERROR: memory_entry failed for %s: %s", ctx->name, mach_error_string(kr));
-        CFRelease(ctx->iosurface);
-        ctx->iosurface = NULL;
-        return;
+        ctx->mem_entry = MACH_PORT_NULL;
+        release_surfaces(ctx);
+        return NO;
     }
 
-    /* Create and register Mach port */
-    mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &ctx->service_port);
-    mach_port_insert_right(mach_task_self(), ctx->service_port, ctx->service_port,
-                           MACH_MSG_TYPE_MAKE_SEND);
+    /* Expose the READ surface ID (surface B) for injection */
+    ctx->surface_id = IOSurfaceGetID(ctx->iosurface_read);
+    return YES;
+}
+
+static void release_port(DeviceContext *ctx) {
+    if (ctx->service_port != MACH_PORT_NULL) {
+        mach_port_deallocate(mach_task_self(), ctx->service_port);
+        ctx->service_port = MACH_PORT_NULL;
+    }
+}
+
+/* Receive port, and the surfaces when eager. Thread-safe for distinct contexts. */
+static BOOL prepare_device(DeviceContext *ctx) {
+    if (ctx->service_port == MACH_PORT_NULL) {
+        kern_return_t kr = mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
+                                              &ctx->service_port);
+        if (kr != KERN_SUCCESS) {
+            NSLog(@"[daemon] ERROR: mach_port_allocate failed for %s: %s",
+                  ctx->name, mach_error_string(kr));
+            ctx->service_port = MACH_PORT_NULL;
+            return NO;
+        }
+        mach_port_insert_right(mach_task_self(), ctx->service_port, ctx->service_port,
+                               MACH_MSG_TYPE_MAKE_SEND);
+    }
+    if (g_eager_surfaces && !prepare_surfaces(ctx)) {
+        release_port(ctx);
+        return NO;
+    }
+    return YES;
+}
+
+static void write_surface_id(DeviceContext *ctx) {
+    FILE *idf = fopen("/tmp/rosettasim_surface_id", "w");
+    if (idf) { fprintf(idf, "%u\n", ctx->surface_id); fclose(idf); }
+}
+
+/* Once a device is published its surfaces belong to g_msg_queue: they are
+ * created there (ensure_surfaces) and read there by every frame, so the main
+ * thread releases them there too. g_msg_queue never waits on main, so the
+ * dispatch_sync can't deadlock. */
+static void release_surfaces_on_queue(DeviceContext *ctx) {
+    dispatch_sync(g_msg_queue, ^{ release_surfaces(ctx); });
+}
+
+/* Lazy surfaces: first message after boot, on g_msg_queue. The metadata
+ * files belong to the main thread, so they are rewritten there. */
+static void ensure_surfaces(DeviceContext *ctx) {
+    if (ctx->iosurface) return;
+    uint64_t t0 = mach_absolute_time();
+    if (!prepare_surfaces(ctx)) return;
+    NSLog(@"[daemon] %s: surfaces created on first message in %.1fms (id=%u)",
+          ctx->name, ms_since(t0), ctx->surface_id);
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!ctx->active) return;
+        write_surface_id(ctx);
+        write_active_devices();
+    });
+}
+
+/* Register the prepared port with CoreSimulator and start receiving.
+ * Main thread. Does not rewrite the active devices file. */
+static void publish_device(DeviceContext *ctx, id device) {
+    if (ctx->active || ctx->service_port == MACH_PORT_NULL) return;
 
     NSError *err = nil;
     BOOL ok = ((BOOL(*)(id, SEL, mach_port_t, id, NSError **))objc_msgSend)(
@@ -489,12 +862,8 @@ static void activate_device(DeviceContext *ctx, id device) {
         ctx->service_port, @"PurpleFBServer", &err);
     if (!ok) {
         NSLog(@"[daemon] ERROR: registerPort failed for %s: %@", ctx->name, err);
-        mach_port_deallocate(mach_task_self(), ctx->service_port);
-        mach_port_deallocate(mach_task_self(), ctx->mem_entry);
-        CFRelease(ctx->iosurface);
-        ctx->service_port = MACH_PORT_NULL;
-        ctx->mem_entry = MACH_PORT_NULL;
-        ctx->iosurface = NULL;
+        release_port(ctx);
+        release_surfaces_on_queue(ctx);
         return;
     }
 
@@ -507,18 +876,28 @@ static void activate_device(DeviceContext *ctx, id device) {
     });
     dispatch_activate(ctx->recv_source);
 
-    /* Write metadata — expose the READ surface ID (surface B) for injection */
-    ctx->surface_id = IOSurfaceGetID(ctx->iosurface_read);
-    FILE *idf = fopen("/tmp/rosettasim_surface_id", "w");
-    if (idf) { fprintf(idf, "%u\n", ctx->surface_id); fclose(idf); }
-
+    if (ctx->iosurface) write_surface_id(ctx);
     write_device_metadata(ctx);
     ctx->active = 1;
     ctx->flush_count = 0;
-    write_active_devices();
 
-    NSLog(@"[daemon] %s: PurpleFBServer registered (port=0x%x, surface=%ux%u id=%u)",
-          ctx->name, ctx->service_port, ctx->pixel_width, ctx->pixel_height, ctx->surface_id);
+    if (ctx->iosurface)
+        NSLog(@"[daemon] %s: PurpleFBServer registered (port=0x%x, surface=%ux%u id=%u)",
+              ctx->name, ctx->service_port, ctx->pixel_width, ctx->pixel_height, ctx->surface_id);
+    else
+        NSLog(@"[daemon] %s: PurpleFBServer registered (port=0x%x, %ux%u, surfaces on first message)",
+              ctx->name, ctx->service_port, ctx->pixel_width, ctx->pixel_height);
+}
+
+/* Single device (state changes, re-scan): prepare + publish inline */
+static void activate_device(DeviceContext *ctx, id device) {
+    if (ctx->active) return;
+    NSLog(@"[daemon] Activating %s (%s)", ctx->name, ctx->udid);
+    query_dimensions(ctx, device);
+    if (!prepare_device(ctx)) return;
+    publish_device(ctx, device);
+    if (!ctx->active) return;
+    write_active_devices();
 
     /* Diagnose Display port for screenshot support */
     diagnose_display_ports(device, ctx);
@@ -528,27 +907,17 @@ static void deactivate_device(DeviceContext *ctx) {
     if (!ctx->active) return;
     NSLog(@"[daemon] Deactivating %s (%s)", ctx->name, ctx->udid);
 
+    /* Cancelling stops new handler runs but not one in progress, which may be
+     * creating the surfaces or publishing a frame; release after it */
     if (ctx->recv_source) {
         dispatch_source_cancel(ctx->recv_source);
         ctx->recv_source = nil;
     }
-    if (ctx->iosurface) {
-        CFRelease(ctx->iosurface);
-        ctx->iosurface = NULL;
-    }
-    if (ctx->iosurface_read) {
-        CFRelease(ctx->iosurface_read);
-        ctx->iosurface_read = NULL;
-    }
-    if (ctx->mem_entry != MACH_PORT_NULL) {
-        mach_port_deallocate(mach_task_self(), ctx->mem_entry);
-        ctx->mem_entry = MACH_PORT_NULL;
-    }
-    if (ctx->service_port != MACH_PORT_NULL) {
-        mach_port_deallocate(mach_task_self(), ctx->service_port);
-        ctx->service_port = MACH_PORT_NULL;
-    }
-    ctx->surface_base = NULL;
+    release_surfaces_on_queue(ctx);
+    release_port(ctx);
+    ctx->sfb_active = 0;
+    memset(ctx->frame_cpu_ns, 0, sizeof(ctx->frame_cpu_ns));
+    memset(ctx->frame_cpu_count, 0, sizeof(ctx->frame_cpu_count));
     ctx->active = 0;
 
     cleanup_device_files(ctx);
@@ -621,7 +990,12 @@ static BOOL is_legacy_runtime(id device) {
 
 int main(int argc, const char *argv[]) {
     @autoreleasepool {
-        BOOL listOnly = (argc > 1 && strcmp(argv[1], "--list") == 0);
+        uint64_t t_launch = mach_absolute_time();
+        BOOL listOnly = NO;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--list") == 0) listOnly = YES;
+            else if (strcmp(argv[i], "--eager") == 0) g_eager_surfaces = 1;
+        }
 
         /* Load CoreSimulator */
         dlopen("/Library/Developer/PrivateFrameworks/CoreSimulator.framework/CoreSimulator", RTLD_NOW);
@@ -713,6 +1087,8 @@ int main(int argc, const char *argv[]) {
          * For already-booted devices, we skip (can't register after boot).
          */
         NSLog(@"[daemon] Pre-registering PurpleFBServer for all shutdown devices...");
+        NSMutableArray *pending = [NSMutableArray array];
+        DeviceContext **pendingCtx = calloc(legacyDevices.count, sizeof(*pendingCtx));
         for (id device in legacyDevices) {
             NSString *udidStr = [((id(*)(id, SEL))objc_msgSend)(device,
                                   sel_registerName("UDID")) UUIDString];
@@ -725,14 +1101,45 @@ int main(int argc, const char *argv[]) {
                       dctx->name, currentState);
                 continue;
             }
+            query_dimensions(dctx, device);
+            pendingCtx[pending.count] = dctx;
+            [pending addObject:device];
+        }
 
-            /* Pre-register PurpleFBServer for shutdown devices (ready for boot) */
-            activate_device(dctx, device);
-            if (dctx->active) {
+        /* Prepare in parallel (each iteration only touches its own context),
+         * then publish serially: registerPort is a CoreSimulator call. */
+        size_t npending = pending.count;
+        uint64_t t_prepare = mach_absolute_time();
+        dispatch_apply(npending, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) { @autoreleasepool {
+            prepare_device(pendingCtx[i]);
+        }});
+        double prepare_ms = ms_since(t_prepare);
+
+        uint64_t t_publish = mach_absolute_time();
+        int registered = 0;
+        for (size_t i = 0; i < npending; i++) {
+            publish_device(pendingCtx[i], pending[i]);
+            if (pendingCtx[i]->active) {
                 NSLog(@"[daemon] %s: pre-registered PurpleFBServer (ready for boot)",
-                      dctx->name);
+                      pendingCtx[i]->name);
+                registered++;
             }
         }
+        write_active_devices();
+        double publish_ms = ms_since(t_publish);
+
+        NSLog(@"[daemon] Ready: %d/%zu shutdown device(s) registered %.1fms after launch "
+              "(prepare %.1fms on %ld CPUs, publish %.1fms, surfaces %s)",
+              registered, npending, ms_since(t_launch), prepare_ms,
+              sysconf(_SC_NPROCESSORS_ONLN), publish_ms,
+              g_eager_surfaces ? "eager" : "on first message");
+
+        /* Diagnose Display ports for screenshot support (after ready: logging only) */
+        for (size_t i = 0; i < npending; i++) {
+            if (pendingCtx[i]->active)
+                diagnose_display_ports(pending[i], pendingCtx[i]);
+        }
+        free(pendingCtx);
 
         /* Register notification handlers for state tracking */
         for (id device in legacyDevices) {
@@ -793,8 +1200,7 @@ int main(int argc, const char *argv[]) {
             unlink("/tmp/rosettasim_active_devices.json");
             unlink("/tmp/rosettasim_dimensions.json");
             unlink("/tmp/rosettasim_surface_id");
-            unlink("/tmp/sim_framebuffer.raw");
-            unlink("/tmp/sim_framebuffer.raw.tmp");
+            rsim_fb_writer_close(&g_raw_out, 1);
             NSLog(@"[daemon] Clean shutdown complete.");
             exit(0);
         };
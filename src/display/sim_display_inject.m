@@ -30,12 +30,17 @@
 #include <mach/mach_time.h>
 #include <notify.h>
 
+#include "common/rosettasim_sfb.h"
+#include "common/rosettasim_fbfile.h"
+
 /* --- Per-device display state --- */
 
 typedef struct {
     char     udid[64];
     char     name[128];
-    char     fb_path[256];    /* path to raw framebuffer file */
+    char     fb_path[256];    /* path to framebuffer file */
+    BOOL     fb_v2;           /* fb_path is a daemon frame file (common/rosettasim_fbfile.h) */
+    uint64_t last_sequence;   /* header sequence of the last frame file shown */
     uint32_t width;
     uint32_t height;
     uint32_t bpr;
@@ -49,6 +54,7 @@ typedef struct {
     int      persist_fd;  /* persistent fd for pread (-1 = not open) */
     uint32_t      surface_id;   /* IOSurface ID from daemon (0 = not set) */
     IOSurfaceRef  iosurface;    /* looked up IOSurface (NULL = not resolved) */
+    IOSurfaceRef  peer_surface; /* other swapchain buffer when the device uses SFB */
     uint32_t      last_seed;    /* IOSurface seed for change detection */
 } DeviceDisplay;
 
@@ -59,6 +65,34 @@ static void device_set_layer(DeviceDisplay *dd, CALayer *layer) {
     dd->layer_ref = layer ? (void *)CFRetain((__bridge CFTypeRef)layer) : NULL;
 }
 
+/* Resolve the peer buffer of a daemon surface (NULL if it has none). */
+static IOSurfaceRef lookup_peer_surface(IOSurfaceRef surface) {
+    CFTypeRef v = IOSurfaceCopyValue(surface, CFSTR(ROSETTASIM_SFB_PEER_KEY));
+    if (!v) return NULL;
+    uint32_t peer_id = 0;
+    if (CFGetTypeID(v) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)v, kCFNumberSInt32Type, &peer_id);
+    CFRelease(v);
+    return peer_id ? IOSurfaceLookup(peer_id) : NULL;
+}
+
+static uint32_t front_sequence(IOSurfaceRef surface) {
+    CFTypeRef v = IOSurfaceCopyValue(surface, CFSTR(ROSETTASIM_SFB_FRONT_KEY));
+    if (!v) return 0;
+    uint32_t seq = 0;
+    if (CFGetTypeID(v) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)v, kCFNumberSInt32Type, &seq);
+    CFRelease(v);
+    return seq;
+}
+
+/* The daemon stamps whichever buffer it currently owns; pick the newest. */
+static IOSurfaceRef device_front_surface(DeviceDisplay *dd) {
+    if (!dd->peer_surface) return dd->iosurface;
+    return front_sequence(dd->peer_surface) > front_sequence(dd->iosurface)
+        ? dd->peer_surface : dd->iosurface;
+}
+
 static DeviceDisplay *g_devices = NULL;
 static int g_device_count = 0;
 static int g_device_capacity = 0;
@@ -208,6 +242,7 @@ static BOOL load_multi_device_list(void) {
         NSNumber *h = dev[@"height"];
         NSNumber *s = dev[@"scale"];
         NSNumber *sid = dev[@"surface_id"];
+        NSString *fb = dev[@"fb"];
         if (!udid || !name || !w || !h) continue;
 
         DeviceDisplay *dd = &g_devices[new_count];
@@ -219,7 +254,11 @@ static BOOL load_multi_device_list(void) {
 
         strlcpy(dd->udid, udid.UTF8String, sizeof(dd->udid));
         strlcpy(dd->name, name.UTF8String, sizeof(dd->name));
-        snprintf(dd->fb_path, sizeof(dd->fb_path), "/tmp/rosettasim_fb_%s.raw", dd->udid);
+        if (fb)
+            strlcpy(dd->fb_path, fb.UTF8String, sizeof(dd->fb_path));
+        else
+            snprintf(dd->fb_path, sizeof(dd->fb_path), "/tmp/rosettasim_fb_%s.fb", dd->udid);
+        dd->fb_v2 = YES;
         dd->width   = w.unsignedIntValue;
         dd->height  = h.unsignedIntValue;
         dd->scale   = s ? s.floatValue : 2.0f;
@@ -230,8 +269,11 @@ static BOOL load_multi_device_list(void) {
         uint32_t new_sid = sid ? sid.unsignedIntValue : 0;
         if (new_sid > 0 && new_sid != dd->surface_id) {
             if (dd->iosurface) { CFRelease(dd->iosurface); dd->iosurface = NULL; }
+            if (dd->peer_surface) { CFRelease(dd->peer_surface); dd->peer_surface = NULL; }
             dd->iosurface = IOSurfaceLookup(new_sid);
             dd->surface_id = new_sid;
+            if (dd->iosurface)
+                dd->peer_surface = lookup_peer_surface(dd->iosurface);
             if (dd->iosurface)
                 NSLog(@"[inject] IOSurface lookup OK for '%s': id=%u", name.UTF8String, new_sid);
             else
@@ -244,13 +286,11 @@ static BOOL load_multi_device_list(void) {
             dd->active = NO;
             if (dd->persist_fd >= 0) { close(dd->persist_fd); dd->persist_fd = -1; }
             dd->last_ino = 0;
+            dd->last_sequence = 0;
         }
         /* else: keep existing layer_ref and active state */
 
-        if (!dd->read_buf || dd->fb_size > dd->bpr * dd->height) {
-            free(dd->read_buf);
-            dd->read_buf = malloc(dd->fb_size);
-        }
+        /* Frame files are mapped in place — no read buffer needed */
         new_count++;
     }
     /* Release layers for devices that were removed */
@@ -259,6 +299,7 @@ static BOOL load_multi_device_list(void) {
         g_devices[i].active = NO;
         if (g_devices[i].persist_fd >= 0) { close(g_devices[i].persist_fd); g_devices[i].persist_fd = -1; }
         if (g_devices[i].iosurface) { CFRelease(g_devices[i].iosurface); g_devices[i].iosurface = NULL; }
+        if (g_devices[i].peer_surface) { CFRelease(g_devices[i].peer_surface); g_devices[i].peer_surface = NULL; }
     }
     g_device_count = new_count;
 
@@ -311,10 +352,54 @@ static CALayer *rescan_window_layer(NSWindow *win) {
     return get_surface_layer(renderable);
 }
 
+static void release_frame_copy(void *info, const void *data, size_t size) {
+    (void)data; (void)size;
+    rsim_fb_frame_free((RSimFBFrame *)info);
+    free(info);
+}
+
+/* The daemon's writer rewrites each ring file in place a few frames after
+ * publishing it, so a mapping isn't a snapshot: copy the frame out under the
+ * header's seqlock and hand the copy to the layer, freed when the image is
+ * released. The header sequence skips frames already shown. */
+static BOOL refresh_device_from_frame_file(DeviceDisplay *dd) {
+    struct stat st;
+    if (stat(dd->fb_path, &st) != 0 || st.st_ino == dd->last_ino) return NO;
+
+    RSimFBFrame *frame = calloc(1, sizeof(*frame));
+    if (!frame) return NO;
+    int err = rsim_fb_read(dd->fb_path, frame, dd->last_sequence, 0);
+    if (err != RSIM_FB_OK) {
+        release_frame_copy(frame, NULL, 0);
+        if (err == RSIM_FB_SAME) dd->last_ino = st.st_ino;
+        return NO;
+    }
+    dd->last_ino = st.st_ino;
+    const RSimFBHeader *h = &frame->header;
+    dd->last_sequence = h->sequence;
+
+    CGDataProviderRef provider = CGDataProviderCreateWithData(frame, frame->pixels,
+        (size_t)h->data_size, release_frame_copy);
+    CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+    CGImageRef img = CGImageCreate(h->width, h->height, 8, 32, h->bytes_per_row, cs,
+        kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst,
+        provider, NULL, false, kCGRenderingIntentDefault);
+    if (img) {
+        [CATransaction begin];
+        [CATransaction setDisableActions:YES];
+        DEVICE_LAYER(dd).contents = (__bridge id)img;
+        [CATransaction commit];
+        CGImageRelease(img);
+    }
+    CGDataProviderRelease(provider);
+    CGColorSpaceRelease(cs);
+    return img != NULL;
+}
+
 /* Returns YES if a new frame was displayed */
 static BOOL refresh_device(DeviceDisplay *dd) {
     if (!dd->layer_ref) return NO;
-    if (!dd->iosurface && (!dd->read_buf || !dd->fb_path[0])) return NO;
+    if (!dd->iosurface && (!dd->fb_path[0] || (!dd->fb_v2 && !dd->read_buf))) return NO;
 
     /* Check layer is still in the view hierarchy — Simulator.app may have replaced it */
     CALayer *layer = DEVICE_LAYER(dd);
@@ -348,9 +433,11 @@ static BOOL refresh_device(DeviceDisplay *dd) {
     /* --- IOSurface path: zero-copy CGImage from double-buffered read surface --- */
     if (dd->iosurface) {
         /* Surface B is a stable snapshot (daemon copies A→B after each flush).
+         * With an SFB client A/B swap instead, so follow the daemon's front stamp.
          * No mtime gating needed — render on every CADisplayLink tick. */
-        void *base = IOSurfaceGetBaseAddress(dd->iosurface);
-        size_t bpr = IOSurfaceGetBytesPerRow(dd->iosurface);
+        IOSurfaceRef front = device_front_surface(dd);
+        void *base = IOSurfaceGetBaseAddress(front);
+        size_t bpr = IOSurfaceGetBytesPerRow(front);
         CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, base, bpr * dd->height, NULL);
         CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
         CGImageRef img = CGImageCreate(dd->width, dd->height, 8, 32, bpr, cs,
@@ -368,6 +455,9 @@ static BOOL refresh_device(DeviceDisplay *dd) {
         return YES;
     }
 
+    /* --- Frame file fallback: daemon devices whose surface isn't reachable --- */
+    if (dd->fb_v2) return refresh_device_from_frame_file(dd);
+
     /* --- File fallback: read from framebuffer file (for standalone bridge compat) --- */
     if (!dd->read_buf || !dd->fb_path[0]) return NO;
 
@@ -0,0 +1,277 @@
+/*
+ * sim_hang_detector.dylib — x86_64 constructor dylib for apps under test
+ *
+ * Reports main-thread stalls: a CFRunLoop observer stamps every run loop
+ * transition, and a watchdog thread flags the main thread as hung when it
+ * has been busy (not parked in BeforeWaiting) past the threshold. The main
+ * thread is then suspended just long enough to walk its frame-pointer chain;
+ * symbolication (dladdr) happens after it resumes.
+ *
+ * Opt-in per app: `rosettasim-ctl hangs <UDID> enable <bundle-id>` adds an
+ * LC_LOAD_DYLIB for /usr/lib/sim_hang_detector.dylib to the installed app.
+ *
+ * Events: one JSON object per line, appended to
+ *   {device data}/tmp/rosettasim_hangs.jsonl
+ * A hang still going after 3s is written with "ongoing":true, then again
+ * with its final duration when the main thread moves on (same "id").
+ *
+ * Threshold: {device data}/tmp/rosettasim_hang_threshold_ms (default 250).
+ *
+ * Build:
+ *   make hang_detector   (from src/)
+ */
+
+#import <Foundation/Foundation.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "common/rosettasim_paths.h"
+
+#define DEFAULT_THRESHOLD_MS    250
+#define ONGOING_REPORT_MS       3000
+#define MAX_FRAMES              48
+#define CYCLE_RING              1024    /* power of two: cycle numbers wrap cleanly */
+
+static char                 g_events_path[1024];
+static uint32_t             g_threshold_ms = DEFAULT_THRESHOLD_MS;
+static thread_act_t         g_main_thread;
+static uintptr_t            g_stack_lo, g_stack_hi;
+static mach_timebase_info_data_t g_tb;
+
+/* Written by the observer on the main thread, read by the watchdog */
+static _Atomic uint64_t     g_busy_since;       /* mach time of the latest non-idle transition; 0 = idle */
+static _Atomic uint32_t     g_cycle;            /* bumped on every activity */
+static _Atomic uint64_t     g_cycle_start[CYCLE_RING];  /* mach time each cycle began, by cycle */
+static _Atomic uint32_t     g_activity;         /* latest CFRunLoopActivity */
+
+static uint64_t mach_to_ms(uint64_t t) {
+    return t * g_tb.numer / g_tb.denom / 1000000ull;
+}
+
+static uint64_t ms_to_mach(uint64_t ms) {
+    return ms * 1000000ull * g_tb.denom / g_tb.numer;
+}
+
+static const char *activity_name(uint32_t activity) {
+    switch (activity) {
+    case kCFRunLoopEntry:           return "Entry";
+    case kCFRunLoopBeforeTimers:    return "BeforeTimers";
+    case kCFRunLoopBeforeSources:   return "BeforeSources";
+    case kCFRunLoopBeforeWaiting:   return "BeforeWaiting";
+    case kCFRunLoopAfterWaiting:    return "AfterWaiting";
+    case kCFRunLoopExit:            return "Exit";
+    }
+    return "Unknown";
+}
+
+/* ================================================================
+ * Run loop observer (main thread)
+ * ================================================================ */
+
+static void observe_runloop(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void *info) {
+    uint64_t now = mach_absolute_time();
+    uint32_t cycle = atomic_load_explicit(&g_cycle, memory_order_relaxed) + 1;   /* only written here */
+    atomic_store_explicit(&g_activity, (uint32_t)activity, memory_order_relaxed);
+    atomic_store_explicit(&g_cycle_start[cycle % CYCLE_RING], now, memory_order_relaxed);
+    atomic_store_explicit(&g_busy_since, activity == kCFRunLoopBeforeWaiting ? 0 : now,
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_cycle, 1, memory_order_release);
+}
+
+/* ================================================================
+ * Main thread backtrace (watchdog thread)
+ * ================================================================ */
+
+/* Suspend, read pc + frame pointer chain, resume. Only plain loads of the
+ * (suspended) main stack happen while it is stopped — no locks, no malloc. */
+static int capture_main_backtrace(uintptr_t *frames, int max) {
+    if (thread_suspend(g_main_thread) != KERN_SUCCESS) return 0;
+    uintptr_t pc = 0, fp = 0;
+#if defined(__x86_64__)
+    x86_thread_state64_t st;
+    mach_msg_type_number_t count = x86_THREAD_STATE64_COUNT;
+    if (thread_get_state(g_main_thread, x86_THREAD_STATE64, (thread_state_t)&st, &count) == KERN_SUCCESS) {
+        pc = (uintptr_t)st.__rip;
+        fp = (uintptr_t)st.__rbp;
+    }
+#elif defined(__arm64__)
+    arm_thread_state64_t st;
+    mach_msg_type_number_t count = ARM_THREAD_STATE64_COUNT;
+    if (thread_get_state(g_main_thread, ARM_THREAD_STATE64, (thread_state_t)&st, &count) == KERN_SUCCESS) {
+        pc = (uintptr_t)arm_thread_state64_get_pc(st);
+        fp = (uintptr_t)arm_thread_state64_get_fp(st);
+    }
+#endif
+    int n = 0;
+    if (pc) frames[n++] = pc;
+    while (n < max && fp >= g_stack_lo && fp + 2 * sizeof(uintptr_t) <= g_stack_hi &&
+           !(fp & (sizeof(uintptr_t) - 1))) {
+        uintptr_t next = ((uintptr_t *)fp)[0];
+        uintptr_t ret = ((uintptr_t *)fp)[1];
+        if (!ret) break;
+        frames[n++] = ret;
+        if (next <= fp) break;      /* the chain must walk up the stack */
+        fp = next;
+    }
+    thread_resume(g_main_thread);
+    return n;
+}
+
+/* ================================================================
+ * Event output
+ * ================================================================ */
+
+typedef struct {
+    uint32_t    id;
+    double      start;              /* seconds since 1970 */
+    uint64_t    busy_since;         /* mach time */
+    uint32_t    cycle;
+    uint32_t    activity;
+    uintptr_t   frames[MAX_FRAMES];
+    int         frame_count;
+    BOOL        ongoing_reported;
+} HangEvent;
+
+static void write_event(const HangEvent *ev, uint64_t duration_ms, BOOL ongoing) {
+    NSMutableArray *frames = [NSMutableArray arrayWithCapacity:(NSUInteger)ev->frame_count];
+    for (int i = 0; i < ev->frame_count; i++) {
+        Dl_info info;
+        uintptr_t addr = ev->frames[i];
+        /* Return addresses point after the call; look up the call itself */
+        uintptr_t lookup = i ? addr - 1 : addr;
+        if (dladdr((const void *)lookup, &info) && info.dli_fname) {
+            const char *image = strrchr(info.dli_fname, '/');
+            image = image ? image + 1 : info.dli_fname;
+            if (info.dli_sname)
+                [frames addObject:[NSString stringWithFormat:@"0x%lx %s %s + %lu", (unsigned long)addr, image,
+                                   info.dli_sname, (unsigned long)(addr - (uintptr_t)info.dli_saddr)]];
+            else
+                [frames addObject:[NSString stringWithFormat:@"0x%lx %s + 0x%lx", (unsigned long)addr, image,
+                                   (unsigned long)(addr - (uintptr_t)info.dli_fbase)]];
+        } else {
+            [frames addObject:[NSString stringWithFormat:@"0x%lx", (unsigned long)addr]];
+        }
+    }
+    NSDictionary *event = @{
+        @"id": @(ev->id),
+        @"pid": @(getpid()),
+        @"process": [NSProcessInfo processInfo].processName ?: @"?",
+        @"bundle": [NSBundle mainBundle].bundleIdentifier ?: @"",
+        @"start": @(ev->start),
+        @"duration_ms": @(duration_ms),
+        @"threshold_ms": @(g_threshold_ms),
+        @"activity": @(activity_name(ev->activity)),
+        @"ongoing": @(ongoing),
+        @"frames": frames,
+    };
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:event options:0 error:nil] mutableCopy];
+    if (!line) return;
+    [line appendBytes:"\n" length:1];
+    /* One O_APPEND write per event: several apps may report into the same file */
+    int fd = open(g_events_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) return;
+    write(fd, line.bytes, line.length);
+    close(fd);
+}
+
+/* ================================================================
+ * Watchdog thread
+ * ================================================================ */
+
+static void *watchdog_thread(void *arg) {
+    (void)arg;
+    pthread_setname_np("rosettasim.hang-watchdog");
+    uint32_t next_id = 1;
+    HangEvent pending;
+    BOOL has_pending = NO;
+    uint32_t interval_ms = g_threshold_ms / 4 > 10 ? g_threshold_ms / 4 : 10;
+
+    for (;;) {
+        usleep(interval_ms * 1000);
+        @autoreleasepool {
+            uint32_t cycle = atomic_load_explicit(&g_cycle, memory_order_acquire);
+            uint64_t busy_since = atomic_load_explicit(&g_busy_since, memory_order_relaxed);
+            uint64_t now = mach_absolute_time();
+
+            if (has_pending && cycle != pending.cycle) {
+                /* The main thread moved on: the hang ended when the cycle after
+                 * it began. Past a full ring of transitions since, that time is
+                 * gone and the oldest one kept is the closest bound. */
+                uint32_t ended = cycle - pending.cycle < CYCLE_RING ? pending.cycle + 1
+                                                                    : cycle - CYCLE_RING + 1;
+                uint64_t end = atomic_load_explicit(&g_cycle_start[ended % CYCLE_RING], memory_order_relaxed);
+                write_event(&pending, mach_to_ms(end - pending.busy_since), NO);
+                has_pending = NO;
+            }
+            if (!busy_since || now - busy_since < ms_to_mach(g_threshold_ms)) continue;
+
+            if (!has_pending) {
+                memset(&pending, 0, sizeof(pending));
+                pending.id = next_id++;
+                pending.cycle = cycle;
+                pending.busy_since = busy_since;
+                pending.activity = atomic_load_explicit(&g_activity, memory_order_relaxed);
+                pending.start = [[NSDate date] timeIntervalSince1970] - mach_to_ms(now - busy_since) / 1000.0;
+                pending.frame_count = capture_main_backtrace(pending.frames, MAX_FRAMES);
+                has_pending = YES;
+            } else if (!pending.ongoing_reported && mach_to_ms(now - busy_since) >= ONGOING_REPORT_MS) {
+                /* Still stuck — report now in case the app gets killed for it */
+                write_event(&pending, mach_to_ms(now - busy_since), YES);
+                pending.ongoing_reported = YES;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* ================================================================
+ * Constructor
+ * ================================================================ */
+
+/* Apps run with their data container as home; events go to the device's
+ * tmp so rosettasim-ctl finds them without knowing the container. */
+static NSString *device_data_root(void) {
+    NSString *home = NSHomeDirectory();
+    NSRange r = [home rangeOfString:@"/Containers/Data/Application/"];
+    return r.location != NSNotFound ? [home substringToIndex:r.location] : home;
+}
+
+__attribute__((constructor))
+static void sim_hang_detector_init(void) {
+    @autoreleasepool {
+        if (![NSThread isMainThread]) return;
+        mach_timebase_info(&g_tb);
+
+        NSString *root = device_data_root();
+        [[NSFileManager defaultManager] createDirectoryAtPath:[root stringByAppendingPathComponent:@"tmp"]
+                                  withIntermediateDirectories:YES attributes:nil error:nil];
+        snprintf(g_events_path, sizeof(g_events_path), "%s/" ROSETTASIM_DEV_HANGS_FILE, root.UTF8String);
+        NSString *thresholdPath = [root stringByAppendingPathComponent:@ROSETTASIM_DEV_HANG_THRESHOLD];
+        int threshold = [[NSString stringWithContentsOfFile:thresholdPath encoding:NSUTF8StringEncoding
+                                                      error:nil] intValue];
+        if (threshold > 0) g_threshold_ms = (uint32_t)threshold;
+
+        /* The constructor runs on the main thread: keep its port and stack bounds */
+        g_main_thread = mach_thread_self();
+        pthread_t self = pthread_self();
+        g_stack_hi = (uintptr_t)pthread_get_stackaddr_np(self);
+        g_stack_lo = g_stack_hi - pthread_get_stacksize_np(self);
+
+        CFRunLoopObserverRef observer = CFRunLoopObserverCreate(NULL, kCFRunLoopAllActivities,
+                                                                true, 0, observe_runloop, NULL);
+        CFRunLoopAddObserver(CFRunLoopGetMain(), observer, kCFRunLoopCommonModes);
+        CFRelease(observer);
+        atomic_store(&g_busy_since, mach_absolute_time());  /* launch counts until the first idle */
+
+        pthread_t watchdog;
+        if (pthread_create(&watchdog, NULL, watchdog_thread, NULL) == 0)
+            pthread_detach(watchdog);
+
+        NSLog(@"[hang_detector] %@ (pid %d): threshold %ums, events → %s",
+              [NSProcessInfo processInfo].processName, getpid(), g_threshold_ms, g_events_path);
+    }
+}
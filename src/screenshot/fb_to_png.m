@@ -1,11 +1,25 @@
 // fb_to_png.m — Screenshot tool for legacy iOS simulators
 //
-// Reads framebuffer data from IOSurface (by ID) or raw file and saves as PNG.
+// Reads framebuffer data from IOSurface (by ID), a daemon frame file or a raw
+// dump and saves as PNG,
+// or as JPEG with the built-in encoder (common/rosettasim_jpeg.c).
 // Used by scripts/simctl wrapper for transparent screenshot support.
 //
 // Usage:
-//   fb_to_png <surface_id> <output.png>                           # IOSurface mode
-//   fb_to_png --raw <raw_file> <width> <height> <bpr> <output.png> # raw file mode
+//   fb_to_png <surface_id> <output.png> [options]                           # IOSurface mode
+//   fb_to_png --fb <frame.fb> <output.png> [options]                         # v2 frame file
+//   fb_to_png --raw <raw_file> <width> <height> <bpr> <output.png> [options] # raw file mode
+//
+// Options (applied in this order):
+//   --rect x,y,w,h        crop, in framebuffer pixels
+//   --scale 0.5|0.25|...  box-filter downscale by a power of two
+//   --rotate auto|0|90|180|270
+//                         clockwise turn; auto (default) shows the guest's
+//                         interface orientation upright (landscape stays
+//                         landscape), as the daemon stamps it on the surface
+//                         and frame file. Raw dumps carry none: auto = 0.
+//   --format png|jpeg     default: from the output extension (.jpg/.jpeg → jpeg)
+//   --quality N           JPEG quality 1-100 (default 80)
 
 #import <Foundation/Foundation.h>
 #import <CoreGraphics/CoreGraphics.h>
@@ -13,6 +27,38 @@
 #import <IOSurface/IOSurface.h>
 #import <UniformTypeIdentifiers/UniformTypeIdentifiers.h>
 
+#include "common/rosettasim_sfb.h"
+#include "common/rosettasim_image.h"
+#include "common/rosettasim_jpeg.h"
+#include "common/rosettasim_fbfile.h"
+#include <sys/stat.h>
+
+static uint32_t surface_u32_value(IOSurfaceRef surface, CFStringRef key) {
+    CFTypeRef v = IOSurfaceCopyValue(surface, key);
+    if (!v) return 0;
+    uint32_t n = 0;
+    if (CFGetTypeID(v) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)v, kCFNumberSInt32Type, &n);
+    CFRelease(v);
+    return n;
+}
+
+// Devices driven by the SFB swapchain alternate between two surfaces; the
+// daemon stamps the one it owns. Swap to the peer if it holds the newer frame.
+static IOSurfaceRef resolve_front_surface(IOSurfaceRef surface) {
+    uint32_t peerID = surface_u32_value(surface, CFSTR(ROSETTASIM_SFB_PEER_KEY));
+    if (!peerID) return surface;
+    IOSurfaceRef peer = IOSurfaceLookup(peerID);
+    if (!peer) return surface;
+    if (surface_u32_value(peer, CFSTR(ROSETTASIM_SFB_FRONT_KEY)) >
+        surface_u32_value(surface, CFSTR(ROSETTASIM_SFB_FRONT_KEY))) {
+        CFRelease(surface);
+        return peer;
+    }
+    CFRelease(peer);
+    return surface;
+}
+
 static int write_png(CGImageRef img, const char *path) {
     NSURL *url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path]];
     CGImageDestinationRef dest = CGImageDestinationCreateWithURL(
@@ -24,53 +70,232 @@ static int write_png(CGImageRef img, const char *path) {
     return ok ? 0 : 1;
 }
 
+typedef struct {
+    BOOL  crop;
+    int   x, y, w, h;       // --rect, pixels
+    int   factor;           // 1 / --scale
+    int   rotate;           // clockwise degrees, -1 = auto
+    BOOL  jpeg;
+    int   quality;
+} EncodeOptions;
+
+// Parses options from argv[first..]; returns NO (after printing why) on bad input
+static BOOL parse_options(int argc, char *argv[], int first, const char *output, EncodeOptions *opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->factor = 1;
+    opt->rotate = -1;
+    opt->quality = 80;
+    const char *ext = strrchr(output, '.');
+    opt->jpeg = ext && (strcasecmp(ext, ".jpg") == 0 || strcasecmp(ext, ".jpeg") == 0);
+
+    for (int i = first; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--rect") == 0 && val) {
+            if (sscanf(val, "%d,%d,%d,%d", &opt->x, &opt->y, &opt->w, &opt->h) != 4 ||
+                opt->x < 0 || opt->y < 0 || opt->w < 1 || opt->h < 1) {
+                fprintf(stderr, "Bad --rect '%s' (expected x,y,w,h in pixels)\n", val);
+                return NO;
+            }
+            opt->crop = YES;
+            i++;
+        } else if (strcmp(arg, "--scale") == 0 && val) {
+            double scale = atof(val);
+            int factor = scale > 0 ? (int)lround(1.0 / scale) : 0;
+            if (factor < 1 || (factor & (factor - 1)) || fabs(1.0 / factor - scale) > 1e-6) {
+                fprintf(stderr, "Bad --scale '%s' (expected 1, 0.5, 0.25, ...)\n", val);
+                return NO;
+            }
+            opt->factor = factor;
+            i++;
+        } else if (strcmp(arg, "--rotate") == 0 && val) {
+            if (strcmp(val, "auto") == 0) {
+                opt->rotate = -1;
+            } else {
+                char *end;
+                long deg = strtol(val, &end, 10);
+                if (*end || deg < 0 || deg >= 360 || deg % 90) {
+                    fprintf(stderr, "Bad --rotate '%s' (auto, 0, 90, 180 or 270)\n", val);
+                    return NO;
+                }
+                opt->rotate = (int)deg;
+            }
+            i++;
+        } else if (strcmp(arg, "--format") == 0 && val) {
+            if (strcmp(val, "jpeg") == 0 || strcmp(val, "jpg") == 0) opt->jpeg = YES;
+            else if (strcmp(val, "png") == 0) opt->jpeg = NO;
+            else { fprintf(stderr, "Unknown --format '%s' (png or jpeg)\n", val); return NO; }
+            i++;
+        } else if (strcmp(arg, "--quality") == 0 && val) {
+            opt->quality = atoi(val);
+            if (opt->quality < 1 || opt->quality > 100) {
+                fprintf(stderr, "--quality must be 1-100\n");
+                return NO;
+            }
+            i++;
+        } else {
+            fprintf(stderr, "Unknown option '%s'\n", arg);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+// Crop, downscale, rotate and encode one BGRA frame. orientation is the
+// guest's UIInterfaceOrientation (0 = unknown) for --rotate auto.
+// Returns 0 on success.
+static int encode_frame(const uint8_t *base, int w, int h, size_t bpr, uint32_t orientation,
+                        const EncodeOptions *opt, const char *path) {
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    if (opt->crop) {
+        if (opt->x + opt->w > w || opt->y + opt->h > h) {
+            fprintf(stderr, "--rect %d,%d,%d,%d is outside the %dx%d framebuffer\n",
+                    opt->x, opt->y, opt->w, opt->h, w, h);
+            return 1;
+        }
+        base += (size_t)opt->y * bpr + (size_t)opt->x * 4;
+        w = opt->w;
+        h = opt->h;
+    }
+
+    RSimBitmap scaled = {0};
+    if (opt->factor > 1) {
+        if (rsim_bgra_shrink(base, w, h, bpr, opt->factor, &scaled) != 0) {
+            fprintf(stderr, "Can't scale %dx%d by 1/%d\n", w, h, opt->factor);
+            return 1;
+        }
+        base = scaled.px;
+        w = scaled.width;
+        h = scaled.height;
+        bpr = scaled.bytes_per_row;
+    }
+
+    // Rotating writes the output buffer directly (from the surface when
+    // not scaled), so there is no separate copy first. It is still a pass
+    // of its own: a quarter turn costs about 3.5x a copy of the same size.
+    RSimBitmap rotated = {0};
+    int degrees = opt->rotate >= 0 ? opt->rotate : rsim_orientation_rotation((int)orientation);
+    if (degrees) {
+        if (rsim_bgra_rotate(base, w, h, bpr, degrees, &rotated) != 0) {
+            fprintf(stderr, "Can't rotate %dx%d by %d\n", w, h, degrees);
+            rsim_bitmap_free(&scaled);
+            return 1;
+        }
+        base = rotated.px;
+        w = rotated.width;
+        h = rotated.height;
+        bpr = rotated.bytes_per_row;
+    }
+
+    int ret = 1;
+    size_t size = 0;
+    if (opt->jpeg) {
+        uint8_t *jpeg = NULL;
+        if (rsim_jpeg_encode_bgra(base, w, h, bpr, opt->quality, &jpeg, &size) == 0) {
+            FILE *f = fopen(path, "wb");
+            if (f) {
+                ret = fwrite(jpeg, 1, size, f) == size ? 0 : 1;
+                if (fclose(f) != 0) ret = 1;
+            }
+            if (ret) fprintf(stderr, "Can't write %s\n", path);
+            free(jpeg);
+        } else {
+            fprintf(stderr, "JPEG encode failed\n");
+        }
+    } else {
+        CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+        CGContextRef ctx = CGBitmapContextCreate((void *)base, w, h, 8, bpr, cs,
+            kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+        CGImageRef img = ctx ? CGBitmapContextCreateImage(ctx) : NULL;
+        if (img) {
+            ret = write_png(img, path);
+            CGImageRelease(img);
+        } else {
+            fprintf(stderr, "Can't create context\n");
+        }
+        if (ctx) CGContextRelease(ctx);
+        CGColorSpaceRelease(cs);
+        struct stat st;
+        if (!ret && stat(path, &st) == 0) size = (size_t)st.st_size;
+    }
+    rsim_bitmap_free(&scaled);
+    rsim_bitmap_free(&rotated);
+
+    if (!ret)
+        fprintf(stderr, "Encoded %dx%d %s, %zu bytes in %.1fms\n", w, h,
+                opt->jpeg ? "JPEG" : "PNG", size, (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e6);
+    return ret;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <surface_id> <output.png>\n", argv[0]);
-        fprintf(stderr, "   or: %s --raw <raw_file> <width> <height> <bpr> <output.png>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <surface_id> <output.png> [options]\n", argv[0]);
+        fprintf(stderr, "   or: %s --fb <frame.fb> <output.png> [options]\n", argv[0]);
+        fprintf(stderr, "   or: %s --raw <raw_file> <width> <height> <bpr> <output.png> [options]\n", argv[0]);
+        fprintf(stderr, "Options: --rect x,y,w,h  --scale 0.5|0.25  --rotate auto|0|90|180|270"
+                        "  --format png|jpeg  --quality N\n");
         return 1;
     }
     @autoreleasepool {
-        CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
-        uint32_t bitmapInfo = kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst;
+        EncodeOptions opt;
+
+        if (strcmp(argv[1], "--fb") == 0 && argc >= 4) {
+            // Frame file mode: dims and stride from the header, pixels copied out
+            // under its seqlock (the daemon rewrites ring files in place)
+            if (!parse_options(argc, argv, 4, argv[3], &opt)) return 1;
+            RSimFBFrame frame = {0};
+            int err = rsim_fb_read(argv[2], &frame, 0, 1);
+            if (err != RSIM_FB_OK) {
+                fprintf(stderr, "Can't read %s: %s\n", argv[2], rsim_fb_strerror(err));
+                rsim_fb_frame_free(&frame);
+                return 1;
+            }
+            const RSimFBHeader *h = &frame.header;
+            int ret = encode_frame(frame.pixels, (int)h->width, (int)h->height, h->bytes_per_row,
+                                   h->orientation, &opt, argv[3]);
+            if (!ret) fprintf(stderr, "Wrote %s (%ux%u) from frame %llu\n", argv[3], h->width, h->height,
+                              (unsigned long long)h->sequence);
+            rsim_fb_frame_free(&frame);
+            return ret;
+        }
 
         if (strcmp(argv[1], "--raw") == 0 && argc >= 7) {
             // Raw file mode
-            NSData *data = [NSData dataWithContentsOfFile:[NSString stringWithUTF8String:argv[2]]];
+            if (!parse_options(argc, argv, 7, argv[6], &opt)) return 1;
+            NSData *data = [NSData dataWithContentsOfFile:[NSString stringWithUTF8String:argv[2]]
+                                                  options:NSDataReadingMappedIfSafe error:nil];
             if (!data) { fprintf(stderr, "Can't read %s\n", argv[2]); return 1; }
             int w = atoi(argv[3]), h = atoi(argv[4]), bpr = atoi(argv[5]);
-            CGContextRef ctx = CGBitmapContextCreate((void *)data.bytes, w, h, 8, bpr, cs, bitmapInfo);
-            if (!ctx) { fprintf(stderr, "Can't create context\n"); return 1; }
-            CGImageRef img = CGBitmapContextCreateImage(ctx);
-            int ret = write_png(img, argv[6]);
-            CGImageRelease(img); CGContextRelease(ctx); CGColorSpaceRelease(cs);
+            if (w < 1 || h < 1 || bpr < w * 4 || data.length < (size_t)bpr * h) {
+                fprintf(stderr, "%s is too small for %dx%d (bpr %d)\n", argv[2], w, h, bpr);
+                return 1;
+            }
+            int ret = encode_frame(data.bytes, w, h, (size_t)bpr, 0, &opt, argv[6]);
             if (!ret) fprintf(stderr, "Wrote %s (%dx%d)\n", argv[6], w, h);
             return ret;
         }
 
         // IOSurface mode
+        if (!parse_options(argc, argv, 3, argv[2], &opt)) return 1;
         uint32_t surfaceID = (uint32_t)atoi(argv[1]);
         IOSurfaceRef surface = IOSurfaceLookup(surfaceID);
         if (!surface) {
             fprintf(stderr, "IOSurfaceLookup(%u) failed — surface not found or not global\n", surfaceID);
             return 1;
         }
+        surface = resolve_front_surface(surface);
 
+        // Crop/scale/encode straight from the locked surface — no full-frame copy
         IOSurfaceLock(surface, kIOSurfaceLockReadOnly, NULL);
         int w = (int)IOSurfaceGetWidth(surface);
         int h = (int)IOSurfaceGetHeight(surface);
-        int bpr = (int)IOSurfaceGetBytesPerRow(surface);
-        void *base = IOSurfaceGetBaseAddress(surface);
-
-        CGContextRef ctx = CGBitmapContextCreate(base, w, h, 8, bpr, cs, bitmapInfo);
-        CGImageRef img = CGBitmapContextCreateImage(ctx);
+        size_t bpr = IOSurfaceGetBytesPerRow(surface);
+        uint32_t orientation = surface_u32_value(surface, CFSTR(ROSETTASIM_SFB_ORIENTATION_KEY));
+        int ret = encode_frame(IOSurfaceGetBaseAddress(surface), w, h, bpr, orientation, &opt, argv[2]);
         IOSurfaceUnlock(surface, kIOSurfaceLockReadOnly, NULL);
 
-        int ret = write_png(img, argv[2]);
-        CGImageRelease(img); CGContextRelease(ctx);
-        CGColorSpaceRelease(cs); CFRelease(surface);
-
-        if (!ret) fprintf(stderr, "Wrote %s (%dx%d) from IOSurface %u\n", argv[2], w, h, surfaceID);
+        if (!ret) fprintf(stderr, "Wrote %s (%dx%d) from IOSurface %u\n", argv[2], w, h, IOSurfaceGetID(surface));
+        CFRelease(surface);
         return ret;
     }
 }
@@ -72,55 +72,96 @@ static void resolve_iohid_functions(void) {
  * mach_msg_header_t (24 bytes) + IndigoHIDMessageStruct
  * IndigoHIDMessageStruct has event data at offset +8 from header end */
 
-static void hid_receive_handler(void) {
-    struct {
-        mach_msg_header_t header;
-        uint8_t payload[4096];
-    } msg;
-    memset(&msg, 0, sizeof(msg));
-
-    kern_return_t kr = mach_msg(&msg.header, MACH_RCV_MSG | MACH_RCV_TIMEOUT,
-                                0, sizeof(msg), g_hid_recv_port,
-                                0, MACH_PORT_NULL);
-    if (kr != KERN_SUCCESS) return;
-
-    static int recv_count = 0;
-    recv_count++;
-    if (recv_count <= 10) {
-        hid_log("[HID-backport] HID msg #%d: id=%d size=%d",
-                recv_count, msg.header.msgh_id, msg.header.msgh_size);
+typedef struct {
+    mach_msg_header_t header;
+    uint8_t payload[4096];
+} HIDMessage;
+
+/* The dispatch source coalesces wakeups during fast drags, so each wakeup
+ * drains everything pending into this batch (serial queue — static is safe). */
+#define HID_BATCH_MAX 32
+static HIDMessage g_hid_batch[HID_BATCH_MAX];
+
+/* Event bytes are copied into one reusable CFData instead of allocating a
+ * wrapper per event. Replaced only if IOHIDEventCreateWithData kept a ref. */
+static CFMutableDataRef g_event_data = NULL;
+
+static int g_recv_count = 0;
+static int g_max_depth = 0;
+
+static void dispatch_hid_message(HIDMessage *msg) {
+    if (!g_create_event || !g_dispatch_event || !g_hid_client) return;
+
+    uint32_t payload_size = msg->header.msgh_size - sizeof(mach_msg_header_t);
+    if (payload_size <= 8 || payload_size > sizeof(msg->payload)) return;
+
+    if (!g_event_data)
+        g_event_data = CFDataCreateMutable(NULL, sizeof(msg->payload));
+    if (!g_event_data) return;
+
+    /* The event data starts after the IndigoHID header (8 bytes) */
+    CFDataSetLength(g_event_data, 0);
+    CFDataAppendBytes(g_event_data, msg->payload + 8, payload_size - 8);
+
+    IOHIDEventRef event = g_create_event(NULL, (void *)g_event_data, 0);
+    if (CFGetRetainCount(g_event_data) > 1) {
+        CFRelease(g_event_data);
+        g_event_data = NULL;
+    }
+    if (event) {
+        g_dispatch_event(g_hid_client, event);
+        CFRelease(event);
+        if (g_recv_count <= 10)
+            hid_log("[HID-backport] Dispatched IOHIDEvent (payload=%u)", payload_size);
     }
+}
+
+static void reply_hid_message(HIDMessage *msg) {
+    if (msg->header.msgh_remote_port == MACH_PORT_NULL) return;
+    mach_msg_header_t reply = {
+        .msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_MOVE_SEND_ONCE, 0),
+        .msgh_size = sizeof(reply),
+        .msgh_remote_port = msg->header.msgh_remote_port,
+        .msgh_local_port = MACH_PORT_NULL,
+        .msgh_id = msg->header.msgh_id
+    };
+    mach_msg_send(&reply);
+}
 
-    /* Try to create IOHIDEvent from the message payload and dispatch it */
-    if (g_create_event && g_dispatch_event && g_hid_client) {
-        uint32_t payload_size = msg.header.msgh_size - sizeof(mach_msg_header_t);
-        if (payload_size > 8) {
-            /* The event data starts after the IndigoHID header (8 bytes) */
-            CFDataRef data = CFDataCreateWithBytesNoCopy(NULL,
-                msg.payload + 8, payload_size - 8, kCFAllocatorNull);
-            if (data) {
-                IOHIDEventRef event = g_create_event(NULL, (void *)data, 0);
-                if (event) {
-                    g_dispatch_event(g_hid_client, event);
-                    CFRelease(event);
-                    if (recv_count <= 10)
-                        hid_log("[HID-backport] Dispatched IOHIDEvent (payload=%u)", payload_size);
-                }
-                CFRelease(data);
+static void hid_receive_handler(void) {
+    int depth = 0;
+    for (;;) {
+        /* Receive every pending message before dispatching any of them */
+        int n = 0;
+        while (n < HID_BATCH_MAX) {
+            HIDMessage *msg = &g_hid_batch[n];
+            kern_return_t kr = mach_msg(&msg->header, MACH_RCV_MSG | MACH_RCV_TIMEOUT,
+                                        0, sizeof(*msg), g_hid_recv_port,
+                                        0, MACH_PORT_NULL);
+            if (kr != KERN_SUCCESS) break;
+            n++;
+        }
+        if (n == 0) break;
+        depth += n;
+
+        for (int i = 0; i < n; i++) {
+            HIDMessage *msg = &g_hid_batch[i];
+            g_recv_count++;
+            if (g_recv_count <= 10) {
+                hid_log("[HID-backport] HID msg #%d: id=%d size=%d",
+                        g_recv_count, msg->header.msgh_id, msg->header.msgh_size);
             }
+            dispatch_hid_message(msg);
+            reply_hid_message(msg);
         }
+        if (n < HID_BATCH_MAX) break;  /* queue drained */
     }
 
-    /* Reply if expected */
-    if (msg.header.msgh_remote_port != MACH_PORT_NULL) {
-        mach_msg_header_t reply = {
-            .msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_MOVE_SEND_ONCE, 0),
-            .msgh_size = sizeof(reply),
-            .msgh_remote_port = msg.header.msgh_remote_port,
-            .msgh_local_port = MACH_PORT_NULL,
-            .msgh_id = msg.header.msgh_id
-        };
-        mach_msg_send(&reply);
+    if (depth > g_max_depth) {
+        g_max_depth = depth;
+        if (depth > 1)
+            hid_log("[HID-backport] queue depth high-water mark: %d msgs/wakeup (total=%d)",
+                    depth, g_recv_count);
     }
 }
 
@@ -128,18 +169,22 @@ static void hid_receive_handler(void) {
  * Replacement IndigoHIDSystemSpawnLoopback (DYLD interpose target)
  * ================================================================ */
 
-/* Helper: append line to log file (safe to call before constructors) */
+/* Helper: append line to log file (safe to call before constructors).
+ * The fd is opened once and kept — this runs on the HID receive path. */
 static void hid_log(const char *fmt, ...) {
-    int fd = open("/tmp/rosettasim_hid_backport.txt", O_WRONLY | O_CREAT | O_APPEND, 0644);
+    static int fd = -1;
+    if (fd < 0)
+        fd = open("/tmp/rosettasim_hid_backport.txt", O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
     if (fd < 0) return;
     char buf[512];
     va_list ap;
     va_start(ap, fmt);
-    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    int len = vsnprintf(buf, sizeof(buf) - 1, fmt, ap);
     va_end(ap);
+    if (len < 0) return;
+    if (len > (int)sizeof(buf) - 2) len = (int)sizeof(buf) - 2;
+    buf[len++] = '\n';
     write(fd, buf, len);
-    write(fd, "\n", 1);
-    close(fd);
 }
 
 static bool hook_SpawnLoopback(void *hidSystem) {
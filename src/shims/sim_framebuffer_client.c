@@ -0,0 +1,418 @@
+/*
+ * sim_framebuffer_client.c — SimFramebufferClient replacement backed by rosettasim_daemon
+ *
+ * Problem: sim_framebuffer_stub.c makes every SFB* entry point fail, so iOS
+ * 13.7/14.5 backboardd falls back to PurpleFB. That path maps the whole
+ * framebuffer through a memory entry and the daemon memcpys it into the read
+ * surface on every flush.
+ *
+ * Fix: Implement the SFB connection/display/swapchain entry points against the
+ * daemon. On connect the daemon hands over two IOSurfaces; backboardd renders
+ * into the back buffer and SFBSwapchainSwapSubmit presents it, transferring
+ * ownership to the daemon without a copy (protocol: common/rosettasim_sfb.h).
+ *
+ * Fallback: if the daemon doesn't answer the SFB connect message (old daemon,
+ * no PurpleFBServer registered), SFBConnectionCreate returns NULL exactly like
+ * the stub, and QuartzCore falls back to PurpleFBServer.
+ *
+ * The SimFramebufferClient API is private; the signatures below are the subset
+ * QuartzCore's display detection and swapchain path call, reconstructed from the
+ * iOS 13/14 simulator runtimes. Entry points we don't serve keep the stub's
+ * failure returns.
+ *
+ * Build (from src/):
+ *   clang -arch x86_64 -dynamiclib -I. -o build/SimFramebufferClient_rosettasim \
+ *     shims/sim_framebuffer_client.c \
+ *     -framework CoreFoundation -framework CoreGraphics -framework IOSurface \
+ *     -install_name /System/Library/PrivateFrameworks/SimFramebufferClient.framework/SimFramebufferClient \
+ *     -target x86_64-apple-ios13.0-simulator \
+ *     -isysroot $(xcrun --show-sdk-path --sdk iphonesimulator)
+ */
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <CoreGraphics/CGGeometry.h>
+#include <IOSurface/IOSurface.h>
+#include <mach/mach.h>
+#include <servers/bootstrap.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common/rosettasim_sfb.h"
+
+#define SFB_CONNECT_TIMEOUT_MS  2000
+#define SFB_PRESENT_TIMEOUT_MS  1000
+
+/* ================================================================
+ * CoreFoundation runtime glue (private CFRuntime.h, version 0 class)
+ * ================================================================ */
+
+typedef struct {
+    uintptr_t _cfisa;
+    uint8_t   _cfinfo[4];
+    uint32_t  _rc;
+} SFBRuntimeBase;
+
+typedef struct {
+    CFIndex version;
+    const char *className;
+    void (*init)(CFTypeRef cf);
+    CFTypeRef (*copy)(CFAllocatorRef allocator, CFTypeRef cf);
+    void (*finalize)(CFTypeRef cf);
+    Boolean (*equal)(CFTypeRef cf1, CFTypeRef cf2);
+    CFHashCode (*hash)(CFTypeRef cf);
+    CFStringRef (*copyFormattingDesc)(CFTypeRef cf, CFDictionaryRef formatOptions);
+    CFStringRef (*copyDebugDesc)(CFTypeRef cf);
+} SFBRuntimeClass;
+
+extern CFTypeID _CFRuntimeRegisterClass(const SFBRuntimeClass *cls);
+extern CFTypeRef _CFRuntimeCreateInstance(CFAllocatorRef allocator, CFTypeID typeID,
+                                          CFIndex extraBytes, unsigned char *category);
+
+#define SFB_EXTRA_BYTES(T) ((CFIndex)(sizeof(T) - sizeof(SFBRuntimeBase)))
+
+/* ================================================================
+ * Object layouts
+ * ================================================================ */
+
+typedef struct SFBConnection {
+    SFBRuntimeBase  base;
+    mach_port_t     server;         /* daemon's PurpleFBServer port (send right) */
+    mach_port_t     reply;          /* our receive right for replies */
+    CFArrayRef      displays;
+} SFBConnection;
+
+typedef struct SFBDisplay {
+    SFBRuntimeBase  base;
+    mach_port_t     server;         /* copied from the connection, not owned */
+    mach_port_t     reply;
+    uint32_t        width;
+    uint32_t        height;
+    uint32_t        stride;
+    uint32_t        pixel_format;
+    double          scale;
+    IOSurfaceRef    surfaces[ROSETTASIM_SFB_BUFFER_COUNT];
+    uint32_t        back_index;
+    uint32_t        frame;
+    pthread_mutex_t lock;           /* serializes present round-trips */
+} SFBDisplay;
+
+typedef struct SFBSwapchain {
+    SFBRuntimeBase  base;
+    SFBDisplay     *display;        /* retained */
+    int             pending;        /* a surface was added since SwapBegin */
+    CGRect          dirty;
+} SFBSwapchain;
+
+static CFTypeID g_conn_type, g_display_type, g_swapchain_type;
+static pthread_once_t g_types_once = PTHREAD_ONCE_INIT;
+
+static void sfb_log(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[sfb] ");
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+static void conn_finalize(CFTypeRef cf) {
+    SFBConnection *c = (SFBConnection *)cf;
+    if (c->displays) CFRelease(c->displays);
+    if (c->server != MACH_PORT_NULL) mach_port_deallocate(mach_task_self(), c->server);
+    if (c->reply != MACH_PORT_NULL)
+        mach_port_mod_refs(mach_task_self(), c->reply, MACH_PORT_RIGHT_RECEIVE, -1);
+}
+
+static void display_finalize(CFTypeRef cf) {
+    SFBDisplay *d = (SFBDisplay *)cf;
+    for (int i = 0; i < ROSETTASIM_SFB_BUFFER_COUNT; i++)
+        if (d->surfaces[i]) CFRelease(d->surfaces[i]);
+    pthread_mutex_destroy(&d->lock);
+}
+
+static void swapchain_finalize(CFTypeRef cf) {
+    SFBSwapchain *s = (SFBSwapchain *)cf;
+    if (s->display) CFRelease((CFTypeRef)s->display);
+}
+
+static const SFBRuntimeClass g_conn_class = {
+    0, "SFBConnection", NULL, NULL, conn_finalize, NULL, NULL, NULL, NULL };
+static const SFBRuntimeClass g_display_class = {
+    0, "SFBDisplay", NULL, NULL, display_finalize, NULL, NULL, NULL, NULL };
+static const SFBRuntimeClass g_swapchain_class = {
+    0, "SFBSwapchain", NULL, NULL, swapchain_finalize, NULL, NULL, NULL, NULL };
+
+static void register_types(void) {
+    g_conn_type = _CFRuntimeRegisterClass(&g_conn_class);
+    g_display_type = _CFRuntimeRegisterClass(&g_display_class);
+    g_swapchain_type = _CFRuntimeRegisterClass(&g_swapchain_class);
+}
+
+static CFTypeRef create_instance(CFAllocatorRef allocator, CFTypeID type, CFIndex extra) {
+    pthread_once(&g_types_once, register_types);
+    return _CFRuntimeCreateInstance(allocator, type, extra, NULL);
+}
+
+/* ================================================================
+ * Daemon handshake
+ * ================================================================ */
+
+static SFBDisplay *connect_display(CFAllocatorRef allocator, mach_port_t server, mach_port_t reply_port) {
+    union {
+        RosettaSimSFBConnect      req;
+        RosettaSimSFBConnectReply reply;
+        uint8_t                   raw[sizeof(RosettaSimSFBConnectReply) + MAX_TRAILER_SIZE];
+    } m;
+    memset(&m, 0, sizeof(m));
+    m.req.header.msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MAKE_SEND_ONCE);
+    m.req.header.msgh_size = sizeof(m.req);
+    m.req.header.msgh_remote_port = server;
+    m.req.header.msgh_local_port = reply_port;
+    m.req.header.msgh_id = ROSETTASIM_SFB_MSG_CONNECT;
+    m.req.client_version = 1;
+
+    kern_return_t kr = mach_msg(&m.req.header,
+                                MACH_SEND_MSG | MACH_RCV_MSG | MACH_SEND_TIMEOUT | MACH_RCV_TIMEOUT,
+                                sizeof(m.req), sizeof(m), reply_port,
+                                SFB_CONNECT_TIMEOUT_MS, MACH_PORT_NULL);
+    if (kr != KERN_SUCCESS) {
+        sfb_log("connect: no reply from daemon (kr=0x%x) — falling back to PurpleFB", kr);
+        return NULL;
+    }
+    if (m.reply.header.msgh_id != ROSETTASIM_SFB_MSG_CONNECT + ROSETTASIM_SFB_REPLY_OFFSET ||
+        !(m.reply.header.msgh_bits & MACH_MSGH_BITS_COMPLEX) ||
+        m.reply.body.msgh_descriptor_count != ROSETTASIM_SFB_BUFFER_COUNT) {
+        /* Pre-SFB daemon answers unknown ids with an empty reply */
+        sfb_log("connect: daemon does not speak SFB (reply id=%d) — falling back to PurpleFB",
+                m.reply.header.msgh_id);
+        mach_msg_destroy(&m.reply.header);
+        return NULL;
+    }
+
+    SFBDisplay *d = (SFBDisplay *)create_instance(allocator, g_display_type,
+                                                  SFB_EXTRA_BYTES(SFBDisplay));
+    if (!d) {
+        mach_msg_destroy(&m.reply.header);
+        return NULL;
+    }
+    d->server = server;
+    d->reply = reply_port;
+    d->width = m.reply.width;
+    d->height = m.reply.height;
+    d->stride = m.reply.stride;
+    d->pixel_format = m.reply.pixel_format;
+    d->scale = m.reply.scale_milli / 1000.0;
+    d->back_index = m.reply.back_index % ROSETTASIM_SFB_BUFFER_COUNT;
+    pthread_mutex_init(&d->lock, NULL);
+
+    for (int i = 0; i < ROSETTASIM_SFB_BUFFER_COUNT; i++) {
+        mach_port_t sp = m.reply.surfaces[i].name;
+        d->surfaces[i] = IOSurfaceLookupFromMachPort(sp);
+        mach_port_deallocate(mach_task_self(), sp);
+        if (!d->surfaces[i]) {
+            sfb_log("connect: IOSurfaceLookupFromMachPort failed for buffer %d", i);
+            CFRelease((CFTypeRef)d);
+            return NULL;
+        }
+    }
+
+    sfb_log("connected: %ux%u stride=%u scale=%.1f surfaces=%u,%u",
+            d->width, d->height, d->stride, d->scale,
+            IOSurfaceGetID(d->surfaces[0]), IOSurfaceGetID(d->surfaces[1]));
+    return d;
+}
+
+/* Present the back buffer; on success the daemon owns it and returns the next back index. */
+static bool present_display(SFBDisplay *d, CGRect dirty) {
+    union {
+        RosettaSimSFBPresent      req;
+        RosettaSimSFBPresentReply reply;
+        uint8_t                   raw[sizeof(RosettaSimSFBPresentReply) + MAX_TRAILER_SIZE];
+    } m;
+
+    pthread_mutex_lock(&d->lock);
+    memset(&m, 0, sizeof(m));
+    m.req.header.msgh_bits = MACH_MSGH_BITS(MACH_MSG_TYPE_COPY_SEND, MACH_MSG_TYPE_MAKE_SEND_ONCE);
+    m.req.header.msgh_size = sizeof(m.req);
+    m.req.header.msgh_remote_port = d->server;
+    m.req.header.msgh_local_port = d->reply;
+    m.req.header.msgh_id = ROSETTASIM_SFB_MSG_PRESENT;
+    m.req.index = d->back_index;
+    if (CGRectIsNull(dirty) || CGRectIsEmpty(dirty)) {
+        m.req.dirty_w = d->width;
+        m.req.dirty_h = d->height;
+    } else {
+        m.req.dirty_x = (uint32_t)dirty.origin.x;
+        m.req.dirty_y = (uint32_t)dirty.origin.y;
+        m.req.dirty_w = (uint32_t)dirty.size.width;
+        m.req.dirty_h = (uint32_t)dirty.size.height;
+    }
+
+    kern_return_t kr = mach_msg(&m.req.header,
+                                MACH_SEND_MSG | MACH_RCV_MSG | MACH_SEND_TIMEOUT | MACH_RCV_TIMEOUT,
+                                sizeof(m.req), sizeof(m), d->reply,
+                                SFB_PRESENT_TIMEOUT_MS, MACH_PORT_NULL);
+    bool ok = (kr == KERN_SUCCESS &&
+               m.reply.header.msgh_id == ROSETTASIM_SFB_MSG_PRESENT + ROSETTASIM_SFB_REPLY_OFFSET);
+    if (ok) {
+        d->back_index = m.reply.back_index % ROSETTASIM_SFB_BUFFER_COUNT;
+        d->frame = m.reply.frame;
+    } else if (d->frame < 10 || d->frame % 500 == 0) {
+        sfb_log("present failed (kr=0x%x) frame=%u", kr, d->frame);
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+/* ================================================================
+ * Connection
+ * ================================================================ */
+
+CFTypeID SFBConnectionGetTypeID(void) {
+    pthread_once(&g_types_once, register_types);
+    return g_conn_type;
+}
+
+void *SFBConnectionCreate(CFAllocatorRef allocator, CFStringRef name) {
+    mach_port_t server = MACH_PORT_NULL;
+    kern_return_t kr = bootstrap_look_up(bootstrap_port, "PurpleFBServer", &server);
+    if (kr != KERN_SUCCESS || server == MACH_PORT_NULL) {
+        sfb_log("PurpleFBServer lookup failed (kr=0x%x) — falling back", kr);
+        return NULL;
+    }
+
+    mach_port_t reply = MACH_PORT_NULL;
+    mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE, &reply);
+
+    SFBDisplay *display = connect_display(allocator, server, reply);
+    if (!display) {
+        mach_port_deallocate(mach_task_self(), server);
+        mach_port_mod_refs(mach_task_self(), reply, MACH_PORT_RIGHT_RECEIVE, -1);
+        return NULL;
+    }
+
+    SFBConnection *c = (SFBConnection *)create_instance(allocator, g_conn_type,
+                                                        SFB_EXTRA_BYTES(SFBConnection));
+    if (!c) {
+        CFRelease((CFTypeRef)display);
+        mach_port_deallocate(mach_task_self(), server);
+        mach_port_mod_refs(mach_task_self(), reply, MACH_PORT_RIGHT_RECEIVE, -1);
+        return NULL;
+    }
+    c->server = server;
+    c->reply = reply;
+    const void *items[1] = { display };
+    c->displays = CFArrayCreate(allocator, items, 1, &kCFTypeArrayCallBacks);
+    CFRelease((CFTypeRef)display);
+    return c;
+}
+
+/* The handshake already happened in Create; nothing left to do. */
+bool SFBConnectionConnect(void *conn, CFErrorRef *error) {
+    if (error) *error = NULL;
+    return conn != NULL;
+}
+
+CFArrayRef SFBConnectionCopyDisplays(void *conn, CFErrorRef *error) {
+    if (error) *error = NULL;
+    SFBConnection *c = (SFBConnection *)conn;
+    if (!c || !c->displays) return NULL;
+    return CFRetain(c->displays);
+}
+
+void SFBConnectionInvalidate(void *conn) {
+    SFBConnection *c = (SFBConnection *)conn;
+    if (!c) return;
+    if (c->displays) { CFRelease(c->displays); c->displays = NULL; }
+}
+
+/* ================================================================
+ * Display
+ * ================================================================ */
+
+CFTypeID SFBDisplayGetTypeID(void) {
+    pthread_once(&g_types_once, register_types);
+    return g_display_type;
+}
+
+/* Displays only come from SFBConnectionCopyDisplays */
+void *SFBDisplayCreate(CFAllocatorRef allocator, CFDictionaryRef props) { return NULL; }
+
+uint32_t SFBDisplayGetID(void *display) { return display ? 1 : 0; }
+
+CGSize SFBDisplayGetDeviceSize(void *display) {
+    SFBDisplay *d = (SFBDisplay *)display;
+    return d ? CGSizeMake(d->width, d->height) : CGSizeZero;
+}
+
+CGSize SFBDisplayGetCanvasSize(void *display) {
+    return SFBDisplayGetDeviceSize(display);
+}
+
+double SFBDisplayGetScale(void *display) {
+    SFBDisplay *d = (SFBDisplay *)display;
+    return d ? d->scale : 1.0;
+}
+
+uint32_t SFBDisplayGetPixelFormat(void *display) {
+    SFBDisplay *d = (SFBDisplay *)display;
+    return d ? d->pixel_format : 0;
+}
+
+uint32_t SFBDisplayGetMaxLayerCount(void *display) { return 1; }
+
+/* ================================================================
+ * Swapchain — ownership of the back buffer moves to the daemon on submit
+ * ================================================================ */
+
+CFTypeID SFBSwapchainGetTypeID(void) {
+    pthread_once(&g_types_once, register_types);
+    return g_swapchain_type;
+}
+
+void *SFBSwapchainCreate(CFAllocatorRef allocator, void *display, CFDictionaryRef options) {
+    if (!display) return NULL;
+    SFBSwapchain *s = (SFBSwapchain *)create_instance(allocator, g_swapchain_type,
+                                                      SFB_EXTRA_BYTES(SFBSwapchain));
+    if (!s) return NULL;
+    s->display = (SFBDisplay *)CFRetain(display);
+    s->dirty = CGRectNull;
+    return s;
+}
+
+/* Returns the surface the caller may render into (not retained). */
+IOSurfaceRef SFBSwapchainAcquireSurface(void *swapchain) {
+    SFBSwapchain *s = (SFBSwapchain *)swapchain;
+    if (!s) return NULL;
+    SFBDisplay *d = s->display;
+    pthread_mutex_lock(&d->lock);
+    IOSurfaceRef surface = d->surfaces[d->back_index];
+    pthread_mutex_unlock(&d->lock);
+    return surface;
+}
+
+bool SFBSwapchainSwapBegin(void *swapchain) {
+    SFBSwapchain *s = (SFBSwapchain *)swapchain;
+    if (!s) return false;
+    s->pending = 0;
+    s->dirty = CGRectNull;
+    return true;
+}
+
+bool SFBSwapchainSwapAddSurface(void *swapchain, IOSurfaceRef surface, CGRect dirty) {
+    SFBSwapchain *s = (SFBSwapchain *)swapchain;
+    if (!s) return false;
+    s->pending = 1;
+    s->dirty = CGRectUnion(s->dirty, dirty);
+    return true;
+}
+
+bool SFBSwapchainSwapSubmit(void *swapchain) {
+    SFBSwapchain *s = (SFBSwapchain *)swapchain;
+    if (!s || !s->pending) return false;
+    s->pending = 0;
+    return present_display(s->display, s->dirty);
+}
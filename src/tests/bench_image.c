@@ -0,0 +1,71 @@
+/*
+ * bench_image.c — Rotation cost against a plain copy of the same frame
+ *
+ * Rotates a width x height BGRA frame by 90, 180 and 270 degrees and copies
+ * it (one memcpy of the whole frame, the cost a rotation is held to),
+ * interleaved, and
+ * prints the median and best of each over the runs and their ratio to the
+ * copy. Built at -O2 by `make bench`; not part of `make test`, since timings
+ * on a shared machine aren't something to assert on.
+ *
+ * Usage: build/tests/bench_image [width height [runs]]   (default 2048 2732 41)
+ */
+
+#include "common/rosettasim_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int by_value(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv) {
+    int w = argc > 2 ? atoi(argv[1]) : 2048;
+    int h = argc > 2 ? atoi(argv[2]) : 2732;
+    int runs = argc > 3 ? atoi(argv[3]) : 41;
+    if (w < 1 || h < 1 || runs < 1) {
+        fprintf(stderr, "Usage: %s [width height [runs]]\n", argv[0]);
+        return 1;
+    }
+    size_t bpr = (size_t)w * 4, size = bpr * h;
+    uint8_t *src = malloc(size), *dst = malloc(size);
+    double *ms[4];
+    if (!src || !dst) return 1;
+    for (size_t i = 0; i < size; i++) src[i] = (uint8_t)(i * 7 + (i >> 12));
+    memset(dst, 0, size);
+    for (int a = 0; a < 4; a++) ms[a] = calloc(runs, sizeof(double));
+
+    for (int a = 0; a < 4; a++) {
+        for (int r = 0; r < runs; r++) {
+            double t0 = now_ms();
+            if (a == 0) memcpy(dst, src, size);
+            else        rsim_bgra_rotate_into(src, w, h, bpr, a * 90, dst, a == 2 ? bpr : (size_t)h * 4);
+            ms[a][r] = now_ms() - t0;
+        }
+    }
+
+    printf("%dx%d BGRA, %d runs\n", w, h, runs);
+    double copy = 0;
+    for (int a = 0; a < 4; a++) {
+        qsort(ms[a], runs, sizeof(double), by_value);
+        double median = ms[a][runs / 2];
+        if (a == 0) copy = median;
+        printf("  %-8s median %6.2f ms  best %6.2f ms  %.2fx copy\n",
+               a == 0 ? "copy" : a == 1 ? "rot 90" : a == 2 ? "rot 180" : "rot 270",
+               median, ms[a][0], median / copy);
+        free(ms[a]);
+    }
+    free(src);
+    free(dst);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * rsim_test.h — Assertions and scratch directories for the core tests
+ *
+ * Each tests/test_<core>.c is a standalone program that exercises one
+ * portable C core from common/. `make test` builds them for the host with
+ * its own compiler and runs them; they need no Apple frameworks, so they
+ * run on Linux too. A failed CHECK prints its location and the test
+ * carries on; the exit status is the number of failures.
+ */
+
+#ifndef ROSETTASIM_TEST_H
+#define ROSETTASIM_TEST_H
+
+#define _GNU_SOURCE
+#include <ftw.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int g_test_checks, g_test_failures;
+
+#define CHECK(cond) do { \
+    g_test_checks++; \
+    if (!(cond)) { \
+        g_test_failures++; \
+        fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+} while (0)
+
+#define CHECK_INT(a, b) do { \
+    long long _a = (long long)(a), _b = (long long)(b); \
+    g_test_checks++; \
+    if (_a != _b) { \
+        g_test_failures++; \
+        fprintf(stderr, "%s:%d: %s == %lld, expected %s == %lld\n", \
+                __FILE__, __LINE__, #a, _a, #b, _b); \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a, b, eps) do { \
+    double _a = (double)(a), _b = (double)(b); \
+    g_test_checks++; \
+    if (!(_a >= _b - (eps) && _a <= _b + (eps))) { \
+        g_test_failures++; \
+        fprintf(stderr, "%s:%d: %s == %.9g, expected %.9g ± %g\n", \
+                __FILE__, __LINE__, #a, _a, _b, (double)(eps)); \
+    } \
+} while (0)
+
+#define CHECK_STR(a, b) do { \
+    const char *_a = (a), *_b = (b); \
+    g_test_checks++; \
+    if (!_a || strcmp(_a, _b) != 0) { \
+        g_test_failures++; \
+        fprintf(stderr, "%s:%d: %s == \"%s\", expected \"%s\"\n", \
+                __FILE__, __LINE__, #a, _a ? _a : "(null)", _b); \
+    } \
+} while (0)
+
+/* Run one test function with a banner */
+#define RUN(fn) do { \
+    int _before = g_test_failures; \
+    fn(); \
+    printf("  %-40s %s\n", #fn, g_test_failures == _before ? "ok" : "FAILED"); \
+} while (0)
+
+static inline int test_report(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, g_test_checks, g_test_failures);
+    return g_test_failures ? 1 : 0;
+}
+
+/* ---- Scratch files ---- */
+
+static int test_rm_one(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st; (void)ftw;
+    if (flag == FTW_DP || flag == FTW_D) chmod(path, 0755);    /* read-only fixtures */
+    return remove(path);
+}
+
+static inline void test_rmtree(const char *path) {
+    nftw(path, test_rm_one, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Fresh directory under $TMPDIR (or /tmp), removed by test_rmtree */
+static inline void test_tmpdir(char *out, size_t size, const char *tag) {
+    const char *base = getenv("TMPDIR");
+    snprintf(out, size, "%s/rsim_test_%s_XXXXXX", base && *base ? base : "/tmp", tag);
+    if (!mkdtemp(out)) {
+        perror(out);
+        exit(2);
+    }
+}
+
+static inline int test_write_file(const char *path, const void *data, size_t len) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    size_t n = fwrite(data, 1, len, f);
+    return fclose(f) == 0 && n == len ? 0 : -1;
+}
+
+/* Whole file, NUL-terminated; caller frees. NULL if unreadable. */
+static inline char *test_read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)n + 1);
+    if (buf && fread(buf, 1, (size_t)n, f) != (size_t)n) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    if (buf) {
+        buf[n] = '\0';
+        if (len) *len = (size_t)n;
+    }
+    return buf;
+}
+
+#endif /* ROSETTASIM_TEST_H */
@@ -0,0 +1,254 @@
+/*
+ * test_archive.c — Capped zip writer: entries, tails, failures, the cap, the manifest
+ *
+ * Archives are checked with unzip(1) (`unzip -t`, `unzip -p`) when it is
+ * installed; without it only the writer's own accounting is checked.
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_archive.h"
+
+#include <sys/wait.h>
+
+static char g_root[512];
+static int g_have_unzip;
+
+/* Bytes that don't deflate */
+static void *noise(size_t len, unsigned seed) {
+    unsigned char *p = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        p[i] = (unsigned char)(seed >> 16);
+    }
+    return p;
+}
+
+/* Output of `unzip <opts> zip [member]` (caller frees), exit status in *status */
+static char *unzip(const char *opts, const char *zip, const char *member, size_t *len, int *status) {
+    char cmd[1200];
+    snprintf(cmd, sizeof(cmd), "unzip %s '%s' %s%s%s 2>&1", opts, zip,
+             member ? "'" : "", member ? member : "", member ? "'" : "");
+    FILE *p = popen(cmd, "r");
+    if (!p) return NULL;
+    size_t cap = 1 << 16, n = 0, got;
+    char *out = malloc(cap);
+    while ((got = fread(out + n, 1, cap - n - 1, p)) > 0) {
+        n += got;
+        if (n + 1 == cap) out = realloc(out, cap *= 2);
+    }
+    out[n] = '\0';
+    int rc = pclose(p);
+    if (len) *len = n;
+    if (status) *status = WIFEXITED(rc) ? WEXITSTATUS(rc) : -1;
+    return out;
+}
+
+static void check_unzip_clean(const char *zip) {
+    if (!g_have_unzip) return;
+    int status = -1;
+    char *out = unzip("-tq", zip, NULL, NULL, &status);
+    CHECK_INT(status, 0);
+    if (status != 0 && out) fprintf(stderr, "%s", out);
+    free(out);
+}
+
+/* The manifest line for name, or NULL. Lines are "%-9s %12lld %12lld  name". */
+#define MANIFEST_NAME_COL   (9 + 1 + 12 + 1 + 12 + 2)
+
+static const char *manifest_line(const char *manifest, const char *name) {
+    size_t n = strlen(name);
+    for (const char *line = manifest; line && *line;) {
+        const char *eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
+        if (len >= MANIFEST_NAME_COL + n && memcmp(line + MANIFEST_NAME_COL, name, n) == 0 &&
+            (len == MANIFEST_NAME_COL + n || line[MANIFEST_NAME_COL + n] == ' '))
+            return line;
+        line = eol ? eol + 1 : NULL;
+    }
+    return NULL;
+}
+
+static long long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+static void test_entries(void) {
+    char zip[600], log[600], dir[600], err[256] = "";
+    snprintf(zip, sizeof(zip), "%s/entries.zip", g_root);
+    snprintf(log, sizeof(log), "%s/daemon.log", g_root);
+    snprintf(dir, sizeof(dir), "%s/a-directory", g_root);
+    mkdir(dir, 0755);
+
+    /* A log whose last 1000 bytes are all 'z' */
+    size_t log_len = 50000;
+    char *text = malloc(log_len);
+    for (size_t i = 0; i < log_len; i++) text[i] = i < log_len - 1000 ? "line\n"[i % 5] : 'z';
+    CHECK_INT(test_write_file(log, text, log_len), 0);
+
+    RSimArchive a;
+    CHECK_INT(rsim_archive_open(&a, zip, 4, 0, 6, err, sizeof(err)), 0);
+    const char *hello = "hello, hello, hello, hello, hello\n";
+    void *bin = noise(4096, 7);
+    rsim_archive_add_data(&a, "dev/info.json", strdup(hello), strlen(hello), 1714564800);
+    void *bin_copy = malloc(4096);
+    memcpy(bin_copy, bin, 4096);
+    rsim_archive_add_data(&a, "dev/noise.bin", bin_copy, 4096, 1714564800);
+    rsim_archive_add_data(&a, "dev/empty.txt", malloc(1), 0, 1714564800);
+    rsim_archive_add_file(&a, "logs/daemon.log", log, 0);
+    rsim_archive_add_file(&a, "logs/daemon-tail.log", log, 1000);
+    rsim_archive_add_file(&a, "logs/missing.log", "/nonexistent/rsim/missing.log", 0);
+    rsim_archive_add_file(&a, "logs/dir", dir, 0);
+
+    RSimArchiveStats stats;
+    CHECK_INT(rsim_archive_close(&a, &stats), 0);
+    CHECK_INT(stats.entries, 7);
+    CHECK_INT(stats.stored, 4);
+    CHECK_INT(stats.truncated, 1);
+    CHECK_INT(stats.skipped, 0);
+    CHECK_INT(stats.failed, 2);
+    CHECK_INT(stats.bytes_in, (long long)strlen(hello) + 4096 + 0 + 50000 + 1000);
+    CHECK_INT(stats.bytes_out, file_size(zip));
+    check_unzip_clean(zip);
+
+    if (g_have_unzip) {
+        /* Contents round-trip (deflated and stored); the tail is the end */
+        size_t len = 0;
+        char *got = unzip("-p", zip, "dev/info.json", &len, NULL);
+        CHECK_STR(got, hello);
+        free(got);
+        got = unzip("-p", zip, "dev/noise.bin", &len, NULL);
+        CHECK_INT(len, 4096);
+        CHECK(got && memcmp(got, bin, 4096) == 0);
+        free(got);
+        got = unzip("-p", zip, "logs/daemon.log", &len, NULL);
+        CHECK_INT(len, log_len);
+        CHECK(got && memcmp(got, text, log_len) == 0);
+        free(got);
+        got = unzip("-p", zip, "logs/daemon-tail.log", &len, NULL);
+        CHECK_INT(len, 1000);
+        CHECK(got && strspn(got, "z") == 1000);
+        free(got);
+
+        /* The manifest accounts for every entry, the failed ones with why */
+        char *manifest = unzip("-p", zip, RSIM_ARCHIVE_MANIFEST, &len, NULL);
+        CHECK(manifest != NULL);
+        const char *names[] = { "dev/info.json", "dev/noise.bin", "dev/empty.txt", "logs/daemon.log",
+                                "logs/daemon-tail.log", "logs/missing.log", "logs/dir" };
+        const char *status[] = { "stored", "stored", "stored", "stored", "truncated", "failed", "failed" };
+        for (int i = 0; manifest && i < 7; i++) {
+            const char *line = manifest_line(manifest, names[i]);
+            CHECK(line != NULL);
+            if (line) CHECK(strncmp(line, status[i], strlen(status[i])) == 0);
+        }
+        const char *line = manifest ? manifest_line(manifest, "logs/dir") : NULL;
+        const char *note = line ? strstr(line, "not a regular file") : NULL;
+        CHECK(note && note < strchr(line, '\n'));
+        free(manifest);
+
+        /* Failed entries aren't in the zip itself */
+        char *listing = unzip("-Z1", zip, NULL, NULL, NULL);
+        CHECK(listing && strstr(listing, "logs/missing.log") == NULL);
+        CHECK(listing && strstr(listing, RSIM_ARCHIVE_MANIFEST) != NULL);
+        free(listing);
+    }
+    free(bin);
+    free(text);
+}
+
+static void test_cap(void) {
+    /* 40 x 16 KB of noise against a 256 KB cap: some fit, the rest are
+     * skipped, the manifest still goes in and the file stays under the cap */
+    char zip[600], err[256] = "";
+    snprintf(zip, sizeof(zip), "%s/capped.zip", g_root);
+    long long cap = 256 << 10;
+    RSimArchive a;
+    CHECK_INT(rsim_archive_open(&a, zip, 3, cap, 1, err, sizeof(err)), 0);
+    for (unsigned i = 0; i < 40; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "frames/%06u.jpg", i);
+        rsim_archive_add_data(&a, name, noise(16 << 10, i + 1), 16 << 10, 1714564800);
+    }
+    RSimArchiveStats stats;
+    CHECK_INT(rsim_archive_close(&a, &stats), 0);
+    CHECK_INT(stats.entries, 40);
+    CHECK_INT(stats.stored + stats.skipped, 40);
+    CHECK(stats.stored >= 1);
+    CHECK(stats.skipped >= 1);
+    /* Everything but the manifest's reserve is used before skipping starts */
+    CHECK((long long)stats.stored * (16 << 10) > cap - (64 << 10) - 2 * (16 << 10));
+    CHECK_INT(stats.bytes_out, file_size(zip));
+    CHECK(file_size(zip) <= cap);
+    check_unzip_clean(zip);
+
+    if (g_have_unzip) {
+        size_t len = 0;
+        char *manifest = unzip("-p", zip, RSIM_ARCHIVE_MANIFEST, &len, NULL);
+        size_t skipped = 0;
+        for (const char *p = manifest; p && (p = strstr(p, "\nskipped")); p++) skipped++;
+        CHECK_INT(skipped, stats.skipped);
+        free(manifest);
+        char *listing = unzip("-Z1", zip, NULL, NULL, NULL);
+        size_t lines = 0;
+        for (const char *p = listing; p && *p; p++) lines += *p == '\n';
+        CHECK_INT(lines, stats.stored + 1);
+        free(listing);
+    }
+
+    /* A cap with no room for the manifest is refused up front */
+    CHECK_INT(rsim_archive_open(&a, zip, 1, 32 << 10, 1, err, sizeof(err)), -1);
+    CHECK(strstr(err, "size cap too small") != NULL);
+}
+
+struct adder {
+    RSimArchive *a;
+    int          thread;
+};
+
+static void *add_many(void *arg) {
+    struct adder *ad = arg;
+    for (int i = 0; i < 100; i++) {
+        char name[64], *body = malloc(64);
+        snprintf(name, sizeof(name), "t%d/%03d.txt", ad->thread, i);
+        int n = snprintf(body, 64, "thread %d entry %d\n", ad->thread, i);
+        rsim_archive_add_data(ad->a, name, body, (size_t)n, 1714564800);
+    }
+    return NULL;
+}
+
+static void test_threads(void) {
+    /* Callers on several threads, more entries than the first item array */
+    char zip[600], err[256] = "";
+    snprintf(zip, sizeof(zip), "%s/threads.zip", g_root);
+    RSimArchive a;
+    CHECK_INT(rsim_archive_open(&a, zip, 8, 0, 1, err, sizeof(err)), 0);
+    pthread_t threads[4];
+    struct adder adders[4];
+    for (int t = 0; t < 4; t++) {
+        adders[t] = (struct adder){ &a, t };
+        pthread_create(&threads[t], NULL, add_many, &adders[t]);
+    }
+    for (int t = 0; t < 4; t++) pthread_join(threads[t], NULL);
+    RSimArchiveStats stats;
+    CHECK_INT(rsim_archive_close(&a, &stats), 0);
+    CHECK_INT(stats.entries, 400);
+    CHECK_INT(stats.stored, 400);
+    check_unzip_clean(zip);
+
+    if (g_have_unzip) {
+        char *got = unzip("-p", zip, "t3/099.txt", NULL, NULL);
+        CHECK_STR(got, "thread 3 entry 99\n");
+        free(got);
+    }
+}
+
+int main(void) {
+    g_have_unzip = system("unzip -v >/dev/null 2>&1") == 0;
+    if (!g_have_unzip) printf("  (unzip not installed: archives are not checked with it)\n");
+    test_tmpdir(g_root, sizeof(g_root), "archive");
+    RUN(test_entries);
+    RUN(test_cap);
+    RUN(test_threads);
+    test_rmtree(g_root);
+    return test_report("test_archive");
+}
@@ -0,0 +1,183 @@
+/*
+ * test_dedup.c — Tree scan and materialize: duplicates, symlinks, modes, re-runs, saved bytes
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_dedup.h"
+
+static char g_root[512];
+
+static void put(const char *rel, char fill, size_t len, mode_t mode) {
+    char path[1024], *data = malloc(len);
+    memset(data, fill, len);
+    snprintf(path, sizeof(path), "%s/src/%s", g_root, rel);
+    CHECK_INT(test_write_file(path, data, len), 0);
+    chmod(path, mode);
+    free(data);
+}
+
+static void sub(const char *rel, char *out, size_t size) {
+    snprintf(out, size, "%s/%s", g_root, rel);
+}
+
+/*   src/a.txt            100 x 'A'  0644
+ *   src/b.bin             50 x 'B'  0755
+ *   src/dup/a-copy.txt   100 x 'A'  0644
+ *   src/ro/c.txt         100 x 'A'  0444   (ro/ itself 0555)
+ *   src/ro/d.txt          30 x 'D'  0444
+ *   src/link -> a.txt, src/dangling -> nowhere */
+static void make_fixture(void) {
+    char path[1024];
+    const char *dirs[] = { "src", "src/dup", "src/ro" };
+    for (int i = 0; i < 3; i++) {
+        sub(dirs[i], path, sizeof(path));
+        mkdir(path, 0755);
+    }
+    put("a.txt", 'A', 100, 0644);
+    put("b.bin", 'B', 50, 0755);
+    put("dup/a-copy.txt", 'A', 100, 0644);
+    put("ro/c.txt", 'A', 100, 0444);
+    put("ro/d.txt", 'D', 30, 0444);
+    sub("src/link", path, sizeof(path));
+    CHECK_INT(symlink("a.txt", path), 0);
+    sub("src/dangling", path, sizeof(path));
+    CHECK_INT(symlink("nowhere", path), 0);
+    sub("src/ro", path, sizeof(path));
+    chmod(path, 0555);
+}
+
+/* dest matches the fixture: contents, modes, links */
+static void check_tree(const char *dest) {
+    const struct { const char *rel; char fill; size_t len; mode_t mode; } files[] = {
+        { "a.txt", 'A', 100, 0644 }, { "b.bin", 'B', 50, 0755 }, { "dup/a-copy.txt", 'A', 100, 0644 },
+        { "ro/c.txt", 'A', 100, 0444 }, { "ro/d.txt", 'D', 30, 0444 },
+    };
+    char path[1200], target[64];
+    struct stat st;
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dest, files[i].rel);
+        size_t len = 0;
+        char *data = test_read_file(path, &len);
+        CHECK(data != NULL);
+        CHECK_INT(len, files[i].len);
+        for (size_t k = 0; data && k < len; k++)
+            if (data[k] != files[i].fill) { CHECK(!"content differs"); break; }
+        free(data);
+        CHECK_INT(lstat(path, &st), 0);
+        CHECK_INT(st.st_mode & 07777, files[i].mode);
+    }
+    snprintf(path, sizeof(path), "%s/ro", dest);
+    CHECK_INT(lstat(path, &st), 0);
+    CHECK_INT(st.st_mode & 07777, 0555);
+    snprintf(path, sizeof(path), "%s/link", dest);
+    ssize_t n = readlink(path, target, sizeof(target) - 1);
+    CHECK_INT(n, 5);
+    if (n >= 0) target[n] = 0;
+    CHECK_STR(target, "a.txt");
+    snprintf(path, sizeof(path), "%s/dangling", dest);
+    CHECK_INT(lstat(path, &st), 0);
+    CHECK(S_ISLNK(st.st_mode));
+}
+
+static void test_scan(void) {
+    char src[600], err[256] = "";
+    sub("src", src, sizeof(src));
+    RSimDedupTree tree;
+    RSimDedupStats stats;
+    CHECK_INT(rsim_dedup_scan(&tree, src, 3, &stats, err, sizeof(err)), 0);
+    CHECK_INT(stats.files, 5);
+    CHECK_INT(stats.dirs, 3);           /* the root, dup, ro */
+    CHECK_INT(stats.symlinks, 2);
+    CHECK_INT(stats.unique, 3);
+    CHECK_INT(stats.bytes, 380);
+    CHECK_INT(stats.bytes_unique, 180);
+
+    /* Parents come before children */
+    CHECK_STR(tree.entries[0].rel, "");
+    for (size_t i = 1; i < tree.count; i++) {
+        const char *slash = strrchr(tree.entries[i].rel, '/');
+        if (!slash) continue;
+        int parent_seen = 0;
+        for (size_t k = 0; k < i; k++)
+            parent_seen |= strlen(tree.entries[k].rel) == (size_t)(slash - tree.entries[i].rel) &&
+                           strncmp(tree.entries[k].rel, tree.entries[i].rel, (size_t)(slash - tree.entries[i].rel)) == 0;
+        CHECK(parent_seen);
+    }
+    int primaries = 0;
+    for (size_t i = 0; i < tree.count; i++) primaries += tree.entries[i].primary;
+    CHECK_INT(primaries, 3);
+    char hex[65];
+    rsim_dedup_hex(tree.entries[0].digest, hex);
+    CHECK_INT(strlen(hex), 64);
+    rsim_dedup_free(&tree);
+
+    sub("src/a.txt", src, sizeof(src));
+    CHECK_INT(rsim_dedup_scan(&tree, src, 1, &stats, err, sizeof(err)), -1);     /* not a directory */
+    CHECK(strstr(err, "not a directory") != NULL);
+    rsim_dedup_free(&tree);
+}
+
+static void test_materialize(void) {
+    char src[600], store[600], dest[600], err[256];
+    sub("src", src, sizeof(src));
+    sub("store", store, sizeof(store));
+    RSimDedupTree tree;
+    RSimDedupStats stats;
+    CHECK_INT(rsim_dedup_scan(&tree, src, 2, &stats, err, sizeof(err)), 0);
+
+    /* First tree, hard links allowed (no clonefile here): the store gets the
+     * 3 contents (180) plus a copy for each (content, mode) other than the
+     * objects' 0444: 'A' as 0644 (100) and 'B' as 0755 (50) */
+    sub("dest1", dest, sizeof(dest));
+    CHECK_INT(rsim_dedup_materialize(&tree, store, dest, 2, 1, &stats), 0);
+    check_tree(dest);
+    CHECK_INT(stats.linked + stats.cloned, 5);
+    CHECK_INT(stats.failed, 0);
+    if (stats.linked == 5) {
+        CHECK_INT(stats.bytes_new, 180 + 150);
+        CHECK_INT(rsim_dedup_saved(&stats), 380 - 330);
+    }
+
+    /* Second tree from the same store costs nothing new */
+    sub("dest2", dest, sizeof(dest));
+    CHECK_INT(rsim_dedup_materialize(&tree, store, dest, 2, 1, &stats), 0);
+    check_tree(dest);
+    CHECK_INT(stats.bytes_new, 0);
+    CHECK_INT(rsim_dedup_saved(&stats), 380);
+
+    /* Again into dest2: files are replaced, read-only ro/ included */
+    CHECK_INT(rsim_dedup_materialize(&tree, store, dest, 2, 1, &stats), 0);
+    check_tree(dest);
+    CHECK_INT(stats.failed, 0);
+
+    /* Copy fallback: every byte written again, nothing saved */
+    sub("dest3", dest, sizeof(dest));
+    CHECK_INT(rsim_dedup_materialize(&tree, store, dest, 2, 0, &stats), 0);
+    check_tree(dest);
+    CHECK_INT(stats.copied + stats.cloned, 5);
+    if (stats.copied == 5) {
+        CHECK_INT(stats.bytes_copied, 380);
+        CHECK_INT(rsim_dedup_saved(&stats), 0);
+    }
+
+    /* Store objects are read-only */
+    char obj[1200], hex[65];
+    for (size_t i = 0; i < tree.count; i++) {
+        if (tree.entries[i].type != RSIM_DEDUP_FILE) continue;
+        rsim_dedup_hex(tree.entries[i].digest, hex);
+        snprintf(obj, sizeof(obj), "%s/objects/%.2s/%s", store, hex, hex + 2);
+        struct stat st;
+        CHECK_INT(stat(obj, &st), 0);
+        CHECK_INT(st.st_mode & 0777, 0444);
+    }
+    rsim_dedup_free(&tree);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "dedup");
+    make_fixture();
+    RUN(test_scan);
+    RUN(test_materialize);
+    test_rmtree(g_root);
+    return test_report("test_dedup");
+}
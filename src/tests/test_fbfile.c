@@ -0,0 +1,359 @@
+/*
+ * test_fbfile.c — v2 frame files: write/map, damaged files, the ring writer, copying frames out
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_fbfile.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+
+static char g_root[512];
+
+#define FRAMES      2000
+#define FB_W        160
+#define FB_H        120
+#define SRC_BPR     (FB_W * 4 + 64)             /* padded source rows */
+
+static uint32_t next_rand(uint32_t *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/* Paint a random rect of the source with the frame's sequence, one uint32
+ * per pixel, and fill in the header's dirty rect to match. Every 50th frame
+ * is a full one (dirty w == 0). */
+static void paint(uint8_t *src, uint64_t seq, uint32_t *state, RSimFBHeader *h) {
+    memset(h, 0, sizeof(*h));
+    h->pixel_format = RSIM_FB_FORMAT_BGRA;
+    h->width = FB_W;
+    h->height = FB_H;
+    h->bytes_per_row = FB_W * 4;
+    h->scale_milli = 2000;
+    h->sequence = seq;
+    uint32_t x = 0, y = 0, w = FB_W, hh = FB_H;
+    if (seq % 50) {
+        x = next_rand(state) % FB_W;
+        y = next_rand(state) % FB_H;
+        w = 1 + next_rand(state) % (FB_W - x);
+        hh = 1 + next_rand(state) % (FB_H - y);
+        h->dirty_x = x;
+        h->dirty_y = y;
+        h->dirty_w = w;
+        h->dirty_h = hh;
+    }
+    for (uint32_t r = y; r < y + hh; r++)
+        for (uint32_t c = x; c < x + w; c++) {
+            uint32_t v = (uint32_t)seq;
+            memcpy(src + (size_t)r * SRC_BPR + (size_t)c * 4, &v, 4);
+        }
+}
+
+static int same_as_source(const uint8_t *px, size_t bpr, const uint8_t *src) {
+    for (uint32_t r = 0; r < FB_H; r++)
+        if (memcmp(px + r * bpr, src + (size_t)r * SRC_BPR, FB_W * 4) != 0) return 0;
+    return 1;
+}
+
+/* Overwrite len bytes of a file at offset */
+static int patch_file(const char *path, off_t offset, const void *data, size_t len) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return -1;
+    ssize_t n = pwrite(fd, data, len, offset);
+    close(fd);
+    return n == (ssize_t)len ? 0 : -1;
+}
+
+static void write_one(const char *path, uint8_t *src) {
+    RSimFBHeader h;
+    uint32_t state = 4;
+    paint(src, 1, &state, &h);
+    h.orientation = 3;
+    CHECK_INT(rsim_fb_write(path, &h, src, SRC_BPR), RSIM_FB_OK);
+}
+
+static void test_write_map(void) {
+    /* Padded source rows come out tight, with the fields rsim_fb_write owns
+     * filled in, and map and read agree on them */
+    char path[600], tmp[640];
+    snprintf(path, sizeof(path), "%s/one.fb", g_root);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    uint8_t *src = calloc(FB_H, SRC_BPR);
+    write_one(path, src);
+    CHECK(access(tmp, F_OK) != 0);
+
+    RSimFBMap map;
+    CHECK_INT(rsim_fb_map(path, &map, 1), RSIM_FB_OK);
+    const RSimFBHeader *h = map.header;
+    CHECK(rsim_fb_is_v2(map.map, map.map_size));
+    CHECK_INT(h->magic, RSIM_FB_MAGIC);
+    CHECK_INT(h->version, RSIM_FB_VERSION);
+    CHECK_INT(h->header_size, RSIM_FB_HEADER_SIZE);
+    CHECK_INT(h->width, FB_W);
+    CHECK_INT(h->bytes_per_row, FB_W * 4);
+    CHECK_INT(h->data_size, FB_W * 4 * FB_H);
+    CHECK_INT(h->sequence, 1);
+    CHECK_INT(h->orientation, 3);
+    CHECK_INT(map.map_size, RSIM_FB_HEADER_SIZE + FB_W * 4 * FB_H);
+    CHECK(same_as_source(map.pixels, h->bytes_per_row, src));
+    CHECK(h->checksum == rsim_fb_checksum(map.pixels, h->data_size));
+
+    RSimFBFrame frame = {0};
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 1), RSIM_FB_OK);
+    CHECK_INT(memcmp(&frame.header, h, sizeof(*h)), 0);
+    CHECK(same_as_source(frame.pixels, frame.header.bytes_per_row, src));
+    rsim_fb_unmap(&map);
+    CHECK(map.map == NULL);
+
+    /* A tight source (the single-write path) gives the same file */
+    uint8_t *tight = malloc((size_t)FB_W * 4 * FB_H);
+    for (int r = 0; r < FB_H; r++) memcpy(tight + (size_t)r * FB_W * 4, src + (size_t)r * SRC_BPR, FB_W * 4);
+    RSimFBHeader th = frame.header;
+    th.checksum = 0;
+    CHECK_INT(rsim_fb_write(path, &th, tight, FB_W * 4), RSIM_FB_OK);
+    RSimFBFrame again = {0};
+    CHECK_INT(rsim_fb_read(path, &again, 0, 1), RSIM_FB_OK);
+    CHECK_INT(memcmp(&again.header, &frame.header, sizeof(frame.header)), 0);
+    CHECK_INT(memcmp(again.pixels, frame.pixels, frame.header.data_size), 0);
+
+    /* The checksum sees the tail bytes past the last 8-byte word */
+    uint8_t odd[13] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+    uint64_t sum = rsim_fb_checksum(odd, sizeof(odd));
+    odd[12] ^= 1;
+    CHECK(rsim_fb_checksum(odd, sizeof(odd)) != sum);
+    CHECK(!rsim_fb_is_v2(odd, sizeof(odd)));
+
+    rsim_fb_frame_free(&frame);
+    rsim_fb_frame_free(&again);
+    CHECK(frame.pixels == NULL);
+    free(tight);
+    free(src);
+}
+
+static void test_damaged_files(void) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/damaged.fb", g_root);
+    uint8_t *src = calloc(FB_H, SRC_BPR);
+    RSimFBMap map;
+    RSimFBFrame frame = {0};
+
+    /* Bad magic, another version, a geometry that doesn't add up */
+    uint32_t bad = 0x12345678;
+    write_one(path, src);
+    CHECK_INT(patch_file(path, offsetof(RSimFBHeader, magic), &bad, 4), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_FORMAT);
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 0), RSIM_FB_ERR_FORMAT);
+    CHECK_STR(rsim_fb_strerror(RSIM_FB_ERR_FORMAT), "not a v2 framebuffer file");
+    write_one(path, src);
+    uint32_t v3 = RSIM_FB_VERSION + 1;
+    CHECK_INT(patch_file(path, offsetof(RSimFBHeader, version), &v3, 4), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_FORMAT);
+    write_one(path, src);
+    uint32_t narrow = FB_W * 4 - 4;
+    CHECK_INT(patch_file(path, offsetof(RSimFBHeader, bytes_per_row), &narrow, 4), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_FORMAT);
+
+    /* Cut short: inside the pixels, and inside the header page */
+    write_one(path, src);
+    CHECK_INT(truncate(path, RSIM_FB_HEADER_SIZE + FB_W * 4 * FB_H / 2), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_TRUNCATED);
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 0), RSIM_FB_ERR_TRUNCATED);
+    CHECK_INT(truncate(path, RSIM_FB_HEADER_SIZE - 1), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_FORMAT);
+    CHECK_INT(truncate(path, 0), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_FORMAT);
+
+    /* One flipped pixel byte: only caught when the checksum is verified */
+    write_one(path, src);
+    uint8_t flip = 0xff;
+    CHECK_INT(patch_file(path, RSIM_FB_HEADER_SIZE + 4 * FB_W * 7 + 5, &flip, 1), 0);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_OK);
+    rsim_fb_unmap(&map);
+    CHECK_INT(rsim_fb_map(path, &map, 1), RSIM_FB_ERR_CHECKSUM);
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 1), RSIM_FB_ERR_CHECKSUM);
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 0), RSIM_FB_OK);
+
+    /* No file at all */
+    unlink(path);
+    CHECK_INT(rsim_fb_map(path, &map, 0), RSIM_FB_ERR_IO);
+    CHECK(map.map == NULL);
+    rsim_fb_frame_free(&frame);
+    free(src);
+}
+
+static void test_ring_frames(void) {
+    /* 2000 frames of random dirty rects: every published file, read back
+     * whole, is the source frame, with a checksum that matches it */
+    char path[600];
+    snprintf(path, sizeof(path), "%s/ring.fb", g_root);
+    uint8_t *src = calloc(FB_H, SRC_BPR);
+    RSimFBWriter w;
+    rsim_fb_writer_init(&w, path, 0);
+    RSimFBFrame frame = {0};
+    RSimFBHeader h;
+    uint32_t state = 1;
+    int bad_read = 0, bad_pixels = 0;
+    for (uint64_t seq = 1; seq <= FRAMES; seq++) {
+        paint(src, seq, &state, &h);
+        if (rsim_fb_writer_publish(&w, &h, src, SRC_BPR) != RSIM_FB_OK) {
+            CHECK(0);
+            break;
+        }
+        if (rsim_fb_read(path, &frame, 0, 1) != RSIM_FB_OK || frame.header.sequence != seq) {
+            bad_read++;
+            continue;
+        }
+        bad_pixels += !same_as_source(frame.pixels, frame.header.bytes_per_row, src);
+        if (seq == FRAMES) {
+            CHECK_INT(frame.header.dirty_w, h.dirty_w);
+            CHECK_INT(frame.header.scale_milli, 2000);
+            CHECK_INT(frame.header.generation % 2, 0);
+        }
+    }
+    CHECK_INT(bad_read, 0);
+    CHECK_INT(bad_pixels, 0);
+
+    /* Still the same frame: nothing is copied */
+    CHECK_INT(rsim_fb_read(path, &frame, FRAMES, 1), RSIM_FB_SAME);
+    CHECK_INT(frame.header.sequence, FRAMES);
+
+    /* The ring: <path> is a link to one of RSIM_FB_RING backing files */
+    struct stat st, slot;
+    CHECK_INT(stat(path, &st), 0);
+    int linked = 0;
+    for (unsigned i = 0; i < RSIM_FB_RING; i++) {
+        char sp[640];
+        snprintf(sp, sizeof(sp), "%s.%u", path, i);
+        CHECK_INT(stat(sp, &slot), 0);
+        linked += slot.st_ino == st.st_ino;
+    }
+    CHECK_INT(linked, 1);
+
+    rsim_fb_writer_close(&w, 1);
+    CHECK(access(path, F_OK) != 0);
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 0), RSIM_FB_ERR_IO);
+    rsim_fb_frame_free(&frame);
+    free(src);
+}
+
+static void test_geometry_change(void) {
+    /* A mapping of the old geometry stays readable after the writer moves
+     * on to a new size: backing files are recreated, not truncated */
+    char path[600];
+    snprintf(path, sizeof(path), "%s/resize.fb", g_root);
+    uint8_t *src = calloc(FB_H, SRC_BPR);
+    RSimFBWriter w;
+    rsim_fb_writer_init(&w, path, 0);
+    RSimFBHeader h;
+    uint32_t state = 2;
+    paint(src, 50, &state, &h);
+    CHECK_INT(rsim_fb_writer_publish(&w, &h, src, SRC_BPR), RSIM_FB_OK);
+
+    RSimFBMap old;
+    CHECK_INT(rsim_fb_map(path, &old, 1), RSIM_FB_OK);
+    h.width = FB_W / 2;
+    h.bytes_per_row = FB_W / 2 * 4;
+    h.sequence = 51;
+    for (int k = 0; k < RSIM_FB_RING; k++) {
+        h.sequence++;
+        CHECK_INT(rsim_fb_writer_publish(&w, &h, src, SRC_BPR), RSIM_FB_OK);
+    }
+    CHECK_INT(old.header->width, FB_W);
+    CHECK(same_as_source(old.pixels, old.header->bytes_per_row, src));
+    CHECK(rsim_fb_checksum(old.pixels, old.header->data_size) == old.header->checksum);
+    rsim_fb_unmap(&old);
+
+    RSimFBFrame frame = {0};
+    CHECK_INT(rsim_fb_read(path, &frame, 0, 1), RSIM_FB_OK);
+    CHECK_INT(frame.header.width, FB_W / 2);
+    CHECK_INT(frame.header.data_size, FB_W / 2 * 4 * FB_H);
+    rsim_fb_frame_free(&frame);
+    rsim_fb_writer_close(&w, 1);
+    free(src);
+}
+
+struct reader {
+    const char *path;
+    volatile int *done;
+    int         copies, same, busy, torn, failed;
+};
+
+/* Copy frames out while the writer publishes. A torn copy would have
+ * pixels newer than its header's sequence, miss the header's own dirty
+ * rect, or fail its checksum. */
+static void *read_frames(void *arg) {
+    struct reader *rd = arg;
+    RSimFBFrame frame = {0};
+    uint64_t last = 0;
+    while (!__atomic_load_n(rd->done, __ATOMIC_ACQUIRE)) {
+        int err = rsim_fb_read(rd->path, &frame, last, 1);
+        if (err == RSIM_FB_SAME) { rd->same++; continue; }
+        if (err == RSIM_FB_ERR_BUSY) { rd->busy++; continue; }
+        if (err == RSIM_FB_ERR_IO) continue;    /* before the first publish */
+        if (err != RSIM_FB_OK) { rd->failed++; continue; }
+        const RSimFBHeader *h = &frame.header;
+        uint32_t seq = (uint32_t)h->sequence;
+        int torn = 0;
+        for (uint32_t r = 0; r < h->height && !torn; r++)
+            for (uint32_t c = 0; c < h->width; c++) {
+                uint32_t v;
+                memcpy(&v, frame.pixels + r * h->bytes_per_row + c * 4, 4);
+                int inside = !h->dirty_w ||
+                             (c >= h->dirty_x && c < h->dirty_x + h->dirty_w &&
+                              r >= h->dirty_y && r < h->dirty_y + h->dirty_h);
+                if (v > seq || (inside && v != seq)) { torn = 1; break; }
+            }
+        rd->torn += torn;
+        rd->copies++;
+        last = h->sequence;
+    }
+    rsim_fb_frame_free(&frame);
+    return NULL;
+}
+
+static void test_concurrent_readers(void) {
+    /* 2000 frames published, in bursts, under two readers: every frame a
+     * reader gets is a consistent one */
+    char path[600];
+    snprintf(path, sizeof(path), "%s/live.fb", g_root);
+    uint8_t *src = calloc(FB_H, SRC_BPR);
+    RSimFBWriter w;
+    rsim_fb_writer_init(&w, path, 0);
+    volatile int done = 0;
+    struct reader rd[2] = { { .path = path, .done = &done }, { .path = path, .done = &done } };
+    pthread_t threads[2];
+    for (int t = 0; t < 2; t++) pthread_create(&threads[t], NULL, read_frames, &rd[t]);
+
+    RSimFBHeader h;
+    uint32_t state = 3;
+    int failed = 0;
+    for (uint64_t seq = 1; seq <= FRAMES; seq++) {
+        paint(src, seq, &state, &h);
+        failed += rsim_fb_writer_publish(&w, &h, src, SRC_BPR) != RSIM_FB_OK;
+        if (seq % 8 == 0) usleep(100);          /* let the readers in */
+    }
+    usleep(20000);
+    __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+    for (int t = 0; t < 2; t++) pthread_join(threads[t], NULL);
+    CHECK_INT(failed, 0);
+    for (int t = 0; t < 2; t++) {
+        CHECK(rd[t].copies > 0);
+        CHECK_INT(rd[t].torn, 0);
+        CHECK_INT(rd[t].failed, 0);
+    }
+    printf("  (readers copied %d and %d frames, %d and %d busy)\n",
+           rd[0].copies, rd[1].copies, rd[0].busy, rd[1].busy);
+    rsim_fb_writer_close(&w, 1);
+    free(src);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "fbfile");
+    RUN(test_write_map);
+    RUN(test_damaged_files);
+    RUN(test_ring_frames);
+    RUN(test_geometry_change);
+    RUN(test_concurrent_readers);
+    test_rmtree(g_root);
+    return test_report("test_fbfile");
+}
@@ -0,0 +1,163 @@
+/*
+ * test_image.c — BGRA rotation by quarter turns, box downscaling, orientation
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_image.h"
+
+static char g_root[512];
+
+/* Every pixel distinct: its own coordinates */
+static uint8_t *pattern(int w, int h, size_t bpr) {
+    uint8_t *p = malloc(bpr * h);
+    memset(p, 0xee, bpr * h);                   /* padding is never read as pixels */
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            uint32_t v = (uint32_t)y << 16 | (uint32_t)x;
+            memcpy(p + (size_t)y * bpr + (size_t)x * 4, &v, 4);
+        }
+    return p;
+}
+
+/* Where src (x, y) goes for a clockwise rotation of w x h by degrees */
+static void rotated_xy(int deg, int w, int h, int x, int y, int *ox, int *oy) {
+    switch (deg) {
+    case 90:  *ox = h - 1 - y; *oy = x;         break;
+    case 180: *ox = w - 1 - x; *oy = h - 1 - y; break;
+    case 270: *ox = y;         *oy = w - 1 - x; break;
+    default:  *ox = x;         *oy = y;         break;
+    }
+}
+
+/* Number of pixels of dst that aren't where the rotation puts them, plus
+ * padding bytes of dst that were written */
+static int check_rotation(int deg, int w, int h, const uint8_t *src, size_t sbpr,
+                          const uint8_t *dst, size_t dbpr) {
+    int ow = deg % 180 ? h : w, oh = deg % 180 ? w : h, bad = 0;
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            int ox, oy;
+            rotated_xy(deg, w, h, x, y, &ox, &oy);
+            bad += memcmp(dst + (size_t)oy * dbpr + (size_t)ox * 4, src + (size_t)y * sbpr + (size_t)x * 4, 4) != 0;
+        }
+    for (int y = 0; y < oh; y++)
+        for (size_t b = (size_t)ow * 4; b < dbpr; b++) bad += dst[(size_t)y * dbpr + b] != 0x5a;
+    return bad;
+}
+
+static int rotate_case(int deg, int w, int h, int src_pad, int dst_pad) {
+    size_t sbpr = (size_t)w * 4 + src_pad;
+    int ow = deg % 180 ? h : w, oh = deg % 180 ? w : h;
+    size_t dbpr = (size_t)ow * 4 + dst_pad;
+    uint8_t *src = pattern(w, h, sbpr), *dst = malloc(dbpr * oh);
+    memset(dst, 0x5a, dbpr * oh);
+    rsim_bgra_rotate_into(src, w, h, sbpr, deg, dst, dbpr);
+    int bad = check_rotation(deg, w, h, src, sbpr, dst, dbpr);
+    if (bad) fprintf(stderr, "  %d deg %dx%d (pad %d/%d): %d bad\n", deg, w, h, src_pad, dst_pad, bad);
+    free(src);
+    free(dst);
+    return bad;
+}
+
+static void test_rotate_sizes(void) {
+    /* Sizes on and off the 4x4 grid, the 32-column blocks and the 64-row
+     * strips, with padded rows (including padding that isn't a multiple of
+     * 16 bytes), for all four angles */
+    static const int sizes[][2] = { { 1, 1 }, { 1, 7 }, { 7, 1 }, { 3, 5 }, { 4, 4 }, { 5, 9 },
+                                    { 16, 16 }, { 31, 33 }, { 64, 64 }, { 65, 63 }, { 97, 131 },
+                                    { 130, 67 }, { 257, 190 } };
+    static const int pads[][2] = { { 0, 0 }, { 64, 0 }, { 0, 12 }, { 20, 36 } };
+    int bad = 0, cases = 0;
+    for (int deg = 0; deg < 360; deg += 90)
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            for (size_t p = 0; p < sizeof(pads) / sizeof(pads[0]); p++, cases++)
+                bad += rotate_case(deg, sizes[s][0], sizes[s][1], pads[p][0], pads[p][1]) != 0;
+    CHECK_INT(bad, 0);
+    printf("  (%d rotations)\n", cases);
+}
+
+static void test_rotate_large(void) {
+    /* Big enough to be streamed past the cache; the width and height are
+     * odd and the destination rows aren't line multiples, so every line
+     * phase is exercised */
+    for (int deg = 90; deg < 360; deg += 90) {
+        CHECK_INT(rotate_case(deg, 1031, 1029, 0, 0), 0);
+        CHECK_INT(rotate_case(deg, 1170, 1283, 32, 4), 0);
+    }
+    CHECK_INT(rotate_case(90, 2048, 2732, 0, 0), 0);
+    CHECK_INT(rotate_case(270, 2048, 2732, 0, 0), 0);
+}
+
+static void test_rotate_bitmap(void) {
+    int w = 37, h = 21;
+    uint8_t *src = pattern(w, h, (size_t)w * 4);
+    RSimBitmap out = {0};
+    CHECK_INT(rsim_bgra_rotate(src, w, h, (size_t)w * 4, 90, &out), 0);
+    CHECK_INT(out.width, h);
+    CHECK_INT(out.height, w);
+    CHECK_INT(out.bytes_per_row, (size_t)h * 4);
+    CHECK_INT(check_rotation(90, w, h, src, (size_t)w * 4, out.px, out.bytes_per_row), 0);
+
+    /* Angles are taken modulo 360, negative ones too */
+    CHECK_INT(rsim_bgra_rotate(src, w, h, (size_t)w * 4, -90, &out), 0);
+    CHECK_INT(check_rotation(270, w, h, src, (size_t)w * 4, out.px, out.bytes_per_row), 0);
+    CHECK_INT(rsim_bgra_rotate(src, w, h, (size_t)w * 4, 540, &out), 0);
+    CHECK_INT(out.width, w);
+    CHECK_INT(check_rotation(180, w, h, src, (size_t)w * 4, out.px, out.bytes_per_row), 0);
+
+    /* The buffer is reused when it is big enough */
+    uint8_t *px = out.px;
+    CHECK_INT(rsim_bgra_rotate(src, w, h, (size_t)w * 4, 0, &out), 0);
+    CHECK(out.px == px);
+    CHECK_INT(rsim_bgra_rotate(src, w, h, (size_t)w * 4, 45, &out), -1);
+    CHECK_INT(rsim_bgra_rotate(src, 0, h, (size_t)w * 4, 90, &out), -1);
+    rsim_bitmap_free(&out);
+    CHECK(out.px == NULL);
+    free(src);
+}
+
+static void test_orientation(void) {
+    CHECK_INT(rsim_orientation_rotation(0), 0);
+    CHECK_INT(rsim_orientation_rotation(RSIM_ORIENTATION_PORTRAIT), 0);
+    CHECK_INT(rsim_orientation_rotation(RSIM_ORIENTATION_PORTRAIT_UPSIDE_DOWN), 180);
+    CHECK_INT(rsim_orientation_rotation(RSIM_ORIENTATION_LANDSCAPE_RIGHT), 270);
+    CHECK_INT(rsim_orientation_rotation(RSIM_ORIENTATION_LANDSCAPE_LEFT), 90);
+}
+
+static void test_shrink(void) {
+    /* 2x2 box average, rounded, on a padded source */
+    int w = 10, h = 6;
+    size_t bpr = (size_t)w * 4 + 8;
+    uint8_t *src = malloc(bpr * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w * 4; x++) src[(size_t)y * bpr + x] = (uint8_t)(x * 3 + y * 11);
+    RSimBitmap out = {0};
+    CHECK_INT(rsim_bgra_shrink(src, w, h, bpr, 2, &out), 0);
+    CHECK_INT(out.width, 5);
+    CHECK_INT(out.height, 3);
+    int bad = 0;
+    for (int y = 0; y < 3; y++)
+        for (int x = 0; x < 5 * 4; x++) {
+            int c = x % 4, px = x / 4;
+            const uint8_t *r0 = src + (size_t)(2 * y) * bpr, *r1 = r0 + bpr;
+            int sum = r0[px * 8 + c] + r0[px * 8 + 4 + c] + r1[px * 8 + c] + r1[px * 8 + 4 + c];
+            bad += out.px[(size_t)y * out.bytes_per_row + x] != (sum + 2) / 4;
+        }
+    CHECK_INT(bad, 0);
+    CHECK_INT(rsim_bgra_shrink(src, w, h, bpr, 3, &out), -1);
+    CHECK_INT(rsim_shrink_factor(2048, 2732, 256, 256), 8);
+    CHECK_INT(rsim_shrink_factor(100, 100, 256, 256), 1);
+    rsim_bitmap_free(&out);
+    free(src);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "image");
+    RUN(test_rotate_sizes);
+    RUN(test_rotate_large);
+    RUN(test_rotate_bitmap);
+    RUN(test_orientation);
+    RUN(test_shrink);
+    test_rmtree(g_root);
+    return test_report("test_image");
+}
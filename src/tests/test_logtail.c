@@ -0,0 +1,232 @@
+/*
+ * test_logtail.c — Following log files: backlog, create, append, rotation, truncation, idle
+ *
+ * Runs against the real kernel watch (inotify on Linux, kqueue on macOS):
+ * every change below has to wake rsim_logtail_wait on its own.
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_logtail.h"
+
+#include <time.h>
+
+static char g_root[512];
+
+typedef struct {
+    char    text[64][128];
+    int     file[64];
+    int     count;
+} Collected;
+
+static void collect(const RSimLogTail *tail, const RSimLogLine *line, void *ctx) {
+    Collected *c = ctx;
+    if (c->count >= 64) return;
+    snprintf(c->text[c->count], sizeof(c->text[0]), "%s", line->text);
+    c->file[c->count++] = line->file;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Wait (up to 2 s) until at least want lines have arrived, then drain them */
+static int wait_lines(RSimLogTail *t, Collected *c, int want) {
+    memset(c, 0, sizeof(*c));
+    double deadline = now_ms() + 2000;
+    while (c->count < want && now_ms() < deadline) {
+        if (rsim_logtail_wait(t, 200) < 0) return -1;
+        rsim_logtail_drain(t, collect, c);
+    }
+    return c->count;
+}
+
+static void append(const char *path, const char *text) {
+    FILE *f = fopen(path, "a");
+    if (!f) return;
+    fputs(text, f);
+    fclose(f);
+}
+
+static void test_parse_time(void) {
+    double iso = rsim_log_parse_time("2024-05-01 12:00:00.250 daemon[1]: hi", 37);
+    double t = rsim_log_parse_time("2024-05-01T12:00:01 x", 21);
+    CHECK(iso > 0);
+    CHECK_NEAR(t - iso, 0.75, 1e-6);
+    CHECK(rsim_log_parse_time("May  1 12:00:00 host x", 22) > 0);
+    CHECK(rsim_log_parse_time("Foo  1 12:00:00 host x", 22) == 0);
+    CHECK(rsim_log_parse_time("no timestamp here", 17) == 0);
+    CHECK(rsim_log_parse_time("2024-13-01 12:00:00", 19) == 0);
+}
+
+static void test_backlog(void) {
+    /* The last 3 lines of each file, merged by timestamp; a continuation
+     * line sorts with the line it continues */
+    char a[600], b[600];
+    snprintf(a, sizeof(a), "%s/backlog_a.log", g_root);
+    snprintf(b, sizeof(b), "%s/backlog_b.log", g_root);
+    const char *ta = "2024-05-01 10:00:00 a1\n2024-05-01 10:00:02 a2\n2024-05-01 10:00:04 a3\n"
+                     "  continued\n2024-05-01 10:00:06 a4\n";
+    const char *tb = "2024-05-01 10:00:01 b1\n2024-05-01 10:00:03 b2\n2024-05-01 10:00:05 b3\n";
+    CHECK_INT(test_write_file(a, ta, strlen(ta)), 0);
+    CHECK_INT(test_write_file(b, tb, strlen(tb)), 0);
+
+    RSimLogTail t;
+    CHECK_INT(rsim_logtail_init(&t), 0);
+    CHECK_INT(rsim_logtail_add(&t, a, "a"), 0);
+    CHECK_INT(rsim_logtail_add(&t, b, "b"), 1);
+    rsim_logtail_backlog(&t, 3);
+    Collected c = {0};
+    rsim_logtail_drain(&t, collect, &c);
+    static const char *want[] = { "2024-05-01 10:00:03 b2", "2024-05-01 10:00:04 a3", "  continued",
+                                  "2024-05-01 10:00:05 b3", "2024-05-01 10:00:06 a4" };
+    CHECK_INT(c.count, 6);
+    CHECK_STR(c.text[0], "2024-05-01 10:00:01 b1");
+    for (int i = 0; i < 5 && i + 1 < c.count; i++) CHECK_STR(c.text[i + 1], want[i]);
+
+    /* No backlog: nothing queued, appends only from here */
+    rsim_logtail_backlog(&t, 0);
+    rsim_logtail_drain(&t, collect, &c);
+    append(a, "2024-05-01 10:00:07 a5\n");
+    CHECK_INT(wait_lines(&t, &c, 1), 1);
+    CHECK_STR(c.text[0], "2024-05-01 10:00:07 a5");
+    rsim_logtail_close(&t);
+}
+
+static void test_append_and_filter(void) {
+    char a[600];
+    snprintf(a, sizeof(a), "%s/append.log", g_root);
+    CHECK_INT(test_write_file(a, "old line\n", 9), 0);
+    RSimLogTail t;
+    rsim_logtail_init(&t);
+    rsim_logtail_add(&t, a, "a");
+    rsim_logtail_backlog(&t, 0);
+
+    /* A line split across two writes comes out once, whole */
+    Collected c;
+    append(a, "2024-05-01 10:00:00 first\r\n2024-05-01 10:00:01 sec");
+    CHECK_INT(wait_lines(&t, &c, 1), 1);
+    CHECK_STR(c.text[0], "2024-05-01 10:00:00 first");
+    append(a, "ond\n");
+    CHECK_INT(wait_lines(&t, &c, 1), 1);
+    CHECK_STR(c.text[0], "2024-05-01 10:00:01 second");
+
+    CHECK_INT(rsim_logtail_set_filter(&t, "ERROR|fatal", 1), 0);
+    append(a, "info: fine\nerror: broken\nFATAL: worse\n");
+    CHECK_INT(wait_lines(&t, &c, 2), 2);
+    CHECK_STR(c.text[0], "error: broken");
+    CHECK_STR(c.text[1], "FATAL: worse");
+    CHECK(rsim_logtail_set_filter(&t, "(", 0) != 0);
+    rsim_logtail_close(&t);
+}
+
+static void test_create(void) {
+    /* A file that doesn't exist yet, in a directory that doesn't exist
+     * yet either: read from its start once both appear */
+    char dir[600], nested[700], path[800];
+    snprintf(dir, sizeof(dir), "%s/later", g_root);
+    snprintf(nested, sizeof(nested), "%s/deeper", dir);
+    snprintf(path, sizeof(path), "%s/new.log", nested);
+    RSimLogTail t;
+    rsim_logtail_init(&t);
+    rsim_logtail_add(&t, path, "new");
+    rsim_logtail_backlog(&t, 10);
+    CHECK_INT(t.files[0].fd, -1);
+
+    /* Each level appearing wakes the wait (well before its timeout) */
+    Collected c;
+    CHECK_INT(mkdir(dir, 0755), 0);
+    double t0 = now_ms();
+    CHECK_INT(rsim_logtail_wait(&t, 1000), 0);
+    CHECK(now_ms() - t0 < 500);
+    CHECK_INT(mkdir(nested, 0755), 0);
+    t0 = now_ms();
+    CHECK_INT(rsim_logtail_wait(&t, 1000), 0);
+    CHECK(now_ms() - t0 < 500);
+    append(path, "created 1\ncreated 2\n");
+    CHECK_INT(wait_lines(&t, &c, 2), 2);
+    CHECK_STR(c.text[0], "created 1");
+    CHECK_STR(c.text[1], "created 2");
+    CHECK(t.files[0].fd >= 0);
+    rsim_logtail_close(&t);
+}
+
+static void test_rotation(void) {
+    /* Renamed away and recreated: the rest of the old file, then the new
+     * one from its start */
+    char path[600], old[640];
+    snprintf(path, sizeof(path), "%s/rotate.log", g_root);
+    snprintf(old, sizeof(old), "%s.1", path);
+    CHECK_INT(test_write_file(path, "before\n", 7), 0);
+    RSimLogTail t;
+    rsim_logtail_init(&t);
+    rsim_logtail_add(&t, path, "r");
+    rsim_logtail_backlog(&t, 0);
+
+    Collected c;
+    append(path, "last of old\n");
+    CHECK_INT(rename(path, old), 0);
+    append(path, "first of new\n");
+    CHECK_INT(wait_lines(&t, &c, 2), 2);
+    CHECK_STR(c.text[0], "last of old");
+    CHECK_STR(c.text[1], "first of new");
+
+    /* Unlinked and recreated */
+    CHECK_INT(unlink(path), 0);
+    append(path, "recreated\n");
+    CHECK_INT(wait_lines(&t, &c, 1), 1);
+    CHECK_STR(c.text[0], "recreated");
+    rsim_logtail_close(&t);
+}
+
+static void test_truncation(void) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/trunc.log", g_root);
+    CHECK_INT(test_write_file(path, "a long first line that is long\n", 31), 0);
+    RSimLogTail t;
+    rsim_logtail_init(&t);
+    rsim_logtail_add(&t, path, "t");
+    rsim_logtail_backlog(&t, 0);
+
+    Collected c;
+    CHECK_INT(test_write_file(path, "short\n", 6), 0);     /* truncates and rewrites */
+    CHECK_INT(wait_lines(&t, &c, 1), 1);
+    CHECK_STR(c.text[0], "short");
+    rsim_logtail_close(&t);
+}
+
+static void test_idle(void) {
+    /* Nothing written: wait sleeps in the kernel for the whole timeout and
+     * returns no lines, also with a missing file's directory watched */
+    char path[600], missing[600];
+    snprintf(path, sizeof(path), "%s/idle.log", g_root);
+    snprintf(missing, sizeof(missing), "%s/nowhere/idle.log", g_root);
+    CHECK_INT(test_write_file(path, "x\n", 2), 0);
+    RSimLogTail t;
+    rsim_logtail_init(&t);
+    rsim_logtail_add(&t, path, "i");
+    rsim_logtail_add(&t, missing, "m");
+    rsim_logtail_backlog(&t, 0);
+    clock_t cpu = clock();
+    double t0 = now_ms();
+    CHECK_INT(rsim_logtail_wait(&t, 300), 0);
+    double waited = now_ms() - t0;
+    CHECK(waited >= 250);
+    CHECK((double)(clock() - cpu) / CLOCKS_PER_SEC < 0.05);
+    CHECK_INT(t.line_count, 0);
+    rsim_logtail_close(&t);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "logtail");
+    RUN(test_parse_time);
+    RUN(test_backlog);
+    RUN(test_append_and_filter);
+    RUN(test_create);
+    RUN(test_rotation);
+    RUN(test_truncation);
+    RUN(test_idle);
+    test_rmtree(g_root);
+    return test_report("test_logtail");
+}
@@ -0,0 +1,213 @@
+/*
+ * test_macho.c — Mach-O slices, segments and LC_LOAD_DYLIB insertion
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_macho.h"
+
+#define SLICE_SIZE  0x4000
+#define LIBSYSTEM   "/usr/lib/libSystem.B.dylib"
+#define INJECT      "/usr/lib/sim_touch_inject.dylib"
+
+static void put32(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i)); }
+static void put64(uint8_t *p, uint64_t v) { put32(p, (uint32_t)v); put32(p + 4, (uint32_t)(v >> 32)); }
+static void put32be(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (24 - 8 * i)); }
+static uint32_t get32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+/* An executable slice at base: __TEXT with one __text section whose data
+ * starts at text_off (the end of the header padding), and libSystem. */
+static void build_slice(uint8_t *base, uint32_t cputype, int is64, uint32_t text_off) {
+    memset(base, 0, SLICE_SIZE);
+    uint32_t hdr = is64 ? 32 : 28, seg = is64 ? 72 + 80 : 56 + 68, dylib = 24 + 32;
+    put32(base, is64 ? 0xfeedfacf : 0xfeedface);
+    put32(base + 4, cputype);
+    put32(base + 8, 3);
+    put32(base + 12, 2);                        /* MH_EXECUTE */
+    put32(base + 16, 2);
+    put32(base + 20, seg + dylib);
+
+    uint8_t *p = base + hdr;
+    put32(p, is64 ? 0x19 : 0x1);
+    put32(p + 4, seg);
+    memcpy(p + 8, "__TEXT", 6);
+    uint8_t *s;
+    if (is64) {
+        put64(p + 32, SLICE_SIZE);              /* vmsize */
+        put64(p + 48, SLICE_SIZE);              /* filesize; fileoff 0 */
+        put32(p + 64, 1);
+        s = p + 72;
+        put64(s + 40, 16);
+        put32(s + 48, text_off);
+    } else {
+        put32(p + 28, SLICE_SIZE);
+        put32(p + 36, SLICE_SIZE);
+        put32(p + 48, 1);
+        s = p + 56;
+        put32(s + 36, 16);
+        put32(s + 40, text_off);
+    }
+    memcpy(s, "__text", 6);
+    memcpy(s + 16, "__TEXT", 6);
+
+    p += seg;
+    put32(p, 0xc);                              /* LC_LOAD_DYLIB */
+    put32(p + 4, dylib);
+    put32(p + 8, 24);
+    memcpy(p + 24, LIBSYSTEM, strlen(LIBSYSTEM));
+    memset(base + text_off, 0xCC, 16);
+}
+
+/* x86_64 and i386 slices behind a fat header */
+static uint8_t *build_fat(size_t *size) {
+    *size = 3 * SLICE_SIZE;
+    uint8_t *image = calloc(1, *size);
+    put32be(image, 0xcafebabe);
+    put32be(image + 4, 2);
+    uint32_t cpus[2] = { RSIM_CPU_X86_64, RSIM_CPU_X86 };
+    for (int i = 0; i < 2; i++) {
+        uint8_t *arch = image + 8 + 20 * i;
+        put32be(arch, cpus[i]);
+        put32be(arch + 4, 3);
+        put32be(arch + 8, (uint32_t)(SLICE_SIZE * (i + 1)));
+        put32be(arch + 12, SLICE_SIZE);
+        put32be(arch + 16, 14);
+        build_slice(image + SLICE_SIZE * (i + 1), cpus[i], i == 0, 0x1000);
+    }
+    return image;
+}
+
+static void test_sniff_and_slices(void) {
+    size_t size;
+    uint8_t *fat = build_fat(&size);
+    CHECK(rsim_macho_sniff(fat, 8));
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    CHECK_INT(rsim_macho_slices(fat, size, slices, RSIM_MACHO_MAX_SLICES), 2);
+    const RSimMachOSlice *x = rsim_macho_find_slice(slices, 2, RSIM_CPU_X86_64);
+    CHECK(x != NULL);
+    if (x) {
+        CHECK_INT(x->offset, SLICE_SIZE);
+        CHECK_INT(x->is64, 1);
+        uint64_t off = 0, len = 0;
+        CHECK_INT(rsim_macho_segment(fat, size, x, "__TEXT", &off, &len), 0);
+        CHECK_INT(len, SLICE_SIZE);
+        CHECK(rsim_macho_segment(fat, size, x, "__DATA", &off, &len) != 0);
+    }
+    CHECK(rsim_macho_find_slice(slices, 2, RSIM_CPU_ARM64) == NULL);
+
+    /* Java class files share the fat magic; their "slice count" is a version */
+    uint8_t java[8];
+    put32be(java, 0xcafebabe);
+    put32be(java + 4, 52);
+    CHECK(!rsim_macho_sniff(java, sizeof(java)));
+    free(fat);
+}
+
+static void test_add_thin(void) {
+    uint8_t *image = malloc(SLICE_SIZE);
+    build_slice(image, RSIM_CPU_X86_64, 1, 0x1000);
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    CHECK_INT(rsim_macho_slices(image, SLICE_SIZE, slices, RSIM_MACHO_MAX_SLICES), 1);
+    CHECK_INT(rsim_macho_has_dylib(image, SLICE_SIZE, &slices[0], LIBSYSTEM), 1);
+    CHECK_INT(rsim_macho_has_dylib(image, SLICE_SIZE, &slices[0], INJECT), 0);
+
+    long room = rsim_macho_header_room(image, SLICE_SIZE, &slices[0]);
+    CHECK_INT(room, 0x1000 - (32 + 152 + 56));
+    CHECK_INT(rsim_macho_add_dylib(image, SLICE_SIZE, &slices[0], INJECT), 0);
+    CHECK_INT(rsim_macho_has_dylib(image, SLICE_SIZE, &slices[0], INJECT), 1);
+    CHECK_INT(get32(image + 16), 3);
+    uint32_t cmdsize = (24 + sizeof(INJECT) + 7) & ~7u;
+    CHECK_INT(rsim_macho_header_room(image, SLICE_SIZE, &slices[0]), room - cmdsize);
+    CHECK_INT(image[0x1000], 0xCC);             /* section data untouched */
+
+    /* Re-adding is a no-op, byte for byte */
+    uint8_t *copy = malloc(SLICE_SIZE);
+    memcpy(copy, image, SLICE_SIZE);
+    CHECK_INT(rsim_macho_add_dylib(image, SLICE_SIZE, &slices[0], INJECT), 1);
+    CHECK(memcmp(copy, image, SLICE_SIZE) == 0);
+    free(copy);
+    free(image);
+}
+
+static void test_add_fat(void) {
+    size_t size;
+    uint8_t *fat = build_fat(&size);
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    int count = rsim_macho_slices(fat, size, slices, RSIM_MACHO_MAX_SLICES);
+    CHECK_INT(count, 2);
+
+    CHECK_INT(rsim_macho_add_dylib(fat, size, &slices[0], INJECT), 0);
+    CHECK_INT(rsim_macho_has_dylib(fat, size, &slices[1], INJECT), 0);   /* one slice at a time */
+    CHECK_INT(rsim_macho_add_dylib(fat, size, &slices[1], INJECT), 0);
+    for (int i = 0; i < count; i++) {
+        CHECK_INT(rsim_macho_has_dylib(fat, size, &slices[i], INJECT), 1);
+        CHECK_INT(rsim_macho_has_dylib(fat, size, &slices[i], LIBSYSTEM), 1);
+    }
+    /* 32-bit load commands are 4-byte aligned */
+    CHECK_INT(get32(fat + 2 * SLICE_SIZE + 20), 124 + 56 + ((24 + sizeof(INJECT) + 3) & ~3u));
+
+    uint8_t *copy = malloc(size);
+    memcpy(copy, fat, size);
+    for (int i = 0; i < count; i++) CHECK_INT(rsim_macho_add_dylib(fat, size, &slices[i], INJECT), 1);
+    CHECK(memcmp(copy, fat, size) == 0);
+    free(copy);
+    free(fat);
+}
+
+static void test_no_room(void) {
+    uint8_t *image = malloc(SLICE_SIZE);
+    uint32_t end = 32 + 152 + 56;
+    build_slice(image, RSIM_CPU_X86_64, 1, end + 16);
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    CHECK_INT(rsim_macho_slices(image, SLICE_SIZE, slices, RSIM_MACHO_MAX_SLICES), 1);
+    CHECK_INT(rsim_macho_header_room(image, SLICE_SIZE, &slices[0]), 16);
+
+    uint8_t *copy = malloc(SLICE_SIZE);
+    memcpy(copy, image, SLICE_SIZE);
+    CHECK_INT(rsim_macho_add_dylib(image, SLICE_SIZE, &slices[0], INJECT), -2);
+    CHECK(memcmp(copy, image, SLICE_SIZE) == 0);
+
+    /* Data right at the end of the commands: no room at all */
+    build_slice(image, RSIM_CPU_X86_64, 1, end);
+    CHECK_INT(rsim_macho_header_room(image, SLICE_SIZE, &slices[0]), 0);
+    CHECK_INT(rsim_macho_add_dylib(image, SLICE_SIZE, &slices[0], "/a"), -2);
+    free(copy);
+    free(image);
+}
+
+static void test_truncated(void) {
+    uint8_t *image = malloc(SLICE_SIZE);
+    build_slice(image, RSIM_CPU_X86_64, 1, 0x1000);
+    uint8_t *copy = malloc(SLICE_SIZE);
+    memcpy(copy, image, SLICE_SIZE);
+    /* Cut inside the header, the segment command and the dylib command */
+    size_t cuts[] = { 0, 3, 16, 31, 32 + 40, 32 + 152 + 8, 32 + 152 + 40 };
+    for (size_t i = 0; i < sizeof(cuts) / sizeof(cuts[0]); i++) {
+        RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+        int count = rsim_macho_slices(image, cuts[i], slices, RSIM_MACHO_MAX_SLICES);
+        if (count > 0) {
+            CHECK(rsim_macho_header_room(image, cuts[i], &slices[0]) < 0);
+            CHECK_INT(rsim_macho_add_dylib(image, cuts[i], &slices[0], INJECT), -1);
+        }
+    }
+    CHECK(memcmp(copy, image, SLICE_SIZE) == 0);
+
+    /* A fat file cut inside its last slice keeps only the slices it holds */
+    size_t size;
+    uint8_t *fat = build_fat(&size);
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    CHECK_INT(rsim_macho_slices(fat, size - 1, slices, RSIM_MACHO_MAX_SLICES), 1);
+    CHECK_INT(slices[0].cputype, RSIM_CPU_X86_64);
+    CHECK_INT(rsim_macho_slices(fat, 20, slices, RSIM_MACHO_MAX_SLICES), 0);
+    free(fat);
+    free(copy);
+    free(image);
+}
+
+int main(void) {
+    RUN(test_sniff_and_slices);
+    RUN(test_add_thin);
+    RUN(test_add_fat);
+    RUN(test_no_room);
+    RUN(test_truncated);
+    return test_report("test_macho");
+}
@@ -0,0 +1,188 @@
+/*
+ * test_match.c — Pyramid NCC template matching: exact crops, repeats, edges, thresholds
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_match.h"
+
+#include <time.h>
+
+static char g_root[512];
+
+/* Frame of the size of a 12.9" iPad screen, filled with noise: the worst
+ * case for a pyramid, since nothing survives averaging but the phase */
+#define NOISE_W     2048
+#define NOISE_H     2732
+
+static uint8_t *noise_frame(int w, int h, size_t bpr, uint64_t seed) {
+    uint8_t *p = malloc(bpr * h);
+    for (size_t i = 0; i < bpr * h; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        p[i] = (uint8_t)seed;
+    }
+    return p;
+}
+
+/* Luma template cropped from a BGRA frame */
+static RSimGray crop(const uint8_t *bgra, size_t bpr, int x, int y, int w, int h) {
+    RSimGray t = {0};
+    rsim_gray_from_bgra(&t, bgra + (size_t)y * bpr + (size_t)x * 4, w, h, bpr);
+    return t;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void test_exact_crops(void) {
+    /* Crops at offsets that are not multiples of any block size, at the
+     * edges, and at the offset that used to be missed entirely */
+    size_t bpr = NOISE_W * 4;
+    uint8_t *frame = noise_frame(NOISE_W, NOISE_H, bpr, 0x9e3779b97f4a7c15ull);
+    static const int sizes[][2] = { { 64, 64 }, { 48, 80 }, { 100, 100 }, { 128, 96 } };
+    static const int offsets[][2] = { { 1333, 2011 }, { 4, 4 }, { 1001, 3 }, { 5, 7 }, { 777, 1555 },
+                                      { -1, -1 } /* bottom-right corner */ };
+    int found = 0, tried = 0;
+    double worst_ms = 0;
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+        for (size_t oi = 0; oi < sizeof(offsets) / sizeof(offsets[0]); oi++) {
+            int w = sizes[si][0], h = sizes[si][1];
+            int x = offsets[oi][0] < 0 ? NOISE_W - w : offsets[oi][0];
+            int y = offsets[oi][1] < 0 ? NOISE_H - h : offsets[oi][1];
+            RSimGray t = crop(frame, bpr, x, y, w, h);
+            RSimMatch m[4];
+            double t0 = now_ms();
+            int n = rsim_match_bgra(frame, NOISE_W, NOISE_H, bpr, &t, 0.5f, m, 4);
+            double ms = now_ms() - t0;
+            if (ms > worst_ms) worst_ms = ms;
+            tried++;
+            if (n == 1 && m[0].x == x && m[0].y == y && m[0].score > 0.99f &&
+                m[0].width == w && m[0].height == h) {
+                found++;
+            } else {
+                fprintf(stderr, "  %dx%d at %d,%d: %d matches, best %d,%d %.3f\n", w, h, x, y, n,
+                        n > 0 ? m[0].x : -1, n > 0 ? m[0].y : -1, n > 0 ? m[0].score : 0.0f);
+            }
+            rsim_gray_free(&t);
+        }
+    }
+    CHECK_INT(found, tried);
+    printf("  (%d crops of a %dx%d noise frame, slowest %.1f ms)\n", tried, NOISE_W, NOISE_H, worst_ms);
+    free(frame);
+}
+
+static void test_small_template(void) {
+    /* Too small for a pyramid: scored at every position of level 0 */
+    int w = 300, h = 200;
+    size_t bpr = w * 4 + 32;
+    uint8_t *frame = noise_frame(w, h, bpr, 42);
+    RSimGray t = crop(frame, bpr, 151, 97, 12, 9);
+    RSimMatch m[2];
+    CHECK_INT(rsim_match_bgra(frame, w, h, bpr, &t, 0.9f, m, 2), 1);
+    CHECK_INT(m[0].x, 151);
+    CHECK_INT(m[0].y, 97);
+    CHECK(m[0].score > 0.99f);
+    rsim_gray_free(&t);
+    free(frame);
+}
+
+/* A flat-ish screen with the same button drawn several times */
+static void draw_button(uint8_t *bgra, size_t bpr, int x0, int y0) {
+    for (int y = 0; y < 44; y++)
+        for (int x = 0; x < 120; x++) {
+            uint8_t *p = bgra + (size_t)(y0 + y) * bpr + (size_t)(x0 + x) * 4;
+            int border = x < 2 || y < 2 || x >= 118 || y >= 42;
+            int glyph = y > 14 && y < 30 && x > 20 && x < 100 && ((x / 6 + y / 5) % 3 == 0);
+            uint8_t v = border ? 40 : glyph ? 250 : 180;
+            p[0] = v;
+            p[1] = v;
+            p[2] = (uint8_t)(v / 2);
+            p[3] = 255;
+        }
+}
+
+static void test_repeated_elements(void) {
+    int w = 750, h = 1334;
+    size_t bpr = w * 4;
+    uint8_t *frame = malloc(bpr * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = frame + (size_t)y * bpr + (size_t)x * 4;
+            p[0] = (uint8_t)(200 + y % 17);
+            p[1] = (uint8_t)(210 + x % 13);
+            p[2] = 220;
+            p[3] = 255;
+        }
+    static const int at[][2] = { { 33, 101 }, { 401, 257 }, { 97, 613 }, { 555, 999 }, { 211, 1201 } };
+    for (int i = 0; i < 5; i++) draw_button(frame, bpr, at[i][0], at[i][1]);
+    RSimGray t = crop(frame, bpr, at[2][0], at[2][1], 120, 44);
+
+    RSimMatch m[8];
+    int n = rsim_match_bgra(frame, w, h, bpr, &t, 0.9f, m, 8);
+    CHECK_INT(n, 5);
+    int hits = 0;
+    for (int i = 0; i < n; i++) {
+        CHECK(m[i].score > 0.95f);
+        if (i) CHECK(m[i].score <= m[i - 1].score);
+        for (int k = 0; k < 5; k++) hits += m[i].x == at[k][0] && m[i].y == at[k][1];
+    }
+    CHECK_INT(hits, 5);
+
+    /* max_matches caps the list, best first */
+    CHECK_INT(rsim_match_bgra(frame, w, h, bpr, &t, 0.9f, m, 2), 2);
+
+    /* The luma entry point finds the same */
+    RSimGray gray;
+    CHECK_INT(rsim_gray_from_bgra(&gray, frame, w, h, bpr), 0);
+    CHECK_INT(rsim_match_template(&gray, &t, 0.9f, m, 8), 5);
+    rsim_gray_free(&gray);
+    rsim_gray_free(&t);
+    free(frame);
+}
+
+static void test_no_match(void) {
+    size_t bpr = 1024 * 4;
+    uint8_t *frame = noise_frame(1024, 768, bpr, 7), *other = noise_frame(256, 256, 256 * 4, 8);
+    RSimGray t = crop(other, 256 * 4, 40, 40, 64, 64);
+    RSimMatch m[4];
+    CHECK_INT(rsim_match_bgra(frame, 1024, 768, bpr, &t, 0.6f, m, 4), 0);
+
+    /* A template larger than the frame, and bad arguments */
+    RSimGray big = crop(other, 256 * 4, 0, 0, 256, 256);
+    CHECK_INT(rsim_match_bgra(frame, 200, 200, bpr, &big, 0.5f, m, 4), 0);
+    CHECK_INT(rsim_match_bgra(NULL, 1024, 768, bpr, &t, 0.5f, m, 4), -1);
+    CHECK_INT(rsim_match_bgra(frame, 1024, 768, bpr, &t, 0.5f, m, 0), -1);
+    rsim_gray_free(&big);
+    rsim_gray_free(&t);
+    free(frame);
+    free(other);
+}
+
+static void test_downsample(void) {
+    RSimGray in = { malloc(5 * 3 * sizeof(float)), 5, 3 }, out;
+    for (int i = 0; i < 15; i++) in.px[i] = (float)i;
+    CHECK_INT(rsim_gray_downsample(&out, &in), 0);
+    CHECK_INT(out.width, 2);
+    CHECK_INT(out.height, 1);
+    CHECK_NEAR(out.px[0], (0 + 1 + 5 + 6) / 4.0, 1e-6);
+    CHECK_NEAR(out.px[1], (2 + 3 + 7 + 8) / 4.0, 1e-6);
+    rsim_gray_free(&out);
+    RSimGray one = { in.px, 1, 1 };
+    CHECK_INT(rsim_gray_downsample(&out, &one), -1);
+    rsim_gray_free(&in);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "match");
+    RUN(test_exact_crops);
+    RUN(test_small_template);
+    RUN(test_repeated_elements);
+    RUN(test_no_match);
+    RUN(test_downsample);
+    test_rmtree(g_root);
+    return test_report("test_match");
+}
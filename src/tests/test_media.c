@@ -0,0 +1,247 @@
+/*
+ * test_media.c — Media import: DCIM names, copy + thumbnail pool, Photos.sqlite rows
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_media.h"
+
+#include <dirent.h>
+#include <sqlite3.h>
+
+static char g_root[512];
+
+/* Stand-in for ImageIO: a 1000x750 gradient, whatever the file holds */
+static int fake_decode(const char *path, int max_side, RSimBitmap *out, int *width, int *height, void *ctx) {
+    int *calls = ctx;
+    __sync_fetch_and_add(calls, 1);
+    int w = 1000, h = 750;
+    size_t need = (size_t)w * h * 4;
+    if (need > out->capacity) {
+        uint8_t *grown = realloc(out->px, need);
+        if (!grown) return -1;
+        out->px = grown;
+        out->capacity = need;
+    }
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = out->px + ((size_t)y * w + x) * 4;
+            p[0] = (uint8_t)x;
+            p[1] = (uint8_t)y;
+            p[2] = 128;
+            p[3] = 255;
+        }
+    out->width = *width = w;
+    out->height = *height = h;
+    out->bytes_per_row = (size_t)w * 4;
+    return 0;
+}
+
+/* Width and height from a JPEG's SOF marker, or -1 */
+static int jpeg_size(const uint8_t *jpeg, size_t len, int *w, int *h) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) return -1;
+    for (size_t i = 2; i + 9 < len;) {
+        if (jpeg[i] != 0xFF) return -1;
+        uint8_t marker = jpeg[i + 1];
+        size_t seg = (size_t)jpeg[i + 2] << 8 | jpeg[i + 3];
+        if (marker >= 0xC0 && marker <= 0xC2) {
+            *h = jpeg[i + 5] << 8 | jpeg[i + 6];
+            *w = jpeg[i + 7] << 8 | jpeg[i + 8];
+            return 0;
+        }
+        i += 2 + seg;
+    }
+    return -1;
+}
+
+static void put_source(const char *dir, const char *name, const char *content, char *path, size_t size) {
+    char d[700];
+    snprintf(d, sizeof(d), "%s/src/%s", g_root, dir);
+    mkdir(d, 0755);
+    snprintf(path, size, "%s/%s", d, name);
+    CHECK_INT(test_write_file(path, content, strlen(content)), 0);
+}
+
+static void test_asset_init(void) {
+    char path[800];
+    put_source(".", "Clip.MOV", "moov", path, sizeof(path));
+    RSimMediaAsset a;
+    CHECK_INT(rsim_media_asset_init(&a, path), 0);
+    CHECK_STR(a.name, "Clip.MOV");
+    CHECK_INT(a.kind, RSIM_MEDIA_VIDEO);
+    CHECK_STR(a.uti, "com.apple.quicktime-movie");
+    CHECK_INT(a.size, 4);
+    CHECK_INT(strlen(a.uuid), 36);
+    CHECK_INT(a.uuid[14], '4');
+    snprintf(path, sizeof(path), "%s/src", g_root);
+    CHECK_INT(rsim_media_asset_init(&a, path), -1);      /* a directory */
+}
+
+static void test_thumbnail(void) {
+    RSimBitmap src = {0};
+    int w, h, calls = 0;
+    CHECK_INT(fake_decode("x", 256, &src, &w, &h, &calls), 0);
+    uint8_t *jpeg = NULL;
+    size_t len = 0;
+    CHECK_INT(rsim_media_thumbnail(&src, 256, 80, &jpeg, &len), 0);
+    int tw = 0, th = 0;
+    CHECK_INT(jpeg_size(jpeg, len, &tw, &th), 0);
+    CHECK_INT(tw, 256);
+    CHECK_INT(th, 192);
+    free(jpeg);
+
+    /* Small images keep their size */
+    src.width = 100;
+    src.height = 40;
+    CHECK_INT(rsim_media_thumbnail(&src, 256, 80, &jpeg, &len), 0);
+    CHECK_INT(jpeg_size(jpeg, len, &tw, &th), 0);
+    CHECK_INT(tw, 100);
+    CHECK_INT(th, 40);
+    free(jpeg);
+
+    src.width = 0;
+    CHECK_INT(rsim_media_thumbnail(&src, 256, 80, &jpeg, &len), -1);
+    rsim_bitmap_free(&src);
+}
+
+static void check_content(const char *path, const char *want) {
+    char *got = test_read_file(path, NULL);
+    CHECK(got != NULL);
+    if (got) CHECK_STR(got, want);
+    free(got);
+}
+
+static RSimMediaAsset g_assets[5];
+
+static void test_import_names(void) {
+    char device[600], dcim[700], path[1200];
+    snprintf(device, sizeof(device), "%s/device", g_root);
+    snprintf(dcim, sizeof(dcim), "%s/" RSIM_MEDIA_DCIM_DIR, device);
+    snprintf(path, sizeof(path), "%s/src", g_root);
+    mkdir(path, 0755);
+
+    /* Already in the library: must survive the import untouched */
+    snprintf(path, sizeof(path), "%s/Media", device);
+    mkdir(device, 0755);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/Media/DCIM", device);
+    mkdir(path, 0755);
+    mkdir(dcim, 0755);
+    snprintf(path, sizeof(path), "%s/IMG_0001.JPG", dcim);
+    CHECK_INT(test_write_file(path, "existing", 8), 0);
+
+    static char sources[5][800];
+    put_source("a", "IMG_0001.JPG", "first", sources[0], sizeof(sources[0]));
+    put_source("b", "IMG_0001.JPG", "second", sources[1], sizeof(sources[1]));
+    put_source("c", "img_0001.jpg", "third, other case", sources[2], sizeof(sources[2]));
+    put_source("a", "IMG_0002.PNG", "fourth", sources[3], sizeof(sources[3]));
+    put_source("a", "clip.mov", "movie", sources[4], sizeof(sources[4]));
+    for (int i = 0; i < 5; i++) CHECK_INT(rsim_media_asset_init(&g_assets[i], sources[i]), 0);
+
+    int calls = 0;
+    RSimMediaImportOpts opts = { .device_root = device, .jobs = 4, .decode = fake_decode, .decode_ctx = &calls };
+    RSimMediaStats stats;
+    CHECK_INT(rsim_media_import(g_assets, 5, &opts, &stats), 0);
+    CHECK_INT(stats.copied, 5);
+    CHECK_INT(stats.failed, 0);
+    CHECK_INT(stats.thumbnailed, 4);        /* not the movie */
+    CHECK_INT(calls, 4);
+
+    CHECK_STR(g_assets[0].name, "IMG_0001-1.JPG");
+    CHECK_STR(g_assets[1].name, "IMG_0001-2.JPG");
+    CHECK_STR(g_assets[2].name, "img_0001-3.jpg");
+    CHECK_STR(g_assets[3].name, "IMG_0002.PNG");
+    CHECK_STR(g_assets[4].name, "clip.mov");
+    CHECK_INT(g_assets[0].width, 1000);
+
+    snprintf(path, sizeof(path), "%s/IMG_0001.JPG", dcim);
+    check_content(path, "existing");
+    const char *want[] = { "first", "second", "third, other case", "fourth", "movie" };
+    for (int i = 0; i < 5; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dcim, g_assets[i].name);
+        check_content(path, want[i]);
+        snprintf(path, sizeof(path), "%s/" RSIM_MEDIA_THUMB_DIR "/DCIM/100APPLE/%s/" RSIM_MEDIA_THUMB_NAME,
+                 device, g_assets[i].name);
+        CHECK_INT(access(path, F_OK) == 0, g_assets[i].thumbnailed);
+    }
+
+    /* Nothing else in DCIM: no temp files left behind */
+    DIR *d = opendir(dcim);
+    int entries = 0;
+    for (struct dirent *e; d && (e = readdir(d));)
+        if (e->d_name[0] != '.') entries++;
+    if (d) closedir(d);
+    CHECK_INT(entries, 6);
+}
+
+static void make_library(const char *db_path) {
+    sqlite3 *db = NULL;
+    CHECK_INT(sqlite3_open(db_path, &db), SQLITE_OK);
+    CHECK_INT(sqlite3_exec(db,
+        "CREATE TABLE Z_PRIMARYKEY (Z_ENT INTEGER PRIMARY KEY, Z_NAME VARCHAR, Z_SUPER INTEGER, Z_MAX INTEGER);"
+        "INSERT INTO Z_PRIMARYKEY VALUES (3, 'GenericAsset', 0, 7), (4, 'Asset', 3, 0);"
+        "CREATE TABLE ZGENERICASSET (Z_PK INTEGER PRIMARY KEY, Z_ENT INTEGER, Z_OPT INTEGER, ZKIND INTEGER, "
+        "ZWIDTH INTEGER, ZHEIGHT INTEGER, ZDATECREATED TIMESTAMP, ZDIRECTORY VARCHAR, ZFILENAME VARCHAR, "
+        "ZUUID VARCHAR, ZUNIFORMTYPEIDENTIFIER VARCHAR, ZCOMPLETE INTEGER);"
+        "INSERT INTO ZGENERICASSET (Z_PK, Z_ENT, ZDIRECTORY, ZFILENAME) VALUES (2, 4, 'DCIM/100APPLE', 'IMG_0001.JPG');",
+        NULL, NULL, NULL), SQLITE_OK);
+    sqlite3_close(db);
+}
+
+static long long query_int(const char *db_path, const char *sql) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    long long v = -1;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        v = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return v;
+}
+
+static void test_index(void) {
+    char db[800], err[256];
+    snprintf(db, sizeof(db), "%s/device/Media/PhotoData", g_root);
+    mkdir(db, 0755);
+    snprintf(db, sizeof(db), "%s/device/" RSIM_MEDIA_PHOTOS_DB, g_root);
+
+    /* No library yet: assetsd creates it, we don't */
+    CHECK_INT(rsim_media_index(db, g_assets, 5, err, sizeof(err)), -1);
+    CHECK(access(db, F_OK) != 0);
+
+    make_library(db);
+    CHECK_INT(rsim_media_index(db, g_assets, 5, err, sizeof(err)), 5);
+    CHECK_STR(err, "");
+    CHECK_INT(query_int(db, "SELECT count(*) FROM ZGENERICASSET"), 6);
+    CHECK_INT(query_int(db, "SELECT min(Z_PK) FROM ZGENERICASSET WHERE Z_PK <> 2"), 8);    /* past Z_MAX */
+    CHECK_INT(query_int(db, "SELECT Z_MAX FROM Z_PRIMARYKEY WHERE Z_NAME = 'Asset'"), 12);
+    CHECK_INT(query_int(db, "SELECT ZKIND FROM ZGENERICASSET WHERE ZFILENAME = 'clip.mov'"), 1);
+    CHECK_INT(query_int(db, "SELECT ZWIDTH FROM ZGENERICASSET WHERE ZFILENAME = 'IMG_0001-1.JPG'"), 1000);
+
+    /* Same assets again: nothing new */
+    CHECK_INT(rsim_media_index(db, g_assets, 5, err, sizeof(err)), 0);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM ZGENERICASSET"), 6);
+
+    /* A database without an asset table is refused */
+    char other[800];
+    snprintf(other, sizeof(other), "%s/other.sqlite", g_root);
+    sqlite3 *o = NULL;
+    sqlite3_open(other, &o);
+    sqlite3_exec(o, "CREATE TABLE t (x)", NULL, NULL, NULL);
+    sqlite3_close(o);
+    CHECK_INT(rsim_media_index(other, g_assets, 5, err, sizeof(err)), -1);
+    CHECK_STR(err, "not a Photos library (no asset table)");
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "media");
+    char src[600];
+    snprintf(src, sizeof(src), "%s/src", g_root);
+    mkdir(src, 0755);
+    RUN(test_asset_init);
+    RUN(test_thumbnail);
+    RUN(test_import_names);
+    RUN(test_index);
+    test_rmtree(g_root);
+    return test_report("test_media");
+}
@@ -0,0 +1,290 @@
+/*
+ * test_monkey.c — Monkey action choice: seeded determinism, type weights, cells, feedback, exploration
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_monkey.h"
+#include "common/rosettasim_phash.h"
+
+static char g_root[512];
+
+#define SCREEN_W    375.0f
+#define SCREEN_H    667.0f
+
+/* Hashes far apart (well beyond merge_distance), one per simulated screen */
+static uint64_t screen_hash(int i) {
+    uint64_t z = (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    return z ^ (z >> 31);
+}
+
+static int same_action(const RSimMonkeyAction *a, const RSimMonkeyAction *b) {
+    return a->type == b->type && a->x == b->x && a->y == b->y && a->x2 == b->x2 && a->y2 == b->y2 &&
+           a->duration_ms == b->duration_ms && a->cell == b->cell && strcmp(a->text, b->text) == 0;
+}
+
+/* A simulated app: each screen has a few live cells that lead to another
+ * screen; a tap anywhere else, a swipe or text changes nothing */
+#define APP_SCREENS     200
+#define APP_LIVE        3
+
+typedef struct {
+    int cell[APP_LIVE];
+    int next[APP_LIVE];
+} AppScreen;
+
+static void make_app(AppScreen *app, uint32_t seed) {
+    for (int s = 0; s < APP_SCREENS; s++)
+        for (int k = 0; k < APP_LIVE; k++) {
+            seed = seed * 1103515245u + 12345u;
+            app[s].cell[k] = (int)((seed >> 8) % RSIM_MONKEY_CELLS);
+            seed = seed * 1103515245u + 12345u;
+            app[s].next[k] = (int)((seed >> 8) % APP_SCREENS);
+        }
+}
+
+static int app_step(const AppScreen *app, int screen, const RSimMonkeyAction *a) {
+    if (a->type != RSIM_MONKEY_TAP) return screen;
+    for (int k = 0; k < APP_LIVE; k++)
+        if (app[screen].cell[k] == a->cell) return app[screen].next[k];
+    return screen;
+}
+
+/* Distinct screens reached in `actions` steps; with guided == 0 the monkey
+ * never hears back, so every pick is a uniform one */
+static int explore(const AppScreen *app, uint64_t seed, int actions, int guided) {
+    RSimMonkey m;
+    rsim_monkey_init(&m, seed, SCREEN_W, SCREEN_H);
+    m.weights[RSIM_MONKEY_SWIPE] = m.weights[RSIM_MONKEY_TEXT] = 0;
+    char seen[APP_SCREENS] = { 1 };
+    int screen = 0, reached = 1;
+    if (guided) rsim_monkey_visit(&m, screen_hash(screen));
+    for (int i = 0; i < actions; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, screen_hash(screen), &a);
+        int after = app_step(app, screen, &a);
+        if (guided) rsim_monkey_feedback(&m, screen_hash(screen), &a, screen_hash(after));
+        if (!seen[after]) {
+            seen[after] = 1;
+            reached++;
+        }
+        screen = after;
+    }
+    rsim_monkey_free(&m);
+    return reached;
+}
+
+static void test_determinism(void) {
+    /* Same seed and the same screens: the same actions, to the bit */
+    RSimMonkey a, b, c;
+    rsim_monkey_init(&a, 1234, SCREEN_W, SCREEN_H);
+    rsim_monkey_init(&b, 1234, SCREEN_W, SCREEN_H);
+    rsim_monkey_init(&c, 1235, SCREEN_W, SCREEN_H);
+    int differ = 0, differ_seed = 0;
+    for (int i = 0; i < 500; i++) {
+        uint64_t before = screen_hash(i % 7), after = screen_hash((i * 3) % 7);
+        RSimMonkeyAction x, y, z;
+        rsim_monkey_next(&a, before, &x);
+        rsim_monkey_next(&b, before, &y);
+        rsim_monkey_next(&c, before, &z);
+        differ += !same_action(&x, &y);
+        differ_seed += !same_action(&x, &z);
+        rsim_monkey_feedback(&a, before, &x, after);
+        rsim_monkey_feedback(&b, before, &y, after);
+        rsim_monkey_feedback(&c, before, &z, after);
+    }
+    CHECK_INT(differ, 0);
+    CHECK(differ_seed > 400);
+    CHECK_INT(a.screen_count, b.screen_count);
+    CHECK_INT(a.changes, b.changes);
+    CHECK_INT(memcmp(a.screens, b.screens, sizeof(RSimMonkeyScreen) * a.screen_count), 0);
+    rsim_monkey_free(&a);
+    rsim_monkey_free(&b);
+    rsim_monkey_free(&c);
+}
+
+static void test_weights(void) {
+    /* The default 70/20/10 mix over many draws */
+    RSimMonkey m;
+    rsim_monkey_init(&m, 7, SCREEN_W, SCREEN_H);
+    int count[RSIM_MONKEY_TYPES] = {0};
+    for (int i = 0; i < 20000; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, 0, &a);
+        count[a.type]++;
+    }
+    CHECK_NEAR(count[RSIM_MONKEY_TAP] / 20000.0, 0.70, 0.015);
+    CHECK_NEAR(count[RSIM_MONKEY_SWIPE] / 20000.0, 0.20, 0.015);
+    CHECK_NEAR(count[RSIM_MONKEY_TEXT] / 20000.0, 0.10, 0.015);
+
+    /* A zero or negative weight leaves a type out; all zero falls back to taps */
+    m.weights[RSIM_MONKEY_TAP] = 0;
+    m.weights[RSIM_MONKEY_SWIPE] = 1;
+    m.weights[RSIM_MONKEY_TEXT] = -5;
+    int other = 0;
+    for (int i = 0; i < 2000; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, 0, &a);
+        other += a.type != RSIM_MONKEY_SWIPE;
+    }
+    CHECK_INT(other, 0);
+    memset(m.weights, 0, sizeof(m.weights));
+    RSimMonkeyAction a;
+    rsim_monkey_next(&m, 0, &a);
+    CHECK_INT(a.type, RSIM_MONKEY_TAP);
+    rsim_monkey_free(&m);
+}
+
+static void test_action_shapes(void) {
+    /* Points inside the screen and inside their cell; tap holds, swipe
+     * lengths and text within the limits the ctl paces by */
+    RSimMonkey m;
+    rsim_monkey_init(&m, 99, SCREEN_W, SCREEN_H);
+    float cw = SCREEN_W / RSIM_MONKEY_COLS, ch = SCREEN_H / RSIM_MONKEY_ROWS;
+    int bad_point = 0, bad_cell = 0, bad_shape = 0;
+    for (int i = 0; i < 5000; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, 0, &a);
+        bad_point += a.x < 0 || a.x >= SCREEN_W || a.y < 0 || a.y >= SCREEN_H ||
+                     a.x2 < 0 || a.x2 >= SCREEN_W || a.y2 < 0 || a.y2 >= SCREEN_H;
+        bad_cell += a.cell < 0 || a.cell >= RSIM_MONKEY_CELLS ||
+                    (int)(a.x / cw) != a.cell % RSIM_MONKEY_COLS || (int)(a.y / ch) != a.cell / RSIM_MONKEY_COLS;
+        switch (a.type) {
+        case RSIM_MONKEY_TAP:
+            bad_shape += a.duration_ms < 16 || a.duration_ms > 47 || a.x2 != a.x || a.y2 != a.y;
+            break;
+        case RSIM_MONKEY_SWIPE:
+            bad_shape += a.duration_ms < 60 || a.duration_ms > 179 || (a.x2 == a.x && a.y2 == a.y);
+            break;
+        case RSIM_MONKEY_TEXT:
+            bad_shape += strlen(a.text) < 1 || strlen(a.text) > 4;
+            break;
+        default:
+            bad_shape++;
+        }
+    }
+    CHECK_INT(bad_point, 0);
+    CHECK_INT(bad_cell, 0);
+    CHECK_INT(bad_shape, 0);
+    rsim_monkey_free(&m);
+}
+
+static void test_cell_choice(void) {
+    /* On an unknown screen every cell is equally likely */
+    RSimMonkey m;
+    rsim_monkey_init(&m, 5, SCREEN_W, SCREEN_H);
+    int hits[RSIM_MONKEY_CELLS] = {0}, lo = 1 << 30, hi = 0;
+    for (int i = 0; i < 60000; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, screen_hash(0), &a);
+        hits[a.cell]++;
+    }
+    for (int c = 0; c < RSIM_MONKEY_CELLS; c++) {
+        if (hits[c] < lo) lo = hits[c];
+        if (hits[c] > hi) hi = hits[c];
+    }
+    CHECK(lo > 850 && hi < 1150);
+
+    /* One cell that changes the screen and one that was tried a lot for
+     * nothing: the first is picked far more often than an untried cell,
+     * the second far less */
+    uint64_t home = screen_hash(0);
+    rsim_monkey_visit(&m, home);
+    RSimMonkeyAction act = { .type = RSIM_MONKEY_TAP, .cell = 13 };
+    rsim_monkey_feedback(&m, home, &act, screen_hash(1));
+    act.cell = 40;
+    for (int i = 0; i < 30; i++) rsim_monkey_feedback(&m, home, &act, home);
+    CHECK(m.screens[0].reward[13] > 0);
+    int productive = 0, dull = 0, untried = 0;
+    for (int i = 0; i < 60000; i++) {
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, home, &a);
+        productive += a.cell == 13;
+        dull += a.cell == 40;
+        untried += a.cell == 0;
+    }
+    CHECK(productive > untried * 2);
+    CHECK(dull * 10 < untried);
+    rsim_monkey_free(&m);
+}
+
+static void test_feedback(void) {
+    RSimMonkey m;
+    rsim_monkey_init(&m, 1, SCREEN_W, SCREEN_H);
+    uint64_t a = screen_hash(0), b = screen_hash(1);
+    CHECK_INT(rsim_monkey_visit(&m, a), 0);
+    RSimMonkeyAction act = { .type = RSIM_MONKEY_TAP, .cell = 2 };
+
+    /* To a new screen: a change, rewarded 1 / its visits */
+    CHECK_INT(rsim_monkey_feedback(&m, a, &act, b), 1);
+    CHECK_INT(m.screen_count, 2);
+    CHECK_INT(m.screens[0].tried[2], 1);
+    CHECK_NEAR(m.screens[0].reward[2], 1.0, 1e-6);
+    CHECK_INT(m.screens[1].visits, 1);
+
+    /* Back again: the second visit is worth half */
+    CHECK_INT(rsim_monkey_feedback(&m, b, &act, a), 1);
+    CHECK_INT(rsim_monkey_feedback(&m, a, &act, b), 1);
+    CHECK_NEAR(m.screens[0].reward[2], 1.5, 1e-6);
+
+    /* A hash within merge_distance bits is the same screen: no change */
+    uint64_t near = b ^ 0x8000000000000101ull;
+    CHECK_INT(rsim_hash_distance(near, b), 3);
+    CHECK_INT(rsim_monkey_feedback(&m, b, &act, near), 0);
+    CHECK_INT(m.screen_count, 2);
+    CHECK_INT(m.screens[1].tried[2], 2);
+
+    /* A replayed action has no cell: it comes from the point */
+    RSimMonkeyAction replayed = { .type = RSIM_MONKEY_TAP, .cell = -1,
+                                  .x = SCREEN_W - 1, .y = SCREEN_H - 1 };
+    CHECK_INT(rsim_monkey_feedback(&m, a, &replayed, a), 0);
+    CHECK_INT(m.screens[0].tried[RSIM_MONKEY_CELLS - 1], 1);
+    CHECK_INT(m.actions, 5);
+    CHECK_INT(m.changes, 3);
+    rsim_monkey_free(&m);
+    CHECK(m.screens == NULL);
+}
+
+static void test_guided_exploration(void) {
+    /* Against uniform taps on the simulated app, over several apps and seeds */
+    static AppScreen app[APP_SCREENS];
+    long guided = 0, uniform = 0;
+    int wins = 0, runs = 0;
+    for (uint32_t s = 1; s <= 10; s++) {
+        make_app(app, s);
+        for (uint64_t seed = 1; seed <= 5; seed++, runs++) {
+            int g = explore(app, seed, 2000, 1), u = explore(app, seed, 2000, 0);
+            guided += g;
+            uniform += u;
+            wins += g > u;
+        }
+    }
+    CHECK(guided > uniform);
+    CHECK(wins * 2 > runs);
+    printf("  (%d runs of 2000 taps: %.1f screens guided, %.1f uniform, %+.0f%%)\n", runs,
+           (double)guided / runs, (double)uniform / runs, 100.0 * (guided - uniform) / uniform);
+}
+
+static void test_type_names(void) {
+    RSimMonkeyType t;
+    for (int i = 0; i < RSIM_MONKEY_TYPES; i++) {
+        CHECK_INT(rsim_monkey_type_parse(rsim_monkey_type_name((RSimMonkeyType)i), &t), 0);
+        CHECK_INT(t, i);
+    }
+    CHECK_STR(rsim_monkey_type_name(RSIM_MONKEY_SWIPE), "swipe");
+    CHECK_STR(rsim_monkey_type_name(RSIM_MONKEY_TYPES), "?");
+    CHECK_INT(rsim_monkey_type_parse("drag", &t), -1);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "monkey");
+    RUN(test_determinism);
+    RUN(test_weights);
+    RUN(test_action_shapes);
+    RUN(test_cell_choice);
+    RUN(test_feedback);
+    RUN(test_guided_exploration);
+    RUN(test_type_names);
+    test_rmtree(g_root);
+    return test_report("test_monkey");
+}
@@ -0,0 +1,195 @@
+/*
+ * test_phash.c — Frame dHash: padded rows, small changes, distances, hex round-trip
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_phash.h"
+
+static char g_root[512];
+
+#define FRAME_W     750
+#define FRAME_H     1334
+
+static uint32_t next_rand(uint32_t *state) {
+    *state = *state * 1103515245u + 12345u;
+    return *state >> 8;
+}
+
+/* A screen of 9x8 blocks of flat grey, each block at least 24 levels away
+ * from its right neighbour, so every hash bit has a margin */
+static uint8_t *screen(int w, int h, size_t bpr, uint32_t seed) {
+    uint8_t *p = malloc(bpr * h), level[8][9];
+    memset(p, 0xa5, bpr * h);
+    for (int r = 0; r < 8; r++) {
+        level[r][0] = (uint8_t)(40 + next_rand(&seed) % 176);
+        for (int c = 1; c < 9; c++) {
+            int v;
+            do v = 40 + (int)(next_rand(&seed) % 176); while (abs(v - level[r][c - 1]) < 24);
+            level[r][c] = (uint8_t)v;
+        }
+    }
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            uint8_t v = level[(int64_t)y * 8 / h][(int64_t)x * 9 / w], *px = p + (size_t)y * bpr + (size_t)x * 4;
+            px[0] = v;
+            px[1] = v;
+            px[2] = v;
+            px[3] = 255;
+        }
+    return p;
+}
+
+/* Same rows, same cells, same weights as the core, one pixel at a time:
+ * checks the NEON / SSE sums and their tails */
+static uint64_t reference_dhash(const uint8_t *bgra, int w, int h, size_t bpr) {
+    uint64_t hash = 0;
+    for (int r = 0; r < 8; r++) {
+        int y0 = (int)((int64_t)r * h / 8), y1 = (int)((int64_t)(r + 1) * h / 8);
+        int step = (y1 - y0) / 16 > 1 ? (y1 - y0) / 16 : 1, rows = 0;
+        uint64_t sums[9][3] = {{0}}, luma[9];
+        for (int y = y0 + step / 2; y < y1; y += step, rows++)
+            for (int c = 0; c < 9; c++)
+                for (int x = (int)((int64_t)c * w / 9); x < (int)((int64_t)(c + 1) * w / 9); x++)
+                    for (int k = 0; k < 3; k++) sums[c][k] += bgra[(size_t)y * bpr + (size_t)x * 4 + k];
+        for (int c = 0; c < 9; c++) {
+            uint64_t n = (uint64_t)((int64_t)(c + 1) * w / 9 - (int64_t)c * w / 9) * (rows ? rows : 1);
+            luma[c] = (29 * sums[c][0] + 150 * sums[c][1] + 77 * sums[c][2]) * 16 / n;
+        }
+        for (int c = 0; c < 8; c++) hash = hash << 1 | (luma[c] > luma[c + 1]);
+    }
+    return hash;
+}
+
+static void test_identical(void) {
+    size_t bpr = FRAME_W * 4;
+    uint8_t *a = screen(FRAME_W, FRAME_H, bpr, 1), *b = malloc(bpr * FRAME_H);
+    memcpy(b, a, bpr * FRAME_H);
+    uint64_t ha = rsim_dhash_bgra(a, FRAME_W, FRAME_H, bpr);
+    CHECK(ha != 0);
+    CHECK(ha == rsim_dhash_bgra(b, FRAME_W, FRAME_H, bpr));
+    CHECK(ha == reference_dhash(a, FRAME_W, FRAME_H, bpr));
+
+    /* Another screen is far away */
+    uint8_t *c = screen(FRAME_W, FRAME_H, bpr, 2);
+    int d = rsim_hash_distance(ha, rsim_dhash_bgra(c, FRAME_W, FRAME_H, bpr));
+    CHECK(d > 12);
+    printf("  (two unrelated screens: %d bits apart)\n", d);
+    free(a);
+    free(b);
+    free(c);
+}
+
+static void test_padded_rows(void) {
+    /* The same pixels with padded rows, padding full of junk, at widths that
+     * leave SIMD tails: the same hash */
+    static const int sizes[][2] = { { 750, 1334 }, { 1001, 333 }, { 9, 8 }, { 37, 21 }, { 2048, 2732 } };
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int w = sizes[s][0], h = sizes[s][1];
+        size_t tight = (size_t)w * 4, padded = tight + 52;
+        uint8_t *a = screen(w, h, tight, 3 + (uint32_t)s), *b = malloc(padded * h);
+        for (int y = 0; y < h; y++) {
+            memcpy(b + (size_t)y * padded, a + (size_t)y * tight, tight);
+            memset(b + (size_t)y * padded + tight, y & 1 ? 0xff : 0x00, padded - tight);
+        }
+        uint64_t ha = rsim_dhash_bgra(a, w, h, tight);
+        CHECK(ha == rsim_dhash_bgra(b, w, h, padded));
+        CHECK(ha == reference_dhash(a, w, h, tight));
+        free(a);
+        free(b);
+    }
+
+    /* Noise has no margins at all: still bit-for-bit the reference */
+    int w = 1003, h = 517;
+    size_t bpr = (size_t)w * 4 + 12;
+    uint8_t *noise = malloc(bpr * h);
+    uint32_t state = 9;
+    for (size_t i = 0; i < bpr * h; i++) noise[i] = (uint8_t)next_rand(&state);
+    CHECK(rsim_dhash_bgra(noise, w, h, bpr) == reference_dhash(noise, w, h, bpr));
+    free(noise);
+}
+
+static void test_small_changes(void) {
+    /* Cursor blink, a few stray pixels, a slight brightness shift: within
+     * the 6 bits the monkey treats as the same screen */
+    size_t bpr = FRAME_W * 4;
+    uint8_t *a = screen(FRAME_W, FRAME_H, bpr, 4), *b = malloc(bpr * FRAME_H);
+    uint64_t ha = rsim_dhash_bgra(a, FRAME_W, FRAME_H, bpr);
+
+    memcpy(b, a, bpr * FRAME_H);
+    for (int y = 600; y < 640; y++) memset(b + (size_t)y * bpr + 300 * 4, 0, 3 * 4);
+    int cursor = rsim_hash_distance(ha, rsim_dhash_bgra(b, FRAME_W, FRAME_H, bpr));
+
+    memcpy(b, a, bpr * FRAME_H);
+    uint32_t state = 5;
+    for (int i = 0; i < 200; i++) {
+        size_t at = (size_t)(next_rand(&state) % FRAME_H) * bpr + (size_t)(next_rand(&state) % FRAME_W) * 4;
+        b[at] = b[at + 1] = b[at + 2] = (uint8_t)next_rand(&state);
+    }
+    int stray = rsim_hash_distance(ha, rsim_dhash_bgra(b, FRAME_W, FRAME_H, bpr));
+
+    for (size_t i = 0; i < bpr * FRAME_H; i++) b[i] = a[i] > 250 ? a[i] : (uint8_t)(a[i] + 4);
+    int brighter = rsim_hash_distance(ha, rsim_dhash_bgra(b, FRAME_W, FRAME_H, bpr));
+
+    CHECK(cursor <= 6);
+    CHECK(stray <= 6);
+    CHECK_INT(brighter, 0);
+    printf("  (cursor %d bits, 200 stray pixels %d, brighter %d)\n", cursor, stray, brighter);
+
+    /* A real change: the bottom quarter inverted (a keyboard sliding in)
+     * flips each of its 16 bits, well past the merge distance */
+    memcpy(b, a, bpr * FRAME_H);
+    for (size_t i = bpr * (FRAME_H * 6 / 8); i < bpr * FRAME_H; i++)
+        if (i % 4 != 3) b[i] = (uint8_t)(255 - a[i]);
+    CHECK_INT(rsim_hash_distance(ha, rsim_dhash_bgra(b, FRAME_W, FRAME_H, bpr)), 16);
+    free(a);
+    free(b);
+}
+
+static void test_gradients(void) {
+    /* Brighter to the left in every row: every bit set; to the right: none */
+    int w = 90, h = 80;
+    size_t bpr = (size_t)w * 4;
+    uint8_t *p = malloc(bpr * h);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) memset(p + (size_t)y * bpr + (size_t)x * 4, 250 - x * 2, 4);
+    CHECK(rsim_dhash_bgra(p, w, h, bpr) == ~0ull);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) memset(p + (size_t)y * bpr + (size_t)x * 4, 10 + x * 2, 4);
+    CHECK(rsim_dhash_bgra(p, w, h, bpr) == 0);
+
+    /* Too small for the grid, or no pixels */
+    CHECK(rsim_dhash_bgra(p, 8, 8, bpr) == 0);
+    CHECK(rsim_dhash_bgra(p, 9, 7, bpr) == 0);
+    CHECK(rsim_dhash_bgra(NULL, w, h, bpr) == 0);
+    free(p);
+}
+
+static void test_distance_and_hex(void) {
+    CHECK_INT(rsim_hash_distance(0, 0), 0);
+    CHECK_INT(rsim_hash_distance(0, ~0ull), 64);
+    CHECK_INT(rsim_hash_distance(0x8000000000000001ull, 1), 1);
+    CHECK_INT(rsim_hash_distance(0xf0f0ull, 0x0ff0ull), 8);
+
+    char hex[RSIM_HASH_HEX_LEN + 1];
+    uint64_t v = 0;
+    rsim_hash_format(0x00c0ffee12345678ull, hex);
+    CHECK_STR(hex, "00c0ffee12345678");
+    CHECK_INT(rsim_hash_parse(hex, &v), 0);
+    CHECK(v == 0x00c0ffee12345678ull);
+    CHECK_INT(rsim_hash_parse("C0FFEE", &v), 0);
+    CHECK(v == 0xc0ffeeull);
+    CHECK_INT(rsim_hash_parse("", &v), -1);
+    CHECK_INT(rsim_hash_parse("12345678123456789", &v), -1);
+    CHECK_INT(rsim_hash_parse("12g4", &v), -1);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "phash");
+    RUN(test_identical);
+    RUN(test_padded_rows);
+    RUN(test_small_changes);
+    RUN(test_gradients);
+    RUN(test_distance_and_hex);
+    test_rmtree(g_root);
+    return test_report("test_phash");
+}
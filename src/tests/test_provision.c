@@ -0,0 +1,148 @@
+/*
+ * test_provision.c — Plan, apply and re-plan a profile against a fake device
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_provision.h"
+
+static char g_root[512];
+
+static void fixture(const char *name, const char *content, char *path, size_t size) {
+    snprintf(path, size, "%s/profile/%s", g_root, name);
+    CHECK_INT(test_write_file(path, content, strlen(content)), 0);
+}
+
+static size_t count_status(const RSimProvPlan *plan, RSimProvStatus status) {
+    size_t counts[4];
+    rsim_prov_counts(plan, counts);
+    return counts[status];
+}
+
+static const RSimProvStep *find_step(const RSimProvPlan *plan, RSimProvKind kind, size_t index) {
+    for (size_t i = 0; i < plan->count; i++)
+        if (plan->steps[i].kind == kind && plan->steps[i].index == index) return &plan->steps[i];
+    return NULL;
+}
+
+static void test_plan_apply_replan(void) {
+    char dir[600], device[600], der[700], pem[700], photo[700], clip[700];
+    snprintf(dir, sizeof(dir), "%s/profile", g_root);
+    mkdir(dir, 0755);
+    snprintf(device, sizeof(device), "%s/device/data", g_root);
+    fixture("ca.der", "abc", der, sizeof(der));
+    fixture("ca.pem", "-----BEGIN CERTIFICATE-----\nZGVm\n-----END CERTIFICATE-----\n", pem, sizeof(pem));
+    fixture("IMG_0001.JPG", "jpeg bytes", photo, sizeof(photo));
+    fixture("clip.mov", "movie bytes, longer", clip, sizeof(clip));
+
+    RSimTccChange privacy[] = {
+        { RSIM_TCC_GRANT, "kTCCServicePhotos", "com.example.app" },
+        { RSIM_TCC_GRANT, NULL,                "com.example.other" },
+    };
+    const char *certs[] = { der, pem };
+    const char *media[] = { photo, clip };
+    RSimProvApp apps[] = { { "com.example.app", "2", "/builds/Example.app" } };
+    RSimProvProfile profile = {
+        .privacy = privacy, .privacy_count = 2,
+        .certs = certs, .cert_count = 2,
+        .content_size = "UICTContentSizeCategoryXL",
+        .has_location = 1, .lat = 51.5074, .lon = -0.1278,
+        .pasteboard = "hello",
+        .media = media, .media_count = 2,
+        .apps = apps, .app_count = 1,
+    };
+    RSimProvApp installed[] = { { "com.example.app", "1", NULL } };
+    RSimProvFacts facts = { "UICTContentSizeCategoryL", installed, 1 };
+
+    /* First plan: nothing on the device yet */
+    RSimProvPlan plan;
+    char err[256] = "";
+    CHECK_INT(rsim_prov_plan(&plan, device, &profile, &facts, err, sizeof(err)), 0);
+    CHECK_INT(plan.count, 2 + 2 + 1 + 1 + 1 + 2 + 1);
+    CHECK_INT(count_status(&plan, RSIM_PROV_PENDING), plan.count);
+    const RSimProvStep *cert = find_step(&plan, RSIM_PROV_CERT, 0);
+    CHECK(cert != NULL);
+    if (cert) CHECK_STR(cert->key, "a9993e364706816aba3e25717850c26c9cd0d89d");     /* SHA-1 of the DER */
+
+    /* Files here; the rest is the caller's job (simulated) */
+    CHECK_INT(rsim_prov_apply(&plan, &profile, RSIM_PROV_FILE_KINDS), 0);
+    CHECK_INT(count_status(&plan, RSIM_PROV_APPLIED), 2 + 2 + 2);
+    for (size_t i = 0; i < plan.count; i++)
+        if (plan.steps[i].status == RSIM_PROV_PENDING) rsim_prov_mark(&plan.steps[i], 1, NULL);
+    CHECK_INT(count_status(&plan, RSIM_PROV_APPLIED), plan.count);
+    CHECK_INT(rsim_prov_save_state(&plan), 0);
+    rsim_prov_free(&plan);
+
+    char path[1200];
+    snprintf(path, sizeof(path), "%s/" RSIM_PROV_DCIM_DIR "/clip.mov", device);
+    char *copied = test_read_file(path, NULL);
+    CHECK(copied && strcmp(copied, "movie bytes, longer") == 0);
+    free(copied);
+
+    /* The caller's steps show up in the facts next time */
+    facts.content_size = "UICTContentSizeCategoryXL";
+    installed[0].version = "2";
+    CHECK_INT(rsim_prov_plan(&plan, device, &profile, &facts, err, sizeof(err)), 0);
+    CHECK_INT(count_status(&plan, RSIM_PROV_DONE), plan.count);
+    CHECK_INT(rsim_prov_apply(&plan, &profile, RSIM_PROV_FILE_KINDS), 0);
+    CHECK_INT(count_status(&plan, RSIM_PROV_APPLIED), 0);
+    rsim_prov_free(&plan);
+
+    /* A changed profile only plans what changed */
+    profile.pasteboard = "goodbye";
+    profile.lat = 48.8566;
+    CHECK_INT(test_write_file(clip, "edited", 6), 0);
+    CHECK_INT(rsim_prov_plan(&plan, device, &profile, &facts, err, sizeof(err)), 0);
+    CHECK_INT(count_status(&plan, RSIM_PROV_PENDING), 3);
+    CHECK_INT(find_step(&plan, RSIM_PROV_PASTEBOARD, 0)->status, RSIM_PROV_PENDING);
+    CHECK_INT(find_step(&plan, RSIM_PROV_LOCATION, 0)->status, RSIM_PROV_PENDING);
+    CHECK_INT(find_step(&plan, RSIM_PROV_MEDIA, 1)->status, RSIM_PROV_PENDING);
+    rsim_prov_free(&plan);
+}
+
+static void test_unreadable_profile(void) {
+    char device[600], missing[600];
+    snprintf(device, sizeof(device), "%s/device2", g_root);
+    snprintf(missing, sizeof(missing), "%s/profile/missing.pem", g_root);
+    const char *certs[] = { missing };
+    RSimProvProfile profile = { .certs = certs, .cert_count = 1 };
+    RSimProvPlan plan;
+    char err[256] = "";
+    CHECK_INT(rsim_prov_plan(&plan, device, &profile, NULL, err, sizeof(err)), -1);
+    CHECK(strstr(err, "missing.pem") != NULL);
+    rsim_prov_free(&plan);
+}
+
+static void test_failure_note_fits(void) {
+    /* A TCC.db that is a directory fails the transaction; the note holds the
+     * (truncated) sqlite message, not garbage */
+    char device[600], db[700];
+    snprintf(device, sizeof(device), "%s/device3", g_root);
+    snprintf(db, sizeof(db), "%s/Library/TCC/TCC.db", device);
+    char *slash = db;
+    while ((slash = strchr(slash + 1, '/'))) {
+        *slash = '\0';
+        mkdir(db, 0755);
+        *slash = '/';
+    }
+    mkdir(db, 0755);
+
+    RSimTccChange privacy[] = { { RSIM_TCC_GRANT, "kTCCServiceCamera", "com.example.app" } };
+    RSimProvProfile profile = { .privacy = privacy, .privacy_count = 1 };
+    RSimProvPlan plan;
+    char err[256] = "";
+    CHECK_INT(rsim_prov_plan(&plan, device, &profile, NULL, err, sizeof(err)), 0);
+    CHECK_INT(rsim_prov_apply(&plan, &profile, RSIM_PROV_FILE_KINDS), 1);
+    CHECK_INT(plan.steps[0].status, RSIM_PROV_FAILED);
+    CHECK(plan.steps[0].note[0] != '\0');
+    CHECK(strlen(plan.steps[0].note) < RSIM_PROV_NOTE_LEN);
+    rsim_prov_free(&plan);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "provision");
+    RUN(test_plan_apply_replan);
+    RUN(test_unreadable_profile);
+    RUN(test_failure_note_fits);
+    test_rmtree(g_root);
+    return test_report("test_provision");
+}
@@ -0,0 +1,204 @@
+/*
+ * test_pushq.c — Push batch queue, GCRA pacing on a simulated clock, latency stats
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_pushq.h"
+
+static char g_root[512];
+
+/* Deterministic timer lateness in [0, max) seconds */
+static double jitter(unsigned *state, double max) {
+    *state = *state * 1103515245u + 12345u;
+    return (double)((*state >> 8) % 1000) / 1000.0 * max;
+}
+
+static void test_ring(void) {
+    RSimPushQueue q;
+    CHECK_INT(rsim_pushq_init(&q, 3), 0);
+    RSimPushItem item;
+    CHECK_INT(rsim_pushq_pop(&q, &item), -1);
+
+    /* Wrap around the ring a few times, in order */
+    uint32_t pushed = 0, popped = 0;
+    for (int round = 0; round < 4; round++) {
+        while (q.count < 3) CHECK_INT(rsim_pushq_push(&q, strdup("x"), 1, ++pushed), 0);
+        char refused[] = "full";
+        CHECK_INT(rsim_pushq_push(&q, refused, 4, 0), -1);
+        for (int k = 0; k < 2; k++) {
+            CHECK_INT(rsim_pushq_pop(&q, &item), 0);
+            CHECK_INT(item.seq, ++popped);
+            free(item.data);
+        }
+    }
+    CHECK_INT(rsim_pushq_done(&q), 0);          /* not at EOF: more may come */
+    rsim_pushq_free(&q);                        /* frees what is left */
+    CHECK(q.items == NULL);
+}
+
+static void test_fill(void) {
+    char path[600];
+    snprintf(path, sizeof(path), "%s/batch.jsonl", g_root);
+    const char *lines =
+        "{\"aps\":{\"alert\":\"1\"}}\n"
+        "\n"
+        "   \t\n"
+        "{\"aps\":{\"alert\":\"4\"}}\r\n"
+        "{\"aps\":{\"alert\":\"5\"}}\n"
+        "{\"aps\":{\"alert\":\"6\"}}\n"
+        "{\"aps\":{\"alert\":\"7\"}}";          /* no final newline */
+    CHECK_INT(test_write_file(path, lines, strlen(lines)), 0);
+
+    FILE *f = fopen(path, "r");
+    CHECK(f != NULL);
+    if (!f) return;
+    RSimPushQueue q;
+    rsim_pushq_init(&q, 2);
+
+    /* Bounded: never more than the capacity in memory; blank lines keep
+     * their line numbers but are not queued */
+    const uint32_t seqs[] = { 1, 4, 5, 6, 7 };
+    size_t got = 0, fills = 0;
+    RSimPushItem item;
+    while (!rsim_pushq_done(&q)) {
+        size_t added = rsim_pushq_fill(&q, f);
+        fills++;
+        CHECK(q.count <= 2);
+        CHECK(added <= 2);
+        while (rsim_pushq_pop(&q, &item) == 0) {
+            CHECK(got < 5);
+            if (got < 5) {
+                CHECK_INT(item.seq, seqs[got]);
+                char want[32];
+                snprintf(want, sizeof(want), "{\"aps\":{\"alert\":\"%u\"}}", seqs[got]);
+                CHECK_STR(item.data, want);
+                CHECK_INT(item.len, strlen(want));
+            }
+            got++;
+            free(item.data);
+        }
+    }
+    CHECK_INT(got, 5);
+    CHECK(fills >= 3);
+    CHECK_INT(q.eof, 1);
+    rsim_pushq_free(&q);
+    fclose(f);
+}
+
+/* Deliver n payloads at rate on a clock the timer wakes up to late */
+static double drive(RSimRateLimit *rl, int n, double *now, unsigned *seed, double late_max,
+                    RSimLatencies *lat) {
+    double first = -1, last = 0;
+    for (int k = 0; k < n; ) {
+        double due, wait = rsim_ratelimit_take(rl, *now, &due);
+        if (wait > 0) {
+            *now += wait + jitter(seed, late_max);
+            continue;
+        }
+        CHECK(due <= *now);
+        if (lat) rsim_latency_add(lat, (*now - due) * 1000);
+        if (first < 0) first = *now;
+        last = *now;
+        k++;
+    }
+    return last - first;
+}
+
+static void test_rate(void) {
+    /* 1000 payloads at 500/s with up to 1.5 ms of timer lateness: the
+     * schedule is kept, so the achieved rate doesn't drift below 500/s */
+    RSimRateLimit rl;
+    double now = 100;
+    unsigned seed = 1;
+    rsim_ratelimit_init(&rl, 500, 1, now);
+    RSimLatencies lat = {0};
+    double elapsed = drive(&rl, 1000, &now, &seed, 0.0015, &lat);
+    CHECK_NEAR(999 / elapsed, 500, 2);
+    CHECK(rsim_latency_percentile(&lat, 1) < 1.5);
+    CHECK(rsim_latency_mean(&lat) > 0);
+    rsim_latency_free(&lat);
+
+    /* Without lateness: exactly on the grid */
+    now = 0;
+    rsim_ratelimit_init(&rl, 500, 1, now);
+    CHECK_NEAR(drive(&rl, 11, &now, &seed, 0, NULL), 10 * 0.002, 1e-9);
+}
+
+static void test_burst(void) {
+    RSimRateLimit rl;
+    double due;
+    rsim_ratelimit_init(&rl, 10, 4, 0);
+    for (int k = 0; k < 4; k++) {
+        CHECK_NEAR(rsim_ratelimit_take(&rl, 0, &due), 0, 0);
+        CHECK_NEAR(due, 0, 0);                  /* early payloads aren't late */
+    }
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0, &due), 0.1, 1e-12);
+
+    /* Then one per interval */
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0.1, &due), 0, 0);
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0.1, &due), 0.1, 1e-12);
+}
+
+static void test_catch_up_and_stall(void) {
+    RSimRateLimit rl;
+    double due;
+    rsim_ratelimit_init(&rl, 100, 1, 0);
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0, &due), 0, 0);
+
+    /* 35 ms late (under the slack): the three missed slots go at once,
+     * each with its own due time */
+    for (int k = 1; k <= 3; k++) {
+        CHECK_NEAR(rsim_ratelimit_take(&rl, 0.035, &due), 0, 0);
+        CHECK_NEAR(due, k * 0.01, 1e-12);
+    }
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0.035, &due), 0.005, 1e-12);
+
+    /* A 2 s stall restarts the schedule instead of a 200-payload burst */
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 2.04, &due), 0, 0);
+    CHECK_NEAR(due, 2.04, 1e-12);
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 2.04, &due), 0.01, 1e-12);
+
+    /* Slow rates: the slack is at least one interval */
+    rsim_ratelimit_init(&rl, 2, 1, 0);
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0, &due), 0, 0);
+    CHECK_NEAR(rsim_ratelimit_take(&rl, 0.9, &due), 0, 0);
+    CHECK_NEAR(due, 0.5, 1e-12);
+}
+
+static void test_latencies(void) {
+    RSimLatencies lat = {0};
+    CHECK_NEAR(rsim_latency_mean(&lat), 0, 0);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 0.5), 0, 0);
+
+    for (int v = 100; v >= 1; v--) rsim_latency_add(&lat, v);
+    CHECK_INT(lat.count, 100);
+    CHECK_NEAR(rsim_latency_mean(&lat), 50.5, 1e-12);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 0), 1, 0);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 0.5), 50, 0);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 0.95), 95, 0);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 1), 100, 0);
+
+    /* A sample after a percentile is sorted in next time */
+    rsim_latency_add(&lat, 0.5);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 0), 0.5, 0);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 1), 100, 0);
+
+    /* Past the first growth */
+    for (int i = 0; i < 2000; i++) rsim_latency_add(&lat, 1000);
+    CHECK_INT(lat.count, 2101);
+    CHECK_NEAR(rsim_latency_percentile(&lat, 1), 1000, 0);
+    rsim_latency_free(&lat);
+    CHECK_INT(lat.count, 0);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "pushq");
+    RUN(test_ring);
+    RUN(test_fill);
+    RUN(test_rate);
+    RUN(test_burst);
+    RUN(test_catch_up_and_stall);
+    RUN(test_latencies);
+    test_rmtree(g_root);
+    return test_report("test_pushq");
+}
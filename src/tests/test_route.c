@@ -0,0 +1,260 @@
+/*
+ * test_route.c — GPX parsing, timelines, sampling and tick statistics
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_route.h"
+
+#include <math.h>
+
+#define ONE_DEGREE_M    111195.08       /* along a great circle */
+
+static char g_root[512];
+
+static int parse(RSimRoute *route, const char *xml, char *err, size_t err_size) {
+    memset(route, 0, sizeof(*route));
+    err[0] = '\0';
+    return rsim_route_parse_gpx(route, xml, strlen(xml), err, err_size);
+}
+
+static void test_point_kinds(void) {
+    RSimRoute route;
+    char err[256];
+
+    /* The track wins over the route and the waypoints; self-closing points,
+     * either quote style; <trkseg> is not a <trkpt> */
+    const char *track =
+        "<?xml version=\"1.0\"?>\n<gpx version=\"1.1\">\n"
+        "  <wpt lat=\"9\" lon=\"9\"/>\n"
+        "  <rte><rtept lat=\"8\" lon=\"8\"/></rte>\n"
+        "  <trk><trkseg>\n"
+        "    <trkpt lat=\"1.5\" lon=\"-2.25\"><ele>12.5</ele></trkpt>\n"
+        "    <trkpt lon='3' lat='4'/>\n"
+        "    <trkpt\n lat=\"5\"\n lon=\"6\" />\n"
+        "  </trkseg></trk>\n</gpx>\n";
+    CHECK_INT(parse(&route, track, err, sizeof(err)), 3);
+    CHECK_INT(route.count, 3);
+    CHECK_NEAR(route.points[0].lat, 1.5, 1e-12);
+    CHECK_NEAR(route.points[0].lon, -2.25, 1e-12);
+    CHECK_NEAR(route.points[0].ele, 12.5, 1e-12);
+    CHECK(isnan(route.points[0].time));
+    CHECK_NEAR(route.points[1].lat, 4, 1e-12);
+    CHECK_NEAR(route.points[1].lon, 3, 1e-12);
+    CHECK_NEAR(route.points[1].ele, 0, 1e-12);
+    CHECK_NEAR(route.points[2].lon, 6, 1e-12);
+    rsim_route_free(&route);
+
+    const char *planned =
+        "<gpx><wpt lat=\"9\" lon=\"9\"/><rte><rtept lat=\"1\" lon=\"1\"></rtept>"
+        "<rtept lat=\"2\" lon=\"2\"/></rte></gpx>";
+    CHECK_INT(parse(&route, planned, err, sizeof(err)), 2);
+    CHECK_NEAR(route.points[1].lat, 2, 1e-12);
+    rsim_route_free(&route);
+
+    const char *waypoints = "<gpx><wpt lat=\"7\" lon=\"-7\"><name>A</name></wpt></gpx>";
+    CHECK_INT(parse(&route, waypoints, err, sizeof(err)), 1);
+    CHECK_NEAR(route.points[0].lon, -7, 1e-12);
+    rsim_route_free(&route);
+}
+
+static void test_bad_documents(void) {
+    RSimRoute route;
+    char err[256];
+    CHECK_INT(parse(&route, "<kml><trkpt lat=\"1\" lon=\"1\"/></kml>", err, sizeof(err)), -1);
+    CHECK_STR(err, "not a GPX document");
+    CHECK_INT(parse(&route, "<gpx><trk></trk></gpx>", err, sizeof(err)), -1);
+    CHECK_STR(err, "no <trkpt>, <rtept> or <wpt> points");
+
+    /* Out of range, missing, unparsable and non-finite coordinates */
+    const char *bad[] = {
+        "<gpx>\n<trkpt lat=\"91\" lon=\"0\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"0\" lon=\"-180.5\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"0\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"north\" lon=\"0\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"nan\" lon=\"0\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"0\" lon=\"inf\"/></gpx>",
+        "<gpx>\n<trkpt lat=\"-INFINITY\" lon=\"0\"/></gpx>",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        CHECK_INT(parse(&route, bad[i], err, sizeof(err)), -1);
+        CHECK_STR(err, "line 2: <trkpt> without a valid lat/lon");
+        rsim_route_free(&route);
+    }
+}
+
+static void test_times(void) {
+    /* The same instant, 2024-05-01 12:00:00 UTC, written four ways */
+    const char *xml =
+        "<gpx>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-05-01T12:00:00Z</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-05-01T14:00:00+02:00</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-05-01T07:30:00-04:30</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-05-01T12:00:00</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-05-01T12:00:00.250Z</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>2024-03-01T00:00:00Z</time></trkpt>"
+        "<trkpt lat=\"0\" lon=\"0\"><time>yesterday</time></trkpt>"
+        "</gpx>";
+    RSimRoute route;
+    char err[256];
+    CHECK_INT(parse(&route, xml, err, sizeof(err)), 7);
+    for (int i = 0; i < 4; i++) CHECK_NEAR(route.points[i].time, 1714564800.0, 1e-6);
+    CHECK_NEAR(route.points[4].time, 1714564800.25, 1e-6);
+    CHECK_NEAR(route.points[5].time, 1709251200.0, 1e-6);      /* after a leap day */
+    CHECK(isnan(route.points[6].time));
+    rsim_route_free(&route);
+}
+
+static void test_timeline(void) {
+    RSimRoute route = {0};
+    rsim_route_add(&route, 0, 0, 0, 1000);
+    rsim_route_add(&route, 0, 1, 0, 1100);
+    rsim_route_add(&route, 0, 2, 0, 1150);
+
+    /* GPX times when every point has one */
+    CHECK_NEAR(rsim_route_timeline(&route, 0), 150, 1e-9);
+    CHECK_NEAR(route.points[1].t, 100, 1e-9);
+    CHECK_NEAR(route.points[1].dist, ONE_DEGREE_M, 0.01);
+    CHECK_NEAR(route.points[2].dist, 2 * ONE_DEGREE_M, 0.02);
+
+    /* A speed overrides them */
+    CHECK_NEAR(rsim_route_timeline(&route, 20), 2 * ONE_DEGREE_M / 20, 0.001);
+
+    /* Times that go backwards can't be replayed: default speed */
+    route.points[2].time = 1050;
+    CHECK_NEAR(rsim_route_timeline(&route, 0), 2 * ONE_DEGREE_M / RSIM_ROUTE_DEFAULT_SPEED, 0.01);
+    route.points[2].time = NAN;
+    CHECK_NEAR(rsim_route_timeline(&route, 0), 2 * ONE_DEGREE_M / RSIM_ROUTE_DEFAULT_SPEED, 0.01);
+    rsim_route_free(&route);
+
+    rsim_route_add(&route, 10, 10, 0, 5);
+    CHECK_NEAR(rsim_route_timeline(&route, 0), 0, 1e-12);
+    rsim_route_free(&route);
+    CHECK_NEAR(rsim_route_timeline(&route, 0), 0, 1e-12);
+}
+
+static void test_sample(void) {
+    RSimRoute route = {0};
+    rsim_route_add(&route, 0, 0, 100, 0);
+    rsim_route_add(&route, 0, 1, 200, 10);
+    rsim_route_add(&route, 1, 1, 200, 20);
+    rsim_route_add(&route, 1, 1, 200, 30);     /* standing still */
+    rsim_route_timeline(&route, 0);
+
+    size_t cursor = 0;
+    RSimRouteFix fix;
+    CHECK_INT(rsim_route_sample(&route, 5, &cursor, &fix), 0);
+    CHECK_NEAR(fix.lat, 0, 1e-12);
+    CHECK_NEAR(fix.lon, 0.5, 1e-12);
+    CHECK_NEAR(fix.ele, 150, 1e-9);
+    CHECK_NEAR(fix.course, 90, 1e-6);
+    CHECK_NEAR(fix.speed, ONE_DEGREE_M / 10, 0.01);
+
+    CHECK_INT(rsim_route_sample(&route, 15, &cursor, &fix), 0);
+    CHECK_INT(cursor, 1);
+    CHECK_NEAR(fix.lat, 0.5, 1e-12);
+    CHECK_NEAR(fix.course, 0, 1e-6);
+
+    CHECK_INT(rsim_route_sample(&route, 25, &cursor, &fix), 0);
+    CHECK_NEAR(fix.course, -1, 0);
+    CHECK_NEAR(fix.speed, 0, 0);
+
+    /* Going back in time rescans from the start */
+    CHECK_INT(rsim_route_sample(&route, 2.5, &cursor, &fix), 0);
+    CHECK_INT(cursor, 0);
+    CHECK_NEAR(fix.lon, 0.25, 1e-12);
+
+    /* At and past the end: the last point, stopped */
+    CHECK_INT(rsim_route_sample(&route, 30, &cursor, &fix), 1);
+    CHECK_INT(rsim_route_sample(&route, 1e9, &cursor, &fix), 1);
+    CHECK_NEAR(fix.lat, 1, 0);
+    CHECK_NEAR(fix.course, -1, 0);
+    rsim_route_free(&route);
+
+    cursor = 0;
+    CHECK_INT(rsim_route_sample(&route, 0, &cursor, &fix), 1);
+}
+
+static void test_antimeridian(void) {
+    /* 179.5E to 179.5W is one degree east, not 359 west */
+    RSimRoute route = {0};
+    rsim_route_add(&route, 0, 179.5, 0, 0);
+    rsim_route_add(&route, 0, -179.5, 0, 100);
+    rsim_route_timeline(&route, 0);
+    CHECK_NEAR(route.points[1].dist, ONE_DEGREE_M, 0.01);
+
+    size_t cursor = 0;
+    RSimRouteFix fix;
+    const double t[] = { 25, 50, 75 }, lon[] = { 179.75, 180, -179.75 };
+    for (int i = 0; i < 3; i++) {
+        CHECK_INT(rsim_route_sample(&route, t[i], &cursor, &fix), 0);
+        CHECK_NEAR(fix.lon, lon[i], 1e-9);
+        CHECK(fix.lon >= -180 && fix.lon <= 180);
+        CHECK_NEAR(fix.course, 90, 1e-6);
+    }
+    rsim_route_free(&route);
+
+    /* And back west */
+    rsim_route_add(&route, 0, -179.5, 0, 0);
+    rsim_route_add(&route, 0, 179.5, 0, 100);
+    rsim_route_timeline(&route, 0);
+    cursor = 0;
+    CHECK_INT(rsim_route_sample(&route, 75, &cursor, &fix), 0);
+    CHECK_NEAR(fix.lon, 179.75, 1e-9);
+    CHECK_NEAR(fix.course, 270, 1e-6);
+    rsim_route_free(&route);
+}
+
+static void test_load_file(void) {
+    char path[600], err[256] = "";
+    snprintf(path, sizeof(path), "%s/walk.gpx", g_root);
+    const char *xml = "<gpx><trk><trkseg><trkpt lat=\"51.5\" lon=\"-0.1\"/></trkseg></trk></gpx>";
+    CHECK_INT(test_write_file(path, xml, strlen(xml)), 0);
+    RSimRoute route = {0};
+    CHECK_INT(rsim_route_load_gpx(&route, path, err, sizeof(err)), 1);
+    CHECK_NEAR(route.points[0].lat, 51.5, 1e-12);
+    rsim_route_free(&route);
+
+    snprintf(path, sizeof(path), "%s/missing.gpx", g_root);
+    CHECK_INT(rsim_route_load_gpx(&route, path, err, sizeof(err)), -1);
+    CHECK(strstr(err, "cannot open") != NULL);
+}
+
+static void test_ticks(void) {
+    RSimTickStats stats;
+    memset(&stats, 0, sizeof(stats));
+    CHECK_NEAR(rsim_tick_mean(&stats), 0, 0);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0.5), 0, 0);
+
+    rsim_tick_record(&stats, 0.05, 0);          /* bucket 0 */
+    rsim_tick_record(&stats, 0.25, 0);          /* bucket 2 */
+    rsim_tick_record(&stats, -1, 0);            /* early counts as on time */
+    rsim_tick_record(&stats, 1.0, 2);           /* bucket 10 */
+    rsim_tick_record(&stats, 30, 1);            /* past the last bucket */
+    CHECK_INT(stats.ticks, 5);
+    CHECK_INT(stats.missed, 3);
+    CHECK_NEAR(stats.max_ms, 30, 0);
+    CHECK_NEAR(rsim_tick_mean(&stats), (0.05 + 0.25 + 1.0 + 30) / 5, 1e-9);
+    CHECK_INT(stats.hist[RSIM_TICK_BUCKETS - 1], 1);
+
+    /* Upper bucket edges; the overflow bucket reports the real maximum */
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0), 0.1, 1e-12);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0.4), 0.1, 1e-12);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0.6), 0.3, 1e-12);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0.8), 1.1, 1e-12);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 0.99), 30, 0);
+    CHECK_NEAR(rsim_tick_percentile(&stats, 1), 30, 0);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "route");
+    RUN(test_point_kinds);
+    RUN(test_bad_documents);
+    RUN(test_times);
+    RUN(test_timeline);
+    RUN(test_sample);
+    RUN(test_antimeridian);
+    RUN(test_load_file);
+    RUN(test_ticks);
+    test_rmtree(g_root);
+    return test_report("test_route");
+}
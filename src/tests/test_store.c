@@ -0,0 +1,167 @@
+/*
+ * test_store.c — Baseline store: digests, index, closest match, gc
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_store.h"
+#include "common/rosettasim_phash.h"
+
+static char g_root[512];
+
+static RSimStoreRef make_ref(double time, uint64_t id, uint64_t phash, const char *name) {
+    RSimStoreRef r;
+    memset(&r, 0, sizeof(r));
+    r.time = time;
+    r.digest.hi = id;
+    r.digest.lo = 7;
+    r.phash = phash;
+    r.width = 4;
+    r.height = 4;
+    snprintf(r.device, sizeof(r.device), "UDID");
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    return r;
+}
+
+static void put_object(RSimStore *s, RSimDigest d) {
+    char path[1200];
+    CHECK_INT(rsim_store_object_path(s, d, ".png", path, sizeof(path)), 0);
+    CHECK_INT(test_write_file(path, "png!", 4), 0);
+}
+
+static void test_digest_ignores_stride(void) {
+    enum { W = 61, H = 17 };
+    size_t padded = W * 4 + 12;
+    uint8_t *a = malloc(padded * H), *b = malloc(W * 4 * H);
+    for (size_t i = 0; i < padded * H; i++) a[i] = (uint8_t)(i * 2654435761u >> 13);
+    for (int y = 0; y < H; y++) memcpy(b + (size_t)y * W * 4, a + y * padded, W * 4);
+
+    RSimDigest da, db;
+    rsim_content_digest(a, W, H, padded, &da);
+    rsim_content_digest(b, W, H, W * 4, &db);
+    CHECK(rsim_digest_equal(da, db));
+
+    /* Padding is not content */
+    a[padded - 1] ^= 0xFF;
+    rsim_content_digest(a, W, H, padded, &da);
+    CHECK(rsim_digest_equal(da, db));
+
+    /* One visible bit is */
+    b[W * 4 * H / 2] ^= 1;
+    rsim_content_digest(b, W, H, W * 4, &db);
+    CHECK(!rsim_digest_equal(da, db));
+
+    /* Dimensions are part of the digest */
+    RSimDigest dc;
+    rsim_content_digest(b, W * H, 1, W * 4 * H, &dc);
+    CHECK(!rsim_digest_equal(db, dc));
+
+    char hex[RSIM_DIGEST_HEX_LEN + 1];
+    rsim_digest_format(da, hex);
+    CHECK_INT(strlen(hex), RSIM_DIGEST_HEX_LEN);
+    RSimDigest parsed;
+    CHECK_INT(rsim_digest_parse(hex, &parsed), 0);
+    CHECK(rsim_digest_equal(parsed, da));
+    CHECK(rsim_digest_parse("not-hex", &parsed) != 0);
+    free(a);
+    free(b);
+}
+
+static void test_index_round_trip(void) {
+    char root[600];
+    snprintf(root, sizeof(root), "%s/index/a/b", g_root);
+    RSimStore s;
+    CHECK_INT(rsim_store_open(&s, root), 0);
+    RSimStoreRef r = make_ref(1000.5, 42, 0x1234, "login\tscreen\n");
+    CHECK_INT(rsim_store_add_ref(&s, &r), 0);
+    r = make_ref(1001, 43, 0x5678, "home");
+    CHECK_INT(rsim_store_add_ref(&s, &r), 0);
+    rsim_store_close(&s);
+
+    CHECK_INT(rsim_store_open(&s, root), 0);
+    CHECK_INT(s.count, 2);
+    CHECK_STR(s.refs[0].name, "login_screen_");  /* tabs and newlines can't split the TSV */
+    CHECK_STR(s.refs[0].device, "UDID");
+    CHECK_NEAR(s.refs[0].time, 1000.5, 1e-3);
+    CHECK_INT(s.refs[1].digest.hi, 43);
+    CHECK_INT(s.refs[1].phash, 0x5678);
+    rsim_store_close(&s);
+}
+
+static void test_closest(void) {
+    char root[600];
+    snprintf(root, sizeof(root), "%s/closest", g_root);
+    RSimStore s;
+    CHECK_INT(rsim_store_open(&s, root), 0);
+    /* 50 screens, each captured 4 times; screen k's dHash is k in every byte */
+    for (int i = 0; i < 200; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "test_%d", i % 10);
+        RSimStoreRef r = make_ref(1000 + i, (uint64_t)(i % 50), (uint64_t)(i % 50) * 0x0101010101010101ull, name);
+        CHECK_INT(rsim_store_add_ref(&s, &r), 0);
+    }
+    CHECK_INT(rsim_store_distinct(&s), 50);
+
+    RSimStoreRef out[5];
+    int dist[5];
+    int n = rsim_store_closest(&s, 3 * 0x0101010101010101ull ^ 1, NULL, out, dist, 5);
+    CHECK_INT(n, 5);
+    CHECK_INT(out[0].digest.hi, 3);
+    CHECK_INT(dist[0], 1);
+    CHECK_NEAR(out[0].time, 1153, 1e-9);        /* newest capture of that screen */
+    for (int i = 1; i < n; i++) {
+        CHECK(dist[i - 1] <= dist[i]);
+        for (int k = 0; k < i; k++) CHECK(!rsim_digest_equal(out[k].digest, out[i].digest));
+    }
+
+    n = rsim_store_closest(&s, 0, "test_4", out, dist, 3);
+    CHECK_INT(n, 3);
+    for (int i = 0; i < n; i++) CHECK_STR(out[i].name, "test_4");
+    CHECK_INT(rsim_store_closest(&s, 0, "nobody", out, dist, 3), 0);
+    rsim_store_close(&s);
+}
+
+static void test_gc(void) {
+    char root[600];
+    snprintf(root, sizeof(root), "%s/gc", g_root);
+    RSimStore s;
+    CHECK_INT(rsim_store_open(&s, root), 0);
+    /* "old" captured at t=100 and t=200; "new" at t=900. Digest 3 only by old@100. */
+    RSimStoreRef refs[] = {
+        make_ref(100, 3, 0, "old"),
+        make_ref(200, 4, 0, "old"),
+        make_ref(900, 5, 0, "new"),
+    };
+    for (size_t i = 0; i < 3; i++) {
+        put_object(&s, refs[i].digest);
+        CHECK_INT(rsim_store_add_ref(&s, &refs[i]), 0);
+    }
+    RSimStoreGCStats st;
+    CHECK_INT(rsim_store_gc(&s, 500, &st), 0);
+    CHECK_INT(st.refs_dropped, 1);      /* old@100; old@200 is the newest "old" */
+    CHECK_INT(st.refs_kept, 2);
+    CHECK_INT(st.objects_deleted, 1);
+    CHECK_INT(st.objects_kept, 2);
+    CHECK_INT(st.bytes_freed, 4);
+
+    char path[1200];
+    rsim_store_object_path(&s, refs[0].digest, ".png", path, sizeof(path));
+    CHECK(access(path, F_OK) != 0);
+    rsim_store_object_path(&s, refs[1].digest, ".png", path, sizeof(path));
+    CHECK(access(path, F_OK) == 0);
+    rsim_store_close(&s);
+
+    CHECK_INT(rsim_store_open(&s, root), 0);
+    CHECK_INT(s.count, 2);
+    CHECK_INT(rsim_store_distinct(&s), 2);
+    rsim_store_close(&s);
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "store");
+    RUN(test_digest_ignores_stride);
+    RUN(test_index_round_trip);
+    RUN(test_closest);
+    RUN(test_gc);
+    test_rmtree(g_root);
+    return test_report("test_store");
+}
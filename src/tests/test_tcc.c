@@ -0,0 +1,115 @@
+/*
+ * test_tcc.c — TCC.db batches: grants, revokes, resets, atomicity, pending
+ */
+
+#include "tests/rsim_test.h"
+#include "common/rosettasim_tcc.h"
+
+#include <sqlite3.h>
+
+static char g_root[512];
+
+/* Result of a single-integer query, -1 on error */
+static int query_int(const char *db_path, const char *sql) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    int v = -1;
+    if (sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK &&
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+        v = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return v;
+}
+
+static void test_service_keys(void) {
+    CHECK_STR(rsim_tcc_service_key("photos"), "kTCCServicePhotos");
+    CHECK_STR(rsim_tcc_service_key("contacts"), "kTCCServiceAddressBook");
+    CHECK_STR(rsim_tcc_service_key("all"), "");
+    CHECK(rsim_tcc_service_key("bluetooth") == NULL);
+    int n = 0;
+    for (const char *const *name = rsim_tcc_service_names; *name; name++, n++)
+        CHECK(rsim_tcc_service_key(*name) != NULL);
+    CHECK_INT(n, 11);
+}
+
+static void test_batch(void) {
+    char db[600];
+    snprintf(db, sizeof(db), "%s/batch/TCC.db", g_root);
+    char dir[600];
+    snprintf(dir, sizeof(dir), "%s/batch", g_root);
+    mkdir(dir, 0755);
+
+    char err[256] = "";
+    RSimTccChange changes[] = {
+        { RSIM_TCC_GRANT,  NULL,                  "com.a" },     /* every service */
+        { RSIM_TCC_GRANT,  "kTCCServicePhotos",   "com.b" },
+        { RSIM_TCC_GRANT,  "kTCCServiceSiri",     "com.b" },
+        { RSIM_TCC_REVOKE, "kTCCServiceCamera",   "com.a" },
+        { RSIM_TCC_RESET,  "kTCCServiceSiri",     NULL },        /* every client */
+    };
+    CHECK_INT(rsim_tcc_apply(db, changes, 5, err, sizeof(err)), 11 + 1 + 1 + 1 + 2);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access"), 11);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access WHERE client = 'com.a' AND allowed = 1"), 9);
+    CHECK_INT(query_int(db, "SELECT allowed FROM access WHERE client = 'com.a' AND service = 'kTCCServiceCamera'"), 0);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access WHERE service = 'kTCCServiceSiri'"), 0);
+
+    /* Later changes undid part of the first grant and all of the Siri one */
+    int pending[5], expected[5] = { 1, 0, 1, 0, 0 };
+    CHECK_INT(rsim_tcc_pending(db, changes, 5, pending), 0);
+    for (int i = 0; i < 5; i++) CHECK_INT(pending[i], expected[i]);
+
+    /* Revoking every service of a client, then resetting it */
+    RSimTccChange revoke_all = { RSIM_TCC_REVOKE, "", "com.a" };
+    CHECK_INT(rsim_tcc_pending(db, &revoke_all, 1, pending), 0);
+    CHECK_INT(pending[0], 1);
+    CHECK_INT(rsim_tcc_apply(db, &revoke_all, 1, err, sizeof(err)), 10);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access WHERE client = 'com.a' AND allowed = 1"), 0);
+    RSimTccChange reset = { RSIM_TCC_RESET, NULL, "com.a" };
+    CHECK_INT(rsim_tcc_apply(db, &reset, 1, err, sizeof(err)), 10);
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access"), 1);
+}
+
+static void test_all_or_nothing(void) {
+    char db[600];
+    snprintf(db, sizeof(db), "%s/TCC_atomic.db", g_root);
+    char err[256] = "";
+    RSimTccChange changes[] = {
+        { RSIM_TCC_GRANT,  "kTCCServicePhotos", "com.a" },
+        { RSIM_TCC_REVOKE, "kTCCServicePhotos", NULL },          /* invalid: no client */
+    };
+    CHECK_INT(rsim_tcc_apply(db, changes, 2, err, sizeof(err)), -1);
+    CHECK_STR(err, "grant and revoke need a bundle ID");
+    CHECK_INT(query_int(db, "SELECT count(*) FROM access"), 0);     /* the grant was rolled back */
+
+    snprintf(db, sizeof(db), "%s/missing/dir/TCC.db", g_root);
+    err[0] = '\0';
+    CHECK_INT(rsim_tcc_apply(db, changes, 1, err, sizeof(err)), -1);
+    CHECK(err[0] != '\0');
+}
+
+static void test_pending_without_db(void) {
+    char db[600];
+    snprintf(db, sizeof(db), "%s/none/TCC.db", g_root);
+    RSimTccChange changes[] = {
+        { RSIM_TCC_GRANT,  "kTCCServiceCamera", "com.a" },
+        { RSIM_TCC_REVOKE, "kTCCServiceCamera", "com.a" },
+        { RSIM_TCC_RESET,  NULL,                NULL },
+    };
+    int pending[3] = { -1, -1, -1 };
+    CHECK_INT(rsim_tcc_pending(db, changes, 3, pending), 0);
+    CHECK_INT(pending[0], 1);
+    CHECK_INT(pending[1], 0);
+    CHECK_INT(pending[2], 0);
+    CHECK(access(db, F_OK) != 0);           /* asking doesn't create it */
+}
+
+int main(void) {
+    test_tmpdir(g_root, sizeof(g_root), "tcc");
+    RUN(test_service_keys);
+    RUN(test_batch);
+    RUN(test_all_or_nothing);
+    RUN(test_pending_without_db);
+    test_rmtree(g_root);
+    return test_report("test_tcc");
+}
@@ -3,11 +3,25 @@
  *
  * Usage:
  *   rosettasim-ctl list
- *   rosettasim-ctl boot <UDID>
+ *   rosettasim-ctl boot <UDID> [--measure]
  *   rosettasim-ctl shutdown <UDID|all>
  *   rosettasim-ctl install <UDID> <app-path>
+ *   rosettasim-ctl launch <UDID> <bundle-id> [--measure [--runs=N] [--settle=ms] [--json]]
  *   rosettasim-ctl screenshot <UDID> <output.png>
  *   rosettasim-ctl status <UDID>
+ *   rosettasim-ctl find <UDID> <template.png>
+ *   rosettasim-ctl tapon <UDID> <template.png>
+ *   rosettasim-ctl pixel <UDID> <x> <y> [--wait-until=#RRGGBB]
+ *   rosettasim-ctl region <UDID> <x> <y> <w> <h> [--stats|--raw] [--wait-until=<pred>]
+ *   rosettasim-ctl phash <UDID> [--history] [--wait-until=<hash>]
+ *   rosettasim-ctl baseline save|closest|list|gc ...
+ *   rosettasim-ctl monkey <UDID> [--seed=N] [--actions=N] [--trace=file] [--replay=file]
+ *   rosettasim-ctl logs <UDID> [--follow] [--grep=regex] [--lines=N]
+ *   rosettasim-ctl prewarm <runtime|all> [--jobs=N] [--report]
+ *   rosettasim-ctl hangs <UDID> [--json] [--clear] | enable <bundle-id> [--threshold=ms]
+ *   rosettasim-ctl privacy <UDID>[,<UDID>...] <grant|revoke|reset> <service> [bundle-id] | --manifest=file
+ *   rosettasim-ctl provision <UDID>[,<UDID>...] --profile=file [--dry-run]
+ *   rosettasim-ctl addmedia <UDID> [--jobs=N] <file|dir> [file...]
  *
  * For legacy runtimes (iOS 7-12.x), implements operations directly.
  * For native runtimes (iOS 15+), delegates to xcrun simctl.
@@ -17,13 +31,38 @@
  */
 
 #import <Foundation/Foundation.h>
+#import <CoreGraphics/CoreGraphics.h>
+#import <ImageIO/ImageIO.h>
+#import <IOSurface/IOSurface.h>
 #import <objc/runtime.h>
 #import <objc/message.h>
 #include <dlfcn.h>
 #include "common/rosettasim_paths.h"
+#include "common/rosettasim_sfb.h"
+#include "common/rosettasim_match.h"
+#include "common/rosettasim_phash.h"
+#include "common/rosettasim_fbfile.h"
+#include "common/rosettasim_store.h"
+#include "common/rosettasim_monkey.h"
+#include "common/rosettasim_logtail.h"
+#include "common/rosettasim_macho.h"
+#include "common/rosettasim_tcc.h"
+#include "common/rosettasim_provision.h"
+#include "common/rosettasim_media.h"
+#include "common/rosettasim_jpeg.h"
+#include "common/rosettasim_route.h"
+#include "common/rosettasim_pushq.h"
+#include "common/rosettasim_archive.h"
+#include <fcntl.h>
 #include <spawn.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <notify.h>
+#include <libproc.h>
+#include <math.h>
+#include <fts.h>
+#include <sys/sysctl.h>
+#include <sqlite3.h>
 
 /* ── Forward declarations ── */
 static int run_with_timeout(NSArray<NSString *> *args, int timeout_secs);
@@ -32,6 +71,11 @@ static id find_device(id deviceSet, NSString *udid);
 static NSString *get_runtime_id(id device);
 static long get_device_state(id device);
 static BOOL is_legacy_runtime(NSString *runtimeID);
+static double now_epoch(void);
+static void measure_boot_ready(NSString *udid, NSString *rtID, double t_start, double t_booted);
+static NSString *agent_send(NSString *udid, NSString *action, NSDictionary *cmd, double timeout_s);
+static NSString *agent_wait(NSString *udid, NSString *tag, NSString *reqID, NSString *want,
+                            double timeout_s, NSString **rest);
 
 /* ── Passthrough: forward any command to real simctl ── */
 
@@ -214,11 +258,241 @@ static NSString *state_string(long state) {
     }
 }
 
+/* ── Helper: daemon framebuffer access (legacy devices) ── */
+
+/* Entry for udid in the daemon's /tmp/rosettasim_active_devices.json, or nil */
+static NSDictionary *find_active_device(NSString *udid) {
+    NSData *data = [NSData dataWithContentsOfFile:@"/tmp/rosettasim_active_devices.json"];
+    if (!data) return nil;
+    NSArray *devices = [NSJSONSerialization JSONObjectWithData:data options:0 error:nil];
+    if (![devices isKindOfClass:[NSArray class]]) return nil;
+    for (NSDictionary *d in devices) {
+        if ([d isKindOfClass:[NSDictionary class]] && [d[@"udid"] isEqualToString:udid])
+            return d;
+    }
+    return nil;
+}
+
+static uint32_t surface_u32_value(IOSurfaceRef surface, CFStringRef key) {
+    CFTypeRef v = IOSurfaceCopyValue(surface, key);
+    if (!v) return 0;
+    uint32_t n = 0;
+    if (CFGetTypeID(v) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)v, kCFNumberSInt32Type, &n);
+    CFRelease(v);
+    return n;
+}
+
+/* Where the latest frame of a device lives. Opened once, then polled:
+ * the daemon bumps ROSETTASIM_SFB_FRONT_KEY on every flush/present, so a
+ * changed sequence means a new frame without touching the pixels. */
+typedef struct {
+    float          scale;       /* pixels per point */
+    uint32_t       width;
+    uint32_t       height;
+    IOSurfaceRef   surface;     /* daemon surface B (from surface_id) */
+    IOSurfaceRef   peer;        /* surface A, only front while an SFB client swaps */
+    char           fb_path[256];/* v2 frame file fallback when surfaces aren't reachable */
+} FrameSource;
+
+/* One frame: surface held locked in place, or copied out of the frame file
+ * (the daemon rewrites its ring files in place, so a mapping can tear) */
+typedef struct {
+    const uint8_t *pixels;      /* BGRA */
+    uint32_t       width;
+    uint32_t       height;
+    uint32_t       bytes_per_row;
+    float          scale;
+    uint64_t       sequence;
+    IOSurfaceRef   surface;
+    RSimFBFrame    copy;
+} DeviceFrame;
+
+static void close_frame_source(FrameSource *src) {
+    if (src->surface) CFRelease(src->surface);
+    if (src->peer) CFRelease(src->peer);
+    memset(src, 0, sizeof(*src));
+}
+
+static BOOL open_frame_source(NSString *udid, FrameSource *src) {
+    memset(src, 0, sizeof(*src));
+    NSDictionary *entry = find_active_device(udid);
+    if (!entry) {
+        fprintf(stderr, "Device %s not found in daemon's active device list.\n", udid.UTF8String);
+        fprintf(stderr, "Is the device booted and managed by rosettasim_daemon?\n");
+        return NO;
+    }
+    src->scale = [entry[@"scale"] floatValue] > 0 ? [entry[@"scale"] floatValue] : 2.0f;
+    src->width = [entry[@"width"] unsignedIntValue];
+    src->height = [entry[@"height"] unsignedIntValue];
+
+    uint32_t sid = [entry[@"surface_id"] unsignedIntValue];
+    src->surface = sid ? IOSurfaceLookup(sid) : NULL;
+    if (src->surface) {
+        uint32_t peerID = surface_u32_value(src->surface, CFSTR(ROSETTASIM_SFB_PEER_KEY));
+        src->peer = peerID ? IOSurfaceLookup(peerID) : NULL;
+        src->width = (uint32_t)IOSurfaceGetWidth(src->surface);
+        src->height = (uint32_t)IOSurfaceGetHeight(src->surface);
+        return YES;
+    }
+
+    NSString *fbPath = entry[@"fb"];
+    if (!fbPath) {
+        fprintf(stderr, "No surface_id or framebuffer file available for this device.\n");
+        return NO;
+    }
+    strlcpy(src->fb_path, fbPath.UTF8String, sizeof(src->fb_path));
+    return YES;
+}
+
+/* Front surface (not retained) and its frame sequence */
+static IOSurfaceRef frame_source_front(FrameSource *src, uint64_t *sequence) {
+    uint32_t seq = surface_u32_value(src->surface, CFSTR(ROSETTASIM_SFB_FRONT_KEY));
+    IOSurfaceRef front = src->surface;
+    if (src->peer) {
+        uint32_t peer_seq = surface_u32_value(src->peer, CFSTR(ROSETTASIM_SFB_FRONT_KEY));
+        if (peer_seq > seq) { seq = peer_seq; front = src->peer; }
+    }
+    if (sequence) *sequence = seq;
+    return front;
+}
+
+/* Cheap "has a new frame arrived" check */
+static uint64_t frame_source_sequence(FrameSource *src) {
+    uint64_t seq = 0;
+    if (src->surface) {
+        frame_source_front(src, &seq);
+        return seq;
+    }
+    /* Only the header: the daemon replaces the file whole, so this is its frame */
+    RSimFBHeader h;
+    int fd = open(src->fb_path, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t n = pread(fd, &h, sizeof(h), 0);
+    close(fd);
+    return n == (ssize_t)sizeof(h) && rsim_fb_is_v2(&h, sizeof(h)) ? h.sequence : 0;
+}
+
+static void release_device_frame(DeviceFrame *frame) {
+    if (frame->surface) {
+        IOSurfaceUnlock(frame->surface, kIOSurfaceLockReadOnly, NULL);
+        CFRelease(frame->surface);
+    }
+    rsim_fb_frame_free(&frame->copy);
+    memset(frame, 0, sizeof(*frame));
+}
+
+static BOOL acquire_frame(FrameSource *src, DeviceFrame *frame) {
+    memset(frame, 0, sizeof(*frame));
+    frame->scale = src->scale;
+    if (src->surface) {
+        IOSurfaceRef front = frame_source_front(src, &frame->sequence);
+        CFRetain(front);
+        IOSurfaceLock(front, kIOSurfaceLockReadOnly, NULL);
+        frame->surface = front;
+        frame->pixels = IOSurfaceGetBaseAddress(front);
+        frame->width = (uint32_t)IOSurfaceGetWidth(front);
+        frame->height = (uint32_t)IOSurfaceGetHeight(front);
+        frame->bytes_per_row = (uint32_t)IOSurfaceGetBytesPerRow(front);
+        return YES;
+    }
+
+    int err = rsim_fb_read(src->fb_path, &frame->copy, 0, 0);
+    if (err != RSIM_FB_OK) {
+        fprintf(stderr, "Can't read %s: %s\n", src->fb_path, rsim_fb_strerror(err));
+        rsim_fb_frame_free(&frame->copy);
+        return NO;
+    }
+    const RSimFBHeader *h = &frame->copy.header;
+    frame->pixels = frame->copy.pixels;
+    frame->width = h->width;
+    frame->height = h->height;
+    frame->bytes_per_row = h->bytes_per_row;
+    frame->sequence = h->sequence;
+    if (h->scale_milli) frame->scale = h->scale_milli / 1000.0f;
+    return YES;
+}
+
+/* One-shot: latest stable frame of a device */
+static BOOL acquire_device_frame(NSString *udid, DeviceFrame *frame) {
+    FrameSource src;
+    if (!open_frame_source(udid, &src)) return NO;
+    BOOL ok = acquire_frame(&src, frame);
+    close_frame_source(&src);
+    return ok;
+}
+
+/* Decode a PNG (or any ImageIO format) to tightly packed BGRA (caller frees) */
+static uint8_t *decode_image_bgra(NSString *path, uint32_t *width, uint32_t *height) {
+    NSURL *url = [NSURL fileURLWithPath:path];
+    CGImageSourceRef src = CGImageSourceCreateWithURL((__bridge CFURLRef)url, NULL);
+    if (!src) return NULL;
+    CGImageRef img = CGImageSourceCreateImageAtIndex(src, 0, NULL);
+    CFRelease(src);
+    if (!img) return NULL;
+
+    size_t w = CGImageGetWidth(img), h = CGImageGetHeight(img);
+    uint8_t *bgra = calloc(w * h, 4);
+    CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+    CGContextRef ctx = bgra ? CGBitmapContextCreate(bgra, w, h, 8, w * 4, cs,
+        kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst) : NULL;
+    if (ctx) {
+        CGContextDrawImage(ctx, CGRectMake(0, 0, w, h), img);
+        CGContextRelease(ctx);
+        *width = (uint32_t)w;
+        *height = (uint32_t)h;
+    } else {
+        free(bgra);
+        bgra = NULL;
+    }
+    CGColorSpaceRelease(cs);
+    CGImageRelease(img);
+    return bgra;
+}
+
+/* Decode an image into luma for template matching */
+static BOOL load_template_gray(NSString *path, RSimGray *out) {
+    uint32_t w = 0, h = 0;
+    uint8_t *bgra = decode_image_bgra(path, &w, &h);
+    if (!bgra) return NO;
+    BOOL ok = rsim_gray_from_bgra(out, bgra, (int)w, (int)h, (size_t)w * 4) == 0;
+    free(bgra);
+    return ok;
+}
+
+/* Encode BGRA as PNG at path (written to path.tmp, then renamed) */
+static BOOL write_png_bgra(const uint8_t *bgra, uint32_t width, uint32_t height,
+                           size_t bytes_per_row, const char *path) {
+    CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+    CGContextRef ctx = CGBitmapContextCreate((void *)bgra, width, height, 8, bytes_per_row, cs,
+        kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+    CGImageRef img = ctx ? CGBitmapContextCreateImage(ctx) : NULL;
+    if (ctx) CGContextRelease(ctx);
+    CGColorSpaceRelease(cs);
+    if (!img) return NO;
+
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    NSURL *url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:tmp]];
+    CGImageDestinationRef dest = CGImageDestinationCreateWithURL((__bridge CFURLRef)url,
+        CFSTR("public.png"), 1, NULL);
+    BOOL ok = NO;
+    if (dest) {
+        CGImageDestinationAddImage(dest, img, NULL);
+        ok = CGImageDestinationFinalize(dest);
+        CFRelease(dest);
+    }
+    CGImageRelease(img);
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) unlink(tmp);
+    return ok;
+}
+
 /* ── Command: list ── */
 
 /* ── Command: boot ── */
 
-static int cmd_boot(NSString *udid) {
+static int cmd_boot(NSString *udid, BOOL measure) {
     id deviceSet = get_device_set();
     if (!deviceSet) return 1;
     id device = find_device(deviceSet, udid);
@@ -241,6 +515,7 @@ static int cmd_boot(NSString *udid) {
            legacy ? " [legacy]" : "");
 
     /* Use simctl with timeout for all devices */
+    double t_start = now_epoch();
     int rc = run_with_timeout(@[@"xcrun", @"simctl", @"boot", udid], legacy ? 45 : 30);
     if (rc == 124) {
         fprintf(stderr, "Boot timed out.\n");
@@ -254,6 +529,7 @@ static int cmd_boot(NSString *udid) {
     /* Verify state */
     state = get_device_state(device);
     printf("Device state: %s\n", state_string(state).UTF8String);
+    if (state == 3 && measure && legacy) measure_boot_ready(udid, rtID, t_start, now_epoch());
     return (state == 3) ? 0 : 1;
 }
 
@@ -616,7 +892,8 @@ static int cmd_launch(NSString *udid, NSString *bundleID) {
 
 /* ── Command: screenshot ── */
 
-static int cmd_screenshot(NSString *udid, NSString *outputPath) {
+/* encodeArgs: fb_to_png options (--rect/--scale/--rotate/--format/--quality), legacy only */
+static int cmd_screenshot(NSString *udid, NSString *outputPath, NSArray<NSString *> *encodeArgs) {
     id deviceSet = get_device_set();
     if (!deviceSet) return 1;
     id device = find_device(deviceSet, udid);
@@ -673,9 +950,9 @@ static int cmd_screenshot(NSString *udid, NSString *outputPath) {
             fbToPng = @"fb_to_png"; /* hope it's in PATH */
         }
 
-        NSArray *args = @[fbToPng,
+        NSArray *args = [@[fbToPng,
             [NSString stringWithFormat:@"%u", surfaceID.unsignedIntValue],
-            outputPath];
+            outputPath] arrayByAddingObjectsFromArray:encodeArgs];
         int ec = 0;
         run_capture(args, &ec);
         if (ec == 0) {
@@ -686,18 +963,12 @@ static int cmd_screenshot(NSString *udid, NSString *outputPath) {
         return ec;
     }
 
-    /* Raw file fallback */
+    /* Frame file fallback — dims come from its header */
     NSString *fbPath = found[@"fb"];
-    NSNumber *width = found[@"width"];
-    NSNumber *height = found[@"height"];
-    if (fbPath && width && height) {
-        uint32_t bpr = width.unsignedIntValue * 4;
+    if (fbPath) {
         NSString *fbToPng = @"fb_to_png";
-        NSArray *args = @[fbToPng, @"--raw", fbPath,
-            [NSString stringWithFormat:@"%u", width.unsignedIntValue],
-            [NSString stringWithFormat:@"%u", height.unsignedIntValue],
-            [NSString stringWithFormat:@"%u", bpr],
-            outputPath];
+        NSArray *args = @[fbToPng, @"--fb", fbPath, outputPath];
+        args = [args arrayByAddingObjectsFromArray:encodeArgs];
         int ec = 0;
         run_capture(args, &ec);
         if (ec == 0) printf("Screenshot saved to %s\n", outputPath.UTF8String);
@@ -1395,123 +1666,232 @@ found:;
 
 /* ── Command: privacy (TCC.db manipulation for legacy) ── */
 
-static int cmd_privacy(NSString *udid, NSString *action, NSString *service, NSString *bundleID) {
-    id deviceSet = get_device_set();
-    if (!deviceSet) return 1;
-    id device = find_device(deviceSet, udid);
-    if (!device) {
-        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
-        return 1;
-    }
+/*
+ * Legacy devices: every change of one invocation goes into TCC.db in a
+ * single transaction (common/rosettasim_tcc.c), devices in parallel.
+ * A manifest maps bundle IDs to services to grant, or to
+ * {"grant": [...], "revoke": [...], "reset": [...]}:
+ *   { "com.example.app": ["photos", "camera"],
+ *     "com.example.other": { "grant": ["all"], "revoke": ["location"] } }
+ * Modern devices get one simctl call per change.
+ */
 
-    NSString *rtID = get_runtime_id(device);
-    BOOL legacy = is_legacy_runtime(rtID);
+/* Changes as @{action, service, bundle}; nil (with a message) if invalid.
+ * manifest is the parsed JSON object, or nil for the single change. */
+static NSArray<NSDictionary *> *privacy_changes(NSString *action, NSString *service, NSString *bundleID,
+                                                id manifest) {
+    NSMutableArray *changes = [NSMutableArray array];
+    void (^add)(NSString *, NSString *, NSString *) = ^(NSString *act, NSString *svc, NSString *bundle) {
+        NSMutableDictionary *c = [@{@"action": act, @"service": svc} mutableCopy];
+        if (bundle) c[@"bundle"] = bundle;
+        [changes addObject:c];
+    };
 
-    if (!legacy) {
-        NSMutableArray *args = [@[@"xcrun", @"simctl", @"privacy", udid, action, service] mutableCopy];
-        if (bundleID) [args addObject:bundleID];
-        return run_with_timeout(args, 15);
+    if (manifest) {
+        if (![manifest isKindOfClass:[NSDictionary class]]) {
+            fprintf(stderr, "Privacy manifest must be a JSON object of bundle-id -> services\n");
+            return nil;
+        }
+        for (NSString *bundle in [manifest allKeys]) {
+            id entry = manifest[bundle];
+            NSDictionary *byAction = [entry isKindOfClass:[NSArray class]] ? @{@"grant": entry} : entry;
+            if (![byAction isKindOfClass:[NSDictionary class]]) {
+                fprintf(stderr, "Manifest: %s must map to a list or an object\n", bundle.UTF8String);
+                return nil;
+            }
+            for (NSString *act in @[@"reset", @"revoke", @"grant"]) {
+                id services = byAction[act];
+                if ([services isKindOfClass:[NSString class]]) services = @[services];
+                for (NSString *svc in services) add(act, svc, bundle);
+            }
+        }
+    } else {
+        add(action, service, bundleID);
     }
 
-    /* Map service names to TCC service keys */
-    NSDictionary *serviceMap = @{
-        @"photos": @"kTCCServicePhotos",
-        @"camera": @"kTCCServiceCamera",
-        @"microphone": @"kTCCServiceMicrophone",
-        @"contacts": @"kTCCServiceAddressBook",
-        @"calendar": @"kTCCServiceCalendar",
-        @"reminders": @"kTCCServiceReminders",
-        @"location": @"kTCCServiceLocation",
-        @"media-library": @"kTCCServiceMediaLibrary",
-        @"motion": @"kTCCServiceMotion",
-        @"siri": @"kTCCServiceSiri",
-        @"speech-recognition": @"kTCCServiceSpeechRecognition",
-        @"all": @"ALL",
-    };
-
-    NSString *tccService = serviceMap[service];
-    if (!tccService) {
-        fprintf(stderr, "Unknown service: %s\nKnown: photos, camera, microphone, contacts, calendar, "
-                "reminders, location, media-library, motion, siri, speech-recognition, all\n",
-                service.UTF8String);
-        return 1;
+    for (NSDictionary *c in changes) {
+        NSString *act = c[@"action"];
+        if (![@[@"grant", @"revoke", @"reset"] containsObject:act]) {
+            fprintf(stderr, "Unknown action: %s (use grant, revoke, or reset)\n", act.UTF8String);
+            return nil;
+        }
+        if (![c[@"service"] isKindOfClass:[NSString class]] || !rsim_tcc_service_key([c[@"service"] UTF8String])) {
+            fprintf(stderr, "Unknown service: %s\nKnown: photos, camera, microphone, contacts, calendar, "
+                    "reminders, location, media-library, motion, siri, speech-recognition, all\n",
+                    [[c[@"service"] description] UTF8String]);
+            return nil;
+        }
+        if (!c[@"bundle"] && ![act isEqualToString:@"reset"]) {
+            fprintf(stderr, "%s requires a bundle-id\n", act.UTF8String);
+            return nil;
+        }
     }
+    return changes;
+}
 
-    NSString *tccPath = [NSString stringWithFormat:
-        @"%@/Library/Developer/CoreSimulator/Devices/%@/data/Library/TCC/TCC.db",
-        NSHomeDirectory(), udid];
+/* RSimTccChange array for changes (pointers into the NSStrings); free() it */
+static RSimTccChange *tcc_batch(NSArray<NSDictionary *> *changes) {
+    RSimTccChange *batch = calloc(changes.count + 1, sizeof(*batch));
+    for (NSUInteger i = 0; i < changes.count; i++) {
+        NSDictionary *c = changes[i];
+        batch[i].op = [c[@"action"] isEqualToString:@"grant"] ? RSIM_TCC_GRANT :
+                      [c[@"action"] isEqualToString:@"revoke"] ? RSIM_TCC_REVOKE : RSIM_TCC_RESET;
+        batch[i].service = rsim_tcc_service_key([c[@"service"] UTF8String]);
+        batch[i].client = [c[@"bundle"] UTF8String];
+    }
+    return batch;
+}
 
-    if (![[NSFileManager defaultManager] fileExistsAtPath:tccPath]) {
-        /* Create TCC directory and empty DB */
-        NSString *tccDir = [tccPath stringByDeletingLastPathComponent];
-        [[NSFileManager defaultManager] createDirectoryAtPath:tccDir
-                                  withIntermediateDirectories:YES attributes:nil error:nil];
-        NSString *createCmd = [NSString stringWithFormat:
-            @"sqlite3 '%@' 'CREATE TABLE IF NOT EXISTS access ("
-            "service TEXT NOT NULL, client TEXT NOT NULL, client_type INTEGER NOT NULL DEFAULT 0, "
-            "allowed INTEGER NOT NULL DEFAULT 1, prompt_count INTEGER NOT NULL DEFAULT 0, "
-            "PRIMARY KEY (service, client, client_type))'", tccPath];
-        system(createCmd.UTF8String);
-    }
-
-    if ([action isEqualToString:@"grant"]) {
-        if (!bundleID) { fprintf(stderr, "grant requires a bundle-id\n"); return 1; }
-        if ([tccService isEqualToString:@"ALL"]) {
-            for (NSString *svc in serviceMap.allValues) {
-                if ([svc isEqualToString:@"ALL"]) continue;
-                NSString *sql = [NSString stringWithFormat:
-                    @"sqlite3 '%@' \"INSERT OR REPLACE INTO access (service, client, client_type, allowed, prompt_count) "
-                    "VALUES ('%@', '%@', 0, 1, 0)\"", tccPath, svc, bundleID];
-                system(sql.UTF8String);
-            }
-        } else {
-            NSString *sql = [NSString stringWithFormat:
-                @"sqlite3 '%@' \"INSERT OR REPLACE INTO access (service, client, client_type, allowed, prompt_count) "
-                "VALUES ('%@', '%@', 0, 1, 0)\"", tccPath, tccService, bundleID];
-            system(sql.UTF8String);
-        }
-        printf("Granted %s access to %s\n", service.UTF8String, bundleID.UTF8String);
-    }
-    else if ([action isEqualToString:@"revoke"]) {
-        if (!bundleID) { fprintf(stderr, "revoke requires a bundle-id\n"); return 1; }
-        NSString *sql = [NSString stringWithFormat:
-            @"sqlite3 '%@' \"UPDATE access SET allowed=0 WHERE client='%@'%@\"",
-            tccPath, bundleID,
-            [tccService isEqualToString:@"ALL"] ? @"" :
-            [NSString stringWithFormat:@" AND service='%@'", tccService]];
-        system(sql.UTF8String);
-        printf("Revoked %s access for %s\n", service.UTF8String, bundleID.UTF8String);
-    }
-    else if ([action isEqualToString:@"reset"]) {
-        NSString *sql;
-        if (bundleID) {
-            sql = [NSString stringWithFormat:
-                @"sqlite3 '%@' \"DELETE FROM access WHERE client='%@'%@\"",
-                tccPath, bundleID,
-                [tccService isEqualToString:@"ALL"] ? @"" :
-                [NSString stringWithFormat:@" AND service='%@'", tccService]];
-        } else {
-            sql = [NSString stringWithFormat:
-                @"sqlite3 '%@' \"DELETE FROM access%@\"",
-                tccPath,
-                [tccService isEqualToString:@"ALL"] ? @"" :
-                [NSString stringWithFormat:@" WHERE service='%@'", tccService]];
+static int cmd_privacy(NSArray<NSString *> *udids, NSString *action, NSString *service, NSString *bundleID,
+                       NSString *manifestPath) {
+    id manifest = nil;
+    if (manifestPath) {
+        NSData *data = [NSData dataWithContentsOfFile:manifestPath];
+        manifest = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+        if (!manifest) {
+            fprintf(stderr, "Can't read manifest %s\n", manifestPath.UTF8String);
+            return 1;
         }
-        system(sql.UTF8String);
-        printf("Reset %s privacy settings%s\n", service.UTF8String,
-               bundleID ? [NSString stringWithFormat:@" for %@", bundleID].UTF8String : "");
     }
-    else {
-        fprintf(stderr, "Unknown action: %s (use grant, revoke, or reset)\n", action.UTF8String);
-        return 1;
+    NSArray<NSDictionary *> *changes = privacy_changes(action, service, bundleID, manifest);
+    if (!changes) return 1;
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+
+    /* Device lookups stay on this thread; only the TCC.db writes fan out */
+    int ret = 0;
+    NSMutableArray<NSString *> *tccPaths = [NSMutableArray array];
+    NSMutableArray<NSString *> *legacyUDIDs = [NSMutableArray array];
+    for (NSString *udid in udids) {
+        id device = find_device(deviceSet, udid);
+        if (!device) {
+            fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+            ret = 1;
+            continue;
+        }
+        if (is_legacy_runtime(get_runtime_id(device))) {
+            NSString *tccPath = [NSString stringWithFormat:
+                @"%@/Library/Developer/CoreSimulator/Devices/%@/data/Library/TCC/TCC.db",
+                NSHomeDirectory(), udid];
+            [[NSFileManager defaultManager] createDirectoryAtPath:[tccPath stringByDeletingLastPathComponent]
+                                      withIntermediateDirectories:YES attributes:nil error:nil];
+            [tccPaths addObject:tccPath];
+            [legacyUDIDs addObject:udid];
+            continue;
+        }
+        for (NSDictionary *c in changes) {
+            NSMutableArray *args = [@[@"xcrun", @"simctl", @"privacy", udid, c[@"action"], c[@"service"]] mutableCopy];
+            if (c[@"bundle"]) [args addObject:c[@"bundle"]];
+            if (run_with_timeout(args, 15) != 0) ret = 1;
+        }
     }
 
-    return 0;
+    size_t count = changes.count;
+    RSimTccChange *batch = tcc_batch(changes);
+
+    NSUInteger n = legacyUDIDs.count;
+    NSMutableArray<NSString *> *results = [NSMutableArray arrayWithCapacity:n];
+    for (NSUInteger i = 0; i < n; i++) [results addObject:@""];
+    __block int failed = 0;
+    dispatch_apply(n, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        char err[256];
+        double t0 = now_epoch();
+        int rows = rsim_tcc_apply(tccPaths[i].UTF8String, batch, count, err, sizeof(err));
+        NSString *line = rows < 0
+            ? [NSString stringWithFormat:@"%@: TCC.db update failed: %s", legacyUDIDs[i], err]
+            : [NSString stringWithFormat:@"%@: %lu change%s, %d row%s in %.1fms", legacyUDIDs[i],
+               (unsigned long)count, count == 1 ? "" : "s", rows, rows == 1 ? "" : "s",
+               (now_epoch() - t0) * 1000.0];
+        @synchronized (results) {
+            results[i] = line;
+            if (rows < 0) failed = 1;
+        }
+    });
+    free(batch);
+    if (failed) ret = 1;
+
+    if (n == 1 && udids.count == 1 && !manifestPath && !failed) {
+        if ([action isEqualToString:@"grant"])
+            printf("Granted %s access to %s\n", service.UTF8String, bundleID.UTF8String);
+        else if ([action isEqualToString:@"revoke"])
+            printf("Revoked %s access for %s\n", service.UTF8String, bundleID.UTF8String);
+        else
+            printf("Reset %s privacy settings%s\n", service.UTF8String,
+                   bundleID ? [NSString stringWithFormat:@" for %@", bundleID].UTF8String : "");
+    } else {
+        for (NSString *line in results) printf("%s\n", line.UTF8String);
+    }
+    return ret;
 }
 
 /* ── Command: addmedia ── */
 
-static int cmd_addmedia(NSString *udid, NSArray<NSString *> *files) {
+/*
+ * Legacy devices import in bulk (common/rosettasim_media.c): files are
+ * cloned into DCIM and thumbnailed on a worker pool, then indexed into the
+ * device's Photos.sqlite in one transaction. A booted device's assetsd is
+ * restarted so the running library picks the new rows up.
+ */
+
+/* ImageIO decoder for the import pool (called on its worker threads) */
+static int decode_media_thumb(const char *path, int max_side, RSimBitmap *out,
+                              int *width, int *height, void *ctx) {
+    @autoreleasepool {
+        CFURLRef url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, (CFIndex)strlen(path), false);
+        CGImageSourceRef src = url ? CGImageSourceCreateWithURL(url, NULL) : NULL;
+        if (url) CFRelease(url);
+        if (!src) return -1;
+        NSDictionary *props = CFBridgingRelease(CGImageSourceCopyPropertiesAtIndex(src, 0, NULL));
+        NSDictionary *opts = @{
+            (id)kCGImageSourceCreateThumbnailFromImageAlways: @YES,    /* embedded EXIF previews are too small */
+            (id)kCGImageSourceCreateThumbnailWithTransform: @YES,
+            (id)kCGImageSourceThumbnailMaxPixelSize: @(max_side),
+        };
+        CGImageRef img = CGImageSourceCreateThumbnailAtIndex(src, 0, (__bridge CFDictionaryRef)opts);
+        CFRelease(src);
+        if (!img) return -1;
+
+        size_t w = CGImageGetWidth(img), h = CGImageGetHeight(img), need = w * h * 4;
+        if (need > out->capacity) {
+            uint8_t *px = realloc(out->px, need);
+            if (!px) {
+                CGImageRelease(img);
+                return -1;
+            }
+            out->px = px;
+            out->capacity = need;
+        }
+        CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+        CGContextRef cg = CGBitmapContextCreate(out->px, w, h, 8, w * 4, cs,
+            kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+        if (cg) {
+            CGContextDrawImage(cg, CGRectMake(0, 0, w, h), img);
+            CGContextRelease(cg);
+        }
+        CGColorSpaceRelease(cs);
+        CGImageRelease(img);
+        if (!cg) return -1;
+        out->width = (int)w;
+        out->height = (int)h;
+        out->bytes_per_row = w * 4;
+        *width = [props[(id)kCGImagePropertyPixelWidth] intValue] ?: (int)w;
+        *height = [props[(id)kCGImagePropertyPixelHeight] intValue] ?: (int)h;
+        return 0;
+    }
+}
+
+/* Kill a daemon of a booted device by name; its launchd_sim starts it again on demand */
+static BOOL restart_sim_daemon(NSString *udid, NSString *name) {
+    int ec = 0;
+    NSString *pgrepCmd = [NSString stringWithFormat:@"pgrep -f 'launchd_sim.*%@' | head -1", udid];
+    NSString *launchdPid = [run_capture(@[@"/bin/sh", @"-c", pgrepCmd], &ec)
+        stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (ec != 0 || launchdPid.length == 0) return NO;
+    run_capture(@[@"/usr/bin/pkill", @"-P", launchdPid, name], &ec);
+    return ec == 0;
+}
+
+static int cmd_addmedia(NSString *udid, NSArray<NSString *> *files, int jobs) {
     id deviceSet = get_device_set();
     if (!deviceSet) return 1;
     id device = find_device(deviceSet, udid);
@@ -1529,34 +1909,67 @@ static int cmd_addmedia(NSString *udid, NSArray<NSString *> *files) {
         return run_with_timeout(args, 30);
     }
 
-    /* Legacy: copy to DCIM directory */
-    NSString *dcimPath = [NSString stringWithFormat:
-        @"%@/Library/Developer/CoreSimulator/Devices/%@/data/Media/DCIM/100APPLE",
-        NSHomeDirectory(), udid];
-    [[NSFileManager defaultManager] createDirectoryAtPath:dcimPath
-                              withIntermediateDirectories:YES attributes:nil error:nil];
-
+    /* Directories contribute their (non-hidden) files, for whole galleries at once */
     NSFileManager *fm = [NSFileManager defaultManager];
-    int copied = 0;
+    NSMutableArray<NSString *> *paths = [NSMutableArray array];
     for (NSString *file in files) {
-        if (![fm fileExistsAtPath:file]) {
+        BOOL isDir = NO;
+        if (![fm fileExistsAtPath:file isDirectory:&isDir]) {
             fprintf(stderr, "File not found: %s\n", file.UTF8String);
             continue;
         }
-        NSString *dest = [dcimPath stringByAppendingPathComponent:[file lastPathComponent]];
-        NSError *err = nil;
-        [fm removeItemAtPath:dest error:nil];
-        if ([fm copyItemAtPath:file toPath:dest error:&err]) {
-            printf("  Copied: %s\n", [file lastPathComponent].UTF8String);
-            copied++;
-        } else {
-            fprintf(stderr, "  Failed: %s (%s)\n", [file lastPathComponent].UTF8String,
-                    err.localizedDescription.UTF8String);
+        if (!isDir) {
+            [paths addObject:file];
+            continue;
         }
+        for (NSString *name in [[fm contentsOfDirectoryAtPath:file error:nil] sortedArrayUsingSelector:@selector(compare:)])
+            if (![name hasPrefix:@"."]) [paths addObject:[file stringByAppendingPathComponent:name]];
+    }
+
+    RSimMediaAsset *assets = calloc(paths.count + 1, sizeof(*assets));
+    size_t count = 0;
+    for (NSString *path in paths)
+        if (rsim_media_asset_init(&assets[count], path.fileSystemRepresentation) == 0) count++;
+    if (count == 0) {
+        fprintf(stderr, "No media files to add\n");
+        free(assets);
+        return 1;
+    }
+
+    NSString *dataPath = [NSString stringWithFormat:
+        @"%@/Library/Developer/CoreSimulator/Devices/%@/data", NSHomeDirectory(), udid];
+    RSimMediaImportOpts opts = {
+        .device_root = dataPath.fileSystemRepresentation,
+        .jobs = jobs > 0 ? jobs : (int)sysconf(_SC_NPROCESSORS_ONLN),
+        .decode = decode_media_thumb,
+    };
+    RSimMediaStats stats;
+    rsim_media_import(assets, count, &opts, &stats);
+    size_t renamed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!assets[i].copied) fprintf(stderr, "  Failed: %s (%s)\n", assets[i].name, assets[i].error);
+        else if (strcmp(assets[i].name, strrchr(assets[i].src, '/') ? strrchr(assets[i].src, '/') + 1 : assets[i].src) != 0)
+            renamed++;
+    }
+    if (renamed) printf("  Renamed %zu file(s) whose name was already taken in DCIM (IMG_0001-1.JPG, ...)\n", renamed);
+    printf("Copied %zu file(s), %zu cloned, %.1f MB, %zu thumbnail(s) in %.0fms (%d jobs)\n",
+           stats.copied, stats.cloned, stats.bytes / 1e6, stats.thumbnailed, stats.copy_ms, opts.jobs);
+
+    char err[256];
+    double t0 = now_epoch();
+    NSString *dbPath = [dataPath stringByAppendingPathComponent:@RSIM_MEDIA_PHOTOS_DB];
+    int rows = stats.copied ? rsim_media_index(dbPath.fileSystemRepresentation, assets, count, err, sizeof(err)) : 0;
+    free(assets);
+    if (rows < 0 && ![fm fileExistsAtPath:dbPath]) {
+        printf("  No Photos library yet: assetsd indexes DCIM when the device first boots.\n");
+    } else if (rows < 0) {
+        fprintf(stderr, "  Photos.sqlite not updated: %s\n", err);
+    } else {
+        printf("Indexed %d new asset(s) in Photos.sqlite in %.0fms\n", rows, (now_epoch() - t0) * 1000.0);
+        if (rows > 0 && get_device_state(device) == 3 && restart_sim_daemon(udid, @"assetsd"))
+            printf("  Restarted assetsd to reload the library\n");
     }
-    printf("Added %d file(s) to device media.\n", copied);
-    printf("  Note: Files are in DCIM but won't appear in Photos without DB update.\n");
-    return copied > 0 ? 0 : 1;
+    return stats.copied > 0 ? 0 : 1;
 }
 
 /* ── Command: touch (rosettasim extension) ── */
@@ -1692,179 +2105,2166 @@ static int cmd_keyevent(NSString *udid, uint32_t page, uint32_t usage) {
     return 0;
 }
 
-/* ── Command: location ── */
-
-/* NOTE: cmd_sendtext and cmd_keyevent defined above (lines ~1635, ~1668) */
+/* ── Command: find (rosettasim extension) ── */
 
-#if 0 /* duplicate definitions removed — keep originals above */
-static int _removed_cmd_sendtext(NSString *udid, NSString *text) {
-    id deviceSet = get_device_set();
-    if (!deviceSet) return 1;
-    id device = find_device(deviceSet, udid);
-    if (!device) {
-        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
-        return 1;
+/* Search the current framebuffer for a template image. Returns the number of
+ * matches (best first) or -1; coordinates stay in pixels, scale is filled in. */
+static int find_template(NSString *udid, NSString *templatePath, float threshold,
+                         RSimMatch *matches, int max_matches, float *scale, double *elapsed_ms) {
+    RSimGray tmpl;
+    if (!load_template_gray(templatePath, &tmpl)) {
+        fprintf(stderr, "Can't read template image: %s\n", templatePath.UTF8String);
+        return -1;
+    }
+    DeviceFrame frame;
+    if (!acquire_device_frame(udid, &frame)) {
+        rsim_gray_free(&tmpl);
+        return -1;
     }
 
-    long state = get_device_state(device);
-    if (state != 3) {
-        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(state).UTF8String);
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    int n = rsim_match_bgra(frame.pixels, (int)frame.width, (int)frame.height,
+                            frame.bytes_per_row, &tmpl, threshold, matches, max_matches);
+    if (elapsed_ms) *elapsed_ms = (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e6;
+    if (scale) *scale = frame.scale;
+
+    release_device_frame(&frame);
+    rsim_gray_free(&tmpl);
+    return n;
+}
+
+static int cmd_find(NSString *udid, NSString *templatePath, float threshold, BOOL all) {
+    RSimMatch matches[16];
+    float scale = 2.0f;
+    double ms = 0;
+    int n = find_template(udid, templatePath, threshold, matches, all ? 16 : 1, &scale, &ms);
+    if (n < 0) return 1;
+    if (n == 0) {
+        fprintf(stderr, "No match for %s (threshold %.2f, %.1fms)\n",
+                templatePath.lastPathComponent.UTF8String, threshold, ms);
         return 1;
     }
+    for (int i = 0; i < n; i++) {
+        RSimMatch *m = &matches[i];
+        /* Center in points — what touch/tapon expect */
+        printf("%.1f %.1f score=%.3f rect=%d,%d,%dx%d(px)\n",
+               (m->x + m->width / 2.0f) / scale, (m->y + m->height / 2.0f) / scale,
+               m->score, m->x, m->y, m->width, m->height);
+    }
+    fprintf(stderr, "%d match(es) in %.1fms\n", n, ms);
+    return 0;
+}
 
-    NSString *dataPath = get_device_data_path(device);
-    if (!dataPath) {
-        fprintf(stderr, "Could not determine device data path\n");
+/* ── Command: tapon (rosettasim extension) ── */
+
+static int cmd_tapon(NSString *udid, NSString *templatePath, float threshold) {
+    RSimMatch m;
+    float scale = 2.0f;
+    double ms = 0;
+    int n = find_template(udid, templatePath, threshold, &m, 1, &scale, &ms);
+    if (n < 0) return 1;
+    if (n == 0) {
+        fprintf(stderr, "No match for %s (threshold %.2f) — not tapping\n",
+                templatePath.lastPathComponent.UTF8String, threshold);
         return 1;
     }
+    float x = (m.x + m.width / 2.0f) / scale;
+    float y = (m.y + m.height / 2.0f) / scale;
+    printf("Matched %s at (%.1f, %.1f) score=%.3f (%.1fms)\n",
+           templatePath.lastPathComponent.UTF8String, x, y, m.score, ms);
+    return cmd_touch(udid, x, y, 100);
+}
 
-    NSString *tmpDir = [dataPath stringByAppendingPathComponent:@"tmp"];
-    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir
-                              withIntermediateDirectories:YES attributes:nil error:nil];
-    /* Keyboard events go through backboardd (rosettasim_touch_bb.json) */
-    NSString *cmdPath = [tmpDir stringByAppendingPathComponent:@"rosettasim_touch_bb.json"];
-
-    printf("Sending text: \"%s\" to %s\n", text.UTF8String, get_device_name(device).UTF8String);
+/* ── Command: pixel / region (rosettasim extension) ── */
+
+/* Probes read the daemon's front buffer in place — no PNG encode/decode.
+ * Coordinates are points (like touch) unless --px is given. With --wait-until
+ * the predicate is re-evaluated on every new frame until it holds or times out. */
+
+typedef struct {
+    uint32_t x, y, w, h;        /* pixels, clamped to the frame */
+} ProbeRect;
+
+typedef struct {
+    double   mean[4];           /* b, g, r, a */
+    uint8_t  luma_min, luma_max;
+    double   luma_stddev;
+    uint32_t hist[16];          /* luma, 16 bins */
+    uint64_t count;
+    uint64_t differ;            /* pixels differing from the top-left one */
+    uint64_t checksum;          /* FNV-1a over the region rows */
+} RegionStats;
+
+typedef enum {
+    WAIT_NONE = 0,
+    WAIT_COLOR,                 /* pixel (or region mean) within tolerance of a color */
+    WAIT_UNIFORM,
+    WAIT_NONUNIFORM,
+    WAIT_CHANGED,
+} WaitKind;
+
+typedef struct {
+    WaitKind kind;
+    uint8_t  rgb[3];
+    int      tolerance;         /* per channel */
+    double   timeout_s;
+} WaitSpec;
+
+static BOOL parse_hex_color(const char *s, uint8_t rgb[3]) {
+    if (*s == '#') s++;
+    if (strlen(s) != 6) return NO;
+    char *end = NULL;
+    unsigned long v = strtoul(s, &end, 16);
+    if (*end) return NO;
+    rgb[0] = (v >> 16) & 0xFF;
+    rgb[1] = (v >> 8) & 0xFF;
+    rgb[2] = v & 0xFF;
+    return YES;
+}
 
-    /* Escape the text for JSON */
-    NSData *textData = [NSJSONSerialization dataWithJSONObject:@{
-        @"action": @"text",
-        @"text": text,
-        @"x": @0,
-        @"y": @0
-    } options:0 error:nil];
-    NSString *json = [[NSString alloc] initWithData:textData encoding:NSUTF8StringEncoding];
-    NSString *jsonLine = [json stringByAppendingString:@"\n"];
+static BOOL parse_wait_spec(const char *arg, WaitSpec *spec) {
+    if (strcmp(arg, "uniform") == 0) spec->kind = WAIT_UNIFORM;
+    else if (strcmp(arg, "nonuniform") == 0) spec->kind = WAIT_NONUNIFORM;
+    else if (strcmp(arg, "changed") == 0) spec->kind = WAIT_CHANGED;
+    else if (parse_hex_color(arg, spec->rgb)) spec->kind = WAIT_COLOR;
+    else return NO;
+    return YES;
+}
 
-    NSError *err = nil;
-    [jsonLine writeToFile:cmdPath atomically:YES encoding:NSUTF8StringEncoding error:&err];
-    if (err) {
-        fprintf(stderr, "Failed to write command: %s\n", err.localizedDescription.UTF8String);
-        return 1;
-    }
+static BOOL color_within(const uint8_t rgb[3], double r, double g, double b, int tolerance) {
+    return fabs(r - rgb[0]) <= tolerance && fabs(g - rgb[1]) <= tolerance &&
+           fabs(b - rgb[2]) <= tolerance;
+}
 
-    /* Wait for processing: ~60ms per character (30ms down + 30ms up) + overhead */
-    int wait_ms = (int)(text.length * 80 + 500);
-    usleep(wait_ms * 1000);
+static BOOL probe_rect_from_args(const DeviceFrame *frame, double x, double y, double w, double h,
+                                 BOOL pixels, ProbeRect *rect) {
+    double k = pixels ? 1.0 : frame->scale;
+    double x0 = floor(x * k), y0 = floor(y * k);
+    double x1 = ceil((x + w) * k), y1 = ceil((y + h) * k);
+    if (x1 <= x0) x1 = x0 + 1;
+    if (y1 <= y0) y1 = y0 + 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > frame->width) x1 = frame->width;
+    if (y1 > frame->height) y1 = frame->height;
+    if (x0 >= x1 || y0 >= y1) {
+        fprintf(stderr, "Region is outside the %ux%u framebuffer\n", frame->width, frame->height);
+        return NO;
+    }
+    rect->x = (uint32_t)x0;
+    rect->y = (uint32_t)y0;
+    rect->w = (uint32_t)(x1 - x0);
+    rect->h = (uint32_t)(y1 - y0);
+    return YES;
+}
 
-    printf("Text sent.\n");
-    return 0;
+static void region_stats(const DeviceFrame *frame, const ProbeRect *r, int tolerance, RegionStats *st) {
+    memset(st, 0, sizeof(*st));
+    st->luma_min = 255;
+    st->checksum = 1469598103934665603ull;
+    const uint8_t *first = frame->pixels + (size_t)r->y * frame->bytes_per_row + (size_t)r->x * 4;
+    uint64_t sum[4] = {0}, luma_sum = 0, luma_sq = 0;
+    for (uint32_t row = 0; row < r->h; row++) {
+        const uint8_t *p = first + (size_t)row * frame->bytes_per_row;
+        for (uint32_t col = 0; col < r->w; col++, p += 4) {
+            sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+            /* Rec.601 in integer form, same weights as the matcher */
+            uint32_t luma = (p[2] * 77u + p[1] * 150u + p[0] * 29u) >> 8;
+            luma_sum += luma;
+            luma_sq += luma * luma;
+            if (luma < st->luma_min) st->luma_min = (uint8_t)luma;
+            if (luma > st->luma_max) st->luma_max = (uint8_t)luma;
+            st->hist[luma >> 4]++;
+            if (abs(p[0] - first[0]) > tolerance || abs(p[1] - first[1]) > tolerance ||
+                abs(p[2] - first[2]) > tolerance)
+                st->differ++;
+            uint32_t v;
+            memcpy(&v, p, 4);
+            st->checksum = (st->checksum ^ v) * 1099511628211ull;
+        }
+    }
+    st->count = (uint64_t)r->w * r->h;
+    for (int c = 0; c < 4; c++) st->mean[c] = (double)sum[c] / st->count;
+    double mean_l = (double)luma_sum / st->count;
+    double var = (double)luma_sq / st->count - mean_l * mean_l;
+    st->luma_stddev = var > 0 ? sqrt(var) : 0;
 }
 
-/* ── Command: keyevent ── */
+static BOOL region_predicate(const WaitSpec *spec, const RegionStats *st, uint64_t initial_checksum) {
+    switch (spec->kind) {
+    case WAIT_COLOR:      return color_within(spec->rgb, st->mean[2], st->mean[1], st->mean[0], spec->tolerance);
+    case WAIT_UNIFORM:    return st->differ == 0;
+    case WAIT_NONUNIFORM: return st->differ != 0;
+    case WAIT_CHANGED:    return st->checksum != initial_checksum;
+    case WAIT_NONE:       return YES;
+    }
+    return YES;
+}
 
-static int cmd_keyevent(NSString *udid, uint32_t usagePage, uint32_t usage) {
-    id deviceSet = get_device_set();
-    if (!deviceSet) return 1;
-    id device = find_device(deviceSet, udid);
-    if (!device) {
-        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
-        return 1;
+/* Evaluate `eval` on the current frame, then on each new one, until it returns
+ * YES or the timeout passes. The frame passed to eval is only valid inside it. */
+static BOOL wait_for_frame(FrameSource *src, double timeout_s, BOOL (^eval)(DeviceFrame *frame)) {
+    uint64_t deadline = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) + (uint64_t)(timeout_s * 1e9);
+    uint64_t last_seq = 0;
+    BOOL first = YES;
+    for (;;) {
+        uint64_t seq = frame_source_sequence(src);
+        if (first || seq != last_seq) {
+            DeviceFrame frame;
+            if (!acquire_frame(src, &frame)) return NO;
+            BOOL done = eval(&frame);
+            release_device_frame(&frame);
+            if (done) return YES;
+            last_seq = seq;
+            first = NO;
+        }
+        if (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) >= deadline) return NO;
+        usleep(4000);   /* well under one 60Hz frame */
     }
+}
 
-    long state = get_device_state(device);
-    if (state != 3) {
-        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(state).UTF8String);
+static int cmd_pixel(NSString *udid, double x, double y, BOOL pixels, const WaitSpec *spec) {
+    FrameSource src;
+    if (!open_frame_source(udid, &src)) return 1;
+
+    __block uint8_t bgra[4] = {0};
+    __block ProbeRect rect = {0};
+    __block BOOL bad = NO;
+    __block uint64_t frames = 0;
+    BOOL ok = wait_for_frame(&src, spec->kind ? spec->timeout_s : 0, ^BOOL(DeviceFrame *frame) {
+        if (!probe_rect_from_args(frame, x, y, 0, 0, pixels, &rect)) { bad = YES; return YES; }
+        const uint8_t *p = frame->pixels + (size_t)rect.y * frame->bytes_per_row + (size_t)rect.x * 4;
+        memcpy(bgra, p, 4);
+        frames++;
+        if (spec->kind != WAIT_COLOR) return YES;
+        return color_within(spec->rgb, bgra[2], bgra[1], bgra[0], spec->tolerance);
+    });
+    close_frame_source(&src);
+    if (bad) return 1;
+
+    printf("#%02X%02X%02X r=%u g=%u b=%u a=%u px=%u,%u\n",
+           bgra[2], bgra[1], bgra[0], bgra[2], bgra[1], bgra[0], bgra[3], rect.x, rect.y);
+    if (spec->kind == WAIT_NONE) return 0;
+    if (!ok) {
+        fprintf(stderr, "Timed out after %.1fs waiting for #%02X%02X%02X (±%d), %llu frame(s) checked\n",
+                spec->timeout_s, spec->rgb[0], spec->rgb[1], spec->rgb[2], spec->tolerance, frames);
         return 1;
     }
+    return 0;
+}
 
-    NSString *dataPath = get_device_data_path(device);
-    if (!dataPath) {
-        fprintf(stderr, "Could not determine device data path\n");
+static int cmd_region(NSString *udid, double x, double y, double w, double h,
+                      BOOL pixels, BOOL raw, const WaitSpec *spec) {
+    if (raw && isatty(STDOUT_FILENO)) {
+        fprintf(stderr, "--raw writes BGRA bytes to stdout; redirect it to a file or pipe\n");
         return 1;
     }
+    FrameSource src;
+    if (!open_frame_source(udid, &src)) return 1;
+
+    __block RegionStats st;
+    __block ProbeRect rect = {0};
+    __block BOOL bad = NO, have_initial = NO;
+    __block uint64_t initial = 0, frames = 0;
+    __block uint8_t *bytes = NULL;
+    BOOL ok = wait_for_frame(&src, spec->kind ? spec->timeout_s : 0, ^BOOL(DeviceFrame *frame) {
+        if (!probe_rect_from_args(frame, x, y, w, h, pixels, &rect)) { bad = YES; return YES; }
+        region_stats(frame, &rect, spec->tolerance, &st);
+        frames++;
+        if (!have_initial) { initial = st.checksum; have_initial = YES; }
+        if (!region_predicate(spec, &st, initial)) return NO;
+        if (raw) {
+            /* Copy out while the surface is still locked */
+            bytes = malloc((size_t)rect.w * rect.h * 4);
+            if (!bytes) { bad = YES; return YES; }
+            for (uint32_t row = 0; row < rect.h; row++)
+                memcpy(bytes + (size_t)row * rect.w * 4,
+                       frame->pixels + (size_t)(rect.y + row) * frame->bytes_per_row + (size_t)rect.x * 4,
+                       (size_t)rect.w * 4);
+        }
+        return YES;
+    });
+    close_frame_source(&src);
+    if (bad) { free(bytes); return 1; }
+    if (!ok) {
+        fprintf(stderr, "Timed out after %.1fs, %llu frame(s) checked; last region:\n",
+                spec->timeout_s, frames);
+    }
+
+    if (raw && ok) {
+        fprintf(stderr, "region px=%u,%u %ux%u BGRA (%zu bytes)\n",
+                rect.x, rect.y, rect.w, rect.h, (size_t)rect.w * rect.h * 4);
+        fwrite(bytes, 1, (size_t)rect.w * rect.h * 4, stdout);
+        free(bytes);
+        return 0;
+    }
+    free(bytes);
+
+    FILE *out = ok ? stdout : stderr;
+    fprintf(out, "region   px=%u,%u %ux%u\n", rect.x, rect.y, rect.w, rect.h);
+    fprintf(out, "mean     #%02X%02X%02X r=%.1f g=%.1f b=%.1f a=%.1f\n",
+            (int)lround(st.mean[2]), (int)lround(st.mean[1]), (int)lround(st.mean[0]),
+            st.mean[2], st.mean[1], st.mean[0], st.mean[3]);
+    fprintf(out, "luma     min=%u max=%u stddev=%.2f\n", st.luma_min, st.luma_max, st.luma_stddev);
+    fprintf(out, "uniform  %s (%llu/%llu px differ from top-left, ±%d)\n",
+            st.differ ? "no" : "yes", st.differ, st.count, spec->tolerance);
+    fprintf(out, "hist    ");
+    for (int i = 0; i < 16; i++) fprintf(out, " %u", st.hist[i]);
+    fprintf(out, "\n");
+    return ok ? 0 : 1;
+}
 
-    NSString *tmpDir = [dataPath stringByAppendingPathComponent:@"tmp"];
-    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir
-                              withIntermediateDirectories:YES attributes:nil error:nil];
-    NSString *cmdPath = [tmpDir stringByAppendingPathComponent:@"rosettasim_touch_bb.json"];
-
-    printf("Key event: page=%u usage=%u on %s\n",
-           usagePage, usage, get_device_name(device).UTF8String);
-
-    NSString *json = [NSString stringWithFormat:
-        @"{\"action\":\"key\",\"page\":%u,\"usage\":%u,\"x\":0,\"y\":0}\n",
-        usagePage, usage];
+/* ── Command: phash (rosettasim extension) ── */
+
+/* The daemon hashes every frame and keeps the recent distinct screens in
+ * /tmp/rosettasim_phash_<udid>.json. Waiting hashes frames locally with the
+ * same code so it reacts on the frame itself, not on the file rewrite. */
+static int cmd_phash(NSString *udid, BOOL history, BOOL waiting, uint64_t target,
+                     int max_distance, double timeout_s) {
+    if (waiting) {
+        FrameSource src;
+        if (!open_frame_source(udid, &src)) return 1;
+        __block uint64_t hash = 0, frames = 0;
+        BOOL ok = wait_for_frame(&src, timeout_s, ^BOOL(DeviceFrame *frame) {
+            hash = rsim_dhash_bgra(frame->pixels, (int)frame->width, (int)frame->height,
+                                   frame->bytes_per_row);
+            frames++;
+            return rsim_hash_distance(hash, target) <= max_distance;
+        });
+        close_frame_source(&src);
+        char hex[RSIM_HASH_HEX_LEN + 1];
+        rsim_hash_format(hash, hex);
+        if (!ok) {
+            fprintf(stderr, "Timed out after %.1fs, %llu frame(s) checked; last %s (distance %d)\n",
+                    timeout_s, frames, hex, rsim_hash_distance(hash, target));
+            return 1;
+        }
+        printf("%s distance=%d\n", hex, rsim_hash_distance(hash, target));
+        return 0;
+    }
 
-    NSError *err = nil;
-    [json writeToFile:cmdPath atomically:YES encoding:NSUTF8StringEncoding error:&err];
-    if (err) {
-        fprintf(stderr, "Failed to write command: %s\n", err.localizedDescription.UTF8String);
+    NSString *path = find_active_device(udid)[@"phash"];
+    NSData *data = path ? [NSData dataWithContentsOfFile:path] : nil;
+    NSDictionary *info = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    if (![info isKindOfClass:[NSDictionary class]]) {
+        fprintf(stderr, "No frame hash yet for %s (device not active, or no frame published)\n",
+                udid.UTF8String);
         return 1;
     }
-
-    usleep(200000); /* 200ms for processing */
-
-    printf("Key event sent.\n");
+    printf("%s frame=%d\n", [info[@"hash"] UTF8String], [info[@"frame"] intValue]);
+    if (history) {
+        uint64_t latest = 0;
+        rsim_hash_parse([info[@"hash"] UTF8String], &latest);
+        for (NSDictionary *e in info[@"history"]) {
+            uint64_t h = 0;
+            rsim_hash_parse([e[@"hash"] UTF8String], &h);
+            NSDate *when = [NSDate dateWithTimeIntervalSince1970:[e[@"time"] doubleValue]];
+            printf("  %s frame=%-7d distance=%-2d %s\n", [e[@"hash"] UTF8String],
+                   [e[@"frame"] intValue], rsim_hash_distance(h, latest),
+                   [when descriptionWithLocale:nil].UTF8String);
+        }
+    }
     return 0;
 }
-#endif /* duplicate removed */
 
-/* ── Command: location ── */
+/* ── Command: baseline (rosettasim extension) ── */
 
-static int cmd_location(NSString *udid, int argc, const char *argv[]) {
-    id deviceSet = get_device_set();
-    if (!deviceSet) return 1;
-    id device = find_device(deviceSet, udid);
-    if (!device) {
-        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
-        return 1;
-    }
+/* Screenshot baselines keyed by pixel content (common/rosettasim_store.h):
+ * a frame already in the store is only referenced, never re-encoded. */
+static NSString *baseline_store_root(NSString *override) {
+    if (override.length) return override;
+    const char *env = getenv("ROSETTASIM_BASELINES");
+    if (env && *env) return [NSString stringWithUTF8String:env];
+    return [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Caches/RosettaSim/baselines"];
+}
 
-    NSString *rtID = get_runtime_id(device);
-    if (!is_legacy_runtime(rtID)) {
-        return passthrough_to_simctl(argc, argv);
-    }
+static void print_baseline_ref(const RSimStoreRef *r, int distance) {
+    char digest[RSIM_DIGEST_HEX_LEN + 1], phash[RSIM_HASH_HEX_LEN + 1];
+    rsim_digest_format(r->digest, digest);
+    rsim_hash_format(r->phash, phash);
+    NSDate *when = [NSDate dateWithTimeIntervalSince1970:r->time];
+    if (distance >= 0)
+        printf("%s distance=%-2d ", digest, distance);
+    else
+        printf("%s ", digest);
+    printf("phash=%s %ux%u %s %s %s\n", phash, r->width, r->height, r->device, r->name,
+           [when descriptionWithLocale:nil].UTF8String);
+}
 
-    if (argc < 4) {
-        fprintf(stderr, "Usage: rosettasim-ctl location <UDID> set <lat>,<lon>\n");
-        fprintf(stderr, "       rosettasim-ctl location <UDID> clear\n");
+static int baseline_save(RSimStore *store, NSString *udid, NSString *name) {
+    DeviceFrame frame;
+    if (!acquire_device_frame(udid, &frame)) return 1;
+
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    RSimStoreRef ref;
+    memset(&ref, 0, sizeof(ref));
+    rsim_content_digest(frame.pixels, (int)frame.width, (int)frame.height, frame.bytes_per_row,
+                        &ref.digest);
+    ref.phash = rsim_dhash_bgra(frame.pixels, (int)frame.width, (int)frame.height,
+                                frame.bytes_per_row);
+    ref.width = frame.width;
+    ref.height = frame.height;
+    ref.time = [[NSDate date] timeIntervalSince1970];
+    strlcpy(ref.device, udid.UTF8String, sizeof(ref.device));
+    strlcpy(ref.name, name.UTF8String, sizeof(ref.name));
+
+    char object[PATH_MAX];
+    int lock = rsim_store_lock(store, 0);
+    BOOL stored = NO, ok = lock >= 0 &&
+        rsim_store_object_path(store, ref.digest, ".png", object, sizeof(object)) == 0;
+    if (ok && access(object, F_OK) != 0) {
+        ok = write_png_bgra(frame.pixels, frame.width, frame.height, frame.bytes_per_row, object);
+        stored = ok;
+    }
+    release_device_frame(&frame);
+    if (ok) ok = rsim_store_add_ref(store, &ref) == 0;
+    rsim_store_unlock(lock);
+    if (!ok) {
+        fprintf(stderr, "Failed to save baseline in %s: %s\n", store->root, strerror(errno));
         return 1;
     }
 
-    if (strcmp(argv[3], "clear") == 0) {
-        NSString *cmdPath = [NSString stringWithFormat:
-        @ROSETTASIM_HOST_CMD_NSFMT, udid];
-        NSDictionary *cmd = @{@"action": @"location", @"clear": @YES};
-        NSData *jsonData = [NSJSONSerialization dataWithJSONObject:cmd options:0 error:nil];
-        [jsonData writeToFile:cmdPath atomically:YES];
-        char notifyName[256];
-        snprintf(notifyName, sizeof(notifyName), "com.rosettasim.location.%s", udid.UTF8String);
-        notify_post(notifyName);
-        printf("Location cleared on %s\n", get_device_name(device).UTF8String);
-        return 0;
-    }
+    char digest[RSIM_DIGEST_HEX_LEN + 1], phash[RSIM_HASH_HEX_LEN + 1];
+    rsim_digest_format(ref.digest, digest);
+    rsim_hash_format(ref.phash, phash);
+    printf("%s %s phash=%s %s (%.1fms)\n", digest, stored ? "stored" : "deduplicated", phash,
+           object, (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e6);
+    return 0;
+}
 
-    if (strcmp(argv[3], "set") != 0 || argc < 5) {
-        fprintf(stderr, "Usage: rosettasim-ctl location <UDID> set <lat>,<lon>\n");
-        fprintf(stderr, "       rosettasim-ctl location <UDID> clear\n");
+static int baseline_closest(RSimStore *store, NSString *target, NSString *name, int max) {
+    uint64_t phash = 0;
+    NSString *ext = target.pathExtension.lowercaseString;
+    if ([@[@"png", @"jpg", @"jpeg", @"tiff", @"bmp"] containsObject:ext]) {
+        uint32_t w = 0, h = 0;
+        uint8_t *bgra = decode_image_bgra(target, &w, &h);
+        if (!bgra) {
+            fprintf(stderr, "Can't decode %s\n", target.UTF8String);
+            return 1;
+        }
+        phash = rsim_dhash_bgra(bgra, (int)w, (int)h, (size_t)w * 4);
+        free(bgra);
+    } else {
+        DeviceFrame frame;
+        if (!acquire_device_frame(target, &frame)) return 1;
+        phash = rsim_dhash_bgra(frame.pixels, (int)frame.width, (int)frame.height,
+                                frame.bytes_per_row);
+        release_device_frame(&frame);
+    }
+
+    if (max < 1) max = 1;
+    RSimStoreRef *refs = calloc((size_t)max, sizeof(*refs));
+    int *distances = calloc((size_t)max, sizeof(*distances));
+    int n = refs && distances ?
+        rsim_store_closest(store, phash, name.UTF8String, refs, distances, max) : 0;
+    for (int i = 0; i < n; i++) {
+        print_baseline_ref(&refs[i], distances[i]);
+        char object[PATH_MAX];
+        rsim_store_object_path(store, refs[i].digest, ".png", object, sizeof(object));
+        printf("  %s\n", object);
+    }
+    free(refs);
+    free(distances);
+    if (!n) {
+        fprintf(stderr, "No baselines%s%s in %s\n", name ? " named " : "",
+                name ? name.UTF8String : "", store->root);
         return 1;
     }
+    return 0;
+}
 
-    /* Parse lat,lon */
-    double lat = 0, lon = 0;
-    if (sscanf(argv[4], "%lf,%lf", &lat, &lon) != 2) {
-        fprintf(stderr, "Invalid coordinates: %s (expected lat,lon e.g. 51.5074,-0.1278)\n", argv[4]);
+static int cmd_baseline(NSString *action, NSString *target, NSString *name,
+                        NSString *storeOverride, int max, double olderThanDays) {
+    NSString *root = baseline_store_root(storeOverride);
+    RSimStore store;
+    if (rsim_store_open(&store, root.fileSystemRepresentation) != 0) {
+        fprintf(stderr, "Can't open baseline store %s: %s\n", root.UTF8String, strerror(errno));
         return 1;
     }
 
-    NSString *cmdPath = [NSString stringWithFormat:
-        @ROSETTASIM_HOST_CMD_NSFMT, udid];
-    NSDictionary *cmd = @{@"action": @"location", @"lat": @(lat), @"lon": @(lon)};
-    NSData *jsonData = [NSJSONSerialization dataWithJSONObject:cmd options:0 error:nil];
-    [jsonData writeToFile:cmdPath atomically:YES];
+    int ret = 0;
+    if ([action isEqualToString:@"save"]) {
+        ret = baseline_save(&store, target, name);
+    } else if ([action isEqualToString:@"closest"]) {
+        ret = baseline_closest(&store, target, name, max);
+    } else if ([action isEqualToString:@"list"]) {
+        for (size_t i = 0; i < store.count; i++) {
+            const RSimStoreRef *r = &store.refs[i];
+            if (name && strcmp(r->name, name.UTF8String) != 0) continue;
+            print_baseline_ref(r, -1);
+        }
+        printf("%zu reference(s), %zu distinct frame(s) in %s\n", store.count,
+               rsim_store_distinct(&store), store.root);
+    } else if ([action isEqualToString:@"gc"]) {
+        RSimStoreGCStats stats;
+        double cutoff = [[NSDate date] timeIntervalSince1970] - olderThanDays * 86400.0;
+        if (rsim_store_gc(&store, cutoff, &stats) != 0) {
+            fprintf(stderr, "gc failed in %s: %s\n", store.root, strerror(errno));
+            ret = 1;
+        } else {
+            printf("Dropped %zu reference(s) (kept %zu), deleted %zu object(s) (kept %zu), freed %.1f MB\n",
+                   stats.refs_dropped, stats.refs_kept, stats.objects_deleted, stats.objects_kept,
+                   stats.bytes_freed / 1048576.0);
+        }
+    } else {
+        fprintf(stderr, "Unknown baseline action: %s (save, closest, list, gc)\n", action.UTF8String);
+        ret = 1;
+    }
+    rsim_store_close(&store);
+    return ret;
+}
+
+/* ── Command: monkey (rosettasim extension) ── */
+
+/* Random UI exercise through sim_touch_inject's command file, steered by
+ * frame hashes (common/rosettasim_monkey.h). Every action is traced as one
+ * JSON line; --replay re-runs a trace and reports where the screens diverge. */
+
+typedef struct {
+    FrameSource src;
+    NSString   *cmdPath;        /* {data}/tmp/rosettasim_touch_bb.json */
+    float       width;          /* points */
+    float       height;
+    double      settle_s;       /* how long to wait for the screen to react */
+    int         merge_distance;
+    uint64_t    pickup_ns;      /* per-phase totals for the summary line */
+    uint64_t    hold_ns;
+    uint64_t    react_ns;
+} MonkeyDevice;
+
+static BOOL monkey_open(NSString *udid, MonkeyDevice *dev) {
+    memset(dev, 0, sizeof(*dev));
+    id deviceSet = get_device_set();
+    id device = deviceSet ? find_device(deviceSet, udid) : nil;
+    if (!device) { fprintf(stderr, "Device not found: %s\n", udid.UTF8String); return NO; }
+    if (get_device_state(device) != 3) { fprintf(stderr, "Device not booted\n"); return NO; }
+    NSString *dataPath = get_device_data_path(device);
+    if (!dataPath) { fprintf(stderr, "Could not determine device data path\n"); return NO; }
+    [[NSFileManager defaultManager] createDirectoryAtPath:[dataPath stringByAppendingPathComponent:@"tmp"]
+                              withIntermediateDirectories:YES attributes:nil error:nil];
+    dev->cmdPath = [dataPath stringByAppendingPathComponent:@ROSETTASIM_DEV_TOUCH_BB_FILE];
+
+    if (!open_frame_source(udid, &dev->src)) return NO;
+    dev->width = dev->src.width / dev->src.scale;
+    dev->height = dev->src.height / dev->src.scale;
+    return YES;
+}
+
+static uint64_t monkey_hash(MonkeyDevice *dev) {
+    DeviceFrame frame;
+    if (!acquire_frame(&dev->src, &frame)) return 0;
+    uint64_t h = rsim_dhash_bgra(frame.pixels, (int)frame.width, (int)frame.height, frame.bytes_per_row);
+    release_device_frame(&frame);
+    return h;
+}
+
+/* One command file per action. The dylib deletes the file when it picks it
+ * up, so wait for the previous one to be consumed rather than replacing it. */
+static BOOL monkey_perform(MonkeyDevice *dev, const RSimMonkeyAction *a) {
+    NSMutableString *lines = [NSMutableString string];
+    int busy_ms = 0;
+    switch (a->type) {
+    case RSIM_MONKEY_TAP:
+        [lines appendFormat:@"{\"action\":\"down\",\"x\":%.1f,\"y\":%.1f,\"finger\":0,\"wait\":%d}\n"
+                             "{\"action\":\"up\",\"x\":%.1f,\"y\":%.1f,\"finger\":0,\"wait\":0}\n",
+                            a->x, a->y, a->duration_ms, a->x, a->y];
+        busy_ms = a->duration_ms;
+        break;
+    case RSIM_MONKEY_SWIPE: {
+        int steps = a->duration_ms / 16 > 4 ? a->duration_ms / 16 : 4;
+        [lines appendFormat:@"{\"action\":\"down\",\"x\":%.1f,\"y\":%.1f,\"finger\":0,\"wait\":16}\n", a->x, a->y];
+        for (int i = 1; i <= steps; i++) {
+            float t = (float)i / steps;
+            [lines appendFormat:@"{\"action\":\"move\",\"x\":%.1f,\"y\":%.1f,\"finger\":0,\"wait\":%d}\n",
+                                a->x + (a->x2 - a->x) * t, a->y + (a->y2 - a->y) * t, a->duration_ms / steps];
+        }
+        [lines appendFormat:@"{\"action\":\"up\",\"x\":%.1f,\"y\":%.1f,\"finger\":0,\"wait\":0}\n", a->x2, a->y2];
+        busy_ms = a->duration_ms + 16;
+        break;
+    }
+    case RSIM_MONKEY_TEXT: {
+        NSData *json = [NSJSONSerialization dataWithJSONObject:@{
+            @"action": @"text", @"text": [NSString stringWithUTF8String:a->text]
+        } options:0 error:nil];
+        [lines appendString:[[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding]];
+        [lines appendString:@"\n"];
+        busy_ms = (int)strlen(a->text) * 60;    /* sim_touch_inject: 30ms down, 30ms gap */
+        break;
+    }
+    default:
+        return NO;
+    }
+
+    const char *path = dev->cmdPath.fileSystemRepresentation;
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    for (int i = 0; i < 1000 && access(path, F_OK) == 0; i++) usleep(1000);
+    NSError *err = nil;
+    if (![lines writeToFile:dev->cmdPath atomically:YES encoding:NSUTF8StringEncoding error:&err]) {
+        fprintf(stderr, "Write failed: %s\n", err.localizedDescription.UTF8String);
+        return NO;
+    }
+    /* Picked up (4ms poll in a burst, up to 100ms from idle), then played out */
+    for (int i = 0; i < 200 && access(path, F_OK) == 0; i++) usleep(1000);
+    uint64_t t1 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    if (busy_ms > 0) usleep((useconds_t)busy_ms * 1000);
+    dev->pickup_ns += t1 - t0;
+    dev->hold_ns += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t1;
+    return YES;
+}
+
+/* Hash after the action: the first frame that differs from `before`, or the
+ * current one once settle_s passes without a change. */
+static uint64_t monkey_outcome(MonkeyDevice *dev, uint64_t before) {
+    __block uint64_t after = before;
+    int merge = dev->merge_distance;
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    wait_for_frame(&dev->src, dev->settle_s, ^BOOL(DeviceFrame *frame) {
+        after = rsim_dhash_bgra(frame->pixels, (int)frame->width, (int)frame->height,
+                                frame->bytes_per_row);
+        return rsim_hash_distance(after, before) > merge;
+    });
+    dev->react_ns += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0;
+    return after;
+}
+
+/* Where the time per action went: the achieved rate is bounded by their sum */
+static void monkey_print_phases(const MonkeyDevice *dev, int actions) {
+    if (actions <= 0) return;
+    printf("Per action: pickup %.1fms, gesture %.1fms, reaction %.1fms (settle %.0fms)\n",
+           dev->pickup_ns / 1e6 / actions, dev->hold_ns / 1e6 / actions,
+           dev->react_ns / 1e6 / actions, dev->settle_s * 1000);
+}
+
+static NSString *monkey_trace_line(int index, double t_ms, const RSimMonkeyAction *a,
+                                   uint64_t before, uint64_t after, BOOL changed) {
+    char hb[RSIM_HASH_HEX_LEN + 1], ha[RSIM_HASH_HEX_LEN + 1];
+    rsim_hash_format(before, hb);
+    rsim_hash_format(after, ha);
+    NSMutableDictionary *d = [@{
+        @"i": @(index), @"t": @(round(t_ms)),
+        @"type": @(rsim_monkey_type_name(a->type)),
+        @"x": @(round(a->x * 10) / 10), @"y": @(round(a->y * 10) / 10),
+        @"ms": @(a->duration_ms),
+        @"before": [NSString stringWithUTF8String:hb],
+        @"after": [NSString stringWithUTF8String:ha], @"changed": @(changed),
+    } mutableCopy];
+    if (a->type == RSIM_MONKEY_SWIPE) {
+        d[@"x2"] = @(round(a->x2 * 10) / 10);
+        d[@"y2"] = @(round(a->y2 * 10) / 10);
+    }
+    if (a->type == RSIM_MONKEY_TEXT) d[@"text"] = [NSString stringWithUTF8String:a->text];
+    NSData *json = [NSJSONSerialization dataWithJSONObject:d options:NSJSONWritingSortedKeys error:nil];
+    return [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding];
+}
+
+static BOOL monkey_action_from_json(NSDictionary *d, RSimMonkeyAction *a) {
+    memset(a, 0, sizeof(*a));
+    a->cell = -1;
+    if (![d[@"type"] isKindOfClass:[NSString class]] ||
+        rsim_monkey_type_parse([d[@"type"] UTF8String], &a->type) != 0)
+        return NO;
+    a->x = [d[@"x"] floatValue];
+    a->y = [d[@"y"] floatValue];
+    a->x2 = d[@"x2"] ? [d[@"x2"] floatValue] : a->x;
+    a->y2 = d[@"y2"] ? [d[@"y2"] floatValue] : a->y;
+    a->duration_ms = [d[@"ms"] intValue];
+    if ([d[@"text"] isKindOfClass:[NSString class]])
+        strlcpy(a->text, [d[@"text"] UTF8String], sizeof(a->text));
+    return YES;
+}
+
+/* Sleep off whatever is left of the per-action period */
+static void monkey_pace(uint64_t action_start_ns, double rate) {
+    if (rate <= 0) return;
+    uint64_t period = (uint64_t)(1e9 / rate);
+    uint64_t spent = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - action_start_ns;
+    if (spent < period) usleep((useconds_t)((period - spent) / 1000));
+}
+
+static int monkey_replay(MonkeyDevice *dev, NSString *tracePath, double rate) {
+    NSString *trace = [NSString stringWithContentsOfFile:tracePath encoding:NSUTF8StringEncoding error:nil];
+    if (!trace) { fprintf(stderr, "Can't read trace %s\n", tracePath.UTF8String); return 1; }
+
+    int replayed = 0, diverged = 0, first_divergence = -1;
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    for (NSString *line in [trace componentsSeparatedByString:@"\n"]) {
+        if (!line.length) continue;
+        NSDictionary *d = [NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding]
+                                                          options:0 error:nil];
+        RSimMonkeyAction a;
+        if (![d isKindOfClass:[NSDictionary class]] || !monkey_action_from_json(d, &a)) continue;
+
+        uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        uint64_t before = monkey_hash(dev);
+        if (!monkey_perform(dev, &a)) return 1;
+        uint64_t after = monkey_outcome(dev, before);
+        uint64_t expected = 0;
+        if ([d[@"after"] isKindOfClass:[NSString class]] &&
+            rsim_hash_parse([d[@"after"] UTF8String], &expected) == 0 &&
+            rsim_hash_distance(after, expected) > dev->merge_distance) {
+            if (first_divergence < 0) first_divergence = [d[@"i"] intValue];
+            diverged++;
+        }
+        replayed++;
+        monkey_pace(start, rate);
+    }
+    double secs = (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e9;
+    printf("Replayed %d action(s) in %.1fs (%.1f/s), %d diverged", replayed, secs,
+           secs > 0 ? replayed / secs : 0, diverged);
+    if (first_divergence >= 0) printf(" (first at #%d)", first_divergence);
+    printf("\n");
+    monkey_print_phases(dev, replayed);
+    return diverged ? 1 : 0;
+}
+
+static int cmd_monkey(NSString *udid, uint64_t seed, int max_actions, double duration_s,
+                      double rate, double settle_ms, NSString *tracePath, NSString *replayPath,
+                      const int *weights) {
+    MonkeyDevice dev;
+    if (!monkey_open(udid, &dev)) return 1;
+    dev.settle_s = settle_ms / 1000.0;
+
+    RSimMonkey m;
+    rsim_monkey_init(&m, seed, dev.width, dev.height);
+    dev.merge_distance = m.merge_distance;
+    if (replayPath) {
+        int ret = monkey_replay(&dev, replayPath, rate);
+        rsim_monkey_free(&m);
+        close_frame_source(&dev.src);
+        return ret;
+    }
+    if (weights) memcpy(m.weights, weights, sizeof(m.weights));
+
+    FILE *trace = NULL;
+    if (tracePath) {
+        trace = fopen(tracePath.fileSystemRepresentation, "w");
+        if (!trace) {
+            fprintf(stderr, "Can't write trace %s: %s\n", tracePath.UTF8String, strerror(errno));
+            rsim_monkey_free(&m);
+            close_frame_source(&dev.src);
+            return 1;
+        }
+    }
+    printf("Monkey on %s: seed=%llu %.0fx%.0fpt rate<=%.0f/s settle=%.0fms\n", udid.UTF8String,
+           (unsigned long long)seed, dev.width, dev.height, rate, settle_ms);
+
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    uint64_t hash = monkey_hash(&dev);
+    rsim_monkey_visit(&m, hash);
+    int ret = 0;
+    for (int i = 0; !max_actions || i < max_actions; i++) {
+        uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+        if (duration_s > 0 && (start - t0) / 1e9 >= duration_s) break;
+
+        RSimMonkeyAction a;
+        rsim_monkey_next(&m, hash, &a);
+        if (!monkey_perform(&dev, &a)) { ret = 1; break; }
+        uint64_t after = monkey_outcome(&dev, hash);
+        BOOL changed = rsim_monkey_feedback(&m, hash, &a, after) == 1;
+        if (trace) {
+            fprintf(trace, "%s\n", monkey_trace_line(i, (start - t0) / 1e6, &a, hash, after, changed).UTF8String);
+            fflush(trace);
+        }
+        hash = after;
+        if ((i + 1) % 100 == 0)
+            printf("  %d actions, %d screens, %d changes\n", i + 1, m.screen_count, m.changes);
+        monkey_pace(start, rate);
+    }
+
+    double secs = (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e9;
+    double achieved = secs > 0 ? m.actions / secs : 0;
+    printf("%d action(s) in %.1fs (%.1f/s): %d changed the screen, %d distinct screen(s)\n",
+           m.actions, secs, achieved, m.changes, m.screen_count);
+    monkey_print_phases(&dev, m.actions);
+    if (rate > 0 && m.actions > 0 && achieved < rate * 0.9)
+        printf("Below the requested %.1f/s: the phases above take %.0fms per action\n", rate,
+               (dev.pickup_ns + dev.hold_ns + dev.react_ns) / 1e6 / m.actions);
+    if (trace) {
+        fclose(trace);
+        printf("Trace: %s (re-run with --replay=%s)\n", tracePath.UTF8String, tracePath.UTF8String);
+    }
+    rsim_monkey_free(&m);
+    close_frame_source(&dev.src);
+    return ret;
+}
+
+/* ── Command: hangs (rosettasim extension) ── */
+
+/*
+ * Main-thread hang events recorded by sim_hang_detector.dylib in apps that
+ * opted in (`hangs <UDID> enable <bundle-id>`). The dylib appends JSON lines
+ * to {device data}/tmp/rosettasim_hangs.jsonl; a long hang appears twice
+ * (ongoing, then final), so the latest record per pid+id wins.
+ */
+
+/* Installed .app path for a bundle ID on a legacy device, or nil */
+static NSString *find_app_path(NSString *udid, NSString *bundleID) {
+    NSDictionary *lsMap = read_ls_map(udid);
+    for (NSString *sec in @[@"User", @"System", @"Internal"]) {
+        NSString *path = lsMap[sec][bundleID][@"Path"];
+        if (path) return path;
+    }
+    NSString *containersPath = [NSString stringWithFormat:
+        @"%@/Library/Developer/CoreSimulator/Devices/%@/data/Containers/Bundle/Application",
+        NSHomeDirectory(), udid];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    for (NSString *cuuid in [fm contentsOfDirectoryAtPath:containersPath error:nil]) {
+        NSString *containerDir = [containersPath stringByAppendingPathComponent:cuuid];
+        for (NSString *item in [fm contentsOfDirectoryAtPath:containerDir error:nil]) {
+            if (![item hasSuffix:@".app"]) continue;
+            NSString *appPath = [containerDir stringByAppendingPathComponent:item];
+            NSDictionary *info = [NSDictionary dictionaryWithContentsOfFile:
+                [appPath stringByAppendingPathComponent:@"Info.plist"]];
+            if ([info[@"CFBundleIdentifier"] isEqualToString:bundleID]) return appPath;
+        }
+    }
+    return nil;
+}
+
+/* Add the LC_LOAD_DYLIB once, then re-sign so the 10.x runtime still loads it */
+static int hangs_enable(NSString *udid, NSString *dataPath, NSString *bundleID, int threshold_ms) {
+    NSString *appPath = find_app_path(udid, bundleID);
+    NSDictionary *info = [NSDictionary dictionaryWithContentsOfFile:
+        [appPath stringByAppendingPathComponent:@"Info.plist"]];
+    NSString *execName = info[@"CFBundleExecutable"];
+    if (!appPath || !execName) {
+        fprintf(stderr, "App %s not found.\n", bundleID.UTF8String);
+        return 1;
+    }
+    NSString *binary = [appPath stringByAppendingPathComponent:execName];
+
+    /* Same patch as `make deploy` (rosettasim_macho.c), every slice */
+    NSMutableData *image = [NSMutableData dataWithContentsOfFile:binary];
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    int count = image ? rsim_macho_slices(image.bytes, image.length, slices, RSIM_MACHO_MAX_SLICES) : 0;
+    if (!count) {
+        fprintf(stderr, "Not a Mach-O binary: %s\n", binary.UTF8String);
+        return 1;
+    }
+    int added = 0;
+    for (int i = 0; i < count; i++) {
+        int rc = rsim_macho_add_dylib(image.mutableBytes, image.length, &slices[i], "/usr/lib/sim_hang_detector.dylib");
+        if (rc < 0) {
+            fprintf(stderr, "Can't add sim_hang_detector to %s (%s)\n", binary.UTF8String,
+                    rc == -2 ? "no room in the Mach-O header" : "malformed load commands");
+            return 1;
+        }
+        if (rc == 0) added++;
+    }
+    if (!added) {
+        printf("sim_hang_detector already in %s\n", execName.UTF8String);
+    } else {
+        NSNumber *mode = [[NSFileManager defaultManager] attributesOfItemAtPath:binary error:nil][NSFilePosixPermissions];
+        if (![image writeToFile:binary atomically:YES]) {
+            fprintf(stderr, "Can't write %s\n", binary.UTF8String);
+            return 1;
+        }
+        if (mode) [[NSFileManager defaultManager] setAttributes:@{NSFilePosixPermissions: mode}
+                                                   ofItemAtPath:binary error:nil];
+        int ec = 0;
+        run_capture(@[@"/usr/bin/codesign", @"--force", @"--sign", @"-", appPath], &ec);
+        if (ec != 0) fprintf(stderr, "warning: codesign of %s failed (exit %d)\n", appPath.UTF8String, ec);
+        printf("Added sim_hang_detector to %s\n", execName.UTF8String);
+    }
+
+    if (threshold_ms > 0) {
+        NSString *path = [dataPath stringByAppendingPathComponent:@ROSETTASIM_DEV_HANG_THRESHOLD];
+        [[NSString stringWithFormat:@"%d\n", threshold_ms] writeToFile:path atomically:YES
+                                                             encoding:NSUTF8StringEncoding error:nil];
+        printf("Hang threshold: %dms\n", threshold_ms);
+    }
+    printf("Relaunch %s to start recording (`make deploy` installs the dylib in the runtime).\n",
+           bundleID.UTF8String);
+    return 0;
+}
+
+static int cmd_hangs(NSString *udid, NSString *enableBundle, int threshold_ms, BOOL json, BOOL clear) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+    if (!is_legacy_runtime(get_runtime_id(device))) {
+        fprintf(stderr, "hangs: only legacy devices are supported\n");
+        return 1;
+    }
+    NSString *dataPath = get_device_data_path(device);
+    if (enableBundle) return hangs_enable(udid, dataPath, enableBundle, threshold_ms);
+
+    NSString *eventsPath = [dataPath stringByAppendingPathComponent:@ROSETTASIM_DEV_HANGS_FILE];
+    NSString *content = [NSString stringWithContentsOfFile:eventsPath encoding:NSUTF8StringEncoding error:nil];
+    NSMutableDictionary<NSString *, NSDictionary *> *latest = [NSMutableDictionary new];
+    for (NSString *line in [content componentsSeparatedByString:@"\n"]) {
+        if (!line.length) continue;
+        NSDictionary *ev = [NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding]
+                                                           options:0 error:nil];
+        if (![ev isKindOfClass:[NSDictionary class]]) continue;
+        latest[[NSString stringWithFormat:@"%@:%@", ev[@"pid"], ev[@"id"]]] = ev;
+    }
+    NSArray<NSDictionary *> *events = [latest.allValues sortedArrayUsingComparator:^(NSDictionary *a, NSDictionary *b) {
+        return [(NSNumber *)a[@"start"] compare:(NSNumber *)b[@"start"]];
+    }];
+
+    if (json) {
+        NSData *data = [NSJSONSerialization dataWithJSONObject:events options:NSJSONWritingPrettyPrinted error:nil];
+        printf("%s\n", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding].UTF8String);
+    } else if (!events.count) {
+        printf("No hangs recorded.\n");
+    } else {
+        NSDateFormatter *fmt = [NSDateFormatter new];
+        fmt.dateFormat = @"HH:mm:ss.SSS";
+        for (NSDictionary *ev in events) {
+            NSDate *start = [NSDate dateWithTimeIntervalSince1970:[ev[@"start"] doubleValue]];
+            printf("%s  %-20s pid %-6d %6ldms%s  in %s\n", [fmt stringFromDate:start].UTF8String,
+                   [ev[@"process"] UTF8String], [ev[@"pid"] intValue], [ev[@"duration_ms"] longValue],
+                   [ev[@"ongoing"] boolValue] ? "+" : " ", [ev[@"activity"] UTF8String]);
+            NSArray *frames = ev[@"frames"];
+            for (NSUInteger i = 0; i < frames.count && i < 8; i++)
+                printf("    %2lu  %s\n", (unsigned long)i, [frames[i] UTF8String]);
+            if (frames.count > 8) printf("    ... %lu more\n", (unsigned long)(frames.count - 8));
+        }
+        printf("%lu hang(s)%s\n", (unsigned long)events.count,
+               [events filteredArrayUsingPredicate:[NSPredicate predicateWithFormat:@"ongoing == YES"]].count
+                   ? " (+ = still hung when last reported)" : "");
+    }
+    if (clear) unlink(eventsPath.fileSystemRepresentation);
+    return 0;
+}
+
+/* ── Command: launch --measure (rosettasim extension) ── */
+
+/*
+ * Launch timing on legacy devices, one run at a time:
+ *   request   ctl writes the launch command
+ *   pickup    sim_app_installer reads it (its cmd-file poll interval)
+ *   call      openApplicationWithBundleID: issued in SpringBoard
+ *   spawn     the app's process start time (kernel, from the host process table)
+ *   first     first frame change after spawn
+ *   settled   last frame change before --settle ms without one
+ * The app is stopped before every run. Run 1 is reported as "first", the
+ * rest as warm (binary and dyld caches already hot). Nothing evicts those
+ * caches first, so run 1 is cold only if the app hasn't run since boot.
+ */
+
+#define LAUNCH_MAX_CHANGES  4096
+
+typedef struct {
+    double request, picked_up, call, returned, spawn, first_frame, settled;
+    pid_t  pid;
+} LaunchRun;
+
+static double now_epoch(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Host pid running this exact executable (the sim app is a host process), and
+ * its start time. The path pins the device: it lives under the device's data. */
+static pid_t find_app_pid(const char *binary, double *started) {
+    int count = proc_listallpids(NULL, 0);
+    if (count <= 0) return 0;
+    pid_t *pids = calloc((size_t)count + 64, sizeof(pid_t));
+    count = proc_listallpids(pids, (int)(((size_t)count + 64) * sizeof(pid_t)));
+    pid_t found = 0;
+    char path[PROC_PIDPATHINFO_MAXSIZE];
+    for (int i = 0; i < count && !found; i++) {
+        if (proc_pidpath(pids[i], path, sizeof(path)) <= 0 || strcmp(path, binary) != 0) continue;
+        struct proc_bsdinfo info;
+        if (proc_pidinfo(pids[i], PROC_PIDTBSDINFO, 0, &info, sizeof(info)) != sizeof(info)) continue;
+        found = pids[i];
+        if (started) *started = info.pbi_start_tvsec + info.pbi_start_tvusec / 1e6;
+    }
+    free(pids);
+    return found;
+}
+
+static void stop_app_pid(pid_t pid) {
+    if (kill(pid, SIGTERM) != 0) return;
+    for (int i = 0; i < 200 && kill(pid, 0) == 0; i++) usleep(10000);
+    if (kill(pid, 0) == 0) kill(pid, SIGKILL);
+}
+
+/* Block until the screen has not changed for quiet_s (or timeout_s) */
+static void wait_screen_quiet(FrameSource *src, double quiet_s, double timeout_s) {
+    double start = now_epoch(), last = start;
+    uint64_t seq = frame_source_sequence(src);
+    while (now_epoch() - last < quiet_s && now_epoch() - start < timeout_s) {
+        usleep(5000);
+        uint64_t s = frame_source_sequence(src);
+        if (s != seq) { seq = s; last = now_epoch(); }
+    }
+}
+
+/* TIMING line sim_app_installer appends to the result file */
+static BOOL read_launch_timing(NSString *udid, LaunchRun *run) {
+    NSString *resultPath = [NSString stringWithFormat:@ROSETTASIM_HOST_RESULT_NSFMT, udid];
+    NSString *result = [NSString stringWithContentsOfFile:resultPath encoding:NSUTF8StringEncoding error:nil];
+    for (NSString *line in [result componentsSeparatedByString:@"\n"]) {
+        const char *s = strstr(line.UTF8String, "TIMING ");
+        if (s && sscanf(s, "TIMING picked_up=%lf call=%lf returned=%lf",
+                        &run->picked_up, &run->call, &run->returned) == 3)
+            return YES;
+    }
+    return NO;
+}
+
+static BOOL measure_one_launch(NSString *udid, NSString *bundleID, const char *binary,
+                               FrameSource *src, double settle_s, double timeout_s, LaunchRun *run) {
+    memset(run, 0, sizeof(*run));
+    pid_t old = find_app_pid(binary, NULL);
+    if (old) {
+        stop_app_pid(old);
+        wait_screen_quiet(src, settle_s, 10.0);
+    }
+
+    NSString *resultPath = [NSString stringWithFormat:@ROSETTASIM_HOST_RESULT_NSFMT, udid];
+    unlink(resultPath.fileSystemRepresentation);
+    NSData *json = [NSJSONSerialization dataWithJSONObject:@{@"bundle_id": bundleID} options:0 error:nil];
+    uint64_t seq = frame_source_sequence(src);
+    run->request = now_epoch();
+    if (![json writeToFile:[NSString stringWithFormat:@ROSETTASIM_HOST_CMD_NSFMT, udid] atomically:YES]) {
+        fprintf(stderr, "Can't write the launch command\n");
+        return NO;
+    }
+
+    /* Frame changes are timestamped here (2ms poll); the pid is looked up
+     * less often and matched against the change list afterwards. */
+    static double changes[LAUNCH_MAX_CHANGES];
+    int nchanges = 0;
+    double last_change = 0, next_pid_check = 0;
+    for (;;) {
+        double now = now_epoch();
+        if (now - run->request > timeout_s) break;
+        uint64_t s = frame_source_sequence(src);
+        if (s != seq) {
+            seq = s;
+            last_change = now;
+            if (nchanges < LAUNCH_MAX_CHANGES) changes[nchanges++] = now;
+        }
+        if (!run->pid && now >= next_pid_check) {
+            run->pid = find_app_pid(binary, &run->spawn);
+            next_pid_check = now + 0.010;
+        }
+        if (run->pid && !run->first_frame) {
+            for (int i = 0; i < nchanges; i++)
+                if (changes[i] >= run->spawn) { run->first_frame = changes[i]; break; }
+        }
+        if (run->first_frame && now - last_change >= settle_s) {
+            run->settled = last_change;
+            break;
+        }
+        usleep(2000);
+    }
+    if (!read_launch_timing(udid, run)) run->call = run->returned = 0;
+    return run->settled > 0;
+}
+
+static double run_stage_ms(double from, double to) {
+    return from > 0 && to > 0 ? (to - from) * 1000.0 : NAN;
+}
+
+/* launch = openApplication call → settled; falls back to the request when
+ * the installer dylib predates TIMING lines */
+static double run_launch_ms(const LaunchRun *r) {
+    return run_stage_ms(r->call > 0 ? r->call : r->request, r->settled);
+}
+
+#define LAUNCH_MAX_RUNS 1000    /* each run is a full relaunch: seconds apiece */
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static NSDictionary *launch_stats(const LaunchRun *runs, int first, int count) {
+    double *v = malloc((size_t)(count > 0 ? count : 1) * sizeof(*v));
+    if (!v) return nil;
+    int n = 0;
+    for (int i = first; i < first + count; i++) {
+        double ms = run_launch_ms(&runs[i]);
+        if (!isnan(ms)) v[n++] = ms;
+    }
+    if (!n) {
+        free(v);
+        return nil;
+    }
+    qsort(v, (size_t)n, sizeof(double), compare_double);
+    double sum = 0, sq = 0;
+    for (int i = 0; i < n; i++) sum += v[i];
+    double mean = sum / n;
+    for (int i = 0; i < n; i++) sq += (v[i] - mean) * (v[i] - mean);
+    NSDictionary *stats = @{ @"runs": @(n), @"min_ms": @(v[0]),
+                             @"median_ms": @(n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2),
+                             @"mean_ms": @(mean), @"max_ms": @(v[n - 1]),
+                             @"stddev_ms": @(n > 1 ? sqrt(sq / (n - 1)) : 0) };
+    free(v);
+    return stats;
+}
+
+static int cmd_launch_measure(NSString *udid, NSString *bundleID, int runs, double settle_ms,
+                              double timeout_s, BOOL json) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+    if (get_device_state(device) != 3 || !is_legacy_runtime(get_runtime_id(device))) {
+        fprintf(stderr, "launch --measure needs a booted legacy device\n");
+        return 1;
+    }
+    NSString *appPath = find_app_path(udid, bundleID);
+    NSString *execName = [NSDictionary dictionaryWithContentsOfFile:
+        [appPath stringByAppendingPathComponent:@"Info.plist"]][@"CFBundleExecutable"];
+    if (!appPath || !execName) {
+        fprintf(stderr, "App %s not found.\n", bundleID.UTF8String);
+        return 1;
+    }
+    char binary[PATH_MAX];
+    if (!realpath([appPath stringByAppendingPathComponent:execName].fileSystemRepresentation, binary)) {
+        fprintf(stderr, "Can't resolve %s/%s\n", appPath.UTF8String, execName.UTF8String);
+        return 1;
+    }
+    LaunchRun *results = calloc((size_t)runs, sizeof(*results));
+    if (!results) {
+        fprintf(stderr, "Out of memory for %d runs\n", runs);
+        return 1;
+    }
+    FrameSource src;
+    if (!open_frame_source(udid, &src)) {
+        free(results);
+        return 1;
+    }
+
+    int ok = 0;
+    if (!json) printf("Measuring %d launch(es) of %s (settle %.0fms)\n", runs, bundleID.UTF8String, settle_ms);
+    for (int i = 0; i < runs; i++) {
+        LaunchRun *r = &results[i];
+        BOOL done = measure_one_launch(udid, bundleID, binary, &src, settle_ms / 1000.0, timeout_s, r);
+        ok += done;
+        if (json) continue;
+        if (i == 0)
+            printf("  run  kind   pickup    call   spawn   first settled  |  launch\n");
+        if (!done) {
+            printf("  %3d  %-5s  timed out after %.0fs%s\n", i + 1, i ? "warm" : "first", timeout_s,
+                   r->pid ? " (no frames settled)" : " (process never started)");
+            continue;
+        }
+        double call = r->call > 0 ? r->call : r->request;
+        printf("  %3d  %-5s %7.0f %7.0f %7.0f %7.0f %7.0f  | %7.0fms\n", i + 1, i ? "warm" : "first",
+               run_stage_ms(r->request, r->picked_up), run_stage_ms(r->call, r->returned),
+               run_stage_ms(call, r->spawn), run_stage_ms(r->spawn, r->first_frame),
+               run_stage_ms(r->first_frame, r->settled), run_launch_ms(r));
+    }
+    close_frame_source(&src);
+
+    NSDictionary *first = launch_stats(results, 0, 1);
+    NSDictionary *warm = runs > 1 ? launch_stats(results, 1, runs - 1) : nil;
+    if (json) {
+        NSMutableArray *list = [NSMutableArray array];
+        for (int i = 0; i < runs; i++) {
+            const LaunchRun *r = &results[i];
+            [list addObject:@{ @"run": @(i + 1), @"kind": i ? @"warm" : @"first", @"pid": @(r->pid),
+                               @"request": @(r->request), @"picked_up": @(r->picked_up), @"call": @(r->call),
+                               @"returned": @(r->returned), @"spawn": @(r->spawn),
+                               @"first_frame": @(r->first_frame), @"settled": @(r->settled),
+                               @"launch_ms": r->settled > 0 ? @(run_launch_ms(r)) : [NSNull null] }];
+        }
+        NSMutableDictionary *report = [@{ @"udid": udid, @"bundle_id": bundleID, @"runtime": get_runtime_id(device),
+                                          @"settle_ms": @(settle_ms), @"runs": list } mutableCopy];
+        if (first) report[@"first"] = first;
+        if (warm) report[@"warm"] = warm;
+        NSData *data = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted error:nil];
+        printf("%s\n", [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding].UTF8String);
+    } else {
+        printf("  (ms; pickup = request→installer, call = openApplication, spawn = call→process start,\n"
+               "   first = spawn→first frame, settled = first→last frame; launch = call→settled)\n");
+        if (first) printf("first: %.0fms\n", [first[@"min_ms"] doubleValue]);
+        if (warm)
+            printf("warm: median %.0fms  mean %.0fms  min %.0fms  max %.0fms  stddev %.0fms  (%@ runs)\n",
+                   [warm[@"median_ms"] doubleValue], [warm[@"mean_ms"] doubleValue], [warm[@"min_ms"] doubleValue],
+                   [warm[@"max_ms"] doubleValue], [warm[@"stddev_ms"] doubleValue], warm[@"runs"]);
+    }
+    free(results);
+    return ok == runs ? 0 : 1;
+}
+
+/* ── Command: logs (rosettasim extension) ── */
+
+/*
+ * One merged view of everything worth tailing on a legacy device: the
+ * in-sim touch logs, the HID backport log, the daemon log and the device
+ * syslog. Files are watched with kqueue and only appended bytes are read
+ * (common/rosettasim_logtail.h), so --follow sits idle in kevent.
+ */
+
+typedef struct {
+    BOOL    tty;
+    int     label_width;
+} LogsOutput;
+
+static void logs_print_line(const RSimLogTail *tail, const RSimLogLine *line, void *ctx) {
+    const LogsOutput *out = ctx;
+    const char *label = tail->files[line->file].label;
+    if (out->tty)
+        printf("\033[2m%-*s\033[0m  %s\n", out->label_width, label, line->text);
+    else
+        printf("%-*s  %s\n", out->label_width, label, line->text);
+}
+
+static int cmd_logs(NSString *udid, BOOL follow, int lines, const char *pattern, BOOL ignoreCase,
+                    NSArray<NSString *> *extraFiles) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+    NSString *dataPath = get_device_data_path(device);
+
+    RSimLogTail tail;
+    if (rsim_logtail_init(&tail) != 0) {
+        fprintf(stderr, "Can't watch log files: %s\n", strerror(errno));
+        return 1;
+    }
+    NSMutableArray<NSArray<NSString *> *> *sources = [@[
+        @[[dataPath stringByAppendingPathComponent:@ROSETTASIM_DEV_TOUCH_LOG], @"touch"],
+        @[[dataPath stringByAppendingPathComponent:@ROSETTASIM_DEV_TOUCH_INJECT_LOG], @"touch_inject"],
+        @[@ROSETTASIM_HOST_HID_LOG, @"hid"],
+        @[@ROSETTASIM_HOST_DAEMON_LOG, @"daemon"],
+        @[[NSString stringWithFormat:@"%@/Library/Logs/CoreSimulator/%@/system.log", NSHomeDirectory(), udid], @"syslog"],
+    ] mutableCopy];
+    for (NSString *path in extraFiles)
+        [sources addObject:@[path, path.lastPathComponent.stringByDeletingPathExtension]];
+
+    LogsOutput out = { isatty(STDOUT_FILENO), 0 };
+    for (NSArray<NSString *> *src in sources) {
+        if (rsim_logtail_add(&tail, src[0].fileSystemRepresentation, src[1].UTF8String) < 0) {
+            fprintf(stderr, "Too many log files (max %d)\n", RSIM_LOGTAIL_MAX_FILES);
+            rsim_logtail_close(&tail);
+            return 1;
+        }
+        int w = (int)strlen(tail.files[tail.count - 1].label);
+        if (w > out.label_width) out.label_width = w;
+    }
+    if (pattern) {
+        int err = rsim_logtail_set_filter(&tail, pattern, ignoreCase);
+        if (err) {
+            char msg[256];
+            regerror(err, &tail.filter, msg, sizeof(msg));
+            fprintf(stderr, "Invalid --grep pattern: %s\n", msg);
+            rsim_logtail_close(&tail);
+            return 1;
+        }
+    }
+
+    rsim_logtail_backlog(&tail, lines);
+    rsim_logtail_drain(&tail, logs_print_line, &out);
+    fflush(stdout);
+    while (follow) {
+        if (rsim_logtail_wait(&tail, -1) < 0) {
+            fprintf(stderr, "Watching log files failed: %s\n", strerror(errno));
+            break;
+        }
+        rsim_logtail_drain(&tail, logs_print_line, &out);
+        fflush(stdout);
+    }
+    rsim_logtail_close(&tail);
+    return follow ? 1 : 0;
+}
+
+/* ── Command: prewarm (rosettasim extension) ── */
+
+/*
+ * The first boot of a legacy runtime (after installing it, or after a macOS
+ * update invalidates Rosetta's AOT cache) translates SpringBoard, backboardd
+ * and hundreds of frameworks on the critical path. prewarm finds every
+ * Mach-O with an x86_64 slice under the RuntimeRoot (plus its dyld_sim
+ * shared cache) and hands them in batches to rosettasim_prewarm, an x86_64
+ * helper that runs under Rosetta and maps each __TEXT executable, with
+ * --jobs helpers at a time. See tools/rosettasim_prewarm.c.
+ *
+ * `boot --measure` appends boot timings to boot_history.jsonl, tagged with
+ * whether it was the first measured boot of that runtime on this macOS
+ * build and whether a prewarm preceded it; `prewarm --report` compares them.
+ * scripts/bench_prewarm.sh runs the comparison after a macOS update, when
+ * every runtime is cold again.
+ */
+
+static NSString *rosettasim_cache_path(NSString *name) {
+    NSString *dir = [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Caches/RosettaSim"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:dir withIntermediateDirectories:YES
+                                               attributes:nil error:nil];
+    return [dir stringByAppendingPathComponent:name];
+}
+
+/* Translations are per macOS build: an OS update starts over */
+static NSString *host_os_build(void) {
+    char build[64] = "";
+    size_t len = sizeof(build);
+    sysctlbyname("kern.osversion", build, &len, NULL, 0);
+    return [NSString stringWithUTF8String:build];
+}
+
+/* Installed legacy runtimes: @{id, name, root} */
+static NSArray<NSDictionary *> *installed_legacy_runtimes(void) {
+    NSMutableArray *runtimes = [NSMutableArray array];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSArray *bases = @[[NSHomeDirectory() stringByAppendingPathComponent:@"Library/Developer/CoreSimulator/Profiles/Runtimes"],
+                       @"/Library/Developer/CoreSimulator/Profiles/Runtimes"];
+    for (NSString *base in bases) {
+        for (NSString *entry in [fm contentsOfDirectoryAtPath:base error:nil]) {
+            if (![entry hasSuffix:@".simruntime"]) continue;
+            NSString *bundle = [base stringByAppendingPathComponent:entry];
+            NSString *rtID = [NSDictionary dictionaryWithContentsOfFile:
+                [bundle stringByAppendingPathComponent:@"Contents/Info.plist"]][@"CFBundleIdentifier"];
+            NSString *root = [bundle stringByAppendingPathComponent:@"Contents/Resources/RuntimeRoot"];
+            if (!is_legacy_runtime(rtID) || ![fm fileExistsAtPath:root]) continue;
+            [runtimes addObject:@{ @"id": rtID, @"name": entry.stringByDeletingPathExtension, @"root": root }];
+        }
+    }
+    return runtimes;
+}
+
+/* "all", a runtime identifier, a bundle name (iOS_9.3) or a version (9.3) */
+static BOOL runtime_matches(NSDictionary *rt, NSString *arg) {
+    if ([arg isEqualToString:@"all"]) return YES;
+    if ([rt[@"id"] isEqualToString:arg] || [rt[@"name"] isEqualToString:arg]) return YES;
+    NSString *suffix = [@"iOS-" stringByAppendingString:[arg stringByReplacingOccurrencesOfString:@"." withString:@"-"]];
+    return [rt[@"id"] hasSuffix:suffix];
+}
+
+/* Regular files that start like a Mach-O, largest first so the long
+ * batches start early */
+static NSArray<NSString *> *collect_machos(NSString *root, uint64_t *bytes) {
+    NSMutableArray<NSArray *> *found = [NSMutableArray array];
+    char *paths[] = { (char *)root.fileSystemRepresentation, NULL };
+    FTS *fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+    if (!fts) return @[];
+    FTSENT *e;
+    while ((e = fts_read(fts))) {
+        if (e->fts_info != FTS_F || e->fts_statp->st_size < 4096) continue;
+        int fd = open(e->fts_path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        uint8_t head[8];
+        BOOL macho = pread(fd, head, sizeof(head), 0) == (ssize_t)sizeof(head) && rsim_macho_sniff(head, sizeof(head));
+        close(fd);
+        if (!macho) continue;
+        [found addObject:@[@(e->fts_statp->st_size), [NSString stringWithUTF8String:e->fts_path]]];
+        *bytes += (uint64_t)e->fts_statp->st_size;
+    }
+    fts_close(fts);
+    [found sortUsingComparator:^(NSArray *a, NSArray *b) { return [b[0] compare:a[0]]; }];
+    NSMutableArray<NSString *> *files = [NSMutableArray arrayWithCapacity:found.count];
+    for (NSArray *f in found) [files addObject:f[1]];
+    return files;
+}
+
+/* CoreSimulator builds the runtime's dyld_sim shared cache on first boot:
+ * Caches/dyld/<host build>/<runtime id>.<runtime build>/dyld_sim_shared_cache_x86_64 */
+static NSArray<NSString *> *dyld_sim_caches(NSString *rtID) {
+    NSMutableArray *files = [NSMutableArray array];
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *base = [NSHomeDirectory() stringByAppendingPathComponent:@"Library/Developer/CoreSimulator/Caches/dyld"];
+    for (NSString *build in [fm contentsOfDirectoryAtPath:base error:nil]) {
+        NSString *buildDir = [base stringByAppendingPathComponent:build];
+        for (NSString *entry in [fm contentsOfDirectoryAtPath:buildDir error:nil]) {
+            if (![entry hasPrefix:rtID]) continue;
+            NSString *dir = [buildDir stringByAppendingPathComponent:entry];
+            for (NSString *name in [fm contentsOfDirectoryAtPath:dir error:nil])
+                if ([name hasPrefix:@"dyld_sim_shared_cache_x86_64"])
+                    [files addObject:[dir stringByAppendingPathComponent:name]];
+        }
+    }
+    return files;
+}
+
+typedef struct {
+    int         files;
+    int         translated;     /* __TEXT mapped executable */
+    int         failed;
+    uint64_t    bytes;
+    double      helper_ms;      /* summed over files */
+} PrewarmTotals;
+
+static BOOL prewarm_runtime(NSDictionary *rt, NSString *helper, int jobs, PrewarmTotals *totals) {
+    uint64_t bytes = 0;
+    double t0 = now_epoch();
+    NSMutableArray<NSString *> *files = [collect_machos(rt[@"root"], &bytes) mutableCopy];
+    [files addObjectsFromArray:dyld_sim_caches(rt[@"id"])];
+    printf("%s: %lu Mach-O file(s), %.1f MB (scan %.1fs)\n", [rt[@"name"] UTF8String],
+           (unsigned long)files.count, bytes / 1048576.0, now_epoch() - t0);
+    if (!files.count) return NO;
+
+    /* Small batches keep the pool busy to the end; interleave so each batch
+     * mixes large and small files */
+    NSUInteger nbatches = MAX((NSUInteger)jobs * 8, files.count / 256 + 1);
+    NSMutableArray<NSMutableArray *> *batches = [NSMutableArray array];
+    for (NSUInteger i = 0; i < MIN(nbatches, files.count); i++) [batches addObject:[NSMutableArray array]];
+    for (NSUInteger i = 0; i < files.count; i++) [batches[i % batches.count] addObject:files[i]];
+
+    dispatch_semaphore_t slots = dispatch_semaphore_create(jobs);
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+    NSObject *lock = [NSObject new];
+    __block PrewarmTotals sum = {0};
+    __block int done = 0;
+    t0 = now_epoch();
+    for (NSArray *batch in batches) {
+        dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+        dispatch_group_async(group, queue, ^{
+            int ec = 0;
+            NSString *out = run_capture([@[helper] arrayByAddingObjectsFromArray:batch], &ec);
+            @synchronized (lock) {
+                for (NSString *line in [out componentsSeparatedByString:@"\n"]) {
+                    NSArray *f = [line componentsSeparatedByString:@"\t"];
+                    if (f.count < 4) continue;
+                    sum.files++;
+                    sum.helper_ms += [f[0] doubleValue];
+                    sum.bytes += strtoull([f[2] UTF8String], NULL, 10);
+                    if ([f[1] isEqualToString:@"ok"]) sum.translated++;
+                    else if ([f[1] isEqualToString:@"error"]) sum.failed++;
+                }
+                if (ec != 0) sum.failed += (int)batch.count;
+                done += (int)batch.count;
+                if (isatty(STDOUT_FILENO)) {
+                    printf("\r  %d/%lu", done, (unsigned long)files.count);
+                    fflush(stdout);
+                }
+            }
+            dispatch_semaphore_signal(slots);
+        });
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    double wall = now_epoch() - t0;
+    if (isatty(STDOUT_FILENO)) printf("\r");
+    printf("  warmed %d file(s) in %.1fs with %d job(s): %d translated, %d failed, %.1f MB read\n",
+           sum.files, wall, jobs, sum.translated, sum.failed, sum.bytes / 1048576.0);
+
+    NSString *statePath = rosettasim_cache_path(@"prewarm.json");
+    NSMutableDictionary *state = [[NSDictionary dictionaryWithContentsOfFile:statePath] mutableCopy]
+        ?: [NSMutableDictionary dictionary];
+    state[rt[@"id"]] = @{ @"time": @([[NSDate date] timeIntervalSince1970]), @"os_build": host_os_build(),
+                          @"files": @(sum.files), @"translated": @(sum.translated), @"failed": @(sum.failed),
+                          @"bytes": @(sum.bytes), @"wall_s": @(wall) };
+    [state writeToFile:statePath atomically:YES];
+
+    totals->files += sum.files;
+    totals->translated += sum.translated;
+    totals->failed += sum.failed;
+    totals->bytes += sum.bytes;
+    totals->helper_ms += sum.helper_ms;
+    return YES;
+}
+
+static NSArray<NSDictionary *> *read_boot_history(void) {
+    NSString *content = [NSString stringWithContentsOfFile:rosettasim_cache_path(@"boot_history.jsonl")
+                                                  encoding:NSUTF8StringEncoding error:nil];
+    NSMutableArray *entries = [NSMutableArray array];
+    for (NSString *line in [content componentsSeparatedByString:@"\n"]) {
+        if (!line.length) continue;
+        id e = [NSJSONSerialization JSONObjectWithData:[line dataUsingEncoding:NSUTF8StringEncoding] options:0 error:nil];
+        if ([e isKindOfClass:[NSDictionary class]]) [entries addObject:e];
+    }
+    return entries;
+}
+
+/* Called by `boot --measure` once simctl reports Booted: wait for the daemon's
+ * first frame and for the screen to settle, then log the boot. */
+static void measure_boot_ready(NSString *udid, NSString *rtID, double t_start, double t_booted) {
+    double first = 0, ready = 0, deadline = t_booted + 180.0;
+    FrameSource src = {0};
+    BOOL have_src = NO;
+    while (now_epoch() < deadline) {
+        if (!have_src && find_active_device(udid)) have_src = open_frame_source(udid, &src);
+        if (have_src && frame_source_sequence(&src) > 0) {
+            first = now_epoch();
+            break;
+        }
+        usleep(have_src ? 20000 : 250000);
+    }
+    if (first > 0) {
+        wait_screen_quiet(&src, 3.0, deadline - now_epoch());
+        ready = now_epoch() - 3.0;
+    }
+    if (have_src) close_frame_source(&src);
+
+    NSString *build = host_os_build();
+    BOOL firstBoot = YES;
+    for (NSDictionary *e in read_boot_history())
+        if ([e[@"runtime"] isEqualToString:rtID] && [e[@"os_build"] isEqualToString:build]) firstBoot = NO;
+    NSDictionary *pw = [NSDictionary dictionaryWithContentsOfFile:rosettasim_cache_path(@"prewarm.json")][rtID];
+    BOOL prewarmed = [pw[@"os_build"] isEqualToString:build];
+
+    NSMutableDictionary *entry = [@{ @"time": @(t_start), @"udid": udid, @"runtime": rtID, @"os_build": build,
+                                     @"boot_s": @(t_booted - t_start), @"first_boot": @(firstBoot),
+                                     @"prewarmed": @(prewarmed) } mutableCopy];
+    if (first > 0) entry[@"first_frame_s"] = @(first - t_start);
+    if (ready > 0) entry[@"ready_s"] = @(ready - t_start);
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:entry options:0 error:nil] mutableCopy];
+    [line appendBytes:"\n" length:1];
+    int fd = open(rosettasim_cache_path(@"boot_history.jsonl").fileSystemRepresentation,
+                  O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd >= 0) {
+        write(fd, line.bytes, line.length);
+        close(fd);
+    }
+
+    printf("Boot timing: booted %.1fs", t_booted - t_start);
+    if (first > 0) printf(", first frame %.1fs, settled %.1fs", first - t_start, ready - t_start);
+    else printf(", no frame from rosettasim_daemon within %.0fs", deadline - t_booted);
+    printf("%s%s\n", firstBoot ? " (first measured boot on this macOS build" : "",
+           firstBoot ? (prewarmed ? ", prewarmed)" : ", not prewarmed)") : "");
+}
+
+static double median_of(NSArray<NSNumber *> *values) {
+    NSArray *s = [values sortedArrayUsingSelector:@selector(compare:)];
+    NSUInteger n = s.count;
+    if (!n) return NAN;
+    return n % 2 ? [s[n / 2] doubleValue] : ([s[n / 2 - 1] doubleValue] + [s[n / 2] doubleValue]) / 2;
+}
+
+static int prewarm_report(NSArray<NSDictionary *> *runtimes) {
+    NSArray *history = read_boot_history();
+    NSDictionary *state = [NSDictionary dictionaryWithContentsOfFile:rosettasim_cache_path(@"prewarm.json")];
+    printf("%-12s %-28s %-28s %s\n", "runtime", "first boot, not prewarmed", "first boot, prewarmed", "later boots");
+    for (NSDictionary *rt in runtimes) {
+        NSMutableArray *cold = [NSMutableArray array], *warmed = [NSMutableArray array], *later = [NSMutableArray array];
+        for (NSDictionary *e in history) {
+            if (![e[@"runtime"] isEqualToString:rt[@"id"]]) continue;
+            NSNumber *t = e[@"ready_s"] ?: e[@"boot_s"];
+            if (![e[@"first_boot"] boolValue]) [later addObject:t];
+            else if ([e[@"prewarmed"] boolValue]) [warmed addObject:t];
+            else [cold addObject:t];
+        }
+        NSString *(^cell)(NSArray *) = ^NSString *(NSArray *v) {
+            return v.count ? [NSString stringWithFormat:@"%.1fs (median of %lu)", median_of(v), (unsigned long)v.count]
+                           : @"-";
+        };
+        printf("%-12s %-28s %-28s %s\n", [rt[@"name"] UTF8String], cell(cold).UTF8String, cell(warmed).UTF8String,
+               cell(later).UTF8String);
+        double c = median_of(cold), w = median_of(warmed);
+        if (!isnan(c) && !isnan(w) && c > 0)
+            printf("%-12s prewarm saves %.1fs (%.0f%%) on first boot\n", "", c - w, (c - w) / c * 100);
+        NSDictionary *pw = state[rt[@"id"]];
+        if (pw)
+            printf("%-12s last prewarm: %s, %@ files in %.1fs (macOS %s)\n", "",
+                   [NSDateFormatter localizedStringFromDate:[NSDate dateWithTimeIntervalSince1970:[pw[@"time"] doubleValue]]
+                                                  dateStyle:NSDateFormatterShortStyle
+                                                  timeStyle:NSDateFormatterShortStyle].UTF8String,
+                   pw[@"files"], [pw[@"wall_s"] doubleValue], [pw[@"os_build"] UTF8String]);
+    }
+    printf("(times: boot → settled home screen, recorded by `rosettasim-ctl boot <UDID> --measure`)\n");
+    return 0;
+}
+
+static int cmd_prewarm(NSString *which, int jobs, BOOL report) {
+    NSMutableArray<NSDictionary *> *runtimes = [NSMutableArray array];
+    for (NSDictionary *rt in installed_legacy_runtimes())
+        if (runtime_matches(rt, which)) [runtimes addObject:rt];
+    if (!runtimes.count) {
+        fprintf(stderr, "No installed legacy runtime matches '%s'\n", which.UTF8String);
+        return 1;
+    }
+    if (report) return prewarm_report(runtimes);
+
+    NSString *helper = [[[NSProcessInfo processInfo].arguments[0] stringByDeletingLastPathComponent]
+                        stringByAppendingPathComponent:@"rosettasim_prewarm"];
+    if (![[NSFileManager defaultManager] isExecutableFileAtPath:helper]) {
+        fprintf(stderr, "rosettasim_prewarm helper not found next to rosettasim-ctl (make prewarm)\n");
+        return 1;
+    }
+    if (jobs <= 0) jobs = MAX(1, MIN(8, (int)[NSProcessInfo processInfo].activeProcessorCount / 2));
+
+    PrewarmTotals totals = {0};
+    double t0 = now_epoch();
+    for (NSDictionary *rt in runtimes) prewarm_runtime(rt, helper, jobs, &totals);
+    printf("Prewarmed %lu runtime(s) in %.1fs: %d files, %d translated, %d failed, %.1f MB "
+           "(%.1fs of helper time)\n", (unsigned long)runtimes.count, now_epoch() - t0, totals.files,
+           totals.translated, totals.failed, totals.bytes / 1048576.0, totals.helper_ms / 1000.0);
+    printf("Compare boots with: rosettasim-ctl boot <UDID> --measure, then rosettasim-ctl prewarm %s --report\n",
+           which.UTF8String);
+    return totals.failed ? 1 : 0;
+}
+
+/* ── Command: diagnose (rosettasim extension) ── */
+
+/*
+ * Everything needed to debug a legacy device from CI, in one zip: host-side
+ * rosettasim files in /tmp (daemon / HID logs, device registry, dims),
+ * per-device metadata, logs, crash logs, the last few frames (those still
+ * in the frame file's ring, then any published while collecting), the
+ * process tree and the runtime profiles. Collectors run in parallel and
+ * feed common/rosettasim_archive.h, which deflates on worker threads while
+ * collection goes on and stops adding entries at the size cap.
+ */
+
+#define DIAG_LOG_TAIL       (32LL << 20)    /* logs: keep the last 32 MB */
+#define DIAG_FILE_TAIL      (8LL << 20)     /* anything else */
+#define DIAG_FRAME_WAIT     1.0             /* seconds to wait for new frames */
+
+static void diag_add_file(RSimArchive *a, NSString *name, NSString *path, long long max_bytes) {
+    BOOL dir = NO;
+    if ([[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&dir] && !dir)
+        rsim_archive_add_file(a, name.UTF8String, path.fileSystemRepresentation, max_bytes);
+}
+
+static void diag_add_text(RSimArchive *a, NSString *name, NSString *text) {
+    const char *utf8 = text.UTF8String ?: "";
+    rsim_archive_add_data(a, name.UTF8String, strdup(utf8), strlen(utf8), time(NULL));
+}
+
+/* Every regular file under dir, as prefix/<relative path> */
+static void diag_add_tree(RSimArchive *a, NSString *prefix, NSString *dir, long long max_bytes) {
+    NSDirectoryEnumerator *e = [[NSFileManager defaultManager] enumeratorAtPath:dir];
+    for (NSString *rel in e) {
+        if (![e.fileAttributes.fileType isEqualToString:NSFileTypeRegular]) continue;
+        diag_add_file(a, [prefix stringByAppendingPathComponent:rel], [dir stringByAppendingPathComponent:rel], max_bytes);
+    }
+}
+
+static void diag_tree_walk(NSMutableString *out, NSDictionary *lines, NSDictionary *children,
+                           NSNumber *pid, int depth) {
+    [out appendFormat:@"%*s%@\n", depth * 2, "",
+        [lines[pid] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]]];
+    if (depth < 32)
+        for (NSNumber *child in children[pid]) diag_tree_walk(out, lines, children, child, depth + 1);
+}
+
+/* ps output, then the launchd_sim subtrees indented */
+static NSString *diag_process_tree(void) {
+    NSString *ps = run_capture(@[@"/bin/ps", @"-axww", @"-o", @"pid=,ppid=,rss=,etime=,command="], NULL) ?: @"";
+    NSMutableDictionary<NSNumber *, NSMutableArray<NSNumber *> *> *children = [NSMutableDictionary dictionary];
+    NSMutableDictionary<NSNumber *, NSString *> *lines = [NSMutableDictionary dictionary];
+    NSMutableArray<NSNumber *> *roots = [NSMutableArray array];
+    for (NSString *line in [ps componentsSeparatedByString:@"\n"]) {
+        int pid, ppid;
+        if (sscanf(line.UTF8String, "%d %d", &pid, &ppid) != 2) continue;
+        lines[@(pid)] = line;
+        if (!children[@(ppid)]) children[@(ppid)] = [NSMutableArray array];
+        [children[@(ppid)] addObject:@(pid)];
+        if ([line rangeOfString:@"launchd_sim"].location != NSNotFound) [roots addObject:@(pid)];
+    }
+    NSMutableString *out = [NSMutableString stringWithString:@"# Simulator process trees (pid ppid rss etime command)\n"];
+    for (NSNumber *root in roots) diag_tree_walk(out, lines, children, root, 0);
+    [out appendFormat:@"\n# All processes\n%@", ps];
+    return out;
+}
+
+/* JPEG of a frame copied out of its file, as <prefix>/frames/<sequence>.jpg */
+static BOOL diag_add_frame(RSimArchive *a, NSString *prefix, const RSimFBFrame *frame) {
+    const RSimFBHeader *h = &frame->header;
+    uint8_t *jpeg = NULL;
+    size_t size = 0;
+    if (rsim_jpeg_encode_bgra(frame->pixels, (int)h->width, (int)h->height, h->bytes_per_row,
+                              85, &jpeg, &size) != 0)
+        return NO;
+    NSString *name = [prefix stringByAppendingFormat:@"/frames/%06llu.jpg", (unsigned long long)h->sequence];
+    rsim_archive_add_data(a, name.UTF8String, jpeg, size, (time_t)(h->timestamp_ns / 1000000000ULL));
+    return YES;
+}
+
+/* Up to count distinct frames: the ones still in the writer's
+ * RSIM_FB_RING backing files (<path>.0, .1, ...; the current frame is one
+ * of them), then those published within DIAG_FRAME_WAIT. Frames are
+ * copied out with rsim_fb_read before encoding, since the daemon rewrites
+ * a backing file in place a few frames after publishing it. */
+static void diag_add_frames(RSimArchive *a, NSString *prefix, NSString *udid, int count) {
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/rosettasim_fb_%s.fb", udid.UTF8String);
+    RSimFBFrame frame = {0};
+    uint64_t last = UINT64_MAX;
+    int got = 0;
+
+    /* The ring, oldest first, so the newest frames win when count is small */
+    RSimFBFrame ring[RSIM_FB_RING] = {{{0}}};
+    int order[RSIM_FB_RING], nring = 0;
+    for (unsigned i = 0; i < RSIM_FB_RING; i++) {
+        char slot[300];
+        snprintf(slot, sizeof(slot), "%s.%u", path, i);
+        if (rsim_fb_read(slot, &ring[i], 0, 0) != RSIM_FB_OK) continue;
+        int k = nring++;
+        for (; k > 0 && ring[order[k - 1]].header.sequence > ring[i].header.sequence; k--) order[k] = order[k - 1];
+        order[k] = (int)i;
+    }
+    for (int k = nring > count ? nring - count : 0; k < nring; k++) {
+        const RSimFBFrame *f = &ring[order[k]];
+        if (f->header.sequence == last) continue;
+        last = f->header.sequence;
+        got += diag_add_frame(a, prefix, f);
+    }
+    for (unsigned i = 0; i < RSIM_FB_RING; i++) rsim_fb_frame_free(&ring[i]);
+
+    /* Then new ones, as they are published */
+    double deadline = now_epoch() + DIAG_FRAME_WAIT;
+    while (got < count && now_epoch() < deadline) {
+        int err = rsim_fb_read(path, &frame, last, 0);
+        if (err == RSIM_FB_OK && frame.header.sequence != last) {   /* the copy's own sequence */
+            last = frame.header.sequence;
+            got += diag_add_frame(a, prefix, &frame);
+        } else if (err != RSIM_FB_OK && err != RSIM_FB_SAME && err != RSIM_FB_ERR_BUSY) {
+            break;                      /* no frame file (any more) */
+        }
+        usleep(10000);
+    }
+    rsim_fb_frame_free(&frame);
+}
+
+static int cmd_diagnose(NSArray<NSString *> *udids, NSString *output, int frames, long long cap,
+                        int jobs, int level) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    NSDictionary *all = ((id(*)(id, SEL))objc_msgSend)(deviceSet, sel_registerName("devicesByUDID"));
+    NSMutableArray *devices = [NSMutableArray array];
+    if (udids.count) {
+        for (NSString *udid in udids) {
+            id device = find_device(deviceSet, udid);
+            if (!device) {
+                fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+                return 1;
+            }
+            [devices addObject:device];
+        }
+    } else {
+        for (id device in all.allValues)
+            if (is_legacy_runtime(get_runtime_id(device))) [devices addObject:device];
+    }
+    if (!output) {
+        NSDateFormatter *fmt = [[NSDateFormatter alloc] init];
+        fmt.dateFormat = @"yyyyMMdd-HHmmss";
+        output = [NSString stringWithFormat:@"rosettasim-diagnose-%@.zip", [fmt stringFromDate:[NSDate date]]];
+    }
+
+    RSimArchive archive;
+    RSimArchive *a = &archive;
+    char err[512];
+    if (rsim_archive_open(a, output.fileSystemRepresentation, jobs, cap, level, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        return 1;
+    }
+    printf("Collecting diagnostics for %lu device(s) into %s\n", (unsigned long)devices.count, output.UTF8String);
+
+    NSString *home = NSHomeDirectory();
+    NSMutableArray<void (^)(void)> *collectors = [NSMutableArray array];
+
+    /* Host: daemon and HID logs, device registry, dims, command results */
+    [collectors addObject:^{
+        for (NSString *f in [[NSFileManager defaultManager] contentsOfDirectoryAtPath:@"/tmp" error:nil]) {
+            if (![f hasPrefix:@"rosettasim_"] || [f containsString:@".fb"] || [f hasSuffix:@".tmp"]) continue;
+            BOOL isLog = [f hasSuffix:@".log"] || [f hasSuffix:@".txt"];
+            diag_add_file(a, [@"host/tmp" stringByAppendingPathComponent:f],
+                          [@"/tmp" stringByAppendingPathComponent:f], isLog ? DIAG_LOG_TAIL : DIAG_FILE_TAIL);
+        }
+    }];
+    [collectors addObject:^{
+        diag_add_text(a, @"host/processes.txt", diag_process_tree());
+    }];
+    [collectors addObject:^{
+        NSString *sw = run_capture(@[@"/usr/bin/sw_vers"], NULL) ?: @"";
+        NSString *uname = run_capture(@[@"/usr/bin/uname", @"-a"], NULL) ?: @"";
+        diag_add_text(a, @"host/system.txt", [NSString stringWithFormat:@"%@\n%@", sw, uname]);
+    }];
+    /* Runtime profiles */
+    [collectors addObject:^{
+        for (NSDictionary *rt in installed_legacy_runtimes()) {
+            NSString *bundle = [[rt[@"root"] stringByDeletingLastPathComponent] stringByDeletingLastPathComponent];
+            NSString *prefix = [@"runtimes" stringByAppendingPathComponent:rt[@"name"]];
+            diag_add_file(a, [prefix stringByAppendingPathComponent:@"Info.plist"],
+                          [bundle stringByAppendingPathComponent:@"Info.plist"], DIAG_FILE_TAIL);
+            diag_add_file(a, [prefix stringByAppendingPathComponent:@"profile.plist"],
+                          [bundle stringByAppendingPathComponent:@"Resources/profile.plist"], DIAG_FILE_TAIL);
+            diag_add_file(a, [prefix stringByAppendingPathComponent:@"SystemVersion.plist"],
+                          [rt[@"root"] stringByAppendingPathComponent:@"System/Library/CoreServices/SystemVersion.plist"],
+                          DIAG_FILE_TAIL);
+        }
+    }];
+    /* Per device: metadata, logs, crash logs (one collector each) and frames */
+    for (id device in devices) {
+        NSString *udid = [((id(*)(id, SEL))objc_msgSend)(device, sel_registerName("UDID")) UUIDString];
+        NSString *prefix = [@"devices" stringByAppendingPathComponent:udid];
+        NSString *devDir = [NSString stringWithFormat:@"%@/Library/Developer/CoreSimulator/Devices/%@", home, udid];
+        NSString *data = [devDir stringByAppendingPathComponent:@"data"];
+        NSData *json = [NSJSONSerialization dataWithJSONObject:@{
+            @"udid": udid, @"name": get_device_name(device) ?: @"", @"runtime": get_runtime_id(device) ?: @"",
+            @"state": state_string(get_device_state(device)),
+        } options:NSJSONWritingPrettyPrinted error:nil];
+        NSString *info = [[NSString alloc] initWithData:json encoding:NSUTF8StringEncoding];
+        BOOL booted = get_device_state(device) == 3;
+        [collectors addObject:^{
+            diag_add_text(a, [prefix stringByAppendingPathComponent:@"info.json"], info);
+            diag_add_file(a, [prefix stringByAppendingPathComponent:@"device.plist"],
+                          [devDir stringByAppendingPathComponent:@"device.plist"], DIAG_FILE_TAIL);
+            for (NSString *rel in @[@ROSETTASIM_DEV_TOUCH_LOG, @ROSETTASIM_DEV_TOUCH_INJECT_LOG,
+                                    @ROSETTASIM_DEV_HANGS_FILE, @ROSETTASIM_DEV_INSTALLED_APPS])
+                diag_add_file(a, [prefix stringByAppendingPathComponent:rel.lastPathComponent],
+                              [data stringByAppendingPathComponent:rel], DIAG_LOG_TAIL);
+            diag_add_tree(a, [prefix stringByAppendingPathComponent:@"logs"],
+                          [NSString stringWithFormat:@"%@/Library/Logs/CoreSimulator/%@", home, udid], DIAG_LOG_TAIL);
+        }];
+        [collectors addObject:^{
+            diag_add_tree(a, [prefix stringByAppendingPathComponent:@"crashes"],
+                          [data stringByAppendingPathComponent:@"Library/Logs"], DIAG_FILE_TAIL);
+        }];
+        if (booted && frames > 0)
+            [collectors addObject:^{ diag_add_frames(a, prefix, udid, frames); }];
+    }
+
+    double t0 = now_epoch();
+    dispatch_apply(collectors.count, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) { @autoreleasepool {
+        collectors[i]();
+    }});
+    double collected = now_epoch() - t0;
+
+    RSimArchiveStats st;
+    if (rsim_archive_close(a, &st) != 0) {
+        fprintf(stderr, "Writing %s failed\n", output.UTF8String);
+        return 1;
+    }
+    printf("Wrote %s: %.1f MB from %.1f MB in %.1fs (collected in %.1fs, %d compression thread(s))\n",
+           output.UTF8String, st.bytes_out / 1048576.0, st.bytes_in / 1048576.0, st.ms / 1000.0, collected, jobs);
+    printf("  %zu entries: %zu stored, %zu truncated to their tail, %zu skipped over the cap, %zu unreadable"
+           " (see " RSIM_ARCHIVE_MANIFEST ")\n", st.entries, st.stored, st.truncated, st.skipped, st.failed);
+    return 0;
+}
+
+/* ── Command: location ── */
+
+/* NOTE: cmd_sendtext and cmd_keyevent defined above (lines ~1635, ~1668) */
+
+#if 0 /* duplicate definitions removed — keep originals above */
+static int _removed_cmd_sendtext(NSString *udid, NSString *text) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+
+    long state = get_device_state(device);
+    if (state != 3) {
+        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(state).UTF8String);
+        return 1;
+    }
+
+    NSString *dataPath = get_device_data_path(device);
+    if (!dataPath) {
+        fprintf(stderr, "Could not determine device data path\n");
+        return 1;
+    }
+
+    NSString *tmpDir = [dataPath stringByAppendingPathComponent:@"tmp"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir
+                              withIntermediateDirectories:YES attributes:nil error:nil];
+    /* Keyboard events go through backboardd (rosettasim_touch_bb.json) */
+    NSString *cmdPath = [tmpDir stringByAppendingPathComponent:@"rosettasim_touch_bb.json"];
+
+    printf("Sending text: \"%s\" to %s\n", text.UTF8String, get_device_name(device).UTF8String);
+
+    /* Escape the text for JSON */
+    NSData *textData = [NSJSONSerialization dataWithJSONObject:@{
+        @"action": @"text",
+        @"text": text,
+        @"x": @0,
+        @"y": @0
+    } options:0 error:nil];
+    NSString *json = [[NSString alloc] initWithData:textData encoding:NSUTF8StringEncoding];
+    NSString *jsonLine = [json stringByAppendingString:@"\n"];
+
+    NSError *err = nil;
+    [jsonLine writeToFile:cmdPath atomically:YES encoding:NSUTF8StringEncoding error:&err];
+    if (err) {
+        fprintf(stderr, "Failed to write command: %s\n", err.localizedDescription.UTF8String);
+        return 1;
+    }
+
+    /* Wait for processing: ~60ms per character (30ms down + 30ms up) + overhead */
+    int wait_ms = (int)(text.length * 80 + 500);
+    usleep(wait_ms * 1000);
+
+    printf("Text sent.\n");
+    return 0;
+}
+
+/* ── Command: keyevent ── */
+
+static int cmd_keyevent(NSString *udid, uint32_t usagePage, uint32_t usage) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+
+    long state = get_device_state(device);
+    if (state != 3) {
+        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(state).UTF8String);
+        return 1;
+    }
+
+    NSString *dataPath = get_device_data_path(device);
+    if (!dataPath) {
+        fprintf(stderr, "Could not determine device data path\n");
+        return 1;
+    }
+
+    NSString *tmpDir = [dataPath stringByAppendingPathComponent:@"tmp"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:tmpDir
+                              withIntermediateDirectories:YES attributes:nil error:nil];
+    NSString *cmdPath = [tmpDir stringByAppendingPathComponent:@"rosettasim_touch_bb.json"];
+
+    printf("Key event: page=%u usage=%u on %s\n",
+           usagePage, usage, get_device_name(device).UTF8String);
+
+    NSString *json = [NSString stringWithFormat:
+        @"{\"action\":\"key\",\"page\":%u,\"usage\":%u,\"x\":0,\"y\":0}\n",
+        usagePage, usage];
+
+    NSError *err = nil;
+    [json writeToFile:cmdPath atomically:YES encoding:NSUTF8StringEncoding error:&err];
+    if (err) {
+        fprintf(stderr, "Failed to write command: %s\n", err.localizedDescription.UTF8String);
+        return 1;
+    }
+
+    usleep(200000); /* 200ms for processing */
+
+    printf("Key event sent.\n");
+    return 0;
+}
+#endif /* duplicate removed */
+
+/* ── Command: location ── */
+
+static int location_usage(void) {
+    fprintf(stderr, "Usage: rosettasim-ctl location <UDID> set <lat>,<lon>\n");
+    fprintf(stderr, "       rosettasim-ctl location <UDID> clear\n");
+    fprintf(stderr, "       rosettasim-ctl location <UDID> route <file.gpx> [--speed <m/s>] [--rate <Hz>] [--wait]\n");
+    return 1;
+}
+
+/*
+ * route: the GPX is parsed and timed here, then sent whole; sim_app_installer
+ * interpolates and feeds locationd at --rate (1–50 Hz) on its own timer.
+ * --speed overrides the GPX timestamps (default: them, else 10 m/s).
+ * --wait blocks until playback ends and prints how close to schedule the
+ * ticks fired.
+ */
+static int location_route(NSString *udid, id device, int argc, const char *argv[]) {
+    const char *path = NULL;
+    double speed = 0, rate = 1;
+    BOOL wait = NO;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "--wait") == 0) wait = YES;
+        else if (argv[i][0] != '-' && !path) path = argv[i];
+        else return location_usage();
+    }
+    if (!path) return location_usage();
+    if (rate <= 0 || rate > RSIM_ROUTE_MAX_RATE) {
+        fprintf(stderr, "--rate must be in (0, %g] Hz\n", RSIM_ROUTE_MAX_RATE);
+        return 1;
+    }
+    if (get_device_state(device) != 3) {
+        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(get_device_state(device)).UTF8String);
+        return 1;
+    }
+
+    RSimRoute route = {0};
+    char err[256];
+    if (rsim_route_load_gpx(&route, path, err, sizeof(err)) < 0) {
+        fprintf(stderr, "%s\n", err);
+        rsim_route_free(&route);
+        return 1;
+    }
+    double duration = rsim_route_timeline(&route, speed);
+    NSMutableArray *points = [NSMutableArray arrayWithCapacity:route.count];
+    for (size_t i = 0; i < route.count; i++) {
+        RSimRoutePoint *p = &route.points[i];
+        [points addObject:@[ @(p->lat), @(p->lon), @(p->ele), @(p->t) ]];
+    }
+    printf("Route %s: %zu points, %.2f km, %.0fs at %g Hz on %s\n", path, route.count,
+           route.points[route.count - 1].dist / 1000.0, duration, rate, get_device_name(device).UTF8String);
+    rsim_route_free(&route);
+
+    NSString *reqID = agent_send(udid, @"location", @{@"route": points, @"rate": @(rate)}, 6.0);
+    NSString *rest = nil;
+    NSString *status = reqID ? agent_wait(udid, @"LOCATION", reqID, nil, 6.0, &rest) : nil;
+    if (!status) {
+        [[NSFileManager defaultManager] removeItemAtPath:
+            [NSString stringWithFormat:@ROSETTASIM_HOST_CMD_NSFMT, udid] error:nil];
+        fprintf(stderr, "sim_app_installer did not answer (not deployed to this runtime?)\n");
+        return 1;
+    }
+    if (![status isEqualToString:@"started"]) {
+        fprintf(stderr, "Route not started: %s (%s)\n", status.UTF8String, rest.UTF8String);
+        return 1;
+    }
+    printf("  Playing in-sim (%s)\n", rest.UTF8String);
+    if (!wait) return 0;
+
+    status = agent_wait(udid, @"LOCATION", reqID, @"done", duration + 10.0, &rest);
+    if (!status) {
+        fprintf(stderr, "Playback did not report completion (replaced by another location command?)\n");
+        return 1;
+    }
+    printf("  Done: %s (lateness in ms)\n", rest.UTF8String);
+    return 0;
+}
+
+static int cmd_location(NSString *udid, int argc, const char *argv[]) {
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    id device = find_device(deviceSet, udid);
+    if (!device) {
+        fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+        return 1;
+    }
+
+    NSString *rtID = get_runtime_id(device);
+    if (!is_legacy_runtime(rtID)) {
+        return passthrough_to_simctl(argc, argv);
+    }
+
+    if (argc < 4) return location_usage();
+
+    if (strcmp(argv[3], "route") == 0) return location_route(udid, device, argc, argv);
+
+    if (strcmp(argv[3], "clear") == 0) {
+        if (!agent_send(udid, @"location", @{@"clear": @YES}, 6.0)) {
+            fprintf(stderr, "Cannot write the command for sim_app_installer\n");
+            return 1;
+        }
+        printf("Location cleared on %s\n", get_device_name(device).UTF8String);
+        return 0;
+    }
 
-    char notifyName[256];
-    snprintf(notifyName, sizeof(notifyName), "com.rosettasim.location.%s", udid.UTF8String);
-    notify_post(notifyName);
+    if (strcmp(argv[3], "set") != 0 || argc < 5) return location_usage();
 
+    /* Parse lat,lon */
+    double lat = 0, lon = 0;
+    if (sscanf(argv[4], "%lf,%lf", &lat, &lon) != 2) {
+        fprintf(stderr, "Invalid coordinates: %s (expected lat,lon e.g. 51.5074,-0.1278)\n", argv[4]);
+        return 1;
+    }
+
+    if (!agent_send(udid, @"location", @{@"lat": @(lat), @"lon": @(lon)}, 6.0)) {
+        fprintf(stderr, "Cannot write the command for sim_app_installer\n");
+        return 1;
+    }
     printf("Location set to %.6f, %.6f on %s\n", lat, lon, get_device_name(device).UTF8String);
-    printf("  Note: requires sim_app_installer.dylib with location handler.\n");
     return 0;
 }
 
 /* ── Command: push ── */
 
+/*
+ * push --batch: payloads.jsonl (one JSON object per line) is validated and
+ * spooled for sim_app_installer, which streams it through a bounded queue
+ * and delivers at --rate payloads/s (up to --burst early), then reports
+ * what it delivered, the achieved rate and per-payload latency.
+ */
+static int push_batch(NSString *udid, id device, NSString *bundleID, int argc, const char *argv[]) {
+    const char *input = NULL;
+    double rate = 0;
+    unsigned burst = 1;
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) input = argv[++i];
+        else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "--burst") == 0 && i + 1 < argc) burst = (unsigned)atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Unknown push option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!input || rate <= 0 || rate > RSIM_PUSH_MAX_RATE || burst < 1) {
+        fprintf(stderr, "Usage: rosettasim-ctl push <UDID> <bundle-id> --batch <payloads.jsonl|-> "
+                        "--rate <N/s, max %g> [--burst <n>]\n", RSIM_PUSH_MAX_RATE);
+        return 1;
+    }
+    if (get_device_state(device) != 3) {
+        fprintf(stderr, "Device is not booted (state: %s)\n", state_string(get_device_state(device)).UTF8String);
+        return 1;
+    }
+
+    /* Validate and spool through the same bounded queue the agent uses */
+    FILE *in = strcmp(input, "-") == 0 ? stdin : fopen(input, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot read payload file: %s\n", input);
+        return 1;
+    }
+    NSString *spool = [NSString stringWithFormat:@ROSETTASIM_HOST_PUSH_SPOOL_NSFMT, udid];
+    NSString *tmp = [spool stringByAppendingString:@".tmp"];
+    FILE *out = fopen(tmp.UTF8String, "w");
+    RSimPushQueue q;
+    if (!out || rsim_pushq_init(&q, RSIM_PUSHQ_CAPACITY) != 0) {
+        fprintf(stderr, "Cannot write %s\n", tmp.UTF8String);
+        if (out) fclose(out);
+        if (in != stdin) fclose(in);
+        return 1;
+    }
+    size_t count = 0;
+    int bad = 0;
+    while (!bad && rsim_pushq_fill(&q, in) > 0) {
+        RSimPushItem item;
+        while (rsim_pushq_pop(&q, &item) == 0) {
+            @autoreleasepool {
+                /* The queue's buffer outlives json: ARC may release json
+                 * right after parsing, so it must not own the bytes */
+                NSData *json = [NSData dataWithBytesNoCopy:item.data length:item.len freeWhenDone:NO];
+                id payload = [NSJSONSerialization JSONObjectWithData:json options:0 error:nil];
+                if (!bad && ![payload isKindOfClass:[NSDictionary class]]) {
+                    fprintf(stderr, "%s:%u: not a JSON object\n", input, item.seq);
+                    bad = 1;
+                }
+                if (!bad) {
+                    fwrite(item.data, 1, item.len, out);
+                    fputc('\n', out);
+                    count++;
+                }
+                free(item.data);
+            }
+        }
+    }
+    rsim_pushq_free(&q);
+    if (in != stdin) fclose(in);
+    if (fclose(out) != 0 || bad || count == 0 || rename(tmp.UTF8String, spool.UTF8String) != 0) {
+        if (!bad && !count) fprintf(stderr, "No payloads in %s\n", input);
+        else if (!bad) fprintf(stderr, "Cannot write %s\n", spool.UTF8String);
+        unlink(tmp.UTF8String);
+        return 1;
+    }
+
+    printf("Pushing %zu payloads to %s on %s at %g/s\n", count, bundleID.UTF8String,
+           get_device_name(device).UTF8String, rate);
+    NSString *reqID = agent_send(udid, @"push", @{@"bundle_id": bundleID, @"batch": spool,
+                                                  @"rate": @(rate), @"burst": @(burst)}, 6.0);
+    NSString *rest = nil;
+    NSString *status = reqID ? agent_wait(udid, @"PUSH", reqID, nil, 6.0, &rest) : nil;
+    if (![status isEqualToString:@"started"]) {
+        [[NSFileManager defaultManager] removeItemAtPath:
+            [NSString stringWithFormat:@ROSETTASIM_HOST_CMD_NSFMT, udid] error:nil];
+        unlink(spool.UTF8String);
+        fprintf(stderr, "Batch not started: %s\n", status ? [NSString stringWithFormat:@"%@ (%@)", status, rest].UTF8String
+                                                            : "sim_app_installer did not answer (not deployed to this runtime?)");
+        return 1;
+    }
+    status = agent_wait(udid, @"PUSH", reqID, @"done", count / rate + 30.0, &rest);
+    if (!status) {
+        fprintf(stderr, "Batch did not report completion\n");
+        return 1;
+    }
+    printf("  %s (latency in ms, from each payload's scheduled time)\n", rest.UTF8String);
+    return [rest rangeOfString:@" failed=0 "].location != NSNotFound ? 0 : 1;
+}
+
 static int cmd_push(NSString *udid, int argc, const char *argv[]) {
     id deviceSet = get_device_set();
     if (!deviceSet) return 1;
@@ -1882,10 +4282,12 @@ static int cmd_push(NSString *udid, int argc, const char *argv[]) {
     /* Usage: push <device> <bundle-id> <json-file-or--> */
     if (argc < 5) {
         fprintf(stderr, "Usage: rosettasim-ctl push <UDID> <bundle-id> <payload.json|->\n");
+        fprintf(stderr, "       rosettasim-ctl push <UDID> <bundle-id> --batch <payloads.jsonl|-> --rate <N/s> [--burst <n>]\n");
         return 1;
     }
 
     NSString *bundleID = [NSString stringWithUTF8String:argv[3]];
+    if (strcmp(argv[4], "--batch") == 0) return push_batch(udid, device, bundleID, argc, argv);
     NSString *payloadArg = [NSString stringWithUTF8String:argv[4]];
 
     /* Read payload from file or stdin */
@@ -1907,20 +4309,11 @@ static int cmd_push(NSString *udid, int argc, const char *argv[]) {
         return 1;
     }
 
-    /* Write push command for sim_app_installer.dylib */
-    NSString *cmdPath = [NSString stringWithFormat:
-        @ROSETTASIM_HOST_CMD_NSFMT, udid];
-    NSDictionary *cmd = @{
-        @"action": @"push",
-        @"bundle_id": bundleID,
-        @"payload": payload,
-    };
-    NSData *jsonData = [NSJSONSerialization dataWithJSONObject:cmd options:0 error:nil];
-    [jsonData writeToFile:cmdPath atomically:YES];
-
-    char notifyName[256];
-    snprintf(notifyName, sizeof(notifyName), "com.rosettasim.push.%s", udid.UTF8String);
-    notify_post(notifyName);
+    /* Push command for sim_app_installer.dylib */
+    if (!agent_send(udid, @"push", @{@"bundle_id": bundleID, @"payload": payload}, 6.0)) {
+        fprintf(stderr, "Cannot write the command for sim_app_installer\n");
+        return 1;
+    }
 
     /* Extract alert for display */
     NSDictionary *aps = payload[@"aps"];
@@ -1931,10 +4324,176 @@ static int cmd_push(NSString *udid, int argc, const char *argv[]) {
     printf("Push notification sent to %s on %s\n", bundleID.UTF8String,
            get_device_name(device).UTF8String);
     if (alert) printf("  Alert: %s\n", alert.UTF8String);
-    printf("  Note: requires sim_app_installer.dylib with push handler.\n");
     return 0;
 }
 
+/* ── Live settings apply (ui content_size, keychain) ── */
+
+/*
+ * On a booted legacy device, settings changes go to sim_app_installer in
+ * SpringBoard, which applies them to the running system (cfprefsd, UIKit,
+ * securityd). Only if it can't — agent not loaded, or no live path on this
+ * runtime — are the files written on the host and the device rebooted.
+ * A shut-down device just gets the files. Each command reports the path it
+ * took and how long it took.
+ */
+
+/* Write a command for sim_app_installer and poke it. Returns the request
+ * id its reply lines carry, or nil if the command slot never freed up. */
+static NSString *agent_send(NSString *udid, NSString *action, NSDictionary *cmd, double timeout_s) {
+    NSString *cmdPath = [NSString stringWithFormat:@ROSETTASIM_HOST_CMD_NSFMT, udid];
+    NSString *reqID = [[NSUUID UUID].UUIDString substringToIndex:8];
+    NSMutableDictionary *payload = [cmd mutableCopy];
+    payload[@"action"] = action;
+    payload[@"id"] = reqID;
+
+    /* One command slot: let a pending one be picked up first (polled every 2s) */
+    double deadline = now_epoch() + timeout_s;
+    while ([[NSFileManager defaultManager] fileExistsAtPath:cmdPath] && now_epoch() < deadline) usleep(50000);
+    NSData *json = [NSJSONSerialization dataWithJSONObject:payload options:0 error:nil];
+    if (![json writeToFile:cmdPath atomically:YES]) return nil;
+    char notifyName[256];
+    snprintf(notifyName, sizeof(notifyName), "com.rosettasim.%s.%s", action.UTF8String, udid.UTF8String);
+    notify_post(notifyName);
+    return reqID;
+}
+
+/* Wait for a "<TAG> id=<reqID> status=<s> ..." reply line, with status
+ * want if given. Returns the status and the rest of the line after it, or
+ * nil on timeout. */
+static NSString *agent_wait(NSString *udid, NSString *tag, NSString *reqID, NSString *want,
+                            double timeout_s, NSString **rest) {
+    NSString *resultPath = [NSString stringWithFormat:@ROSETTASIM_HOST_RESULT_NSFMT, udid];
+    NSString *marker = [NSString stringWithFormat:@"%@ id=%@ status=", tag, reqID];
+    double deadline = now_epoch() + timeout_s;
+    while (now_epoch() < deadline) {
+        NSString *log = [NSString stringWithContentsOfFile:resultPath encoding:NSUTF8StringEncoding error:nil];
+        for (NSString *line in [log componentsSeparatedByString:@"\n"]) {
+            if (![line hasPrefix:marker]) continue;
+            NSString *tail = [line substringFromIndex:marker.length];
+            NSRange sp = [tail rangeOfString:@" "];
+            NSString *status = sp.location == NSNotFound ? tail : [tail substringToIndex:sp.location];
+            if (want && ![status isEqualToString:want]) continue;
+            *rest = sp.location == NSNotFound ? @"" : [tail substringFromIndex:NSMaxRange(sp)];
+            return status;
+        }
+        usleep(50000);
+    }
+    return nil;
+}
+
+/* Send a settings command to sim_app_installer and wait for its SETTINGS
+ * reply. Returns the status ("live", "unsupported", "failed"), or nil if
+ * the agent never answered. */
+static NSString *agent_request(NSString *udid, NSDictionary *cmd, double timeout_s, NSString **detail) {
+    double t0 = now_epoch();
+    NSString *reqID = agent_send(udid, @"settings", cmd, timeout_s);
+    NSString *rest = nil;
+    NSString *status = reqID ? agent_wait(udid, @"SETTINGS", reqID, nil, timeout_s - (now_epoch() - t0), &rest) : nil;
+    if (!status) {
+        /* Don't leave it for a later boot to act on */
+        [[NSFileManager defaultManager] removeItemAtPath:
+            [NSString stringWithFormat:@ROSETTASIM_HOST_CMD_NSFMT, udid] error:nil];
+        return nil;
+    }
+    NSRange r = [rest rangeOfString:@"detail="];
+    *detail = r.location != NSNotFound ? [rest substringFromIndex:NSMaxRange(r)] : @"";
+    return status;
+}
+
+/* Apply one change by the cheapest path that works. write_files does the
+ * on-disk change; it runs only when live apply isn't used. */
+static int apply_setting(NSString *udid, id device, NSDictionary *cmd, BOOL allowReboot,
+                         BOOL (^write_files)(void)) {
+    double t0 = now_epoch();
+    if (get_device_state(device) != 3) {
+        if (!write_files()) return 1;
+        printf("  Applied: offline in %.0fms (device not booted; takes effect at next boot)\n",
+               (now_epoch() - t0) * 1000.0);
+        return 0;
+    }
+
+    NSString *detail = nil;
+    NSString *status = agent_request(udid, cmd, 6.0, &detail);
+    if ([status isEqualToString:@"live"]) {
+        printf("  Applied: live in %.0fms (%s)\n", (now_epoch() - t0) * 1000.0, detail.UTF8String);
+        return 0;
+    }
+    printf("  Live apply not possible: %s\n",
+           status ? [NSString stringWithFormat:@"%@ (%@)", status, detail].UTF8String
+                  : "sim_app_installer did not answer (not deployed to this runtime?)");
+
+    if (!allowReboot) {
+        if (!write_files()) return 1;
+        printf("  Applied: on disk only in %.0fms — reboot device for change to take effect.\n",
+               (now_epoch() - t0) * 1000.0);
+        return 0;
+    }
+    /* Files are written with the device down so nothing running overwrites them */
+    cmd_shutdown(udid);
+    BOOL ok = write_files();
+    int rc = cmd_boot(udid, NO);
+    if (!ok || rc != 0) return 1;
+    printf("  Applied: reboot in %.1fs\n", now_epoch() - t0);
+    return 0;
+}
+
+/* Certificates (base64 DER) in a device's TrustStore.sqlite3 */
+static NSArray<NSString *> *trust_store_certs(NSString *trustStorePath) {
+    NSMutableArray *certs = [NSMutableArray array];
+    sqlite3 *db = NULL;
+    if (sqlite3_open_v2(trustStorePath.fileSystemRepresentation, &db, SQLITE_OPEN_READONLY, NULL) == SQLITE_OK) {
+        sqlite3_stmt *stmt = NULL;
+        if (sqlite3_prepare_v2(db, "SELECT data FROM tsettings WHERE data IS NOT NULL", -1, &stmt, NULL) == SQLITE_OK) {
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                NSData *der = [NSData dataWithBytes:sqlite3_column_blob(stmt, 0) length:sqlite3_column_bytes(stmt, 0)];
+                if (der.length) [certs addObject:[der base64EncodedStringWithOptions:0]];
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+    sqlite3_close(db);
+    return certs;
+}
+
+/* UIContentSizeCategory key for a simctl-style size name, or nil */
+static NSString *content_size_category(NSString *name) {
+    NSDictionary *sizeMap = @{
+        @"extra-small": @"UICTContentSizeCategoryXS",
+        @"small": @"UICTContentSizeCategoryS",
+        @"medium": @"UICTContentSizeCategoryM",
+        @"large": @"UICTContentSizeCategoryL",
+        @"extra-large": @"UICTContentSizeCategoryXL",
+        @"extra-extra-large": @"UICTContentSizeCategoryXXL",
+        @"extra-extra-extra-large": @"UICTContentSizeCategoryXXXL",
+        @"accessibility-medium": @"UICTContentSizeCategoryAccessibilityM",
+        @"accessibility-large": @"UICTContentSizeCategoryAccessibilityL",
+        @"accessibility-extra-large": @"UICTContentSizeCategoryAccessibilityXL",
+        @"accessibility-extra-extra-large": @"UICTContentSizeCategoryAccessibilityXXL",
+        @"accessibility-extra-extra-extra-large": @"UICTContentSizeCategoryAccessibilityXXXL",
+    };
+    return sizeMap[name];
+}
+
+/* Offline content size: the device's com.apple.Accessibility.plist */
+static BOOL write_content_size(NSString *prefsPath, NSString *category) {
+    /* Ensure directory exists */
+    NSString *prefsDir = [prefsPath stringByDeletingLastPathComponent];
+    [[NSFileManager defaultManager] createDirectoryAtPath:prefsDir
+                              withIntermediateDirectories:YES attributes:nil error:nil];
+
+    /* Read existing or create new */
+    NSMutableDictionary *prefs = [NSMutableDictionary dictionaryWithContentsOfFile:prefsPath] ?: [NSMutableDictionary new];
+    prefs[@"PreferredContentSizeCategoryName"] = category;
+    return [prefs writeToFile:prefsPath atomically:YES];
+}
+
+static BOOL has_flag(int argc, const char *argv[], const char *flag) {
+    for (int i = 3; i < argc; i++)
+        if (strcmp(argv[i], flag) == 0) return YES;
+    return NO;
+}
+
 /* ── Command: ui ── */
 
 static int cmd_ui(NSString *udid, int argc, const char *argv[]) {
@@ -1952,7 +4511,7 @@ static int cmd_ui(NSString *udid, int argc, const char *argv[]) {
     }
 
     if (argc < 5) {
-        fprintf(stderr, "Usage: rosettasim-ctl ui <UDID> content_size <category>\n");
+        fprintf(stderr, "Usage: rosettasim-ctl ui <UDID> content_size <category> [--no-reboot]\n");
         fprintf(stderr, "       rosettasim-ctl ui <UDID> appearance <light|dark>\n");
         fprintf(stderr, "\nContent size categories: extra-small, small, medium, large (default),\n");
         fprintf(stderr, "  extra-large, extra-extra-large, extra-extra-extra-large,\n");
@@ -1970,47 +4529,23 @@ static int cmd_ui(NSString *udid, int argc, const char *argv[]) {
     }
 
     if ([option isEqualToString:@"content_size"]) {
-        /* Map size name to UIContentSizeCategory key */
-        NSDictionary *sizeMap = @{
-            @"extra-small": @"UICTContentSizeCategoryXS",
-            @"small": @"UICTContentSizeCategoryS",
-            @"medium": @"UICTContentSizeCategoryM",
-            @"large": @"UICTContentSizeCategoryL",
-            @"extra-large": @"UICTContentSizeCategoryXL",
-            @"extra-extra-large": @"UICTContentSizeCategoryXXL",
-            @"extra-extra-extra-large": @"UICTContentSizeCategoryXXXL",
-            @"accessibility-medium": @"UICTContentSizeCategoryAccessibilityM",
-            @"accessibility-large": @"UICTContentSizeCategoryAccessibilityL",
-            @"accessibility-extra-large": @"UICTContentSizeCategoryAccessibilityXL",
-            @"accessibility-extra-extra-large": @"UICTContentSizeCategoryAccessibilityXXL",
-            @"accessibility-extra-extra-extra-large": @"UICTContentSizeCategoryAccessibilityXXXL",
-        };
-
-        NSString *category = sizeMap[value];
+        NSString *category = content_size_category(value);
         if (!category) {
             fprintf(stderr, "Unknown content size: %s\n", value.UTF8String);
             return 1;
         }
 
-        /* Write to device's accessibility prefs plist */
+        /* Device's accessibility prefs plist (used when live apply isn't) */
         NSString *prefsPath = [NSString stringWithFormat:
             @"%@/Library/Developer/CoreSimulator/Devices/%@/data/Library/Preferences/com.apple.Accessibility.plist",
             NSHomeDirectory(), udid];
 
-        /* Ensure directory exists */
-        NSString *prefsDir = [prefsPath stringByDeletingLastPathComponent];
-        [[NSFileManager defaultManager] createDirectoryAtPath:prefsDir
-                                  withIntermediateDirectories:YES attributes:nil error:nil];
-
-        /* Read existing or create new */
-        NSMutableDictionary *prefs = [NSMutableDictionary dictionaryWithContentsOfFile:prefsPath] ?: [NSMutableDictionary new];
-        prefs[@"PreferredContentSizeCategoryName"] = category;
-        [prefs writeToFile:prefsPath atomically:YES];
-
         printf("Content size set to %s (%s) on %s\n",
                value.UTF8String, category.UTF8String, get_device_name(device).UTF8String);
-        printf("  Reboot device for change to take effect.\n");
-        return 0;
+        return apply_setting(udid, device, @{@"op": @"content_size", @"value": category},
+                             !has_flag(argc, argv, "--no-reboot"), ^BOOL {
+            return write_content_size(prefsPath, category);
+        });
     }
 
     fprintf(stderr, "Unknown UI option: %s (use content_size or appearance)\n", option.UTF8String);
@@ -2034,9 +4569,9 @@ static int cmd_keychain(NSString *udid, int argc, const char *argv[]) {
     }
 
     if (argc < 4) {
-        fprintf(stderr, "Usage: rosettasim-ctl keychain <UDID> reset\n");
-        fprintf(stderr, "       rosettasim-ctl keychain <UDID> add-root-cert <cert.pem>\n");
-        fprintf(stderr, "       rosettasim-ctl keychain <UDID> add-cert <cert.pem>\n");
+        fprintf(stderr, "Usage: rosettasim-ctl keychain <UDID> reset [--no-reboot]\n");
+        fprintf(stderr, "       rosettasim-ctl keychain <UDID> add-root-cert <cert.pem> [--no-reboot]\n");
+        fprintf(stderr, "       rosettasim-ctl keychain <UDID> add-cert <cert.pem> [--no-reboot]\n");
         return 1;
     }
 
@@ -2045,20 +4580,26 @@ static int cmd_keychain(NSString *udid, int argc, const char *argv[]) {
         @"%@/Library/Developer/CoreSimulator/Devices/%@/data",
         NSHomeDirectory(), udid];
 
+    BOOL allowReboot = !has_flag(argc, argv, "--no-reboot");
+
     if ([action isEqualToString:@"reset"]) {
-        /* Delete keychain databases */
+        /* Live: securityd deletes the items and the trust settings we know of */
         NSString *keychainsDir = [deviceDataPath stringByAppendingPathComponent:@"Library/Keychains"];
-        NSFileManager *fm = [NSFileManager defaultManager];
-        int removed = 0;
-        for (NSString *file in [fm contentsOfDirectoryAtPath:keychainsDir error:nil]) {
-            if ([file hasPrefix:@"keychain-"] || [file hasPrefix:@"TrustStore"]) {
-                [fm removeItemAtPath:[keychainsDir stringByAppendingPathComponent:file] error:nil];
-                removed++;
+        NSArray *certs = trust_store_certs([keychainsDir stringByAppendingPathComponent:@"TrustStore.sqlite3"]);
+        printf("Resetting keychain on %s\n", get_device_name(device).UTF8String);
+        return apply_setting(udid, device, @{@"op": @"keychain_reset", @"certs": certs}, allowReboot, ^BOOL {
+            /* Delete keychain databases */
+            NSFileManager *fm = [NSFileManager defaultManager];
+            int removed = 0;
+            for (NSString *file in [fm contentsOfDirectoryAtPath:keychainsDir error:nil]) {
+                if ([file hasPrefix:@"keychain-"] || [file hasPrefix:@"TrustStore"]) {
+                    [fm removeItemAtPath:[keychainsDir stringByAppendingPathComponent:file] error:nil];
+                    removed++;
+                }
             }
-        }
-        printf("Keychain reset: removed %d file(s) from %s\n", removed, keychainsDir.UTF8String);
-        printf("  Reboot device for change to take effect.\n");
-        return 0;
+            printf("  Keychain reset: removed %d file(s) from %s\n", removed, keychainsDir.UTF8String);
+            return YES;
+        });
     }
 
     if ([action isEqualToString:@"add-root-cert"] || [action isEqualToString:@"add-cert"]) {
@@ -2073,51 +4614,373 @@ static int cmd_keychain(NSString *udid, int argc, const char *argv[]) {
             return 1;
         }
 
-        /* Copy cert to device's TrustStore via sqlite3 */
         NSData *certData = [NSData dataWithContentsOfFile:certPath];
         if (!certData) {
             fprintf(stderr, "Cannot read certificate file\n");
             return 1;
         }
 
-        NSString *trustStorePath = [deviceDataPath stringByAppendingPathComponent:
-            @"Library/Keychains/TrustStore.sqlite3"];
-        NSString *keychainsDir = [trustStorePath stringByDeletingLastPathComponent];
-        [[NSFileManager defaultManager] createDirectoryAtPath:keychainsDir
-                                  withIntermediateDirectories:YES attributes:nil error:nil];
-
-        /* Create table if needed and insert cert */
-        NSString *createSql = [NSString stringWithFormat:
-            @"sqlite3 '%@' 'CREATE TABLE IF NOT EXISTS tsettings ("
-            "sha1 BLOB NOT NULL DEFAULT (x\\'\\'), subj BLOB NOT NULL DEFAULT (x\\'\\'), "
-            "tset BLOB, data BLOB, PRIMARY KEY (sha1))'", trustStorePath];
-        system(createSql.UTF8String);
-
-        /* Write cert data to temp file for sqlite3 import */
-        NSString *tmpCert = [NSString stringWithFormat:@"/tmp/rosettasim_cert_%@.der", udid];
-        [certData writeToFile:tmpCert atomically:YES];
-
-        NSString *insertSql = [NSString stringWithFormat:
-            @"sqlite3 '%@' \"INSERT OR REPLACE INTO tsettings (sha1, subj, data) "
-            "VALUES (x'0000000000000000000000000000000000000000', x'00', readfile('%@'))\"",
-            trustStorePath, tmpCert];
-        int rc = system(insertSql.UTF8String);
-        [[NSFileManager defaultManager] removeItemAtPath:tmpCert error:nil];
-
-        if (rc == 0) {
-            printf("Certificate added to TrustStore on %s\n", get_device_name(device).UTF8String);
-            printf("  Reboot device for change to take effect.\n");
-        } else {
-            fprintf(stderr, "Failed to add certificate to TrustStore\n");
-            return 1;
+        /* securityd wants DER: unwrap a PEM file's first certificate */
+        NSString *pem = [[NSString alloc] initWithData:certData encoding:NSUTF8StringEncoding];
+        NSRange begin = [pem rangeOfString:@"-----BEGIN CERTIFICATE-----"];
+        NSRange end = [pem rangeOfString:@"-----END CERTIFICATE-----"];
+        if (begin.location != NSNotFound && end.location != NSNotFound && end.location > NSMaxRange(begin)) {
+            NSString *body = [pem substringWithRange:NSMakeRange(NSMaxRange(begin), end.location - NSMaxRange(begin))];
+            certData = [[NSData alloc] initWithBase64EncodedString:body
+                                                           options:NSDataBase64DecodingIgnoreUnknownCharacters];
+            if (!certData.length) {
+                fprintf(stderr, "Cannot decode PEM certificate\n");
+                return 1;
+            }
         }
-        return 0;
+
+        printf("Adding certificate to TrustStore on %s\n", get_device_name(device).UTF8String);
+        NSDictionary *cmd = @{@"op": @"trust_add", @"certs": @[[certData base64EncodedStringWithOptions:0]]};
+        return apply_setting(udid, device, cmd, allowReboot, ^BOOL {
+            char err[256];
+            if (rsim_prov_trust_add(deviceDataPath.fileSystemRepresentation, certData.bytes, certData.length,
+                                    err, sizeof(err)) != 0) {
+                fprintf(stderr, "Failed to add certificate to TrustStore: %s\n", err);
+                return NO;
+            }
+            return YES;
+        });
     }
 
     fprintf(stderr, "Unknown keychain action: %s\n", action.UTF8String);
     return 1;
 }
 
+/* ── Command: provision ── */
+
+/*
+ * Puts legacy devices into the state a profile describes, in one run:
+ *   { "privacy":      { "com.example.app": ["photos", "camera"] },
+ *     "certificates": ["certs/ca.pem"],
+ *     "content_size": "extra-large",
+ *     "location":     "51.5074,-0.1278",
+ *     "pasteboard":   "hello",
+ *     "media":        ["photos/", "clip.mov"],
+ *     "apps":         ["build/Example.app"] }
+ * "privacy" takes the privacy --manifest format; relative paths are against
+ * the profile's directory. common/rosettasim_provision.c compares each item
+ * with the device first and only what differs is applied, so a second run
+ * changes nothing. Devices are provisioned in parallel; app installs go
+ * through each device's agent one at a time afterwards.
+ */
+
+static const char *const kProvStatusNames[] = { "done", "pending", "applied", "failed" };
+
+/* A profile value as a list: a single string counts as one item */
+static NSArray *profile_list(NSDictionary *profile, NSString *key) {
+    id value = profile[key];
+    if ([value isKindOfClass:[NSString class]]) return @[value];
+    return [value isKindOfClass:[NSArray class]] ? value : @[];
+}
+
+static NSString *profile_path(NSString *base, id value) {
+    if (![value isKindOfClass:[NSString class]]) return nil;
+    NSString *path = [value stringByExpandingTildeInPath];
+    return path.isAbsolutePath ? path : [base stringByAppendingPathComponent:path];
+}
+
+/* NULL-padded C array of fileSystemRepresentations; free() it */
+static const char **c_paths(NSArray<NSString *> *paths) {
+    const char **out = calloc(paths.count + 1, sizeof(*out));
+    for (NSUInteger i = 0; i < paths.count; i++) out[i] = paths[i].fileSystemRepresentation;
+    return out;
+}
+
+/* Apply one device's pending steps, apps excepted. Certificates, content size
+ * and pasteboard go live through the agent when the device is booted. */
+static void provision_device(NSString *udid, id device, RSimProvPlan *plan, const RSimProvProfile *profile) {
+    BOOL booted = get_device_state(device) == 3;
+    NSString *detail = nil;
+
+    if (booted) {
+        NSMutableArray *certs = [NSMutableArray array];
+        for (size_t i = 0; i < plan->count; i++) {
+            RSimProvStep *s = &plan->steps[i];
+            if (s->kind != RSIM_PROV_CERT || s->status != RSIM_PROV_PENDING) continue;
+            size_t size = 0;
+            unsigned char *der = rsim_prov_read_cert(profile->certs[s->index], &size);
+            if (der) [certs addObject:[[NSData dataWithBytes:der length:size] base64EncodedStringWithOptions:0]];
+            free(der);
+        }
+        if (certs.count &&
+            [agent_request(udid, @{@"op": @"trust_add", @"certs": certs}, 6.0, &detail) isEqualToString:@"live"]) {
+            for (size_t i = 0; i < plan->count; i++)
+                if (plan->steps[i].kind == RSIM_PROV_CERT && plan->steps[i].status == RSIM_PROV_PENDING)
+                    rsim_prov_mark(&plan->steps[i], 1, "live");
+        }
+    }
+    rsim_prov_apply(plan, profile, RSIM_PROV_FILE_KINDS);
+
+    NSString *prefsPath = [[NSString stringWithUTF8String:plan->root]
+        stringByAppendingPathComponent:@"Library/Preferences/com.apple.Accessibility.plist"];
+    for (size_t i = 0; i < plan->count; i++) {
+        RSimProvStep *s = &plan->steps[i];
+        if (s->status != RSIM_PROV_PENDING) continue;
+        NSDictionary *cmd = nil;
+        switch (s->kind) {
+        case RSIM_PROV_CONTENT_SIZE:
+            cmd = @{@"op": @"content_size", @"value": @(profile->content_size)};
+            break;
+        case RSIM_PROV_LOCATION:
+            cmd = @{@"op": @"location", @"lat": @(profile->lat), @"lon": @(profile->lon)};
+            break;
+        case RSIM_PROV_PASTEBOARD:
+            cmd = @{@"op": @"pasteboard", @"value": @(profile->pasteboard)};
+            break;
+        default:
+            continue;
+        }
+
+        NSString *status = booted ? agent_request(udid, cmd, 6.0, &detail) : nil;
+        if ([status isEqualToString:@"live"]) {
+            rsim_prov_mark(s, 1, "live");
+        } else if (s->kind == RSIM_PROV_CONTENT_SIZE) {
+            /* The plist is read at boot, so this one has an offline path */
+            BOOL ok = write_content_size(prefsPath, cmd[@"value"]);
+            rsim_prov_mark(s, ok, !ok ? "can't write com.apple.Accessibility.plist" :
+                                  booted ? "on disk; takes effect at next boot" : NULL);
+        } else if ([status isEqualToString:@"failed"]) {
+            rsim_prov_mark(s, 0, detail.UTF8String);
+        } else {
+            /* Stays pending and is retried by the next run */
+            snprintf(s->note, sizeof(s->note), "%s",
+                     !booted ? "device not booted" :
+                     status ? [NSString stringWithFormat:@"%@ (%@)", status, detail].UTF8String
+                            : "sim_app_installer did not answer");
+        }
+    }
+}
+
+static int cmd_provision(NSArray<NSString *> *udids, NSString *profilePath, BOOL dryRun) {
+    NSData *data = [NSData dataWithContentsOfFile:profilePath];
+    NSDictionary *json = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    if (![json isKindOfClass:[NSDictionary class]]) {
+        fprintf(stderr, "Can't read profile %s (expected a JSON object)\n", profilePath.UTF8String);
+        return 1;
+    }
+    NSString *base = [[profilePath stringByStandardizingPath] stringByDeletingLastPathComponent];
+    NSFileManager *fm = [NSFileManager defaultManager];
+
+    /* Profile → plain values; everything is checked before any device is touched */
+    NSArray<NSDictionary *> *privacy = json[@"privacy"] ? privacy_changes(nil, nil, nil, json[@"privacy"]) : @[];
+    if (!privacy) return 1;
+
+    NSMutableArray<NSString *> *certs = [NSMutableArray array];
+    for (id c in profile_list(json, @"certificates")) {
+        NSString *path = profile_path(base, c);
+        if (!path || ![fm fileExistsAtPath:path]) {
+            fprintf(stderr, "Certificate file not found: %s\n", [[c description] UTF8String]);
+            return 1;
+        }
+        [certs addObject:path];
+    }
+
+    NSMutableArray<NSString *> *media = [NSMutableArray array];
+    for (id m in profile_list(json, @"media")) {
+        NSString *path = profile_path(base, m);
+        BOOL isDir = NO;
+        if (!path || ![fm fileExistsAtPath:path isDirectory:&isDir]) {
+            fprintf(stderr, "Media not found: %s\n", [[m description] UTF8String]);
+            return 1;
+        }
+        if (!isDir) {
+            [media addObject:path];
+            continue;
+        }
+        for (NSString *name in [[fm contentsOfDirectoryAtPath:path error:nil] sortedArrayUsingSelector:@selector(compare:)]) {
+            NSString *file = [path stringByAppendingPathComponent:name];
+            if (![name hasPrefix:@"."] && [fm fileExistsAtPath:file isDirectory:&isDir] && !isDir) [media addObject:file];
+        }
+    }
+
+    NSString *category = nil;
+    if (json[@"content_size"]) {
+        category = [json[@"content_size"] isKindOfClass:[NSString class]] ? content_size_category(json[@"content_size"]) : nil;
+        if (!category) {
+            fprintf(stderr, "Unknown content size: %s\n", [[json[@"content_size"] description] UTF8String]);
+            return 1;
+        }
+    }
+
+    RSimProvProfile profile = {0};
+    id location = json[@"location"];
+    if ([location isKindOfClass:[NSString class]]) {
+        profile.has_location = sscanf([location UTF8String], "%lf,%lf", &profile.lat, &profile.lon) == 2;
+    } else if ([location isKindOfClass:[NSArray class]] && [location count] == 2) {
+        profile.lat = [location[0] doubleValue];
+        profile.lon = [location[1] doubleValue];
+        profile.has_location = 1;
+    }
+    if (location && !profile.has_location) {
+        fprintf(stderr, "Invalid location: %s (expected \"lat,lon\" or [lat, lon])\n", [[location description] UTF8String]);
+        return 1;
+    }
+
+    NSString *pasteboard = json[@"pasteboard"];
+    if (pasteboard && ![pasteboard isKindOfClass:[NSString class]]) {
+        fprintf(stderr, "pasteboard must be a string\n");
+        return 1;
+    }
+
+    NSMutableArray<NSString *> *appPaths = [NSMutableArray array];
+    NSMutableArray<NSDictionary *> *appInfos = [NSMutableArray array];
+    for (id a in profile_list(json, @"apps")) {
+        NSString *path = profile_path(base, a);
+        NSDictionary *info = path ? [NSDictionary dictionaryWithContentsOfFile:
+                                     [path stringByAppendingPathComponent:@"Info.plist"]] : nil;
+        if (![info[@"CFBundleIdentifier"] isKindOfClass:[NSString class]]) {
+            fprintf(stderr, "Not an app bundle: %s\n", [[a description] UTF8String]);
+            return 1;
+        }
+        [appPaths addObject:path];
+        [appInfos addObject:info];
+    }
+
+    /* Devices: lookups stay on this thread */
+    id deviceSet = get_device_set();
+    if (!deviceSet) return 1;
+    int ret = 0;
+    NSMutableArray<NSString *> *targets = [NSMutableArray array];
+    NSMutableArray *devices = [NSMutableArray array];
+    for (NSString *udid in udids) {
+        id device = find_device(deviceSet, udid);
+        if (!device) {
+            fprintf(stderr, "Device not found: %s\n", udid.UTF8String);
+            ret = 1;
+        } else if (!is_legacy_runtime(get_runtime_id(device))) {
+            fprintf(stderr, "%s: not a legacy device; use simctl for native runtimes\n", udid.UTF8String);
+            ret = 1;
+        } else {
+            [targets addObject:udid];
+            [devices addObject:device];
+        }
+    }
+    if (!targets.count) return 1;
+
+    RSimTccChange *batch = tcc_batch(privacy);
+    const char **certPaths = c_paths(certs), **mediaPaths = c_paths(media);
+    RSimProvApp *apps = calloc(appPaths.count + 1, sizeof(*apps));
+    for (NSUInteger i = 0; i < appPaths.count; i++) {
+        NSString *version = appInfos[i][@"CFBundleVersion"];
+        apps[i] = (RSimProvApp){ [appInfos[i][@"CFBundleIdentifier"] UTF8String],
+                                 [version isKindOfClass:[NSString class]] ? version.UTF8String : NULL,
+                                 appPaths[i].fileSystemRepresentation };
+    }
+    profile.privacy = batch;
+    profile.privacy_count = privacy.count;
+    profile.certs = certPaths;
+    profile.cert_count = certs.count;
+    profile.content_size = category.UTF8String;
+    profile.pasteboard = pasteboard.UTF8String;
+    profile.media = mediaPaths;
+    profile.media_count = media.count;
+    profile.apps = apps;
+    profile.app_count = appPaths.count;
+
+    /* Plan and apply, one device per worker */
+    NSUInteger n = targets.count;
+    RSimProvPlan *plans = calloc(n, sizeof(*plans));
+    double *ms = calloc(n, sizeof(*ms));
+    NSMutableArray<NSString *> *errors = [NSMutableArray arrayWithCapacity:n];
+    for (NSUInteger i = 0; i < n; i++) [errors addObject:@""];
+    double start = now_epoch();
+    dispatch_apply(n, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) { @autoreleasepool {
+        NSString *udid = targets[i];
+        double t0 = now_epoch();
+        NSString *root = [NSString stringWithFormat:@"%@/Library/Developer/CoreSimulator/Devices/%@/data",
+                          NSHomeDirectory(), udid];
+
+        /* Facts the plan engine can't read itself */
+        NSString *current = [NSDictionary dictionaryWithContentsOfFile:[root stringByAppendingPathComponent:
+            @"Library/Preferences/com.apple.Accessibility.plist"]][@"PreferredContentSizeCategoryName"];
+        NSDictionary *lsMap = read_ls_map(udid) ?: [NSDictionary dictionaryWithContentsOfFile:
+            [root stringByAppendingPathComponent:@ROSETTASIM_DEV_INSTALLED_APPS]];
+        NSDictionary *user = [lsMap[@"User"] isKindOfClass:[NSDictionary class]] ? lsMap[@"User"] : @{};
+        RSimProvApp *installed = calloc(user.count + 1, sizeof(*installed));
+        size_t count = 0;
+        for (NSString *bid in user) {
+            NSDictionary *info = user[bid];
+            id version = [info isKindOfClass:[NSDictionary class]] ? info[@"CFBundleVersion"] : nil;
+            if (!version && [info isKindOfClass:[NSDictionary class]] && [info[@"Path"] isKindOfClass:[NSString class]])
+                version = [NSDictionary dictionaryWithContentsOfFile:
+                           [info[@"Path"] stringByAppendingPathComponent:@"Info.plist"]][@"CFBundleVersion"];
+            installed[count++] = (RSimProvApp){ bid.UTF8String,
+                                                [version isKindOfClass:[NSString class]] ? [version UTF8String] : NULL,
+                                                NULL };
+        }
+        RSimProvFacts facts = { [current isKindOfClass:[NSString class]] ? current.UTF8String : NULL,
+                                installed, count };
+
+        char err[256] = "";
+        if (rsim_prov_plan(&plans[i], root.fileSystemRepresentation, &profile, &facts, err, sizeof(err)) != 0) {
+            @synchronized (errors) { errors[i] = [NSString stringWithUTF8String:err]; }
+        } else if (!dryRun) {
+            provision_device(udid, devices[i], &plans[i], &profile);
+        }
+        free(installed);
+        ms[i] = (now_epoch() - t0) * 1000.0;
+    }});
+
+    /* Apps: installs share the device's command slot, so one at a time */
+    for (NSUInteger i = 0; i < n && !dryRun; i++) {
+        BOOL booted = get_device_state(devices[i]) == 3;
+        for (size_t k = 0; k < plans[i].count; k++) {
+            RSimProvStep *s = &plans[i].steps[k];
+            if (s->kind != RSIM_PROV_APP || s->status != RSIM_PROV_PENDING || errors[i].length) continue;
+            if (!booted) {
+                snprintf(s->note, sizeof(s->note), "device not booted");
+                continue;
+            }
+            int rc = cmd_install(targets[i], appPaths[s->index]);
+            rsim_prov_mark(s, rc == 0, rc == 0 ? NULL : "install failed");
+        }
+    }
+
+    for (NSUInteger i = 0; i < n; i++) {
+        RSimProvPlan *plan = &plans[i];
+        printf("%s (%s):", get_device_name(devices[i]).UTF8String, targets[i].UTF8String);
+        if (errors[i].length) {
+            printf(" %s\n", errors[i].UTF8String);
+            ret = 1;
+            continue;
+        }
+        size_t counts[4];
+        rsim_prov_counts(plan, counts);
+        if (dryRun) {
+            printf(" %zu step%s, %zu to apply\n", plan->count, plan->count == 1 ? "" : "s",
+                   counts[RSIM_PROV_PENDING]);
+        } else {
+            if (rsim_prov_save_state(plan) != 0) fprintf(stderr, "  warning: can't write " RSIM_PROV_STATE_FILE "\n");
+            printf(" %zu done, %zu applied, %zu pending, %zu failed in %.0fms\n",
+                   counts[RSIM_PROV_DONE], counts[RSIM_PROV_APPLIED], counts[RSIM_PROV_PENDING],
+                   counts[RSIM_PROV_FAILED], ms[i]);
+            if (counts[RSIM_PROV_FAILED]) ret = 1;
+        }
+        for (size_t k = 0; k < plan->count; k++) {
+            const RSimProvStep *s = &plan->steps[k];
+            if (s->status == RSIM_PROV_DONE) continue;
+            printf("  %-8s %-12s %s%s%s%s%s\n", dryRun ? "apply" : kProvStatusNames[s->status],
+                   rsim_prov_kind_name(s->kind), s->key, s->key[0] ? " " : "", s->value,
+                   s->note[0] ? "  — " : "", s->note);
+        }
+        rsim_prov_free(plan);
+    }
+    if (n > 1) printf("%lu devices in %.1fs\n", (unsigned long)n, now_epoch() - start);
+
+    free(plans);
+    free(ms);
+    free(apps);
+    free(certPaths);
+    free(mediaPaths);
+    free(batch);
+    return ret;
+}
+
 /* ── Command: pbcopy ── */
 
 static int cmd_pbcopy(NSString *udid) {
@@ -2224,7 +5087,7 @@ static void usage(void) {
         "\tclone               Clone an existing device.\n"
         "\tcreate              Create a new device.\n"
         "\tdelete              Delete specified devices, unavailable devices, or all devices.\n"
-        "\tdiagnose            Collect diagnostic info for the Simulator.\n"
+        "\tdiagnose            Collect rosettasim logs, frames and crash logs into one capped zip (rosettasim extension).\n"
         "\terase               Erase a device's contents and settings.\n"
         "\tget_app_container   Print the path of the installed app's container\n"
         "\tgetenv              Print an environment variable from a running device.\n"
@@ -2232,17 +5095,17 @@ static void usage(void) {
         "\tinstall             Install an app on a device.\n"
         "\tio                  Set up a device IO operation.\n"
         "\tkeychain            Manipulate a device's keychain.\n"
-        "\tlaunch              Launch an application by identifier on a device.\n"
+        "\tlaunch              Launch an application by identifier on a device (--measure: launch timing).\n"
         "\tlist                List available devices, device types, runtimes, or device pairs.\n"
         "\tlistapps            Show the installed applications.\n"
-        "\tlocation            Control a device's simulated location.\n"
+        "\tlocation            Control a device's simulated location; play GPX routes in-sim.\n"
         "\tlogverbose          enable or disable verbose logging for a device\n"
         "\topenurl             Open a URL in a device.\n"
         "\tpbcopy              Copy standard input onto the device pasteboard.\n"
         "\tpbpaste             Print the contents of the device pasteboard.\n"
         "\tpbsync              Sync the pasteboard content.\n"
-        "\tprivacy             Grant, revoke, or reset privacy permissions.\n"
-        "\tpush                Send a simulated push notification.\n"
+        "\tprivacy             Grant, revoke, or reset privacy permissions (several devices, --manifest).\n"
+        "\tpush                Send a simulated push notification, or a rate-paced batch (--batch).\n"
         "\trename              Rename a device.\n"
         "\tshutdown            Shutdown a device.\n"
         "\tspawn               Spawn a process by executing a given executable on a device.\n"
@@ -2252,6 +5115,17 @@ static void usage(void) {
         "\ttouch               Send a touch event to a device (rosettasim extension).\n"
         "\tsendtext            Send text input to a device (rosettasim extension).\n"
         "\tkeyevent            Send a HID key event to a device (rosettasim extension).\n"
+        "\tfind                Locate a template image on screen (rosettasim extension).\n"
+        "\ttapon               Tap the best match of a template image (rosettasim extension).\n"
+        "\tpixel               Read a framebuffer pixel (rosettasim extension).\n"
+        "\tregion              Read stats or raw bytes of a framebuffer region (rosettasim extension).\n"
+        "\tphash               Show or wait for the perceptual hash of the screen (rosettasim extension).\n"
+        "\tbaseline            Store, look up and garbage-collect screenshot baselines (rosettasim extension).\n"
+        "\tmonkey              Explore the UI with random input, or replay a trace (rosettasim extension).\n"
+        "\tlogs                Show or follow the device's rosettasim and system logs, merged (rosettasim extension).\n"
+        "\tprewarm             Pre-translate a legacy runtime's binaries for a faster first boot (rosettasim extension).\n"
+        "\thangs               Show main-thread hangs recorded in apps, or opt an app in (rosettasim extension).\n"
+        "\tprovision           Bring devices to the state a profile describes, idempotently (rosettasim extension).\n"
         "\tui                  Get or set UI options.\n"
         "\tuninstall           Uninstall an app from a device.\n"
         "\n"
@@ -2278,8 +5152,9 @@ int main(int argc, const char *argv[]) {
             return passthrough_to_simctl(argc, argv);
         }
         else if ([cmd isEqualToString:@"boot"]) {
-            if (argc < 3) { fprintf(stderr, "Usage: rosettasim-ctl boot <UDID>\n"); return 1; }
-            return cmd_boot([NSString stringWithUTF8String:argv[2]]);
+            if (argc < 3) { fprintf(stderr, "Usage: rosettasim-ctl boot <UDID> [--measure]\n"); return 1; }
+            return cmd_boot([NSString stringWithUTF8String:argv[2]],
+                            argc > 3 && strcmp(argv[3], "--measure") == 0);
         }
         else if ([cmd isEqualToString:@"shutdown"]) {
             if (argc < 3) { fprintf(stderr, "Usage: rosettasim-ctl shutdown <UDID|all>\n"); return 1; }
@@ -2291,14 +5166,43 @@ int main(int argc, const char *argv[]) {
                               [NSString stringWithUTF8String:argv[3]]);
         }
         else if ([cmd isEqualToString:@"launch"]) {
-            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl launch <UDID> <bundle-id>\n"); return 1; }
+            if (argc < 4) {
+                fprintf(stderr, "Usage: rosettasim-ctl launch <UDID> <bundle-id>\n"
+                                "       rosettasim-ctl launch <UDID> <bundle-id> --measure [--runs=<n>]"
+                                " [--settle=<ms>] [--timeout=<s>] [--json]\n");
+                return 1;
+            }
+            BOOL measure = NO, json = NO;
+            int runs = 5;
+            double settle = 750.0, timeout = 30.0;
+            for (int i = 4; i < argc; i++) {
+                if (strcmp(argv[i], "--measure") == 0) measure = YES;
+                else if (strcmp(argv[i], "--json") == 0) json = YES;
+                else if (strncmp(argv[i], "--runs=", 7) == 0) runs = atoi(argv[i] + 7);
+                else if (strncmp(argv[i], "--settle=", 9) == 0) settle = atof(argv[i] + 9);
+                else if (strncmp(argv[i], "--timeout=", 10) == 0) timeout = atof(argv[i] + 10);
+            }
+            if (runs > LAUNCH_MAX_RUNS) {
+                fprintf(stderr, "--runs: at most %d\n", LAUNCH_MAX_RUNS);
+                return 1;
+            }
+            if (measure)
+                return cmd_launch_measure(resolve_device_arg(argv[2]), [NSString stringWithUTF8String:argv[3]],
+                                          runs > 0 ? runs : 1, settle, timeout, json);
             return cmd_launch([NSString stringWithUTF8String:argv[2]],
                              [NSString stringWithUTF8String:argv[3]]);
         }
         else if ([cmd isEqualToString:@"screenshot"]) {
-            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl screenshot <UDID> <output.png>\n"); return 1; }
+            if (argc < 4) {
+                fprintf(stderr, "Usage: rosettasim-ctl screenshot <UDID> <output.png|.jpg>"
+                                " [--rect x,y,w,h] [--scale 0.5|0.25] [--rotate auto|0|90|180|270]"
+                                " [--format png|jpeg] [--quality N]\n");
+                return 1;
+            }
+            NSMutableArray *encodeArgs = [NSMutableArray array];
+            for (int i = 4; i < argc; i++) [encodeArgs addObject:[NSString stringWithUTF8String:argv[i]]];
             return cmd_screenshot([NSString stringWithUTF8String:argv[2]],
-                                 [NSString stringWithUTF8String:argv[3]]);
+                                 [NSString stringWithUTF8String:argv[3]], encodeArgs);
         }
         else if ([cmd isEqualToString:@"listapps"]) {
             if (argc < 3) { fprintf(stderr, "Usage: rosettasim-ctl listapps <UDID>\n"); return 1; }
@@ -2344,7 +5248,33 @@ int main(int argc, const char *argv[]) {
             return passthrough_to_simctl(argc, argv);
         }
         else if ([cmd isEqualToString:@"diagnose"]) {
-            return passthrough_to_simctl(argc, argv);
+            /* --simctl: Apple's own bundle (no rosettasim artifacts) */
+            if (argc >= 3 && strcmp(argv[2], "--simctl") == 0) {
+                NSMutableArray *args = [@[@"xcrun", @"simctl", @"diagnose"] mutableCopy];
+                for (int i = 3; i < argc; i++) [args addObject:[NSString stringWithUTF8String:argv[i]]];
+                return run_with_timeout(args, 600);
+            }
+            NSMutableArray<NSString *> *udids = [NSMutableArray array];
+            NSString *output = nil;
+            int frames = 5, level = 1, jobs = (int)[NSProcessInfo processInfo].activeProcessorCount;
+            long long maxMB = 200;
+            for (int i = 2; i < argc; i++) {
+                if (strncmp(argv[i], "--output=", 9) == 0) output = [NSString stringWithUTF8String:argv[i] + 9];
+                else if (strncmp(argv[i], "--next-frames=", 14) == 0) frames = atoi(argv[i] + 14);
+                else if (strncmp(argv[i], "--max-size=", 11) == 0) maxMB = atoll(argv[i] + 11);
+                else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+                else if (strncmp(argv[i], "--level=", 8) == 0) level = atoi(argv[i] + 8);
+                else if (argv[i][0] != '-' && resolve_device_arg(argv[i])) [udids addObject:resolve_device_arg(argv[i])];
+                else {
+                    fprintf(stderr, "Usage: rosettasim-ctl diagnose [<UDID>...] [--output=<file.zip>] [--next-frames=<n>]\n"
+                                    "           [--max-size=<MB>] [--jobs=<n>] [--level=<1-9>]\n"
+                                    "       --next-frames: the current frame and up to n-1 published in the next second\n"
+                                    "       rosettasim-ctl diagnose --simctl [simctl diagnose options]\n");
+                    return 1;
+                }
+            }
+            if (level < 1 || level > 9) level = 1;
+            return cmd_diagnose(udids, output, frames, maxMB << 20, jobs, level);
         }
         else if ([cmd isEqualToString:@"appinfo"]) {
             if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl appinfo <UDID> <bundle-id>\n"); return 1; }
@@ -2352,11 +5282,23 @@ int main(int argc, const char *argv[]) {
                               [NSString stringWithUTF8String:argv[3]]);
         }
         else if ([cmd isEqualToString:@"privacy"]) {
-            if (argc < 5) { fprintf(stderr, "Usage: rosettasim-ctl privacy <UDID> <grant|revoke|reset> <service> [bundle-id]\n"); return 1; }
-            return cmd_privacy(resolve_device_arg(argv[2]),
-                              [NSString stringWithUTF8String:argv[3]],
-                              [NSString stringWithUTF8String:argv[4]],
-                              argc > 5 ? [NSString stringWithUTF8String:argv[5]] : nil);
+            /* <UDID>[,<UDID>...] — one pass over several devices */
+            NSString *manifest = nil;
+            NSMutableArray *pos = [NSMutableArray array];
+            for (int i = 3; i < argc; i++) {
+                if (strncmp(argv[i], "--manifest=", 11) == 0) manifest = [NSString stringWithUTF8String:argv[i] + 11];
+                else [pos addObject:[NSString stringWithUTF8String:argv[i]]];
+            }
+            if (argc < 4 || (!manifest && pos.count < 2)) {
+                fprintf(stderr, "Usage: rosettasim-ctl privacy <UDID>[,<UDID>...] <grant|revoke|reset> <service> [bundle-id]\n"
+                                "       rosettasim-ctl privacy <UDID>[,<UDID>...] --manifest=<file.json>\n");
+                return 1;
+            }
+            NSMutableArray *udids = [NSMutableArray array];
+            for (NSString *arg in [[NSString stringWithUTF8String:argv[2]] componentsSeparatedByString:@","])
+                if (arg.length) [udids addObject:resolve_device_arg(arg.UTF8String)];
+            return cmd_privacy(udids, manifest ? nil : pos[0], manifest ? nil : pos[1],
+                               !manifest && pos.count > 2 ? pos[2] : nil, manifest);
         }
         else if ([cmd isEqualToString:@"getenv"]) {
             if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl getenv <UDID> <variable>\n"); return 1; }
@@ -2364,14 +5306,17 @@ int main(int argc, const char *argv[]) {
                              [NSString stringWithUTF8String:argv[3]]);
         }
         else if ([cmd isEqualToString:@"addmedia"]) {
-            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl addmedia <UDID> <file> [file...]\n"); return 1; }
+            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl addmedia <UDID> [--jobs=N] <file|dir> [file...]\n"); return 1; }
             NSMutableArray *files = [NSMutableArray new];
-            for (int i = 3; i < argc; i++)
-                [files addObject:[NSString stringWithUTF8String:argv[i]]];
-            return cmd_addmedia(resolve_device_arg(argv[2]), files);
+            int jobs = 0;
+            for (int i = 3; i < argc; i++) {
+                if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+                else [files addObject:[NSString stringWithUTF8String:argv[i]]];
+            }
+            return cmd_addmedia(resolve_device_arg(argv[2]), files, jobs);
         }
         else if ([cmd isEqualToString:@"location"]) {
-            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl location <UDID> set <lat>,<lon>\n"); return 1; }
+            if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl location <UDID> set <lat>,<lon> | clear | route <file.gpx>\n"); return 1; }
             return cmd_location(resolve_device_arg(argv[2]), argc, argv);
         }
         else if ([cmd isEqualToString:@"push"]) {
@@ -2395,6 +5340,19 @@ int main(int argc, const char *argv[]) {
             if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl keychain <UDID> <reset|add-root-cert|add-cert> [cert]\n"); return 1; }
             return cmd_keychain(resolve_device_arg(argv[2]), argc, argv);
         }
+        else if ([cmd isEqualToString:@"provision"]) {
+            NSString *profile = nil;
+            for (int i = 3; i < argc; i++)
+                if (strncmp(argv[i], "--profile=", 10) == 0) profile = [NSString stringWithUTF8String:argv[i] + 10];
+            if (argc < 4 || !profile) {
+                fprintf(stderr, "Usage: rosettasim-ctl provision <UDID>[,<UDID>...] --profile=<profile.json> [--dry-run]\n");
+                return 1;
+            }
+            NSMutableArray *udids = [NSMutableArray array];
+            for (NSString *arg in [[NSString stringWithUTF8String:argv[2]] componentsSeparatedByString:@","])
+                if (arg.length) [udids addObject:resolve_device_arg(arg.UTF8String)];
+            return cmd_provision(udids, profile, has_flag(argc, argv, "--dry-run"));
+        }
         else if ([cmd isEqualToString:@"pbcopy"]) {
             if (argc < 3) { fprintf(stderr, "Usage: echo text | rosettasim-ctl pbcopy <UDID>\n"); return 1; }
             return cmd_pbcopy(resolve_device_arg(argv[2]));
@@ -2440,6 +5398,200 @@ int main(int argc, const char *argv[]) {
             return cmd_keyevent(resolve_device_arg(argv[2]),
                                (uint32_t)atoi(argv[3]), (uint32_t)atoi(argv[4]));
         }
+        else if ([cmd isEqualToString:@"find"] || [cmd isEqualToString:@"tapon"]) {
+            if (argc < 4) {
+                fprintf(stderr, "Usage: rosettasim-ctl %s <UDID> <template.png> [--threshold=<0-1>]%s\n",
+                        argv[1], [cmd isEqualToString:@"find"] ? " [--all]" : "");
+                return 1;
+            }
+            float threshold = 0.9f;
+            BOOL all = NO;
+            for (int i = 4; i < argc; i++) {
+                if (strncmp(argv[i], "--threshold=", 12) == 0)
+                    threshold = atof(argv[i] + 12);
+                else if (strcmp(argv[i], "--all") == 0)
+                    all = YES;
+            }
+            NSString *templatePath = [NSString stringWithUTF8String:argv[3]];
+            if ([cmd isEqualToString:@"tapon"])
+                return cmd_tapon(resolve_device_arg(argv[2]), templatePath, threshold);
+            return cmd_find(resolve_device_arg(argv[2]), templatePath, threshold, all);
+        }
+        else if ([cmd isEqualToString:@"pixel"] || [cmd isEqualToString:@"region"]) {
+            BOOL isRegion = [cmd isEqualToString:@"region"];
+            int npos = isRegion ? 4 : 2;
+            if (argc < 3 + npos) {
+                if (isRegion)
+                    fprintf(stderr, "Usage: rosettasim-ctl region <UDID> <x> <y> <w> <h> [--stats|--raw] [--px]\n"
+                                    "         [--wait-until=uniform|nonuniform|changed|#RRGGBB] [--tolerance=<n>] [--timeout=<s>]\n");
+                else
+                    fprintf(stderr, "Usage: rosettasim-ctl pixel <UDID> <x> <y> [--px]\n"
+                                    "         [--wait-until=#RRGGBB] [--tolerance=<n>] [--timeout=<s>]\n");
+                return 1;
+            }
+            double v[4] = {0};
+            for (int i = 0; i < npos; i++) v[i] = atof(argv[3 + i]);
+            WaitSpec spec = { .kind = WAIT_NONE, .tolerance = 8, .timeout_s = 10.0 };
+            BOOL pixels = NO, raw = NO;
+            for (int i = 3 + npos; i < argc; i++) {
+                if (strcmp(argv[i], "--px") == 0) pixels = YES;
+                else if (strcmp(argv[i], "--raw") == 0) raw = YES;
+                else if (strcmp(argv[i], "--stats") == 0) raw = NO;
+                else if (strncmp(argv[i], "--tolerance=", 12) == 0) spec.tolerance = atoi(argv[i] + 12);
+                else if (strncmp(argv[i], "--timeout=", 10) == 0) spec.timeout_s = atof(argv[i] + 10);
+                else if (strncmp(argv[i], "--wait-until=", 13) == 0) {
+                    if (!parse_wait_spec(argv[i] + 13, &spec) || (!isRegion && spec.kind != WAIT_COLOR)) {
+                        fprintf(stderr, "Unknown --wait-until predicate: %s\n", argv[i] + 13);
+                        return 1;
+                    }
+                }
+            }
+            if (isRegion)
+                return cmd_region(resolve_device_arg(argv[2]), v[0], v[1], v[2], v[3], pixels, raw, &spec);
+            return cmd_pixel(resolve_device_arg(argv[2]), v[0], v[1], pixels, &spec);
+        }
+        else if ([cmd isEqualToString:@"phash"]) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: rosettasim-ctl phash <UDID> [--history]\n"
+                                "         [--wait-until=<hash>] [--max-distance=<bits>] [--timeout=<s>]\n");
+                return 1;
+            }
+            BOOL history = NO, waiting = NO;
+            uint64_t target = 0;
+            int maxDistance = 4;
+            double timeout = 10.0;
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "--history") == 0) history = YES;
+                else if (strncmp(argv[i], "--max-distance=", 15) == 0) maxDistance = atoi(argv[i] + 15);
+                else if (strncmp(argv[i], "--timeout=", 10) == 0) timeout = atof(argv[i] + 10);
+                else if (strncmp(argv[i], "--wait-until=", 13) == 0) {
+                    if (rsim_hash_parse(argv[i] + 13, &target) != 0) {
+                        fprintf(stderr, "Invalid hash: %s (expected up to 16 hex digits)\n", argv[i] + 13);
+                        return 1;
+                    }
+                    waiting = YES;
+                }
+            }
+            return cmd_phash(resolve_device_arg(argv[2]), history, waiting, target, maxDistance, timeout);
+        }
+        else if ([cmd isEqualToString:@"baseline"]) {
+            NSString *action = argc >= 3 ? [NSString stringWithUTF8String:argv[2]] : nil;
+            BOOL needsTarget = [action isEqualToString:@"save"] || [action isEqualToString:@"closest"];
+            if (!action || (needsTarget && argc < 4) ||
+                ([action isEqualToString:@"save"] && argc < 5)) {
+                fprintf(stderr, "Usage: rosettasim-ctl baseline save <UDID> <name>\n"
+                                "       rosettasim-ctl baseline closest <UDID|image.png> [--name=<name>] [--max=<n>]\n"
+                                "       rosettasim-ctl baseline list [--name=<name>]\n"
+                                "       rosettasim-ctl baseline gc [--older-than=<days>]\n"
+                                "       (all: [--store=<dir>], default $ROSETTASIM_BASELINES or\n"
+                                "        ~/Library/Caches/RosettaSim/baselines)\n");
+                return 1;
+            }
+            NSString *target = nil, *name = nil, *store = nil;
+            int max = 5, first = 3;
+            double olderThan = 30.0;
+            if (needsTarget) {
+                target = resolve_device_arg(argv[3]);   /* image paths pass through */
+                first = 4;
+            }
+            if ([action isEqualToString:@"save"]) {
+                name = [NSString stringWithUTF8String:argv[4]];
+                first = 5;
+            }
+            for (int i = first; i < argc; i++) {
+                if (strncmp(argv[i], "--name=", 7) == 0) name = [NSString stringWithUTF8String:argv[i] + 7];
+                else if (strncmp(argv[i], "--store=", 8) == 0) store = [NSString stringWithUTF8String:argv[i] + 8];
+                else if (strncmp(argv[i], "--max=", 6) == 0) max = atoi(argv[i] + 6);
+                else if (strncmp(argv[i], "--older-than=", 13) == 0) olderThan = atof(argv[i] + 13);
+            }
+            return cmd_baseline(action, target, name, store, max, olderThan);
+        }
+        else if ([cmd isEqualToString:@"monkey"]) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: rosettasim-ctl monkey <UDID> [--seed=<n>] [--actions=<n>] [--duration=<s>]\n"
+                                "         [--rate=<actions/s>] [--settle=<ms>] [--weights=<tap>,<swipe>,<text>]\n"
+                                "         [--trace=<file.jsonl>]\n"
+                                "       rosettasim-ctl monkey <UDID> --replay=<file.jsonl> [--rate=<actions/s>]\n");
+                return 1;
+            }
+            uint64_t seed = (uint64_t)time(NULL);
+            int actions = 0, weights[RSIM_MONKEY_TYPES];
+            BOOL customWeights = NO;
+            /* With the default mix an action takes about 64ms of gesture, a few
+             * of pickup and up to the 50ms settle (three 60Hz frames): about
+             * 8.5/s when nothing reacts, so 8/s is a rate every run can keep */
+            double duration = 0, rate = 8.0, settle = 50.0;
+            NSString *trace = nil, *replay = nil;
+            for (int i = 3; i < argc; i++) {
+                if (strncmp(argv[i], "--seed=", 7) == 0) seed = strtoull(argv[i] + 7, NULL, 10);
+                else if (strncmp(argv[i], "--actions=", 10) == 0) actions = atoi(argv[i] + 10);
+                else if (strncmp(argv[i], "--duration=", 11) == 0) duration = atof(argv[i] + 11);
+                else if (strncmp(argv[i], "--rate=", 7) == 0) rate = atof(argv[i] + 7);
+                else if (strncmp(argv[i], "--settle=", 9) == 0) settle = atof(argv[i] + 9);
+                else if (strncmp(argv[i], "--trace=", 8) == 0) trace = [NSString stringWithUTF8String:argv[i] + 8];
+                else if (strncmp(argv[i], "--replay=", 9) == 0) replay = [NSString stringWithUTF8String:argv[i] + 9];
+                else if (strncmp(argv[i], "--weights=", 10) == 0) {
+                    if (sscanf(argv[i] + 10, "%d,%d,%d", &weights[0], &weights[1], &weights[2]) != 3) {
+                        fprintf(stderr, "Invalid weights: %s (expected tap,swipe,text)\n", argv[i] + 10);
+                        return 1;
+                    }
+                    customWeights = YES;
+                }
+            }
+            if (!actions && duration <= 0 && !replay) actions = 500;
+            return cmd_monkey(resolve_device_arg(argv[2]), seed, actions, duration, rate, settle,
+                              trace, replay, customWeights ? weights : NULL);
+        }
+        else if ([cmd isEqualToString:@"logs"]) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: rosettasim-ctl logs <UDID> [--follow|-f] [--grep=<regex>] [-i]"
+                                " [--lines=<n>] [--file=<path>]...\n");
+                return 1;
+            }
+            BOOL follow = NO, ignoreCase = NO;
+            int lines = 20;
+            const char *pattern = NULL;
+            NSMutableArray<NSString *> *files = [NSMutableArray array];
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "--follow") == 0 || strcmp(argv[i], "-f") == 0) follow = YES;
+                else if (strcmp(argv[i], "-i") == 0) ignoreCase = YES;
+                else if (strncmp(argv[i], "--grep=", 7) == 0) pattern = argv[i] + 7;
+                else if (strncmp(argv[i], "--lines=", 8) == 0) lines = atoi(argv[i] + 8);
+                else if (strncmp(argv[i], "--file=", 7) == 0) [files addObject:[NSString stringWithUTF8String:argv[i] + 7]];
+            }
+            return cmd_logs(resolve_device_arg(argv[2]), follow, lines, pattern, ignoreCase, files);
+        }
+        else if ([cmd isEqualToString:@"prewarm"]) {
+            if (argc < 3) {
+                fprintf(stderr, "Usage: rosettasim-ctl prewarm <runtime|version|all> [--jobs=<n>]\n"
+                                "       rosettasim-ctl prewarm <runtime|version|all> --report\n");
+                return 1;
+            }
+            int jobs = 0;
+            BOOL report = NO;
+            for (int i = 3; i < argc; i++) {
+                if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+                else if (strcmp(argv[i], "--report") == 0) report = YES;
+            }
+            return cmd_prewarm([NSString stringWithUTF8String:argv[2]], jobs, report);
+        }
+        else if ([cmd isEqualToString:@"hangs"]) {
+            if (argc < 3 || (argc >= 4 && strcmp(argv[3], "enable") == 0 && argc < 5)) {
+                fprintf(stderr, "Usage: rosettasim-ctl hangs <UDID> [--json] [--clear]\n"
+                                "       rosettasim-ctl hangs <UDID> enable <bundle-id> [--threshold=<ms>]\n");
+                return 1;
+            }
+            NSString *enable = nil;
+            int threshold = 0;
+            BOOL json = NO, clear = NO;
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "enable") == 0 && i + 1 < argc) enable = [NSString stringWithUTF8String:argv[++i]];
+                else if (strncmp(argv[i], "--threshold=", 12) == 0) threshold = atoi(argv[i] + 12);
+                else if (strcmp(argv[i], "--json") == 0) json = YES;
+                else if (strcmp(argv[i], "--clear") == 0) clear = YES;
+            }
+            return cmd_hangs(resolve_device_arg(argv[2]), enable, threshold, json, clear);
+        }
         else if ([cmd isEqualToString:@"logverbose"]) {
             if (argc < 4) { fprintf(stderr, "Usage: rosettasim-ctl logverbose <UDID> <on|off>\n"); return 1; }
             return cmd_logverbose([NSString stringWithUTF8String:argv[2]],
@@ -2457,7 +5609,9 @@ int main(int argc, const char *argv[]) {
                 id device = deviceSet ? find_device(deviceSet, udid) : nil;
                 if (device && is_legacy_runtime(get_runtime_id(device))) {
                     NSString *output = argc >= 5 ? [NSString stringWithUTF8String:argv[4]] : @"screenshot.png";
-                    return cmd_screenshot(udid, output);
+                    NSMutableArray *encodeArgs = [NSMutableArray array];
+                    for (int i = 5; i < argc; i++) [encodeArgs addObject:[NSString stringWithUTF8String:argv[i]]];
+                    return cmd_screenshot(udid, output, encodeArgs);
                 }
             }
             return passthrough_to_simctl(argc, argv);
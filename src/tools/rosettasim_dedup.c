@@ -0,0 +1,101 @@
+/*
+ * rosettasim_dedup.c — Install runtime trees through a content-addressed store
+ *
+ * Replaces `cp -R` of RuntimeRoots in install_legacy_sim.sh. The source tree
+ * is hashed on worker threads, contents the store lacks are added once, and
+ * the destination is cloned from the store (common/rosettasim_dedup.c), so
+ * the second and later runtimes mostly cost metadata.
+ *
+ * Usage:
+ *   rosettasim_dedup [--jobs=N] [--store=<dir>] [--link] <src> <dest>
+ *   rosettasim_dedup --scan [--jobs=N] <dir> ...
+ *
+ *   <dest>     created and filled with the contents of <src> (like cp -R src/ dest/)
+ *   --store    content store (default ~/Library/Caches/RosettaSim/dedup)
+ *   --jobs     hashing / placing threads (default: online CPUs)
+ *   --link     hard-link from the store where clonefile isn't supported.
+ *              Linked files share an inode with the store: only replace
+ *              them (write + rename), never edit in place.
+ *   --scan     hash only and report how much of the trees is duplicate
+ *
+ * Plain C + POSIX, so it also builds on Linux (without clonefile: --link or
+ * copies).
+ *
+ * Build:
+ *   make dedup   (from src/)
+ */
+
+#include "common/rosettasim_dedup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static double gb(long long bytes) { return bytes / 1e9; }
+
+static int usage(void) {
+    fprintf(stderr, "Usage: rosettasim_dedup [--jobs=N] [--store=<dir>] [--link] <src> <dest>\n"
+                    "       rosettasim_dedup --scan [--jobs=N] <dir> ...\n");
+    return 2;
+}
+
+static void print_scan(const char *root, const RSimDedupStats *st) {
+    printf("%s: %zu files, %.2f GB, %zu distinct (%.2f GB) — %.0f%% duplicate, hashed in %.1fs\n",
+           root, st->files, gb(st->bytes), st->unique, gb(st->bytes_unique),
+           st->bytes ? 100.0 * (st->bytes - st->bytes_unique) / st->bytes : 0.0, st->scan_ms / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN), scan_only = 0, allow_link = 0;
+    char store[1024] = "";
+    const char *home = getenv("HOME");
+    if (home) snprintf(store, sizeof(store), "%s/Library/Caches/RosettaSim/dedup", home);
+    const char *paths[64];
+    int npaths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scan") == 0) scan_only = 1;
+        else if (strcmp(argv[i], "--link") == 0) allow_link = 1;
+        else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--store=", 8) == 0) snprintf(store, sizeof(store), "%s", argv[i] + 8);
+        else if (argv[i][0] == '-' || npaths == 64) return usage();
+        else paths[npaths++] = argv[i];
+    }
+    if (jobs < 1) jobs = 1;
+    if (scan_only ? npaths < 1 : npaths != 2 || !store[0]) return usage();
+
+    char err[512];
+    if (scan_only) {
+        int rc = 0;
+        for (int i = 0; i < npaths; i++) {
+            RSimDedupTree tree;
+            RSimDedupStats st;
+            if (rsim_dedup_scan(&tree, paths[i], jobs, &st, err, sizeof(err)) != 0) {
+                fprintf(stderr, "%s\n", err);
+                rc = 1;
+            } else {
+                print_scan(paths[i], &st);
+            }
+            rsim_dedup_free(&tree);
+        }
+        return rc;
+    }
+
+    RSimDedupTree tree;
+    RSimDedupStats st;
+    if (rsim_dedup_scan(&tree, paths[0], jobs, &st, err, sizeof(err)) != 0) {
+        fprintf(stderr, "%s\n", err);
+        rsim_dedup_free(&tree);
+        return 1;
+    }
+    print_scan(paths[0], &st);
+
+    int failed = rsim_dedup_materialize(&tree, store, paths[1], jobs, allow_link, &st);
+    rsim_dedup_free(&tree);
+    printf("%s: %zu cloned, %zu linked, %zu copied, %zu failed in %.1fs\n", paths[1],
+           st.cloned, st.linked, st.copied, st.failed, st.place_ms / 1000.0);
+    printf("Store %s: %.2f GB new; %.2f GB of %.2f GB shared instead of copied\n",
+           store, gb(st.bytes_new), gb(rsim_dedup_saved(&st)), gb(st.bytes));
+    return failed ? 1 : 0;
+}
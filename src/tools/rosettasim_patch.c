@@ -0,0 +1,389 @@
+/*
+ * rosettasim_patch.c — Add LC_LOAD_DYLIB entries to runtime binaries
+ *
+ * Native replacement for the `otool -L | grep` + `insert_dylib --inplace`
+ * + codesign dance in the deploy targets. Every slice of thin and fat
+ * binaries is patched (common/rosettasim_macho.c); a binary that already
+ * loads the dylib is left untouched, so re-running is free.
+ *
+ * Usage:
+ *   rosettasim_patch [--check] [--jobs=N] [--state=<file>]
+ *                    --add <dylib>:<binary> [--add ...] <runtime-root>[:sign] ...
+ *
+ *   --add      install name to load, and the binary relative to each root
+ *   :sign      re-sign modified binaries ad hoc (iOS 10+ runtimes enforce it)
+ *   --check    report only; exit 1 if any binary is missing a dylib
+ *   --jobs     runtime roots processed in parallel (default 4)
+ *   --state    content hashes of binaries already patched (default
+ *              ~/Library/Caches/RosettaSim/patch_state.tsv); a binary whose
+ *              hash and dylib list match is skipped without parsing
+ *
+ * Plain C + POSIX, so it also builds on Linux.
+ *
+ * Build:
+ *   make patch   (from src/)
+ */
+
+#include "common/rosettasim_macho.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define MAX_SPECS   32
+#define MAX_ROOTS   64
+
+typedef struct {
+    char        dylib[256];
+    char        binary[512];
+} PatchSpec;
+
+typedef struct {
+    char        path[1024];
+    int         sign;
+} PatchRoot;
+
+typedef struct {
+    char       *key;            /* "<path>\t<dylibs>" */
+    uint64_t    hash;
+} StateEntry;
+
+static PatchSpec        g_specs[MAX_SPECS];
+static int              g_spec_count;
+static PatchRoot        g_roots[MAX_ROOTS];
+static int              g_root_count;
+static int              g_check;
+static int              g_next_root;
+static int              g_failures;
+static int              g_missing;
+static StateEntry      *g_state;
+static size_t           g_state_count, g_state_capacity;
+static pthread_mutex_t  g_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ================================================================
+ * State file
+ * ================================================================ */
+
+/* Once the workers run, callers of state_set and state_get hold g_lock */
+static void state_set(const char *key, uint64_t hash) {
+    for (size_t i = 0; i < g_state_count; i++) {
+        if (strcmp(g_state[i].key, key) == 0) {
+            g_state[i].hash = hash;
+            return;
+        }
+    }
+    if (g_state_count == g_state_capacity) {
+        size_t cap = g_state_capacity ? g_state_capacity * 2 : 64;
+        StateEntry *grown = realloc(g_state, cap * sizeof(*grown));
+        if (!grown) return;
+        g_state = grown;
+        g_state_capacity = cap;
+    }
+    g_state[g_state_count].key = strdup(key);
+    g_state[g_state_count++].hash = hash;
+}
+
+static int state_get(const char *key, uint64_t *hash) {
+    for (size_t i = 0; i < g_state_count; i++) {
+        if (strcmp(g_state[i].key, key) == 0) {
+            *hash = g_state[i].hash;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* One line per binary: <hash hex>\t<path>\t<dylibs> */
+static void state_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char line[2048];
+    while (fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = 0;
+        char *tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = 0;
+        state_set(tab + 1, strtoull(line, NULL, 16));
+    }
+    fclose(f);
+}
+
+static void mkdir_parents(const char *path) {
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = 0;
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+}
+
+static void state_save(const char *path) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    mkdir_parents(path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    for (size_t i = 0; i < g_state_count; i++)
+        fprintf(f, "%016llx\t%s\n", (unsigned long long)g_state[i].hash, g_state[i].key);
+    if (fclose(f) == 0) rename(tmp, path);
+    else unlink(tmp);
+}
+
+/* ================================================================
+ * Patching
+ * ================================================================ */
+
+static uint8_t *read_file(const char *path, size_t *size, mode_t *mode) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    uint8_t *buf = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (buf = malloc((size_t)st.st_size))) {
+        size_t got = 0;
+        while (got < (size_t)st.st_size) {
+            ssize_t n = read(fd, buf + got, (size_t)st.st_size - got);
+            if (n <= 0) break;
+            got += (size_t)n;
+        }
+        if (got != (size_t)st.st_size) {
+            free(buf);
+            buf = NULL;
+        }
+        *size = got;
+        *mode = st.st_mode & 07777;
+    }
+    close(fd);
+    return buf;
+}
+
+/* Write next to the original, then rename over it */
+static int write_file(const char *path, const uint8_t *data, size_t size, mode_t mode) {
+    char tmp[1700];
+    snprintf(tmp, sizeof(tmp), "%s.rsimpatch", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    if (fd < 0) return -1;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    fchmod(fd, mode);
+    if (close(fd) != 0 || done != size || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int codesign(const char *path) {
+    char *argv[] = { "/usr/bin/codesign", "--force", "--sign", "-", (char *)path, NULL };
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) != 0) return -1;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) { }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/* FNV-1a over 8-byte words (tail bytewise); only compared with itself */
+static uint64_t content_hash(const uint8_t *data, size_t size) {
+    uint64_t h = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0x100000001b3ull;
+    }
+    for (; i < size; i++) h = (h ^ data[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static uint64_t file_hash(const char *path) {
+    size_t size = 0;
+    mode_t mode;
+    uint8_t *data = read_file(path, &size, &mode);
+    uint64_t h = data ? content_hash(data, size) : 0;
+    free(data);
+    return h;
+}
+
+static void report(const char *root, const char *binary, const char *fmt, const char *detail) {
+    pthread_mutex_lock(&g_lock);
+    printf("%s: %s: ", root, binary);
+    printf(fmt, detail);
+    printf("\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/* All specs for one binary under one root */
+static void patch_binary(const PatchRoot *root, const char *binary) {
+    const char *name = root->path;     /* roots often share a basename (RuntimeRoot) */
+    char path[1600], key[2048], added[1024] = "";
+    snprintf(path, sizeof(path), "%s/%s", root->path, binary);
+    int len = snprintf(key, sizeof(key), "%s\t", path);
+    for (int s = 0; s < g_spec_count; s++)
+        if (strcmp(g_specs[s].binary, binary) == 0)
+            len += snprintf(key + len, sizeof(key) - (size_t)len, "%s%s", key[len - 1] == '\t' ? "" : ",",
+                            g_specs[s].dylib);
+
+    size_t size = 0;
+    mode_t mode = 0644;
+    uint8_t *data = read_file(path, &size, &mode);
+    if (!data) {
+        report(name, binary, "error: can't read (%s)", strerror(errno ? errno : EIO));
+        __sync_fetch_and_add(&g_failures, 1);
+        return;
+    }
+    uint64_t known, hash = content_hash(data, size);
+    /* Other workers' state_set may grow g_state while we look */
+    pthread_mutex_lock(&g_lock);
+    int have_known = !g_check && state_get(key, &known);
+    pthread_mutex_unlock(&g_lock);
+    if (have_known && known == hash) {
+        report(name, binary, "unchanged%s", "");
+        free(data);
+        return;
+    }
+
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    int count = rsim_macho_slices(data, size, slices, RSIM_MACHO_MAX_SLICES);
+    if (!count) {
+        report(name, binary, "error: %s", "not a Mach-O file");
+        __sync_fetch_and_add(&g_failures, 1);
+        free(data);
+        return;
+    }
+
+    int changed = 0, failed = 0;
+    for (int s = 0; s < g_spec_count && !failed; s++) {
+        if (strcmp(g_specs[s].binary, binary) != 0) continue;
+        int missing = 0;
+        for (int i = 0; i < count && !failed; i++) {
+            int rc = g_check ? rsim_macho_has_dylib(data, size, &slices[i], g_specs[s].dylib)
+                             : rsim_macho_add_dylib(data, size, &slices[i], g_specs[s].dylib);
+            if (g_check && rc == 0) missing = 1;
+            else if (!g_check && rc == 0) missing = changed = 1;
+            else if (rc == -2) {
+                report(name, binary, "error: no header room for %s", g_specs[s].dylib);
+                failed = 1;
+            } else if (rc < 0) {
+                report(name, binary, "error: malformed load commands (%s)", g_specs[s].dylib);
+                failed = 1;
+            }
+        }
+        if (missing) {
+            const char *base = strrchr(g_specs[s].dylib, '/');
+            snprintf(added + strlen(added), sizeof(added) - strlen(added), " %s", base ? base + 1 : g_specs[s].dylib);
+        }
+    }
+
+    if (failed) {
+        __sync_fetch_and_add(&g_failures, 1);
+    } else if (g_check) {
+        if (added[0]) __sync_fetch_and_add(&g_missing, 1);
+        report(name, binary, added[0] ? "missing:%s" : "ok%s", added);
+    } else if (!changed) {
+        report(name, binary, "already patched%s", "");
+        pthread_mutex_lock(&g_lock);
+        state_set(key, hash);
+        pthread_mutex_unlock(&g_lock);
+    } else if (write_file(path, data, size, mode) != 0) {
+        report(name, binary, "error: write failed (%s)", strerror(errno));
+        __sync_fetch_and_add(&g_failures, 1);
+    } else {
+        int sign_failed = root->sign && codesign(path) != 0;
+        if (sign_failed) __sync_fetch_and_add(&g_failures, 1);
+        char detail[1100];
+        snprintf(detail, sizeof(detail), "%s%s", added,
+                 root->sign ? (sign_failed ? " (codesign FAILED)" : " (signed)") : "");
+        report(name, binary, "patched:%s", detail);
+        if (!sign_failed) {
+            uint64_t after = file_hash(path);
+            pthread_mutex_lock(&g_lock);
+            state_set(key, after);
+            pthread_mutex_unlock(&g_lock);
+        }
+    }
+    free(data);
+}
+
+static void *root_worker(void *arg) {
+    (void)arg;
+    for (;;) {
+        int r = __sync_fetch_and_add(&g_next_root, 1);
+        if (r >= g_root_count) return NULL;
+        const PatchRoot *root = &g_roots[r];
+        struct stat st;
+        if (stat(root->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            report(root->path, "-", "skipped: %s", "runtime root not found");
+            continue;
+        }
+        /* Each binary once, with every dylib it gets */
+        for (int s = 0; s < g_spec_count; s++) {
+            int first = 1;
+            for (int p = 0; p < s && first; p++) first = strcmp(g_specs[p].binary, g_specs[s].binary) != 0;
+            if (first) patch_binary(root, g_specs[s].binary);
+        }
+    }
+}
+
+static int usage(void) {
+    fprintf(stderr, "Usage: rosettasim_patch [--check] [--jobs=N] [--state=<file>]\n"
+                    "                        --add <dylib>:<binary> [--add ...] <runtime-root>[:sign] ...\n");
+    return 2;
+}
+
+int main(int argc, char *argv[]) {
+    int jobs = 4;
+    char state_path[1024] = "";
+    const char *home = getenv("HOME");
+    if (home) snprintf(state_path, sizeof(state_path), "%s/Library/Caches/RosettaSim/patch_state.tsv", home);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--check") == 0) g_check = 1;
+        else if (strncmp(argv[i], "--jobs=", 7) == 0) jobs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--state=", 8) == 0) snprintf(state_path, sizeof(state_path), "%s", argv[i] + 8);
+        else if (strcmp(argv[i], "--add") == 0 && i + 1 < argc) {
+            const char *spec = argv[++i], *colon = strchr(spec, ':');
+            if (!colon || colon == spec || !colon[1] || g_spec_count == MAX_SPECS) return usage();
+            PatchSpec *p = &g_specs[g_spec_count++];
+            snprintf(p->dylib, sizeof(p->dylib), "%.*s", (int)(colon - spec), spec);
+            snprintf(p->binary, sizeof(p->binary), "%s", colon + 1);
+        } else if (argv[i][0] == '-') {
+            return usage();
+        } else if (g_root_count < MAX_ROOTS) {
+            PatchRoot *r = &g_roots[g_root_count++];
+            snprintf(r->path, sizeof(r->path), "%s", argv[i]);
+            size_t len = strlen(r->path);
+            if (len > 5 && strcmp(r->path + len - 5, ":sign") == 0) {
+                r->path[len - 5] = 0;
+                r->sign = 1;
+            }
+            while ((len = strlen(r->path)) > 1 && r->path[len - 1] == '/') r->path[len - 1] = 0;
+        }
+    }
+    if (!g_spec_count || !g_root_count) return usage();
+    if (jobs < 1) jobs = 1;
+    if (jobs > g_root_count) jobs = g_root_count;
+
+    if (state_path[0]) state_load(state_path);
+    pthread_t threads[MAX_ROOTS];
+    for (int i = 0; i < jobs; i++) pthread_create(&threads[i], NULL, root_worker, NULL);
+    for (int i = 0; i < jobs; i++) pthread_join(threads[i], NULL);
+    if (state_path[0] && !g_check) state_save(state_path);
+
+    if (g_failures) return 1;
+    return g_check && g_missing ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * rosettasim_prewarm.c — Warm one batch of runtime binaries (x86_64 helper)
+ *
+ * Run by `rosettasim-ctl prewarm` under Rosetta, a few instances at a time.
+ * For every path argument:
+ *   1. maps the file read-only and touches each page (page cache), then
+ *   2. maps the x86_64 __TEXT segment executable. Rosetta translates
+ *      file-backed executable mappings ahead of time and keeps the result in
+ *      its AOT cache, so the simulator processes that later map the same file
+ *      skip the translation. dyld_sim shared caches map their first (text)
+ *      mapping the same way.
+ * Nothing is executed. One line per file on stdout:
+ *   <ms>\t<ok|data|skip|error>\t<bytes>\t<path>
+ *
+ * Build (x86_64 only — it must itself run translated):
+ *   make prewarm   (from src/)
+ */
+
+#include "common/rosettasim_macho.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysctl.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static volatile uint8_t g_sink;
+
+static void touch_pages(const uint8_t *p, size_t size) {
+    long page = sysconf(_SC_PAGESIZE);
+    uint8_t acc = 0;
+    for (size_t off = 0; off < size; off += (size_t)page) acc ^= p[off];
+    g_sink ^= acc;
+}
+
+/* Map [offset, offset + size) of fd executable; offset rounded down to a page */
+static int map_exec(int fd, uint64_t offset, uint64_t size) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t aligned = offset & ~(page - 1);
+    size += offset - aligned;
+    void *text = mmap(NULL, (size_t)size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, (off_t)aligned);
+    if (text == MAP_FAILED) return -1;
+    munmap(text, (size_t)size);
+    return 0;
+}
+
+/* Text range of a dyld shared cache: its first mapping (dyld_cache_mapping_info) */
+static int dyld_cache_text(const uint8_t *image, size_t size, uint64_t *offset, uint64_t *length) {
+    if (size < 0x20 || memcmp(image, "dyld_v1", 7) != 0) return -1;
+    uint32_t mapping_offset, mapping_count;
+    memcpy(&mapping_offset, image + 0x10, 4);
+    memcpy(&mapping_count, image + 0x14, 4);
+    if (!mapping_count || (uint64_t)mapping_offset + 32 > size) return -1;
+    memcpy(length, image + mapping_offset + 8, 8);
+    memcpy(offset, image + mapping_offset + 16, 8);
+    return *offset <= size && *length <= size - *offset ? 0 : -1;
+}
+
+static const char *prewarm_file(const char *path, uint64_t *bytes) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return "error";
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return "skip";
+    }
+    size_t size = (size_t)st.st_size;
+    const uint8_t *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED) {
+        close(fd);
+        return "error";
+    }
+    touch_pages(image, size);
+    *bytes = size;
+
+    const char *status = "data";      /* cached, but nothing to translate */
+    uint64_t offset = 0, length = 0;
+    RSimMachOSlice slices[RSIM_MACHO_MAX_SLICES];
+    int count = rsim_macho_slices(image, size, slices, RSIM_MACHO_MAX_SLICES);
+    const RSimMachOSlice *x86 = rsim_macho_find_slice(slices, count, RSIM_CPU_X86_64);
+    if (x86 && rsim_macho_segment(image, size, x86, "__TEXT", &offset, &length) == 0) {
+        status = map_exec(fd, x86->offset + offset, length) == 0 ? "ok" : "error";
+    } else if (dyld_cache_text(image, size, &offset, &length) == 0) {
+        status = map_exec(fd, offset, length) == 0 ? "ok" : "error";
+    }
+    munmap((void *)image, size);
+    close(fd);
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: rosettasim_prewarm <file>...\n");
+        return 1;
+    }
+    int translated = 0;
+    size_t len = sizeof(translated);
+    if (sysctlbyname("sysctl.proc_translated", &translated, &len, NULL, 0) != 0 || !translated)
+        fprintf(stderr, "rosettasim_prewarm: not running under Rosetta; only the page cache is warmed\n");
+
+    for (int i = 1; i < argc; i++) {
+        double t0 = now_ms();
+        uint64_t bytes = 0;
+        const char *status = prewarm_file(argv[i], &bytes);
+        printf("%.3f\t%s\t%llu\t%s\n", now_ms() - t0, status, (unsigned long long)bytes, argv[i]);
+    }
+    return 0;
+}
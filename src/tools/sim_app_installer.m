@@ -1,16 +1,22 @@
 /*
  * sim_app_installer.dylib — x86_64 constructor dylib injected into SpringBoard
  *
- * Listens for darwin notifications to install apps and launch them.
+ * Listens for darwin notifications to install apps and launch them,
+ * applies settings changes (content size, trust store) to the live system,
+ * sets or plays back the simulated location, and delivers push payloads
+ * (singly or as rate-paced batches).
  * Uses device-specific notification names: com.rosettasim.{install,launch}.<UDID>
  * Command payload is in /tmp/rosettasim_cmd_<UDID>.json (consumed immediately).
+ * Reports the interface orientation in /tmp/rosettasim_orientation_<UDID> so
+ * the daemon can tag frames for upright captures.
  *
  * Build: (x86_64 iOS simulator dylib)
  *   clang -arch x86_64 -dynamiclib -framework Foundation -fobjc-arc \
  *     -mios-simulator-version-min=9.0 -install_name /usr/lib/sim_app_installer.dylib \
  *     -isysroot $(xcrun --show-sdk-path --sdk iphonesimulator) \
  *     -undefined dynamic_lookup -Wl,-not_for_dyld_shared_cache \
- *     -o sim_app_installer.dylib sim_app_installer.m
+ *     -I.. -o sim_app_installer.dylib sim_app_installer.m ../common/rosettasim_route.c \
+ *     ../common/rosettasim_pushq.c
  *
  * Deploy: inject into SpringBoard via insert_dylib
  */
@@ -21,7 +27,10 @@
 #import <dlfcn.h>
 #include <notify.h>
 #include <CoreGraphics/CoreGraphics.h>
+#include <mach/mach_time.h>
 #include "common/rosettasim_paths.h"
+#include "common/rosettasim_route.h"
+#include "common/rosettasim_pushq.h"
 
 static const char *g_udid = NULL;
 static char g_cmd_path[512];
@@ -277,8 +286,16 @@ static void handle_install(void) {
  * Launch handler
  * ================================================================ */
 
+/* Wall clock, comparable with host-side timestamps (same kernel clock) */
+static double now_epoch(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 static void handle_launch(void) {
     @autoreleasepool {
+        double picked_up = now_epoch();
         NSString *cmdPath = [NSString stringWithUTF8String:g_cmd_path];
         NSData *data = [NSData dataWithContentsOfFile:cmdPath];
         if (!data) {
@@ -296,6 +313,8 @@ static void handle_launch(void) {
 
         log_result("Launching: %s", [bundleId UTF8String]);
         BOOL launched = NO;
+        const char *method = "none";
+        double call_start = now_epoch();
 
         /* Approach 1: LSApplicationWorkspace */
         Class lsClass = objc_getClass("LSApplicationWorkspace");
@@ -308,6 +327,7 @@ static void handle_launch(void) {
                 if (ok) {
                     log_result("  LSApplicationWorkspace: SUCCESS");
                     launched = YES;
+                    method = "LSApplicationWorkspace";
                 }
             }
         }
@@ -324,6 +344,7 @@ static void handle_launch(void) {
                         bundleId, nil, nil);
                     log_result("  FBSSystemService: called");
                     launched = YES;
+                    method = "FBSSystemService";
                 }
             }
         }
@@ -331,11 +352,512 @@ static void handle_launch(void) {
         if (!launched) {
             log_result("  WARNING: No launch method available");
         }
+        /* Parsed by rosettasim-ctl launch --measure */
+        log_result("  TIMING picked_up=%.6f call=%.6f returned=%.6f method=%s",
+                   picked_up, call_start, now_epoch(), method);
 
         [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
     }
 }
 
+/* ================================================================
+ * Simulated location (rosettasim-ctl location set / clear / route)
+ *
+ * Positions go to locationd through CLSimulationManager, the same SPI
+ * simctl uses. A route arrives whole in one command and is played back
+ * here by a timer, so the host isn't in the loop at every tick:
+ *   LOCATION id=<id> status=started points=<n> duration=<s> rate=<hz>
+ *   LOCATION id=<id> status=done ticks=<n> missed=<n> late_mean=<ms> late_p95=<ms> late_max=<ms>
+ * ================================================================ */
+
+typedef struct { double latitude, longitude; } LocCoordinate;   /* CLLocationCoordinate2D */
+
+static dispatch_queue_t g_loc_queue;
+static id g_loc_manager;
+static BOOL g_loc_started;
+static dispatch_source_t g_loc_timer;   /* the route being played, if any */
+static RSimRoute g_loc_route;
+
+static uint64_t mach_ns(void) {
+    static mach_timebase_info_data_t tb;
+    if (!tb.denom) mach_timebase_info(&tb);
+    return mach_absolute_time() * tb.numer / tb.denom;
+}
+
+/* On g_loc_queue. nil when CoreLocation's simulation SPI isn't there. */
+static id location_manager(void) {
+    if (!g_loc_manager) {
+        dlopen("/System/Library/Frameworks/CoreLocation.framework/CoreLocation", RTLD_LAZY);
+        Class cls = objc_getClass("CLSimulationManager");
+        if (cls) g_loc_manager = [[cls alloc] init];
+    }
+    return g_loc_manager;
+}
+
+/* Replace the simulated position. On g_loc_queue. */
+static BOOL feed_location(const RSimRouteFix *fix) {
+    id mgr = location_manager();
+    Class locClass = objc_getClass("CLLocation");
+    if (!mgr || !locClass) return NO;
+    LocCoordinate coord = { fix->lat, fix->lon };
+    id loc = ((id(*)(id, SEL, LocCoordinate, double, double, double, double, double, id))objc_msgSend)(
+        [locClass alloc], sel_registerName("initWithCoordinate:altitude:horizontalAccuracy:verticalAccuracy:course:speed:timestamp:"),
+        coord, fix->ele, 5.0, 5.0, fix->course, fix->speed, [NSDate date]);
+    ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("clearSimulatedLocations"));
+    ((void(*)(id, SEL, id))objc_msgSend)(mgr, sel_registerName("appendSimulatedLocation:"), loc);
+    ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("flush"));
+    if (!g_loc_started) {
+        ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("startLocationSimulation"));
+        g_loc_started = YES;
+    }
+    return YES;
+}
+
+/* On g_loc_queue */
+static void stop_route(void) {
+    if (!g_loc_timer) return;
+    dispatch_source_cancel(g_loc_timer);
+    g_loc_timer = nil;
+    rsim_route_free(&g_loc_route);
+}
+
+/* On g_loc_queue */
+static void clear_location(void) {
+    stop_route();
+    id mgr = location_manager();
+    if (!mgr || !g_loc_started) return;
+    ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("stopLocationSimulation"));
+    ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("clearSimulatedLocations"));
+    ((void(*)(id, SEL))objc_msgSend)(mgr, sel_registerName("flush"));
+    g_loc_started = NO;
+}
+
+/* points: [[lat, lon, ele, t], ...] with t in playback seconds, from rosettasim-ctl */
+static const char *start_route(NSString *reqID, NSArray *points, double rate, NSString **detail) {
+    stop_route();
+    for (NSArray *p in points) {
+        if (![p isKindOfClass:[NSArray class]] || p.count < 4) continue;
+        rsim_route_add(&g_loc_route, [p[0] doubleValue], [p[1] doubleValue], [p[2] doubleValue], [p[3] doubleValue]);
+    }
+    if (g_loc_route.count == 0) {
+        *detail = @"empty route";
+        return "failed";
+    }
+    double duration = rsim_route_timeline(&g_loc_route, 0);   /* the t values above */
+    if (rate <= 0 || rate > RSIM_ROUTE_MAX_RATE) rate = 1;
+    RSimRouteFix fix;
+    size_t first = 0;
+    rsim_route_sample(&g_loc_route, 0, &first, &fix);
+    if (!feed_location(&fix)) {
+        rsim_route_free(&g_loc_route);
+        *detail = @"CLSimulationManager not available";
+        return "unsupported";
+    }
+
+    /*
+     * One repeating timer with zero leeway: libdispatch schedules it at
+     * start + n * period, so lateness doesn't accumulate, and the position
+     * is sampled at the time actually elapsed rather than at a tick count.
+     * (The cmd poll loop avoids dispatch sources; here dispatch_after's
+     * default leeway would be most of a 20ms period.)
+     */
+    uint64_t period = (uint64_t)(1e9 / rate);
+    uint64_t t0 = mach_ns();
+    __block uint64_t tick = 0;
+    __block size_t cursor = 0;
+    __block RSimTickStats stats;
+    memset(&stats, 0, sizeof(stats));
+    NSString *rid = [reqID copy];
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0,
+#ifdef DISPATCH_TIMER_STRICT
+                                                     DISPATCH_TIMER_STRICT,
+#else
+                                                     0,
+#endif
+                                                     g_loc_queue);
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)period), period, 0);
+    dispatch_source_set_event_handler(timer, ^{
+        uint64_t now = mach_ns();
+        unsigned long fired = dispatch_source_get_data(timer);
+        tick += fired ? fired : 1;
+        rsim_tick_record(&stats, ((double)now - (double)(t0 + tick * period)) / 1e6,
+                         fired > 1 ? (unsigned)(fired - 1) : 0);
+        RSimRouteFix f;
+        int done = rsim_route_sample(&g_loc_route, (now - t0) / 1e9, &cursor, &f);
+        feed_location(&f);
+        if (!done) return;
+        log_result("LOCATION id=%s status=done ticks=%zu missed=%zu late_mean=%.2f late_p95=%.2f late_max=%.2f",
+                   rid.UTF8String, stats.ticks, stats.missed, rsim_tick_mean(&stats),
+                   rsim_tick_percentile(&stats, 0.95), stats.max_ms);
+        stop_route();
+    });
+    g_loc_timer = timer;
+    dispatch_resume(timer);
+    *detail = [NSString stringWithFormat:@"points=%zu duration=%.1f rate=%g",
+               g_loc_route.count, duration, rate];
+    return "started";
+}
+
+/* Also used by live settings (rosettasim-ctl provision) */
+static const char *apply_location(double lat, double lon, NSString **detail) {
+    __block BOOL ok = NO;
+    dispatch_sync(g_loc_queue, ^{
+        stop_route();
+        RSimRouteFix fix = { lat, lon, 0, -1, 0 };
+        ok = feed_location(&fix);
+    });
+    if (!ok) {
+        *detail = @"CLSimulationManager not available";
+        return "unsupported";
+    }
+    *detail = [NSString stringWithFormat:@"locationd: %.6f,%.6f", lat, lon];
+    return "live";
+}
+
+static void handle_location(NSDictionary *cmd) {
+    @autoreleasepool {
+        NSString *reqID = [cmd[@"id"] isKindOfClass:[NSString class]] ? cmd[@"id"] : @"-";
+        NSString *detail = @"";
+        __block const char *status = "failed";
+        if ([cmd[@"route"] isKindOfClass:[NSArray class]]) {
+            __block NSString *d = nil;
+            dispatch_sync(g_loc_queue, ^{
+                NSString *out = nil;
+                status = start_route(reqID, cmd[@"route"], [cmd[@"rate"] doubleValue], &out);
+                d = out;
+            });
+            detail = d;
+        } else if ([cmd[@"clear"] boolValue]) {
+            dispatch_sync(g_loc_queue, ^{ clear_location(); });
+            status = "cleared";
+        } else if (cmd[@"lat"] && cmd[@"lon"]) {
+            status = apply_location([cmd[@"lat"] doubleValue], [cmd[@"lon"] doubleValue], &detail);
+        } else {
+            detail = @"expected route, clear or lat/lon";
+        }
+        /* Parsed by rosettasim-ctl (agent_wait) */
+        log_result("LOCATION id=%s status=%s %s", reqID.UTF8String, status, detail.UTF8String);
+    }
+}
+
+/* ================================================================
+ * Push notifications (rosettasim-ctl push, push --batch)
+ *
+ * A payload is handed to SpringBoard's remote-notification server as if
+ * apsd had received it. A batch is streamed from its spool file through
+ * a bounded queue and paced by a rate limiter (common/rosettasim_pushq):
+ *   PUSH id=<id> status=started rate=<hz> burst=<n>
+ *   PUSH id=<id> status=done delivered=<n> failed=<n> elapsed=<s> rate=<hz>
+ *        latency_mean=<ms> latency_p50=<ms> latency_p95=<ms> latency_max=<ms>
+ * ================================================================ */
+
+/* Where rate limiting hands control back to the main run loop */
+#define PUSH_SLICE_MS   5.0
+
+static const char *deliver_push(NSString *bundleID, NSDictionary *payload, NSString **detail) {
+    dlopen("/System/Library/PrivateFrameworks/ApplePushService.framework/ApplePushService", RTLD_LAZY);
+    Class msgClass = objc_getClass("APSIncomingMessage");
+    /* UserNotificationsServer (iOS 10+), then SpringBoard's own (iOS 7-9) */
+    Class serverClass = objc_getClass("UNSRemoteNotificationServer") ?: objc_getClass("SBRemoteNotificationServer");
+    SEL receive = sel_registerName("connection:didReceiveIncomingMessage:");
+    id server = [serverClass respondsToSelector:sel_registerName("sharedInstance")]
+        ? ((id(*)(id, SEL))objc_msgSend)((id)serverClass, sel_registerName("sharedInstance")) : nil;
+    if (!msgClass || ![server respondsToSelector:receive]) {
+        *detail = @"no remote notification server in SpringBoard";
+        return "unsupported";
+    }
+    id msg = ((id(*)(id, SEL, id, id))objc_msgSend)([msgClass alloc],
+        sel_registerName("initWithTopic:userInfo:"), bundleID, payload);
+    if (!msg) {
+        *detail = @"APSIncomingMessage rejected the payload";
+        return "failed";
+    }
+    ((void(*)(id, SEL, id, id))objc_msgSend)(server, receive, nil, msg);
+    *detail = [NSString stringWithFormat:@"%@ via %s", bundleID, class_getName(serverClass)];
+    return "delivered";
+}
+
+/* The batch in progress (g_push_id set while it runs); main queue only */
+static NSString *g_push_id, *g_push_bundle, *g_push_spool;
+static dispatch_source_t g_push_timer;
+static struct {
+    FILE           *file;
+    RSimPushQueue   queue;
+    RSimRateLimit   limit;
+    RSimLatencies   latency;
+    size_t          delivered, failed;
+    double          start, last_done;
+} g_push;
+
+static void finish_push_batch(void) {
+    double elapsed = g_push.last_done > g_push.start ? g_push.last_done - g_push.start : 0;
+    /* The first payload goes at start: n payloads span n - 1 intervals */
+    size_t sent = g_push.delivered + g_push.failed;
+    log_result("PUSH id=%s status=done delivered=%zu failed=%zu elapsed=%.3f rate=%.1f "
+               "latency_mean=%.2f latency_p50=%.2f latency_p95=%.2f latency_max=%.2f",
+               g_push_id.UTF8String, g_push.delivered, g_push.failed, elapsed,
+               elapsed > 0 && sent > 1 ? (sent - 1) / elapsed : 0, rsim_latency_mean(&g_push.latency),
+               rsim_latency_percentile(&g_push.latency, 0.5), rsim_latency_percentile(&g_push.latency, 0.95),
+               rsim_latency_percentile(&g_push.latency, 1.0));
+    dispatch_source_cancel(g_push_timer);
+    fclose(g_push.file);
+    unlink(g_push_spool.UTF8String);
+    rsim_pushq_free(&g_push.queue);
+    rsim_latency_free(&g_push.latency);
+    g_push_id = nil;
+    g_push_timer = nil;
+}
+
+/* Deliver everything that is due, then sleep until the next payload is */
+static void pump_push_batch(void) {
+    @autoreleasepool {
+        double slice_end = mach_ns() / 1e9 + PUSH_SLICE_MS / 1000.0;
+        for (;;) {
+            if (g_push.queue.count < g_push.queue.capacity / 2 && !g_push.queue.eof)
+                rsim_pushq_fill(&g_push.queue, g_push.file);
+            if (rsim_pushq_done(&g_push.queue)) {
+                finish_push_batch();
+                return;
+            }
+            double now = mach_ns() / 1e9, due = now;
+            double wait = now < slice_end ? rsim_ratelimit_take(&g_push.limit, now, &due) : 0;
+            if (wait > 0 || now >= slice_end) {
+                dispatch_source_set_timer(g_push_timer,
+                    dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)), DISPATCH_TIME_FOREVER, 0);
+                return;
+            }
+
+            RSimPushItem item;
+            rsim_pushq_pop(&g_push.queue, &item);
+            NSData *json = [NSData dataWithBytesNoCopy:item.data length:item.len freeWhenDone:YES];
+            NSDictionary *payload = [NSJSONSerialization JSONObjectWithData:json options:0 error:nil];
+            NSString *detail = nil;
+            const char *status = [payload isKindOfClass:[NSDictionary class]]
+                ? deliver_push(g_push_bundle, payload, &detail) : "failed";
+            g_push.last_done = mach_ns() / 1e9;
+            rsim_latency_add(&g_push.latency, (g_push.last_done - due) * 1000.0);
+            if (strcmp(status, "delivered") == 0) {
+                g_push.delivered++;
+            } else {
+                if (g_push.failed++ < 5)
+                    log_result("PUSH id=%s line=%u %s %s", g_push_id.UTF8String, item.seq, status,
+                               detail ? detail.UTF8String : "not a JSON object");
+                if (strcmp(status, "unsupported") == 0) {
+                    /* Nothing further can be delivered either */
+                    g_push.queue.eof = 1;
+                    RSimPushItem rest;
+                    while (rsim_pushq_pop(&g_push.queue, &rest) == 0) free(rest.data);
+                }
+            }
+        }
+    }
+}
+
+static const char *start_push_batch(NSString *reqID, NSString *bundleID, NSString *spool,
+                                    double rate, unsigned burst, NSString **detail) {
+    if (g_push_id) {
+        *detail = [NSString stringWithFormat:@"batch %@ still running", g_push_id];
+        return "failed";
+    }
+    if (rate <= 0 || rate > RSIM_PUSH_MAX_RATE) {
+        *detail = @"rate out of range";
+        return "failed";
+    }
+    FILE *f = fopen(spool.UTF8String, "r");
+    if (!f) {
+        *detail = [NSString stringWithFormat:@"cannot open %@", spool];
+        return "failed";
+    }
+    if (rsim_pushq_init(&g_push.queue, RSIM_PUSHQ_CAPACITY) != 0) {
+        fclose(f);
+        *detail = @"out of memory";
+        return "failed";
+    }
+    g_push_id = [reqID copy];
+    g_push_bundle = [bundleID copy];
+    g_push_spool = [spool copy];
+    g_push.file = f;
+    g_push.delivered = g_push.failed = 0;
+    memset(&g_push.latency, 0, sizeof(g_push.latency));
+    g_push.start = g_push.last_done = mach_ns() / 1e9;
+    rsim_ratelimit_init(&g_push.limit, rate, burst ? burst : 1, g_push.start);
+
+    g_push_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, dispatch_get_main_queue());
+    dispatch_source_set_event_handler(g_push_timer, ^{ pump_push_batch(); });
+    dispatch_source_set_timer(g_push_timer, DISPATCH_TIME_NOW, DISPATCH_TIME_FOREVER, 0);
+    dispatch_resume(g_push_timer);
+    *detail = [NSString stringWithFormat:@"rate=%g burst=%u", rate, burst ? burst : 1];
+    return "started";
+}
+
+static void handle_push(NSDictionary *cmd) {
+    @autoreleasepool {
+        NSString *reqID = [cmd[@"id"] isKindOfClass:[NSString class]] ? cmd[@"id"] : @"-";
+        NSString *bundleID = cmd[@"bundle_id"];
+        NSString *detail = @"";
+        const char *status = "failed";
+        if (![bundleID isKindOfClass:[NSString class]])
+            detail = @"no bundle_id";
+        else if ([cmd[@"batch"] isKindOfClass:[NSString class]])
+            status = start_push_batch(reqID, bundleID, cmd[@"batch"], [cmd[@"rate"] doubleValue],
+                                      [cmd[@"burst"] unsignedIntValue], &detail);
+        else if ([cmd[@"payload"] isKindOfClass:[NSDictionary class]])
+            status = deliver_push(bundleID, cmd[@"payload"], &detail);
+        else
+            detail = @"expected payload or batch";
+        /* Parsed by rosettasim-ctl (agent_wait) */
+        log_result("PUSH id=%s status=%s %s", reqID.UTF8String, status, detail.UTF8String);
+    }
+}
+
+/* ================================================================
+ * Live settings apply (rosettasim-ctl ui content_size / keychain / provision)
+ *
+ * Makes the running system pick up a settings change so the host doesn't
+ * have to reboot the device. Replies with one line in the result file:
+ *   SETTINGS id=<id> status=<live|unsupported|failed> ms=<t> detail=<text>
+ * "unsupported" means this runtime has no live path; the host then writes
+ * the files itself and reboots.
+ * ================================================================ */
+
+/* Darwin name UIKit's content-size cache is invalidated by */
+#define CONTENT_SIZE_CHANGED_NOTIFY "com.apple.UIKit.PreferredContentSizeChanged"
+#define TRUST_STORE_DOMAIN_USER     1   /* kSecTrustStoreDomainUser */
+
+typedef CFTypeRef (*SecCertificateCreateWithDataFn)(CFAllocatorRef, CFDataRef);
+typedef CFTypeRef (*SecTrustStoreForDomainFn)(int);
+typedef OSStatus (*SecTrustStoreSetTrustSettingsFn)(CFTypeRef, CFTypeRef, CFTypeRef);
+typedef OSStatus (*SecTrustStoreRemoveCertificateFn)(CFTypeRef, CFTypeRef);
+typedef OSStatus (*SecItemDeleteAllFn)(void);
+
+static NSString *current_content_size(void) {
+    Class appClass = objc_getClass("UIApplication");
+    id app = appClass ? ((id(*)(id, SEL))objc_msgSend)((id)appClass, sel_registerName("sharedApplication")) : nil;
+    SEL sel = sel_registerName("preferredContentSizeCategory");
+    return [app respondsToSelector:sel] ? ((id(*)(id, SEL))objc_msgSend)(app, sel) : nil;
+}
+
+static const char *apply_content_size(NSString *category, NSString **detail) {
+    /* Through cfprefsd, so every process's preferences cache sees it */
+    CFStringRef domain = CFSTR("com.apple.Accessibility");
+    CFPreferencesSetAppValue(CFSTR("PreferredContentSizeCategoryName"), (__bridge CFStringRef)category, domain);
+    if (!CFPreferencesAppSynchronize(domain)) {
+        *detail = @"CFPreferencesAppSynchronize failed";
+        return "failed";
+    }
+    notify_post(CONTENT_SIZE_CHANGED_NOTIFY);
+
+    /* SpringBoard is a UIKit app too: if its category followed, apps will */
+    [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.3]];
+    if ([current_content_size() isEqualToString:category]) {
+        *detail = @"cfprefsd + " CONTENT_SIZE_CHANGED_NOTIFY;
+        return "live";
+    }
+    *detail = [NSString stringWithFormat:@"preferences synced but UIKit still reports %@",
+               current_content_size() ?: @"nothing"];
+    return "unsupported";
+}
+
+/* Certificates as base64 DER strings; add (trusted as root) or remove in the user trust store */
+static const char *apply_trust(NSArray *certs, BOOL add, NSString **detail) {
+    SecCertificateCreateWithDataFn createCert = (SecCertificateCreateWithDataFn)dlsym(RTLD_DEFAULT, "SecCertificateCreateWithData");
+    SecTrustStoreForDomainFn storeForDomain = (SecTrustStoreForDomainFn)dlsym(RTLD_DEFAULT, "SecTrustStoreForDomain");
+    SecTrustStoreSetTrustSettingsFn setTrust = (SecTrustStoreSetTrustSettingsFn)dlsym(RTLD_DEFAULT, "SecTrustStoreSetTrustSettings");
+    SecTrustStoreRemoveCertificateFn removeCert = (SecTrustStoreRemoveCertificateFn)dlsym(RTLD_DEFAULT, "SecTrustStoreRemoveCertificate");
+    if (!createCert || !storeForDomain || (add ? !setTrust : !removeCert)) {
+        *detail = @"SecTrustStore SPI not available";
+        return "unsupported";
+    }
+    CFTypeRef store = storeForDomain(TRUST_STORE_DOMAIN_USER);
+    if (!store) {
+        *detail = @"no user trust store";
+        return "unsupported";
+    }
+    int done = 0;
+    for (NSString *b64 in certs) {
+        NSData *der = [[NSData alloc] initWithBase64EncodedString:b64 options:0];
+        CFTypeRef cert = der ? createCert(NULL, (__bridge CFDataRef)der) : NULL;
+        if (!cert) {
+            *detail = @"not a DER certificate";
+            return "failed";
+        }
+        /* securityd owns TrustStore.sqlite3; going through it keeps its cache current */
+        OSStatus st = add ? setTrust(store, cert, NULL) : removeCert(store, cert);
+        CFRelease(cert);
+        if (st != 0 && !(st == -25300 && !add)) {     /* errSecItemNotFound on remove is fine */
+            *detail = [NSString stringWithFormat:@"securityd returned %d", (int)st];
+            return "failed";
+        }
+        done++;
+    }
+    *detail = [NSString stringWithFormat:@"securityd: %d certificate(s) %s", done, add ? "trusted" : "removed"];
+    return "live";
+}
+
+static const char *apply_keychain_reset(NSArray *trustCerts, NSString **detail) {
+    SecItemDeleteAllFn deleteAll = (SecItemDeleteAllFn)dlsym(RTLD_DEFAULT, "SecItemDeleteAll");
+    if (!deleteAll) {
+        *detail = @"SecItemDeleteAll not available";
+        return "unsupported";
+    }
+    OSStatus st = deleteAll();
+    if (st != 0) {
+        *detail = [NSString stringWithFormat:@"SecItemDeleteAll returned %d", (int)st];
+        return "failed";
+    }
+    if (!trustCerts.count) {
+        *detail = @"securityd: keychain items deleted";
+        return "live";
+    }
+    const char *status = apply_trust(trustCerts, NO, detail);
+    if (strcmp(status, "live") == 0)
+        *detail = [NSString stringWithFormat:@"securityd: keychain items deleted, %lu trust setting(s) removed",
+                   (unsigned long)trustCerts.count];
+    return status;
+}
+
+static const char *apply_pasteboard(NSString *text, NSString **detail) {
+    Class pbClass = objc_getClass("UIPasteboard");
+    id pb = pbClass ? ((id(*)(id, SEL))objc_msgSend)((id)pbClass, sel_registerName("generalPasteboard")) : nil;
+    if (!pb) {
+        *detail = @"UIPasteboard not available";
+        return "unsupported";
+    }
+    ((void(*)(id, SEL, id))objc_msgSend)(pb, sel_registerName("setString:"), text);
+    NSString *now = ((id(*)(id, SEL))objc_msgSend)(pb, sel_registerName("string"));
+    if (![now isEqualToString:text]) {
+        *detail = @"pasteboard did not take the string";
+        return "failed";
+    }
+    *detail = [NSString stringWithFormat:@"pasteboardd: %lu characters", (unsigned long)text.length];
+    return "live";
+}
+
+static void handle_settings(NSDictionary *cmd) {
+    @autoreleasepool {
+        double t0 = now_epoch();
+        NSString *op = cmd[@"op"];
+        NSString *detail = @"";
+        const char *status = "unsupported";
+        if ([op isEqualToString:@"content_size"] && [cmd[@"value"] isKindOfClass:[NSString class]])
+            status = apply_content_size(cmd[@"value"], &detail);
+        else if ([op isEqualToString:@"trust_add"])
+            status = apply_trust(cmd[@"certs"], YES, &detail);
+        else if ([op isEqualToString:@"keychain_reset"])
+            status = apply_keychain_reset(cmd[@"certs"], &detail);
+        else if ([op isEqualToString:@"pasteboard"] && [cmd[@"value"] isKindOfClass:[NSString class]])
+            status = apply_pasteboard(cmd[@"value"], &detail);
+        else if ([op isEqualToString:@"location"] && cmd[@"lat"] && cmd[@"lon"])
+            status = apply_location([cmd[@"lat"] doubleValue], [cmd[@"lon"] doubleValue], &detail);
+        else
+            detail = [NSString stringWithFormat:@"unknown op %@", op];
+
+        /* Parsed by rosettasim-ctl (agent_request) */
+        log_result("SETTINGS id=%s status=%s ms=%.1f detail=%s", [cmd[@"id"] UTF8String] ?: "-",
+                   status, (now_epoch() - t0) * 1000.0, detail.UTF8String);
+    }
+}
+
 /* ================================================================
  * Also process legacy global pending files (backward compat)
  * ================================================================ */
@@ -376,6 +898,59 @@ static void process_legacy_pending(void) {
  * Constructor
  * ================================================================ */
 
+/* ================================================================
+ * Interface orientation hint (rosettasim_daemon stamps it on captures)
+ * ================================================================ */
+
+static char g_orientation_path[512];
+static long g_orientation = -1;
+
+/* UIInterfaceOrientation of the front-most UI, as SpringBoard tracks it */
+static long current_orientation(void) {
+    Class appClass = objc_getClass("UIApplication");
+    id app = appClass ? ((id(*)(id, SEL))objc_msgSend)((id)appClass, sel_registerName("sharedApplication")) : nil;
+    if (!app) return 0;
+    /* SpringBoard (iOS 8+), SpringBoard (iOS 7-9), then any UIApplication */
+    const char *getters[] = { "activeInterfaceOrientation", "_frontMostAppOrientation", "statusBarOrientation" };
+    for (size_t i = 0; i < sizeof(getters) / sizeof(getters[0]); i++) {
+        SEL sel = sel_registerName(getters[i]);
+        if ([app respondsToSelector:sel])
+            return ((long(*)(id, SEL))objc_msgSend)(app, sel);
+    }
+    return 0;
+}
+
+/* Rewrite the hint file (atomically) when the orientation changed */
+static void publish_orientation(void) {
+    long orientation = current_orientation();
+    if (orientation < 1 || orientation > 4 || orientation == g_orientation) return;
+
+    char tmp[600];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", g_orientation_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fprintf(f, "%ld\n", orientation);
+    if (fclose(f) != 0 || rename(tmp, g_orientation_path) != 0) {
+        unlink(tmp);
+        return;
+    }
+    g_orientation = orientation;
+    NSLog(@"[app_installer] Interface orientation: %ld", orientation);
+}
+
+static void observe_orientation(void) {
+    NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
+    for (NSString *name in @[ @"UIApplicationDidChangeStatusBarOrientationNotification",
+                              @"UIDeviceOrientationDidChangeNotification" ]) {
+        [nc addObserverForName:name object:nil queue:[NSOperationQueue mainQueue]
+                    usingBlock:^(NSNotification *note) {
+            /* Read after the rotation animation has settled */
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 500 * NSEC_PER_MSEC),
+                           dispatch_get_main_queue(), ^{ publish_orientation(); });
+        }];
+    }
+}
+
 /* ================================================================
  * File-polling fallback for cross-namespace IPC
  *
@@ -485,6 +1060,15 @@ static void poll_cmd_file(void) {
                 }
                 [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
             }
+        } else if ([action isEqualToString:@"settings"]) {
+            [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
+            handle_settings(cmd);
+        } else if ([action isEqualToString:@"location"]) {
+            [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
+            handle_location(cmd);
+        } else if ([action isEqualToString:@"push"]) {
+            [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
+            handle_push(cmd);
         } else if (cmd[@"bundle_id"] && !action) {
             /* Dict with bundle_id but no action = launch command */
             handle_launch();
@@ -511,6 +1095,8 @@ static void sim_app_installer_init(void) {
 
     snprintf(g_cmd_path, sizeof(g_cmd_path), ROSETTASIM_HOST_CMD_FMT, g_udid);
     snprintf(g_result_path, sizeof(g_result_path), ROSETTASIM_HOST_RESULT_FMT, g_udid);
+    snprintf(g_orientation_path, sizeof(g_orientation_path), ROSETTASIM_HOST_ORIENTATION_FMT, g_udid);
+    g_loc_queue = dispatch_queue_create("com.rosettasim.location", DISPATCH_QUEUE_SERIAL);
 
     /* Touch command file path — in sim's home/tmp */
     NSString *home = NSHomeDirectory();
@@ -538,6 +1124,25 @@ static void sim_app_installer_init(void) {
     uint32_t launch_status = notify_register_dispatch(launch_name, &launch_token,
         dispatch_get_main_queue(), ^(int token) { handle_launch(); });
 
+    /* Settings commands share the cmd file; same-namespace callers get picked up at once */
+    char settings_name[256];
+    snprintf(settings_name, sizeof(settings_name), "com.rosettasim.settings.%s", g_udid);
+    int settings_token = 0;
+    notify_register_dispatch(settings_name, &settings_token,
+        dispatch_get_main_queue(), ^(int token) { poll_cmd_file(); });
+
+    char location_name[256];
+    snprintf(location_name, sizeof(location_name), "com.rosettasim.location.%s", g_udid);
+    int location_token = 0;
+    notify_register_dispatch(location_name, &location_token,
+        dispatch_get_main_queue(), ^(int token) { poll_cmd_file(); });
+
+    char push_name[256];
+    snprintf(push_name, sizeof(push_name), "com.rosettasim.push.%s", g_udid);
+    int push_token = 0;
+    notify_register_dispatch(push_name, &push_token,
+        dispatch_get_main_queue(), ^(int token) { poll_cmd_file(); });
+
     NSLog(@"[app_installer] Notify registration: install=%s (status=%u token=%d), launch=%s (status=%u token=%d)",
           install_name, install_status, install_token,
           launch_name, launch_status, launch_token);
@@ -547,6 +1152,7 @@ static void sim_app_installer_init(void) {
      * Use recursive dispatch_after (safer than dispatch_source under Rosetta 2). */
     __block void (^poll_loop)(void) = ^{
         poll_cmd_file();
+        publish_orientation();  /* backstop for missed notifications */
         if (g_poll_count <= 3)
             NSLog(@"[app_installer] Scheduling next poll in 2s (poll #%d)", g_poll_count);
         dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 2 * NSEC_PER_SEC),
@@ -560,6 +1166,8 @@ static void sim_app_installer_init(void) {
 
     NSLog(@"[app_installer] Listening: %s, %s + polling every 2s", install_name, launch_name);
 
+    observe_orientation();
+
     /* Process legacy pending files after delay (backward compat) */
     dispatch_after(dispatch_time(DISPATCH_TIME_NOW, 5 * NSEC_PER_SEC),
                    dispatch_get_main_queue(), ^{
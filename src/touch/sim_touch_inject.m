@@ -10,6 +10,12 @@
  *   {"action":"down","x":160,"y":284,"finger":0}
  *   {"action":"move","x":170,"y":290,"finger":0}
  *   {"action":"up","x":170,"y":290,"finger":0}
+ * Optional "wait" (ms) sleeps after the event; down defaults to 150ms, the
+ * hold UIKit needs to register a tap. Drivers that pace themselves (monkey,
+ * swipes) pass a shorter one.
+ *
+ * The file is polled every 100ms when idle and every 4ms for two seconds
+ * after a command, so back-to-back commands aren't throttled by the poll.
  *
  * Build:
  *   SDK=$(xcrun --show-sdk-path --sdk iphonesimulator)
@@ -417,25 +423,27 @@ static void send_text(const char *text) {
 
 static int g_poll_count = 0;
 
-static void poll_touch_cmd(void) {
+/* Returns YES if a command file was consumed */
+static BOOL poll_touch_cmd(void) {
     g_poll_count++;
 
-    if (g_poll_count <= 3 || (g_poll_count % 300 == 0)) {
+    if (g_poll_count <= 3 || (g_poll_count % 3000 == 0)) {
         touch_log("Poll #%d", g_poll_count);
     }
 
-    NSString *cmdPath = [NSString stringWithUTF8String:g_cmd_path];
-    if (![[NSFileManager defaultManager] fileExistsAtPath:cmdPath]) return;
+    /* access() first: this runs every 4ms in burst mode */
+    if (access(g_cmd_path, F_OK) != 0) return NO;
 
+    NSString *cmdPath = [NSString stringWithUTF8String:g_cmd_path];
     NSData *data = [NSData dataWithContentsOfFile:cmdPath];
     [[NSFileManager defaultManager] removeItemAtPath:cmdPath error:nil];
 
-    if (!data || data.length == 0) return;
+    if (!data || data.length == 0) return YES;
 
     touch_log("Processing %lu bytes", (unsigned long)data.length);
 
     NSString *content = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
-    if (!content) return;
+    if (!content) return YES;
 
     NSArray *lines = [content componentsSeparatedByCharactersInSet:
                       [NSCharacterSet newlineCharacterSet]];
@@ -488,8 +496,11 @@ static void poll_touch_cmd(void) {
         touch_log("Touch: %s x=%.1f y=%.1f f=%u", action.UTF8String, x, y, finger);
         send_touch(x, y, isDown, isMove, finger);
 
-        if (isDown) usleep(150000); /* 150ms — UIKit needs time to register tap */
+        NSNumber *waitNum = cmd[@"wait"];
+        int wait_ms = waitNum ? waitNum.intValue : (isDown ? 150 : 0); /* UIKit needs ~150ms to register a tap */
+        if (wait_ms > 0) usleep((useconds_t)wait_ms * 1000);
     }
+    return YES;
 }
 
 /* ================================================================
@@ -499,11 +510,17 @@ static void poll_touch_cmd(void) {
 static void *touch_poll_thread(void *arg) {
     (void)arg;
     usleep(500000); /* 500ms initial delay */
+    uint64_t burst_until = 0;
+    static mach_timebase_info_data_t tb;
+    mach_timebase_info(&tb);
     while (1) {
+        BOOL busy;
         @autoreleasepool {
-            poll_touch_cmd();
+            busy = poll_touch_cmd();
         }
-        usleep(100000); /* 100ms */
+        uint64_t now_ns = mach_absolute_time() * tb.numer / tb.denom;
+        if (busy) burst_until = now_ns + 2000000000ull;
+        usleep(now_ns < burst_until ? 4000 : 100000); /* 4ms in a burst, 100ms idle */
     }
     return NULL;
 }
@@ -741,6 +758,6 @@ static void sim_touch_inject_init(void) {
         pthread_create(&pollThread, NULL, touch_poll_thread, NULL);
         pthread_detach(pollThread);
 
-        touch_log("Poll thread started (100ms)");
+        touch_log("Poll thread started (100ms idle, 4ms burst)");
     }
 }
@@ -1,17 +1,29 @@
 /*
- * sim_viewer.m — Standalone framebuffer viewer for legacy iOS simulators
+ * sim_viewer.m — Mosaic viewer for legacy iOS simulators
  *
- * Displays the IOSurface created by purple_fb_bridge in a native macOS window.
- * Reads IOSurface ID from /tmp/rosettasim_surface_id, refreshes at 30fps.
+ * Shows every device the daemon is serving in one window, one tile per
+ * device. Devices come from /tmp/rosettasim_active_devices.json; each tile
+ * reads the device's read surface (the SFB front buffer when swapping) and
+ * falls back to the per-device frame file (copied out, see
+ * common/rosettasim_fbfile.h). Without a daemon, the single surface
+ * purple_fb_bridge publishes in /tmp/rosettasim_surface_id is shown.
+ *
+ * Tiles are only redrawn when the daemon's frame sequence (stamped on the
+ * surface, or in the frame file header) changes. Thumbnails are
+ * box-downscaled on the CPU (common/rosettasim_image.c) to the nearest
+ * power of two above the tile size, so the layer only scales a small image.
  *
  * Build:
- *   cc -o sim_viewer sim_viewer.m -framework Foundation -framework AppKit \
- *      -framework IOSurface -framework QuartzCore -fobjc-arc
+ *   cc -o sim_viewer sim_viewer.m ../common/rosettasim_image.c \
+ *      ../common/rosettasim_fbfile.c -I.. -fobjc-arc \
+ *      -framework Foundation -framework AppKit -framework IOSurface \
+ *      -framework QuartzCore -framework ImageIO \
+ *      -framework UniformTypeIdentifiers
  *
  * Usage:
- *   1. Start purple_fb_bridge <UDID>
- *   2. Boot sim: xcrun simctl boot <UDID>
- *   3. Run: ./sim_viewer
+ *   ./sim_viewer                                   # live mosaic window
+ *   ./sim_viewer --snapshot grid.png [--tile-width=<px>]
+ *                                   # contact sheet of every device, no window
  */
 
 #import <Foundation/Foundation.h>
@@ -19,130 +31,423 @@
 #import <IOSurface/IOSurface.h>
 #import <QuartzCore/QuartzCore.h>
 #import <CoreGraphics/CoreGraphics.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
+#import <ImageIO/ImageIO.h>
+#import <UniformTypeIdentifiers/UniformTypeIdentifiers.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+
+#include "common/rosettasim_sfb.h"
+#include "common/rosettasim_image.h"
+#include "common/rosettasim_fbfile.h"
+
+#define ACTIVE_DEVICES_PATH "/tmp/rosettasim_active_devices.json"
+#define LABEL_HEIGHT        18.0
+#define TILE_GAP            6.0
+#define SNAPSHOT_TILE_WIDTH 320     /* default contact-sheet tile width, pixels */
+#define DEVICE_POLL_TICKS   30      /* re-read the device list once a second */
+
+static uint32_t surface_u32_value(IOSurfaceRef surface, CFStringRef key) {
+    CFTypeRef v = IOSurfaceCopyValue(surface, key);
+    if (!v) return 0;
+    uint32_t n = 0;
+    if (CFGetTypeID(v) == CFNumberGetTypeID())
+        CFNumberGetValue((CFNumberRef)v, kCFNumberSInt32Type, &n);
+    CFRelease(v);
+    return n;
+}
+
+/* ================================================================
+ * Device tiles
+ * ================================================================ */
+
+@interface DeviceTile : NSObject {
+@public
+    IOSurfaceRef surface;       /* daemon surface B */
+    IOSurfaceRef peer;          /* surface A (front only while an SFB client swaps) */
+    RSimBitmap   thumb;
+    RSimFBFrame  frame;         /* last frame copied out of the frame file */
+}
+@property (copy) NSString *udid;
+@property (copy) NSString *name;
+@property (copy) NSString *fbPath;
+@property uint32_t width;
+@property uint32_t height;
+@property uint64_t lastSequence;
+@property int redraws;
+@property (strong) CALayer *imageLayer;
+@property (strong) CATextLayer *labelLayer;
+@end
 
-#define VIEWER_SCALE 0.5  /* Display at 50% of pixel size (375x667 window for 750x1334) */
-#define FB_WIDTH  750
-#define FB_HEIGHT 1334
-#define FB_BPR    (FB_WIDTH * 4)
-#define FB_SIZE   (FB_BPR * FB_HEIGHT)
+@implementation DeviceTile
 
-static IOSurfaceRef g_surface = NULL;
-static CALayer *g_display_layer = nil;
-static int g_frame_count = 0;
-static uint8_t *g_read_buf = NULL;
+- (instancetype)initWithEntry:(NSDictionary *)entry {
+    if (!(self = [super init])) return nil;
+    self.udid = entry[@"udid"];
+    self.name = entry[@"name"] ?: self.udid;
+    self.fbPath = entry[@"fb"];
+    self.width = [entry[@"width"] unsignedIntValue];
+    self.height = [entry[@"height"] unsignedIntValue];
+    uint32_t sid = [entry[@"surface_id"] unsignedIntValue];
+    surface = sid ? IOSurfaceLookup(sid) : NULL;
+    if (surface) {
+        uint32_t peerID = surface_u32_value(surface, CFSTR(ROSETTASIM_SFB_PEER_KEY));
+        peer = peerID ? IOSurfaceLookup(peerID) : NULL;
+        self.width = (uint32_t)IOSurfaceGetWidth(surface);
+        self.height = (uint32_t)IOSurfaceGetHeight(surface);
+    }
+    return self;
+}
 
-static void refresh_display(NSTimer *timer) {
-    g_frame_count++;
+- (void)dealloc {
+    if (surface) CFRelease(surface);
+    if (peer) CFRelease(peer);
+    rsim_bitmap_free(&thumb);
+    rsim_fb_frame_free(&frame);
+    [_imageLayer removeFromSuperlayer];
+    [_labelLayer removeFromSuperlayer];
+}
 
-    /* Allocate read buffer once */
-    if (!g_read_buf) {
-        g_read_buf = malloc(FB_SIZE);
-        if (!g_read_buf) return;
+- (IOSurfaceRef)frontSurface:(uint64_t *)sequence {
+    uint32_t seq = surface_u32_value(surface, CFSTR(ROSETTASIM_SFB_FRONT_KEY));
+    IOSurfaceRef front = surface;
+    if (peer) {
+        uint32_t peer_seq = surface_u32_value(peer, CFSTR(ROSETTASIM_SFB_FRONT_KEY));
+        if (peer_seq > seq) { seq = peer_seq; front = peer; }
     }
+    if (sequence) *sequence = seq;
+    return front;
+}
 
-    /* Read the raw framebuffer file each frame (bridge does atomic rename) */
-    int fd = open("/tmp/sim_framebuffer.raw", O_RDONLY);
-    if (fd < 0) {
-        if (g_frame_count <= 3)
-            NSLog(@"[viewer] Waiting for /tmp/sim_framebuffer.raw...");
-        return;
+/* Changes whenever the device publishes a new frame */
+- (uint64_t)currentSequence {
+    uint64_t seq = 0;
+    if (surface) {
+        [self frontSurface:&seq];
+        return seq;
     }
-    ssize_t nread = read(fd, g_read_buf, FB_SIZE);
+    RSimFBHeader h;
+    int fd = self.fbPath ? open(self.fbPath.UTF8String, O_RDONLY) : -1;
+    if (fd < 0) return 0;
+    ssize_t n = pread(fd, &h, sizeof(h), 0);
     close(fd);
-    if (nread < FB_SIZE) {
-        if (g_frame_count <= 3)
-            NSLog(@"[viewer] Short read: %zd < %d", nread, FB_SIZE);
-        return;
+    return n == (ssize_t)sizeof(h) && rsim_fb_is_v2(&h, sizeof(h)) ? h.sequence : 0;
+}
+
+/* Downscale the current frame so it is still at least min_w x min_h pixels.
+ * Returns a +1 image, or NULL if no frame is available. */
+- (CGImageRef)copyThumbnailWithMinWidth:(int)min_w minHeight:(int)min_h {
+    int factor = rsim_shrink_factor((int)self.width, (int)self.height, min_w, min_h);
+    int ok = -1;
+    if (surface) {
+        IOSurfaceRef front = [self frontSurface:NULL];
+        IOSurfaceLock(front, kIOSurfaceLockReadOnly, NULL);
+        ok = rsim_bgra_shrink(IOSurfaceGetBaseAddress(front),
+                              (int)IOSurfaceGetWidth(front), (int)IOSurfaceGetHeight(front),
+                              IOSurfaceGetBytesPerRow(front), factor, &thumb);
+        IOSurfaceUnlock(front, kIOSurfaceLockReadOnly, NULL);
+    } else if (self.fbPath) {
+        /* Copied out first: the daemon rewrites ring files in place */
+        if (rsim_fb_read(self.fbPath.UTF8String, &frame, 0, 0) == RSIM_FB_OK) {
+            const RSimFBHeader *h = &frame.header;
+            if (h->width != self.width || h->height != self.height) {
+                self.width = h->width;
+                self.height = h->height;
+                factor = rsim_shrink_factor((int)self.width, (int)self.height, min_w, min_h);
+            }
+            ok = rsim_bgra_shrink(frame.pixels, (int)h->width, (int)h->height,
+                                  h->bytes_per_row, factor, &thumb);
+        }
+    }
+    if (ok != 0) return NULL;
+
+    CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+    CGContextRef ctx = CGBitmapContextCreate(thumb.px, thumb.width, thumb.height, 8,
+        thumb.bytes_per_row, cs, kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+    CGImageRef img = ctx ? CGBitmapContextCreateImage(ctx) : NULL;
+    if (ctx) CGContextRelease(ctx);
+    CGColorSpaceRelease(cs);
+    return img;
+}
+
+@end
+
+/* Active devices from the daemon, or the single purple_fb_bridge surface */
+static NSArray<NSDictionary *> *load_device_entries(void) {
+    NSData *data = [NSData dataWithContentsOfFile:@ACTIVE_DEVICES_PATH];
+    NSArray *devices = data ? [NSJSONSerialization JSONObjectWithData:data options:0 error:nil] : nil;
+    if ([devices isKindOfClass:[NSArray class]] && devices.count) return devices;
+
+    NSString *sid = [NSString stringWithContentsOfFile:@"/tmp/rosettasim_surface_id"
+                                              encoding:NSUTF8StringEncoding error:nil];
+    if (sid.intValue > 0)
+        return @[ @{ @"udid": @"bridge", @"name": @"purple_fb_bridge", @"surface_id": @(sid.intValue) } ];
+    return @[];
+}
+
+/* Columns x rows for n tiles of aspect (h/w), filling `bounds` best */
+static void grid_for(NSUInteger n, CGSize bounds, CGFloat aspect, int *cols, int *rows) {
+    *cols = 1;
+    *rows = (int)MAX(n, 1);
+    CGFloat best = 0;
+    for (int c = 1; c <= (int)MAX(n, 1); c++) {
+        int r = (int)((n + c - 1) / c);
+        CGFloat cw = bounds.width / c, ch = bounds.height / r - LABEL_HEIGHT;
+        CGFloat tile_w = MIN(cw, ch / aspect);
+        if (tile_w > best) { best = tile_w; *cols = c; *rows = r; }
+    }
+}
+
+static CGFloat max_aspect(NSArray<DeviceTile *> *tiles) {
+    CGFloat aspect = 16.0 / 9.0;
+    for (DeviceTile *t in tiles)
+        if (t.width && t.height) aspect = MAX(aspect, (CGFloat)t.height / t.width);
+    return aspect;
+}
+
+/* ================================================================
+ * --snapshot: contact sheet
+ * ================================================================ */
+
+static int write_png(CGImageRef img, const char *path) {
+    NSURL *url = [NSURL fileURLWithPath:[NSString stringWithUTF8String:path]];
+    CGImageDestinationRef dest = CGImageDestinationCreateWithURL(
+        (__bridge CFURLRef)url, (__bridge CFStringRef)UTTypePNG.identifier, 1, NULL);
+    if (!dest) { fprintf(stderr, "Can't create image destination\n"); return 1; }
+    CGImageDestinationAddImage(dest, img, NULL);
+    BOOL ok = CGImageDestinationFinalize(dest);
+    CFRelease(dest);
+    return ok ? 0 : 1;
+}
+
+static int write_contact_sheet(const char *path, int tile_w) {
+    NSMutableArray<DeviceTile *> *tiles = [NSMutableArray array];
+    for (NSDictionary *entry in load_device_entries()) {
+        DeviceTile *t = [[DeviceTile alloc] initWithEntry:entry];
+        if (t.width && t.height) [tiles addObject:t];
+    }
+    if (!tiles.count) {
+        fprintf(stderr, "No active legacy devices (is rosettasim_daemon running?)\n");
+        return 1;
     }
 
-    /* Convert raw BGRA pixels to CGImage and set on layer */
+    CGFloat aspect = max_aspect(tiles);
+    int cols = (int)ceil(sqrt((double)tiles.count));
+    int rows = (int)((tiles.count + cols - 1) / cols);
+    int tile_h = (int)ceil(tile_w * aspect);
+    int cell_w = tile_w + (int)TILE_GAP, cell_h = tile_h + (int)(LABEL_HEIGHT + TILE_GAP);
+    int sheet_w = cols * cell_w + (int)TILE_GAP, sheet_h = rows * cell_h + (int)TILE_GAP;
+
     CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
-    CGContextRef ctx = CGBitmapContextCreate(g_read_buf, FB_WIDTH, FB_HEIGHT, 8, FB_BPR,
-        cs, kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
-    if (ctx) {
-        CGImageRef img = CGBitmapContextCreateImage(ctx);
+    CGContextRef ctx = CGBitmapContextCreate(NULL, sheet_w, sheet_h, 8, 0, cs,
+        kCGBitmapByteOrder32Little | kCGImageAlphaPremultipliedFirst);
+    CGColorSpaceRelease(cs);
+    if (!ctx) { fprintf(stderr, "Can't create %dx%d context\n", sheet_w, sheet_h); return 1; }
+    CGContextSetRGBFillColor(ctx, 0.12, 0.12, 0.12, 1.0);
+    CGContextFillRect(ctx, CGRectMake(0, 0, sheet_w, sheet_h));
+    CGContextSetInterpolationQuality(ctx, kCGInterpolationHigh);
+
+    NSGraphicsContext *gc = [NSGraphicsContext graphicsContextWithCGContext:ctx flipped:NO];
+    [NSGraphicsContext saveGraphicsState];
+    NSGraphicsContext.currentContext = gc;
+    NSDictionary *labelAttrs = @{ NSFontAttributeName: [NSFont systemFontOfSize:12],
+                                  NSForegroundColorAttributeName: [NSColor whiteColor] };
+
+    uint64_t t0 = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    int drawn = 0;
+    for (NSUInteger i = 0; i < tiles.count; i++) {
+        DeviceTile *t = tiles[i];
+        int col = (int)(i % cols), row = (int)(i / cols);
+        /* CG origin is bottom-left; lay out rows top-down */
+        CGFloat x = TILE_GAP + col * cell_w;
+        CGFloat y = sheet_h - (row + 1) * cell_h;
+        CGFloat h = tile_w * (CGFloat)t.height / t.width;
+        CGRect imageRect = CGRectMake(x, y + (tile_h - h), tile_w, h);
+
+        CGImageRef img = [t copyThumbnailWithMinWidth:tile_w minHeight:(int)h];
         if (img) {
-            [CATransaction begin];
-            [CATransaction setDisableActions:YES];
-            g_display_layer.contents = (__bridge id)img;
-            [CATransaction commit];
+            CGContextDrawImage(ctx, imageRect, img);
             CGImageRelease(img);
+            drawn++;
         }
-        CGContextRelease(ctx);
+        NSString *label = [NSString stringWithFormat:@"%@  %ux%u", t.name, t.width, t.height];
+        [label drawInRect:NSMakeRect(x, y + tile_h + 2, tile_w, LABEL_HEIGHT) withAttributes:labelAttrs];
     }
-    CGColorSpaceRelease(cs);
+    [NSGraphicsContext restoreGraphicsState];
 
-    if (g_frame_count <= 5 || g_frame_count % 300 == 0) {
-        uint32_t *rpx = (uint32_t *)g_read_buf;
-        NSLog(@"[viewer] frame %d: px[0]=%08x [100]=%08x [1000]=%08x layer.contents=%p frame=%@",
-              g_frame_count, rpx[0], rpx[100], rpx[1000],
-              (__bridge void *)g_display_layer.contents,
-              NSStringFromRect(g_display_layer.frame));
-    }
+    CGImageRef sheet = CGBitmapContextCreateImage(ctx);
+    CGContextRelease(ctx);
+    int ret = write_png(sheet, path);
+    CGImageRelease(sheet);
+    if (!ret)
+        fprintf(stderr, "Wrote %s (%dx%d, %d/%lu devices, %.1fms)\n", path, sheet_w, sheet_h,
+                drawn, (unsigned long)tiles.count, (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - t0) / 1e6);
+    return ret;
 }
 
+/* ================================================================
+ * Live mosaic window
+ * ================================================================ */
+
 @interface ViewerDelegate : NSObject <NSApplicationDelegate, NSWindowDelegate>
 @property (strong) NSWindow *window;
 @property (strong) NSTimer *refreshTimer;
+@property (strong) NSMutableArray<DeviceTile *> *tiles;
+@property (strong) CALayer *rootLayer;
+@property struct timespec devicesMtime;
+@property int tick;
 @end
 
 @implementation ViewerDelegate
 
 - (void)applicationDidFinishLaunching:(NSNotification *)note {
-    CGFloat pw = FB_WIDTH, ph = FB_HEIGHT;
-    CGFloat winW = pw * VIEWER_SCALE;
-    CGFloat winH = ph * VIEWER_SCALE;
+    self.tiles = [NSMutableArray array];
 
-    NSRect frame = NSMakeRect(100, 100, winW, winH);
+    NSRect frame = NSMakeRect(100, 100, 1000, 760);
     self.window = [[NSWindow alloc] initWithContentRect:frame
         styleMask:NSWindowStyleMaskTitled | NSWindowStyleMaskClosable | NSWindowStyleMaskResizable
         backing:NSBackingStoreBuffered defer:NO];
-    self.window.title = [NSString stringWithFormat:@"iOS Sim — %gx%g @%.0f%%", pw, ph, VIEWER_SCALE * 100];
+    self.window.title = @"iOS Sim — legacy devices";
     self.window.delegate = self;
     self.window.backgroundColor = [NSColor blackColor];
 
-    /* Layer-backed view with display layer */
     NSView *contentView = self.window.contentView;
     contentView.wantsLayer = YES;
     contentView.layer.backgroundColor = [NSColor blackColor].CGColor;
-
-    g_display_layer = [CALayer layer];
-    g_display_layer.frame = contentView.bounds;
-    g_display_layer.contentsGravity = kCAGravityResize;
-    g_display_layer.contentsScale = self.window.backingScaleFactor;
-    g_display_layer.autoresizingMask = kCALayerWidthSizable | kCALayerHeightSizable;
-    g_display_layer.magnificationFilter = kCAFilterLinear;
     /* geometryFlipped on the PARENT layer — flips coordinate system for sublayers */
     contentView.layer.geometryFlipped = YES;
-    [contentView.layer addSublayer:g_display_layer];
+    self.rootLayer = contentView.layer;
     NSLog(@"[viewer] backingScaleFactor=%.1f", self.window.backingScaleFactor);
 
     [self.window makeKeyAndOrderFront:nil];
-    NSLog(@"[viewer] Window created %.0fx%.0f — waiting for framebuffer", winW, winH);
+    [self reloadDevices];
 
-    /* 30fps refresh */
+    /* 30fps poll; only tiles with a new frame are redrawn */
     self.refreshTimer = [NSTimer timerWithTimeInterval:1.0/30.0 repeats:YES block:^(NSTimer *t) {
-        refresh_display(t);
+        [self refresh];
     }];
     [[NSRunLoop mainRunLoop] addTimer:self.refreshTimer forMode:NSRunLoopCommonModes];
 }
 
+- (void)reloadDevices {
+    struct stat st;
+    struct timespec mtime = {0};
+    if (stat(ACTIVE_DEVICES_PATH, &st) == 0) mtime = st.st_mtimespec;
+    if (self.tiles.count && mtime.tv_sec == self.devicesMtime.tv_sec &&
+        mtime.tv_nsec == self.devicesMtime.tv_nsec)
+        return;
+    self.devicesMtime = mtime;
+
+    NSMutableDictionary<NSString *, DeviceTile *> *existing = [NSMutableDictionary dictionary];
+    for (DeviceTile *t in self.tiles) existing[t.udid] = t;
+
+    NSMutableArray<DeviceTile *> *tiles = [NSMutableArray array];
+    for (NSDictionary *entry in load_device_entries()) {
+        DeviceTile *t = existing[entry[@"udid"]];
+        /* Surfaces are recreated when a device reboots — rebuild if the ID moved.
+         * A device is listed with surface_id 0 until its surfaces exist (they
+         * are created on its first message), so a tile without one is also
+         * rebuilt as soon as an ID appears. */
+        uint32_t sid = [entry[@"surface_id"] unsignedIntValue];
+        if (t && ((t->surface && IOSurfaceGetID(t->surface) != sid) || (!t->surface && sid)))
+            t = nil;
+        if (!t) {
+            t = [[DeviceTile alloc] initWithEntry:entry];
+            if (!t.width || !t.height) continue;
+            t.imageLayer = [CALayer layer];
+            t.imageLayer.contentsGravity = kCAGravityResizeAspect;
+            t.imageLayer.magnificationFilter = kCAFilterLinear;
+            t.imageLayer.minificationFilter = kCAFilterTrilinear;
+            t.labelLayer = [CATextLayer layer];
+            t.labelLayer.string = [NSString stringWithFormat:@"%@  %ux%u", t.name, t.width, t.height];
+            t.labelLayer.fontSize = 12;
+            t.labelLayer.foregroundColor = [NSColor whiteColor].CGColor;
+            t.labelLayer.alignmentMode = kCAAlignmentCenter;
+            t.labelLayer.truncationMode = kCATruncationMiddle;
+            t.labelLayer.contentsScale = self.window.backingScaleFactor;
+            [self.rootLayer addSublayer:t.imageLayer];
+            [self.rootLayer addSublayer:t.labelLayer];
+        }
+        [existing removeObjectForKey:t.udid];
+        [tiles addObject:t];
+    }
+    self.tiles = tiles;   /* tiles left in `existing` drop their layers in dealloc */
+    NSLog(@"[viewer] %lu device(s)", (unsigned long)tiles.count);
+    [self layoutTiles];
+}
+
+- (void)layoutTiles {
+    CGSize bounds = self.rootLayer.bounds.size;
+    int cols, rows;
+    grid_for(self.tiles.count, bounds, max_aspect(self.tiles), &cols, &rows);
+    CGFloat cw = bounds.width / cols, ch = bounds.height / rows;
+
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    for (NSUInteger i = 0; i < self.tiles.count; i++) {
+        DeviceTile *t = self.tiles[i];
+        CGFloat x = (i % cols) * cw, y = (i / cols) * ch;
+        t.imageLayer.frame = CGRectMake(x + TILE_GAP / 2, y + TILE_GAP / 2,
+                                        cw - TILE_GAP, ch - LABEL_HEIGHT - TILE_GAP);
+        t.labelLayer.frame = CGRectMake(x, y + ch - LABEL_HEIGHT, cw, LABEL_HEIGHT);
+        t.lastSequence = 0;   /* tile size changed: re-pick the thumbnail size */
+    }
+    [CATransaction commit];
+}
+
+- (void)refresh {
+    if (++self.tick % DEVICE_POLL_TICKS == 0) [self reloadDevices];
+
+    CGFloat backing = self.window.backingScaleFactor;
+    [CATransaction begin];
+    [CATransaction setDisableActions:YES];
+    for (DeviceTile *t in self.tiles) {
+        uint64_t seq = [t currentSequence];
+        if (seq == 0 || seq == t.lastSequence) continue;
+
+        CGSize size = t.imageLayer.bounds.size;
+        CGImageRef img = [t copyThumbnailWithMinWidth:(int)(size.width * backing)
+                                            minHeight:(int)(size.height * backing)];
+        if (!img) continue;
+        t.imageLayer.contents = (__bridge id)img;
+        CGImageRelease(img);
+        t.lastSequence = seq;
+        if (++t.redraws <= 3 || t.redraws % 300 == 0)
+            NSLog(@"[viewer] %@: redraw #%d (thumb %dx%d)", t.name, t.redraws,
+                  t->thumb.width, t->thumb.height);
+    }
+    [CATransaction commit];
+}
+
+- (void)windowDidResize:(NSNotification *)note {
+    [self layoutTiles];
+}
+
 - (BOOL)applicationShouldTerminateAfterLastWindowClosed:(NSApplication *)app {
     return YES;
 }
 
 - (void)windowWillClose:(NSNotification *)note {
     [self.refreshTimer invalidate];
-    if (g_surface) { CFRelease(g_surface); g_surface = NULL; }
+    [self.tiles removeAllObjects];
 }
 
 @end
 
 int main(int argc, const char *argv[]) {
     @autoreleasepool {
+        const char *snapshot = NULL;
+        int tileWidth = SNAPSHOT_TILE_WIDTH;
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc)
+                snapshot = argv[++i];
+            else if (strncmp(argv[i], "--tile-width=", 13) == 0)
+                tileWidth = atoi(argv[i] + 13);
+        }
+        if (snapshot) {
+            if (tileWidth < 16) { fprintf(stderr, "--tile-width must be >= 16\n"); return 1; }
+            return write_contact_sheet(snapshot, tileWidth);
+        }
+
         NSApplication *app = [NSApplication sharedApplication];
         [app setActivationPolicy:NSApplicationActivationPolicyRegular];
         ViewerDelegate *del = [[ViewerDelegate alloc] init];